@@ -43,6 +43,14 @@ void* sailnavsim_boatregistry_free_boats_iterator(void* iterator);
 int32_t sailnavsim_boatregistry_group_add_boat(void* boat_registry, const char* group, const char* boat, const char* boat_altname);
 void sailnavsim_boatregistry_group_remove_boat(void* boat_registry, const char* group, const char* boat);
 
+// Boat entries of all boats in a group (or null if none), to be freed with sailnavsim_boatregistry_free_boat_entries()
+void** sailnavsim_boatregistry_get_group_boat_entries(void* boat_registry, const char* group, uint32_t* count);
+
+// Removes a group and all of its boats (returning their entries, as above)
+void** sailnavsim_boatregistry_remove_group(void* boat_registry, const char* group, uint32_t* count);
+
+void sailnavsim_boatregistry_free_boat_entries(void** entries, uint32_t count);
+
 char* sailnavsim_boatregistry_produce_group_membership_response(void* boat_registry, const char* group);
 void sailnavsim_boatregistry_free_group_membership_response(char* resp);
 
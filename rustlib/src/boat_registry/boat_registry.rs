@@ -20,7 +20,13 @@ use std::os::raw::c_void;
 
 pub struct BoatRegistry {
     boats: HashMap<String, *mut c_void>,
-    boat_groups: HashMap<String, HashMap<String, Option<String>>>,
+    boat_groups: HashMap<String, HashMap<String, GroupMember>>,
+}
+
+// Group member, with its boat entry (so that whole groups can be walked without looking up each boat by name)
+struct GroupMember {
+    altname: Option<String>,
+    entry: *mut c_void,
 }
 
 pub struct BoatRegistryIter<'a> {
@@ -89,16 +95,24 @@ impl BoatRegistry {
 
 
     pub fn add_boat_to_group(&mut self, group: String, boat: String, boat_altname: Option<String>) -> bool {
+        let member = GroupMember {
+            altname: boat_altname,
+            entry: match self.boats.get(&boat) {
+                Some(b) => *b,
+                None => 0 as *mut c_void,
+            },
+        };
+
         match self.boat_groups.get_mut(&group) {
             Some(boat_group) => {
-                match boat_group.insert(boat, boat_altname) {
+                match boat_group.insert(boat, member) {
                     Some(_) => false,
                     None => true,
                 }
             }
             None => {
                 let mut boat_group = HashMap::new();
-                boat_group.insert(boat, boat_altname);
+                boat_group.insert(boat, member);
                 self.boat_groups.insert(group, boat_group);
                 true
             }
@@ -119,14 +133,35 @@ impl BoatRegistry {
         }
     }
 
+    pub fn get_group_boats(&self, group: &String) -> Vec<*mut c_void> {
+        match self.boat_groups.get(group) {
+            Some(boats) => boats.values().map(|m| m.entry).filter(|e| !e.is_null()).collect(),
+            None => Vec::new(),
+        }
+    }
+
+    // Removes a whole group and all of its boats, returning the removed boats' entries.
+    pub fn remove_group(&mut self, group: &String) -> Vec<*mut c_void> {
+        let mut removed = Vec::new();
+        if let Some(boats) = self.boat_groups.remove(group) {
+            removed.reserve(boats.len());
+            for boat in boats.keys() {
+                if let Some(b) = self.boats.remove(boat) {
+                    removed.push(b);
+                }
+            }
+        }
+        removed
+    }
+
     pub fn produce_group_membership_response(&self, group: &String) -> String {
         let mut resp = String::from("");
         match self.boat_groups.get(group) {
             Some(boats) => {
-                for (boat, altname) in boats.iter() {
+                for (boat, member) in boats.iter() {
                     resp.push_str(boat);
                     resp.push_str(",");
-                    resp.push_str(match altname {
+                    resp.push_str(match &member.altname {
                         Some(an) => an,
                         None => "!",
                     });
@@ -230,6 +230,66 @@ pub extern fn sailnavsim_boatregistry_group_remove_boat(boat_registry_raw: *mut
 }
 
 
+#[no_mangle]
+pub extern fn sailnavsim_boatregistry_get_group_boat_entries(boat_registry_raw: *mut c_void, group_raw: *const c_char, count_raw: *mut u32) -> *mut *mut c_void {
+    let boat_registry = unsafe {
+        Box::from_raw(boat_registry_raw as *mut BoatRegistry)
+    };
+
+    let group = unsafe {
+        match CStr::from_ptr(group_raw).to_str() {
+            Ok(s) => String::from(s),
+            Err(_) => String::from(""),
+        }
+    };
+
+    let entries = boat_registry.get_group_boats(&group);
+
+    let _no_drop = Box::into_raw(boat_registry);
+    into_raw_entries(entries, count_raw)
+}
+
+#[no_mangle]
+pub extern fn sailnavsim_boatregistry_remove_group(boat_registry_raw: *mut c_void, group_raw: *const c_char, count_raw: *mut u32) -> *mut *mut c_void {
+    let mut boat_registry = unsafe {
+        Box::from_raw(boat_registry_raw as *mut BoatRegistry)
+    };
+
+    let group = unsafe {
+        match CStr::from_ptr(group_raw).to_str() {
+            Ok(s) => String::from(s),
+            Err(_) => String::from(""),
+        }
+    };
+
+    let entries = boat_registry.remove_group(&group);
+
+    let _no_drop = Box::into_raw(boat_registry);
+    into_raw_entries(entries, count_raw)
+}
+
+#[no_mangle]
+pub unsafe extern fn sailnavsim_boatregistry_free_boat_entries(entries_raw: *mut *mut c_void, count: u32) {
+    if entries_raw != 0 as *mut *mut c_void {
+        let _to_free = Box::from_raw(std::ptr::slice_from_raw_parts_mut(entries_raw, count as usize));
+    }
+}
+
+fn into_raw_entries(entries: Vec<*mut c_void>, count_raw: *mut u32) -> *mut *mut c_void {
+    if count_raw != 0 as *mut u32 {
+        unsafe {
+            *count_raw = entries.len() as u32;
+        }
+    }
+
+    if entries.is_empty() {
+        return 0 as *mut *mut c_void;
+    }
+
+    Box::into_raw(entries.into_boxed_slice()) as *mut *mut c_void
+}
+
+
 #[no_mangle]
 pub extern fn sailnavsim_boatregistry_produce_group_membership_response(boat_registry_raw: *mut c_void, group_raw: *const c_char) -> *mut c_char {
     let boat_registry = unsafe {
@@ -0,0 +1,507 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+
+#include "Affinity.h"
+
+#include "ErrLog.h"
+
+
+#define ERRLOG_ID "Affinity"
+
+// Node masks passed to the kernel (enough for any real machine)
+#define MAX_NUMA_NODES (1024)
+#define NODE_MASK_WORDS (MAX_NUMA_NODES / (8 * sizeof(unsigned long)))
+
+// Exiting threads tracked until they're gone (any more may briefly be counted twice)
+#define MAX_RETIRED_TIDS (64)
+
+
+static const char* ROLE_NAMES[AFFINITY_STATS_ROLE_COUNT] = {
+	"tick",
+	"logger",
+	"command",
+	"net",
+	"ensemble",
+	"other"
+};
+
+static cpu_set_t _cpus[AFFINITY_ROLE_COUNT];
+static bool _set[AFFINITY_ROLE_COUNT] = { false };
+
+// NUMA node of the tick thread's (first) CPU, if NUMA-local allocation is enabled
+static int _tickNode = -1;
+
+static AffinitySchedStats _lastStats[AFFINITY_STATS_ROLE_COUNT];
+
+// Stats of threads that have exited (threads unused), and the threads that may still be listed (skipped while they are)
+static pthread_mutex_t _retiredLock = PTHREAD_MUTEX_INITIALIZER;
+static AffinitySchedStats _retiredStats[AFFINITY_STATS_ROLE_COUNT];
+static pid_t _retiredTids[MAX_RETIRED_TIDS];
+static unsigned int _retiredTidCount = 0;
+
+static int parseCpuList(const char* s, cpu_set_t* cpus);
+static int getCpuNode(int cpu);
+static int getThreadRole(pid_t tid);
+static int readThreadSchedStats(pid_t tid, AffinitySchedStats* stats);
+static bool isRetiredTid(pid_t tid, bool* seen);
+
+
+int Affinity_parse(const char* spec)
+{
+	const char* eq = strchr(spec, '=');
+	if (!eq)
+	{
+		return -1;
+	}
+
+	int role = -1;
+	for (int i = 0; i < AFFINITY_ROLE_COUNT; i++)
+	{
+		if (strlen(ROLE_NAMES[i]) == (size_t) (eq - spec) && 0 == strncmp(ROLE_NAMES[i], spec, eq - spec))
+		{
+			role = i;
+			break;
+		}
+	}
+
+	if (role < 0)
+	{
+		return -2;
+	}
+
+	// Parsed separately, so that a bad spec leaves any CPUs already set for the role as they were.
+	cpu_set_t cpus;
+	if (0 != parseCpuList(eq + 1, &cpus))
+	{
+		return -3;
+	}
+
+	_cpus[role] = cpus;
+	_set[role] = true;
+	return 0;
+}
+
+int Affinity_setNumaLocal()
+{
+	if (!_set[AFFINITY_ROLE_TICK])
+	{
+		ERRLOG("NUMA-local allocation requires the tick thread's CPUs to be set!");
+		return -1;
+	}
+
+	int cpu = 0;
+	while (cpu < CPU_SETSIZE && !CPU_ISSET(cpu, _cpus + AFFINITY_ROLE_TICK))
+	{
+		cpu++;
+	}
+
+	_tickNode = getCpuNode(cpu);
+	if (_tickNode < 0 || _tickNode >= MAX_NUMA_NODES)
+	{
+		ERRLOG1("Failed to find NUMA node of CPU %d!", cpu);
+		_tickNode = -1;
+		return -2;
+	}
+
+	ERRLOG2("Boats and boat log buffers will be allocated on NUMA node %d (of tick CPU %d)", _tickNode, cpu);
+	return 0;
+}
+
+int Affinity_applyToThread(pthread_t thread, int role)
+{
+	if (role < 0 || role >= AFFINITY_ROLE_COUNT || !_set[role])
+	{
+		return 0;
+	}
+
+	const int rc = pthread_setaffinity_np(thread, sizeof(cpu_set_t), _cpus + role);
+	if (0 != rc)
+	{
+		ERRLOG2("Failed to set CPU affinity for %s thread! rc=%d", ROLE_NAMES[role], rc);
+		return -1;
+	}
+
+	return 0;
+}
+
+bool Affinity_isSet(int role)
+{
+	return (role >= 0 && role < AFFINITY_ROLE_COUNT && _set[role]);
+}
+
+const cpu_set_t* Affinity_getCpus(int role)
+{
+	return Affinity_isSet(role) ? _cpus + role : 0;
+}
+
+void Affinity_reset()
+{
+	for (int i = 0; i < AFFINITY_ROLE_COUNT; i++)
+	{
+		_set[i] = false;
+	}
+
+	_tickNode = -1;
+}
+
+void Affinity_preferTickNode(bool prefer)
+{
+	if (_tickNode < 0)
+	{
+		return;
+	}
+
+	unsigned long nodeMask[NODE_MASK_WORDS];
+	memset(nodeMask, 0, sizeof(nodeMask));
+	nodeMask[_tickNode / (8 * sizeof(unsigned long))] = 1UL << (_tickNode % (8 * sizeof(unsigned long)));
+
+	const long rc = prefer ?
+		syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodeMask, (unsigned long) MAX_NUMA_NODES) :
+		syscall(SYS_set_mempolicy, MPOL_DEFAULT, 0, 0UL);
+
+	if (0 != rc)
+	{
+		ERRLOG1("Failed to set memory policy! errno=%d", errno);
+	}
+}
+
+int Affinity_getSchedStats(AffinitySchedStats stats[AFFINITY_STATS_ROLE_COUNT])
+{
+	memset(stats, 0, AFFINITY_STATS_ROLE_COUNT * sizeof(AffinitySchedStats));
+
+	DIR* d = opendir("/proc/self/task");
+	if (!d)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&_retiredLock);
+
+	// Threads that have exited still count, so that totals don't go down.
+	for (int i = 0; i < AFFINITY_STATS_ROLE_COUNT; i++)
+	{
+		stats[i].migrations = _retiredStats[i].migrations;
+		stats[i].voluntarySwitches = _retiredStats[i].voluntarySwitches;
+		stats[i].involuntarySwitches = _retiredStats[i].involuntarySwitches;
+	}
+
+	bool seen[MAX_RETIRED_TIDS] = { false };
+
+	struct dirent* de;
+	while ((de = readdir(d)))
+	{
+		const pid_t tid = atoi(de->d_name);
+		if (tid <= 0 || isRetiredTid(tid, seen))
+		{
+			continue;
+		}
+
+		AffinitySchedStats ts;
+		if (0 != readThreadSchedStats(tid, &ts))
+		{
+			// Thread may have just exited.
+			continue;
+		}
+
+		AffinitySchedStats* s = stats + getThreadRole(tid);
+		s->threads++;
+		s->migrations += ts.migrations;
+		s->voluntarySwitches += ts.voluntarySwitches;
+		s->involuntarySwitches += ts.involuntarySwitches;
+	}
+
+	closedir(d);
+
+	// Retired threads no longer listed are gone for good.
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < _retiredTidCount; i++)
+	{
+		if (seen[i])
+		{
+			_retiredTids[kept++] = _retiredTids[i];
+		}
+	}
+	_retiredTidCount = kept;
+
+	pthread_mutex_unlock(&_retiredLock);
+
+	return 0;
+}
+
+void Affinity_retireThread()
+{
+	const pid_t tid = (pid_t) syscall(SYS_gettid);
+
+	AffinitySchedStats ts;
+	if (0 != readThreadSchedStats(tid, &ts))
+	{
+		return;
+	}
+
+	const int role = getThreadRole(tid);
+
+	pthread_mutex_lock(&_retiredLock);
+
+	_retiredStats[role].migrations += ts.migrations;
+	_retiredStats[role].voluntarySwitches += ts.voluntarySwitches;
+	_retiredStats[role].involuntarySwitches += ts.involuntarySwitches;
+
+	if (_retiredTidCount < MAX_RETIRED_TIDS)
+	{
+		_retiredTids[_retiredTidCount++] = tid;
+	}
+
+	pthread_mutex_unlock(&_retiredLock);
+}
+
+void Affinity_logSchedStats()
+{
+	AffinitySchedStats stats[AFFINITY_STATS_ROLE_COUNT];
+	if (0 != Affinity_getSchedStats(stats))
+	{
+		ERRLOG("Failed to get scheduler stats!");
+		return;
+	}
+
+	char buf[512];
+	int len = 0;
+
+	for (int i = 0; i < AFFINITY_STATS_ROLE_COUNT && len < (int) sizeof(buf); i++)
+	{
+		if (stats[i].threads == 0)
+		{
+			continue;
+		}
+
+		len += snprintf(buf + len, sizeof(buf) - len, "%s%s(%u%s): %ld migr, %ld/%ld sw",
+				len > 0 ? "; " : "",
+				ROLE_NAMES[i],
+				stats[i].threads,
+				(i < AFFINITY_ROLE_COUNT && _set[i]) ? ", pinned" : "",
+				(long) (stats[i].migrations - _lastStats[i].migrations),
+				(long) (stats[i].voluntarySwitches - _lastStats[i].voluntarySwitches),
+				(long) (stats[i].involuntarySwitches - _lastStats[i].involuntarySwitches));
+	}
+
+	ERRLOG1("Sched stats (migrations, voluntary/involuntary context switches) since last: %s", buf);
+
+	memcpy(_lastStats, stats, sizeof(_lastStats));
+}
+
+const char* Affinity_getRoleName(int role)
+{
+	return (role >= 0 && role < AFFINITY_STATS_ROLE_COUNT) ? ROLE_NAMES[role] : "unknown";
+}
+
+
+// Parses a CPU list such as "0-3,8,10-11".
+static int parseCpuList(const char* s, cpu_set_t* cpus)
+{
+	CPU_ZERO(cpus);
+
+	unsigned int count = 0;
+
+	while (*s)
+	{
+		// Only plain digits (strtol would also take whitespace and signs)
+		if (!isdigit((unsigned char) *s))
+		{
+			return -1;
+		}
+
+		char* end;
+		const long first = strtol(s, &end, 10);
+		if (first >= CPU_SETSIZE)
+		{
+			return -1;
+		}
+
+		long last = first;
+		s = end;
+
+		if (*s == '-')
+		{
+			s++;
+			if (!isdigit((unsigned char) *s))
+			{
+				return -1;
+			}
+
+			last = strtol(s, &end, 10);
+			if (last < first || last >= CPU_SETSIZE)
+			{
+				return -1;
+			}
+			s = end;
+		}
+
+		for (long cpu = first; cpu <= last; cpu++)
+		{
+			CPU_SET(cpu, cpus);
+			count++;
+		}
+
+		if (*s == ',' && s[1])
+		{
+			s++;
+		}
+		else if (*s)
+		{
+			// Anything else, or a trailing comma
+			return -1;
+		}
+	}
+
+	return (count > 0) ? 0 : -1;
+}
+
+static int getCpuNode(int cpu)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+	DIR* d = opendir(path);
+	if (!d)
+	{
+		return -1;
+	}
+
+	int node = -1;
+
+	struct dirent* de;
+	while ((de = readdir(d)))
+	{
+		if (0 == strncmp(de->d_name, "node", 4) && de->d_name[4] >= '0' && de->d_name[4] <= '9')
+		{
+			node = atoi(de->d_name + 4);
+			break;
+		}
+	}
+
+	closedir(d);
+	return node;
+}
+
+static int getThreadRole(pid_t tid)
+{
+	if (tid == getpid())
+	{
+		// Main thread runs the ticks.
+		return AFFINITY_ROLE_TICK;
+	}
+
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+
+	char name[32] = { 0 };
+	FILE* f = fopen(path, "r");
+	if (f)
+	{
+		if (!fgets(name, sizeof(name), f))
+		{
+			name[0] = 0;
+		}
+		fclose(f);
+	}
+
+	// By thread names (as set where each thread is created)
+	if (0 == strncmp(name, "Logger", 6))
+	{
+		return AFFINITY_ROLE_LOGGER;
+	}
+	else if (0 == strncmp(name, "Command", 7))
+	{
+		return AFFINITY_ROLE_COMMAND;
+	}
+	else if (0 == strncmp(name, "NetServer", 9) || 0 == strncmp(name, "NSWorker", 8))
+	{
+		return AFFINITY_ROLE_NET;
+	}
+	else if (0 == strncmp(name, "Ensemble", 8))
+	{
+		return AFFINITY_ROLE_ENSEMBLE;
+	}
+
+	return AFFINITY_ROLE_OTHER;
+}
+
+static int readThreadSchedStats(pid_t tid, AffinitySchedStats* stats)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/task/%d/sched", tid);
+
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		return -1;
+	}
+
+	memset(stats, 0, sizeof(AffinitySchedStats));
+
+	char line[256];
+	while (fgets(line, sizeof(line), f))
+	{
+		const char* colon = strchr(line, ':');
+		if (!colon)
+		{
+			continue;
+		}
+
+		const unsigned long v = strtoul(colon + 1, 0, 10);
+
+		if (0 == strncmp(line, "se.nr_migrations ", 17))
+		{
+			stats->migrations = v;
+		}
+		else if (0 == strncmp(line, "nr_voluntary_switches ", 22))
+		{
+			stats->voluntarySwitches = v;
+		}
+		else if (0 == strncmp(line, "nr_involuntary_switches ", 24))
+		{
+			stats->involuntarySwitches = v;
+		}
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static bool isRetiredTid(pid_t tid, bool* seen)
+{
+	for (unsigned int i = 0; i < _retiredTidCount; i++)
+	{
+		if (_retiredTids[i] == tid)
+		{
+			seen[i] = true;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,82 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Affinity_h_
+#define _Affinity_h_
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+
+
+// Thread roles, each of which can be given its own set of CPUs to run on
+#define AFFINITY_ROLE_TICK	(0)
+#define AFFINITY_ROLE_LOGGER	(1)
+#define AFFINITY_ROLE_COMMAND	(2)
+#define AFFINITY_ROLE_NET	(3)
+#define AFFINITY_ROLE_ENSEMBLE	(4)
+#define AFFINITY_ROLE_COUNT	(5)
+
+// All other threads (only for scheduler stats)
+#define AFFINITY_ROLE_OTHER	(5)
+#define AFFINITY_STATS_ROLE_COUNT	(6)
+
+
+typedef struct
+{
+	unsigned int threads;
+
+	unsigned long migrations;
+	unsigned long voluntarySwitches;
+	unsigned long involuntarySwitches;
+} AffinitySchedStats;
+
+
+// Sets the CPUs for a role, from a "role=cpulist" spec (such as "tick=2" or "net=4-7,12-15").
+int Affinity_parse(const char* spec);
+
+// Enables allocating boats and boat log buffers on the NUMA node of the tick thread's CPUs (which must be set).
+int Affinity_setNumaLocal();
+
+// Sets the CPUs a thread runs on to those of its role (if set).
+int Affinity_applyToThread(pthread_t thread, int role);
+
+bool Affinity_isSet(int role);
+
+// The CPUs set for a role (or null if not set).
+const cpu_set_t* Affinity_getCpus(int role);
+
+// Clears the CPUs of all roles (and NUMA-local allocation), as before any were set.
+void Affinity_reset();
+
+// Makes the calling thread's memory allocations prefer the tick thread's NUMA node (or go back to the default, local
+// allocation), if NUMA-local allocation is enabled.
+void Affinity_preferTickNode(bool prefer);
+
+// Scheduler stats totals (since each thread started) per role, from /proc/self/task/*/sched, plus those of threads that
+// have exited (through Affinity_retireThread()).
+int Affinity_getSchedStats(AffinitySchedStats stats[AFFINITY_STATS_ROLE_COUNT]);
+
+// Keeps the calling thread's scheduler stats in its role's totals, as it exits.
+void Affinity_retireThread();
+
+// Logs CPU migrations and context switches per role since the last call.
+void Affinity_logSchedStats();
+
+const char* Affinity_getRoleName(int role);
+
+
+#endif // _Affinity_h_
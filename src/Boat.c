@@ -30,6 +30,7 @@
 #include "Boat.h"
 
 #include "BoatWindResponse.h"
+#include "WindField.h"
 #include "WxUtils.h"
 
 
@@ -38,19 +39,42 @@
 #define STARTING_FROM_LAND_COUNTDOWN (10)
 
 
-static void updateCourse(Boat* b, time_t curTime);
+static bool isHeadingTowardWater(const Boat* b, time_t curTime, const BoatEnv* env);
+static void updateCourse(Boat* b, time_t curTime, const BoatEnv* env, unsigned int* randSeed);
 static void updateVelocity(Boat* b, const proteus_Weather* wx, bool odv, const proteus_OceanData* od, bool wdv, const proteus_WaveData* wd);
-static void updateDamage(Boat* b, double windGust, double windAngle, bool takeDamage);
+static void updateDamage(Boat* b, double windGust, double windAngle, bool takeDamage, const BoatEnv* env);
 static void stopBoat(Boat* b);
-static double getDesiredCourseTrue(const Boat* b, time_t t);
-static double convertMag2True(const proteus_GeoPos* pos, time_t t, double compassMag);
+static void checkZones(Boat* b, const proteus_GeoPos* prevPos);
+static void advanceGhost(Boat* b, time_t curTime);
+static double getDesiredCourseTrue(const Boat* b, time_t t, const BoatEnv* env);
+static double convertMag2True(const proteus_GeoPos* pos, time_t t, double compassMag, const BoatEnv* env);
 static double oceanIceSpeedAdjustmentFactor(bool valid, const proteus_OceanData* od);
 static double boatDamageSpeedAdjustmentFactor(const Boat* b);
 static double waveSpeedAdjustmentFactor(const Boat* b, bool valid, const proteus_WaveData* wd);
-static double getRandDouble(double scale);
+static double getRandDouble(double scale, unsigned int* randSeed);
+
+static bool liveGetOcean(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od);
+static void liveGetWind(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx);
+static bool liveGetWave(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd);
+static bool liveIsWater(void* ctx, const proteus_GeoPos* pos);
+static double liveGetMagDec(void* ctx, const proteus_GeoPos* pos, time_t t);
 
 static unsigned int _randSeed = 0;
 
+// Environment lookups from the live data (as loaded by proteus), with wind from the precomputed wind field if there is one
+static const BoatEnv _liveEnv = {
+	.getOcean = &liveGetOcean,
+	.getWind = &liveGetWind,
+	.getWave = &liveGetWave,
+	.isWater = &liveIsWater,
+	.getMagDec = &liveGetMagDec,
+	.ctx = 0
+};
+
+// Boats are packed together in slab chunks (rather than spread across the heap by add/remove churn).
+#define BOATS_PER_SLAB_CHUNK (1024)
+static Slab _boatSlab = SLAB_INITIALIZER(sizeof(Boat), BOATS_PER_SLAB_CHUNK);
+
 
 int Boat_init()
 {
@@ -60,12 +84,19 @@ int Boat_init()
 
 Boat* Boat_new(double lat, double lon, int boatType, int boatFlags)
 {
-	Boat* boat = malloc(sizeof(Boat));
+	Boat* boat = Slab_alloc(&_boatSlab);
 	if (!boat)
 	{
 		return 0;
 	}
 
+	Boat_initState(boat, lat, lon, boatType, boatFlags);
+
+	return boat;
+}
+
+void Boat_initState(Boat* boat, double lat, double lon, int boatType, int boatFlags)
+{
 	boat->pos.lat = lat;
 	boat->pos.lon = (lon < 180.0 ? lon : lon - 360.0);
 	boat->v.angle = 0.0;
@@ -93,11 +124,50 @@ Boat* Boat_new(double lat, double lon, int boatType, int boatFlags)
 	boat->leewaySpeed = 0.0;
 	boat->heelingAngle = 0.0;
 
-	return boat;
+	boat->zones = 0;
+	boat->inZone = 0;
+	boat->enteredZone = 0;
+
+	boat->ghost.track = 0;
+	boat->ghostTimeOffset = 0;
+}
+
+void Boat_free(Boat* b)
+{
+	if (b && b->ghost.track)
+	{
+		GhostTrack_release(b->ghost.track);
+	}
+
+	Slab_free(&_boatSlab, b);
+}
+
+void Boat_getAllocStats(SlabStats* stats)
+{
+	Slab_getStats(&_boatSlab, stats);
 }
 
 void Boat_advance(Boat* b, time_t curTime)
 {
+	Boat_advanceWithEnv(b, curTime, &_liveEnv, &_randSeed);
+}
+
+const BoatEnv* Boat_getLiveEnv()
+{
+	return &_liveEnv;
+}
+
+void Boat_advanceWithEnv(Boat* b, time_t curTime, const BoatEnv* env, unsigned int* randSeed)
+{
+	b->enteredZone = 0;
+
+	if (b->ghost.track)
+	{
+		// Ghost boat, so just follow the recorded track (without any environment lookups).
+		advanceGhost(b, curTime);
+		return;
+	}
+
 	if (b->stop)
 	{
 		// Stopped, so nowhere to go.
@@ -105,7 +175,7 @@ void Boat_advance(Boat* b, time_t curTime)
 		if (b->damage > 0.0)
 		{
 			// Possibly fix some boat damage.
-			updateDamage(b, -1.0 /* indicates stopped boat */, 0.0, false);
+			updateDamage(b, -1.0 /* indicates stopped boat */, 0.0, false, env);
 		}
 
 		return;
@@ -122,7 +192,7 @@ void Boat_advance(Boat* b, time_t curTime)
 	{
 		// Possibly on land, moving to sea.
 
-		if (proteus_GeoInfo_isWater(&b->pos))
+		if (env->isWater(env->ctx, &b->pos))
 		{
 			// We're on water, so proceed normally.
 			b->movingToSea = false;
@@ -131,17 +201,17 @@ void Boat_advance(Boat* b, time_t curTime)
 			{
 				// Probably the first time the boat is being started,
 				// so set the course to the desired course immediately.
-				b->v.angle = getDesiredCourseTrue(b, curTime);
+				b->v.angle = getDesiredCourseTrue(b, curTime, env);
 				b->setImmediateDesiredCourse = false;
 			}
 		}
 		else
 		{
 			// Not on water, so check that there is water ahead of us.
-			if (Boat_isHeadingTowardWater(b, curTime))
+			if (isHeadingTowardWater(b, curTime, env))
 			{
 				// Water ahead, so proceed at fixed speed toward it.
-				b->v.angle = getDesiredCourseTrue(b, curTime);
+				b->v.angle = getDesiredCourseTrue(b, curTime, env);
 				b->v.mag = 0.5;
 				b->leewaySpeed = 0.0;
 
@@ -159,19 +229,15 @@ void Boat_advance(Boat* b, time_t curTime)
 		}
 	}
 
-	proteus_Weather wx;
-	proteus_Weather_get(&b->pos, &wx, true);
-
 	proteus_OceanData od;
-	const bool oceanDataValid = proteus_Ocean_get(&b->pos, &od);
+	const bool oceanDataValid = env->getOcean(env->ctx, &b->pos, &od);
 
-	if (oceanDataValid)
-	{
-		WxUtils_adjustWindForCurrent(&wx, &od.current);
-	}
+	// Current-adjusted wind
+	proteus_Weather wx;
+	env->getWind(env->ctx, &b->pos, true, oceanDataValid ? &od : 0, &wx);
 
 	proteus_WaveData wd;
-	const bool waveDataValid = proteus_Wave_get(&b->pos, &wd);
+	const bool waveDataValid = env->getWave(env->ctx, &b->pos, &wd);
 
 	const bool advancedBoatType = BoatWindResponse_isBoatTypeAdvanced(b->boatType);
 
@@ -189,7 +255,7 @@ void Boat_advance(Boat* b, time_t curTime)
 		}
 
 		// With sails down, we do not take any additional damage, but we can still repair it.
-		updateDamage(b, wx.windGust, windVec->angle, false);
+		updateDamage(b, wx.windGust, windVec->angle, false, env);
 
 		// NOTE: While sails are down, we intentionally do not take into account the boat damage speed adjustment factor.
 		b->v.mag = windVec->mag * 0.1 *
@@ -200,10 +266,10 @@ void Boat_advance(Boat* b, time_t curTime)
 	{
 		// Update boat damage.
 		const bool takeDamage = (!advancedBoatType || b->sailArea > 0.0); // For advanced boat types, only take additional damage if some sail is up.
-		updateDamage(b, wx.windGust, wx.wind.angle, takeDamage);
+		updateDamage(b, wx.windGust, wx.wind.angle, takeDamage, env);
 
 		// Update course, if necessary.
-		updateCourse(b, curTime);
+		updateCourse(b, curTime, env, randSeed);
 
 		// Update boat velocity.
 		updateVelocity(b, &wx, oceanDataValid, &od, waveDataValid, &wd);
@@ -260,6 +326,8 @@ void Boat_advance(Boat* b, time_t curTime)
 		b->startingFromLandCount--;
 	}
 
+	const proteus_GeoPos prevPos = b->pos;
+
 	// Advance boat by "over ground" vector.
 	proteus_GeoPos_advance(&b->pos, &b->vGround);
 
@@ -267,36 +335,37 @@ void Boat_advance(Boat* b, time_t curTime)
 	b->distanceTravelled += b->vGround.mag;
 
 	// Finally, check if we're still in water.
-	if (!proteus_GeoInfo_isWater(&b->pos))
+	if (!env->isWater(env->ctx, &b->pos))
 	{
 		// We're on land, so stop the boat and reset the land countdown value.
 		stopBoat(b);
 		b->startingFromLandCount = STARTING_FROM_LAND_COUNTDOWN;
 	}
+	else if (b->zones)
+	{
+		checkZones(b, &prevPos);
+	}
 }
 
-bool Boat_isHeadingTowardWater(const Boat* b, time_t curTime)
+void Boat_startGhost(Boat* b, const GhostTrack* track, time_t startTime)
 {
-	int d = 0;
-
-	proteus_GeoPos pos = b->pos;
-
-	proteus_GeoVec v;
-	v.angle = getDesiredCourseTrue(b, curTime);
-	v.mag = 10.0;
-
-	while (d <= MOVE_TO_WATER_DISTANCE + 10)
+	b->boatFlags |= BOAT_FLAG_GHOST;
+	b->ghostTimeOffset = startTime - GhostTrack_getStartTime(track);
+	GhostTrack_retain(track);
+	if (b->ghost.track)
 	{
-		if (proteus_GeoInfo_isWater(&pos))
-		{
-			return true;
-		}
-
-		proteus_GeoPos_advance(&pos, &v);
-		d += 10;
+		GhostTrack_release(b->ghost.track);
 	}
+	GhostTrack_initCursor(&b->ghost, track);
 
-	return false;
+	b->stop = false;
+	GhostTrack_position(&b->ghost, startTime - b->ghostTimeOffset, &b->pos, &b->vGround);
+	b->v = b->vGround;
+}
+
+bool Boat_isHeadingTowardWater(const Boat* b, time_t curTime)
+{
+	return isHeadingTowardWater(b, curTime, &_liveEnv);
 }
 
 bool Boat_getWaveAdjustedCelestialAzAlt(const Boat* b, double* az, double* alt)
@@ -319,7 +388,7 @@ bool Boat_getWaveAdjustedCelestialAzAlt(const Boat* b, double* az, double* alt)
 	const double wh = wd.waveHeight;
 	const double wer = BoatWindResponse_getWaveEffectResistance(b->boatType);
 
-	double newAlt = *alt + (1.666667 * getRandDouble(wh) * getRandDouble(wh) / wer);
+	double newAlt = *alt + (1.666667 * getRandDouble(wh, &_randSeed) * getRandDouble(wh, &_randSeed) / wer);
 	if (newAlt < 0.0)
 	{
 		// Adjusted altitude is below horizon.
@@ -330,7 +399,7 @@ bool Boat_getWaveAdjustedCelestialAzAlt(const Boat* b, double* az, double* alt)
 		newAlt = 90.0 - (newAlt - 90.0);
 	}
 
-	double newAz = *az + (100.0 * getRandDouble(wh) * getRandDouble(wh) / wer);
+	double newAz = *az + (100.0 * getRandDouble(wh, &_randSeed) * getRandDouble(wh, &_randSeed) / wer);
 	while (newAz < 0.0)
 	{
 		newAz += 360.0;
@@ -347,9 +416,33 @@ bool Boat_getWaveAdjustedCelestialAzAlt(const Boat* b, double* az, double* alt)
 }
 
 
-static void updateCourse(Boat* b, time_t curTime)
+static bool isHeadingTowardWater(const Boat* b, time_t curTime, const BoatEnv* env)
 {
-	const double desiredCourseTrue = getDesiredCourseTrue(b, curTime);
+	int d = 0;
+
+	proteus_GeoPos pos = b->pos;
+
+	proteus_GeoVec v;
+	v.angle = getDesiredCourseTrue(b, curTime, env);
+	v.mag = 10.0;
+
+	while (d <= MOVE_TO_WATER_DISTANCE + 10)
+	{
+		if (env->isWater(env->ctx, &pos))
+		{
+			return true;
+		}
+
+		proteus_GeoPos_advance(&pos, &v);
+		d += 10;
+	}
+
+	return false;
+}
+
+static void updateCourse(Boat* b, time_t curTime, const BoatEnv* env, unsigned int* randSeed)
+{
+	const double desiredCourseTrue = getDesiredCourseTrue(b, curTime, env);
 	const double courseDiff = proteus_Compass_diff(b->v.angle, desiredCourseTrue);
 	const double courseChangeRate = BoatWindResponse_getCourseChangeRate(b->boatType);
 
@@ -375,7 +468,7 @@ static void updateCourse(Boat* b, time_t curTime)
 	{
 		// Within a degree of being opposite where we want to go,
 		// so choose a direction at random.
-		if (rand_r(&_randSeed) % 2 == 0)
+		if (rand_r(randSeed) % 2 == 0)
 		{
 			// Turn left.
 			b->v.angle -= courseChangeRate;
@@ -466,7 +559,7 @@ static void updateVelocity(Boat* b, const proteus_Weather* wx, bool odv, const p
 #define DAMAGE_TAKE_FACTOR (0.25 * KTS_IN_MPS * KTS_IN_MPS / 3600.0) // 0.25% (to max damage) per hour per knot squared above threshold.
 #define DAMAGE_REPAIR_FACTOR (0.25 * KTS_IN_MPS / 3600.0) // 0.25% per hour per knot below threshold.
 
-static void updateDamage(Boat* b, double windGust, double windAngle, bool takeDamage)
+static void updateDamage(Boat* b, double windGust, double windAngle, bool takeDamage, const BoatEnv* env)
 {
 	if ((b->boatFlags & BOAT_FLAG_TAKES_DAMAGE) == 0)
 	{
@@ -477,7 +570,7 @@ static void updateDamage(Boat* b, double windGust, double windAngle, bool takeDa
 	if (windGust < 0.0)
 	{
 		proteus_Weather wx;
-		proteus_Weather_get(&b->pos, &wx, true);
+		env->getWind(env->ctx, &b->pos, false, 0, &wx);
 
 		// NOTE: No need to adjust wind for ocean currents here
 		//       since windGust < 0.0 indicates "stopped" boat.
@@ -551,11 +644,11 @@ static void stopBoat(Boat* b)
 	// FIXME: Should probably also set Boat.started to 0 in the database (if we're using it).
 }
 
-static double getDesiredCourseTrue(const Boat* b, time_t t)
+static double getDesiredCourseTrue(const Boat* b, time_t t, const BoatEnv* env)
 {
 	if (b->courseMagnetic)
 	{
-		return convertMag2True(&b->pos, t, b->desiredCourse);
+		return convertMag2True(&b->pos, t, b->desiredCourse, env);
 	}
 	else
 	{
@@ -563,9 +656,9 @@ static double getDesiredCourseTrue(const Boat* b, time_t t)
 	}
 }
 
-static double convertMag2True(const proteus_GeoPos* pos, time_t t, double compassMag)
+static double convertMag2True(const proteus_GeoPos* pos, time_t t, double compassMag, const BoatEnv* env)
 {
-	const double magDec = proteus_Compass_magdec(pos, t);
+	const double magDec = env->getMagDec(env->ctx, pos, t);
 
 	double compassTrue = compassMag + magDec;
 	if (compassTrue < 0.0)
@@ -610,7 +703,89 @@ static double waveSpeedAdjustmentFactor(const Boat* b, bool valid, const proteus
 	return 1.0;
 }
 
-static double getRandDouble(double scale)
+static double getRandDouble(double scale, unsigned int* randSeed)
+{
+	return ((double) ((rand_r(randSeed) % 257) - 128)) / 128.0 * scale;
+}
+
+static void checkZones(Boat* b, const proteus_GeoPos* prevPos)
+{
+	const Zone* zone = Zones_find(b->zones, &b->pos);
+
+	if (zone && Zones_getAction(zone) == ZONE_ACTION_STOP)
+	{
+		// Not allowed in, so stay at the boundary.
+		b->pos = *prevPos;
+		b->distanceTravelled -= b->vGround.mag;
+		stopBoat(b);
+
+		b->enteredZone = zone;
+		return;
+	}
+
+	if (zone && zone != b->inZone)
+	{
+		b->enteredZone = zone;
+	}
+
+	b->inZone = zone;
+}
+
+static void advanceGhost(Boat* b, time_t curTime)
+{
+	if (b->stop)
+	{
+		return;
+	}
+
+	if (!GhostTrack_position(&b->ghost, curTime - b->ghostTimeOffset, &b->pos, &b->vGround))
+	{
+		// Reached the end of the recorded track.
+		b->stop = true;
+	}
+
+	b->v = b->vGround;
+	b->distanceTravelled += b->vGround.mag;
+}
+
+static bool liveGetOcean(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od)
+{
+	(void) ctx;
+	return proteus_Ocean_get(pos, od);
+}
+
+static void liveGetWind(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx)
+{
+	(void) ctx;
+
+	// Current-adjusted wind from the precomputed wind field, if there is one
+	if (adjustForCurrent && WindField_get(pos, wx, 0))
+	{
+		return;
+	}
+
+	proteus_Weather_get(pos, wx, true);
+
+	if (adjustForCurrent && od)
+	{
+		WxUtils_adjustWindForCurrent(wx, &od->current);
+	}
+}
+
+static bool liveGetWave(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd)
+{
+	(void) ctx;
+	return proteus_Wave_get(pos, wd);
+}
+
+static bool liveIsWater(void* ctx, const proteus_GeoPos* pos)
+{
+	(void) ctx;
+	return proteus_GeoInfo_isWater(pos);
+}
+
+static double liveGetMagDec(void* ctx, const proteus_GeoPos* pos, time_t t)
 {
-	return ((double) ((rand_r(&_randSeed) % 257) - 128)) / 128.0 * scale;
+	(void) ctx;
+	return proteus_Compass_magdec(pos, t);
 }
@@ -21,6 +21,13 @@
 
 #include <proteus/GeoVec.h>
 #include <proteus/GeoPos.h>
+#include <proteus/Ocean.h>
+#include <proteus/Wave.h>
+#include <proteus/Weather.h>
+
+#include "GhostTrack.h"
+#include "Slab.h"
+#include "Zones.h"
 
 
 #define BOAT_FLAG_TAKES_DAMAGE			(0x0001)
@@ -29,6 +36,7 @@
 #define BOAT_FLAG_CELESTIAL_WAVE_EFFECT		(0x0008)
 #define BOAT_FLAG_DAMAGE_APPARENT_WIND		(0x0010)
 #define BOAT_FLAG_LIVE_SHARING_HIDDEN		(0x0020)
+#define BOAT_FLAG_GHOST				(0x0040)
 
 
 typedef struct
@@ -64,13 +72,61 @@ typedef struct
 	double sailArea;
 	double leewaySpeed;
 	double heelingAngle;
+
+	// Exclusion zones of the boat's group (if any), the zone it is currently within, and a zone entered during the last advance
+	const ZoneSet* zones;
+	const Zone* inZone;
+	const Zone* enteredZone;
+
+	// Recorded track followed by ghost boats, and the offset from track time to simulation time
+	GhostCursor ghost;
+	time_t ghostTimeOffset;
 } Boat;
 
+// Environment lookups used in advancing boats (each passed ctx as its first argument)
+typedef struct
+{
+	// Ocean data at a position, returning whether there is any
+	bool (*getOcean)(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od);
+
+	// Wind at a position, adjusted for the ocean current (od, if non-null) if adjustForCurrent is set
+	void (*getWind)(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx);
+
+	// Wave data at a position, returning whether there is any
+	bool (*getWave)(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd);
+
+	bool (*isWater)(void* ctx, const proteus_GeoPos* pos);
+
+	// Magnetic declination (degrees) at a position and time
+	double (*getMagDec)(void* ctx, const proteus_GeoPos* pos, time_t t);
+
+	void* ctx;
+} BoatEnv;
+
 
 int Boat_init();
 
 Boat* Boat_new(double lat, double lon, int boatType, int boatFlags);
+
+// Sets up boat state (as for a new boat) in caller-owned memory.
+void Boat_initState(Boat* b, double lat, double lon, int boatType, int boatFlags);
+
+// Frees a boat from Boat_new() (ignoring null).
+void Boat_free(Boat* b);
+
+void Boat_getAllocStats(SlabStats* stats);
+
 void Boat_advance(Boat* b, time_t curTime);
+
+// Advances a boat by one second, as Boat_advance() does, but with the given environment lookups and random number
+// state rather than the daemon's (so that boats can be advanced on any number of threads, each with its own state).
+void Boat_advanceWithEnv(Boat* b, time_t curTime, const BoatEnv* env, unsigned int* randSeed);
+
+// Environment lookups from the live data (as loaded by proteus), as used by Boat_advance().
+const BoatEnv* Boat_getLiveEnv();
+
+// Turns a new boat into a ghost boat replaying a recorded track, with the start of the track at startTime.
+void Boat_startGhost(Boat* b, const GhostTrack* track, time_t startTime);
 bool Boat_isHeadingTowardWater(const Boat* b, time_t curTime);
 bool Boat_getWaveAdjustedCelestialAzAlt(const Boat* b, double* az, double* alt);
 
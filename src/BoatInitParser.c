@@ -15,6 +15,8 @@
  */
 
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,13 +31,34 @@
 #define ERRLOG_ID "BoatInitParser"
 
 
+// Boats read from the Boat table at a time
+#define SQL_BATCH_SIZE (256)
+
+// Column of the Boat select statement holding the rowid
+#define SQL_BOAT_ROWID_COLUMN (8)
+
+// How long DB reads wait on a writer (such as the Logger committing) before failing
+#define SQL_BUSY_TIMEOUT_MS (10000)
+
+
 static int startSql(const char* sqliteDbFilename);
 static BoatInitEntry* getNextSql();
+static void readBatchSql();
+static BoatInitEntry* readEntrySql();
+static void endSql();
 
 static sqlite3* _sql = 0;
 static sqlite3_stmt* _sqlStmtBoat;
 static sqlite3_stmt* _sqlStmtBoatLog;
 
+// Entries of the batch read last (and the next to return), the rowid the next batch starts after, and whether there
+// may be more
+static BoatInitEntry* _sqlEntries[SQL_BATCH_SIZE];
+static unsigned int _sqlEntryCount;
+static unsigned int _sqlEntryPos;
+static sqlite3_int64 _sqlLastRowid;
+static bool _sqlMore;
+
 
 static int startFile(const char* boatInitFilename);
 static BoatInitEntry* getNextFile();
@@ -72,6 +95,14 @@ BoatInitEntry* BoatInitParser_getNext()
 	return 0;
 }
 
+void BoatInitParser_freeEntry(BoatInitEntry* entry)
+{
+	free(entry->name);
+	free(entry->group);
+	free(entry->boatAltName);
+	free(entry);
+}
+
 
 static int startSql(const char* sqliteDbFilename)
 {
@@ -99,7 +130,7 @@ static int startSql(const char* sqliteDbFilename)
 		fclose(fdb);
 	}
 
-	static const char* SELECT_BOAT_STMT_STR = "SELECT name, race, desiredCourse, started, boatType, boatFlags, friendlyName, sailArea FROM Boat WHERE isActive = 1;";
+	static const char* SELECT_BOAT_STMT_STR = "SELECT name, race, desiredCourse, started, boatType, boatFlags, friendlyName, sailArea, rowid FROM Boat WHERE isActive = 1 AND rowid > ? ORDER BY rowid LIMIT ?;";
 	static const char* SELECT_BOATLOG_STMT_STR = "SELECT lat, lon, courseWater, speedWater, boatStatus, boatLocation, distanceTravelled, damage, leewaySpeed, heelingAngle FROM BoatLog WHERE boatName=? ORDER BY time DESC LIMIT 1;";
 
 	int src;
@@ -110,6 +141,12 @@ static int startSql(const char* sqliteDbFilename)
 		return -1;
 	}
 
+	if (SQLITE_OK != (src = sqlite3_busy_timeout(_sql, SQL_BUSY_TIMEOUT_MS)))
+	{
+		ERRLOG1("Failed to set SQLite busy timeout. sqlite rc=%d", src);
+		return -1;
+	}
+
 	if (SQLITE_OK != (src = sqlite3_prepare_v2(_sql, SELECT_BOAT_STMT_STR, strlen(SELECT_BOAT_STMT_STR) + 1, &_sqlStmtBoat, 0)))
 	{
 		ERRLOG1("Failed to prepare Boat select statement. sqlite rc=%d", src);
@@ -134,274 +171,337 @@ static int startSql(const char* sqliteDbFilename)
 		return -1;
 	}
 
+	_sqlEntryCount = 0;
+	_sqlEntryPos = 0;
+	_sqlLastRowid = INT64_MIN;
+	_sqlMore = true;
+
 	return 0;
 }
 
 static BoatInitEntry* getNextSql()
 {
-	for (;;)
+	while (_sqlEntryPos == _sqlEntryCount)
+	{
+		if (!_sqlMore)
+		{
+			endSql();
+			return 0;
+		}
+
+		readBatchSql();
+	}
+
+	return _sqlEntries[_sqlEntryPos++];
+}
+
+// Reads the next (up to SQL_BATCH_SIZE) boats, then resets the statements, so that the DB is only read-locked while a
+// batch is read (and writers, like the Logger, can commit in between batches).
+static void readBatchSql()
+{
+	_sqlEntryCount = 0;
+	_sqlEntryPos = 0;
+
+	int src;
+
+	if (SQLITE_OK != (src = sqlite3_bind_int64(_sqlStmtBoat, 1, _sqlLastRowid)) ||
+			SQLITE_OK != (src = sqlite3_bind_int(_sqlStmtBoat, 2, SQL_BATCH_SIZE)))
+	{
+		ERRLOG1("Failed to bind Boat select statement! sqlite rc=%d", src);
+		_sqlMore = false;
+		return;
+	}
+
+	unsigned int rows = 0;
+
+	while (SQLITE_ROW == (src = sqlite3_step(_sqlStmtBoat)))
+	{
+		rows++;
+		_sqlLastRowid = sqlite3_column_int64(_sqlStmtBoat, SQL_BOAT_ROWID_COLUMN);
+
+		BoatInitEntry* entry = readEntrySql();
+		if (entry)
+		{
+			_sqlEntries[_sqlEntryCount++] = entry;
+		}
+	}
+
+	if (SQLITE_DONE != src)
+	{
+		ERRLOG1("Failed to step Boat select statement! sqlite rc=%d", src);
+		_sqlMore = false;
+	}
+	else
+	{
+		_sqlMore = (rows == SQL_BATCH_SIZE);
+	}
+
+	// (Return codes are those of the last step, already handled.)
+	sqlite3_reset(_sqlStmtBoatLog);
+	sqlite3_reset(_sqlStmtBoat);
+}
+
+// Makes an entry of the Boat row just stepped to (along with its last BoatLog row, or its race start if none).
+static BoatInitEntry* readEntrySql()
+{
+	int src;
+
+	int n = 0;
+
+	const char* boatName = (const char*) sqlite3_column_text(_sqlStmtBoat, n++);
+	const char* race = (const char*) sqlite3_column_text(_sqlStmtBoat, n++);
+	const double desiredCourse = sqlite3_column_double(_sqlStmtBoat, n++);
+	const int started = sqlite3_column_int(_sqlStmtBoat, n++);
+	const int boatType = sqlite3_column_int(_sqlStmtBoat, n++);
+	const int boatFlags = sqlite3_column_int(_sqlStmtBoat, n++);
+	const char* boatFriendlyName = (const char*) sqlite3_column_text(_sqlStmtBoat, n++);
+	const double sailArea = sqlite3_column_double(_sqlStmtBoat, n++);
+
+	src = sqlite3_reset(_sqlStmtBoatLog);
+	if (src != SQLITE_OK)
+	{
+		ERRLOG1("Failed to reset BoatLog statement! sqlite rc=%d", src);
+		return 0;
+	}
+
+	src = sqlite3_bind_text(_sqlStmtBoatLog, 1, boatName, -1, 0);
+	if (src != SQLITE_OK)
 	{
-		int src = sqlite3_step(_sqlStmtBoat);
-		if (src == SQLITE_DONE)
+		ERRLOG1("Failed to bind boat name to BoatLog statement! sqlite rc=%d", src);
+		return 0;
+	}
+
+	src = sqlite3_step(_sqlStmtBoatLog);
+	if (src == SQLITE_ROW)
+	{
+		int n = 0;
+
+		const double lat = sqlite3_column_double(_sqlStmtBoatLog, n++);
+		const double lon = sqlite3_column_double(_sqlStmtBoatLog, n++);
+		const double course = sqlite3_column_double(_sqlStmtBoatLog, n++);
+		const double speed = sqlite3_column_double(_sqlStmtBoatLog, n++);
+		const int boatStatus = sqlite3_column_int(_sqlStmtBoatLog, n++);
+		const int boatLocation = sqlite3_column_int(_sqlStmtBoatLog, n++);
+		const double distanceTravelled = sqlite3_column_double(_sqlStmtBoatLog, n++);
+		const double damage = sqlite3_column_double(_sqlStmtBoatLog, n++);
+		const double leewaySpeed = sqlite3_column_double(_sqlStmtBoatLog, n++);
+		const double heelingAngle = sqlite3_column_double(_sqlStmtBoatLog, n++);
+
+		BoatInitEntry* entry = malloc(sizeof(BoatInitEntry));
+		if (!entry)
+		{
+			ERRLOG("Failed to alloc BoatInitEntry!");
+			return 0;
+		}
+
+		Boat* boat = Boat_new(lat, lon, boatType, boatFlags);
+		if (!boat)
 		{
-			if (SQLITE_OK != (src = sqlite3_finalize(_sqlStmtBoat)))
-			{
-				ERRLOG1("Failed to finalize Boat statement! sqlite rc=%d", src);
-			}
-			_sqlStmtBoat = 0;
-
-			if (SQLITE_OK != (src = sqlite3_finalize(_sqlStmtBoatLog)))
-			{
-				ERRLOG1("Failed to finalize BoatLog statement! sqlite rc=%d", src);
-			}
-			_sqlStmtBoatLog = 0;
-
-			if (SQLITE_OK != (src = sqlite3_close(_sql)))
-			{
-				ERRLOG1("Failed to close SQLite DB! sqlite rc=%d", src);
-			}
-			_sql = 0;
+			ERRLOG("Failed to create new Boat!");
+			free(entry);
+			entry = 0;
+			return 0;
+		}
+
+		boat->v.angle = course;
+		boat->v.mag = speed;
+		boat->desiredCourse = desiredCourse;
+		boat->distanceTravelled = distanceTravelled;
+		boat->damage = damage;
+		boat->stop = (boatStatus == 0 && started == 0);
+		boat->sailsDown = (BoatWindResponse_isBoatTypeBasic(boatType) && boatLocation == 0 && started == 0);
+		boat->movingToSea = (boatLocation == 1 && started == 1);
+		boat->sailArea = sailArea;
+		boat->leewaySpeed = leewaySpeed;
+		boat->heelingAngle = heelingAngle;
+
+		if (boat->stop)
+		{
+			boat->v.mag = 0.0;
+		}
+
+		entry->boat = boat;
+
+		entry->name = strdup(boatName);
+		if (!entry->name)
+		{
+			ERRLOG("Failed to alloc entry->name!");
+
+			free(entry);
+			entry = 0;
+			Boat_free(boat);
+			boat = 0;
 
 			return 0;
 		}
-		else if (src == SQLITE_ROW)
+
+		entry->group = strdup(race);
+		if (!entry->group)
 		{
-			int n = 0;
-
-			const char* boatName = (const char*) sqlite3_column_text(_sqlStmtBoat, n++);
-			const char* race = (const char*) sqlite3_column_text(_sqlStmtBoat, n++);
-			const double desiredCourse = sqlite3_column_double(_sqlStmtBoat, n++);
-			const int started = sqlite3_column_int(_sqlStmtBoat, n++);
-			const int boatType = sqlite3_column_int(_sqlStmtBoat, n++);
-			const int boatFlags = sqlite3_column_int(_sqlStmtBoat, n++);
-			const char* boatFriendlyName = (const char*) sqlite3_column_text(_sqlStmtBoat, n++);
-			const double sailArea = sqlite3_column_double(_sqlStmtBoat, n++);
-
-			src = sqlite3_reset(_sqlStmtBoatLog);
-			if (src != SQLITE_OK)
-			{
-				ERRLOG1("Failed to reset BoatLog statement! sqlite rc=%d", src);
-				continue;
-			}
-
-			src = sqlite3_bind_text(_sqlStmtBoatLog, 1, boatName, -1, 0);
-			if (src != SQLITE_OK)
-			{
-				ERRLOG1("Failed to bind boat name to BoatLog statement! sqlite rc=%d", src);
-				continue;
-			}
-
-			src = sqlite3_step(_sqlStmtBoatLog);
-			if (src == SQLITE_ROW)
-			{
-				int n = 0;
-
-				const double lat = sqlite3_column_double(_sqlStmtBoatLog, n++);
-				const double lon = sqlite3_column_double(_sqlStmtBoatLog, n++);
-				const double course = sqlite3_column_double(_sqlStmtBoatLog, n++);
-				const double speed = sqlite3_column_double(_sqlStmtBoatLog, n++);
-				const int boatStatus = sqlite3_column_int(_sqlStmtBoatLog, n++);
-				const int boatLocation = sqlite3_column_int(_sqlStmtBoatLog, n++);
-				const double distanceTravelled = sqlite3_column_double(_sqlStmtBoatLog, n++);
-				const double damage = sqlite3_column_double(_sqlStmtBoatLog, n++);
-				const double leewaySpeed = sqlite3_column_double(_sqlStmtBoatLog, n++);
-				const double heelingAngle = sqlite3_column_double(_sqlStmtBoatLog, n++);
-
-				BoatInitEntry* entry = malloc(sizeof(BoatInitEntry));
-				if (!entry)
-				{
-					ERRLOG("Failed to alloc BoatInitEntry!");
-					continue;
-				}
-
-				Boat* boat = Boat_new(lat, lon, boatType, boatFlags);
-				if (!boat)
-				{
-					ERRLOG("Failed to create new Boat!");
-					free(entry);
-					entry = 0;
-					continue;
-				}
-
-				boat->v.angle = course;
-				boat->v.mag = speed;
-				boat->desiredCourse = desiredCourse;
-				boat->distanceTravelled = distanceTravelled;
-				boat->damage = damage;
-				boat->stop = (boatStatus == 0 && started == 0);
-				boat->sailsDown = (BoatWindResponse_isBoatTypeBasic(boatType) && boatLocation == 0 && started == 0);
-				boat->movingToSea = (boatLocation == 1 && started == 1);
-				boat->sailArea = sailArea;
-				boat->leewaySpeed = leewaySpeed;
-				boat->heelingAngle = heelingAngle;
-
-				if (boat->stop)
-				{
-					boat->v.mag = 0.0;
-				}
-
-				entry->boat = boat;
-
-				entry->name = strdup(boatName);
-				if (!entry->name)
-				{
-					ERRLOG("Failed to alloc entry->name!");
-
-					free(entry);
-					entry = 0;
-					free(boat);
-					boat = 0;
-
-					continue;
-				}
-
-				entry->group = strdup(race);
-				if (!entry->group)
-				{
-					ERRLOG("Failed to alloc entry->group!");
-
-					free(entry->name);
-					entry->name = 0;
-					free(entry);
-					entry = 0;
-					free(boat);
-					boat = 0;
-
-					continue;
-				}
-
-				entry->boatAltName = strdup(boatFriendlyName);
-				if (!entry->boatAltName)
-				{
-					ERRLOG("Failed to alloc entry->boatAltName!");
-
-					free(entry->group);
-					entry->group = 0;
-					free(entry->name);
-					entry->name = 0;
-					free(entry);
-					entry = 0;
-					free(boat);
-					boat = 0;
-
-					continue;
-				}
-
-				return entry;
-			}
-			else if (src == SQLITE_DONE)
-			{
-				// Boat that exists in the Boat table but has nothing logged yet, so assume it was newly added.
-
-				BoatInitEntry* entry = 0;
-
-				sqlite3_stmt* stmt;
-				static const char* SELECT_FROM_BOATRACE_STMT_STR = "SELECT startLat, startLon FROM BoatRace WHERE name=?;";
-
-				src = sqlite3_prepare_v2(_sql, SELECT_FROM_BOATRACE_STMT_STR, strlen(SELECT_FROM_BOATRACE_STMT_STR) + 1, &stmt, 0);
-				if (SQLITE_OK != src)
-				{
-					ERRLOG1("Failed to prepare statement! sqlite rc=%d", src);
-					continue;
-				}
-
-				src = sqlite3_bind_text(stmt, 1, race, -1, 0);
-				if (SQLITE_OK != src)
-				{
-					ERRLOG1("Failed to bind race value to statement! sqlite rc=%d", src);
-					goto cleanup;
-				}
-
-				src = sqlite3_step(stmt);
-				if (SQLITE_ROW != src)
-				{
-					ERRLOG1("Did not find race! sqlite rc=%d", src);
-					goto cleanup;
-				}
-
-				const double lat = sqlite3_column_double(stmt, 0);
-				const double lon = sqlite3_column_double(stmt, 1);
-
-				entry = malloc(sizeof(BoatInitEntry));
-				if (!entry)
-				{
-					ERRLOG("Failed to alloc BoatInitEntry!");
-					goto cleanup;
-				}
-
-				Boat* boat = Boat_new(lat, lon, boatType, boatFlags);
-				if (!boat)
-				{
-					ERRLOG("Failed to create new Boat!");
-					free(entry);
-					entry = 0;
-					goto cleanup;
-				}
-
-				entry->boat = boat;
-
-				entry->name = strdup(boatName);
-				if (!entry->name)
-				{
-					ERRLOG("Failed to alloc entry->name!");
-
-					free(entry);
-					entry = 0;
-					free(boat);
-					boat = 0;
-
-					goto cleanup;
-				}
-
-				entry->group = strdup(race);
-				if (!entry->group)
-				{
-					ERRLOG("Failed to alloc entry->group!");
-
-					free(entry->name);
-					entry->name = 0;
-					free(entry);
-					entry = 0;
-					free(boat);
-					boat = 0;
-
-					goto cleanup;
-				}
-
-				entry->boatAltName = strdup(boatFriendlyName);
-				if (!entry->boatAltName)
-				{
-					ERRLOG("Failed to alloc entry->boatAltName!");
-
-					free(entry->group);
-					entry->group = 0;
-					free(entry->name);
-					entry->name = 0;
-					free(entry);
-					entry = 0;
-					free(boat);
-					boat = 0;
-
-					goto cleanup;
-				}
+			ERRLOG("Failed to alloc entry->group!");
+
+			free(entry->name);
+			entry->name = 0;
+			free(entry);
+			entry = 0;
+			Boat_free(boat);
+			boat = 0;
+
+			return 0;
+		}
+
+		entry->boatAltName = strdup(boatFriendlyName);
+		if (!entry->boatAltName)
+		{
+			ERRLOG("Failed to alloc entry->boatAltName!");
+
+			free(entry->group);
+			entry->group = 0;
+			free(entry->name);
+			entry->name = 0;
+			free(entry);
+			entry = 0;
+			Boat_free(boat);
+			boat = 0;
+
+			return 0;
+		}
+
+		return entry;
+	}
+	else if (src == SQLITE_DONE)
+	{
+		// Boat that exists in the Boat table but has nothing logged yet, so assume it was newly added.
+
+		BoatInitEntry* entry = 0;
+
+		sqlite3_stmt* stmt;
+		static const char* SELECT_FROM_BOATRACE_STMT_STR = "SELECT startLat, startLon FROM BoatRace WHERE name=?;";
+
+		src = sqlite3_prepare_v2(_sql, SELECT_FROM_BOATRACE_STMT_STR, strlen(SELECT_FROM_BOATRACE_STMT_STR) + 1, &stmt, 0);
+		if (SQLITE_OK != src)
+		{
+			ERRLOG1("Failed to prepare statement! sqlite rc=%d", src);
+			return 0;
+		}
+
+		src = sqlite3_bind_text(stmt, 1, race, -1, 0);
+		if (SQLITE_OK != src)
+		{
+			ERRLOG1("Failed to bind race value to statement! sqlite rc=%d", src);
+			goto cleanup;
+		}
+
+		src = sqlite3_step(stmt);
+		if (SQLITE_ROW != src)
+		{
+			ERRLOG1("Did not find race! sqlite rc=%d", src);
+			goto cleanup;
+		}
+
+		const double lat = sqlite3_column_double(stmt, 0);
+		const double lon = sqlite3_column_double(stmt, 1);
+
+		entry = malloc(sizeof(BoatInitEntry));
+		if (!entry)
+		{
+			ERRLOG("Failed to alloc BoatInitEntry!");
+			goto cleanup;
+		}
+
+		Boat* boat = Boat_new(lat, lon, boatType, boatFlags);
+		if (!boat)
+		{
+			ERRLOG("Failed to create new Boat!");
+			free(entry);
+			entry = 0;
+			goto cleanup;
+		}
+
+		entry->boat = boat;
+
+		entry->name = strdup(boatName);
+		if (!entry->name)
+		{
+			ERRLOG("Failed to alloc entry->name!");
+
+			free(entry);
+			entry = 0;
+			Boat_free(boat);
+			boat = 0;
+
+			goto cleanup;
+		}
+
+		entry->group = strdup(race);
+		if (!entry->group)
+		{
+			ERRLOG("Failed to alloc entry->group!");
+
+			free(entry->name);
+			entry->name = 0;
+			free(entry);
+			entry = 0;
+			Boat_free(boat);
+			boat = 0;
+
+			goto cleanup;
+		}
+
+		entry->boatAltName = strdup(boatFriendlyName);
+		if (!entry->boatAltName)
+		{
+			ERRLOG("Failed to alloc entry->boatAltName!");
+
+			free(entry->group);
+			entry->group = 0;
+			free(entry->name);
+			entry->name = 0;
+			free(entry);
+			entry = 0;
+			Boat_free(boat);
+			boat = 0;
+
+			goto cleanup;
+		}
 
 cleanup:
-				src = sqlite3_finalize(stmt);
-				if (SQLITE_OK != src)
-				{
-					ERRLOG1("Failed to finalize statement! sqlite rc=%d", src);
-					continue;
-				}
-
-				if (entry)
-				{
-					return entry;
-				}
-			}
+		src = sqlite3_finalize(stmt);
+		if (SQLITE_OK != src)
+		{
+			ERRLOG1("Failed to finalize statement! sqlite rc=%d", src);
 		}
+
+		return entry;
+	}
+
+	return 0;
+}
+
+static void endSql()
+{
+	int src;
+
+	if (SQLITE_OK != (src = sqlite3_finalize(_sqlStmtBoat)))
+	{
+		ERRLOG1("Failed to finalize Boat statement! sqlite rc=%d", src);
+	}
+	_sqlStmtBoat = 0;
+
+	if (SQLITE_OK != (src = sqlite3_finalize(_sqlStmtBoatLog)))
+	{
+		ERRLOG1("Failed to finalize BoatLog statement! sqlite rc=%d", src);
 	}
+	_sqlStmtBoatLog = 0;
+
+	if (SQLITE_OK != (src = sqlite3_close(_sql)))
+	{
+		ERRLOG1("Failed to close SQLite DB! sqlite rc=%d", src);
+	}
+	_sql = 0;
 }
 
+
 static int startFile(const char* boatInitFilename)
 {
 	if (!boatInitFilename)
@@ -467,6 +567,7 @@ static BoatInitEntry* getNextFile()
 		entry->boat = boat;
 		entry->name = name;
 		entry->group = 0; // NOTE: Boat add with group from CSV not currently supported.
+		entry->boatAltName = 0;
 
 		return entry;
 	}
@@ -31,5 +31,8 @@ typedef struct
 int BoatInitParser_start(const char* boatInitFilename, const char* sqliteDbFilename);
 BoatInitEntry* BoatInitParser_getNext();
 
+// Frees an entry (but not its boat, which is either added to the registry or freed separately).
+void BoatInitParser_freeEntry(BoatInitEntry* entry);
+
 
 #endif // _BoatInitParser_h_
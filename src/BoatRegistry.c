@@ -22,6 +22,9 @@
 
 #include "BoatRegistry.h"
 #include "ErrLog.h"
+#include "Probes.h"
+#include "Slab.h"
+#include "Zones.h"
 
 
 #define ERRLOG_ID "BoatRegistry"
@@ -31,7 +34,44 @@ static pthread_rwlock_t _lock = PTHREAD_RWLOCK_INITIALIZER;
 static void* _boatRegistry = 0;
 
 
+// Boat entry, with its name, group and alt name stored inline (one after another, as far as they fit), in one cache-aligned record
+#define ENTRY_RECORD_SIZE (128)
+#define ENTRY_INLINE_NAMES_SIZE (ENTRY_RECORD_SIZE - sizeof(BoatEntry))
+#define ENTRIES_PER_SLAB_CHUNK (1024)
+
+typedef struct
+{
+	BoatEntry entry;
+	char names[ENTRY_INLINE_NAMES_SIZE];
+} EntryRecord;
+
+static Slab _entrySlab = SLAB_INITIALIZER(sizeof(EntryRecord), ENTRIES_PER_SLAB_CHUNK);
+
+
+// Entries removed with whole groups, waiting to be freed (along with their boats) outside the lock
+typedef struct RemovedGroup RemovedGroup;
+
+struct RemovedGroup
+{
+	BoatEntry** entries;
+	unsigned int count;
+
+	RemovedGroup* next;
+};
+
+static RemovedGroup* _removed = 0;
+
+static bool _coldTier = false;
+
+// Boats moved between the hot and cold tiers (only changed with the write lock held)
+static unsigned long _promotions = 0;
+static unsigned long _demotions = 0;
+
+
 static BoatEntry* findBoatEntry(const char* name);
+static char* storeName(EntryRecord* rec, size_t* used, const char* s);
+static void freeEntry(BoatEntry* e);
+static void freeBoatState(BoatEntry* e);
 
 
 int BoatRegistry_init()
@@ -62,38 +102,52 @@ int BoatRegistry_add(Boat* boat, const char* name, const char* group, const char
 		return BoatRegistry_EXISTS;
 	}
 
-	BoatEntry* newEntry = malloc(sizeof(BoatEntry));
-	if (!newEntry)
+	EntryRecord* rec = Slab_alloc(&_entrySlab);
+	if (!rec)
 	{
 		ERRLOG("Failed to alloc BoatEntry!");
 		return BoatRegistry_FAILED;
 	}
 
-	newEntry->name = strdup(name);
+	BoatEntry* newEntry = &rec->entry;
+	size_t used = 0;
+
+	newEntry->group = 0;
+	newEntry->altName = 0;
+
+	newEntry->name = storeName(rec, &used, name);
 	if (!newEntry->name)
 	{
 		ERRLOG("Failed to alloc newEntry->name!");
-		free(newEntry);
+		freeEntry(newEntry);
 		return BoatRegistry_FAILED;
 	}
 
 	if (group)
 	{
-		newEntry->group = strdup(group);
+		newEntry->group = storeName(rec, &used, group);
 		if (!newEntry->group)
 		{
 			ERRLOG("Failed to alloc newEntry->group!");
-			free(newEntry->name);
-			free(newEntry);
+			freeEntry(newEntry);
 			return BoatRegistry_FAILED;
 		}
 	}
-	else
+
+	// Alt name only applies to boats in a group.
+	if (group && boatAltName)
 	{
-		newEntry->group = 0;
+		newEntry->altName = storeName(rec, &used, boatAltName);
+		if (!newEntry->altName)
+		{
+			ERRLOG("Failed to alloc newEntry->altName!");
+			freeEntry(newEntry);
+			return BoatRegistry_FAILED;
+		}
 	}
 
 	newEntry->boat = boat;
+	newEntry->cold = 0;
 
 	int rc;
 
@@ -101,12 +155,7 @@ int BoatRegistry_add(Boat* boat, const char* name, const char* group, const char
 	{
 		ERRLOG1("Failed to add boat to boat registry! rc=%d", rc);
 
-		free(newEntry->name);
-		if (newEntry->group)
-		{
-			free(newEntry->group);
-		}
-		free(newEntry);
+		freeEntry(newEntry);
 
 		return BoatRegistry_FAILED;
 	}
@@ -121,23 +170,23 @@ int BoatRegistry_add(Boat* boat, const char* name, const char* group, const char
 			ERRLOG("Unexpected unequal removed BoatEntry compared to local BoatEntry!");
 		}
 
-		free(newEntry->name);
-		if (newEntry->group)
-		{
-			free(newEntry->group);
-		}
-		free(newEntry);
+		freeEntry(newEntry);
 
 		return BoatRegistry_FAILED;
 	}
 
+	if (_coldTier)
+	{
+		BoatRegistry_demote(newEntry);
+	}
+
 	return BoatRegistry_OK;
 }
 
 Boat* BoatRegistry_get(const char* name)
 {
-	const BoatEntry* e = findBoatEntry(name);
-	return (e != 0) ? e->boat : 0;
+	BoatEntry* e = findBoatEntry(name);
+	return (e != 0) ? BoatRegistry_promote(e) : 0;
 }
 
 const BoatEntry* BoatRegistry_getBoatEntry(const char* name)
@@ -153,19 +202,181 @@ Boat* BoatRegistry_remove(const char* name)
 		return 0;
 	}
 
-	Boat* boat = e->boat;
+	// Removed boats are handed back in full state.
+	Boat* boat = BoatRegistry_promote(e);
+	if (!boat)
+	{
+		ColdBoat_free(e->cold);
+	}
 
-	free(e->name);
 	if (e->group)
 	{
 		sailnavsim_boatregistry_group_remove_boat(_boatRegistry, e->group, name);
-		free(e->group);
 	}
-	free(e);
+	freeEntry(e);
 
 	return boat;
 }
 
+BoatEntry** BoatRegistry_getGroupEntries(const char* group, unsigned int* count)
+{
+	uint32_t n = 0;
+	BoatEntry** entries = (BoatEntry**) sailnavsim_boatregistry_get_group_boat_entries(_boatRegistry, group, &n);
+
+	*count = n;
+	return entries;
+}
+
+void BoatRegistry_freeGroupEntries(BoatEntry** entries, unsigned int count)
+{
+	sailnavsim_boatregistry_free_boat_entries((void**) entries, count);
+}
+
+unsigned int BoatRegistry_removeGroup(const char* group)
+{
+	uint32_t count = 0;
+	BoatEntry** entries = (BoatEntry**) sailnavsim_boatregistry_remove_group(_boatRegistry, group, &count);
+	if (!entries)
+	{
+		return 0;
+	}
+
+	RemovedGroup* r = malloc(sizeof(RemovedGroup));
+	if (!r)
+	{
+		// Can't defer, so free them right away.
+		ERRLOG("Failed to alloc RemovedGroup!");
+		for (uint32_t i = 0; i < count; i++)
+		{
+			freeBoatState(entries[i]);
+			freeEntry(entries[i]);
+		}
+		sailnavsim_boatregistry_free_boat_entries((void**) entries, count);
+
+		return count;
+	}
+
+	r->entries = entries;
+	r->count = count;
+	r->next = _removed;
+	_removed = r;
+
+	return count;
+}
+
+void BoatRegistry_freeRemoved()
+{
+	while (_removed)
+	{
+		RemovedGroup* r = _removed;
+		_removed = r->next;
+
+		for (unsigned int i = 0; i < r->count; i++)
+		{
+			freeBoatState(r->entries[i]);
+			freeEntry(r->entries[i]);
+		}
+
+		sailnavsim_boatregistry_free_boat_entries((void**) r->entries, r->count);
+		free(r);
+	}
+}
+
+void BoatRegistry_getAllocStats(SlabStats* stats)
+{
+	Slab_getStats(&_entrySlab, stats);
+}
+
+const Boat* BoatRegistry_view(const BoatEntry* e, Boat* scratch)
+{
+	if (e->boat)
+	{
+		return e->boat;
+	}
+
+	ColdBoat_decode(e->cold, 0, scratch);
+	return scratch;
+}
+
+Boat* BoatRegistry_promote(BoatEntry* e)
+{
+	if (e->boat)
+	{
+		return e->boat;
+	}
+
+	Boat* boat = Boat_new(0.0, 0.0, 0, 0);
+	if (!boat)
+	{
+		ERRLOG("Failed to alloc boat for promotion!");
+		return 0;
+	}
+
+	ColdBoat_decode(e->cold, ColdBoat_hasZones(e->cold) ? Zones_getGroupZones(e->group) : 0, boat);
+
+	ColdBoat_free(e->cold);
+	e->cold = 0;
+	e->boat = boat;
+
+	_promotions++;
+
+	return boat;
+}
+
+bool BoatRegistry_demote(BoatEntry* e)
+{
+	if (!e->boat)
+	{
+		return true;
+	}
+
+	if (!ColdBoat_canDemote(e->boat))
+	{
+		return false;
+	}
+
+	ColdBoat* cold = ColdBoat_new();
+	if (!cold)
+	{
+		// Just stays hot.
+		return false;
+	}
+
+	ColdBoat_encode(e->boat, cold);
+
+	Boat_free(e->boat);
+	e->boat = 0;
+	e->cold = cold;
+
+	_demotions++;
+
+	return true;
+}
+
+void BoatRegistry_setColdTier(bool enabled)
+{
+	_coldTier = enabled;
+}
+
+void BoatRegistry_getTierStats(BoatRegistryTierStats* stats)
+{
+	SlabStats s;
+
+	Boat_getAllocStats(&s);
+	stats->hotCount = s.liveCount;
+	stats->hotBytes = s.bytes;
+
+	ColdBoat_getAllocStats(&s);
+	stats->coldCount = s.liveCount;
+	stats->coldBytes = s.bytes;
+
+	Slab_getStats(&_entrySlab, &s);
+	stats->entryBytes = s.bytes;
+
+	stats->promotions = _promotions;
+	stats->demotions = _demotions;
+}
+
 
 const char* BoatRegistry_getBoatsInGroupResponse(const char* group)
 {
@@ -180,23 +391,31 @@ void BoatRegistry_freeBoatsInGroupResponse(const char* resp)
 
 int BoatRegistry_rdlock()
 {
+	PROBE1(registry_lock_wait_start, 0);
+
 	if (0 != pthread_rwlock_rdlock(&_lock))
 	{
 		ERRLOG("Failed to lock for read!");
 		return BoatRegistry_FAILED;
 	}
 
+	PROBE1(registry_lock_acquired, 0);
+
 	return BoatRegistry_OK;
 }
 
 int BoatRegistry_wrlock()
 {
+	PROBE1(registry_lock_wait_start, 1);
+
 	if (0 != pthread_rwlock_wrlock(&_lock))
 	{
 		ERRLOG("Failed to lock for write!");
 		return BoatRegistry_FAILED;
 	}
 
+	PROBE1(registry_lock_acquired, 1);
+
 	return BoatRegistry_OK;
 }
 
@@ -216,3 +435,41 @@ static BoatEntry* findBoatEntry(const char* name)
 {
 	return sailnavsim_boatregistry_get_boat_entry(_boatRegistry, name);
 }
+
+// Copies a string into the record's inline names if there's room left (and otherwise onto the heap).
+static char* storeName(EntryRecord* rec, size_t* used, const char* s)
+{
+	const size_t len = strlen(s) + 1;
+	if (len > ENTRY_INLINE_NAMES_SIZE - *used)
+	{
+		return strdup(s);
+	}
+
+	char* p = rec->names + *used;
+	memcpy(p, s, len);
+	*used += len;
+
+	return p;
+}
+
+static void freeEntry(BoatEntry* e)
+{
+	EntryRecord* rec = (EntryRecord*) e;
+	char* const names[] = { e->name, e->group, e->altName };
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (names[i] && (names[i] < rec->names || names[i] >= rec->names + ENTRY_INLINE_NAMES_SIZE))
+		{
+			free(names[i]);
+		}
+	}
+
+	Slab_free(&_entrySlab, rec);
+}
+
+static void freeBoatState(BoatEntry* e)
+{
+	Boat_free(e->boat);
+	ColdBoat_free(e->cold);
+}
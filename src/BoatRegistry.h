@@ -18,6 +18,7 @@
 #define _BoatRegistry_h_
 
 #include "Boat.h"
+#include "ColdBoat.h"
 
 
 #define BoatRegistry_OK		(0)
@@ -32,18 +33,67 @@ struct BoatEntry
 {
 	char* name;
 	char* group;
+	char* altName;
+
+	// Full boat state, or (with boat null) the compact state of an idle boat demoted to the cold tier
 	Boat* boat;
+	ColdBoat* cold;
 };
 
+typedef struct
+{
+	// Boats in full (hot) and compact (cold) state, and the memory taken by each (in slab chunks)
+	unsigned long hotCount;
+	unsigned long coldCount;
+	size_t hotBytes;
+	size_t coldBytes;
+
+	// Registry entries (with names), for all boats
+	size_t entryBytes;
+
+	unsigned long promotions;
+	unsigned long demotions;
+} BoatRegistryTierStats;
+
 int BoatRegistry_init();
 void BoatRegistry_destroy();
 void* BoatRegistry_registry();
 
+// With the cold tier on, an idle boat is demoted as soon as it's added (so the boat passed in is freed).
 int BoatRegistry_add(Boat* boat, const char* name, const char* group, const char* boatAltName);
+// Gets a boat for changing it, promoting it to full state first if it's cold (so needs the write lock).
 Boat* BoatRegistry_get(const char* name);
 const BoatEntry* BoatRegistry_getBoatEntry(const char* name);
 Boat* BoatRegistry_remove(const char* name);
 
+// Full state of an entry's boat for reading: the boat itself, or if it's cold, its state expanded into scratch (without
+// its exclusion zones).
+const Boat* BoatRegistry_view(const BoatEntry* e, Boat* scratch);
+
+// Promotes an entry's boat to full state if it's cold, returning the boat (or null on failure). Needs the write lock.
+Boat* BoatRegistry_promote(BoatEntry* e);
+
+// Demotes an entry's boat to compact state if it's idle, returning whether it's cold. Needs the write lock.
+bool BoatRegistry_demote(BoatEntry* e);
+
+// Turns on demotion of idle boats as they're added (off by default).
+void BoatRegistry_setColdTier(bool enabled);
+
+void BoatRegistry_getTierStats(BoatRegistryTierStats* stats);
+
+// Boat entries (with names) allocated from the registry's slab
+void BoatRegistry_getAllocStats(SlabStats* stats);
+
+// Entries of all boats in a group (or null if none), without looking up each boat by name, to be freed (just the array)
+// with BoatRegistry_freeGroupEntries().
+BoatEntry** BoatRegistry_getGroupEntries(const char* group, unsigned int* count);
+void BoatRegistry_freeGroupEntries(BoatEntry** entries, unsigned int count);
+
+// Removes all boats in a group at once, returning how many were removed. The removed boats and their entries are only
+// freed by BoatRegistry_freeRemoved(), which can be called after unlocking.
+unsigned int BoatRegistry_removeGroup(const char* group);
+void BoatRegistry_freeRemoved();
+
 const char* BoatRegistry_getBoatsInGroupResponse(const char* group);
 void BoatRegistry_freeBoatsInGroupResponse(const char* resp);
 
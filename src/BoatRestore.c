@@ -0,0 +1,266 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "BoatRestore.h"
+
+#include "Affinity.h"
+#include "BoatInitParser.h"
+#include "BoatRegistry.h"
+#include "ErrLog.h"
+#include "Zones.h"
+
+
+#define ERRLOG_ID "BoatRestore"
+#define THREAD_NAME "BoatRestore"
+
+
+typedef struct Batch
+{
+	struct Batch* next;
+
+	unsigned int count;
+
+	// Next entry to publish
+	unsigned int pos;
+
+	BoatInitEntry* entries[BOAT_RESTORE_BATCH_SIZE];
+} Batch;
+
+
+static void* restoreThreadMain(void* arg);
+static void queueBatch(Batch* batch, bool last);
+
+static BoatRestoreFilter _filter = 0;
+
+// Batches read but not yet published, and whether the restore thread is done reading
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static Batch* _head = 0;
+static Batch* _tail = 0;
+static bool _readDone = false;
+
+// Batch being published (only touched by the publishing thread)
+static Batch* _current = 0;
+
+static atomic_bool _restoring = false;
+static atomic_ulong _restored = 0;
+static atomic_ulong _skipped = 0;
+static atomic_ulong _published = 0;
+
+
+int BoatRestore_start(const char* boatInitFilename, const char* sqliteDbFilename, BoatRestoreFilter filter)
+{
+	if (atomic_load(&_restoring))
+	{
+		ERRLOG("Boat restore already running!");
+		return -1;
+	}
+
+	const int initRc = BoatInitParser_start(boatInitFilename, sqliteDbFilename);
+	if (initRc != 0)
+	{
+		return initRc;
+	}
+
+	_filter = filter;
+	_readDone = false;
+	atomic_store(&_restored, 0);
+	atomic_store(&_skipped, 0);
+	atomic_store(&_published, 0);
+	atomic_store(&_restoring, true);
+
+	pthread_t thread;
+	if (0 != pthread_create(&thread, 0, &restoreThreadMain, 0))
+	{
+		ERRLOG("Failed to start boat restore thread!");
+		atomic_store(&_restoring, false);
+		return -2;
+	}
+
+	if (0 != pthread_setname_np(thread, THREAD_NAME))
+	{
+		ERRLOG("Failed to set boat restore thread name!");
+	}
+
+	pthread_detach(thread);
+
+	return 0;
+}
+
+unsigned int BoatRestore_publish(unsigned int max)
+{
+	if (!atomic_load(&_restoring))
+	{
+		return 0;
+	}
+
+	unsigned int n = 0;
+	bool done = false;
+
+	while (n < max)
+	{
+		if (!_current)
+		{
+			pthread_mutex_lock(&_lock);
+
+			if ((_current = _head))
+			{
+				if (!(_head = _current->next))
+				{
+					_tail = 0;
+				}
+			}
+			else
+			{
+				done = _readDone;
+			}
+
+			pthread_mutex_unlock(&_lock);
+
+			if (!_current)
+			{
+				// Nothing more read yet (or at all).
+				break;
+			}
+		}
+
+		while (n < max && _current->pos < _current->count)
+		{
+			BoatInitEntry* be = _current->entries[_current->pos++];
+
+			int rc;
+			if (BoatRegistry_OK != (rc = BoatRegistry_add(be->boat, be->name, be->group, be->boatAltName)))
+			{
+				ERRLOG2("Failed to add restored boat %s to registry! rc=%d", be->name, rc);
+				Boat_free(be->boat);
+			}
+			else
+			{
+				atomic_fetch_add(&_published, 1);
+			}
+
+			BoatInitParser_freeEntry(be);
+			n++;
+		}
+
+		if (_current->pos == _current->count)
+		{
+			free(_current);
+			_current = 0;
+		}
+	}
+
+	if (done)
+	{
+		atomic_store(&_restoring, false);
+	}
+
+	return n;
+}
+
+bool BoatRestore_isRestoring()
+{
+	return atomic_load(&_restoring);
+}
+
+void BoatRestore_getStats(BoatRestoreStats* stats)
+{
+	stats->done = !atomic_load(&_restoring);
+	stats->restored = atomic_load(&_restored);
+	stats->skipped = atomic_load(&_skipped);
+	stats->published = atomic_load(&_published);
+}
+
+
+static void* restoreThreadMain(void* arg)
+{
+	(void) arg;
+
+	// Boats restored here are allocated on the tick thread's NUMA node (if enabled), since that's where they're used.
+	Affinity_preferTickNode(true);
+
+	Batch* batch = 0;
+
+	BoatInitEntry* be;
+	while ((be = BoatInitParser_getNext()) != 0)
+	{
+		atomic_fetch_add(&_restored, 1);
+
+		if (_filter && !_filter(be->name, be->group))
+		{
+			Boat_free(be->boat);
+			BoatInitParser_freeEntry(be);
+			atomic_fetch_add(&_skipped, 1);
+			continue;
+		}
+
+		be->boat->zones = Zones_getGroupZones(be->group);
+
+		if (!batch)
+		{
+			if (!(batch = malloc(sizeof(Batch))))
+			{
+				ERRLOG("Failed to alloc restore batch!");
+				Boat_free(be->boat);
+				BoatInitParser_freeEntry(be);
+				continue;
+			}
+
+			batch->next = 0;
+			batch->count = 0;
+			batch->pos = 0;
+		}
+
+		batch->entries[batch->count++] = be;
+
+		if (batch->count == BOAT_RESTORE_BATCH_SIZE)
+		{
+			queueBatch(batch, false);
+			batch = 0;
+		}
+	}
+
+	queueBatch(batch, true);
+
+	return 0;
+}
+
+// Hands a batch (if any) over for publishing, along with whether it's the last one.
+static void queueBatch(Batch* batch, bool last)
+{
+	pthread_mutex_lock(&_lock);
+
+	if (batch)
+	{
+		if (_tail)
+		{
+			_tail->next = batch;
+		}
+		else
+		{
+			_head = batch;
+		}
+		_tail = batch;
+	}
+
+	_readDone = last;
+
+	pthread_mutex_unlock(&_lock);
+}
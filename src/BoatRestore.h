@@ -0,0 +1,66 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _BoatRestore_h_
+#define _BoatRestore_h_
+
+#include <stdbool.h>
+
+
+// Background boat restore: boats are read (from the boat init data) on a thread of their own, in batches, while the
+// tick thread publishes them to the registry a batch at a time (so that boats restored so far are advanced, and
+// requests served, while the rest are still being read).
+
+// Boats read before a batch is handed over for publishing
+#define BOAT_RESTORE_BATCH_SIZE (1024)
+
+// Most boats published in one tick
+#define BOAT_RESTORE_PUBLISH_MAX (100000)
+
+
+// Whether a restored boat (by name and group) is to be added to the registry (rather than freed)
+typedef bool (*BoatRestoreFilter)(const char* name, const char* group);
+
+typedef struct
+{
+	// Boats read so far, and those of them skipped (by filter)
+	unsigned long restored;
+	unsigned long skipped;
+
+	// Boats added to the registry so far
+	unsigned long published;
+
+	// Whether all boats have been published
+	bool done;
+} BoatRestoreStats;
+
+
+// Starts restoring boats from boat init data (as BoatInitParser_start), with filter (if not 0) choosing which to add.
+// Returns 0 if started, 1 if there are no boats to restore, or negative on failure.
+int BoatRestore_start(const char* boatInitFilename, const char* sqliteDbFilename, BoatRestoreFilter filter);
+
+// Adds up to max boats restored so far to the registry (by the registry's one writer, with the registry write-locked).
+// Returns the number added.
+unsigned int BoatRestore_publish(unsigned int max);
+
+// Whether boats are still being restored (and not all published yet)
+bool BoatRestore_isRestoring();
+
+void BoatRestore_getStats(BoatRestoreStats* stats);
+
+
+#endif // _BoatRestore_h_
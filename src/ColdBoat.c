@@ -0,0 +1,172 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include "ColdBoat.h"
+
+
+#define STATE_SAILS_DOWN		(0x01)
+#define STATE_MOVING_TO_SEA		(0x02)
+#define STATE_SET_IMMEDIATE_COURSE	(0x04)
+#define STATE_COURSE_MAGNETIC		(0x08)
+#define STATE_HAS_ZONES			(0x10)
+
+// Two cold boats per cache line
+#define COLD_BOATS_PER_SLAB_CHUNK (4096)
+
+
+static bool fitsUnsigned(double v, double scale);
+static bool fitsSigned(double v, double scale);
+static uint16_t encodeAngle(double a);
+
+static Slab _coldBoatSlab = SLAB_INITIALIZER_PACKED(sizeof(ColdBoat), COLD_BOATS_PER_SLAB_CHUNK);
+
+
+bool ColdBoat_canDemote(const Boat* b)
+{
+	if (!b->stop || b->damage != 0.0 || b->ghost.track || b->ghostTimeOffset != 0)
+	{
+		// Not idle: advancing it would change it.
+		return false;
+	}
+
+	if (b->boatType < 0 || b->boatType > UINT8_MAX || b->boatFlags < 0 || b->boatFlags > UINT8_MAX ||
+			b->startingFromLandCount < 0 || b->startingFromLandCount > UINT8_MAX)
+	{
+		return false;
+	}
+
+	return (fabs(b->pos.lat) <= 90.0 && fabs(b->pos.lon) <= 180.0 &&
+			isfinite(b->v.angle) && isfinite(b->vGround.angle) && isfinite(b->desiredCourse) &&
+			fitsUnsigned(b->v.mag, COLD_BOAT_SPEED_SCALE) &&
+			fitsUnsigned(b->vGround.mag, COLD_BOAT_SPEED_SCALE) &&
+			fitsUnsigned(b->sailArea, COLD_BOAT_SAIL_AREA_SCALE) &&
+			fitsSigned(b->leewaySpeed, COLD_BOAT_SPEED_SCALE) &&
+			fitsSigned(b->heelingAngle, COLD_BOAT_ANGLE_SCALE) &&
+			isfinite((float) b->distanceTravelled));
+}
+
+void ColdBoat_encode(const Boat* b, ColdBoat* c)
+{
+	c->lat = (int32_t) lrint(b->pos.lat * COLD_BOAT_POS_SCALE);
+	c->lon = (int32_t) lrint(b->pos.lon * COLD_BOAT_POS_SCALE);
+
+	c->distanceTravelled = (float) b->distanceTravelled;
+
+	c->vAngle = encodeAngle(b->v.angle);
+	c->vMag = (uint16_t) lrint(b->v.mag * COLD_BOAT_SPEED_SCALE);
+	c->vGroundAngle = encodeAngle(b->vGround.angle);
+	c->vGroundMag = (uint16_t) lrint(b->vGround.mag * COLD_BOAT_SPEED_SCALE);
+	c->desiredCourse = encodeAngle(b->desiredCourse);
+	c->sailArea = (uint16_t) lrint(b->sailArea * COLD_BOAT_SAIL_AREA_SCALE);
+	c->leewaySpeed = (int16_t) lrint(b->leewaySpeed * COLD_BOAT_SPEED_SCALE);
+	c->heelingAngle = (int16_t) lrint(b->heelingAngle * COLD_BOAT_ANGLE_SCALE);
+
+	c->boatType = (uint8_t) b->boatType;
+	c->boatFlags = (uint8_t) b->boatFlags;
+	c->startingFromLandCount = (uint8_t) b->startingFromLandCount;
+
+	c->state = (b->sailsDown ? STATE_SAILS_DOWN : 0) |
+		(b->movingToSea ? STATE_MOVING_TO_SEA : 0) |
+		(b->setImmediateDesiredCourse ? STATE_SET_IMMEDIATE_COURSE : 0) |
+		(b->courseMagnetic ? STATE_COURSE_MAGNETIC : 0) |
+		(b->zones ? STATE_HAS_ZONES : 0);
+}
+
+void ColdBoat_decode(const ColdBoat* c, const ZoneSet* zones, Boat* b)
+{
+	memset(b, 0, sizeof(Boat));
+
+	b->pos.lat = c->lat / COLD_BOAT_POS_SCALE;
+	b->pos.lon = c->lon / COLD_BOAT_POS_SCALE;
+
+	b->v.angle = c->vAngle / COLD_BOAT_ANGLE_SCALE;
+	b->v.mag = c->vMag / COLD_BOAT_SPEED_SCALE;
+	b->vGround.angle = c->vGroundAngle / COLD_BOAT_ANGLE_SCALE;
+	b->vGround.mag = c->vGroundMag / COLD_BOAT_SPEED_SCALE;
+
+	b->desiredCourse = c->desiredCourse / COLD_BOAT_ANGLE_SCALE;
+	b->distanceTravelled = c->distanceTravelled;
+	b->damage = 0.0;
+
+	b->boatType = c->boatType;
+	b->boatFlags = c->boatFlags;
+	b->startingFromLandCount = c->startingFromLandCount;
+
+	b->stop = true;
+	b->sailsDown = (c->state & STATE_SAILS_DOWN);
+	b->movingToSea = (c->state & STATE_MOVING_TO_SEA);
+	b->setImmediateDesiredCourse = (c->state & STATE_SET_IMMEDIATE_COURSE);
+	b->courseMagnetic = (c->state & STATE_COURSE_MAGNETIC);
+
+	b->sailArea = c->sailArea / COLD_BOAT_SAIL_AREA_SCALE;
+	b->leewaySpeed = c->leewaySpeed / COLD_BOAT_SPEED_SCALE;
+	b->heelingAngle = c->heelingAngle / COLD_BOAT_ANGLE_SCALE;
+
+	// The boat hasn't moved since it was last advanced, so the zone it's within is the one at its position.
+	b->zones = zones;
+	b->inZone = (zones ? Zones_find(zones, &b->pos) : 0);
+	b->enteredZone = 0;
+
+	b->ghost.track = 0;
+	b->ghostTimeOffset = 0;
+}
+
+bool ColdBoat_hasZones(const ColdBoat* c)
+{
+	return (c->state & STATE_HAS_ZONES);
+}
+
+ColdBoat* ColdBoat_new()
+{
+	return Slab_alloc(&_coldBoatSlab);
+}
+
+void ColdBoat_free(ColdBoat* c)
+{
+	Slab_free(&_coldBoatSlab, c);
+}
+
+void ColdBoat_getAllocStats(SlabStats* stats)
+{
+	Slab_getStats(&_coldBoatSlab, stats);
+}
+
+
+static bool fitsUnsigned(double v, double scale)
+{
+	return (v >= 0.0 && v * scale <= UINT16_MAX);
+}
+
+static bool fitsSigned(double v, double scale)
+{
+	return (v * scale >= INT16_MIN && v * scale <= INT16_MAX);
+}
+
+// Hundredths of a degree, in [0, 360)
+static uint16_t encodeAngle(double a)
+{
+	long v = lrint(a * COLD_BOAT_ANGLE_SCALE) % 36000;
+	if (v < 0)
+	{
+		v += 36000;
+	}
+
+	return (uint16_t) v;
+}
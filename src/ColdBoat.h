@@ -0,0 +1,84 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _ColdBoat_h_
+#define _ColdBoat_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "Boat.h"
+#include "Slab.h"
+#include "Zones.h"
+
+
+// Compact reduced-precision state of an idle boat (stopped, undamaged and not a ghost, so that advancing it changes
+// nothing): position as 32-bit fixed point (1e-7 degrees, about 1cm), angles as 16-bit hundredths of a degree, speeds
+// as 16-bit centimetres per second, and flags packed. Boats are demoted to this form while idle, and promoted back to a
+// full Boat when they're to be changed. Encoding a decoded state gives the same state back, so that repeated
+// promotion and demotion doesn't drift.
+
+#define COLD_BOAT_POS_SCALE		(10000000.0)
+#define COLD_BOAT_ANGLE_SCALE		(100.0)
+#define COLD_BOAT_SPEED_SCALE		(100.0)
+#define COLD_BOAT_SAIL_AREA_SCALE	(10000.0)
+
+
+typedef struct
+{
+	int32_t lat;
+	int32_t lon;
+
+	float distanceTravelled;
+
+	uint16_t vAngle;
+	uint16_t vMag;
+	uint16_t vGroundAngle;
+	uint16_t vGroundMag;
+	uint16_t desiredCourse;
+	uint16_t sailArea;
+	int16_t leewaySpeed;
+	int16_t heelingAngle;
+
+	uint8_t boatType;
+	uint8_t boatFlags;
+	uint8_t startingFromLandCount;
+
+	// Boolean fields of the boat (sails down, moving to sea, immediate course, magnetic course) and whether it has
+	// exclusion zones, as the STATE_* bits private to ColdBoat.c
+	uint8_t state;
+} ColdBoat;
+
+
+// Whether a boat is idle, and its state can be held as a ColdBoat.
+bool ColdBoat_canDemote(const Boat* b);
+
+void ColdBoat_encode(const Boat* b, ColdBoat* c);
+
+// Expands a cold boat into full state, with the given exclusion zones (which the zone the boat is within is found in).
+void ColdBoat_decode(const ColdBoat* c, const ZoneSet* zones, Boat* b);
+
+// Whether the boat had exclusion zones when demoted (so is to get its group's zones back when promoted).
+bool ColdBoat_hasZones(const ColdBoat* c);
+
+// Cold boats are packed together in a slab of their own.
+ColdBoat* ColdBoat_new();
+void ColdBoat_free(ColdBoat* c);
+void ColdBoat_getAllocStats(SlabStats* stats);
+
+
+#endif // _ColdBoat_h_
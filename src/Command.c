@@ -14,6 +14,9 @@
  * along with this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,15 +25,26 @@
 #include <unistd.h>
 #include <pthread.h>
 
+#if defined(__linux__)
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 #include "Command.h"
 
+#include "Affinity.h"
 #include "BoatWindResponse.h"
 #include "ErrLog.h"
+#include "RaceMarks.h"
 
 
 #define ERRLOG_ID "Command"
 #define THREAD_NAME "Command"
 
+// Optional execution time prefix (e.g. "@1700000000,TestBoat,start")
+#define CMD_EXEC_TIME_PREFIX '@'
+
 
 static const char* CMD_ACTION_STR_STOP = "stop";
 static const char* CMD_ACTION_STR_START = "start";
@@ -42,6 +56,23 @@ static const char* CMD_ACTION_STR_ADD_BOAT = "add";
 static const char* CMD_ACTION_STR_ADD_BOAT_WITH_GROUP = "add_g";
 static const char* CMD_ACTION_STR_REMOVE_BOAT = "remove";
 
+static const char* CMD_ACTION_STR_ADD_MARK = "mark";
+static const char* CMD_ACTION_STR_REMOVE_MARK = "mark_remove";
+
+static const char* CMD_ACTION_STR_ADD_GHOST = "add_ghost";
+
+static const char* CMD_ACTION_STR_GROUP_START = "group_start";
+static const char* CMD_ACTION_STR_GROUP_STOP = "group_stop";
+static const char* CMD_ACTION_STR_GROUP_COURSE = "group_course";
+static const char* CMD_ACTION_STR_GROUP_REMOVE = "group_remove";
+
+static const char* CMD_RESULT_STR_OK = "ok";
+static const char* CMD_RESULT_STR_NOBOAT = "noboat";
+static const char* CMD_RESULT_STR_REJECTED = "rejected";
+static const char* CMD_RESULT_STR_SCHEDULED = "scheduled";
+static const char* CMD_RESULT_STR_FAILED = "failed";
+static const char* CMD_RESULT_STR_PENDING = "pending";
+
 
 #define CMD_VAL_NONE (0)
 #define CMD_VAL_INT (1)
@@ -53,16 +84,23 @@ static const uint8_t CMD_ACTION_VALS_NONE[COMMAND_MAX_ARG_COUNT] = { CMD_VAL_NON
 static const uint8_t CMD_ACTION_SINGLE_INT_VALS[COMMAND_MAX_ARG_COUNT] = { CMD_VAL_INT, CMD_VAL_NONE, CMD_VAL_NONE, CMD_VAL_NONE, CMD_VAL_NONE, CMD_VAL_NONE };
 static const uint8_t CMD_ACTION_ADD_BOAT_VALS[COMMAND_MAX_ARG_COUNT] = { CMD_VAL_DOUBLE, CMD_VAL_DOUBLE, CMD_VAL_INT, CMD_VAL_INT, CMD_VAL_NONE, CMD_VAL_NONE };
 static const uint8_t CMD_ACTION_ADD_BOAT_WITH_GROUP_VALS[COMMAND_MAX_ARG_COUNT] = { CMD_VAL_DOUBLE, CMD_VAL_DOUBLE, CMD_VAL_INT, CMD_VAL_INT, CMD_VAL_STRING, CMD_VAL_STRING };
+static const uint8_t CMD_ACTION_ADD_MARK_VALS[COMMAND_MAX_ARG_COUNT] = { CMD_VAL_STRING, CMD_VAL_INT, CMD_VAL_DOUBLE, CMD_VAL_DOUBLE, CMD_VAL_DOUBLE, CMD_VAL_DOUBLE };
+static const uint8_t CMD_ACTION_REMOVE_MARK_VALS[COMMAND_MAX_ARG_COUNT] = { CMD_VAL_STRING, CMD_VAL_NONE, CMD_VAL_NONE, CMD_VAL_NONE, CMD_VAL_NONE, CMD_VAL_NONE };
+static const uint8_t CMD_ACTION_ADD_GHOST_VALS[COMMAND_MAX_ARG_COUNT] = { CMD_VAL_STRING, CMD_VAL_INT, CMD_VAL_STRING, CMD_VAL_STRING, CMD_VAL_NONE, CMD_VAL_NONE };
 
 
 #define BOAT_TYPE_MAX_VALUE (11)
 #define BOAT_FLAGS_MAX_VALUE (0x003f)
 
 
+static int startInputThread();
 static void* commandThreadMain();
+static bool waitInputStop(int timeoutMs);
+static void handleInputLines(bool all);
 static int handleCmd(char* cmdStr);
 
 static int getAction(const char* s);
+static const char* getActionStr(int action);
 static const uint8_t* getActionExpectedValueTypes(int action);
 static bool areValuesValidForAction(int action, CommandValue values[COMMAND_MAX_ARG_COUNT]);
 static bool isBoatTypeValid(int boatType);
@@ -71,6 +109,14 @@ static int queueCmd(Command* cmd);
 
 static const char* _cmdsInputPath = 0;
 
+// Command input, once opened, and a pipe for stopping the thread reading it
+static int _cmdsInputFd = -1;
+static int _inputStopPipe[2] = { -1, -1 };
+
+// Input read but not yet handled (not yet a whole line)
+static char _inputBuf[COMMAND_INPUT_PENDING_MAX + 1];
+static size_t _inputLen = 0;
+
 static pthread_t _commandThread;
 static Command* _cmds = 0;
 static Command* _cmdsLast = 0;
@@ -79,33 +125,78 @@ static pthread_mutex_t _cmdsLock;
 
 int Command_init(const char* cmdsInputPath)
 {
+	if (0 != pthread_mutex_init(&_cmdsLock, 0))
+	{
+		ERRLOG("Failed to init cmds mutex!");
+		return -4;
+	}
+
 	if (!cmdsInputPath)
 	{
-		return -3;
+		// No command input path, so commands only arrive via Command_add() (e.g. from NetServer).
+		ERRLOG("No command input path provided, so not reading commands from there.");
+		return 0;
 	}
 
 	_cmdsInputPath = strdup(cmdsInputPath);
 
+	return startInputThread();
+}
+
+int Command_initWithInput(int fd, const char* pending, size_t pendingLen)
+{
 	if (0 != pthread_mutex_init(&_cmdsLock, 0))
 	{
 		ERRLOG("Failed to init cmds mutex!");
 		return -4;
 	}
 
-	if (0 != pthread_create(&_commandThread, 0, &commandThreadMain, 0))
+	return Command_startInput(fd, pending, pendingLen);
+}
+
+int Command_stopInput(char* pending, size_t* pendingLen)
+{
+	*pendingLen = 0;
+
+	if (_inputStopPipe[1] < 0)
 	{
-		ERRLOG("Failed to start command processing thread!");
+		// Not reading any input.
 		return -1;
 	}
 
-#if defined(_GNU_SOURCE) && defined(__GLIBC__)
-	if (0 != pthread_setname_np(_commandThread, THREAD_NAME))
+	if (write(_inputStopPipe[1], "x", 1) != 1 || 0 != pthread_join(_commandThread, 0))
 	{
-		ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", THREAD_NAME);
+		ERRLOG("Failed to stop command input thread!");
+		return -1;
 	}
-#endif
 
-	return 0;
+	close(_inputStopPipe[0]);
+	close(_inputStopPipe[1]);
+	_inputStopPipe[0] = -1;
+	_inputStopPipe[1] = -1;
+
+	memcpy(pending, _inputBuf, _inputLen);
+	*pendingLen = _inputLen;
+	_inputLen = 0;
+
+	const int fd = _cmdsInputFd;
+	_cmdsInputFd = -1;
+
+	return fd;
+}
+
+int Command_startInput(int fd, const char* pending, size_t pendingLen)
+{
+	if (pendingLen > COMMAND_INPUT_PENDING_MAX)
+	{
+		return -1;
+	}
+
+	_cmdsInputFd = fd;
+	memcpy(_inputBuf, pending, pendingLen);
+	_inputLen = pendingLen;
+
+	return startInputThread();
 }
 
 Command* Command_next()
@@ -138,13 +229,185 @@ int Command_add(char* cmdStr)
 	return handleCmd(cmdStr);
 }
 
+int Command_addWithCompletion(char* cmdStr, CommandCompletion** completion)
+{
+	Command* cmd = Command_parse(cmdStr);
+	if (!cmd)
+	{
+		return -1;
+	}
+
+	CommandCompletion* c = malloc(sizeof(CommandCompletion));
+	if (!c)
+	{
+		ERRLOG("Failed to alloc command completion!");
+		Command_free(cmd);
+		return -1;
+	}
+
+	atomic_init(&c->done, 0);
+	c->result = COMMAND_RESULT_FAILED;
+	c->tick = 0;
+
+	// Waiting thread, and the command
+	atomic_init(&c->refs, 2);
+	cmd->completion = c;
+
+	if (0 != queueCmd(cmd))
+	{
+		// Releasing the command's reference too.
+		Command_free(cmd);
+		Command_releaseCompletion(c);
+		return -1;
+	}
+
+	*completion = c;
+	return 0;
+}
+
+void Command_complete(Command* cmd, int result, time_t tick)
+{
+	CommandCompletion* c = cmd->completion;
+	if (!c)
+	{
+		return;
+	}
+
+	cmd->completion = 0;
+
+	c->result = result;
+	c->tick = tick;
+	atomic_store_explicit(&c->done, 1, memory_order_release);
+
+#if defined(__linux__)
+	// The waiter may already have seen the flag and gone, in which case this wakes nobody (harmlessly).
+	syscall(SYS_futex, &c->done, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+#endif
+
+	Command_releaseCompletion(c);
+}
+
+bool Command_waitCompletion(CommandCompletion* completion, unsigned int timeoutMs)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const int64_t endNs = now.tv_sec * 1000000000L + now.tv_nsec + timeoutMs * 1000000L;
+
+	while (0 == atomic_load_explicit(&completion->done, memory_order_acquire))
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		const int64_t leftNs = endNs - (now.tv_sec * 1000000000L + now.tv_nsec);
+		if (leftNs <= 0)
+		{
+			return false;
+		}
+
+#if defined(__linux__)
+		// Sleeps only if still not done (otherwise returns right away).
+		const struct timespec left = { leftNs / 1000000000L, leftNs % 1000000000L };
+		syscall(SYS_futex, &completion->done, FUTEX_WAIT_PRIVATE, 0, &left, 0, 0);
+#else
+		usleep(1000);
+#endif
+	}
+
+	return true;
+}
+
+void Command_releaseCompletion(CommandCompletion* completion)
+{
+	if (1 == atomic_fetch_sub_explicit(&completion->refs, 1, memory_order_acq_rel))
+	{
+		free(completion);
+	}
+}
+
+const char* Command_getResultStr(int result)
+{
+	switch (result)
+	{
+		case COMMAND_RESULT_OK:
+			return CMD_RESULT_STR_OK;
+		case COMMAND_RESULT_NOBOAT:
+			return CMD_RESULT_STR_NOBOAT;
+		case COMMAND_RESULT_REJECTED:
+			return CMD_RESULT_STR_REJECTED;
+		case COMMAND_RESULT_SCHEDULED:
+			return CMD_RESULT_STR_SCHEDULED;
+		case COMMAND_RESULT_PENDING:
+			return CMD_RESULT_STR_PENDING;
+		default:
+			return CMD_RESULT_STR_FAILED;
+	}
+}
+
+int Command_format(const Command* cmd, char* buf, size_t size)
+{
+	const char* actionStr = getActionStr(cmd->action);
+	if (!actionStr)
+	{
+		return -1;
+	}
+
+	int len = (cmd->execTime > 0) ?
+		snprintf(buf, size, "%c%lld,%s,%s", CMD_EXEC_TIME_PREFIX, (long long) cmd->execTime, cmd->name, actionStr) :
+		snprintf(buf, size, "%s,%s", cmd->name, actionStr);
+	if (len < 0)
+	{
+		return -1;
+	}
+
+	const uint8_t* vt = getActionExpectedValueTypes(cmd->action);
+
+	for (int i = 0; i < COMMAND_MAX_ARG_COUNT; i++)
+	{
+		char* p = ((size_t) len < size) ? buf + len : 0;
+		const size_t rem = ((size_t) len < size) ? size - len : 0;
+
+		int n;
+		switch (vt[i])
+		{
+			case CMD_VAL_INT:
+				n = snprintf(p, rem, ",%d", cmd->values[i].i);
+				break;
+			case CMD_VAL_DOUBLE:
+				// Enough digits to get the same value back when parsed again.
+				n = snprintf(p, rem, ",%.17g", cmd->values[i].d);
+				break;
+			case CMD_VAL_STRING:
+				n = snprintf(p, rem, ",%s", cmd->values[i].s);
+				break;
+			default:
+				n = 0;
+				break;
+		}
+
+		if (n < 0)
+		{
+			return -1;
+		}
+
+		len += n;
+	}
+
+	return len;
+}
+
 void Command_free(Command* cmd)
 {
+	// Never handled, so don't leave anyone waiting.
+	Command_complete(cmd, COMMAND_RESULT_FAILED, 0);
+
 	if (cmd->name)
 	{
 		free(cmd->name);
 	}
 
+	if (cmd->str)
+	{
+		free(cmd->str);
+	}
+
 	const uint8_t* valueTypes = getActionExpectedValueTypes(cmd->action);
 	for (int i = 0; i < COMMAND_MAX_ARG_COUNT; i++)
 	{
@@ -158,35 +421,131 @@ void Command_free(Command* cmd)
 }
 
 
-#define COMMAND_BUF_SIZE (1024)
+static int startInputThread()
+{
+	if (0 != pipe(_inputStopPipe))
+	{
+		ERRLOG1("Failed to create command input stop pipe! errno=%d", errno);
+		return -1;
+	}
+
+	if (0 != pthread_create(&_commandThread, 0, &commandThreadMain, 0))
+	{
+		ERRLOG("Failed to start command processing thread!");
+		return -1;
+	}
+
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+	if (0 != pthread_setname_np(_commandThread, THREAD_NAME))
+	{
+		ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", THREAD_NAME);
+	}
+#endif
+
+	Affinity_applyToThread(_commandThread, AFFINITY_ROLE_COMMAND);
+
+	return 0;
+}
 
 static void* commandThreadMain()
 {
-	char buf[COMMAND_BUF_SIZE];
-
-	FILE* f = fopen(_cmdsInputPath, "r");
-	if (f == 0)
+	if (_cmdsInputFd < 0)
 	{
-		ERRLOG("Failed to open command input path!");
-		return 0;
+		// Opened without waiting for a writer (with nothing to read until there is one).
+		_cmdsInputFd = open(_cmdsInputPath, O_RDONLY | O_NONBLOCK);
+		if (_cmdsInputFd < 0)
+		{
+			ERRLOG("Failed to open command input path!");
+			return 0;
+		}
 	}
 
+	// Anything left over (handed over along with the input) is handled along with what's read next.
+	handleInputLines(_inputLen == COMMAND_INPUT_PENDING_MAX);
+
 	for (;;)
 	{
-		while (fgets(buf, COMMAND_BUF_SIZE, f) != 0)
+		struct pollfd fds[2] = { { _cmdsInputFd, POLLIN, 0 }, { _inputStopPipe[0], POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0 && errno != EINTR)
 		{
-			handleCmd(buf);
+			ERRLOG1("Failed to poll command input! errno=%d", errno);
+			if (waitInputStop(1000))
+			{
+				break;
+			}
+			continue;
 		}
 
-		clearerr(f);
-		sleep(1);
+		if (fds[1].revents)
+		{
+			break;
+		}
+
+		const ssize_t n = read(_cmdsInputFd, _inputBuf + _inputLen, COMMAND_INPUT_PENDING_MAX - _inputLen);
+		if (n > 0)
+		{
+			_inputLen += n;
+			handleInputLines(_inputLen == COMMAND_INPUT_PENDING_MAX);
+		}
+		else if (n == 0 || (errno != EAGAIN && errno != EINTR))
+		{
+			// No writers (or failed), so check again a bit later.
+			if (waitInputStop(1000))
+			{
+				break;
+			}
+		}
 	}
 
-	fclose(f);
 	return 0;
 }
 
+// Waits up to timeoutMs for the input to be stopped, returning whether it has been.
+static bool waitInputStop(int timeoutMs)
+{
+	struct pollfd fd = { _inputStopPipe[0], POLLIN, 0 };
+	return (poll(&fd, 1, timeoutMs) > 0);
+}
+
+// Handles each whole line of input read so far (along with any partial line left over, if all is set, as when a line
+// is too long to fit).
+static void handleInputLines(bool all)
+{
+	size_t start = 0;
+
+	for (size_t i = 0; i < _inputLen; i++)
+	{
+		if (_inputBuf[i] == '\n')
+		{
+			_inputBuf[i] = 0;
+			handleCmd(_inputBuf + start);
+			start = i + 1;
+		}
+	}
+
+	if (all && start < _inputLen)
+	{
+		_inputBuf[_inputLen] = 0;
+		handleCmd(_inputBuf + start);
+		start = _inputLen;
+	}
+
+	memmove(_inputBuf, _inputBuf + start, _inputLen - start);
+	_inputLen -= start;
+}
+
 static int handleCmd(char* cmdStr)
+{
+	Command* cmd = Command_parse(cmdStr);
+	if (!cmd)
+	{
+		return -1;
+	}
+
+	return queueCmd(cmd);
+}
+
+Command* Command_parse(char* cmdStr)
 {
 	char* s;
 	char* t;
@@ -206,8 +565,31 @@ static int handleCmd(char* cmdStr)
 	}
 
 	cmd->name = 0;
+	cmd->action = COMMAND_ACTION_INVALID;
+	cmd->execTime = 0;
+	cmd->str = 0;
+	cmd->completion = 0;
 	cmd->next = 0;
 
+	if (cmdStr[0] == CMD_EXEC_TIME_PREFIX)
+	{
+		// Scheduled command, so pick out the execution time and keep the rest of the command string (for persisting).
+		char* e;
+		cmd->execTime = (time_t) strtoll(cmdStr + 1, &e, 10);
+		if (e == cmdStr + 1 || *e != ',' || cmd->execTime <= 0)
+		{
+			goto fail;
+		}
+
+		cmdStr = e + 1;
+
+		if (!(cmd->str = strdup(cmdStr)))
+		{
+			ERRLOG("Failed to alloc cmd->str!");
+			goto fail;
+		}
+	}
+
 	if ((s = strtok_r(cmdStr, ",", &t)) == 0)
 	{
 		goto fail;
@@ -279,7 +661,7 @@ static int handleCmd(char* cmdStr)
 		goto fail;
 	}
 
-	return queueCmd(cmd);
+	return cmd;
 
 fail:
 	if (cmd)
@@ -287,7 +669,7 @@ fail:
 		Command_free(cmd);
 	}
 
-	return -1;
+	return 0;
 }
 
 static int getAction(const char* s)
@@ -324,10 +706,77 @@ static int getAction(const char* s)
 	{
 		return COMMAND_ACTION_REMOVE_BOAT;
 	}
+	else if (strcmp(CMD_ACTION_STR_ADD_MARK, s) == 0)
+	{
+		return COMMAND_ACTION_ADD_MARK;
+	}
+	else if (strcmp(CMD_ACTION_STR_REMOVE_MARK, s) == 0)
+	{
+		return COMMAND_ACTION_REMOVE_MARK;
+	}
+	else if (strcmp(CMD_ACTION_STR_ADD_GHOST, s) == 0)
+	{
+		return COMMAND_ACTION_ADD_GHOST;
+	}
+	else if (strcmp(CMD_ACTION_STR_GROUP_START, s) == 0)
+	{
+		return COMMAND_ACTION_GROUP_START;
+	}
+	else if (strcmp(CMD_ACTION_STR_GROUP_STOP, s) == 0)
+	{
+		return COMMAND_ACTION_GROUP_STOP;
+	}
+	else if (strcmp(CMD_ACTION_STR_GROUP_COURSE, s) == 0)
+	{
+		return COMMAND_ACTION_GROUP_COURSE;
+	}
+	else if (strcmp(CMD_ACTION_STR_GROUP_REMOVE, s) == 0)
+	{
+		return COMMAND_ACTION_GROUP_REMOVE;
+	}
 
 	return COMMAND_ACTION_INVALID;
 }
 
+static const char* getActionStr(int action)
+{
+	switch (action)
+	{
+		case COMMAND_ACTION_STOP:
+			return CMD_ACTION_STR_STOP;
+		case COMMAND_ACTION_START:
+			return CMD_ACTION_STR_START;
+		case COMMAND_ACTION_COURSE_TRUE:
+			return CMD_ACTION_STR_COURSE_TRUE;
+		case COMMAND_ACTION_COURSE_MAG:
+			return CMD_ACTION_STR_COURSE_MAG;
+		case COMMAND_ACTION_SAIL_AREA:
+			return CMD_ACTION_STR_SAIL_AREA;
+		case COMMAND_ACTION_ADD_BOAT:
+			return CMD_ACTION_STR_ADD_BOAT;
+		case COMMAND_ACTION_ADD_BOAT_WITH_GROUP:
+			return CMD_ACTION_STR_ADD_BOAT_WITH_GROUP;
+		case COMMAND_ACTION_REMOVE_BOAT:
+			return CMD_ACTION_STR_REMOVE_BOAT;
+		case COMMAND_ACTION_ADD_MARK:
+			return CMD_ACTION_STR_ADD_MARK;
+		case COMMAND_ACTION_REMOVE_MARK:
+			return CMD_ACTION_STR_REMOVE_MARK;
+		case COMMAND_ACTION_ADD_GHOST:
+			return CMD_ACTION_STR_ADD_GHOST;
+		case COMMAND_ACTION_GROUP_START:
+			return CMD_ACTION_STR_GROUP_START;
+		case COMMAND_ACTION_GROUP_STOP:
+			return CMD_ACTION_STR_GROUP_STOP;
+		case COMMAND_ACTION_GROUP_COURSE:
+			return CMD_ACTION_STR_GROUP_COURSE;
+		case COMMAND_ACTION_GROUP_REMOVE:
+			return CMD_ACTION_STR_GROUP_REMOVE;
+	}
+
+	return 0;
+}
+
 static const uint8_t* getActionExpectedValueTypes(int action)
 {
 	switch (action)
@@ -335,11 +784,18 @@ static const uint8_t* getActionExpectedValueTypes(int action)
 		case COMMAND_ACTION_COURSE_TRUE:
 		case COMMAND_ACTION_COURSE_MAG:
 		case COMMAND_ACTION_SAIL_AREA:
+		case COMMAND_ACTION_GROUP_COURSE:
 			return CMD_ACTION_SINGLE_INT_VALS;
 		case COMMAND_ACTION_ADD_BOAT:
 			return CMD_ACTION_ADD_BOAT_VALS;
 		case COMMAND_ACTION_ADD_BOAT_WITH_GROUP:
 			return CMD_ACTION_ADD_BOAT_WITH_GROUP_VALS;
+		case COMMAND_ACTION_ADD_MARK:
+			return CMD_ACTION_ADD_MARK_VALS;
+		case COMMAND_ACTION_REMOVE_MARK:
+			return CMD_ACTION_REMOVE_MARK_VALS;
+		case COMMAND_ACTION_ADD_GHOST:
+			return CMD_ACTION_ADD_GHOST_VALS;
 	}
 
 	return CMD_ACTION_VALS_NONE;
@@ -351,6 +807,7 @@ static bool areValuesValidForAction(int action, CommandValue values[COMMAND_MAX_
 	{
 		case COMMAND_ACTION_COURSE_TRUE:
 		case COMMAND_ACTION_COURSE_MAG:
+		case COMMAND_ACTION_GROUP_COURSE:
 		{
 			return (values[0].i >= 0 && values[0].i <= 360);
 		}
@@ -374,6 +831,21 @@ static bool areValuesValidForAction(int action, CommandValue values[COMMAND_MAX_
 					isBoatTypeValid(values[2].i) &&
 					values[3].i >= 0 && values[3].i <= BOAT_FLAGS_MAX_VALUE);
 		}
+		case COMMAND_ACTION_ADD_MARK:
+		{
+			return (values[0].s && strlen(values[0].s) > 0 &&
+					(values[1].i == RACEMARK_TYPE_GATE || values[1].i == RACEMARK_TYPE_FINISH) &&
+					values[2].d >= -90.0 && values[2].d <= 90.0 &&
+					values[3].d >= -180.0 && values[3].d <= 180.0 &&
+					values[4].d >= -90.0 && values[4].d <= 90.0 &&
+					values[5].d >= -180.0 && values[5].d <= 180.0);
+		}
+		case COMMAND_ACTION_ADD_GHOST:
+		{
+			return (values[0].s && strlen(values[0].s) > 0 &&
+					isBoatTypeValid(values[1].i) &&
+					values[2].s && strlen(values[2].s) > 0);
+		}
 	}
 
 	// All other actions do not use values and have no restrictions.
@@ -17,6 +17,11 @@
 #ifndef _Command_h_
 #define _Command_h_
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
 
 #define COMMAND_ACTION_INVALID (-1)
 
@@ -30,12 +35,55 @@
 #define COMMAND_ACTION_ADD_BOAT_WITH_GROUP (6)
 #define COMMAND_ACTION_REMOVE_BOAT (7)
 
+// Race mark actions (with the group/race name in place of the boat name)
+#define COMMAND_ACTION_ADD_MARK (8)
+#define COMMAND_ACTION_REMOVE_MARK (9)
+
+// Ghost boat (replaying a recorded track) action
+#define COMMAND_ACTION_ADD_GHOST (10)
+
+// Actions on all boats in a group at once (with the group name in place of the boat name)
+#define COMMAND_ACTION_GROUP_START (11)
+#define COMMAND_ACTION_GROUP_STOP (12)
+#define COMMAND_ACTION_GROUP_COURSE (13)
+#define COMMAND_ACTION_GROUP_REMOVE (14)
+
 
 #define COMMAND_MAX_ARG_COUNT (6)
 
+// Most command input read but not yet handled (a partial line)
+#define COMMAND_INPUT_PENDING_MAX (1023)
+
+
+// Results of handling a command (as reported to a client waiting on its completion)
+#define COMMAND_RESULT_OK (0)
+#define COMMAND_RESULT_NOBOAT (1)
+#define COMMAND_RESULT_REJECTED (2)
+#define COMMAND_RESULT_SCHEDULED (3)
+#define COMMAND_RESULT_FAILED (4)
+
+// Not handled yet, by the time a client stopped waiting for it (see Command_waitCompletion())
+#define COMMAND_RESULT_PENDING (5)
+
+// Longest a client waits for a command to be handled (a few ticks), so that a stalled tick can't hold up NetServer
+// workers for good
+#define COMMAND_COMPLETION_WAIT_MAX_MS (3000)
+
 
 typedef struct Command Command;
 
+// Completion of a command, set by the main thread once the command has been handled, for a (NetServer worker) thread
+// waiting on it. Shared by the waiting thread and the command, and freed once both have released it (so that the waiting
+// thread can give up waiting before the command is handled).
+typedef struct
+{
+	atomic_int done;
+	int result;
+	time_t tick;
+
+	atomic_int refs;
+} CommandCompletion;
+
 typedef union
 {
 	int i;
@@ -49,13 +97,57 @@ struct Command
 	int action;
 	CommandValue values[COMMAND_MAX_ARG_COUNT];
 
+	// Scheduled execution time (0 if not scheduled), and the command string (without execution time) for scheduled commands
+	time_t execTime;
+	char* str;
+
+	// Completion to set once handled (if a client is waiting on it)
+	CommandCompletion* completion;
+
 	Command* next;
 };
 
 
 int Command_init(const char* cmdsInputPath);
+
+// Same as Command_init(), but reading commands from an already open input (such as one handed over by another process),
+// with input already read from it but not yet handled (a partial line, of up to COMMAND_INPUT_PENDING_MAX) in pending.
+int Command_initWithInput(int fd, const char* pending, size_t pendingLen);
+
+// Stops reading commands from the input (to hand it over to another process), returning its fd (left open, or -1 if not
+// open), along with input read from it but not yet handled (up to COMMAND_INPUT_PENDING_MAX) in pending.
+int Command_stopInput(char* pending, size_t* pendingLen);
+
+// Starts reading commands from the input again, after Command_stopInput().
+int Command_startInput(int fd, const char* pending, size_t pendingLen);
+
 Command* Command_next();
 int Command_add(char* cmdStr);
+
+// Queues a command like Command_add(), with a new completion (set in completion, only if queued successfully) to set once
+// the command has been handled, to be released with Command_releaseCompletion() once done waiting.
+int Command_addWithCompletion(char* cmdStr, CommandCompletion** completion);
+
+// Sets a command's completion (if any) with the result of handling it in a tick, waking the waiting thread, and releases
+// the command's reference to it. Must be called from the main thread.
+void Command_complete(Command* cmd, int result, time_t tick);
+
+// Waits (without taking any locks) up to timeoutMs for a completion set by Command_complete(), which happens for every
+// queued command, at the latest when the command is freed (with COMMAND_RESULT_FAILED) if it was never handled. Returns
+// true if set, or false if timed out (with the command left to be handled later).
+bool Command_waitCompletion(CommandCompletion* completion, unsigned int timeoutMs);
+
+// Releases the waiting thread's reference to a completion.
+void Command_releaseCompletion(CommandCompletion* completion);
+
+const char* Command_getResultStr(int result);
+
+// Parses a command string without queueing it (returning null if invalid).
+Command* Command_parse(char* cmdStr);
+
+// Formats a command (with its execution time, if scheduled) as a string that parses back to the same command, snprintf-style
+// (returning the full length, even if truncated to fit size), or returns -1 on failure.
+int Command_format(const Command* cmd, char* buf, size_t size);
 void Command_free(Command* cmd);
 
 
@@ -0,0 +1,611 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <sqlite3.h>
+
+#include "CommandJournal.h"
+
+#include "ErrLog.h"
+
+
+#define ERRLOG_ID "CommandJournal"
+
+#define SEGMENT_SUFFIX ".journal"
+#define PATH_BUF_SIZE (4096)
+
+#define SEGMENTS_INIT_CAP (16)
+#define WRITE_BUF_INIT_SIZE (16384)
+#define TAIL_SCAN_BUF_SIZE (4096)
+
+
+typedef struct
+{
+	// First tick of commands in the segment (also its file name)
+	time_t start;
+
+	// Tick from which commands go into the next segment (0 for the current segment)
+	time_t end;
+} Segment;
+
+
+static int loadLastLogTime(const char* sqliteDbFilename);
+static int scanSegments();
+static int addSegment(time_t start);
+static int compareSegments(const void* a, const void* b);
+static void getSegmentPath(time_t start, char* path);
+static int repairTail(time_t start);
+static int replaySegment(time_t start, CommandJournal_CommandHandlerFunc commandHandler, CommandJournal_ScheduledHandlerFunc scheduledHandler, unsigned int* count, unsigned int* scheduledCount, time_t* lastTick);
+static int openCurrentSegment();
+static time_t nextSegmentStart(time_t t, time_t prevStart);
+
+
+static char* _dir = 0;
+
+// Segments in order, the last one being the current segment (for new commands)
+static Segment* _segs = 0;
+static unsigned int _segCount = 0;
+static unsigned int _segCap = 0;
+
+// Current segment's file (once there is something to write to it)
+static int _fd = -1;
+
+// Time of the last boat logs in the DB at startup (from which the boats were restored)
+static time_t _lastLogTime = 0;
+
+static char* _buf = 0;
+static size_t _bufSize = 0;
+
+
+int CommandJournal_init(const char* dir, const char* sqliteDbFilename)
+{
+	if (strlen(dir) >= PATH_BUF_SIZE - 64)
+	{
+		ERRLOG("Journal directory path name is too long!");
+		return -1;
+	}
+
+	if (0 != mkdir(dir, 0755) && errno != EEXIST)
+	{
+		ERRLOG1("Failed to create journal directory! errno=%d", errno);
+		return -1;
+	}
+
+	if (!(_dir = strdup(dir)))
+	{
+		ERRLOG("Failed to alloc journal directory path!");
+		return -1;
+	}
+
+	_lastLogTime = 0;
+	if (sqliteDbFilename && 0 != loadLastLogTime(sqliteDbFilename))
+	{
+		return -1;
+	}
+
+	if (0 != scanSegments())
+	{
+		return -1;
+	}
+
+	// New commands go into a new segment, after any from before the restart.
+	const time_t start = nextSegmentStart(time(0), (_segCount > 0) ? _segs[_segCount - 1].start : 0);
+	if (_segCount > 0)
+	{
+		_segs[_segCount - 1].end = start;
+	}
+
+	if (0 != addSegment(start))
+	{
+		return -1;
+	}
+
+	ERRLOG1("Found %u segments.", _segCount - 1);
+
+	return 0;
+}
+
+int CommandJournal_replay(CommandJournal_CommandHandlerFunc commandHandler, CommandJournal_ScheduledHandlerFunc scheduledHandler, time_t* doneUpTo)
+{
+	unsigned int count = 0;
+	unsigned int scheduledCount = 0;
+	time_t lastTick = 0;
+
+	for (unsigned int i = 0; i + 1 < _segCount; i++)
+	{
+		if (0 != replaySegment(_segs[i].start, commandHandler, scheduledHandler, &count, &scheduledCount, &lastTick))
+		{
+			return -1;
+		}
+	}
+
+	// Commands from ticks before the last boat logs were all applied too (though no longer journaled, in case their segments were removed).
+	*doneUpTo = (lastTick > _lastLogTime - 1) ? lastTick : _lastLogTime - 1;
+
+	ERRLOG3("Replayed %u commands (and %u scheduled), from tick %ld.", count, scheduledCount, (long) _lastLogTime);
+
+	return 0;
+}
+
+int CommandJournal_write(time_t t, const Command* cmds)
+{
+	if (!cmds)
+	{
+		return 0;
+	}
+
+	size_t len = 0;
+
+	for (const Command* cmd = cmds; cmd; )
+	{
+		int n = -1;
+		int m = -1;
+
+		if (_bufSize > 0)
+		{
+			n = snprintf(_buf + len, _bufSize - len, "%lld,", (long long) t);
+			if (n >= 0 && len + n < _bufSize)
+			{
+				m = Command_format(cmd, _buf + len + n, _bufSize - len - n);
+				if (m < 0)
+				{
+					ERRLOG1("Failed to format command for %s! Not journaling it.", cmd->name);
+					cmd = cmd->next;
+					continue;
+				}
+			}
+		}
+
+		if (n < 0 || m < 0 || len + n + m + 1 >= _bufSize)
+		{
+			// Not enough room (including the newline), so grow the buffer and try again.
+			const size_t size = (_bufSize == 0 ? WRITE_BUF_INIT_SIZE : _bufSize * 2);
+
+			char* b = realloc(_buf, size);
+			if (!b)
+			{
+				ERRLOG("Failed to grow journal write buffer!");
+				return -1;
+			}
+
+			_buf = b;
+			_bufSize = size;
+			continue;
+		}
+
+		len += n + m;
+		_buf[len++] = '\n';
+
+		cmd = cmd->next;
+	}
+
+	if (_fd < 0 && 0 != openCurrentSegment())
+	{
+		return -1;
+	}
+
+	size_t written = 0;
+	while (written < len)
+	{
+		const ssize_t w = write(_fd, _buf + written, len - written);
+		if (w < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			ERRLOG1("Failed to write to journal segment! errno=%d", errno);
+			return -1;
+		}
+
+		written += w;
+	}
+
+	if (0 != fdatasync(_fd))
+	{
+		ERRLOG1("Failed to sync journal segment! errno=%d", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+void CommandJournal_startSegment(time_t t)
+{
+	if (_segCount == 0)
+	{
+		return;
+	}
+
+	Segment* cur = _segs + _segCount - 1;
+
+	if (_fd < 0)
+	{
+		// Nothing written to the current segment yet, so it can just start later.
+		cur->start = nextSegmentStart(t, (_segCount > 1) ? _segs[_segCount - 2].start : 0);
+		return;
+	}
+
+	close(_fd);
+	_fd = -1;
+
+	const time_t start = nextSegmentStart(t, cur->start);
+	cur->end = start;
+
+	addSegment(start);
+}
+
+void CommandJournal_checkpoint(time_t t)
+{
+	unsigned int removed = 0;
+
+	// The current segment always stays.
+	while (removed + 1 < _segCount && _segs[removed].end <= t)
+	{
+		char path[PATH_BUF_SIZE];
+		getSegmentPath(_segs[removed].start, path);
+
+		if (0 != unlink(path) && errno != ENOENT)
+		{
+			ERRLOG1("Failed to remove journal segment! errno=%d", errno);
+			break;
+		}
+
+		removed++;
+	}
+
+	if (removed > 0)
+	{
+		memmove(_segs, _segs + removed, (_segCount - removed) * sizeof(Segment));
+		_segCount -= removed;
+	}
+}
+
+void CommandJournal_close()
+{
+	if (_fd >= 0)
+	{
+		close(_fd);
+		_fd = -1;
+	}
+
+	free(_segs);
+	_segs = 0;
+	_segCount = 0;
+	_segCap = 0;
+
+	free(_buf);
+	_buf = 0;
+	_bufSize = 0;
+
+	free(_dir);
+	_dir = 0;
+}
+
+
+static int loadLastLogTime(const char* sqliteDbFilename)
+{
+	FILE* fdb = fopen(sqliteDbFilename, "r");
+	if (fdb == 0)
+	{
+		ERRLOG("No SQLite DB file found, but the command journal needs it (for boat log checkpoints)!");
+		return -1;
+	}
+	fclose(fdb);
+
+	sqlite3* sql;
+	sqlite3_stmt* stmt;
+	int src;
+
+	if (SQLITE_OK != (src = sqlite3_open(sqliteDbFilename, &sql)))
+	{
+		ERRLOG1("Failed to open SQLite DB. sqlite rc=%d", src);
+		return -1;
+	}
+
+	// BoatLog is only ever appended to, so the last row has the latest time (without scanning the table for it).
+	static const char* SELECT_LAST_BOATLOG_STMT_STR = "SELECT time FROM BoatLog ORDER BY rowid DESC LIMIT 1;";
+	if (SQLITE_OK != (src = sqlite3_prepare_v2(sql, SELECT_LAST_BOATLOG_STMT_STR, strlen(SELECT_LAST_BOATLOG_STMT_STR) + 1, &stmt, 0)))
+	{
+		ERRLOG1("Failed to prepare BoatLog select statement! sqlite rc=%d", src);
+		sqlite3_close(sql);
+		return -1;
+	}
+
+	int rc = 0;
+
+	if (SQLITE_ROW == (src = sqlite3_step(stmt)))
+	{
+		_lastLogTime = (time_t) sqlite3_column_int64(stmt, 0);
+	}
+	else if (SQLITE_DONE != src)
+	{
+		ERRLOG1("Failed to step BoatLog select statement! sqlite rc=%d", src);
+		rc = -1;
+	}
+
+	if (SQLITE_OK != (src = sqlite3_finalize(stmt)))
+	{
+		ERRLOG1("Failed to finalize BoatLog statement! sqlite rc=%d", src);
+	}
+
+	if (SQLITE_OK != (src = sqlite3_close(sql)))
+	{
+		ERRLOG1("Failed to close SQLite DB! sqlite rc=%d", src);
+	}
+
+	return rc;
+}
+
+static int scanSegments()
+{
+	DIR* d = opendir(_dir);
+	if (!d)
+	{
+		ERRLOG1("Failed to open journal directory! errno=%d", errno);
+		return -1;
+	}
+
+	struct dirent* de;
+	while ((de = readdir(d)))
+	{
+		char* e;
+		const long long start = strtoll(de->d_name, &e, 10);
+
+		if (e == de->d_name || start <= 0 || 0 != strcmp(e, SEGMENT_SUFFIX))
+		{
+			// Not a segment file.
+			continue;
+		}
+
+		if (0 != addSegment((time_t) start))
+		{
+			closedir(d);
+			return -1;
+		}
+	}
+
+	closedir(d);
+
+	qsort(_segs, _segCount, sizeof(Segment), &compareSegments);
+
+	for (unsigned int i = 0; i < _segCount; i++)
+	{
+		if (i + 1 < _segCount)
+		{
+			_segs[i].end = _segs[i + 1].start;
+		}
+
+		if (0 != repairTail(_segs[i].start))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int addSegment(time_t start)
+{
+	if (_segCount == _segCap)
+	{
+		const unsigned int cap = (_segCap == 0 ? SEGMENTS_INIT_CAP : _segCap * 2);
+
+		Segment* s = realloc(_segs, cap * sizeof(Segment));
+		if (!s)
+		{
+			ERRLOG("Failed to grow journal segments!");
+			return -1;
+		}
+
+		_segs = s;
+		_segCap = cap;
+	}
+
+	_segs[_segCount].start = start;
+	_segs[_segCount].end = 0;
+	_segCount++;
+
+	return 0;
+}
+
+static int compareSegments(const void* a, const void* b)
+{
+	const time_t sa = ((const Segment*) a)->start;
+	const time_t sb = ((const Segment*) b)->start;
+
+	return (sa < sb) ? -1 : ((sa > sb) ? 1 : 0);
+}
+
+static void getSegmentPath(time_t start, char* path)
+{
+	snprintf(path, PATH_BUF_SIZE, "%s/%lld" SEGMENT_SUFFIX, _dir, (long long) start);
+}
+
+static int repairTail(time_t start)
+{
+	char path[PATH_BUF_SIZE];
+	getSegmentPath(start, path);
+
+	const int fd = open(path, O_RDWR);
+	if (fd < 0)
+	{
+		ERRLOG1("Failed to open journal segment for checking! errno=%d", errno);
+		return -1;
+	}
+
+	struct stat st;
+	if (0 != fstat(fd, &st))
+	{
+		ERRLOG1("Failed to stat journal segment! errno=%d", errno);
+		close(fd);
+		return -1;
+	}
+
+	// Find the end of the last complete line, since a crash may have left a partly written one.
+	char buf[TAIL_SCAN_BUF_SIZE];
+	off_t end = st.st_size;
+	off_t keep = 0;
+
+	while (end > 0)
+	{
+		const off_t from = (end > TAIL_SCAN_BUF_SIZE) ? end - TAIL_SCAN_BUF_SIZE : 0;
+		const ssize_t r = pread(fd, buf, end - from, from);
+		if (r != end - from)
+		{
+			ERRLOG1("Failed to read journal segment! errno=%d", errno);
+			close(fd);
+			return -1;
+		}
+
+		ssize_t i = r - 1;
+		while (i >= 0 && buf[i] != '\n')
+		{
+			i--;
+		}
+
+		if (i >= 0)
+		{
+			keep = from + i + 1;
+			break;
+		}
+
+		end = from;
+	}
+
+	int rc = 0;
+
+	if (keep < st.st_size)
+	{
+		ERRLOG2("Dropping incomplete record at end of journal segment %lld (%lld bytes).", (long long) start, (long long) (st.st_size - keep));
+
+		if (0 != ftruncate(fd, keep) || 0 != fsync(fd))
+		{
+			ERRLOG1("Failed to truncate journal segment! errno=%d", errno);
+			rc = -1;
+		}
+	}
+
+	close(fd);
+	return rc;
+}
+
+static int replaySegment(time_t start, CommandJournal_CommandHandlerFunc commandHandler, CommandJournal_ScheduledHandlerFunc scheduledHandler, unsigned int* count, unsigned int* scheduledCount, time_t* lastTick)
+{
+	char path[PATH_BUF_SIZE];
+	getSegmentPath(start, path);
+
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		ERRLOG1("Failed to open journal segment for replay! errno=%d", errno);
+		return -1;
+	}
+
+	char* line = 0;
+	size_t lineSize = 0;
+
+	while (getline(&line, &lineSize, f) > 0)
+	{
+		char* e;
+		const time_t t = (time_t) strtoll(line, &e, 10);
+
+		if (e == line || *e != ',')
+		{
+			ERRLOG1("Skipping invalid record in journal segment %lld!", (long long) start);
+			continue;
+		}
+
+		if (t > *lastTick)
+		{
+			*lastTick = t;
+		}
+
+		if (t < _lastLogTime)
+		{
+			// Already reflected in the boats restored from the DB.
+			continue;
+		}
+
+		Command* cmd = Command_parse(e + 1);
+		if (!cmd)
+		{
+			ERRLOG1("Skipping invalid command in journal segment %lld!", (long long) start);
+			continue;
+		}
+
+		if (cmd->execTime > t)
+		{
+			// Scheduled then, not applied.
+			scheduledHandler(cmd);
+			(*scheduledCount)++;
+			continue;
+		}
+
+		commandHandler(cmd, t);
+		Command_free(cmd);
+
+		(*count)++;
+	}
+
+	free(line);
+	fclose(f);
+
+	return 0;
+}
+
+static int openCurrentSegment()
+{
+	char path[PATH_BUF_SIZE];
+	getSegmentPath(_segs[_segCount - 1].start, path);
+
+	if ((_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0)
+	{
+		ERRLOG1("Failed to open journal segment! errno=%d", errno);
+		return -1;
+	}
+
+	// Sync the directory too, so that the new segment itself is there after a crash.
+	const int dfd = open(_dir, O_RDONLY | O_DIRECTORY);
+	if (dfd < 0 || 0 != fsync(dfd))
+	{
+		ERRLOG1("Failed to sync journal directory! errno=%d", errno);
+	}
+
+	if (dfd >= 0)
+	{
+		close(dfd);
+	}
+
+	return 0;
+}
+
+static time_t nextSegmentStart(time_t t, time_t prevStart)
+{
+	// Segment names must stay unique and in order, even if a new one is started within the same second.
+	return (t > prevStart) ? t : prevStart + 1;
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CommandJournal_h_
+#define _CommandJournal_h_
+
+#include <time.h>
+
+#include "Command.h"
+
+
+// Append-only journal of applied (and newly scheduled) commands, as "<tick time>,<command>" lines in segment files
+// "<dir>/<start>.journal". Each tick's commands are written together and synced to disk once (group commit) before they
+// are applied (or acknowledged as scheduled).
+// A new segment is started whenever boat logs are written, and old segments are removed once those boat logs
+// (the checkpoint) are committed to the DB.
+
+
+// Handles a command as applied at the given tick time.
+typedef int (*CommandJournal_CommandHandlerFunc)(Command* cmd, time_t tick);
+
+// Takes a command journaled when it was scheduled (for after the tick it was journaled in), taking ownership of it.
+typedef void (*CommandJournal_ScheduledHandlerFunc)(Command* cmd);
+
+
+// Opens the journal directory (creating it if needed) and scans any existing segments. The SQLite DB is required (for the
+// last boat log time to replay from), unless sqliteDbFilename is null (in which case everything journaled is replayed).
+int CommandJournal_init(const char* dir, const char* sqliteDbFilename);
+
+// Replays journaled commands from ticks at or after the last boat log time in the DB (not reflected in the restored boats),
+// in order, and sets doneUpTo to the last tick whose commands have all been applied. Commands journaled as scheduled go to
+// scheduledHandler instead (those from before the last boat log time being in the DB already). Must be called before any
+// CommandJournal_write() call.
+int CommandJournal_replay(CommandJournal_CommandHandlerFunc commandHandler, CommandJournal_ScheduledHandlerFunc scheduledHandler, time_t* doneUpTo);
+
+// Journals a tick's commands (linked by Command.next, in order of application, with any newly scheduled ones first),
+// returning only once they are on disk.
+int CommandJournal_write(time_t t, const Command* cmds);
+
+// Starts a new segment for commands from tick t on (called when boat logs for tick t are written).
+void CommandJournal_startSegment(time_t t);
+
+// Removes segments holding only commands from ticks before t (the time of the last boat logs committed to the DB).
+void CommandJournal_checkpoint(time_t t);
+
+// Closes the journal (leaving segments in place), for reuse with CommandJournal_init().
+void CommandJournal_close();
+
+
+#endif // _CommandJournal_h_
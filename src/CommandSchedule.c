@@ -0,0 +1,457 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "CommandSchedule.h"
+
+#include "ErrLog.h"
+#include "Logger.h"
+
+
+#define ERRLOG_ID "CommandSchedule"
+
+#define SLOTS (1 << COMMANDSCHEDULE_LEVEL_BITS)
+#define SLOT_MASK (SLOTS - 1)
+
+// Furthest ahead a command can be scheduled (the range of the wheel)
+#define MAX_DELTA (((int64_t) 1) << (COMMANDSCHEDULE_LEVEL_BITS * COMMANDSCHEDULE_LEVELS))
+
+#define PERSIST_INIT_CAP (256)
+
+#define COMPARE_BUF_SIZE (1024)
+
+
+typedef struct
+{
+	Command* head;
+	Command* tail;
+} CommandList;
+
+
+static CommandList* getSlot(time_t execTime);
+static void place(Command* cmd, bool front);
+static void cascade(unsigned int level);
+static bool isScheduled(const Command* cmd);
+static void append(CommandList* list, Command* cmd);
+static int persist(const Command* cmd);
+static int loadSql(const char* sqliteDbFilename, time_t doneUpTo);
+
+
+static CommandList _wheel[COMMANDSCHEDULE_LEVELS][SLOTS];
+static unsigned int _wheelCount = 0;
+
+// Commands due (at or before _now) but not yet taken
+static CommandList _due = { 0, 0 };
+static unsigned int _dueCount = 0;
+
+// Time of the last second drained from the wheel
+static time_t _now = 0;
+
+// Commands journaled as scheduled, to be put back into the schedule by CommandSchedule_init()
+static CommandList _journaled = { 0, 0 };
+
+// Newly scheduled commands not yet persisted
+static ScheduledCommandEntry* _persist = 0;
+static unsigned int _persistCount = 0;
+static unsigned int _persistCap = 0;
+
+// Persisted commands already applied before startup (to remove from the DB on the next CommandSchedule_takeDue() call)
+static time_t _staleUpTo = 0;
+
+
+int CommandSchedule_init(const char* sqliteDbFilename, time_t curTime, time_t doneUpTo)
+{
+	_now = curTime;
+
+	if (sqliteDbFilename && 0 != loadSql(sqliteDbFilename, doneUpTo))
+	{
+		return -1;
+	}
+
+	// Scheduled before a restart, but maybe not persisted yet (or already applied, and journaled as such).
+	unsigned int restored = 0;
+	Command* cmd;
+	while ((cmd = _journaled.head))
+	{
+		_journaled.head = cmd->next;
+
+		if (cmd->execTime <= doneUpTo || isScheduled(cmd) || 0 != CommandSchedule_add(cmd))
+		{
+			Command_free(cmd);
+			continue;
+		}
+
+		restored++;
+	}
+	_journaled.tail = 0;
+
+	if (restored > 0)
+	{
+		ERRLOG1("Restored %u scheduled commands from the command journal.", restored);
+	}
+
+	return 0;
+}
+
+void CommandSchedule_addJournaled(Command* cmd)
+{
+	append(&_journaled, cmd);
+}
+
+int CommandSchedule_add(Command* cmd)
+{
+	if (cmd->execTime - _now >= MAX_DELTA)
+	{
+		ERRLOG1("Command for %s scheduled too far ahead!", cmd->name);
+		return -1;
+	}
+
+	if (cmd->execTime <= _now)
+	{
+		// Already due, so no need to persist it.
+		append(&_due, cmd);
+		_dueCount++;
+		return 0;
+	}
+
+	if (0 != persist(cmd))
+	{
+		return -1;
+	}
+
+	place(cmd, false);
+	_wheelCount++;
+
+	return 0;
+}
+
+Command* CommandSchedule_takeDue(time_t curTime)
+{
+	while (_now < curTime)
+	{
+		if (_wheelCount == 0)
+		{
+			// Nothing scheduled, so skip straight ahead.
+			_now = curTime;
+			break;
+		}
+
+		_now++;
+
+		// Cascade the next slot of each higher level whose period has just started, lowest level first
+		// (so that commands cascaded from further up, which were scheduled earlier, end up first).
+		for (unsigned int level = 1; level < COMMANDSCHEDULE_LEVELS; level++)
+		{
+			if ((((uint64_t) _now) & ((((uint64_t) 1) << (COMMANDSCHEDULE_LEVEL_BITS * level)) - 1)) != 0)
+			{
+				break;
+			}
+
+			cascade(level);
+		}
+
+		CommandList* slot = &_wheel[0][((uint64_t) _now) & SLOT_MASK];
+		for (Command* cmd = slot->head; cmd; cmd = cmd->next)
+		{
+			_wheelCount--;
+			_dueCount++;
+		}
+
+		if (slot->head)
+		{
+			if (_due.tail)
+			{
+				_due.tail->next = slot->head;
+			}
+			else
+			{
+				_due.head = slot->head;
+			}
+			_due.tail = slot->tail;
+
+			slot->head = 0;
+			slot->tail = 0;
+		}
+	}
+
+	Command* due = _due.head;
+
+	_due.head = 0;
+	_due.tail = 0;
+	_dueCount = 0;
+
+	if (_persistCount > 0 || due || _staleUpTo > 0)
+	{
+		// Persist newly scheduled commands, and drop the persisted ones now due.
+		Logger_writeScheduledCommands(_persist, _persistCount, ((due || _staleUpTo > 0) ? curTime : 0));
+
+		_persist = 0;
+		_persistCount = 0;
+		_persistCap = 0;
+		_staleUpTo = 0;
+	}
+
+	return due;
+}
+
+unsigned int CommandSchedule_getCount()
+{
+	return _wheelCount + _dueCount;
+}
+
+
+static CommandList* getSlot(time_t execTime)
+{
+	const uint64_t delta = (uint64_t) (execTime - _now);
+
+	unsigned int level = 0;
+	while (level < COMMANDSCHEDULE_LEVELS - 1 && delta >= (((uint64_t) 1) << (COMMANDSCHEDULE_LEVEL_BITS * (level + 1))))
+	{
+		level++;
+	}
+
+	return &_wheel[level][(((uint64_t) execTime) >> (COMMANDSCHEDULE_LEVEL_BITS * level)) & SLOT_MASK];
+}
+
+static void place(Command* cmd, bool front)
+{
+	CommandList* slot = getSlot(cmd->execTime);
+
+	if (front)
+	{
+		cmd->next = slot->head;
+		slot->head = cmd;
+		if (!slot->tail)
+		{
+			slot->tail = cmd;
+		}
+	}
+	else
+	{
+		append(slot, cmd);
+	}
+}
+
+static void cascade(unsigned int level)
+{
+	CommandList* slot = &_wheel[level][(((uint64_t) _now) >> (COMMANDSCHEDULE_LEVEL_BITS * level)) & SLOT_MASK];
+
+	// Reverse the list, then place each command at the front of its lower level slot, so that these commands
+	// stay in order and ahead of any placed there directly (which were scheduled later).
+	Command* rev = 0;
+	Command* cmd = slot->head;
+	while (cmd)
+	{
+		Command* next = cmd->next;
+		cmd->next = rev;
+		rev = cmd;
+		cmd = next;
+	}
+
+	slot->head = 0;
+	slot->tail = 0;
+
+	while (rev)
+	{
+		Command* next = rev->next;
+		place(rev, true);
+		rev = next;
+	}
+}
+
+// Whether the same command is already scheduled for the same time (such as loaded from the DB).
+static bool isScheduled(const Command* cmd)
+{
+	char a[COMPARE_BUF_SIZE];
+	const int n = Command_format(cmd, a, sizeof(a));
+	if (n < 0 || n >= COMPARE_BUF_SIZE)
+	{
+		return false;
+	}
+
+	const CommandList* list = (cmd->execTime <= _now) ? &_due : getSlot(cmd->execTime);
+
+	for (const Command* c = list->head; c; c = c->next)
+	{
+		char b[COMPARE_BUF_SIZE];
+		if (c->execTime == cmd->execTime && Command_format(c, b, sizeof(b)) == n && 0 == strcmp(a, b))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void append(CommandList* list, Command* cmd)
+{
+	cmd->next = 0;
+
+	if (list->tail)
+	{
+		list->tail->next = cmd;
+	}
+	else
+	{
+		list->head = cmd;
+	}
+
+	list->tail = cmd;
+}
+
+static int persist(const Command* cmd)
+{
+	if (!cmd->str)
+	{
+		// No command string to persist.
+		return 0;
+	}
+
+	if (_persistCount == _persistCap)
+	{
+		const unsigned int cap = (_persistCap == 0 ? PERSIST_INIT_CAP : _persistCap * 2);
+
+		ScheduledCommandEntry* p = realloc(_persist, cap * sizeof(ScheduledCommandEntry));
+		if (!p)
+		{
+			ERRLOG("Failed to grow scheduled commands to persist!");
+			return -1;
+		}
+
+		_persist = p;
+		_persistCap = cap;
+	}
+
+	ScheduledCommandEntry* e = _persist + _persistCount;
+	e->execTime = cmd->execTime;
+	if (!(e->command = strdup(cmd->str)))
+	{
+		ERRLOG("Failed to alloc scheduled command string to persist!");
+		return -1;
+	}
+
+	_persistCount++;
+	return 0;
+}
+
+static int loadSql(const char* sqliteDbFilename, time_t doneUpTo)
+{
+	FILE* fdb = fopen(sqliteDbFilename, "r");
+	if (fdb == 0)
+	{
+		// No DB, so no persisted scheduled commands.
+		return 0;
+	}
+	fclose(fdb);
+
+	sqlite3* sql;
+	sqlite3_stmt* stmt;
+	int src;
+
+	if (SQLITE_OK != (src = sqlite3_open(sqliteDbFilename, &sql)))
+	{
+		ERRLOG1("Failed to open SQLite DB. sqlite rc=%d", src);
+		return -1;
+	}
+
+	static const char* SELECT_SCHEDULED_COMMAND_STMT_STR = "SELECT execTime, command FROM ScheduledCommand ORDER BY execTime, rowid;";
+	if (SQLITE_OK != (src = sqlite3_prepare_v2(sql, SELECT_SCHEDULED_COMMAND_STMT_STR, strlen(SELECT_SCHEDULED_COMMAND_STMT_STR) + 1, &stmt, 0)))
+	{
+		// The ScheduledCommand table was added later, so older DBs may not have it.
+		ERRLOG1("Failed to prepare ScheduledCommand select statement, so not loading scheduled commands. sqlite rc=%d", src);
+		sqlite3_close(sql);
+		return 0;
+	}
+
+	unsigned int loaded = 0;
+	unsigned int stale = 0;
+
+	while (SQLITE_ROW == (src = sqlite3_step(stmt)))
+	{
+		const time_t execTime = (time_t) sqlite3_column_int64(stmt, 0);
+		const char* cmdStr = (const char*) sqlite3_column_text(stmt, 1);
+
+		char* s;
+		if (!cmdStr || !(s = strdup(cmdStr)))
+		{
+			continue;
+		}
+
+		Command* cmd = Command_parse(s);
+		free(s);
+
+		if (!cmd)
+		{
+			ERRLOG1("Dropping invalid scheduled command: %s", cmdStr);
+			continue;
+		}
+
+		// Already persisted, so just put it back into the schedule.
+		cmd->execTime = execTime;
+
+		if (execTime <= doneUpTo)
+		{
+			// Already applied (and in the command journal) before a restart that left it in the DB.
+			Command_free(cmd);
+			_staleUpTo = doneUpTo;
+			stale++;
+			continue;
+		}
+		else if (execTime <= _now)
+		{
+			append(&_due, cmd);
+			_dueCount++;
+		}
+		else if (execTime - _now < MAX_DELTA)
+		{
+			place(cmd, false);
+			_wheelCount++;
+		}
+		else
+		{
+			Command_free(cmd);
+			continue;
+		}
+
+		loaded++;
+	}
+
+	if (SQLITE_DONE != src)
+	{
+		ERRLOG1("Failed to step ScheduledCommand select statement! sqlite rc=%d", src);
+	}
+
+	if (SQLITE_OK != (src = sqlite3_finalize(stmt)))
+	{
+		ERRLOG1("Failed to finalize ScheduledCommand statement! sqlite rc=%d", src);
+	}
+
+	if (SQLITE_OK != (src = sqlite3_close(sql)))
+	{
+		ERRLOG1("Failed to close SQLite DB! sqlite rc=%d", src);
+	}
+
+	ERRLOG2("Loaded %u scheduled commands (and dropped %u already applied).", loaded, stale);
+
+	return 0;
+}
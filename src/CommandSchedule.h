@@ -0,0 +1,50 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CommandSchedule_h_
+#define _CommandSchedule_h_
+
+#include <time.h>
+
+#include "Command.h"
+
+
+// Hierarchical timing wheel of 4 levels of 256 one-second (then 256-second, etc.) slots
+#define COMMANDSCHEDULE_LEVEL_BITS	(8)
+#define COMMANDSCHEDULE_LEVELS		(4)
+
+
+// Sets the schedule's current time, and loads any persisted scheduled commands from the DB (if available), except for those
+// due at or before doneUpTo (already applied, according to the command journal).
+int CommandSchedule_init(const char* sqliteDbFilename, time_t curTime, time_t doneUpTo);
+
+// Keeps a command replayed from the command journal as scheduled (taking ownership of it), for CommandSchedule_init() to
+// put back into the schedule unless it has already been applied (by doneUpTo) or is loaded from the DB too. Must be
+// called before CommandSchedule_init().
+void CommandSchedule_addJournaled(Command* cmd);
+
+// Schedules a command (with execTime set), taking ownership of it. Newly scheduled commands are persisted on the next
+// CommandSchedule_takeDue() call. Must be called from the main thread.
+int CommandSchedule_add(Command* cmd);
+
+// Advances the schedule to curTime, returning the list (linked by Command.next, in execution time and then arrival order)
+// of commands now due, for the caller to handle and free. Must be called from the main thread.
+Command* CommandSchedule_takeDue(time_t curTime);
+
+unsigned int CommandSchedule_getCount();
+
+
+#endif // _CommandSchedule_h_
@@ -0,0 +1,232 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Counters.h"
+
+#include "ErrLog.h"
+
+
+#define ERRLOG_ID "Counters"
+
+
+static CountersSlot* newSlot(unsigned int count, bool shared);
+static void sumCounters(Counters* c, unsigned int first, unsigned int n, uint64_t* totals);
+
+
+CountersSlot* Counters_newThreadSlot(Counters* c)
+{
+	CountersSlot* slot = 0;
+
+	if (0 != pthread_mutex_lock(&c->lock))
+	{
+		ERRLOG("Failed to lock counters mutex!");
+		return 0;
+	}
+
+	const unsigned int slotCount = atomic_load_explicit(&c->slotCount, memory_order_relaxed);
+
+	if (c->freeSlots)
+	{
+		// Released by a thread that has exited (and already zeroed)
+		slot = c->freeSlots;
+		c->freeSlots = slot->nextFree;
+		slot->nextFree = 0;
+	}
+	else if (slotCount < COUNTERS_MAX_THREADS)
+	{
+		if ((slot = newSlot(c->count, false)))
+		{
+			c->slots[slotCount] = slot;
+
+			// Published to readers only once set up.
+			atomic_store_explicit(&c->slotCount, slotCount + 1, memory_order_release);
+		}
+	}
+	else
+	{
+		// Out of copies, so share one (created when first needed) among all further threads.
+		if (!c->sharedSlot)
+		{
+			c->sharedSlot = newSlot(c->count, true);
+		}
+
+		slot = c->sharedSlot;
+	}
+
+	if (0 != pthread_mutex_unlock(&c->lock))
+	{
+		ERRLOG("Failed to unlock counters mutex!");
+	}
+
+	if (!slot)
+	{
+		ERRLOG("Failed to alloc counters slot!");
+	}
+
+	return slot;
+}
+
+void Counters_releaseThreadSlot(Counters* c, CountersSlot* slot)
+{
+	if (slot->shared)
+	{
+		// Still in use by other threads
+		return;
+	}
+
+	if (0 != pthread_mutex_lock(&c->lock))
+	{
+		ERRLOG("Failed to lock counters mutex!");
+		return;
+	}
+
+	if (!c->retiredSlot && !(c->retiredSlot = newSlot(c->count, false)))
+	{
+		// Nowhere else to keep its counts, so the copy just isn't reused.
+		ERRLOG("Failed to alloc retired counters slot!");
+	}
+	else
+	{
+		const unsigned int seq = atomic_load_explicit(&c->seq, memory_order_relaxed);
+		atomic_store_explicit(&c->seq, seq + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+
+		for (unsigned int i = 0; i < c->count; i++)
+		{
+			const uint64_t v = atomic_load_explicit(slot->v + i, memory_order_relaxed);
+			atomic_store_explicit(c->retiredSlot->v + i, atomic_load_explicit(c->retiredSlot->v + i, memory_order_relaxed) + v, memory_order_relaxed);
+			atomic_store_explicit(slot->v + i, 0, memory_order_relaxed);
+		}
+
+		atomic_store_explicit(&c->seq, seq + 2, memory_order_release);
+
+		slot->nextFree = c->freeSlots;
+		c->freeSlots = slot;
+	}
+
+	if (0 != pthread_mutex_unlock(&c->lock))
+	{
+		ERRLOG("Failed to unlock counters mutex!");
+	}
+}
+
+void Counters_sum(Counters* c, uint64_t* totals)
+{
+	sumCounters(c, 0, c->count, totals);
+}
+
+uint64_t Counters_get(Counters* c, unsigned int i)
+{
+	uint64_t total;
+	sumCounters(c, i, 1, &total);
+
+	return total;
+}
+
+void Counters_add(CountersSlot* slot, unsigned int i, uint64_t n)
+{
+	if (slot->shared)
+	{
+		atomic_fetch_add_explicit(slot->v + i, n, memory_order_relaxed);
+	}
+	else
+	{
+		// Only this thread writes here, so no read-modify-write needed (relaxed load and store, just so that
+		// concurrent readers see whole values).
+		atomic_store_explicit(slot->v + i, atomic_load_explicit(slot->v + i, memory_order_relaxed) + n, memory_order_relaxed);
+	}
+}
+
+void Counters_inc(CountersSlot* slot, unsigned int i)
+{
+	Counters_add(slot, i, 1);
+}
+
+
+static CountersSlot* newSlot(unsigned int count, bool shared)
+{
+	// Whole cache lines, so that no other thread's data shares them.
+	size_t size = sizeof(CountersSlot) + count * sizeof(uint64_t);
+	size = ((size + COUNTERS_CACHE_LINE_SIZE - 1) / COUNTERS_CACHE_LINE_SIZE) * COUNTERS_CACHE_LINE_SIZE;
+
+	CountersSlot* slot = aligned_alloc(COUNTERS_CACHE_LINE_SIZE, size);
+	if (!slot)
+	{
+		return 0;
+	}
+
+	memset(slot, 0, size);
+	slot->shared = shared;
+
+	return slot;
+}
+
+// Sums counters first to first + n - 1 over all copies (including the retired total) into totals.
+static void sumCounters(Counters* c, unsigned int first, unsigned int n, uint64_t* totals)
+{
+	for (;;)
+	{
+		const unsigned int seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+		if (seq & 1)
+		{
+			// Counts being moved to the retired total
+			continue;
+		}
+
+		memset(totals, 0, n * sizeof(uint64_t));
+
+		const unsigned int slotCount = atomic_load_explicit(&c->slotCount, memory_order_acquire);
+
+		for (unsigned int s = 0; s < slotCount; s++)
+		{
+			for (unsigned int i = 0; i < n; i++)
+			{
+				totals[i] += atomic_load_explicit(c->slots[s]->v + first + i, memory_order_relaxed);
+			}
+		}
+
+		// Only ever set (under lock) before the first counts are moved to it.
+		if (seq > 0)
+		{
+			for (unsigned int i = 0; i < n; i++)
+			{
+				totals[i] += atomic_load_explicit(c->retiredSlot->v + first + i, memory_order_relaxed);
+			}
+		}
+
+		// Only ever set (under lock) after all other copies are in use.
+		if (slotCount == COUNTERS_MAX_THREADS)
+		{
+			pthread_mutex_lock(&c->lock);
+			CountersSlot* shared = c->sharedSlot;
+			pthread_mutex_unlock(&c->lock);
+
+			for (unsigned int i = 0; shared && i < n; i++)
+			{
+				totals[i] += atomic_load_explicit(shared->v + first + i, memory_order_relaxed);
+			}
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&c->seq, memory_order_relaxed) == seq)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Counters_h_
+#define _Counters_h_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Statistics counters sharded per thread: each thread increments its own copy of the counters (in cache lines of its
+// own, with a plain load and store rather than an atomic read-modify-write), and readers sum the copies of all threads.
+
+// Threads with their own copies at once (any further ones share an extra copy, incremented atomically). Copies released
+// by exiting threads are reused, with their counts kept in a retired total.
+#define COUNTERS_MAX_THREADS (256)
+
+#define COUNTERS_CACHE_LINE_SIZE (64)
+
+
+typedef struct CountersSlot
+{
+	// Whether this copy is shared by several threads (so needs atomic increments)
+	bool shared;
+
+	// Next released copy, for reuse (only while released)
+	struct CountersSlot* nextFree;
+
+	_Atomic uint64_t v[];
+} CountersSlot;
+
+typedef struct
+{
+	unsigned int count;
+
+	pthread_mutex_t lock;
+	_Atomic unsigned int slotCount;
+	CountersSlot* slots[COUNTERS_MAX_THREADS];
+	CountersSlot* sharedSlot;
+
+	// Released copies (zeroed), and the counts they had (created when first needed)
+	CountersSlot* freeSlots;
+	CountersSlot* retiredSlot;
+
+	// Odd while counts are being moved from a released copy to the retired total, so that readers (which retry then)
+	// never see them in both or neither.
+	_Atomic unsigned int seq;
+} Counters;
+
+// Static initializer, for a set of count counters
+#define COUNTERS_INITIALIZER(count) { (count), PTHREAD_MUTEX_INITIALIZER, 0, { 0 }, 0, 0, 0, 0 }
+
+
+// Returns a new copy of the counters for the calling thread to increment (to be kept by the thread, such as in a
+// thread-local variable), or 0 on failure.
+CountersSlot* Counters_newThreadSlot(Counters* c);
+
+// Gives back the calling thread's copy (from Counters_newThreadSlot()) as it exits, for reuse by a later thread. Its
+// counts stay in the totals.
+void Counters_releaseThreadSlot(Counters* c, CountersSlot* slot);
+
+// Sums the copies of all threads, for each of the counters.
+void Counters_sum(Counters* c, uint64_t* totals);
+
+uint64_t Counters_get(Counters* c, unsigned int i);
+
+// Adds to one of the counters, in the calling thread's copy.
+void Counters_add(CountersSlot* slot, unsigned int i, uint64_t n);
+void Counters_inc(CountersSlot* slot, unsigned int i);
+
+
+#endif // _Counters_h_
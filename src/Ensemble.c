@@ -0,0 +1,923 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include <proteus/Compass.h>
+
+#include "Ensemble.h"
+
+#include "Affinity.h"
+#include "BoatRegistry.h"
+#include "ErrLog.h"
+#include "RaceMarks.h"
+
+
+#define ERRLOG_ID "Ensemble"
+#define THREAD_NAME "Ensemble"
+
+// Most groups (with finish lines) forecast in one run
+#define MAX_GROUPS (256)
+
+// Members are steered, checked for crossing the finish line, and have their perturbations updated once per chunk.
+#define CHUNK_SECONDS (60)
+
+// Wind perturbations: relative speed and angle (degrees) standard deviations, and their persistence from one chunk to
+// the next (as a first-order autoregressive process, so about an hour's correlation time).
+#define WIND_SPEED_SD (0.12)
+#define WIND_ANGLE_SD (8.0)
+#define WIND_PERSISTENCE (0.983)
+
+// Course keeping variation (degrees) around the course steered toward the finish
+#define COURSE_SD (4.0)
+
+// Closest to the wind boats are steered
+#define NO_GO_ANGLE (45.0)
+
+// Throttles measure CPU use over windows of this long (so that time spent waiting for the CPU doesn't bank up).
+#define THROTTLE_WINDOW_NS (5000000000L)
+
+
+typedef struct
+{
+	char* name;
+	Boat boat;
+} RunBoat;
+
+typedef struct
+{
+	char* name;
+	proteus_GeoPos p1;
+	proteus_GeoPos p2;
+
+	// Range of the group's boats in the run
+	unsigned int first;
+	unsigned int count;
+} RunGroup;
+
+typedef struct
+{
+	time_t t;
+	unsigned int scenarioSeed;
+
+	RunGroup* groups;
+	unsigned int groupCount;
+
+	RunBoat* boats;
+	unsigned int boatCount;
+
+	// Member finish times, members per boat
+	int32_t* finishTimes;
+
+	_Atomic unsigned int nextBoat;
+
+	// Workers working on the run (under _runLock)
+	unsigned int active;
+
+	struct timespec startTime;
+} Run;
+
+typedef struct
+{
+	char* group;
+	char* rows;
+} GroupResult;
+
+typedef struct
+{
+	time_t runTime;
+	GroupResult* results;
+	unsigned int count;
+} Results;
+
+// Environment lookups for one member: the run's, with the member's wind perturbations applied
+typedef struct
+{
+	const BoatEnv* base;
+
+	double speedFactor;
+	double angleOffset;
+
+	// Perturbation processes (standard normal) and their random number state
+	double speedX;
+	double angleX;
+	unsigned int scenarioSeed;
+
+	// Course keeping and boat random number state
+	unsigned int boatSeed;
+
+	bool done;
+} MemberEnv;
+
+
+static bool _enabled = false;
+static EnsembleConfig _config;
+static unsigned int _ticks = 0;
+
+static pthread_mutex_t _runLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _runCond = PTHREAD_COND_INITIALIZER;
+static Run* _run = 0;
+static unsigned long _runGen = 0;
+static atomic_bool _running;
+
+static pthread_rwlock_t _resultsLock = PTHREAD_RWLOCK_INITIALIZER;
+static Results _results = { 0, 0, 0 };
+
+
+static void* workerThreadMain(void* arg);
+static void lowerThreadPriority();
+static void finishRun(Run* run);
+static void freeRun(Run* run);
+static char* buildGroupRows(const Run* run, const RunGroup* g, const EnsembleEta* etas);
+static void freeResults(Results* results);
+
+static void steerMember(Boat* b, MemberEnv* me, const proteus_GeoPos* target);
+static double getBearing(const proteus_GeoPos* from, const proteus_GeoPos* to);
+static double normalizeAngle(double angle);
+static double getNormal(unsigned int* seed);
+static unsigned int mixSeed(unsigned int a, unsigned int b);
+static int compareInt32(const void* a, const void* b);
+static long nsBetween(const struct timespec* t0, const struct timespec* t1);
+
+static bool memberGetOcean(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od);
+static void memberGetWind(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx);
+static bool memberGetWave(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd);
+static bool memberIsWater(void* ctx, const proteus_GeoPos* pos);
+static double memberGetMagDec(void* ctx, const proteus_GeoPos* pos, time_t t);
+
+
+int Ensemble_init(const EnsembleConfig* config)
+{
+	if (config->interval < ENSEMBLE_INTERVAL_MIN || config->interval > ENSEMBLE_INTERVAL_MAX ||
+			config->members < ENSEMBLE_MEMBERS_MIN || config->members > ENSEMBLE_MEMBERS_MAX ||
+			config->threads < 1 || config->threads > ENSEMBLE_THREADS_MAX ||
+			config->cpuPercent < ENSEMBLE_CPU_PERCENT_MIN || config->cpuPercent > ENSEMBLE_CPU_PERCENT_MAX ||
+			config->horizonHours < ENSEMBLE_HORIZON_HOURS_MIN || config->horizonHours > ENSEMBLE_HORIZON_HOURS_MAX)
+	{
+		ERRLOG("Invalid ensemble config!");
+		return -1;
+	}
+
+	_config = *config;
+	atomic_init(&_running, false);
+
+	for (unsigned int i = 0; i < _config.threads; i++)
+	{
+		pthread_t thread;
+		if (0 != pthread_create(&thread, 0, &workerThreadMain, 0))
+		{
+			ERRLOG("Failed to start ensemble worker thread!");
+			return -2;
+		}
+
+		if (0 != pthread_setname_np(thread, THREAD_NAME))
+		{
+			ERRLOG("Failed to set ensemble worker thread name!");
+		}
+
+		Affinity_applyToThread(thread, AFFINITY_ROLE_ENSEMBLE);
+		pthread_detach(thread);
+	}
+
+	_enabled = true;
+
+	ERRLOG5("Ensemble ETA forecasts enabled, every %u ticks, with %u members, %u threads, %u%% CPU cap, %u hour horizon",
+			_config.interval, _config.members, _config.threads, _config.cpuPercent, _config.horizonHours);
+
+	return 0;
+}
+
+bool Ensemble_isEnabled()
+{
+	return _enabled;
+}
+
+void Ensemble_update(time_t curTime)
+{
+	if (!_enabled || (++_ticks % _config.interval) != 0 || atomic_load(&_running))
+	{
+		// Not due, or the previous run isn't done yet.
+		return;
+	}
+
+	RaceMarkFinish finishes[MAX_GROUPS];
+	const unsigned int finishCount = RaceMarks_getFinishes(finishes, MAX_GROUPS);
+	if (finishCount == 0)
+	{
+		return;
+	}
+
+	Run* run = calloc(1, sizeof(Run));
+	if (!run || !(run->groups = calloc(finishCount, sizeof(RunGroup))))
+	{
+		ERRLOG("update: Alloc failed!");
+		freeRun(run);
+		return;
+	}
+
+	// Groups with a finish line (the first one, if there are several), and their boats (other than ghosts, which just
+	// replay a recorded track)
+	BoatEntry** entries[MAX_GROUPS];
+	unsigned int entryCounts[MAX_GROUPS];
+	unsigned int boatCount = 0;
+
+	for (unsigned int i = 0; i < finishCount; i++)
+	{
+		unsigned int g = 0;
+		while (g < run->groupCount && strcmp(run->groups[g].name, finishes[i].group) != 0)
+		{
+			g++;
+		}
+
+		if (g < run->groupCount)
+		{
+			continue;
+		}
+
+		RunGroup* rg = run->groups + run->groupCount;
+		if (!(rg->name = strdup(finishes[i].group)))
+		{
+			break;
+		}
+
+		rg->p1 = finishes[i].p1;
+		rg->p2 = finishes[i].p2;
+		rg->first = boatCount;
+
+		entries[g] = BoatRegistry_getGroupEntries(rg->name, entryCounts + g);
+		for (unsigned int j = 0; entries[g] && j < entryCounts[g]; j++)
+		{
+			// Ghost boats are left out (and cold boats are never ghosts).
+			if (!entries[g][j]->boat || !entries[g][j]->boat->ghost.track)
+			{
+				rg->count++;
+			}
+		}
+
+		boatCount += rg->count;
+		run->groupCount++;
+	}
+
+	run->boats = calloc(boatCount + 1, sizeof(RunBoat));
+	run->finishTimes = malloc(((size_t) boatCount * _config.members + 1) * sizeof(int32_t));
+
+	bool ok = (run->boats && run->finishTimes);
+
+	for (unsigned int g = 0; g < run->groupCount; g++)
+	{
+		for (unsigned int j = 0; ok && entries[g] && j < entryCounts[g]; j++)
+		{
+			const BoatEntry* e = entries[g][j];
+			if (e->boat && e->boat->ghost.track)
+			{
+				continue;
+			}
+
+			Boat coldBoat;
+			RunBoat* rb = run->boats + run->boatCount;
+			rb->boat = *BoatRegistry_view(e, &coldBoat);
+			ok = ((rb->name = strdup(e->name)) != 0);
+			run->boatCount++;
+		}
+
+		if (entries[g])
+		{
+			BoatRegistry_freeGroupEntries(entries[g], entryCounts[g]);
+		}
+	}
+
+	if (!ok || run->boatCount == 0)
+	{
+		if (!ok)
+		{
+			ERRLOG("update: Alloc failed!");
+		}
+
+		freeRun(run);
+		return;
+	}
+
+	run->t = curTime;
+	run->scenarioSeed = (unsigned int) curTime;
+	atomic_init(&run->nextBoat, 0);
+	clock_gettime(CLOCK_MONOTONIC, &run->startTime);
+
+	atomic_store(&_running, true);
+
+	pthread_mutex_lock(&_runLock);
+	_run = run;
+	_runGen++;
+	pthread_cond_broadcast(&_runCond);
+	pthread_mutex_unlock(&_runLock);
+}
+
+const char* Ensemble_getGroupResponse(const char* group, time_t* runTime)
+{
+	char* resp = 0;
+
+	if (0 != pthread_rwlock_rdlock(&_resultsLock))
+	{
+		ERRLOG("Failed to read-lock results lock!");
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < _results.count; i++)
+	{
+		if (strcmp(_results.results[i].group, group) == 0)
+		{
+			resp = strdup(_results.results[i].rows);
+			*runTime = _results.runTime;
+			break;
+		}
+	}
+
+	if (0 != pthread_rwlock_unlock(&_resultsLock))
+	{
+		ERRLOG("Failed to unlock results lock!");
+	}
+
+	return resp;
+}
+
+void Ensemble_freeGroupResponse(const char* resp)
+{
+	free((char*) resp);
+}
+
+int Ensemble_runBoat(const Boat* boat, const proteus_GeoPos* finish1, const proteus_GeoPos* finish2, time_t t, unsigned int horizon,
+		const BoatEnv* env, unsigned int members, unsigned int scenarioSeed, unsigned int boatSeed, EnsembleThrottle* throttle, int32_t* finishTimes)
+{
+	for (unsigned int m = 0; m < members; m++)
+	{
+		finishTimes[m] = -1;
+	}
+
+	if (boat->stop || boat->ghost.track)
+	{
+		// Going nowhere (or just replaying a recorded track)
+		return 0;
+	}
+
+	// All members' states together, stepped a chunk at a time
+	Boat* mb = malloc(members * sizeof(Boat));
+	MemberEnv* me = malloc(members * sizeof(MemberEnv));
+	BoatEnv* envs = malloc(members * sizeof(BoatEnv));
+	if (!mb || !me || !envs)
+	{
+		free(mb);
+		free(me);
+		free(envs);
+		return -1;
+	}
+
+	const proteus_GeoPos target = {
+		.lat = (finish1->lat + finish2->lat) / 2.0,
+		.lon = finish1->lon + normalizeAngle(finish2->lon - finish1->lon + 180.0) / 2.0 - 90.0
+	};
+
+	for (unsigned int m = 0; m < members; m++)
+	{
+		mb[m] = *boat;
+
+		// Courses steered are true, and exclusion zones (which may change meanwhile) aren't looked at.
+		mb[m].courseMagnetic = false;
+		mb[m].zones = 0;
+		mb[m].inZone = 0;
+
+		me[m].base = env;
+		me[m].scenarioSeed = mixSeed(scenarioSeed, m);
+		me[m].boatSeed = mixSeed(boatSeed, m);
+		me[m].speedX = getNormal(&me[m].scenarioSeed);
+		me[m].angleX = getNormal(&me[m].scenarioSeed);
+		me[m].done = false;
+
+		envs[m].getOcean = &memberGetOcean;
+		envs[m].getWind = &memberGetWind;
+		envs[m].getWave = &memberGetWave;
+		envs[m].isWater = &memberIsWater;
+		envs[m].getMagDec = &memberGetMagDec;
+		envs[m].ctx = me + m;
+	}
+
+	const double innovation = sqrt(1.0 - WIND_PERSISTENCE * WIND_PERSISTENCE);
+
+	unsigned int remaining = members;
+
+	for (unsigned int elapsed = 0; elapsed < horizon && remaining > 0; elapsed += CHUNK_SECONDS)
+	{
+		const unsigned int steps = (horizon - elapsed < CHUNK_SECONDS) ? (horizon - elapsed) : CHUNK_SECONDS;
+
+		for (unsigned int m = 0; m < members; m++)
+		{
+			if (me[m].done)
+			{
+				continue;
+			}
+
+			Boat* b = mb + m;
+			MemberEnv* e = me + m;
+
+			e->speedX = WIND_PERSISTENCE * e->speedX + innovation * getNormal(&e->scenarioSeed);
+			e->angleX = WIND_PERSISTENCE * e->angleX + innovation * getNormal(&e->scenarioSeed);
+			e->speedFactor = fmax(0.0, 1.0 + WIND_SPEED_SD * e->speedX);
+			e->angleOffset = WIND_ANGLE_SD * e->angleX;
+
+			steerMember(b, e, &target);
+
+			const proteus_GeoPos from = b->pos;
+
+			for (unsigned int s = 1; s <= steps; s++)
+			{
+				Boat_advanceWithEnv(b, t + elapsed + s, envs + m, &e->boatSeed);
+			}
+
+			const double crossing = RaceMarks_segmentCrossing(&from, &b->pos, finish1, finish2);
+			if (crossing > 0.0)
+			{
+				finishTimes[m] = elapsed + (int32_t) ceil(crossing * steps);
+				e->done = true;
+				remaining--;
+			}
+			else if (b->stop)
+			{
+				// Ran aground (or stopped at a pole), so not finishing.
+				e->done = true;
+				remaining--;
+			}
+		}
+
+		if (throttle)
+		{
+			Ensemble_throttle(throttle);
+		}
+	}
+
+	free(mb);
+	free(me);
+	free(envs);
+
+	return 0;
+}
+
+void Ensemble_summarize(const int32_t* finishTimes, unsigned int boatCount, unsigned int members, EnsembleEta* etas)
+{
+	int32_t* sorted = malloc(members * sizeof(int32_t));
+
+	for (unsigned int i = 0; i < boatCount; i++)
+	{
+		EnsembleEta* eta = etas + i;
+		const int32_t* ft = finishTimes + (size_t) i * members;
+
+		unsigned int finished = 0;
+		for (unsigned int m = 0; m < members; m++)
+		{
+			if (ft[m] >= 0)
+			{
+				finished++;
+			}
+
+			if (sorted)
+			{
+				// Not finishing sorts last.
+				sorted[m] = (ft[m] >= 0) ? ft[m] : INT32_MAX;
+			}
+		}
+
+		eta->finishProb = ((double) finished) / members;
+		eta->firstProb = 0.0;
+		eta->p10 = -1;
+		eta->p50 = -1;
+		eta->p90 = -1;
+
+		if (sorted)
+		{
+			qsort(sorted, members, sizeof(int32_t), &compareInt32);
+
+			const unsigned int i10 = (unsigned int) ceil(0.1 * members) - 1;
+			const unsigned int i50 = (unsigned int) ceil(0.5 * members) - 1;
+			const unsigned int i90 = (unsigned int) ceil(0.9 * members) - 1;
+
+			eta->p10 = (sorted[i10] != INT32_MAX) ? sorted[i10] : -1;
+			eta->p50 = (sorted[i50] != INT32_MAX) ? sorted[i50] : -1;
+			eta->p90 = (sorted[i90] != INT32_MAX) ? sorted[i90] : -1;
+		}
+	}
+
+	free(sorted);
+
+	// Members with the same index share their wind, so are compared across boats (with ties shared).
+	for (unsigned int m = 0; m < members; m++)
+	{
+		int32_t best = INT32_MAX;
+		unsigned int bestCount = 0;
+
+		for (unsigned int i = 0; i < boatCount; i++)
+		{
+			const int32_t f = finishTimes[(size_t) i * members + m];
+			if (f >= 0 && f < best)
+			{
+				best = f;
+				bestCount = 1;
+			}
+			else if (f >= 0 && f == best)
+			{
+				bestCount++;
+			}
+		}
+
+		for (unsigned int i = 0; bestCount > 0 && i < boatCount; i++)
+		{
+			if (finishTimes[(size_t) i * members + m] == best)
+			{
+				etas[i].firstProb += 1.0 / bestCount / members;
+			}
+		}
+	}
+}
+
+void Ensemble_initThrottle(EnsembleThrottle* throttle, double share)
+{
+	throttle->share = share;
+	clock_gettime(CLOCK_MONOTONIC, &throttle->wall0);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &throttle->cpu0);
+}
+
+void Ensemble_throttle(EnsembleThrottle* throttle)
+{
+	if (throttle->share >= 1.0)
+	{
+		return;
+	}
+
+	struct timespec wall;
+	struct timespec cpu;
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+
+	const long wallNs = nsBetween(&throttle->wall0, &wall);
+	const long cpuNs = nsBetween(&throttle->cpu0, &cpu);
+
+	// Wall clock time needed for the CPU time used so far to be within the share
+	const long neededNs = (long) (cpuNs / throttle->share);
+
+	if (neededNs > wallNs)
+	{
+		const long sleepNs = neededNs - wallNs;
+		const struct timespec ts = { .tv_sec = sleepNs / 1000000000L, .tv_nsec = sleepNs % 1000000000L };
+		nanosleep(&ts, 0);
+	}
+
+	if (wallNs >= THROTTLE_WINDOW_NS)
+	{
+		Ensemble_initThrottle(throttle, throttle->share);
+	}
+}
+
+
+static void* workerThreadMain(void* arg)
+{
+	(void) arg;
+
+	lowerThreadPriority();
+
+	const double share = ((double) _config.cpuPercent) / 100.0 / _config.threads;
+	const unsigned int horizon = _config.horizonHours * 3600;
+
+	unsigned long seenGen = 0;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&_runLock);
+		while (!_run || _runGen == seenGen)
+		{
+			pthread_cond_wait(&_runCond, &_runLock);
+		}
+		seenGen = _runGen;
+		Run* run = _run;
+		run->active++;
+		pthread_mutex_unlock(&_runLock);
+
+		EnsembleThrottle throttle;
+		Ensemble_initThrottle(&throttle, share);
+
+		unsigned int i;
+		unsigned int g = 0;
+		while ((i = atomic_fetch_add(&run->nextBoat, 1)) < run->boatCount)
+		{
+			while (i >= run->groups[g].first + run->groups[g].count)
+			{
+				g++;
+			}
+
+			const RunGroup* rg = run->groups + g;
+
+			if (0 != Ensemble_runBoat(&run->boats[i].boat, &rg->p1, &rg->p2, run->t, horizon, Boat_getLiveEnv(),
+					_config.members, run->scenarioSeed, mixSeed(run->scenarioSeed, i + _config.members), &throttle,
+					run->finishTimes + (size_t) i * _config.members))
+			{
+				ERRLOG1("Failed to run ensemble for boat %s!", run->boats[i].name);
+			}
+		}
+
+		// The last worker out (by when all boats are done) publishes the results.
+		pthread_mutex_lock(&_runLock);
+		const bool last = (--run->active == 0);
+		if (last)
+		{
+			_run = 0;
+		}
+		pthread_mutex_unlock(&_runLock);
+
+		if (last)
+		{
+			finishRun(run);
+			freeRun(run);
+			atomic_store(&_running, false);
+		}
+	}
+
+	return 0;
+}
+
+static void lowerThreadPriority()
+{
+	// Only run when a CPU would otherwise be idle, so that the tick thread (and everything else) always goes first.
+	const struct sched_param param = { .sched_priority = 0 };
+	if (0 != pthread_setschedparam(pthread_self(), SCHED_IDLE, &param))
+	{
+		if (0 != setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19))
+		{
+			ERRLOG1("Failed to lower ensemble worker priority! errno=%d", errno);
+		}
+	}
+}
+
+static void finishRun(Run* run)
+{
+	Results results = { run->t, calloc(run->groupCount + 1, sizeof(GroupResult)), 0 };
+	EnsembleEta* etas = malloc((run->boatCount + 1) * sizeof(EnsembleEta));
+
+	if (!results.results || !etas)
+	{
+		ERRLOG("finishRun: Alloc failed!");
+		free(results.results);
+		free(etas);
+		return;
+	}
+
+	for (unsigned int g = 0; g < run->groupCount; g++)
+	{
+		const RunGroup* rg = run->groups + g;
+
+		Ensemble_summarize(run->finishTimes + (size_t) rg->first * _config.members, rg->count, _config.members, etas + rg->first);
+
+		GroupResult* gr = results.results + results.count;
+		gr->group = strdup(rg->name);
+		gr->rows = buildGroupRows(run, rg, etas + rg->first);
+
+		if (!gr->group || !gr->rows)
+		{
+			ERRLOG("finishRun: Alloc failed!");
+			free(gr->group);
+			free(gr->rows);
+			continue;
+		}
+
+		results.count++;
+	}
+
+	free(etas);
+
+	if (0 != pthread_rwlock_wrlock(&_resultsLock))
+	{
+		ERRLOG("Failed to write-lock results lock!");
+		freeResults(&results);
+		return;
+	}
+
+	Results old = _results;
+	_results = results;
+
+	if (0 != pthread_rwlock_unlock(&_resultsLock))
+	{
+		ERRLOG("Failed to unlock results lock!");
+	}
+
+	freeResults(&old);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	ERRLOG4("Ensemble run done: %u boats in %u groups, %u members each, in %.1fs",
+			run->boatCount, run->groupCount, _config.members, nsBetween(&run->startTime, &now) / 1000000000.0);
+}
+
+static void freeRun(Run* run)
+{
+	if (!run)
+	{
+		return;
+	}
+
+	for (unsigned int g = 0; run->groups && g < run->groupCount; g++)
+	{
+		free(run->groups[g].name);
+	}
+
+	for (unsigned int i = 0; run->boats && i < run->boatCount; i++)
+	{
+		free(run->boats[i].name);
+	}
+
+	free(run->groups);
+	free(run->boats);
+	free(run->finishTimes);
+	free(run);
+}
+
+static char* buildGroupRows(const Run* run, const RunGroup* g, const EnsembleEta* etas)
+{
+	size_t size = 1;
+	for (unsigned int i = 0; i < g->count; i++)
+	{
+		size += strlen(run->boats[g->first + i].name) + 80;
+	}
+
+	char* rows = malloc(size);
+	if (!rows)
+	{
+		return 0;
+	}
+
+	size_t pos = 0;
+	rows[0] = 0;
+
+	for (unsigned int i = 0; i < g->count; i++)
+	{
+		const EnsembleEta* eta = etas + i;
+		const int32_t ps[3] = { eta->p10, eta->p50, eta->p90 };
+
+		char pStrs[3][24];
+		for (int p = 0; p < 3; p++)
+		{
+			if (ps[p] >= 0)
+			{
+				snprintf(pStrs[p], sizeof(pStrs[p]), "%ld", (long) (run->t + ps[p]));
+			}
+			else
+			{
+				snprintf(pStrs[p], sizeof(pStrs[p]), "!");
+			}
+		}
+
+		pos += snprintf(rows + pos, size - pos, "%s,%.3f,%.3f,%s,%s,%s\n",
+				run->boats[g->first + i].name,
+				eta->finishProb,
+				eta->firstProb,
+				pStrs[0],
+				pStrs[1],
+				pStrs[2]);
+	}
+
+	return rows;
+}
+
+static void freeResults(Results* results)
+{
+	for (unsigned int i = 0; i < results->count; i++)
+	{
+		free(results->results[i].group);
+		free(results->results[i].rows);
+	}
+
+	free(results->results);
+	results->results = 0;
+	results->count = 0;
+}
+
+static void steerMember(Boat* b, MemberEnv* me, const proteus_GeoPos* target)
+{
+	double course = getBearing(&b->pos, target);
+
+	// Not any closer to the wind than the no-go angle (on whichever side is closer to the finish)
+	proteus_Weather wx;
+	memberGetWind(me, &b->pos, false, 0, &wx);
+
+	const double offWind = proteus_Compass_diff(wx.wind.angle, course);
+	if (fabs(offWind) < NO_GO_ANGLE)
+	{
+		course = wx.wind.angle + (offWind >= 0.0 ? NO_GO_ANGLE : -NO_GO_ANGLE);
+	}
+
+	b->desiredCourse = normalizeAngle(course + COURSE_SD * getNormal(&me->boatSeed));
+}
+
+// Initial great circle bearing (degrees true)
+static double getBearing(const proteus_GeoPos* from, const proteus_GeoPos* to)
+{
+	const double lat1 = from->lat * M_PI / 180.0;
+	const double lat2 = to->lat * M_PI / 180.0;
+	const double dLon = (to->lon - from->lon) * M_PI / 180.0;
+
+	const double y = sin(dLon) * cos(lat2);
+	const double x = cos(lat1) * sin(lat2) - sin(lat1) * cos(lat2) * cos(dLon);
+
+	return normalizeAngle(atan2(y, x) * 180.0 / M_PI);
+}
+
+// Angle in [0, 360)
+static double normalizeAngle(double angle)
+{
+	angle = fmod(angle, 360.0);
+	return (angle < 0.0) ? angle + 360.0 : angle;
+}
+
+// Standard normal random number (Box-Muller)
+static double getNormal(unsigned int* seed)
+{
+	const double u1 = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+	const double u2 = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static unsigned int mixSeed(unsigned int a, unsigned int b)
+{
+	uint32_t h = a * 2654435761u ^ (b + 0x9e3779b9u + (a << 6) + (a >> 2));
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+
+	return h;
+}
+
+static int compareInt32(const void* a, const void* b)
+{
+	const int32_t x = *((const int32_t*) a);
+	const int32_t y = *((const int32_t*) b);
+
+	return (x > y) - (x < y);
+}
+
+static long nsBetween(const struct timespec* t0, const struct timespec* t1)
+{
+	return (t1->tv_sec - t0->tv_sec) * 1000000000L + (t1->tv_nsec - t0->tv_nsec);
+}
+
+static bool memberGetOcean(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od)
+{
+	const MemberEnv* me = ctx;
+	return me->base->getOcean(me->base->ctx, pos, od);
+}
+
+static void memberGetWind(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx)
+{
+	const MemberEnv* me = ctx;
+	me->base->getWind(me->base->ctx, pos, adjustForCurrent, od, wx);
+
+	wx->wind.mag *= me->speedFactor;
+	wx->windGust *= me->speedFactor;
+	wx->wind.angle = normalizeAngle(wx->wind.angle + me->angleOffset);
+}
+
+static bool memberGetWave(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd)
+{
+	const MemberEnv* me = ctx;
+	return me->base->getWave(me->base->ctx, pos, wd);
+}
+
+static bool memberIsWater(void* ctx, const proteus_GeoPos* pos)
+{
+	const MemberEnv* me = ctx;
+	return me->base->isWater(me->base->ctx, pos);
+}
+
+static double memberGetMagDec(void* ctx, const proteus_GeoPos* pos, time_t t)
+{
+	const MemberEnv* me = ctx;
+	return me->base->getMagDec(me->base->ctx, pos, t);
+}
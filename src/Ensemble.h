@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Ensemble_h_
+#define _Ensemble_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <proteus/GeoPos.h>
+
+#include "Boat.h"
+
+
+// Ensemble ETA forecasts for race groups: for each boat in a group with a finish line, many forward simulations
+// ("members") from the boat's current state, with perturbed wind and course keeping, run on a low-priority worker pool
+// (capped in CPU use) and summarized into finish time percentiles and chances of finishing (first).
+
+#define ENSEMBLE_INTERVAL_MIN		(10)
+#define ENSEMBLE_INTERVAL_MAX		(86400)
+
+#define ENSEMBLE_MEMBERS_MIN		(4)
+#define ENSEMBLE_MEMBERS_MAX		(1024)
+#define ENSEMBLE_MEMBERS_DEFAULT	(32)
+
+#define ENSEMBLE_THREADS_MAX		(64)
+#define ENSEMBLE_THREADS_DEFAULT	(1)
+
+// CPU use cap of the whole worker pool, as a percentage of one CPU
+#define ENSEMBLE_CPU_PERCENT_MIN	(1)
+#define ENSEMBLE_CPU_PERCENT_MAX	(100 * ENSEMBLE_THREADS_MAX)
+#define ENSEMBLE_CPU_PERCENT_DEFAULT	(50)
+
+// How far ahead members are simulated (those not finished by then count as not finishing)
+#define ENSEMBLE_HORIZON_HOURS_MIN	(1)
+#define ENSEMBLE_HORIZON_HOURS_MAX	(720)
+#define ENSEMBLE_HORIZON_HOURS_DEFAULT	(48)
+
+
+typedef struct
+{
+	// Ticks between forecast runs (a run due while the previous one is still going is skipped)
+	unsigned int interval;
+
+	unsigned int members;
+	unsigned int threads;
+	unsigned int cpuPercent;
+	unsigned int horizonHours;
+} EnsembleConfig;
+
+// Keeps a thread's CPU use to a fraction of wall clock time, sleeping as needed.
+typedef struct
+{
+	double share;
+
+	struct timespec wall0;
+	struct timespec cpu0;
+} EnsembleThrottle;
+
+typedef struct
+{
+	// Fraction of members finishing (within the horizon), and finishing first in their group
+	double finishProb;
+	double firstProb;
+
+	// Finish time percentiles (seconds from the start of the run), or -1 where more members than that don't finish
+	int32_t p10;
+	int32_t p50;
+	int32_t p90;
+} EnsembleEta;
+
+
+int Ensemble_init(const EnsembleConfig* config);
+bool Ensemble_isEnabled();
+
+// Starts a forecast run from the current state of all boats in groups with a finish line, when due (and the previous run
+// is done). Must be called from the main thread (which is the only writer of boats and the boat registry).
+void Ensemble_update(time_t curTime);
+
+// Returns the "boat,finish chance,first chance,p10,p50,p90" lines (finish time percentiles as Unix times, or "!" where
+// unknown) for a group from the latest run (with the run's start time), or null if there are none.
+const char* Ensemble_getGroupResponse(const char* group, time_t* runTime);
+void Ensemble_freeGroupResponse(const char* resp);
+
+// Simulates members forward from a boat's state (for up to horizon seconds) toward a finish line, setting each member's
+// finish time (seconds from t), or -1 if it doesn't finish. Members with the same index share their wind perturbations
+// (from scenarioSeed) across boats, with course keeping varying per boat (from boatSeed). Throttled if throttle is
+// non-null. Returns 0, or -1 on failure.
+int Ensemble_runBoat(const Boat* boat, const proteus_GeoPos* finish1, const proteus_GeoPos* finish2, time_t t, unsigned int horizon,
+		const BoatEnv* env, unsigned int members, unsigned int scenarioSeed, unsigned int boatSeed, EnsembleThrottle* throttle, int32_t* finishTimes);
+
+// Summarizes the member finish times (boatCount rows of members each) of a group's boats.
+void Ensemble_summarize(const int32_t* finishTimes, unsigned int boatCount, unsigned int members, EnsembleEta* etas);
+
+void Ensemble_initThrottle(EnsembleThrottle* throttle, double share);
+void Ensemble_throttle(EnsembleThrottle* throttle);
+
+
+#endif // _Ensemble_h_
@@ -0,0 +1,726 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sailnavsim_boatregistry.h>
+
+#include "FleetTiles.h"
+
+#include "Boat.h"
+#include "BoatRegistry.h"
+#include "ErrLog.h"
+#include "Shard.h"
+
+
+#define ERRLOG_ID "FleetTiles"
+
+// Latitude limit of the (square) web map projection
+#define MAX_TILE_LAT (85.0511287798)
+
+#define SUBTILES_PER_SIDE (1 << FLEETTILES_SUBTILE_LEVELS)
+
+// Tiles down to this zoom level are kept in dense arrays (small enough to stay in cache, and cheap to copy),
+// and the (mostly empty) deeper ones in hash tables.
+#define DENSE_MAX_ZOOM (8)
+#define DENSE_TILE_COUNT (((1 << (2 * (DENSE_MAX_ZOOM + 1))) - 1) / 3)
+
+
+// Entry of an open addressing hash table, used both for tiles (keyed by tileKey(), with sums of boat positions)
+// and for boats (keyed by boat id, with the position and finest tile they were last counted in). The generation
+// is that of the last build which saw the boat, or which changed the tile.
+typedef struct
+{
+	uint64_t key;
+	uint64_t tile;
+	double lat;
+	double lon;
+	uint32_t count;
+	uint32_t gen;
+} Entry;
+
+typedef struct
+{
+	Entry* entries;
+	uint64_t mask;
+	uint64_t count;
+} Table;
+
+typedef struct
+{
+	uint32_t count;
+	double lat;
+	double lon;
+} DenseTile;
+
+typedef struct
+{
+	Table tiles;
+	DenseTile* dense;
+} Snapshot;
+
+typedef struct
+{
+	uint64_t* keys;
+	unsigned int count;
+	unsigned int cap;
+} KeyList;
+
+
+static bool _enabled = false;
+static unsigned int _interval = 1;
+static unsigned int _ticks = 0;
+
+// Working state, updated by builds only
+static Table _tiles = { 0, 0, 0 };
+static DenseTile* _dense = 0;
+static Table _boats = { 0, 0, 0 };
+static uint32_t _gen = 0;
+
+// Two copies of the tiles for requests: the published one (read under the lock), and a spare one, which is brought
+// up to date (by replaying the hash table tile changes of the last two builds) before being swapped in.
+static pthread_rwlock_t _snapshotLock = PTHREAD_RWLOCK_INITIALIZER;
+static Snapshot _snapshots[2] = { { { 0, 0, 0 }, 0 }, { { 0, 0, 0 }, 0 } };
+static Snapshot* _snapshot = 0;
+static KeyList _prevChanged = { 0, 0, 0 };
+
+
+static uint64_t tileKey(int z, int x, int y);
+static uint64_t parentKey(uint64_t key);
+static uint64_t finestTileKey(double lat, double lon);
+static unsigned int denseIndex(int z, uint64_t x, uint64_t y);
+static bool getSnapshotTile(const Snapshot* snapshot, int z, int x, int y, uint32_t* count, double* lat, double* lon);
+
+static int updateTiles(uint64_t finestKey, int dCount, double dLat, double dLon, KeyList* changed);
+static int publishSnapshot(KeyList* changed);
+static void applyChanges(Table* snapshot, const KeyList* changed);
+
+static uint64_t hashKey(uint64_t key);
+static int tableInit(Table* t, uint64_t size);
+static Entry* tableFind(const Table* t, uint64_t key);
+static Entry* tableInsert(Table* t, uint64_t key);
+static void tableRemove(Table* t, Entry* e);
+static int copyTable(Table* to, const Table* from);
+
+static int keyListAdd(KeyList* list, uint64_t key);
+
+
+int FleetTiles_init(unsigned int interval)
+{
+	if (interval < FLEETTILES_INTERVAL_MIN || interval > FLEETTILES_INTERVAL_MAX)
+	{
+		ERRLOG1("Invalid fleet tile interval: %u", interval);
+		return -1;
+	}
+
+	_interval = interval;
+	_enabled = true;
+
+	ERRLOG1("Fleet tiles enabled, built every %u ticks", _interval);
+
+	return 0;
+}
+
+bool FleetTiles_isEnabled()
+{
+	return _enabled;
+}
+
+void FleetTiles_update()
+{
+	if (!_enabled || (++_ticks % _interval) != 0)
+	{
+		return;
+	}
+
+	unsigned int boatCount;
+	void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
+
+	FleetTileBoat* boats = malloc((boatCount + 1) * sizeof(FleetTileBoat));
+	if (!boats)
+	{
+		ERRLOG("update: Alloc failed!");
+		sailnavsim_boatregistry_free_boats_iterator(iterator);
+		return;
+	}
+
+	// Boats hidden from live sharing, and those in celestial navigation mode (whose positions are not reported), are left off the map.
+	unsigned int count = 0;
+	const BoatEntry* e;
+	while ((e = sailnavsim_boatregistry_boats_iterator_get_next(iterator)) && count < boatCount)
+	{
+		Boat coldBoat;
+		const Boat* b = BoatRegistry_view(e, &coldBoat);
+
+		if ((b->boatFlags & (BOAT_FLAG_LIVE_SHARING_HIDDEN | BOAT_FLAG_CELESTIAL)) == 0)
+		{
+			boats[count].id = Shard_hash(e->name);
+			boats[count].lat = b->pos.lat;
+			boats[count].lon = b->pos.lon;
+			count++;
+		}
+	}
+
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+
+	if (0 != FleetTiles_build(boats, count))
+	{
+		ERRLOG("update: Failed to build fleet tiles!");
+	}
+
+	free(boats);
+}
+
+int FleetTiles_build(const FleetTileBoat* boats, unsigned int count)
+{
+	if (!_tiles.entries && (0 != tableInit(&_tiles, 1024) || 0 != tableInit(&_boats, 1024) || !(_dense = calloc(DENSE_TILE_COUNT, sizeof(DenseTile)))))
+	{
+		ERRLOG("build: Alloc failed!");
+		return -1;
+	}
+
+	if (++_gen == 0)
+	{
+		_gen = 1;
+	}
+
+	KeyList changed = { 0, 0, 0 };
+	int rc = 0;
+
+	// Only boats which have moved (or are new) change any tiles.
+	for (unsigned int i = 0; i < count && rc == 0; i++)
+	{
+		const FleetTileBoat* b = boats + i;
+		const uint64_t id = (b->id == 0) ? 1 : b->id;
+
+		Entry* be = tableInsert(&_boats, id);
+		if (!be)
+		{
+			rc = -1;
+			break;
+		}
+
+		if (be->count == 1 && be->lat == b->lat && be->lon == b->lon)
+		{
+			be->gen = _gen;
+			continue;
+		}
+
+		const uint64_t tile = finestTileKey(b->lat, b->lon);
+
+		if (be->count == 1 && be->tile == tile)
+		{
+			// Moved within its tile (and so within all the tiles above it), which is by far the most common case.
+			rc = updateTiles(tile, 0, b->lat - be->lat, b->lon - be->lon, &changed);
+		}
+		else
+		{
+			if (be->count == 1)
+			{
+				rc = updateTiles(be->tile, -1, -be->lat, -be->lon, &changed);
+			}
+
+			if (rc == 0)
+			{
+				rc = updateTiles(tile, 1, b->lat, b->lon, &changed);
+			}
+		}
+
+		be->tile = tile;
+		be->lat = b->lat;
+		be->lon = b->lon;
+		be->count = 1;
+		be->gen = _gen;
+	}
+
+	// Boats not seen in this build have been removed (or hidden).
+	for (uint64_t i = 0; i <= _boats.mask && rc == 0; )
+	{
+		Entry* be = _boats.entries + i;
+		if (be->key != 0 && be->gen != _gen)
+		{
+			rc = updateTiles(be->tile, -1, -be->lat, -be->lon, &changed);
+
+			// (Removal may shift a following entry into this slot, so check it again.)
+			tableRemove(&_boats, be);
+			continue;
+		}
+
+		i++;
+	}
+
+	if (rc == 0 && (changed.count > 0 || !_snapshot))
+	{
+		// (Takes ownership of the changed keys.)
+		return publishSnapshot(&changed);
+	}
+
+	free(changed.keys);
+	return rc;
+}
+
+int FleetTiles_getSubTiles(int z, int x, int y, FleetTile* tiles, unsigned int maxTiles)
+{
+	if (!FleetTiles_isValidTile(z, x, y))
+	{
+		return -1;
+	}
+
+	const int d = (z + FLEETTILES_SUBTILE_LEVELS > FLEETTILES_MAX_ZOOM) ? FLEETTILES_MAX_ZOOM - z : FLEETTILES_SUBTILE_LEVELS;
+	const int sz = z + d;
+	const int side = 1 << d;
+
+	if (0 != pthread_rwlock_rdlock(&_snapshotLock))
+	{
+		ERRLOG("getSubTiles: Failed to read-lock snapshot rwlock!");
+		return -1;
+	}
+
+	unsigned int n = 0;
+
+	if (_snapshot)
+	{
+		for (int sy = y * side; sy < (y + 1) * side; sy++)
+		{
+			for (int sx = x * side; sx < (x + 1) * side && n < maxTiles; sx++)
+			{
+				uint32_t count;
+				double lat;
+				double lon;
+
+				if (getSnapshotTile(_snapshot, sz, sx, sy, &count, &lat, &lon))
+				{
+					tiles[n].z = sz;
+					tiles[n].x = sx;
+					tiles[n].y = sy;
+					tiles[n].count = count;
+					tiles[n].lat = lat / count;
+					tiles[n].lon = lon / count;
+					n++;
+				}
+			}
+		}
+	}
+
+	if (0 != pthread_rwlock_unlock(&_snapshotLock))
+	{
+		ERRLOG("getSubTiles: Failed to unlock snapshot rwlock!");
+	}
+
+	return n;
+}
+
+const char* FleetTiles_getTileResponse(int z, int x, int y)
+{
+	FleetTile tiles[SUBTILES_PER_SIDE * SUBTILES_PER_SIDE];
+
+	const int n = FleetTiles_getSubTiles(z, x, y, tiles, SUBTILES_PER_SIDE * SUBTILES_PER_SIDE);
+	if (n < 0)
+	{
+		return 0;
+	}
+
+	const size_t respSize = n * 80 + 1;
+	char* resp = malloc(respSize);
+	if (!resp)
+	{
+		return 0;
+	}
+
+	size_t pos = 0;
+	resp[0] = 0;
+
+	for (int i = 0; i < n && pos < respSize; i++)
+	{
+		pos += snprintf(resp + pos, respSize - pos, "%d,%d,%d,%u,%.5f,%.5f\n",
+				tiles[i].z, tiles[i].x, tiles[i].y, tiles[i].count, tiles[i].lat, tiles[i].lon);
+	}
+
+	return resp;
+}
+
+void FleetTiles_freeTileResponse(const char* resp)
+{
+	free((char*) resp);
+}
+
+bool FleetTiles_isValidTile(int z, int x, int y)
+{
+	return (z >= 0 && z <= FLEETTILES_MAX_ZOOM && x >= 0 && x < (1 << z) && y >= 0 && y < (1 << z));
+}
+
+
+static uint64_t tileKey(int z, int x, int y)
+{
+	// (Zoom level is offset by one, so that no key is zero.)
+	return (((uint64_t) (z + 1)) << 48) | (((uint64_t) x) << 24) | ((uint64_t) y);
+}
+
+static uint64_t parentKey(uint64_t key)
+{
+	const uint64_t z = (key >> 48) - 1;
+	const uint64_t x = (key >> 24) & 0xffffff;
+	const uint64_t y = key & 0xffffff;
+
+	return tileKey(z - 1, x >> 1, y >> 1);
+}
+
+static uint64_t finestTileKey(double lat, double lon)
+{
+	const int n = 1 << FLEETTILES_MAX_ZOOM;
+
+	lat = fmax(-MAX_TILE_LAT, fmin(MAX_TILE_LAT, lat));
+	const double latRad = lat * M_PI / 180.0;
+
+	int x = (int) floor((lon + 180.0) / 360.0 * n);
+	int y = (int) floor((1.0 - log(tan(latRad) + 1.0 / cos(latRad)) / M_PI) / 2.0 * n);
+
+	x = (x < 0) ? 0 : ((x >= n) ? n - 1 : x);
+	y = (y < 0) ? 0 : ((y >= n) ? n - 1 : y);
+
+	return tileKey(FLEETTILES_MAX_ZOOM, x, y);
+}
+
+static unsigned int denseIndex(int z, uint64_t x, uint64_t y)
+{
+	// (Tiles of all the levels above come first.)
+	return ((1 << (2 * z)) - 1) / 3 + (y << z) + x;
+}
+
+static bool getSnapshotTile(const Snapshot* snapshot, int z, int x, int y, uint32_t* count, double* lat, double* lon)
+{
+	if (z <= DENSE_MAX_ZOOM)
+	{
+		const DenseTile* t = snapshot->dense + denseIndex(z, x, y);
+
+		*count = t->count;
+		*lat = t->lat;
+		*lon = t->lon;
+	}
+	else
+	{
+		const Entry* e = tableFind(&snapshot->tiles, tileKey(z, x, y));
+
+		*count = (e ? e->count : 0);
+		*lat = (e ? e->lat : 0.0);
+		*lon = (e ? e->lon : 0.0);
+	}
+
+	return (*count > 0);
+}
+
+// Applies a change in boat count and position sums to a finest tile and all the tiles above it, and lists each tile
+// changed for the first time in this build (marking it with the build's generation).
+static int updateTiles(uint64_t finestKey, int dCount, double dLat, double dLon, KeyList* changed)
+{
+	uint64_t key = finestKey;
+
+	for (int z = FLEETTILES_MAX_ZOOM; z > DENSE_MAX_ZOOM; z--)
+	{
+		Entry* e = (dCount > 0) ? tableInsert(&_tiles, key) : tableFind(&_tiles, key);
+		if (!e)
+		{
+			return -1;
+		}
+
+		e->count += dCount;
+		e->lat += dLat;
+		e->lon += dLon;
+
+		if (e->gen != _gen)
+		{
+			e->gen = _gen;
+			if (0 != keyListAdd(changed, key))
+			{
+				return -1;
+			}
+		}
+
+		if (e->count == 0)
+		{
+			tableRemove(&_tiles, e);
+		}
+
+		key = parentKey(key);
+	}
+
+	// (The dense tiles are copied as a whole, so changes to them need not be listed.)
+	const uint64_t x = (key >> 24) & 0xffffff;
+	const uint64_t y = key & 0xffffff;
+
+	for (int z = DENSE_MAX_ZOOM; z >= 0; z--)
+	{
+		DenseTile* t = _dense + denseIndex(z, x >> (DENSE_MAX_ZOOM - z), y >> (DENSE_MAX_ZOOM - z));
+
+		t->count += dCount;
+		t->lat += dLat;
+		t->lon += dLon;
+
+		if (t->count == 0)
+		{
+			t->lat = 0.0;
+			t->lon = 0.0;
+		}
+	}
+
+	return 0;
+}
+
+static int publishSnapshot(KeyList* changed)
+{
+	Snapshot* spare = (_snapshot == _snapshots) ? _snapshots + 1 : _snapshots;
+
+	if (!spare->tiles.entries && (0 != tableInit(&spare->tiles, 1024) || !(spare->dense = malloc(DENSE_TILE_COUNT * sizeof(DenseTile)))))
+	{
+		ERRLOG("publishSnapshot: Alloc failed!");
+		free(changed->keys);
+		return -1;
+	}
+
+	// No requests read the spare tiles, so no lock is needed until they are swapped in.
+	// When most tiles have changed, copying the whole table is cheaper than replaying the changes.
+	if ((uint64_t) _prevChanged.count + changed->count > _tiles.count / 2)
+	{
+		if (0 != copyTable(&spare->tiles, &_tiles))
+		{
+			free(changed->keys);
+			return -1;
+		}
+	}
+	else
+	{
+		applyChanges(&spare->tiles, &_prevChanged);
+		applyChanges(&spare->tiles, changed);
+	}
+	memcpy(spare->dense, _dense, DENSE_TILE_COUNT * sizeof(DenseTile));
+
+	if (0 != pthread_rwlock_wrlock(&_snapshotLock))
+	{
+		ERRLOG("publishSnapshot: Failed to write-lock snapshot rwlock!");
+		free(changed->keys);
+		return -1;
+	}
+
+	_snapshot = spare;
+
+	if (0 != pthread_rwlock_unlock(&_snapshotLock))
+	{
+		ERRLOG("publishSnapshot: Failed to unlock snapshot rwlock!");
+	}
+
+	// The other table (now the spare one) is only missing this build's changes.
+	free(_prevChanged.keys);
+	_prevChanged = *changed;
+
+	return 0;
+}
+
+// Copies the current state of the changed tiles (including removals) from the working tile table.
+static void applyChanges(Table* snapshot, const KeyList* changed)
+{
+	for (unsigned int i = 0; i < changed->count; i++)
+	{
+		const uint64_t key = changed->keys[i];
+		const Entry* e = tableFind(&_tiles, key);
+		Entry* se = tableFind(snapshot, key);
+
+		if (e)
+		{
+			if (!se && !(se = tableInsert(snapshot, key)))
+			{
+				continue;
+			}
+
+			se->count = e->count;
+			se->lat = e->lat;
+			se->lon = e->lon;
+		}
+		else if (se)
+		{
+			tableRemove(snapshot, se);
+		}
+	}
+}
+
+
+static uint64_t hashKey(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+static int tableInit(Table* t, uint64_t size)
+{
+	t->entries = calloc(size, sizeof(Entry));
+	if (!t->entries)
+	{
+		ERRLOG("tableInit: Alloc failed!");
+		return -1;
+	}
+
+	t->mask = size - 1;
+	t->count = 0;
+
+	return 0;
+}
+
+static Entry* tableFind(const Table* t, uint64_t key)
+{
+	for (uint64_t i = hashKey(key) & t->mask; ; i = (i + 1) & t->mask)
+	{
+		Entry* e = t->entries + i;
+
+		if (e->key == key)
+		{
+			return e;
+		}
+		else if (e->key == 0)
+		{
+			return 0;
+		}
+	}
+}
+
+// Returns the entry for key, inserting a zeroed one if not present (which may move other entries).
+static Entry* tableInsert(Table* t, uint64_t key)
+{
+	Entry* e = tableFind(t, key);
+	if (e)
+	{
+		return e;
+	}
+
+	if ((t->count + 1) * 2 > t->mask + 1)
+	{
+		Table bigger;
+		if (0 != tableInit(&bigger, (t->mask + 1) * 2))
+		{
+			return 0;
+		}
+
+		for (uint64_t i = 0; i <= t->mask; i++)
+		{
+			if (t->entries[i].key != 0)
+			{
+				uint64_t j = hashKey(t->entries[i].key) & bigger.mask;
+				while (bigger.entries[j].key != 0)
+				{
+					j = (j + 1) & bigger.mask;
+				}
+
+				bigger.entries[j] = t->entries[i];
+			}
+		}
+
+		bigger.count = t->count;
+
+		free(t->entries);
+		*t = bigger;
+	}
+
+	uint64_t i = hashKey(key) & t->mask;
+	while (t->entries[i].key != 0)
+	{
+		i = (i + 1) & t->mask;
+	}
+
+	e = t->entries + i;
+	memset(e, 0, sizeof(Entry));
+	e->key = key;
+	t->count++;
+
+	return e;
+}
+
+// Removes an entry, shifting back any following entries of the same probe run (so no tombstones are needed).
+static void tableRemove(Table* t, Entry* e)
+{
+	uint64_t i = e - t->entries;
+	uint64_t j = i;
+
+	for (;;)
+	{
+		j = (j + 1) & t->mask;
+		if (t->entries[j].key == 0)
+		{
+			break;
+		}
+
+		const uint64_t home = hashKey(t->entries[j].key) & t->mask;
+
+		// Move entry j into the gap at i unless its home slot lies (cyclically) within (i, j].
+		if ((i < j) ? (home <= i || home > j) : (home <= i && home > j))
+		{
+			t->entries[i] = t->entries[j];
+			i = j;
+		}
+	}
+
+	t->entries[i].key = 0;
+	t->count--;
+}
+
+static int copyTable(Table* to, const Table* from)
+{
+	if (to->mask != from->mask)
+	{
+		Entry* entries = malloc((from->mask + 1) * sizeof(Entry));
+		if (!entries)
+		{
+			ERRLOG("copyTable: Alloc failed!");
+			return -1;
+		}
+
+		free(to->entries);
+		to->entries = entries;
+		to->mask = from->mask;
+	}
+
+	memcpy(to->entries, from->entries, (from->mask + 1) * sizeof(Entry));
+	to->count = from->count;
+
+	return 0;
+}
+
+
+static int keyListAdd(KeyList* list, uint64_t key)
+{
+	if (list->count == list->cap)
+	{
+		const unsigned int newCap = (list->cap == 0) ? 1024 : list->cap * 2;
+		uint64_t* newKeys = realloc(list->keys, newCap * sizeof(uint64_t));
+		if (!newKeys)
+		{
+			ERRLOG("keyListAdd: Alloc failed!");
+			return -1;
+		}
+
+		list->keys = newKeys;
+		list->cap = newCap;
+	}
+
+	list->keys[list->count++] = key;
+	return 0;
+}
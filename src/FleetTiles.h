@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FleetTiles_h_
+#define _FleetTiles_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Zoom levels 0 (whole world) to FLEETTILES_MAX_ZOOM, using the usual web map tiling (2^z x 2^z tiles at zoom z).
+#define FLEETTILES_MAX_ZOOM		(12)
+
+// A tile request returns the aggregates of its sub-tiles this many levels deeper (up to 8 x 8 sub-tiles).
+#define FLEETTILES_SUBTILE_LEVELS	(3)
+
+#define FLEETTILES_INTERVAL_MIN		(1)
+#define FLEETTILES_INTERVAL_MAX		(3600)
+
+
+typedef struct
+{
+	// Any unique (non-zero) identifier for the boat, stable across builds
+	uint64_t id;
+
+	double lat;
+	double lon;
+} FleetTileBoat;
+
+typedef struct
+{
+	int z;
+	int x;
+	int y;
+
+	unsigned int count;
+
+	// Representative (mean) position of the boats in the tile
+	double lat;
+	double lon;
+} FleetTile;
+
+
+// Enables fleet tile building every interval ticks.
+int FleetTiles_init(unsigned int interval);
+bool FleetTiles_isEnabled();
+
+// Updates the fleet tiles from all boats visible on the map (i.e. not hidden and not in celestial navigation mode), when due.
+// Must be called from the main thread (which is the only writer of boats and the boat registry).
+void FleetTiles_update();
+
+// Updates the tile aggregates from the given (visible) boats, incrementally from the previous build, and publishes them.
+// Boats missing since the previous build are removed. Must only be called from one thread at a time.
+int FleetTiles_build(const FleetTileBoat* boats, unsigned int count);
+
+// Fills tiles (up to maxTiles) with the non-empty sub-tiles of tile z/x/y from the latest build. Returns the number filled,
+// or -1 on failure.
+int FleetTiles_getSubTiles(int z, int x, int y, FleetTile* tiles, unsigned int maxTiles);
+
+// Returns the "z,x,y,count,lat,lon" sub-tile lines (each newline-terminated) for tile z/x/y from the latest build, or null on failure.
+const char* FleetTiles_getTileResponse(int z, int x, int y);
+void FleetTiles_freeTileResponse(const char* resp);
+
+bool FleetTiles_isValidTile(int z, int x, int y);
+
+
+#endif // _FleetTiles_h_
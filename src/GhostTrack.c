@@ -0,0 +1,1088 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <sqlite3.h>
+
+#include "GhostTrack.h"
+
+#include "ErrLog.h"
+
+
+#define ERRLOG_ID "GhostTrack"
+#define THREAD_NAME "GhostLoader"
+
+#define EARTH_RADIUS (6371000.0)
+
+#define COORD_SCALE (1000000.0)
+#define LON_RANGE (360000000LL)
+
+// Largest encoding of one point: three varints of up to 10 bytes each
+#define MAX_POINT_BYTES (30)
+
+#define POINTS_INIT_CAP (1024)
+
+
+typedef struct
+{
+	time_t t;
+	int32_t lat;
+	int32_t lon;
+
+	// Byte offset of the deltas of the point following the keyframe point
+	size_t offset;
+} Keyframe;
+
+struct GhostTrack
+{
+	unsigned int count;
+	time_t endTime;
+
+	uint8_t* data;
+	size_t dataSize;
+
+	Keyframe* keys;
+	unsigned int keyCount;
+
+	// Source loaded from (null if not loaded), and ghost boats using the track
+	char* source;
+	atomic_uint refs;
+};
+
+// Track (being) loaded for a source, only touched by the main thread
+typedef struct CachedTrack CachedTrack;
+struct CachedTrack
+{
+	char* source;
+
+	// Null while loading, or if loading failed
+	GhostTrack* track;
+	bool loading;
+
+	// Main thread use sequence, for evicting the least recently used unreferenced tracks
+	unsigned long lastUsed;
+
+	CachedTrack* next;
+};
+
+// Track for the loader thread to load, handed back once loaded (with track null if loading failed)
+typedef struct LoadRequest LoadRequest;
+struct LoadRequest
+{
+	char* source;
+	GhostTrack* track;
+	LoadRequest* next;
+};
+
+typedef struct
+{
+	time_t* times;
+	proteus_GeoPos* positions;
+	unsigned int count;
+	unsigned int cap;
+} Points;
+
+
+static void* loaderThreadMain(void* arg);
+static void publishLoaded();
+static CachedTrack* findCached(const char* source);
+static void removeCached(CachedTrack* ct);
+static void evictUnused();
+static GhostTrack* loadFile(const char* source);
+static GhostTrack* loadSql(const char* boatName);
+static int addPoint(Points* p, time_t t, double lat, double lon);
+static GhostTrack* encodePoints(Points* p);
+static void seek(GhostCursor* c, time_t t);
+static void step(GhostCursor* c);
+static void decodeNext(GhostCursor* c);
+static size_t putVarint(uint8_t* buf, uint64_t v);
+static uint64_t getVarint(const uint8_t* buf, size_t* offset);
+static uint64_t zigzag(int64_t v);
+static int64_t unzigzag(uint64_t v);
+static int32_t wrapLon(int64_t lon);
+
+
+// Where tracks are loaded from, which the loader thread holds the lock for while loading
+static pthread_mutex_t _configLock = PTHREAD_MUTEX_INITIALIZER;
+static char* _sqliteDbFilename = 0;
+static char* _trackDir = 0;
+
+static CachedTrack* _cache = 0;
+static unsigned long _useSeq = 0;
+
+// Requests waiting for the loader thread, and those it's done with (waiting for the main thread)
+static pthread_mutex_t _loadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _loadCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _loadedCond = PTHREAD_COND_INITIALIZER;
+static LoadRequest* _pending = 0;
+static LoadRequest* _loaded = 0;
+static bool _loaderStarted = false;
+
+
+int GhostTrack_init(const char* sqliteDbFilename, const char* trackDir)
+{
+	pthread_mutex_lock(&_configLock);
+
+	free(_sqliteDbFilename);
+	free(_trackDir);
+	_sqliteDbFilename = 0;
+	_trackDir = 0;
+
+	if (sqliteDbFilename && !(_sqliteDbFilename = strdup(sqliteDbFilename)))
+	{
+		ERRLOG("Failed to alloc DB filename!");
+		pthread_mutex_unlock(&_configLock);
+		return -1;
+	}
+
+	if (trackDir && !(_trackDir = realpath(trackDir, 0)))
+	{
+		ERRLOG1("Ghost track directory %s not found!", trackDir);
+		pthread_mutex_unlock(&_configLock);
+		return -1;
+	}
+
+	pthread_mutex_unlock(&_configLock);
+
+	if (!_loaderStarted)
+	{
+		pthread_t thread;
+		if (0 != pthread_create(&thread, 0, &loaderThreadMain, 0))
+		{
+			ERRLOG("Failed to start ghost track loader thread!");
+			return -1;
+		}
+
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+		if (0 != pthread_setname_np(thread, THREAD_NAME))
+		{
+			ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", THREAD_NAME);
+		}
+#endif
+
+		pthread_detach(thread);
+		_loaderStarted = true;
+	}
+
+	return 0;
+}
+
+int GhostTrack_request(const char* source)
+{
+	publishLoaded();
+
+	CachedTrack* ct = findCached(source);
+	if (ct)
+	{
+		if (ct->loading)
+		{
+			return GHOSTTRACK_LOADING;
+		}
+		else if (!ct->track)
+		{
+			// Failed, which is reported once (with a later request trying again).
+			removeCached(ct);
+			return GHOSTTRACK_FAILED;
+		}
+
+		ct->lastUsed = ++_useSeq;
+		evictUnused();
+
+		return GHOSTTRACK_READY;
+	}
+
+	ct = malloc(sizeof(CachedTrack));
+	LoadRequest* req = malloc(sizeof(LoadRequest));
+	if (!ct || !req || !(ct->source = strdup(source)) || !(req->source = strdup(source)))
+	{
+		ERRLOG("Failed to alloc ghost track load request!");
+		if (ct && req)
+		{
+			free(ct->source);
+		}
+		free(ct);
+		free(req);
+		return GHOSTTRACK_FAILED;
+	}
+
+	ct->track = 0;
+	ct->loading = true;
+	ct->lastUsed = ++_useSeq;
+	ct->next = _cache;
+	_cache = ct;
+
+	req->track = 0;
+
+	pthread_mutex_lock(&_loadLock);
+	req->next = _pending;
+	_pending = req;
+	pthread_cond_signal(&_loadCond);
+	pthread_mutex_unlock(&_loadLock);
+
+	return GHOSTTRACK_LOADING;
+}
+
+const GhostTrack* GhostTrack_get(const char* source)
+{
+	CachedTrack* ct = findCached(source);
+	if (!ct || !ct->track)
+	{
+		return 0;
+	}
+
+	ct->lastUsed = ++_useSeq;
+	return ct->track;
+}
+
+const GhostTrack* GhostTrack_load(const char* source)
+{
+	int rc;
+	while ((rc = GhostTrack_request(source)) == GHOSTTRACK_LOADING)
+	{
+		pthread_mutex_lock(&_loadLock);
+		while (!_loaded)
+		{
+			pthread_cond_wait(&_loadedCond, &_loadLock);
+		}
+		pthread_mutex_unlock(&_loadLock);
+	}
+
+	if (rc != GHOSTTRACK_READY)
+	{
+		ERRLOG1("No usable track found for ghost source %s!", source);
+		return 0;
+	}
+
+	return GhostTrack_get(source);
+}
+
+const char* GhostTrack_getSource(const GhostTrack* track)
+{
+	return track->source;
+}
+
+void GhostTrack_retain(const GhostTrack* track)
+{
+	atomic_fetch_add(&((GhostTrack*) track)->refs, 1);
+}
+
+void GhostTrack_release(const GhostTrack* track)
+{
+	atomic_fetch_sub(&((GhostTrack*) track)->refs, 1);
+}
+
+unsigned int GhostTrack_getUsed(const GhostTrack** tracks, unsigned int maxCount)
+{
+	unsigned int count = 0;
+
+	for (CachedTrack* ct = _cache; ct; ct = ct->next)
+	{
+		if (ct->track && atomic_load(&ct->track->refs) > 0)
+		{
+			if (count < maxCount)
+			{
+				tracks[count] = ct->track;
+			}
+
+			count++;
+		}
+	}
+
+	return count;
+}
+
+int GhostTrack_put(const char* source, GhostTrack* track)
+{
+	publishLoaded();
+
+	CachedTrack* ct = findCached(source);
+	if (ct)
+	{
+		if (!ct->track)
+		{
+			ERRLOG1("Ghost track for source %s is still being loaded (or failed to load)!", source);
+			GhostTrack_free(track);
+			return -1;
+		}
+
+		GhostTrack_free(track);
+		ct->lastUsed = ++_useSeq;
+		return 0;
+	}
+
+	ct = malloc(sizeof(CachedTrack));
+	if (!ct || !(ct->source = strdup(source)) || !(track->source = strdup(source)))
+	{
+		ERRLOG("Failed to alloc cached ghost track!");
+		if (ct)
+		{
+			free(ct->source);
+		}
+		free(ct);
+		GhostTrack_free(track);
+		return -1;
+	}
+
+	ct->track = track;
+	ct->loading = false;
+	ct->lastUsed = ++_useSeq;
+	ct->next = _cache;
+	_cache = ct;
+
+	return 0;
+}
+
+void GhostTrack_getData(const GhostTrack* track, GhostTrackData* data)
+{
+	data->startTime = track->keys[0].t;
+	data->startLat = track->keys[0].lat;
+	data->startLon = track->keys[0].lon;
+	data->count = track->count;
+	data->data = track->data;
+	data->dataSize = track->dataSize;
+}
+
+GhostTrack* GhostTrack_fromData(const GhostTrackData* data)
+{
+	if (data->count == 0 || data->count > GHOSTTRACK_MAX_POINTS || data->dataSize > ((size_t) (data->count - 1)) * MAX_POINT_BYTES)
+	{
+		return 0;
+	}
+
+	GhostTrack* track = malloc(sizeof(GhostTrack));
+	if (!track)
+	{
+		return 0;
+	}
+
+	track->source = 0;
+	atomic_init(&track->refs, 0);
+
+	// Zero padded, so that decoding stops (at a zero byte) just past the end of data that ends partway through a point.
+	track->data = calloc(data->dataSize + MAX_POINT_BYTES, 1);
+	track->keyCount = (data->count + GHOSTTRACK_KEYFRAME_INTERVAL - 1) / GHOSTTRACK_KEYFRAME_INTERVAL;
+	track->keys = malloc(track->keyCount * sizeof(Keyframe));
+	if (!track->data || !track->keys)
+	{
+		GhostTrack_free(track);
+		return 0;
+	}
+
+	memcpy(track->data, data->data, data->dataSize);
+
+	size_t offset = 0;
+	time_t t = data->startTime;
+	int32_t lat = data->startLat;
+	int32_t lon = data->startLon;
+
+	for (unsigned int n = 0; n < data->count; n++)
+	{
+		if (n > 0)
+		{
+			const uint64_t dt = getVarint(track->data, &offset);
+			lat = (int32_t) (lat + unzigzag(getVarint(track->data, &offset)));
+			lon = wrapLon(lon + unzigzag(getVarint(track->data, &offset)));
+
+			if (dt == 0 || offset > data->dataSize)
+			{
+				GhostTrack_free(track);
+				return 0;
+			}
+
+			t += (time_t) dt;
+		}
+
+		if (n % GHOSTTRACK_KEYFRAME_INTERVAL == 0)
+		{
+			Keyframe* k = track->keys + (n / GHOSTTRACK_KEYFRAME_INTERVAL);
+			k->t = t;
+			k->lat = lat;
+			k->lon = lon;
+			k->offset = offset;
+		}
+	}
+
+	if (offset != data->dataSize)
+	{
+		GhostTrack_free(track);
+		return 0;
+	}
+
+	track->count = data->count;
+	track->endTime = t;
+	track->dataSize = data->dataSize;
+
+	return track;
+}
+
+GhostTrack* GhostTrack_new(const time_t* times, const proteus_GeoPos* positions, unsigned int count)
+{
+	if (count == 0 || count > GHOSTTRACK_MAX_POINTS)
+	{
+		return 0;
+	}
+
+	GhostTrack* track = malloc(sizeof(GhostTrack));
+	if (!track)
+	{
+		return 0;
+	}
+
+	track->source = 0;
+	atomic_init(&track->refs, 0);
+
+	track->data = malloc(((size_t) count) * MAX_POINT_BYTES);
+	track->keys = malloc(((count + GHOSTTRACK_KEYFRAME_INTERVAL - 1) / GHOSTTRACK_KEYFRAME_INTERVAL) * sizeof(Keyframe));
+	if (!track->data || !track->keys)
+	{
+		GhostTrack_free(track);
+		return 0;
+	}
+
+	unsigned int n = 0;
+	size_t offset = 0;
+	time_t prevT = 0;
+	int32_t prevLat = 0;
+	int32_t prevLon = 0;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (n > 0 && times[i] <= prevT)
+		{
+			continue;
+		}
+
+		const double lat = fmax(-90.0, fmin(90.0, positions[i].lat));
+		const int32_t iLat = (int32_t) lround(lat * COORD_SCALE);
+		const int32_t iLon = wrapLon(llround(positions[i].lon * COORD_SCALE));
+
+		if (n > 0)
+		{
+			offset += putVarint(track->data + offset, (uint64_t) (times[i] - prevT));
+			offset += putVarint(track->data + offset, zigzag(iLat - prevLat));
+			offset += putVarint(track->data + offset, zigzag(wrapLon(((int64_t) iLon) - prevLon)));
+		}
+
+		if (n % GHOSTTRACK_KEYFRAME_INTERVAL == 0)
+		{
+			Keyframe* k = track->keys + (n / GHOSTTRACK_KEYFRAME_INTERVAL);
+			k->t = times[i];
+			k->lat = iLat;
+			k->lon = iLon;
+			k->offset = offset;
+		}
+
+		prevT = times[i];
+		prevLat = iLat;
+		prevLon = iLon;
+		n++;
+	}
+
+	track->count = n;
+	track->endTime = prevT;
+	track->keyCount = (n + GHOSTTRACK_KEYFRAME_INTERVAL - 1) / GHOSTTRACK_KEYFRAME_INTERVAL;
+	track->dataSize = offset;
+
+	// Shrink the buffers down to what was actually used.
+	uint8_t* data = realloc(track->data, (offset > 0 ? offset : 1));
+	if (data)
+	{
+		track->data = data;
+	}
+
+	Keyframe* keys = realloc(track->keys, track->keyCount * sizeof(Keyframe));
+	if (keys)
+	{
+		track->keys = keys;
+	}
+
+	return track;
+}
+
+void GhostTrack_free(GhostTrack* track)
+{
+	if (!track)
+	{
+		return;
+	}
+
+	free(track->data);
+	free(track->keys);
+	free(track->source);
+	free(track);
+}
+
+unsigned int GhostTrack_getPointCount(const GhostTrack* track)
+{
+	return track->count;
+}
+
+size_t GhostTrack_getEncodedSize(const GhostTrack* track)
+{
+	return track->dataSize + track->keyCount * sizeof(Keyframe);
+}
+
+time_t GhostTrack_getStartTime(const GhostTrack* track)
+{
+	return track->keys[0].t;
+}
+
+time_t GhostTrack_getEndTime(const GhostTrack* track)
+{
+	return track->endTime;
+}
+
+void GhostTrack_initCursor(GhostCursor* c, const GhostTrack* track)
+{
+	c->track = track;
+	seek(c, track->keys[0].t);
+}
+
+bool GhostTrack_position(GhostCursor* c, time_t t, proteus_GeoPos* pos, proteus_GeoVec* v)
+{
+	const GhostTrack* track = c->track;
+
+	if (t < c->t0)
+	{
+		seek(c, t);
+	}
+	else if (t >= c->t1)
+	{
+		// Jump ahead with the keyframes if the next one has already been passed, otherwise just step forward.
+		const unsigned int nextKey = c->index / GHOSTTRACK_KEYFRAME_INTERVAL + 1;
+		if (nextKey < track->keyCount && track->keys[nextKey].t <= t)
+		{
+			seek(c, t);
+		}
+	}
+
+	while (t >= c->t1 && c->index + 2 < track->count)
+	{
+		step(c);
+	}
+
+	if (t < c->t0 || t >= c->t1)
+	{
+		// Before the start of the track (holding at the first point) or past its end (holding at the last point).
+		const bool ended = (t >= c->t1);
+
+		pos->lat = (ended ? c->lat1 : c->lat0) / COORD_SCALE;
+		pos->lon = (ended ? c->lon1 : c->lon0) / COORD_SCALE;
+		v->angle = 0.0;
+		v->mag = 0.0;
+
+		return !ended;
+	}
+
+	const double f = ((double) (t - c->t0)) / ((double) (c->t1 - c->t0));
+	const double dLat = (double) (c->lat1 - c->lat0);
+	const double dLon = (double) wrapLon(((int64_t) c->lon1) - c->lon0);
+
+	pos->lat = (c->lat0 + f * dLat) / COORD_SCALE;
+	pos->lon = (c->lon0 + f * dLon) / COORD_SCALE;
+	if (pos->lon >= 180.0)
+	{
+		pos->lon -= 360.0;
+	}
+	else if (pos->lon < -180.0)
+	{
+		pos->lon += 360.0;
+	}
+
+	*v = c->v;
+
+	return true;
+}
+
+
+static void* loaderThreadMain(void* arg)
+{
+	(void) arg;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&_loadLock);
+		while (!_pending)
+		{
+			pthread_cond_wait(&_loadCond, &_loadLock);
+		}
+
+		LoadRequest* req = _pending;
+		_pending = req->next;
+		pthread_mutex_unlock(&_loadLock);
+
+		pthread_mutex_lock(&_configLock);
+		GhostTrack* track = (strchr(req->source, '/') ? loadFile(req->source) : loadSql(req->source));
+		pthread_mutex_unlock(&_configLock);
+
+		if (!track)
+		{
+			ERRLOG1("No usable track found for ghost source %s!", req->source);
+		}
+		else if (!(track->source = strdup(req->source)))
+		{
+			ERRLOG("Failed to alloc ghost track source!");
+			GhostTrack_free(track);
+			track = 0;
+		}
+
+		req->track = track;
+
+		pthread_mutex_lock(&_loadLock);
+		req->next = _loaded;
+		_loaded = req;
+		pthread_cond_broadcast(&_loadedCond);
+		pthread_mutex_unlock(&_loadLock);
+	}
+
+	return 0;
+}
+
+// Takes the tracks the loader thread is done with into the cache.
+static void publishLoaded()
+{
+	pthread_mutex_lock(&_loadLock);
+	LoadRequest* req = _loaded;
+	_loaded = 0;
+	pthread_mutex_unlock(&_loadLock);
+
+	while (req)
+	{
+		LoadRequest* next = req->next;
+
+		// (Entries being loaded are never removed.)
+		CachedTrack* ct = findCached(req->source);
+		ct->track = req->track;
+		ct->loading = false;
+
+		free(req->source);
+		free(req);
+		req = next;
+	}
+}
+
+static CachedTrack* findCached(const char* source)
+{
+	for (CachedTrack* ct = _cache; ct; ct = ct->next)
+	{
+		if (strcmp(ct->source, source) == 0)
+		{
+			return ct;
+		}
+	}
+
+	return 0;
+}
+
+static void removeCached(CachedTrack* ct)
+{
+	for (CachedTrack** p = &_cache; *p; p = &(*p)->next)
+	{
+		if (*p == ct)
+		{
+			*p = ct->next;
+			break;
+		}
+	}
+
+	GhostTrack_free(ct->track);
+	free(ct->source);
+	free(ct);
+}
+
+// Frees the least recently used tracks not used by any ghost boat, beyond GHOSTTRACK_CACHE_MAX_UNUSED of them.
+static void evictUnused()
+{
+	for (;;)
+	{
+		unsigned int unused = 0;
+		CachedTrack* oldest = 0;
+
+		for (CachedTrack* ct = _cache; ct; ct = ct->next)
+		{
+			if (ct->track && atomic_load(&ct->track->refs) == 0)
+			{
+				unused++;
+
+				if (!oldest || ct->lastUsed < oldest->lastUsed)
+				{
+					oldest = ct;
+				}
+			}
+		}
+
+		if (unused <= GHOSTTRACK_CACHE_MAX_UNUSED)
+		{
+			return;
+		}
+
+		removeCached(oldest);
+	}
+}
+
+// Loads a CSV track file, which must be a regular file (of no more than GHOSTTRACK_MAX_FILE_SIZE) within the track
+// directory, so that a source can't point at (and stall loading on) a FIFO, device or huge file, or anything else.
+static GhostTrack* loadFile(const char* source)
+{
+	if (!_trackDir)
+	{
+		ERRLOG1("No ghost track directory set, so not loading ghost track file %s!", source);
+		return 0;
+	}
+
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof(path), "%s%s%s", (source[0] == '/') ? "" : _trackDir, (source[0] == '/') ? "" : "/", source) >= (int) sizeof(path))
+	{
+		ERRLOG1("Ghost track file path too long: %s", source);
+		return 0;
+	}
+
+	char* resolved = realpath(path, 0);
+	const size_t dirLen = (strcmp(_trackDir, "/") == 0) ? 0 : strlen(_trackDir);
+	if (!resolved || strncmp(resolved, _trackDir, dirLen) != 0 || resolved[dirLen] != '/')
+	{
+		ERRLOG1("Ghost track file %s not found in the ghost track directory!", source);
+		free(resolved);
+		return 0;
+	}
+
+	// Opened without blocking, and checked by what was opened (rather than by path, which could change meanwhile).
+	const int fd = open(resolved, O_RDONLY | O_NONBLOCK | O_NOCTTY);
+	free(resolved);
+
+	struct stat st;
+	if (fd < 0 || 0 != fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size > GHOSTTRACK_MAX_FILE_SIZE)
+	{
+		ERRLOG1("Ghost track file %s is not a readable regular file of up to the maximum size!", source);
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return 0;
+	}
+
+	FILE* f = fdopen(fd, "r");
+	if (!f)
+	{
+		ERRLOG1("Failed to open ghost track file %s!", source);
+		close(fd);
+		return 0;
+	}
+
+	Points p = { 0, 0, 0, 0 };
+	char* line = 0;
+	size_t lineCap = 0;
+
+	while (getline(&line, &lineCap, f) > 0)
+	{
+		// Lines of "time,lat,lon" with anything following ignored (so CSV boat logs can be used directly).
+		char* e;
+		const long long t = strtoll(line, &e, 10);
+		if (e == line || *e != ',')
+		{
+			continue;
+		}
+
+		char* s = e + 1;
+		const double lat = strtod(s, &e);
+		if (e == s || *e != ',')
+		{
+			continue;
+		}
+
+		s = e + 1;
+		const double lon = strtod(s, &e);
+		if (e == s)
+		{
+			continue;
+		}
+
+		if (0 != addPoint(&p, (time_t) t, lat, lon))
+		{
+			break;
+		}
+	}
+
+	free(line);
+	fclose(f);
+
+	return encodePoints(&p);
+}
+
+static GhostTrack* loadSql(const char* boatName)
+{
+	if (!_sqliteDbFilename)
+	{
+		return 0;
+	}
+
+	FILE* fdb = fopen(_sqliteDbFilename, "r");
+	if (fdb == 0)
+	{
+		// No DB, so no logged tracks.
+		return 0;
+	}
+	fclose(fdb);
+
+	sqlite3* sql;
+	sqlite3_stmt* stmt;
+	int src;
+
+	if (SQLITE_OK != (src = sqlite3_open(_sqliteDbFilename, &sql)))
+	{
+		ERRLOG1("Failed to open SQLite DB. sqlite rc=%d", src);
+		return 0;
+	}
+
+	static const char* SELECT_BOATLOG_TRACK_STMT_STR = "SELECT time, lat, lon FROM BoatLog WHERE boatName = ? ORDER BY time;";
+	if (SQLITE_OK != (src = sqlite3_prepare_v2(sql, SELECT_BOATLOG_TRACK_STMT_STR, strlen(SELECT_BOATLOG_TRACK_STMT_STR) + 1, &stmt, 0)))
+	{
+		ERRLOG1("Failed to prepare BoatLog track select statement. sqlite rc=%d", src);
+		sqlite3_close(sql);
+		return 0;
+	}
+
+	Points p = { 0, 0, 0, 0 };
+
+	if (SQLITE_OK != (src = sqlite3_bind_text(stmt, 1, boatName, -1, SQLITE_STATIC)))
+	{
+		ERRLOG1("Failed to bind boat name for BoatLog track select! sqlite rc=%d", src);
+	}
+	else
+	{
+		while (SQLITE_ROW == (src = sqlite3_step(stmt)))
+		{
+			if (0 != addPoint(&p, (time_t) sqlite3_column_int64(stmt, 0), sqlite3_column_double(stmt, 1), sqlite3_column_double(stmt, 2)))
+			{
+				break;
+			}
+		}
+
+		if (SQLITE_DONE != src && SQLITE_ROW != src)
+		{
+			ERRLOG1("Failed to step BoatLog track select statement! sqlite rc=%d", src);
+		}
+	}
+
+	if (SQLITE_OK != (src = sqlite3_finalize(stmt)))
+	{
+		ERRLOG1("Failed to finalize BoatLog track statement! sqlite rc=%d", src);
+	}
+
+	if (SQLITE_OK != (src = sqlite3_close(sql)))
+	{
+		ERRLOG1("Failed to close SQLite DB! sqlite rc=%d", src);
+	}
+
+	return encodePoints(&p);
+}
+
+static int addPoint(Points* p, time_t t, double lat, double lon)
+{
+	if (lat < -90.0 || lat > 90.0 || lon < -180.0 || lon > 180.0)
+	{
+		// Skip invalid points.
+		return 0;
+	}
+
+	if (p->count == GHOSTTRACK_MAX_POINTS)
+	{
+		ERRLOG("Ghost track has too many points, so truncating.");
+		return -1;
+	}
+
+	if (p->count == p->cap)
+	{
+		const unsigned int cap = (p->cap == 0 ? POINTS_INIT_CAP : p->cap * 2);
+
+		time_t* times = realloc(p->times, cap * sizeof(time_t));
+		if (!times)
+		{
+			ERRLOG("Failed to grow ghost track times!");
+			return -1;
+		}
+		p->times = times;
+
+		proteus_GeoPos* positions = realloc(p->positions, cap * sizeof(proteus_GeoPos));
+		if (!positions)
+		{
+			ERRLOG("Failed to grow ghost track positions!");
+			return -1;
+		}
+		p->positions = positions;
+
+		p->cap = cap;
+	}
+
+	p->times[p->count] = t;
+	p->positions[p->count].lat = lat;
+	p->positions[p->count].lon = lon;
+	p->count++;
+
+	return 0;
+}
+
+static GhostTrack* encodePoints(Points* p)
+{
+	GhostTrack* track = GhostTrack_new(p->times, p->positions, p->count);
+
+	free(p->times);
+	free(p->positions);
+
+	return track;
+}
+
+static void seek(GhostCursor* c, time_t t)
+{
+	const GhostTrack* track = c->track;
+
+	// Find the last keyframe at or before t (or the first one, if t is before the start).
+	unsigned int lo = 0;
+	unsigned int hi = track->keyCount;
+	while (hi - lo > 1)
+	{
+		const unsigned int mid = (lo + hi) / 2;
+		if (track->keys[mid].t <= t)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	const Keyframe* k = track->keys + lo;
+
+	c->index = lo * GHOSTTRACK_KEYFRAME_INTERVAL;
+	c->offset = k->offset;
+	c->t0 = k->t;
+	c->lat0 = k->lat;
+	c->lon0 = k->lon;
+
+	if (c->index + 1 < track->count)
+	{
+		decodeNext(c);
+	}
+	else
+	{
+		c->t1 = c->t0;
+		c->lat1 = c->lat0;
+		c->lon1 = c->lon0;
+		c->v.angle = 0.0;
+		c->v.mag = 0.0;
+	}
+}
+
+static void step(GhostCursor* c)
+{
+	c->index++;
+	c->t0 = c->t1;
+	c->lat0 = c->lat1;
+	c->lon0 = c->lon1;
+
+	decodeNext(c);
+}
+
+static void decodeNext(GhostCursor* c)
+{
+	const uint8_t* data = c->track->data;
+
+	c->t1 = c->t0 + (time_t) getVarint(data, &c->offset);
+	c->lat1 = (int32_t) (c->lat0 + unzigzag(getVarint(data, &c->offset)));
+	c->lon1 = wrapLon(c->lon0 + unzigzag(getVarint(data, &c->offset)));
+
+	// Segment velocity, using a local flat approximation (segments are short).
+	const double mPerUnit = EARTH_RADIUS * M_PI / 180.0 / COORD_SCALE;
+	const double dLat = (double) (c->lat1 - c->lat0);
+	const double dLon = (double) wrapLon(((int64_t) c->lon1) - c->lon0);
+	const double midLat = (c->lat0 + 0.5 * dLat) / COORD_SCALE;
+	const double north = dLat * mPerUnit;
+	const double east = dLon * mPerUnit * cos(midLat * M_PI / 180.0);
+
+	c->v.mag = sqrt(north * north + east * east) / ((double) (c->t1 - c->t0));
+	c->v.angle = atan2(east, north) * 180.0 / M_PI;
+	if (c->v.angle < 0.0)
+	{
+		c->v.angle += 360.0;
+	}
+}
+
+static size_t putVarint(uint8_t* buf, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80)
+	{
+		buf[n++] = (uint8_t) (v | 0x80);
+		v >>= 7;
+	}
+
+	buf[n++] = (uint8_t) v;
+
+	return n;
+}
+
+static uint64_t getVarint(const uint8_t* buf, size_t* offset)
+{
+	uint64_t v = 0;
+	unsigned int shift = 0;
+	uint8_t b;
+
+	do
+	{
+		b = buf[(*offset)++];
+		v |= ((uint64_t) (b & 0x7f)) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	return v;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+	return (((uint64_t) v) << 1) ^ ((uint64_t) (v >> 63));
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+	return (int64_t) (v >> 1) ^ -((int64_t) (v & 1));
+}
+
+static int32_t wrapLon(int64_t lon)
+{
+	// Wraps a longitude (or longitude difference) into [-180, 180) degrees.
+	while (lon >= LON_RANGE / 2)
+	{
+		lon -= LON_RANGE;
+	}
+	while (lon < -LON_RANGE / 2)
+	{
+		lon += LON_RANGE;
+	}
+
+	return (int32_t) lon;
+}
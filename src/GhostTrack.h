@@ -0,0 +1,134 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GhostTrack_h_
+#define _GhostTrack_h_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <proteus/GeoPos.h>
+#include <proteus/GeoVec.h>
+
+
+// Recorded tracks are stored as delta-encoded points (1e-6 degree fixed point), with a keyframe
+// (absolute point and byte offset) every GHOSTTRACK_KEYFRAME_INTERVAL points for seeking.
+#define GHOSTTRACK_KEYFRAME_INTERVAL	(64)
+#define GHOSTTRACK_MAX_POINTS		(10000000)
+
+// Largest CSV track file loaded
+#define GHOSTTRACK_MAX_FILE_SIZE	(256L * 1024 * 1024)
+
+// Loaded tracks kept cached while no ghost boat uses them (with the least recently used beyond this freed)
+#define GHOSTTRACK_CACHE_MAX_UNUSED	(16)
+
+// Results of GhostTrack_request()
+#define GHOSTTRACK_READY		(0)
+#define GHOSTTRACK_LOADING		(1)
+#define GHOSTTRACK_FAILED		(-1)
+
+
+typedef struct GhostTrack GhostTrack;
+
+// Playback position within a track (a segment between two consecutive points)
+typedef struct
+{
+	const GhostTrack* track;
+	unsigned int index;
+	size_t offset;
+
+	time_t t0;
+	time_t t1;
+	int32_t lat0;
+	int32_t lon0;
+	int32_t lat1;
+	int32_t lon1;
+
+	// Velocity over ground along the segment
+	proteus_GeoVec v;
+} GhostCursor;
+
+// Encoded form of a track (such as for handing it over to a new process): the first point, and the deltas of the rest
+typedef struct
+{
+	time_t startTime;
+	int32_t startLat;
+	int32_t startLon;
+	unsigned int count;
+
+	const uint8_t* data;
+	size_t dataSize;
+} GhostTrackData;
+
+
+// Sets where tracks are loaded from: the DB (for boat name sources) and the directory that track files must be in (with
+// file sources rejected if null), and starts the loader thread.
+int GhostTrack_init(const char* sqliteDbFilename, const char* trackDir);
+
+// Requests the track for a source, which is loaded on the loader thread (so that a slow source can't hold up the main
+// thread). Returns GHOSTTRACK_READY once loaded (see GhostTrack_get()), GHOSTTRACK_LOADING while loading (to be requested
+// again later, such as in the next tick), or GHOSTTRACK_FAILED if loading failed (reported once, with a later request
+// loading it again). The source is either a CSV file path (containing '/', relative to or within the track directory) of
+// "time,lat,lon,..." lines (such as a CSV boat log), or a boat name in BoatLog. Must be called from the main thread.
+int GhostTrack_request(const char* source);
+
+// Returns the track for a source if loaded (see GhostTrack_request()), or null. Loaded tracks remain valid while used by
+// a ghost boat (see GhostTrack_retain()). Must be called from the main thread.
+const GhostTrack* GhostTrack_get(const char* source);
+
+// Requests the track for a source and waits for it to be loaded, returning it (or null on failure). For the main thread
+// before it ticks (such as when replaying commands at startup). Must be called from the main thread.
+const GhostTrack* GhostTrack_load(const char* source);
+
+// Returns the source a track was loaded from (or null if made with GhostTrack_new()).
+const char* GhostTrack_getSource(const GhostTrack* track);
+
+// Adds or drops a ghost boat's use of a track (keeping a loaded track cached while used). Safe to call from any thread.
+void GhostTrack_retain(const GhostTrack* track);
+void GhostTrack_release(const GhostTrack* track);
+
+// Gets up to maxCount loaded tracks used by ghost boats, returning how many there are in total (which may be more than
+// maxCount). Must be called from the main thread.
+unsigned int GhostTrack_getUsed(const GhostTrack** tracks, unsigned int maxCount);
+
+// Adds a track (taking ownership of it) as loaded from a source, as if requested and loaded. If the source already has a
+// loaded track, that one's kept (and the given one freed). Returns 0 on success. Must be called from the main thread.
+int GhostTrack_put(const char* source, GhostTrack* track);
+
+// Gets a track's encoded form (pointing into the track), and makes a track from an encoded form (checking that it
+// decodes to exactly count points, and returning null if not).
+void GhostTrack_getData(const GhostTrack* track, GhostTrackData* data);
+GhostTrack* GhostTrack_fromData(const GhostTrackData* data);
+
+// Encodes a track from points in time order (points not later than the previous one are dropped).
+GhostTrack* GhostTrack_new(const time_t* times, const proteus_GeoPos* positions, unsigned int count);
+void GhostTrack_free(GhostTrack* track);
+
+unsigned int GhostTrack_getPointCount(const GhostTrack* track);
+size_t GhostTrack_getEncodedSize(const GhostTrack* track);
+time_t GhostTrack_getStartTime(const GhostTrack* track);
+time_t GhostTrack_getEndTime(const GhostTrack* track);
+
+void GhostTrack_initCursor(GhostCursor* c, const GhostTrack* track);
+
+// Gets the interpolated position and velocity over ground (m/s) at track time t, moving the cursor as needed.
+// Returns false once t is at or past the end of the track (with the last position and zero velocity).
+bool GhostTrack_position(GhostCursor* c, time_t t, proteus_GeoPos* pos, proteus_GeoVec* v);
+
+
+#endif // _GhostTrack_h_
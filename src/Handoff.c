@@ -0,0 +1,1475 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <sailnavsim_boatregistry.h>
+
+#include "Handoff.h"
+
+#include "BoatRegistry.h"
+#include "CommandSchedule.h"
+#include "ErrLog.h"
+#include "GhostTrack.h"
+#include "Logger.h"
+#include "NetServer.h"
+#include "RaceMarks.h"
+#include "Zones.h"
+
+
+#define ERRLOG_ID "Handoff"
+#define THREAD_NAME_LISTEN "HandoffListen"
+#define THREAD_NAME_FORWARD "HandoffFwd"
+
+
+// Protocol (host byte order, since both processes always run on the same machine):
+//
+//   Hello (new to old, on connect): u32 magic, u16 version, u16 reserved
+//
+//   Handover (old to new, at the end of a tick): u32 magic, u8 fd mask (bits by HANDOFF_FD_*), u8 reserved,
+//     u16 pending input length, u64 snapshot length, sent along with the fds in the mask (in HANDOFF_FD_* order),
+//     then the pending command input, then the snapshot
+//
+//   Ready (new to old, once the snapshot is applied): u32 magic
+//
+//   Commit (old to new, once ready): u32 magic, after which the old process never carries on itself, and without which
+//     the new process never ticks
+//
+//   Forwarded commands (old to new, while draining): u32 length, then the command string (with "@<exec time>," in
+//     front if scheduled), with a length of 0 ending the stream
+//
+//   Snapshot: u32 magic, u16 version, u16 reserved, i64 tick time, i64 handoff time (CLOCK_REALTIME ns),
+//     u32 boat count, u32 mark count, u32 ghost track count, then
+//       ghost tracks: str source, i64 start time, i32 start lat, i32 start lon, u32 point count, u64 data size, data
+//       boats: str name, str group, str alt name, boat fields, str ghost track source (then ghost cursor, if not null)
+//       marks: str group, str name, i32 type, f64 p1 lat, f64 p1 lon, f64 p2 lat, f64 p2 lon
+//
+//   Strings are a u16 length (or STR_NULL) followed by the bytes (without terminator).
+
+#define HANDOFF_MAGIC (0x534e5348)
+#define HANDOFF_VERSION (2)
+
+#define HELLO_SIZE (8)
+#define HANDOVER_SIZE (4 + 1 + 1 + 2 + 8)
+#define READY_SIZE (4)
+#define COMMIT_SIZE (4)
+
+#define SNAPSHOT_HEADER_SIZE (4 + 2 + 2 + 8 + 8 + 4 + 4 + 4)
+#define SNAPSHOT_COUNTS_OFFSET (4 + 2 + 2 + 8 + 8)
+#define SNAPSHOT_MAX_SIZE ((uint64_t) 16 * 1024 * 1024 * 1024)
+
+#define BOAT_FIELDS_SIZE (6 * 8 + 3 * 8 + 3 * 4 + 5 + 3 * 8 + 8)
+#define GHOST_CURSOR_SIZE (4 + 8 + 2 * 8 + 4 * 4 + 2 * 8)
+#define MARK_FIELDS_SIZE (4 + 4 * 8)
+#define TRACK_FIELDS_SIZE (8 + 2 * 4 + 4 + 8)
+
+#define STR_NULL (0xffff)
+#define STR_MAX_LEN (0xfffe)
+
+// Longest forwarded command string
+#define FORWARD_CMD_MAX_LEN (1024)
+
+#define HELLO_TIMEOUT_SEC (5)
+
+// How often the old process forwards commands while draining
+#define DRAIN_CHECK_MS (100)
+
+
+typedef struct
+{
+	const uint8_t* p;
+	const uint8_t* end;
+} Reader;
+
+
+static void* listenThreadMain();
+static void* forwardThreadMain();
+static int startThread(pthread_t* thread, void* (*threadMain)(), const char* name);
+
+static int sendHandover(int sock, const int* fds, const char* pending, size_t pendingLen, const HandoffBuf* snapshot);
+static void requeueCommands(Command* cmds);
+static void drain(int sock, Command* due, time_t curTime);
+static bool forwardCommand(int sock, Command* cmd, bool ok, time_t curTime);
+
+static int writeAll(int fd, const void* buf, size_t len);
+static int readAll(int fd, void* buf, size_t len);
+static int connectOld(const char* path);
+static void setRecvTimeout(int fd, unsigned int sec);
+static long msSince(const struct timespec* t);
+
+static int bufReserve(HandoffBuf* buf, size_t n);
+static int putStr(HandoffBuf* buf, const char* s);
+static int putTrack(HandoffBuf* buf, const GhostTrack* track);
+static int putBoat(HandoffBuf* buf, const BoatEntry* e, const Boat* boat);
+static int putMark(HandoffBuf* buf, const RaceMarkInfo* mark);
+
+static bool getBytes(Reader* r, void* v, size_t n);
+static bool getStr(Reader* r, char** s);
+static int applyTrack(Reader* r);
+static int applyBoat(Reader* r);
+static int applyMark(Reader* r);
+
+
+// Old process side
+static int _listenFd = -1;
+static pthread_t _listenThread;
+
+// Connection from the new process waiting to take over (-1 if none)
+static atomic_int _successorFd = -1;
+
+// New process side: connection to the old process (for forwarded commands)
+static int _oldFd = -1;
+static pthread_t _forwardThread;
+
+
+int Handoff_listen(const char* path)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		ERRLOG("Handoff socket path is too long!");
+		return -4;
+	}
+	strcpy(sa.sun_path, path);
+
+	// Remove any stale socket file (or that of the old process, once taken over from).
+	if (unlink(path) != 0 && errno != ENOENT)
+	{
+		ERRLOG1("Failed to unlink existing handoff socket path! errno=%d", errno);
+		return -5;
+	}
+
+	_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (_listenFd < 0)
+	{
+		ERRLOG1("Failed to open socket! errno=%d", errno);
+		return -1;
+	}
+
+	if (0 != bind(_listenFd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)) || 0 != listen(_listenFd, 1))
+	{
+		ERRLOG1("Failed to bind/listen on handoff socket! errno=%d", errno);
+		close(_listenFd);
+		_listenFd = -1;
+		return -2;
+	}
+
+	if (0 != startThread(&_listenThread, &listenThreadMain, THREAD_NAME_LISTEN))
+	{
+		return -3;
+	}
+
+	ERRLOG1("Handoff listening on %s", path);
+	return 0;
+}
+
+bool Handoff_isRequested()
+{
+	return (atomic_load(&_successorFd) >= 0);
+}
+
+int Handoff_run(time_t curTime)
+{
+	const int sock = atomic_load(&_successorFd);
+	if (sock < 0)
+	{
+		return -1;
+	}
+
+	// Boat logs can take a while to write (for many boats), so the handoff waits for a tick when there are none being
+	// written, rather than for them to be written after the tick (with neither process serving in the meantime).
+	if (!Logger_isIdle())
+	{
+		return 1;
+	}
+
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	// Commands scheduled during this tick are persisted (for the new process to load), and any already due are
+	// forwarded along with the rest.
+	Command* due = CommandSchedule_takeDue(curTime);
+
+	// Logs (and scheduled commands) all in the DB before the new process carries on from them.
+	Logger_flush();
+
+	HandoffBuf snapshot = { 0, 0, 0 };
+	int fds[HANDOFF_FD_COUNT] = { -1, -1, -1 };
+	char pending[COMMAND_INPUT_PENDING_MAX];
+	size_t pendingLen = 0;
+
+	int rc = Handoff_encodeSnapshot(curTime, &snapshot);
+	if (rc != 0)
+	{
+		ERRLOG("Failed to encode handoff snapshot!");
+	}
+	else
+	{
+		// From here, new connections wait in the listen backlog (for the new process to accept them), and command
+		// input in the FIFO.
+		NetServer_getListenFds(fds + HANDOFF_FD_NET, fds + HANDOFF_FD_HTTP);
+		if ((rc = NetServer_stopAccepting()) == 0)
+		{
+			fds[HANDOFF_FD_CMD] = Command_stopInput(pending, &pendingLen);
+
+			rc = sendHandover(sock, fds, pending, pendingLen, &snapshot);
+
+			uint32_t magic = 0;
+			if (rc == 0 && (0 != readAll(sock, &magic, READY_SIZE) || magic != HANDOFF_MAGIC))
+			{
+				ERRLOG("New process didn't take over!");
+				rc = -1;
+			}
+
+			// Past this point, this process never carries on ticking, since the new process may have started. (If
+			// sending fails, the new process can't have received it, and exits without ticking.)
+			magic = HANDOFF_MAGIC;
+			if (rc == 0 && 0 != writeAll(sock, &magic, COMMIT_SIZE))
+			{
+				ERRLOG("Failed to commit handoff to new process!");
+				rc = -1;
+			}
+		}
+	}
+
+	const size_t snapshotLen = snapshot.len;
+	HandoffBuf_free(&snapshot);
+
+	if (rc != 0)
+	{
+		ERRLOG("Handoff failed, so carrying on.");
+
+		if (fds[HANDOFF_FD_CMD] >= 0 && 0 != Command_startInput(fds[HANDOFF_FD_CMD], pending, pendingLen))
+		{
+			ERRLOG("Failed to restart command input!");
+		}
+
+		if (0 != NetServer_resumeAccepting())
+		{
+			ERRLOG("Failed to resume accepting connections!");
+		}
+
+		requeueCommands(due);
+
+		close(sock);
+		atomic_store(&_successorFd, -1);
+		return -1;
+	}
+
+	ERRLOG3("Handed over after tick %ld (snapshot of %zu bytes), in %ld ms. Draining...", curTime, snapshotLen, msSince(&t0));
+
+	drain(sock, due, curTime);
+	close(sock);
+
+	ERRLOG1("Drained, %ld ms after handoff.", msSince(&t0));
+	return 0;
+}
+
+int Handoff_takeover(const char* path, HandoffState* state)
+{
+	memset(state, 0, sizeof(HandoffState));
+	for (unsigned int i = 0; i < HANDOFF_FD_COUNT; i++)
+	{
+		state->fds[i] = -1;
+	}
+
+	const int fd = connectOld(path);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	uint8_t handover[HANDOVER_SIZE];
+	int fds[HANDOFF_FD_COUNT];
+	unsigned int fdCount;
+
+	if (0 != Handoff_receiveFds(fd, fds, HANDOFF_FD_COUNT, &fdCount, handover, HANDOVER_SIZE))
+	{
+		ERRLOG("Failed to receive handover!");
+		close(fd);
+		return -1;
+	}
+
+	uint32_t magic;
+	uint8_t fdMask;
+	uint16_t pendingLen;
+	uint64_t snapshotLen;
+
+	memcpy(&magic, handover, 4);
+	memcpy(&fdMask, handover + 4, 1);
+	memcpy(&pendingLen, handover + 6, 2);
+	memcpy(&snapshotLen, handover + 8, 8);
+
+	unsigned int j = 0;
+	for (unsigned int i = 0; i < HANDOFF_FD_COUNT; i++)
+	{
+		if ((fdMask & (1 << i)) && j < fdCount)
+		{
+			state->fds[i] = fds[j++];
+		}
+	}
+
+	uint8_t* snapshot = 0;
+
+	if (magic != HANDOFF_MAGIC || j != fdCount || pendingLen > COMMAND_INPUT_PENDING_MAX || snapshotLen > SNAPSHOT_MAX_SIZE)
+	{
+		ERRLOG("Bad handover!");
+		goto fail;
+	}
+
+	if (0 != readAll(fd, state->pending, pendingLen))
+	{
+		ERRLOG("Failed to receive pending command input!");
+		goto fail;
+	}
+	state->pendingLen = pendingLen;
+
+	if (!(snapshot = malloc(snapshotLen)))
+	{
+		ERRLOG("Failed to alloc handoff snapshot!");
+		goto fail;
+	}
+
+	if (0 != readAll(fd, snapshot, snapshotLen))
+	{
+		ERRLOG("Failed to receive handoff snapshot!");
+		goto fail;
+	}
+
+	if (0 != Handoff_applySnapshot(snapshot, snapshotLen, state))
+	{
+		ERRLOG("Failed to apply handoff snapshot!");
+		goto fail;
+	}
+
+	free(snapshot);
+	snapshot = 0;
+
+	magic = HANDOFF_MAGIC;
+	if (0 != writeAll(fd, &magic, READY_SIZE))
+	{
+		ERRLOG("Failed to tell old process it's been taken over from!");
+		goto fail;
+	}
+
+	// The old process may already have given up waiting and carried on, in which case it doesn't commit (and this
+	// process must not tick).
+	setRecvTimeout(fd, HANDOFF_COMMIT_TIMEOUT_SEC);
+	magic = 0;
+	if (0 != readAll(fd, &magic, COMMIT_SIZE) || magic != HANDOFF_MAGIC)
+	{
+		ERRLOG("Old process didn't commit to the handoff!");
+		goto fail;
+	}
+
+	// Forwarded commands may be a while apart, until the old process is done draining.
+	setRecvTimeout(fd, 0);
+	_oldFd = fd;
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	const long sinceHandoffMs = ((now.tv_sec * 1000000000L + now.tv_nsec) - state->handoffTimeNs) / 1000000L;
+
+	ERRLOG5("Took over %u boats (and %u ghost tracks) and %u race marks after tick %ld, %ld ms after handoff", state->boatCount, state->trackCount, state->markCount, state->tickTime, sinceHandoffMs);
+	return 0;
+
+fail:
+	free(snapshot);
+	for (unsigned int i = 0; i < HANDOFF_FD_COUNT; i++)
+	{
+		if (state->fds[i] >= 0)
+		{
+			close(state->fds[i]);
+			state->fds[i] = -1;
+		}
+	}
+	close(fd);
+	return -1;
+}
+
+int Handoff_startForwarded()
+{
+	if (_oldFd < 0)
+	{
+		return -1;
+	}
+
+	return startThread(&_forwardThread, &forwardThreadMain, THREAD_NAME_FORWARD);
+}
+
+void HandoffBuf_free(HandoffBuf* buf)
+{
+	free(buf->data);
+	buf->data = 0;
+	buf->len = 0;
+	buf->cap = 0;
+}
+
+#define PUT(buf, v) do { memcpy((buf)->data + (buf)->len, &(v), sizeof(v)); (buf)->len += sizeof(v); } while (0)
+
+int Handoff_encodeSnapshot(time_t tickTime, HandoffBuf* out)
+{
+	const size_t start = out->len;
+	if (0 != bufReserve(out, SNAPSHOT_HEADER_SIZE))
+	{
+		return -1;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	const uint32_t magic = HANDOFF_MAGIC;
+	const uint16_t version = HANDOFF_VERSION;
+	const uint16_t reserved = 0;
+	const int64_t t = tickTime;
+	const int64_t handoffTimeNs = now.tv_sec * 1000000000L + now.tv_nsec;
+	uint32_t boatCount = 0; // Filled in at the end
+	uint32_t markCount = 0; // Likewise
+	uint32_t trackCount = 0; // Likewise
+
+	PUT(out, magic);
+	PUT(out, version);
+	PUT(out, reserved);
+	PUT(out, t);
+	PUT(out, handoffTimeNs);
+	PUT(out, boatCount);
+	PUT(out, markCount);
+	PUT(out, trackCount);
+
+	// Tracks of ghost boats, so that the new process doesn't have to load them (while neither process is ticking)
+	const unsigned int totalTracks = GhostTrack_getUsed(0, 0);
+	if (totalTracks > 0)
+	{
+		const GhostTrack** tracks = malloc(totalTracks * sizeof(GhostTrack*));
+		if (!tracks)
+		{
+			ERRLOG("Failed to alloc ghost tracks for handoff snapshot!");
+			return -1;
+		}
+
+		GhostTrack_getUsed(tracks, totalTracks);
+
+		for (unsigned int i = 0; i < totalTracks; i++)
+		{
+			if (0 != putTrack(out, tracks[i]))
+			{
+				free(tracks);
+				return -1;
+			}
+		}
+
+		free(tracks);
+		trackCount = totalTracks;
+	}
+
+	// No lock needed here, since only the main thread modifies boats and the boat registry.
+	unsigned int count;
+	void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &count);
+
+	const BoatEntry* e;
+	while ((e = sailnavsim_boatregistry_boats_iterator_get_next(iterator)) != 0)
+	{
+		if (!e->boat && !e->cold)
+		{
+			continue;
+		}
+
+		Boat coldBoat;
+		if (0 != putBoat(out, e, BoatRegistry_view(e, &coldBoat)))
+		{
+			sailnavsim_boatregistry_free_boats_iterator(iterator);
+			return -1;
+		}
+
+		boatCount++;
+	}
+
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+
+	const unsigned int totalMarks = RaceMarks_getMarks(0, 0);
+	if (totalMarks > 0)
+	{
+		RaceMarkInfo* marks = malloc(totalMarks * sizeof(RaceMarkInfo));
+		if (!marks)
+		{
+			ERRLOG("Failed to alloc race marks for handoff snapshot!");
+			return -1;
+		}
+
+		RaceMarks_getMarks(marks, totalMarks);
+
+		for (unsigned int i = 0; i < totalMarks; i++)
+		{
+			if (0 != putMark(out, marks + i))
+			{
+				free(marks);
+				return -1;
+			}
+		}
+
+		free(marks);
+		markCount = totalMarks;
+	}
+
+	memcpy(out->data + start + SNAPSHOT_COUNTS_OFFSET, &boatCount, 4);
+	memcpy(out->data + start + SNAPSHOT_COUNTS_OFFSET + 4, &markCount, 4);
+	memcpy(out->data + start + SNAPSHOT_COUNTS_OFFSET + 8, &trackCount, 4);
+
+	return 0;
+}
+
+#define GET(r, v) getBytes((r), &(v), sizeof(v))
+
+int Handoff_applySnapshot(const uint8_t* data, size_t len, HandoffState* state)
+{
+	Reader r = { data, data + len };
+
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reserved;
+	int64_t t;
+	int64_t handoffTimeNs;
+	uint32_t boatCount;
+	uint32_t markCount;
+	uint32_t trackCount;
+
+	if (!(GET(&r, magic) && GET(&r, version) && GET(&r, reserved) && GET(&r, t) && GET(&r, handoffTimeNs) && GET(&r, boatCount) && GET(&r, markCount) && GET(&r, trackCount)))
+	{
+		return -1;
+	}
+
+	if (magic != HANDOFF_MAGIC || version != HANDOFF_VERSION)
+	{
+		ERRLOG2("Unexpected handoff snapshot magic/version: %x/%u", magic, version);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < trackCount; i++)
+	{
+		if (0 != applyTrack(&r))
+		{
+			ERRLOG1("Failed to apply ghost track %u of handoff snapshot!", i);
+			return -1;
+		}
+	}
+
+	for (uint32_t i = 0; i < boatCount; i++)
+	{
+		if (0 != applyBoat(&r))
+		{
+			ERRLOG1("Failed to apply boat %u of handoff snapshot!", i);
+			return -1;
+		}
+	}
+
+	if (0 != RaceMarks_removeAll())
+	{
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < markCount; i++)
+	{
+		if (0 != applyMark(&r))
+		{
+			ERRLOG1("Failed to apply race mark %u of handoff snapshot!", i);
+			return -1;
+		}
+	}
+
+	if (r.p != r.end)
+	{
+		ERRLOG("Trailing data in handoff snapshot!");
+		return -1;
+	}
+
+	state->tickTime = t;
+	state->handoffTimeNs = handoffTimeNs;
+	state->boatCount = boatCount;
+	state->markCount = markCount;
+	state->trackCount = trackCount;
+
+	return 0;
+}
+
+int Handoff_sendFds(int sock, const int* fds, unsigned int count, const void* data, size_t len)
+{
+	if (count > HANDOFF_FD_COUNT || len == 0)
+	{
+		return -1;
+	}
+
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_FD_COUNT)];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+
+	struct iovec iov = { (void*) data, len };
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (count > 0)
+	{
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+		struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_RIGHTS;
+		c->cmsg_len = CMSG_LEN(sizeof(int) * count);
+		memcpy(CMSG_DATA(c), fds, sizeof(int) * count);
+	}
+
+	ssize_t sb;
+	while ((sb = sendmsg(sock, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+	{
+	}
+
+	if (sb <= 0)
+	{
+		ERRLOG1("Failed to send fds! errno=%d", errno);
+		return -1;
+	}
+
+	// The fds go along with the first part of the data, and the rest follows as usual.
+	return ((size_t) sb < len) ? writeAll(sock, ((const uint8_t*) data) + sb, len - sb) : 0;
+}
+
+int Handoff_receiveFds(int sock, int* fds, unsigned int maxCount, unsigned int* count, void* data, size_t len)
+{
+	*count = 0;
+
+	if (maxCount > HANDOFF_FD_COUNT || len == 0)
+	{
+		return -1;
+	}
+
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(int) * HANDOFF_FD_COUNT)];
+		struct cmsghdr align;
+	} control;
+
+	struct iovec iov = { data, len };
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	ssize_t rb;
+	while ((rb = recvmsg(sock, &msg, 0)) < 0 && errno == EINTR)
+	{
+	}
+
+	if (rb <= 0)
+	{
+		ERRLOG1("Failed to receive fds! errno=%d", errno);
+		return -1;
+	}
+
+	for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+	{
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+		{
+			continue;
+		}
+
+		const unsigned int n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (unsigned int i = 0; i < n; i++)
+		{
+			int fd;
+			memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+
+			if (*count < maxCount)
+			{
+				fds[(*count)++] = fd;
+			}
+			else
+			{
+				close(fd);
+			}
+		}
+	}
+
+	if ((msg.msg_flags & MSG_CTRUNC) || ((size_t) rb < len && 0 != readAll(sock, ((uint8_t*) data) + rb, len - rb)))
+	{
+		for (unsigned int i = 0; i < *count; i++)
+		{
+			close(fds[i]);
+		}
+		*count = 0;
+
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static void* listenThreadMain()
+{
+	for (;;)
+	{
+		const int fd = accept(_listenFd, 0, 0);
+		if (fd < 0)
+		{
+			ERRLOG1("Failed to accept handoff connection! errno=%d", errno);
+			sleep(1);
+			continue;
+		}
+
+		// Don't let a new process that never says hello hold this up.
+		setRecvTimeout(fd, HELLO_TIMEOUT_SEC);
+
+		uint8_t hello[HELLO_SIZE];
+		uint32_t magic;
+		uint16_t version;
+
+		if (0 != readAll(fd, hello, HELLO_SIZE))
+		{
+			ERRLOG("Failed to read handoff hello!");
+			close(fd);
+			continue;
+		}
+
+		memcpy(&magic, hello, 4);
+		memcpy(&version, hello + 4, 2);
+
+		if (magic != HANDOFF_MAGIC || version != HANDOFF_VERSION)
+		{
+			ERRLOG2("Unexpected handoff hello magic/version: %x/%u", magic, version);
+			close(fd);
+			continue;
+		}
+
+		// The new process waits (without taking over anything yet) for the end of the tick.
+		setRecvTimeout(fd, HANDOFF_TAKEOVER_TIMEOUT_SEC);
+
+		int none = -1;
+		if (!atomic_compare_exchange_strong(&_successorFd, &none, fd))
+		{
+			ERRLOG("Handoff already pending, so rejecting another new process.");
+			close(fd);
+			continue;
+		}
+
+		ERRLOG1("New process connected (fd=%d), handing over at the end of the next tick with no logs being written", fd);
+	}
+
+	return 0;
+}
+
+static void* forwardThreadMain()
+{
+	char buf[FORWARD_CMD_MAX_LEN + 1];
+	unsigned int count = 0;
+
+	for (;;)
+	{
+		uint32_t len;
+		if (0 != readAll(_oldFd, &len, 4) || len > FORWARD_CMD_MAX_LEN || 0 != readAll(_oldFd, buf, len))
+		{
+			ERRLOG("Lost connection to old process before it was done draining!");
+			break;
+		}
+
+		if (len == 0)
+		{
+			ERRLOG1("Old process done draining, having forwarded %u commands.", count);
+			break;
+		}
+
+		buf[len] = 0;
+		if (0 != Command_add(buf))
+		{
+			ERRLOG1("Failed to queue forwarded command: %s", buf);
+			continue;
+		}
+
+		count++;
+	}
+
+	close(_oldFd);
+	_oldFd = -1;
+
+	return 0;
+}
+
+static int startThread(pthread_t* thread, void* (*threadMain)(), const char* name)
+{
+	if (0 != pthread_create(thread, 0, threadMain, 0))
+	{
+		ERRLOG1("Failed to start %s thread!", name);
+		return -1;
+	}
+
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+	if (0 != pthread_setname_np(*thread, name))
+	{
+		ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", name);
+	}
+#endif
+
+	return 0;
+}
+
+
+static int sendHandover(int sock, const int* fds, const char* pending, size_t pendingLen, const HandoffBuf* snapshot)
+{
+	int sendFds[HANDOFF_FD_COUNT];
+	unsigned int count = 0;
+	uint8_t fdMask = 0;
+
+	for (unsigned int i = 0; i < HANDOFF_FD_COUNT; i++)
+	{
+		if (fds[i] >= 0)
+		{
+			sendFds[count++] = fds[i];
+			fdMask |= (1 << i);
+		}
+	}
+
+	uint8_t handover[HANDOVER_SIZE];
+	const uint32_t magic = HANDOFF_MAGIC;
+	const uint16_t pl = pendingLen;
+	const uint64_t snapshotLen = snapshot->len;
+
+	memset(handover, 0, HANDOVER_SIZE);
+	memcpy(handover, &magic, 4);
+	memcpy(handover + 4, &fdMask, 1);
+	memcpy(handover + 6, &pl, 2);
+	memcpy(handover + 8, &snapshotLen, 8);
+
+	if (0 != Handoff_sendFds(sock, sendFds, count, handover, HANDOVER_SIZE) ||
+			0 != writeAll(sock, pending, pendingLen) ||
+			0 != writeAll(sock, snapshot->data, snapshot->len))
+	{
+		ERRLOG("Failed to send handover!");
+		return -1;
+	}
+
+	return 0;
+}
+
+// Puts commands taken from the schedule back (as already due, for the next tick).
+static void requeueCommands(Command* cmds)
+{
+	while (cmds)
+	{
+		Command* cmd = cmds;
+		cmds = cmd->next;
+		cmd->next = 0;
+
+		if (0 != CommandSchedule_add(cmd))
+		{
+			Command_free(cmd);
+		}
+	}
+}
+
+// Forwards due commands, then those still arriving (from connections accepted before the handoff) until no connections
+// are left (or for at most HANDOFF_DRAIN_MAX_SEC), and then ends the stream.
+static void drain(int sock, Command* due, time_t curTime)
+{
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	bool ok = true;
+	unsigned int forwarded = 0;
+
+	while (due)
+	{
+		Command* cmd = due;
+		due = cmd->next;
+
+		if ((ok = forwardCommand(sock, cmd, ok, curTime)))
+		{
+			forwarded++;
+		}
+	}
+
+	for (bool drained = false; !drained; )
+	{
+		// Checked before taking commands, so that any queued by connections finishing meanwhile are still forwarded.
+		NetServerWorkerPoolStats ps;
+		NetServer_getWorkerPoolStats(&ps);
+		drained = (ps.queuedFds == 0 && ps.idleWorkers == ps.workers) || msSince(&t0) >= HANDOFF_DRAIN_MAX_SEC * 1000L;
+
+		Command* cmd;
+		while ((cmd = Command_next()))
+		{
+			if ((ok = forwardCommand(sock, cmd, ok, curTime)))
+			{
+				forwarded++;
+			}
+		}
+
+		if (!drained)
+		{
+			usleep(DRAIN_CHECK_MS * 1000);
+		}
+	}
+
+	const uint32_t end = 0;
+	if (!ok || 0 != writeAll(sock, &end, 4))
+	{
+		ERRLOG("Failed to forward all commands to new process!");
+	}
+
+	ERRLOG1("Forwarded %u commands to new process.", forwarded);
+}
+
+// Forwards a command to the new process (if nothing has failed so far), completing it as scheduled (for the new process
+// to apply), and frees it. Returns whether forwarded.
+static bool forwardCommand(int sock, Command* cmd, bool ok, time_t curTime)
+{
+	char buf[FORWARD_CMD_MAX_LEN];
+
+	if (ok)
+	{
+		// Including any execution time
+		const int n = Command_format(cmd, buf, FORWARD_CMD_MAX_LEN);
+		if (n < 0 || n >= FORWARD_CMD_MAX_LEN)
+		{
+			ERRLOG1("Failed to format command for %s to forward!", cmd->name);
+			ok = false;
+		}
+		else
+		{
+			const uint32_t l = n;
+			ok = (0 == writeAll(sock, &l, 4) && 0 == writeAll(sock, buf, l));
+		}
+	}
+
+	Command_complete(cmd, ok ? COMMAND_RESULT_SCHEDULED : COMMAND_RESULT_FAILED, curTime);
+	Command_free(cmd);
+
+	return ok;
+}
+
+
+static int writeAll(int fd, const void* buf, size_t len)
+{
+	size_t wt = 0;
+
+	while (wt < len)
+	{
+		// MSG_NOSIGNAL, so that the other process going away can't take this one down with SIGPIPE.
+		const ssize_t wb = send(fd, ((const uint8_t*) buf) + wt, len - wt, MSG_NOSIGNAL);
+		if (wb < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return -1;
+		}
+
+		wt += wb;
+	}
+
+	return 0;
+}
+
+static int readAll(int fd, void* buf, size_t len)
+{
+	size_t rt = 0;
+
+	while (rt < len)
+	{
+		const ssize_t rb = read(fd, ((uint8_t*) buf) + rt, len - rt);
+		if (rb < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (rb <= 0)
+		{
+			return -1;
+		}
+
+		rt += rb;
+	}
+
+	return 0;
+}
+
+static int connectOld(const char* path)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		ERRLOG("Handoff socket path is too long!");
+		return -1;
+	}
+	strcpy(sa.sun_path, path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		ERRLOG1("Failed to open socket! errno=%d", errno);
+		return -1;
+	}
+
+	if (0 != connect(fd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)))
+	{
+		ERRLOG2("Failed to connect to old process at %s! errno=%d", path, errno);
+		close(fd);
+		return -1;
+	}
+
+	uint8_t hello[HELLO_SIZE];
+	const uint32_t magic = HANDOFF_MAGIC;
+	const uint16_t version = HANDOFF_VERSION;
+	memset(hello, 0, HELLO_SIZE);
+	memcpy(hello, &magic, 4);
+	memcpy(hello + 4, &version, 2);
+
+	if (0 != writeAll(fd, hello, HELLO_SIZE))
+	{
+		ERRLOG("Failed to send handoff hello!");
+		close(fd);
+		return -1;
+	}
+
+	// Handed over at the end of one of the old process's next few ticks (once no boat logs are being written)
+	setRecvTimeout(fd, HANDOFF_WAIT_TIMEOUT_SEC);
+
+	ERRLOG1("Connected to old process at %s, waiting for handover", path);
+	return fd;
+}
+
+// Sets a receive timeout (0 for none).
+static void setRecvTimeout(int fd, unsigned int sec)
+{
+	struct timeval tv = { .tv_sec = sec, .tv_usec = 0 };
+	if (0 != setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval)))
+	{
+		ERRLOG1("Failed to set handoff socket receive timeout! errno=%d", errno);
+	}
+}
+
+static long msSince(const struct timespec* t)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - t->tv_sec) * 1000L + (now.tv_nsec - t->tv_nsec) / 1000000L;
+}
+
+
+static int bufReserve(HandoffBuf* buf, size_t n)
+{
+	if (buf->len + n <= buf->cap)
+	{
+		return 0;
+	}
+
+	size_t newCap = (buf->cap > 0) ? buf->cap : 65536;
+	while (newCap < buf->len + n)
+	{
+		newCap *= 2;
+	}
+
+	uint8_t* d = realloc(buf->data, newCap);
+	if (!d)
+	{
+		ERRLOG("Failed to alloc handoff buffer!");
+		return -1;
+	}
+
+	buf->data = d;
+	buf->cap = newCap;
+
+	return 0;
+}
+
+static int putStr(HandoffBuf* buf, const char* s)
+{
+	const size_t slen = (s ? strlen(s) : 0);
+	if (slen > STR_MAX_LEN || 0 != bufReserve(buf, 2 + slen))
+	{
+		return -1;
+	}
+
+	const uint16_t len = (s ? slen : STR_NULL);
+	PUT(buf, len);
+
+	memcpy(buf->data + buf->len, s, slen);
+	buf->len += slen;
+
+	return 0;
+}
+
+static int putTrack(HandoffBuf* buf, const GhostTrack* track)
+{
+	GhostTrackData d;
+	GhostTrack_getData(track, &d);
+
+	if (0 != putStr(buf, GhostTrack_getSource(track)) || 0 != bufReserve(buf, TRACK_FIELDS_SIZE + d.dataSize))
+	{
+		return -1;
+	}
+
+	const int64_t startTime = d.startTime;
+	const uint32_t count = d.count;
+	const uint64_t dataSize = d.dataSize;
+
+	PUT(buf, startTime);
+	PUT(buf, d.startLat);
+	PUT(buf, d.startLon);
+	PUT(buf, count);
+	PUT(buf, dataSize);
+
+	memcpy(buf->data + buf->len, d.data, d.dataSize);
+	buf->len += d.dataSize;
+
+	return 0;
+}
+
+static int putBoat(HandoffBuf* buf, const BoatEntry* e, const Boat* boat)
+{
+	const char* ghostSource = (boat->ghost.track ? GhostTrack_getSource(boat->ghost.track) : 0);
+	if (boat->ghost.track && !ghostSource)
+	{
+		ERRLOG1("No source for the track of ghost boat %s!", e->name);
+		return -1;
+	}
+
+	if (0 != putStr(buf, e->name) || 0 != putStr(buf, e->group) || 0 != putStr(buf, e->altName) || 0 != bufReserve(buf, BOAT_FIELDS_SIZE))
+	{
+		return -1;
+	}
+
+	const int32_t boatType = boat->boatType;
+	const int32_t boatFlags = boat->boatFlags;
+	const int32_t startingFromLandCount = boat->startingFromLandCount;
+	const uint8_t stop = boat->stop;
+	const uint8_t sailsDown = boat->sailsDown;
+	const uint8_t movingToSea = boat->movingToSea;
+	const uint8_t setImmediateDesiredCourse = boat->setImmediateDesiredCourse;
+	const uint8_t courseMagnetic = boat->courseMagnetic;
+	const int64_t ghostTimeOffset = boat->ghostTimeOffset;
+
+	PUT(buf, boat->pos.lat);
+	PUT(buf, boat->pos.lon);
+	PUT(buf, boat->v.angle);
+	PUT(buf, boat->v.mag);
+	PUT(buf, boat->vGround.angle);
+	PUT(buf, boat->vGround.mag);
+	PUT(buf, boat->desiredCourse);
+	PUT(buf, boat->distanceTravelled);
+	PUT(buf, boat->damage);
+	PUT(buf, boatType);
+	PUT(buf, boatFlags);
+	PUT(buf, startingFromLandCount);
+	PUT(buf, stop);
+	PUT(buf, sailsDown);
+	PUT(buf, movingToSea);
+	PUT(buf, setImmediateDesiredCourse);
+	PUT(buf, courseMagnetic);
+	PUT(buf, boat->sailArea);
+	PUT(buf, boat->leewaySpeed);
+	PUT(buf, boat->heelingAngle);
+	PUT(buf, ghostTimeOffset);
+
+	if (0 != putStr(buf, ghostSource))
+	{
+		return -1;
+	}
+
+	if (ghostSource)
+	{
+		if (0 != bufReserve(buf, GHOST_CURSOR_SIZE))
+		{
+			return -1;
+		}
+
+		const GhostCursor* c = &boat->ghost;
+		const uint32_t index = c->index;
+		const uint64_t offset = c->offset;
+		const int64_t t0 = c->t0;
+		const int64_t t1 = c->t1;
+
+		PUT(buf, index);
+		PUT(buf, offset);
+		PUT(buf, t0);
+		PUT(buf, t1);
+		PUT(buf, c->lat0);
+		PUT(buf, c->lon0);
+		PUT(buf, c->lat1);
+		PUT(buf, c->lon1);
+		PUT(buf, c->v.angle);
+		PUT(buf, c->v.mag);
+	}
+
+	return 0;
+}
+
+static int putMark(HandoffBuf* buf, const RaceMarkInfo* mark)
+{
+	if (0 != putStr(buf, mark->group) || 0 != putStr(buf, mark->name) || 0 != bufReserve(buf, MARK_FIELDS_SIZE))
+	{
+		return -1;
+	}
+
+	const int32_t type = mark->type;
+
+	PUT(buf, type);
+	PUT(buf, mark->p1.lat);
+	PUT(buf, mark->p1.lon);
+	PUT(buf, mark->p2.lat);
+	PUT(buf, mark->p2.lon);
+
+	return 0;
+}
+
+
+static bool getBytes(Reader* r, void* v, size_t n)
+{
+	if ((size_t) (r->end - r->p) < n)
+	{
+		return false;
+	}
+
+	memcpy(v, r->p, n);
+	r->p += n;
+
+	return true;
+}
+
+static bool getStr(Reader* r, char** s)
+{
+	uint16_t len;
+	if (!getBytes(r, &len, 2))
+	{
+		return false;
+	}
+
+	if (len == STR_NULL)
+	{
+		*s = 0;
+		return true;
+	}
+
+	if ((size_t) (r->end - r->p) < len || !(*s = malloc(len + 1)))
+	{
+		return false;
+	}
+
+	memcpy(*s, r->p, len);
+	(*s)[len] = 0;
+	r->p += len;
+
+	return true;
+}
+
+static int applyTrack(Reader* r)
+{
+	char* source = 0;
+	int64_t startTime;
+	uint32_t count;
+	uint64_t dataSize;
+	GhostTrackData d;
+
+	if (!(getStr(r, &source) && source && GET(r, startTime) && GET(r, d.startLat) && GET(r, d.startLon) && GET(r, count) && GET(r, dataSize)) ||
+			dataSize > (uint64_t) (r->end - r->p))
+	{
+		free(source);
+		return -1;
+	}
+
+	d.startTime = startTime;
+	d.count = count;
+	d.data = r->p;
+	d.dataSize = dataSize;
+	r->p += dataSize;
+
+	GhostTrack* track = GhostTrack_fromData(&d);
+	if (!track)
+	{
+		ERRLOG1("Bad ghost track from %s!", source);
+		free(source);
+		return -1;
+	}
+
+	// (Taking over the track.)
+	const int rc = GhostTrack_put(source, track);
+	free(source);
+
+	return rc;
+}
+
+static int applyBoat(Reader* r)
+{
+	char* name = 0;
+	char* group = 0;
+	char* altName = 0;
+	char* ghostSource = 0;
+	Boat* boat = 0;
+	int rc = -1;
+
+	if (!(getStr(r, &name) && name && getStr(r, &group) && getStr(r, &altName)))
+	{
+		goto done;
+	}
+
+	Boat s;
+	Boat_initState(&s, 0.0, 0.0, 0, 0);
+
+	int32_t boatType;
+	int32_t boatFlags;
+	int32_t startingFromLandCount;
+	uint8_t stop;
+	uint8_t sailsDown;
+	uint8_t movingToSea;
+	uint8_t setImmediateDesiredCourse;
+	uint8_t courseMagnetic;
+	int64_t ghostTimeOffset;
+
+	if (!(GET(r, s.pos.lat) && GET(r, s.pos.lon) &&
+			GET(r, s.v.angle) && GET(r, s.v.mag) &&
+			GET(r, s.vGround.angle) && GET(r, s.vGround.mag) &&
+			GET(r, s.desiredCourse) && GET(r, s.distanceTravelled) && GET(r, s.damage) &&
+			GET(r, boatType) && GET(r, boatFlags) && GET(r, startingFromLandCount) &&
+			GET(r, stop) && GET(r, sailsDown) && GET(r, movingToSea) && GET(r, setImmediateDesiredCourse) && GET(r, courseMagnetic) &&
+			GET(r, s.sailArea) && GET(r, s.leewaySpeed) && GET(r, s.heelingAngle) &&
+			GET(r, ghostTimeOffset) &&
+			getStr(r, &ghostSource)))
+	{
+		goto done;
+	}
+
+	s.boatType = boatType;
+	s.boatFlags = boatFlags;
+	s.startingFromLandCount = startingFromLandCount;
+	s.stop = stop;
+	s.sailsDown = sailsDown;
+	s.movingToSea = movingToSea;
+	s.setImmediateDesiredCourse = setImmediateDesiredCourse;
+	s.courseMagnetic = courseMagnetic;
+	s.ghostTimeOffset = ghostTimeOffset;
+
+	if (ghostSource)
+	{
+		// Carried in the snapshot
+		const GhostTrack* track = GhostTrack_get(ghostSource);
+		if (!track)
+		{
+			ERRLOG2("No track for ghost boat %s from %s!", name, ghostSource);
+			goto done;
+		}
+
+		GhostTrack_initCursor(&s.ghost, track);
+
+		uint32_t index;
+		uint64_t offset;
+		int64_t t0;
+		int64_t t1;
+
+		if (!(GET(r, index) && GET(r, offset) && GET(r, t0) && GET(r, t1) &&
+				GET(r, s.ghost.lat0) && GET(r, s.ghost.lon0) && GET(r, s.ghost.lat1) && GET(r, s.ghost.lon1) &&
+				GET(r, s.ghost.v.angle) && GET(r, s.ghost.v.mag)))
+		{
+			goto done;
+		}
+
+		s.ghost.index = index;
+		s.ghost.offset = offset;
+		s.ghost.t0 = t0;
+		s.ghost.t1 = t1;
+	}
+
+	// Exclusion zones as loaded by this process
+	s.zones = Zones_getGroupZones(group);
+	s.inZone = (s.zones ? Zones_find(s.zones, &s.pos) : 0);
+	s.enteredZone = 0;
+
+	if (!(boat = Boat_new(s.pos.lat, s.pos.lon, s.boatType, s.boatFlags)))
+	{
+		ERRLOG1("Failed to alloc boat %s!", name);
+		goto done;
+	}
+
+	*boat = s;
+
+	if (boat->ghost.track)
+	{
+		GhostTrack_retain(boat->ghost.track);
+	}
+
+	const int addRc = BoatRegistry_add(boat, name, group, altName);
+	if (addRc != BoatRegistry_OK)
+	{
+		ERRLOG2("Failed to add boat %s to BoatRegistry! rc=%d", name, addRc);
+		Boat_free(boat);
+		goto done;
+	}
+
+	rc = 0;
+
+done:
+	free(name);
+	free(group);
+	free(altName);
+	free(ghostSource);
+
+	return rc;
+}
+
+static int applyMark(Reader* r)
+{
+	char* group = 0;
+	char* name = 0;
+	int32_t type;
+	proteus_GeoPos p1;
+	proteus_GeoPos p2;
+	int rc = -1;
+
+	if (getStr(r, &group) && group && getStr(r, &name) && name &&
+			GET(r, type) && GET(r, p1.lat) && GET(r, p1.lon) && GET(r, p2.lat) && GET(r, p2.lon))
+	{
+		rc = RaceMarks_add(group, name, type, &p1, &p2);
+	}
+
+	free(group);
+	free(name);
+
+	return rc;
+}
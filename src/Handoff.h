@@ -0,0 +1,122 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _Handoff_h_
+#define _Handoff_h_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "Command.h"
+
+
+// Handoff to a new process (such as for a binary upgrade), without dropping connections or commands: the new process
+// (--takeover) connects to the old one's handoff socket (--handoff), and at the end of the old process's next tick, gets
+// the listening NetServer sockets and the command input (as fds, over SCM_RIGHTS), along with a snapshot of all boats
+// (and their ghost tracks) and race marks. Once the new process has applied it, the old one commits to the handoff (never
+// ticking again), and only then does the new process carry on ticking from the next second, while the old one stops
+// accepting connections, forwards commands still arriving on connections it already accepted, and exits once those are
+// done.
+
+// Longest the old process keeps serving connections it accepted before the handoff (as long as HTTP keep-alive)
+#define HANDOFF_DRAIN_MAX_SEC (30)
+
+// Longest the old process waits (without ticking) for the new one to take over, before carrying on itself
+#define HANDOFF_TAKEOVER_TIMEOUT_SEC (60)
+
+// Longest the new process waits for the old one to hand over (which can be put off while boat logs are written)
+#define HANDOFF_WAIT_TIMEOUT_SEC (180)
+
+// Longest the new process waits, once ready, for the old one to commit to the handoff (exiting without ticking if not)
+#define HANDOFF_COMMIT_TIMEOUT_SEC (10)
+
+// Fds handed over: NetServer and HTTP listening sockets, and command input
+#define HANDOFF_FD_NET (0)
+#define HANDOFF_FD_HTTP (1)
+#define HANDOFF_FD_CMD (2)
+#define HANDOFF_FD_COUNT (3)
+
+
+typedef struct
+{
+	// Handed over fds (-1 for any the old process didn't have), by HANDOFF_FD_*
+	int fds[HANDOFF_FD_COUNT];
+
+	// Command input read but not yet handled
+	char pending[COMMAND_INPUT_PENDING_MAX];
+	size_t pendingLen;
+
+	// Last tick run by the old process, and when it handed over (CLOCK_REALTIME ns)
+	time_t tickTime;
+	int64_t handoffTimeNs;
+
+	unsigned int boatCount;
+	unsigned int markCount;
+	unsigned int trackCount;
+} HandoffState;
+
+
+// Old process side: listens for a new process on a unix socket.
+int Handoff_listen(const char* path);
+
+// Whether a new process is waiting to take over.
+bool Handoff_isRequested();
+
+// Hands over to the waiting new process, after all boat advances and commands for the tick at curTime, then forwards
+// commands until drained. Returns 0 once done (for the process to exit), 1 if put off until a later tick (while boat
+// logs are being written), or negative if the handoff failed (with this process carrying on as before). Must be called
+// from the main simulation thread.
+int Handoff_run(time_t curTime);
+
+
+// New process side: connects to the old process's handoff socket, and takes over its fds and state (adding its boats
+// to the registry, and replacing any race marks). Zones, ghost tracks and race marks must be initialized first.
+int Handoff_takeover(const char* path, HandoffState* state);
+
+// Starts queueing commands forwarded by the old process while it drains (after Command_init()).
+int Handoff_startForwarded();
+
+
+// Snapshot encoding/decoding and fd passing (exposed for testing)
+
+typedef struct
+{
+	uint8_t* data;
+	size_t len;
+	size_t cap;
+} HandoffBuf;
+
+void HandoffBuf_free(HandoffBuf* buf);
+
+// Appends a snapshot of all boats (in the registry), the ghost tracks they use, and race marks. Must be called from the
+// main simulation thread.
+int Handoff_encodeSnapshot(time_t tickTime, HandoffBuf* out);
+
+// Adds the ghost tracks and boats of a snapshot (to the ghost track cache and the registry), and replaces all race marks
+// with its marks (setting state's tick time, handoff time, and boat, mark and ghost track counts).
+int Handoff_applySnapshot(const uint8_t* data, size_t len, HandoffState* state);
+
+// Sends data (of len bytes, at least 1) along with fds (of count, each open).
+int Handoff_sendFds(int sock, const int* fds, unsigned int count, const void* data, size_t len);
+
+// Receives data (exactly len bytes) sent by Handoff_sendFds(), along with up to maxCount fds (setting count).
+int Handoff_receiveFds(int sock, int* fds, unsigned int maxCount, unsigned int* count, void* data, size_t len);
+
+
+#endif // _Handoff_h_
@@ -0,0 +1,437 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "HttpApi.h"
+
+
+// Longest header value looked at (for "Connection" tokens)
+#define HEADER_VALUE_MAX_LEN (64)
+
+
+static int pathToReqStr(const char* path, size_t len, char* reqStr);
+static int hexDigit(char c);
+static bool isHeader(const char* line, size_t lineLen, const char* name, char* value);
+static int writeJsonStringN(char* buf, size_t bufSize, const char* s, size_t n);
+static bool isNumber(const char* s, size_t n);
+static const char* getStatusReason(int status);
+
+
+int HttpApi_parseRequest(const char* buf, size_t len, HttpApiRequest* req)
+{
+	const char* end = memmem(buf, len, "\r\n\r\n", 4);
+	if (!end)
+	{
+		return 0;
+	}
+
+	req->status = HTTP_API_STATUS_OK;
+	req->keepAlive = true;
+	req->reqStr[0] = 0;
+
+	// Request line: method, target and version
+	const char* lineEnd = memmem(buf, end + 2 - buf, "\r\n", 2);
+
+	const char* target = memchr(buf, ' ', lineEnd - buf);
+	if (!target)
+	{
+		return -1;
+	}
+	target++;
+
+	const char* version = memchr(target, ' ', lineEnd - target);
+	if (!version)
+	{
+		return -1;
+	}
+	version++;
+
+	if (lineEnd - version == 8 && 0 == memcmp(version, "HTTP/1.1", 8))
+	{
+		req->keepAlive = true;
+	}
+	else if (lineEnd - version == 8 && 0 == memcmp(version, "HTTP/1.0", 8))
+	{
+		req->keepAlive = false;
+	}
+	else
+	{
+		return -1;
+	}
+
+	// Headers
+	for (const char* h = lineEnd + 2; h < end; )
+	{
+		const char* he = memmem(h, end + 2 - h, "\r\n", 2);
+
+		char value[HEADER_VALUE_MAX_LEN + 1];
+		if (isHeader(h, he - h, "Connection", value))
+		{
+			if (strcasestr(value, "close"))
+			{
+				req->keepAlive = false;
+			}
+			else if (strcasestr(value, "keep-alive"))
+			{
+				req->keepAlive = true;
+			}
+		}
+		else if (isHeader(h, he - h, "Content-Length", value))
+		{
+			if (strtol(value, 0, 10) != 0)
+			{
+				// No request bodies taken
+				return -1;
+			}
+		}
+		else if (isHeader(h, he - h, "Transfer-Encoding", value))
+		{
+			return -1;
+		}
+
+		h = he + 2;
+	}
+
+	if (target - 1 - buf != 3 || 0 != memcmp(buf, "GET", 3))
+	{
+		req->status = HTTP_API_STATUS_METHOD_NOT_ALLOWED;
+	}
+	else
+	{
+		req->status = pathToReqStr(target, version - 1 - target, req->reqStr);
+	}
+
+	return (end - buf) + 4;
+}
+
+int HttpApi_writeResponseHead(char* buf, size_t bufSize, int status, size_t contentLength, bool keepAlive)
+{
+	const int n = snprintf(buf, bufSize,
+			"HTTP/1.1 %d %s\r\n"
+			"Content-Type: application/json\r\n"
+			"Content-Length: %zu\r\n"
+			"Access-Control-Allow-Origin: *\r\n"
+			"Connection: %s\r\n"
+			"\r\n",
+			status,
+			getStatusReason(status),
+			contentLength,
+			keepAlive ? "keep-alive" : "close");
+
+	return (n < 0 || (size_t) n >= bufSize) ? -1 : n;
+}
+
+int HttpApi_writeJsonString(char* buf, size_t bufSize, const char* s)
+{
+	return writeJsonStringN(buf, bufSize, s, strlen(s));
+}
+
+int HttpApi_writeJsonRows(char* buf, size_t bufSize, const char* rows, const char* const* names, const char* types)
+{
+	size_t pos = 0;
+	int n;
+
+#define APPEND(...) \
+	if ((n = snprintf(buf + pos, bufSize - pos, __VA_ARGS__)) < 0 || (size_t) n >= bufSize - pos) \
+	{ \
+		return -1; \
+	} \
+	pos += n;
+
+	if (bufSize == 0)
+	{
+		return -1;
+	}
+
+	buf[0] = 0;
+	APPEND("[");
+
+	bool first = true;
+
+	for (const char* line = rows; *line; )
+	{
+		const char* le = strchr(line, '\n');
+		if (!le)
+		{
+			le = line + strlen(line);
+		}
+
+		if (le == line)
+		{
+			// Empty line
+			line = (*le) ? le + 1 : le;
+			continue;
+		}
+
+		APPEND(first ? "{" : ",{");
+		first = false;
+
+		const char* f = line;
+
+		for (size_t i = 0; types[i]; i++)
+		{
+			if (f > le)
+			{
+				// Too few fields
+				return -1;
+			}
+
+			const char* fe = memchr(f, ',', le - f);
+			if (!fe)
+			{
+				fe = le;
+			}
+
+			APPEND("%s\"%s\":", (i > 0) ? "," : "", names[i]);
+
+			if ((types[i] == 'o' && fe - f == 1 && *f == '!') || (types[i] == 'n' && !isNumber(f, fe - f)))
+			{
+				APPEND("null");
+			}
+			else if (types[i] == 'n')
+			{
+				APPEND("%.*s", (int) (fe - f), f);
+			}
+			else
+			{
+				if ((n = writeJsonStringN(buf + pos, bufSize - pos, f, fe - f)) < 0)
+				{
+					return -1;
+				}
+				pos += n;
+			}
+
+			f = fe + 1;
+		}
+
+		APPEND("}");
+
+		line = (*le) ? le + 1 : le;
+	}
+
+	APPEND("]");
+
+#undef APPEND
+
+	return pos;
+}
+
+
+// Maps a request path ("/wind/44.0/-63.0", with each segment percent-decoded, and any query string ignored) to a
+// request string ("wind,44.0,-63.0"), returning the status to respond with.
+static int pathToReqStr(const char* path, size_t len, char* reqStr)
+{
+	const char* q = memchr(path, '?', len);
+	if (q)
+	{
+		len = q - path;
+	}
+
+	if (len == 0 || path[0] != '/')
+	{
+		return HTTP_API_STATUS_BAD_REQUEST;
+	}
+
+	size_t out = 0;
+
+	for (size_t i = 1; i < len; i++)
+	{
+		char c = path[i];
+
+		if (c == '/')
+		{
+			if (i + 1 == len)
+			{
+				// Trailing slash
+				break;
+			}
+			else if (path[i - 1] == '/')
+			{
+				// Empty segment
+				return HTTP_API_STATUS_BAD_REQUEST;
+			}
+
+			c = ',';
+		}
+		else if (c == '%')
+		{
+			int hi;
+			int lo;
+			if (i + 2 >= len || (hi = hexDigit(path[i + 1])) < 0 || (lo = hexDigit(path[i + 2])) < 0)
+			{
+				return HTTP_API_STATUS_BAD_REQUEST;
+			}
+
+			c = (char) ((hi << 4) | lo);
+			i += 2;
+
+			// Separators (and anything else that can't be in a request string value) can't be escaped into a segment.
+			if (c == ',' || c == '\n' || c == '\r' || c == 0)
+			{
+				return HTTP_API_STATUS_BAD_REQUEST;
+			}
+		}
+		else if (c == ',')
+		{
+			return HTTP_API_STATUS_BAD_REQUEST;
+		}
+
+		if (out + 1 >= HTTP_API_REQ_STR_SIZE)
+		{
+			return HTTP_API_STATUS_URI_TOO_LONG;
+		}
+
+		reqStr[out++] = c;
+	}
+
+	reqStr[out] = 0;
+
+	return (out > 0) ? HTTP_API_STATUS_OK : HTTP_API_STATUS_NOT_FOUND;
+}
+
+static int hexDigit(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	else if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	else if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+// Whether a header line is for the named header (case-insensitive), setting value to its value (trimmed, and truncated
+// to HEADER_VALUE_MAX_LEN) if so.
+static bool isHeader(const char* line, size_t lineLen, const char* name, char* value)
+{
+	const size_t nameLen = strlen(name);
+
+	if (lineLen <= nameLen || line[nameLen] != ':' || 0 != strncasecmp(line, name, nameLen))
+	{
+		return false;
+	}
+
+	const char* v = line + nameLen + 1;
+	size_t vl = lineLen - nameLen - 1;
+
+	while (vl > 0 && (*v == ' ' || *v == '\t'))
+	{
+		v++;
+		vl--;
+	}
+
+	if (vl > HEADER_VALUE_MAX_LEN)
+	{
+		vl = HEADER_VALUE_MAX_LEN;
+	}
+
+	memcpy(value, v, vl);
+	value[vl] = 0;
+
+	return true;
+}
+
+static int writeJsonStringN(char* buf, size_t bufSize, const char* s, size_t n)
+{
+	size_t pos = 0;
+
+	if (bufSize < 3)
+	{
+		return -1;
+	}
+
+	buf[pos++] = '"';
+
+	for (size_t i = 0; i < n; i++)
+	{
+		const unsigned char c = (unsigned char) s[i];
+
+		// Room for the longest escape, and the closing quote and null terminator
+		if (pos + 8 >= bufSize)
+		{
+			return -1;
+		}
+
+		if (c == '"' || c == '\\')
+		{
+			buf[pos++] = '\\';
+			buf[pos++] = c;
+		}
+		else if (c < 0x20)
+		{
+			pos += snprintf(buf + pos, bufSize - pos, "\\u%04x", c);
+		}
+		else
+		{
+			buf[pos++] = c;
+		}
+	}
+
+	buf[pos++] = '"';
+	buf[pos] = 0;
+
+	return pos;
+}
+
+static bool isNumber(const char* s, size_t n)
+{
+	if (n == 0)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (!((s[i] >= '0' && s[i] <= '9') || s[i] == '.' || s[i] == '-' || s[i] == '+' || s[i] == 'e' || s[i] == 'E'))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static const char* getStatusReason(int status)
+{
+	switch (status)
+	{
+		case HTTP_API_STATUS_OK:
+			return "OK";
+		case HTTP_API_STATUS_BAD_REQUEST:
+			return "Bad Request";
+		case HTTP_API_STATUS_NOT_FOUND:
+			return "Not Found";
+		case HTTP_API_STATUS_METHOD_NOT_ALLOWED:
+			return "Method Not Allowed";
+		case HTTP_API_STATUS_URI_TOO_LONG:
+			return "URI Too Long";
+		case HTTP_API_STATUS_HEADERS_TOO_LARGE:
+			return "Request Header Fields Too Large";
+	}
+
+	return "Internal Server Error";
+}
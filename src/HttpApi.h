@@ -0,0 +1,69 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HttpApi_h_
+#define _HttpApi_h_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+// HTTP/1.1 framing for the NetServer JSON read API: each GET request path ("/wind/44.0/-63.0") maps to a NetServer
+// request string ("wind,44.0,-63.0"), handled by the same request handlers as the text protocol, but with the response
+// written as JSON.
+
+// Longest request string (from a request path)
+#define HTTP_API_REQ_STR_SIZE (256)
+
+#define HTTP_API_STATUS_OK			(200)
+#define HTTP_API_STATUS_BAD_REQUEST		(400)
+#define HTTP_API_STATUS_NOT_FOUND		(404)
+#define HTTP_API_STATUS_METHOD_NOT_ALLOWED	(405)
+#define HTTP_API_STATUS_URI_TOO_LONG		(414)
+#define HTTP_API_STATUS_HEADERS_TOO_LARGE	(431)
+#define HTTP_API_STATUS_INTERNAL_ERROR		(500)
+
+
+typedef struct
+{
+	// Status to respond with: HTTP_API_STATUS_OK if the request string is to be handled, otherwise an error.
+	int status;
+
+	// Whether the connection stays open after the response (by HTTP version and "Connection" header)
+	bool keepAlive;
+
+	char reqStr[HTTP_API_REQ_STR_SIZE];
+} HttpApiRequest;
+
+
+// Parses the request at the start of buf (of len bytes). Returns the length of the request (so that any pipelined
+// requests after it can be parsed next), 0 if the request isn't complete yet, or -1 if it's malformed (or has a body).
+int HttpApi_parseRequest(const char* buf, size_t len, HttpApiRequest* req);
+
+// Writes the status line and headers for a JSON response. Returns the length written, or -1 if there isn't room.
+int HttpApi_writeResponseHead(char* buf, size_t bufSize, int status, size_t contentLength, bool keepAlive);
+
+// Writes s as a quoted JSON string. Returns the length written, or -1 if there isn't room.
+int HttpApi_writeJsonString(char* buf, size_t bufSize, const char* s);
+
+// Writes a JSON array of objects, one per line of rows (as in text protocol responses), with each comma-separated
+// field of a line named by names, and typed by the corresponding character of types: 's' for a string, 'o' for an
+// optional string ("!" for none, as null), or 'n' for a number. Returns the length written, or -1 if there isn't room
+// (or a line has too few fields).
+int HttpApi_writeJsonRows(char* buf, size_t bufSize, const char* rows, const char* const* names, const char* types);
+
+
+#endif // _HttpApi_h_
@@ -0,0 +1,177 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "InitPhases.h"
+
+#include "ErrLog.h"
+
+
+#define ERRLOG_ID "InitPhases"
+#define THREAD_NAME "InitPhases"
+
+
+typedef struct
+{
+	InitPhase* phases;
+	unsigned int count;
+	atomic_uint next;
+	atomic_bool failed;
+} PhaseQueue;
+
+
+static void* initThreadMain(void* arg);
+static void runPhases(PhaseQueue* q);
+static long elapsedNs(const struct timespec* t0);
+
+
+int InitPhases_run(InitPhase* phases, unsigned int count, unsigned int threadCount)
+{
+	PhaseQueue q;
+	q.phases = phases;
+	q.count = count;
+	atomic_init(&q.next, 0);
+	atomic_init(&q.failed, false);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		phases[i].run = false;
+		phases[i].rc = 0;
+		phases[i].ns = 0;
+	}
+
+	if (threadCount > count)
+	{
+		threadCount = count;
+	}
+	if (threadCount > INIT_PHASES_MAX_THREAD_COUNT)
+	{
+		threadCount = INIT_PHASES_MAX_THREAD_COUNT;
+	}
+
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	pthread_t threads[INIT_PHASES_MAX_THREAD_COUNT];
+	unsigned int started = 0;
+
+	// The calling thread takes phases too, so one fewer thread is needed.
+	for (unsigned int i = 1; i < threadCount; i++)
+	{
+		if (0 != pthread_create(threads + started, 0, &initThreadMain, &q))
+		{
+			// The remaining threads will just take more phases each.
+			ERRLOG("Failed to start init thread!");
+			break;
+		}
+
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+		if (0 != pthread_setname_np(threads[started], THREAD_NAME))
+		{
+			ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", THREAD_NAME);
+		}
+#endif
+
+		started++;
+	}
+
+	runPhases(&q);
+
+	for (unsigned int i = 0; i < started; i++)
+	{
+		pthread_join(threads[i], 0);
+	}
+
+	const long totalNs = elapsedNs(&t0);
+
+	int rc = 0;
+	long sumNs = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (!phases[i].run)
+		{
+			ERRLOG1("Phase %s skipped", phases[i].name);
+			continue;
+		}
+
+		ERRLOG3("Phase %s took %.1fms%s", phases[i].name, ((double) phases[i].ns) / 1000000.0, (phases[i].rc != 0 ? " (failed)" : ""));
+
+		sumNs += phases[i].ns;
+		if (rc == 0)
+		{
+			rc = phases[i].rc;
+		}
+	}
+
+	ERRLOG4("Startup init phases done in %.1fms (%.1fms for all phases one after another, %u threads)%s",
+			((double) totalNs) / 1000000.0,
+			((double) sumNs) / 1000000.0,
+			started + 1,
+			(rc != 0 ? ", with failures!" : ""));
+
+	if (rc != 0)
+	{
+		for (unsigned int i = count; i-- > 0; )
+		{
+			if (phases[i].run && phases[i].rc == 0 && phases[i].teardown)
+			{
+				ERRLOG1("Tearing down phase %s", phases[i].name);
+				phases[i].teardown(phases[i].arg);
+			}
+		}
+	}
+
+	return rc;
+}
+
+
+static void* initThreadMain(void* arg)
+{
+	runPhases(arg);
+	return 0;
+}
+
+static void runPhases(PhaseQueue* q)
+{
+	unsigned int i;
+	while (!atomic_load(&q->failed) && (i = atomic_fetch_add(&q->next, 1)) < q->count)
+	{
+		InitPhase* phase = q->phases + i;
+
+		struct timespec t0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+
+		phase->rc = phase->func(phase->arg);
+		phase->ns = elapsedNs(&t0);
+		phase->run = true;
+
+		if (phase->rc != 0)
+		{
+			atomic_store(&q->failed, true);
+		}
+	}
+}
+
+static long elapsedNs(const struct timespec* t0)
+{
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return (t1.tv_nsec - t0->tv_nsec) + 1000000000L * (t1.tv_sec - t0->tv_sec);
+}
@@ -0,0 +1,56 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _InitPhases_h_
+#define _InitPhases_h_
+
+
+// Independent startup initialization phases (e.g. loading each environment dataset), run concurrently
+// on a small pool of threads so that startup takes about as long as the slowest phase.
+
+#include <stdbool.h>
+
+#define INIT_PHASES_MAX_THREAD_COUNT (16)
+
+
+typedef int (*InitPhases_Func)(void* arg);
+typedef void (*InitPhases_TeardownFunc)(void* arg);
+
+typedef struct
+{
+	const char* name;
+	InitPhases_Func func;
+
+	// Undoes a successful func if another phase fails (or null if there's nothing to undo)
+	InitPhases_TeardownFunc teardown;
+
+	void* arg;
+
+	// Set once run: whether the phase was run, its result (0 on success) and how long it took
+	bool run;
+	int rc;
+	long ns;
+} InitPhase;
+
+
+// Runs the phases on up to threadCount threads, including the calling thread, logging how long each took. Phases
+// are started in array order (so one after another with a single thread), and none are started once one has failed.
+// Returns once all started phases have finished: 0 if all succeeded, or otherwise the result of the first failed phase
+// (in array order), after tearing down the phases that succeeded (in reverse array order).
+int InitPhases_run(InitPhase* phases, unsigned int count, unsigned int threadCount);
+
+
+#endif // _InitPhases_h_
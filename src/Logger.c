@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -35,8 +36,11 @@
 
 #include "Logger.h"
 
+#include "Affinity.h"
 #include "Boat.h"
 #include "ErrLog.h"
+#include "Probes.h"
+#include "WindField.h"
 #include "WxUtils.h"
 
 
@@ -48,6 +52,9 @@
 
 #define SQLITE_BUSY_RETRIES_MAX (5)
 
+// How long a statement waits on the DB being locked (e.g. by a boat restore reading a batch) before giving BUSY
+#define SQLITE_BUSY_TIMEOUT_MS (5000)
+
 
 typedef struct LogEntries LogEntries;
 
@@ -59,6 +66,13 @@ struct LogEntries
 	CelestialSightEntry* cs;
 	unsigned int csCount;
 
+	BoatEventEntry* ev;
+	unsigned int evCount;
+
+	ScheduledCommandEntry* sc;
+	unsigned int scCount;
+	time_t scDoneUpTo;
+
 	LogEntries* next;
 };
 
@@ -69,8 +83,15 @@ static LogEntries* _logsLast = 0;
 static pthread_mutex_t _logsLock;
 static pthread_cond_t _logsCond;
 
+// Whether the logger thread is writing logs taken off the queue (signalled on _logsDoneCond once all are written)
+static bool _logsWriting = false;
+static pthread_cond_t _logsDoneCond;
+
 static bool _init = false;
 
+// Time of the last boat logs committed to the DB
+static atomic_llong _lastBoatLogTime = 0;
+
 
 static void* loggerThreadMain();
 
@@ -80,12 +101,22 @@ static void writeLogsSql(const LogEntry* const logEntries, unsigned int lCount,
 static void writeLogsSqlBoatLogs(const LogEntry* const logEntries, unsigned int lCount);
 static void writeLogsSqlCelestialSights(const CelestialSightEntry* const csEntries, unsigned int csCount);
 
+static void writeEventsCsv(const BoatEventEntry* const events, unsigned int evCount);
+static void writeEventsSql(const BoatEventEntry* const events, unsigned int evCount);
+
+static void writeScheduledCommandsSql(const ScheduledCommandEntry* const entries, unsigned int count, time_t doneUpTo);
+
+static void queueLogEntries(LogEntries* l);
+
 
 static const char* _csvLoggerDir = 0;
 
 static sqlite3* _sql = 0;
 static sqlite3_stmt* _sqlInsertStmtBoatLog;
 static sqlite3_stmt* _sqlInsertStmtCelestialSight;
+static sqlite3_stmt* _sqlInsertStmtBoatEvent = 0;
+static sqlite3_stmt* _sqlInsertStmtScheduledCommand = 0;
+static sqlite3_stmt* _sqlDeleteStmtScheduledCommand = 0;
 
 static int setupSql(const char* sqliteDbFilename);
 
@@ -104,7 +135,7 @@ int Logger_init(const char* csvLoggerDir, const char* sqliteDbFilename)
 		return 0;
 	}
 
-	_csvLoggerDir = strdup(csvLoggerDir);
+	_csvLoggerDir = csvLoggerDir ? strdup(csvLoggerDir) : 0;
 
 	if (0 != pthread_mutex_init(&_logsLock, 0))
 	{
@@ -112,7 +143,7 @@ int Logger_init(const char* csvLoggerDir, const char* sqliteDbFilename)
 		return -4;
 	}
 
-	if (0 != pthread_cond_init(&_logsCond, 0))
+	if (0 != pthread_cond_init(&_logsCond, 0) || 0 != pthread_cond_init(&_logsDoneCond, 0))
 	{
 		ERRLOG("Failed to init logs condvar!");
 		return -4;
@@ -142,13 +173,15 @@ int Logger_init(const char* csvLoggerDir, const char* sqliteDbFilename)
 	}
 #endif
 
+	Affinity_applyToThread(_loggerThread, AFFINITY_ROLE_LOGGER);
+
 	_init = true;
 	return 0;
 }
 
 static char* LOGGER_DEFAULT_LOG_BOAT_NAME = "__default__";
 
-void Logger_fillLogEntry(Boat* boat, const char* name, time_t t, bool reportVisible, LogEntry* log)
+void Logger_fillLogEntry(const Boat* boat, const char* name, time_t t, bool reportVisible, LogEntry* log)
 {
 	if (!_init)
 	{
@@ -163,7 +196,8 @@ void Logger_fillLogEntry(Boat* boat, const char* name, time_t t, bool reportVisi
 
 	double windGustAngle = wx.wind.angle;
 
-	if (odValid)
+	// Current-adjusted wind, from the precomputed wind field (as seen by the boat) if there is one
+	if (!WindField_get(&boat->pos, &wx, &windGustAngle) && odValid)
 	{
 		windGustAngle = WxUtils_adjustWindForCurrent(&wx, &od.current);
 	}
@@ -198,7 +232,7 @@ void Logger_fillLogEntry(Boat* boat, const char* name, time_t t, bool reportVisi
 	log->oceanDataValid = odValid;
 	log->waveData = wd;
 	log->waveDataValid = wdValid;
-	log->boatState = (boat->stop ? 0 : (boat->sailsDown ? 2 : 1));
+	log->boatState = ((boat->boatFlags & BOAT_FLAG_GHOST) ? 3 : (boat->stop ? 0 : (boat->sailsDown ? 2 : 1)));
 	log->locState = (isWater ? 0 : 1);
 	log->reportVisible = reportVisible;
 }
@@ -221,7 +255,154 @@ void Logger_writeLogs(LogEntry* logEntries, unsigned int lCount, CelestialSightE
 	l->lCount = lCount;
 	l->cs = csEntries;
 	l->csCount = csCount;
+	l->ev = 0;
+	l->evCount = 0;
+	l->sc = 0;
+	l->scCount = 0;
+	l->scDoneUpTo = 0;
+
+	PROBE2(log_enqueue, lCount, csCount);
+
+	queueLogEntries(l);
+}
+
+void Logger_writeEvents(BoatEventEntry* events, unsigned int evCount)
+{
+	if (!_init)
+	{
+		Logger_freeEvents(events, evCount);
+		return;
+	}
+
+	LogEntries* l = malloc(sizeof(LogEntries));
+	if (!l)
+	{
+		ERRLOG("writeEvents: Alloc failed for LogEntries!");
+		Logger_freeEvents(events, evCount);
+		return;
+	}
+
+	l->logs = 0;
+	l->lCount = 0;
+	l->cs = 0;
+	l->csCount = 0;
+	l->ev = events;
+	l->evCount = evCount;
+	l->sc = 0;
+	l->scCount = 0;
+	l->scDoneUpTo = 0;
+
+	queueLogEntries(l);
+}
+
+void Logger_freeEvents(BoatEventEntry* events, unsigned int evCount)
+{
+	for (unsigned int i = 0; i < evCount; i++)
+	{
+		free(events[i].boatName);
+		free(events[i].ref);
+	}
+
+	free(events);
+}
+
+void Logger_writeScheduledCommands(ScheduledCommandEntry* entries, unsigned int count, time_t doneUpTo)
+{
+	if (!_init || !_sql)
+	{
+		Logger_freeScheduledCommands(entries, count);
+		return;
+	}
+
+	LogEntries* l = malloc(sizeof(LogEntries));
+	if (!l)
+	{
+		ERRLOG("writeScheduledCommands: Alloc failed for LogEntries!");
+		Logger_freeScheduledCommands(entries, count);
+		return;
+	}
+
+	l->logs = 0;
+	l->lCount = 0;
+	l->cs = 0;
+	l->csCount = 0;
+	l->ev = 0;
+	l->evCount = 0;
+	l->sc = entries;
+	l->scCount = count;
+	l->scDoneUpTo = doneUpTo;
+
+	queueLogEntries(l);
+}
+
+void Logger_freeScheduledCommands(ScheduledCommandEntry* entries, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++)
+	{
+		free(entries[i].command);
+	}
+
+	free(entries);
+}
+
+void Logger_flush()
+{
+	if (!_init)
+	{
+		return;
+	}
+
+	if (0 != pthread_mutex_lock(&_logsLock))
+	{
+		ERRLOG("flush: Failed to lock logs mutex!");
+		return;
+	}
+
+	while (_logs != 0 || _logsWriting)
+	{
+		if (0 != pthread_cond_wait(&_logsDoneCond, &_logsLock))
+		{
+			ERRLOG("flush: Failed to wait on condvar!");
+		}
+	}
+
+	if (0 != pthread_mutex_unlock(&_logsLock))
+	{
+		ERRLOG("flush: Failed to unlock logs mutex!");
+	}
+}
+
+bool Logger_isIdle()
+{
+	if (!_init)
+	{
+		return true;
+	}
+
+	if (0 != pthread_mutex_lock(&_logsLock))
+	{
+		ERRLOG("isIdle: Failed to lock logs mutex!");
+		return false;
+	}
+
+	const bool idle = (_logs == 0 && !_logsWriting);
 
+	if (0 != pthread_mutex_unlock(&_logsLock))
+	{
+		ERRLOG("isIdle: Failed to unlock logs mutex!");
+	}
+
+	return idle;
+}
+
+time_t Logger_getLastBoatLogTime()
+{
+	return (time_t) atomic_load(&_lastBoatLogTime);
+}
+
+
+static void queueLogEntries(LogEntries* l)
+{
 	l->next = 0;
 
 	if (0 != pthread_mutex_lock(&_logsLock))
@@ -282,15 +463,37 @@ static void* loggerThreadMain()
 			CelestialSightEntry* cs = l->cs;
 			unsigned int csCount = l->csCount;
 
+			BoatEventEntry* ev = l->ev;
+			unsigned int evCount = l->evCount;
+
+			ScheduledCommandEntry* sc = l->sc;
+			unsigned int scCount = l->scCount;
+			const time_t scDoneUpTo = l->scDoneUpTo;
+
 			_logs = l->next;
+			_logsWriting = true;
 
 			if (0 != pthread_mutex_unlock(&_logsLock))
 			{
 				ERRLOG("loggerThreadMain: Failed to unlock logs mutex!");
 			}
 
-			writeLogsSql(entries, lCount, cs, csCount);
-			writeLogsCsv(entries, lCount, cs, csCount);
+			if (ev)
+			{
+				writeEventsSql(ev, evCount);
+				writeEventsCsv(ev, evCount);
+			}
+			else if (sc || scDoneUpTo > 0)
+			{
+				writeScheduledCommandsSql(sc, scCount, scDoneUpTo);
+			}
+			else
+			{
+				writeLogsSql(entries, lCount, cs, csCount);
+				writeLogsCsv(entries, lCount, cs, csCount);
+
+				PROBE2(log_sink_done, lCount, csCount);
+			}
 
 			for (unsigned int i = 0; i < lCount; i++)
 			{
@@ -302,14 +505,20 @@ static void* loggerThreadMain()
 
 			free(entries);
 			free(cs);
+			Logger_freeEvents(ev, evCount);
+			Logger_freeScheduledCommands(sc, scCount);
 			free(l);
 
 			if (0 != pthread_mutex_lock(&_logsLock))
 			{
 				ERRLOG("loggerThreadMain: Failed to lock logs mutex!");
 			}
+
+			_logsWriting = false;
 		}
 
+		pthread_cond_broadcast(&_logsDoneCond);
+
 		if (0 != pthread_mutex_unlock(&_logsLock))
 		{
 			ERRLOG("loggerThreadMain: Failed to unlock logs mutex!");
@@ -381,7 +590,7 @@ static void writeLogsCsv(const LogEntry* const logEntries, unsigned int lCount,
 		//  - visibility
 		//  - precip rate
 		//  - precip type
-		//  - boat status (0: stopped; 1: moving - sailing; 2: moving - sails down)
+		//  - boat status (0: stopped; 1: moving - sailing; 2: moving - sails down; 3: ghost replaying a recorded track)
 		//  - boat location (0: water; 1: landed)
 		//  - water salinity
 		//  - ocean ice
@@ -866,6 +1075,11 @@ static void writeLogsSqlBoatLogs(const LogEntry* const logEntries, unsigned int
 	}
 
 	ERRLOG("Committed BoatLogs DB transaction.");
+
+	if (lCount > 0)
+	{
+		atomic_store(&_lastBoatLogTime, (long long) logEntries[0].time);
+	}
 }
 
 static void writeLogsSqlCelestialSights(const CelestialSightEntry* const csEntries, unsigned int csCount)
@@ -982,6 +1196,262 @@ static void writeLogsSqlCelestialSights(const CelestialSightEntry* const csEntri
 	ERRLOG("Committed CelestialSights DB transaction.");
 }
 
+static void writeEventsCsv(const BoatEventEntry* const events, unsigned int evCount)
+{
+	if (!_csvLoggerDir)
+	{
+		return;
+	}
+
+	DIR* dir = opendir(_csvLoggerDir);
+	if (dir)
+	{
+		// Directory exists.
+		closedir(dir);
+	}
+	else
+	{
+		// Directory doesn't exist (or can't be opened), so don't write CSV logs.
+		return;
+	}
+
+	for (unsigned int i = 0; i < evCount; i++)
+	{
+		const BoatEventEntry* const ev = events + i;
+
+		char filepath[CSV_LOGGER_DIR_PATH_MAXLEN + 512];
+		snprintf(filepath, CSV_LOGGER_DIR_PATH_MAXLEN + 512, "%s/%s-ev.csv", _csvLoggerDir, ev->boatName);
+
+		FILE* f = fopen(filepath, "a");
+		if (f == 0)
+		{
+			ERRLOG1("Failed to open log output file: %s", filepath);
+			continue;
+		}
+
+		char logLine[CSV_LOGGER_LINE_BUF_SIZE];
+
+		// Log:
+		//  - time
+		//  - event type
+		//  - event reference (e.g. other boat name)
+		//  - event value
+
+		snprintf(logLine, CSV_LOGGER_LINE_BUF_SIZE, "%lu,%d,%s,%.3f\n",
+			ev->time,
+			ev->type,
+			(ev->ref ? ev->ref : ""),
+			ev->value
+			);
+
+		size_t l = strlen(logLine);
+		size_t w;
+		if (l != (w = fwrite(logLine, 1, l, f)))
+		{
+			ERRLOG2("Failed to write boat event entry of %ld bytes for %s!", l, ev->boatName);
+		}
+
+		fclose(f);
+	}
+}
+
+static void writeEventsSql(const BoatEventEntry* const events, unsigned int evCount)
+{
+	if (!_sql || !_sqlInsertStmtBoatEvent)
+	{
+		return;
+	}
+
+	int src;
+	unsigned int busyRetryCounter;
+
+	busyRetryCounter = SQLITE_BUSY_RETRIES_MAX;
+	while (SQLITE_OK != (src = sqlite3_exec(_sql, "BEGIN IMMEDIATE TRANSACTION;", 0, 0, 0)))
+	{
+		if (SQLITE_BUSY == src && busyRetryCounter > 0)
+		{
+			busyRetryCounter--;
+			ERRLOG1("Got BUSY trying to begin transaction. Trying again in 1 second (%u retries remaining)...", busyRetryCounter);
+			sleep(1);
+		}
+		else
+		{
+			ERRLOG1("Failed to begin SQL transaction! sqlite rc=%d", src);
+			return;
+		}
+	}
+
+	for (unsigned int i = 0; i < evCount; i++)
+	{
+		const BoatEventEntry* const ev = events + i;
+
+		if (SQLITE_OK != (src = sqlite3_reset(_sqlInsertStmtBoatEvent)))
+		{
+			ERRLOG1("Failed to reset stmt! sqlite rc=%d", src);
+			continue;
+		}
+
+
+		int n = 0;
+
+		if (SQLITE_OK != (src = sqlite3_bind_text(_sqlInsertStmtBoatEvent, ++n, ev->boatName, -1, 0)))
+		{
+			ERRLOG1("Failed to bind boatName! sqlite rc=%d", src);
+			continue;
+		}
+
+		if (SQLITE_OK != (src = sqlite3_bind_int64(_sqlInsertStmtBoatEvent, ++n, ev->time)))
+		{
+			ERRLOG1("Failed to bind time! sqlite rc=%d", src);
+			continue;
+		}
+
+		if (SQLITE_OK != (src = sqlite3_bind_int(_sqlInsertStmtBoatEvent, ++n, ev->type)))
+		{
+			ERRLOG1("Failed to bind event type! sqlite rc=%d", src);
+			continue;
+		}
+
+		if (SQLITE_OK != (src = (ev->ref ? sqlite3_bind_text(_sqlInsertStmtBoatEvent, ++n, ev->ref, -1, 0) : sqlite3_bind_null(_sqlInsertStmtBoatEvent, ++n))))
+		{
+			ERRLOG1("Failed to bind event ref! sqlite rc=%d", src);
+			continue;
+		}
+
+		if (SQLITE_OK != (src = sqlite3_bind_double(_sqlInsertStmtBoatEvent, ++n, ev->value)))
+		{
+			ERRLOG1("Failed to bind event value! sqlite rc=%d", src);
+			continue;
+		}
+
+
+		if (SQLITE_DONE != (src = sqlite3_step(_sqlInsertStmtBoatEvent)))
+		{
+			ERRLOG1("Failed to step insert! sqlite rc=%d", src);
+			continue;
+		}
+	}
+
+	busyRetryCounter = SQLITE_BUSY_RETRIES_MAX;
+	while (SQLITE_OK != (src = sqlite3_exec(_sql, "END TRANSACTION;", 0, 0, 0)))
+	{
+		if (SQLITE_BUSY == src && busyRetryCounter > 0)
+		{
+			busyRetryCounter--;
+			ERRLOG1("Got BUSY trying to end transaction. Trying again in 1 second (%u retries remaining)...", busyRetryCounter);
+			sleep(1);
+		}
+		else
+		{
+			ERRLOG1("Failed to end SQL transaction! sqlite rc=%d", src);
+
+			src = sqlite3_exec(_sql, "ROLLBACK;", 0, 0, 0);
+			if (SQLITE_OK != src)
+			{
+				ERRLOG1("Failed to rollback after failed end transaction! sqlite rc=%d", src);
+			}
+
+			return;
+		}
+	}
+}
+
+static void writeScheduledCommandsSql(const ScheduledCommandEntry* const entries, unsigned int count, time_t doneUpTo)
+{
+	if (!_sql || !_sqlInsertStmtScheduledCommand || !_sqlDeleteStmtScheduledCommand)
+	{
+		return;
+	}
+
+	int src;
+	unsigned int busyRetryCounter;
+
+	busyRetryCounter = SQLITE_BUSY_RETRIES_MAX;
+	while (SQLITE_OK != (src = sqlite3_exec(_sql, "BEGIN IMMEDIATE TRANSACTION;", 0, 0, 0)))
+	{
+		if (SQLITE_BUSY == src && busyRetryCounter > 0)
+		{
+			busyRetryCounter--;
+			ERRLOG1("Got BUSY trying to begin transaction. Trying again in 1 second (%u retries remaining)...", busyRetryCounter);
+			sleep(1);
+		}
+		else
+		{
+			ERRLOG1("Failed to begin SQL transaction! sqlite rc=%d", src);
+			return;
+		}
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const ScheduledCommandEntry* const sc = entries + i;
+
+		if (SQLITE_OK != (src = sqlite3_reset(_sqlInsertStmtScheduledCommand)))
+		{
+			ERRLOG1("Failed to reset stmt! sqlite rc=%d", src);
+			continue;
+		}
+
+		if (SQLITE_OK != (src = sqlite3_bind_int64(_sqlInsertStmtScheduledCommand, 1, sc->execTime)))
+		{
+			ERRLOG1("Failed to bind execution time! sqlite rc=%d", src);
+			continue;
+		}
+
+		if (SQLITE_OK != (src = sqlite3_bind_text(_sqlInsertStmtScheduledCommand, 2, sc->command, -1, 0)))
+		{
+			ERRLOG1("Failed to bind command! sqlite rc=%d", src);
+			continue;
+		}
+
+		if (SQLITE_DONE != (src = sqlite3_step(_sqlInsertStmtScheduledCommand)))
+		{
+			ERRLOG1("Failed to step insert! sqlite rc=%d", src);
+			continue;
+		}
+	}
+
+	// Removed after inserting, so that newly scheduled commands already due are not left behind.
+	if (doneUpTo > 0)
+	{
+		if (SQLITE_OK != (src = sqlite3_reset(_sqlDeleteStmtScheduledCommand)))
+		{
+			ERRLOG1("Failed to reset stmt! sqlite rc=%d", src);
+		}
+		else if (SQLITE_OK != (src = sqlite3_bind_int64(_sqlDeleteStmtScheduledCommand, 1, doneUpTo)))
+		{
+			ERRLOG1("Failed to bind done time! sqlite rc=%d", src);
+		}
+		else if (SQLITE_DONE != (src = sqlite3_step(_sqlDeleteStmtScheduledCommand)))
+		{
+			ERRLOG1("Failed to step delete! sqlite rc=%d", src);
+		}
+	}
+
+	busyRetryCounter = SQLITE_BUSY_RETRIES_MAX;
+	while (SQLITE_OK != (src = sqlite3_exec(_sql, "END TRANSACTION;", 0, 0, 0)))
+	{
+		if (SQLITE_BUSY == src && busyRetryCounter > 0)
+		{
+			busyRetryCounter--;
+			ERRLOG1("Got BUSY trying to end transaction. Trying again in 1 second (%u retries remaining)...", busyRetryCounter);
+			sleep(1);
+		}
+		else
+		{
+			ERRLOG1("Failed to end SQL transaction! sqlite rc=%d", src);
+
+			src = sqlite3_exec(_sql, "ROLLBACK;", 0, 0, 0);
+			if (SQLITE_OK != src)
+			{
+				ERRLOG1("Failed to rollback after failed end transaction! sqlite rc=%d", src);
+			}
+
+			return;
+		}
+	}
+}
+
 static int setupSql(const char* sqliteDbFilename)
 {
 	if (!sqliteDbFilename)
@@ -1016,6 +1486,12 @@ static int setupSql(const char* sqliteDbFilename)
 		return -1;
 	}
 
+	if (SQLITE_OK != (src = sqlite3_busy_timeout(_sql, SQLITE_BUSY_TIMEOUT_MS)))
+	{
+		ERRLOG1("Failed to set SQLite busy timeout. sqlite rc=%d", src);
+		return -1;
+	}
+
 
 	static const char* BOAT_LOG_INSERT_STMT_STR = "INSERT INTO BoatLog VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?);";
 	if (SQLITE_OK != (src = sqlite3_prepare_v2(_sql, BOAT_LOG_INSERT_STMT_STR, strlen(BOAT_LOG_INSERT_STMT_STR) + 1, &_sqlInsertStmtBoatLog, 0)))
@@ -1031,6 +1507,25 @@ static int setupSql(const char* sqliteDbFilename)
 		return -1;
 	}
 
+	// The BoatEvent table was added later, so don't fail on DBs that don't have it yet (events are just not written to the DB then).
+	static const char* BOAT_EVENT_INSERT_STMT_STR = "INSERT INTO BoatEvent VALUES (?,?,?,?,?);";
+	if (SQLITE_OK != (src = sqlite3_prepare_v2(_sql, BOAT_EVENT_INSERT_STMT_STR, strlen(BOAT_EVENT_INSERT_STMT_STR) + 1, &_sqlInsertStmtBoatEvent, 0)))
+	{
+		ERRLOG1("Failed to prepare BoatEvent insert statement, so not logging boat events to DB. sqlite rc=%d", src);
+		_sqlInsertStmtBoatEvent = 0;
+	}
+
+	// Likewise for the ScheduledCommand table (scheduled commands are then only kept in memory).
+	static const char* SCHEDULED_COMMAND_INSERT_STMT_STR = "INSERT INTO ScheduledCommand VALUES (?,?);";
+	static const char* SCHEDULED_COMMAND_DELETE_STMT_STR = "DELETE FROM ScheduledCommand WHERE execTime <= ?;";
+	if (SQLITE_OK != (src = sqlite3_prepare_v2(_sql, SCHEDULED_COMMAND_INSERT_STMT_STR, strlen(SCHEDULED_COMMAND_INSERT_STMT_STR) + 1, &_sqlInsertStmtScheduledCommand, 0)) ||
+			SQLITE_OK != (src = sqlite3_prepare_v2(_sql, SCHEDULED_COMMAND_DELETE_STMT_STR, strlen(SCHEDULED_COMMAND_DELETE_STMT_STR) + 1, &_sqlDeleteStmtScheduledCommand, 0)))
+	{
+		ERRLOG1("Failed to prepare ScheduledCommand statements, so not persisting scheduled commands. sqlite rc=%d", src);
+		_sqlInsertStmtScheduledCommand = 0;
+		_sqlDeleteStmtScheduledCommand = 0;
+	}
+
 
 	return 0;
 }
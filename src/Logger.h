@@ -74,7 +74,7 @@ typedef struct
 	proteus_WaveData waveData;
 	bool waveDataValid;
 
-	// Boat status (0: stopped; 1: moving - sailing; 2: moving - sails down)
+	// Boat status (0: stopped; 1: moving - sailing; 2: moving - sails down; 3: ghost replaying a recorded track)
 	unsigned char boatState;
 
 	// Boat location state (0: water; 1: landed)
@@ -105,8 +105,57 @@ typedef struct
 	double compassMagDec;
 } CelestialSightEntry;
 
+// Boat event types
+#define BOAT_EVENT_PROXIMITY		(1)	// Came within proximity radius of another boat in the same group (ref: other boat, value: distance in metres)
+#define BOAT_EVENT_GATE_CROSSING	(2)	// Crossed a race gate line (ref: mark name, value: crossing time, with fractional seconds)
+#define BOAT_EVENT_FINISH_CROSSING	(3)	// Crossed a race finish line (ref: mark name, value: crossing time, with fractional seconds)
+#define BOAT_EVENT_ZONE_STOP		(4)	// Stopped at the boundary of a restricted zone (ref: zone name)
+#define BOAT_EVENT_ZONE_PENALTY		(5)	// Entered a penalty zone (ref: zone name)
+
+typedef struct BoatEventEntry
+{
+	// Time
+	time_t time;
+
+	// Boat name
+	char* boatName;
+
+	// Event type (BOAT_EVENT_*)
+	int type;
+
+	// Other boat, mark, zone, etc. that the event refers to (may be null)
+	char* ref;
+
+	// Event-specific value
+	double value;
+} BoatEventEntry;
+
+typedef struct
+{
+	// Scheduled execution time
+	time_t execTime;
+
+	// Command string (without the execution time)
+	char* command;
+} ScheduledCommandEntry;
+
 int Logger_init(const char* csvLoggerDir, const char* sqliteDbFilename);
-void Logger_fillLogEntry(Boat* boat, const char* name, time_t t, bool reportVisible, LogEntry* log);
+void Logger_fillLogEntry(const Boat* boat, const char* name, time_t t, bool reportVisible, LogEntry* log);
 void Logger_writeLogs(LogEntry* logEntries, unsigned int lCount, CelestialSightEntry* csEntries, unsigned int csCount);
+void Logger_writeEvents(BoatEventEntry* events, unsigned int evCount);
+void Logger_freeEvents(BoatEventEntry* events, unsigned int evCount);
+
+// Persists newly scheduled commands (to the DB only), and removes persisted ones due at or before doneUpTo (if positive).
+void Logger_writeScheduledCommands(ScheduledCommandEntry* entries, unsigned int count, time_t doneUpTo);
+void Logger_freeScheduledCommands(ScheduledCommandEntry* entries, unsigned int count);
+
+// Waits until all logs (and scheduled commands) queued so far have been written.
+void Logger_flush();
+
+// Whether there are no logs queued or being written.
+bool Logger_isIdle();
+
+// Returns the time of the last boat logs committed to the DB (or 0 if none yet), safe to call from any thread.
+time_t Logger_getLastBoatLogTime();
 
 #endif // _Logger_h_
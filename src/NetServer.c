@@ -16,6 +16,7 @@
 
 #include <errno.h>
 #include <netdb.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdatomic.h>
 #include <stdbool.h>
@@ -23,25 +24,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <proteus/Ocean.h>
 #include <proteus/Wave.h>
 #include <proteus/Weather.h>
 
 #include "NetServer.h"
+#include "Affinity.h"
 #include "Boat.h"
 #include "BoatRegistry.h"
+#include "BoatRestore.h"
 #include "Command.h"
+#include "Counters.h"
+#include "Ensemble.h"
 #include "ErrLog.h"
-#include "WxUtils.h"
+#include "FleetTiles.h"
+#include "HttpApi.h"
+#include "Probes.h"
+#include "Profiler.h"
+#include "Proximity.h"
+#include "WindField.h"
 
 
 #define ERRLOG_ID "NetServer"
 #define THREAD_NAME "NetServer"
+#define HTTP_THREAD_NAME "NetServerHttp"
 #define WORKER_THREAD_NAME_PREFIX "NSWorker"
 
 
@@ -58,7 +73,15 @@
 #define REQ_TYPE_BOAT_CMD				(10)
 #define REQ_TYPE_BOAT_GROUP_MEMBERSHIP			(11)
 #define REQ_TYPE_SYS_REQUEST_COUNTS			(12)
-#define COUNTERS_REQ_TYPE_COUNT				(REQ_TYPE_SYS_REQUEST_COUNTS + 1)
+#define REQ_TYPE_GROUP_PROXIMITY			(13)
+#define REQ_TYPE_FLEET_TILE				(14)
+#define REQ_TYPE_BOAT_CMD_SYNC				(15)
+#define REQ_TYPE_SYS_NET_WORKERS			(16)
+#define REQ_TYPE_GROUP_ETA				(17)
+#define REQ_TYPE_SYS_PROFILE_START			(18)
+#define REQ_TYPE_SYS_PROFILE_STOP			(19)
+#define REQ_TYPE_SYS_BOAT_TIERS				(20)
+#define COUNTERS_REQ_TYPE_COUNT				(REQ_TYPE_SYS_BOAT_TIERS + 1)
 
 static const char* REQ_STR_GET_WIND =			"wind";
 static const char* REQ_STR_GET_WIND_ADJCUR =		"wind_c";
@@ -72,21 +95,37 @@ static const char* REQ_STR_GET_BOAT_DATA_NO_CELESTIAL =	"bd_nc";
 static const char* REQ_STR_BOAT_CMD =			"boatcmd";
 static const char* REQ_STR_BOAT_GROUP_MEMBERSHIP =	"boatgroupmembers";
 static const char* REQ_STR_SYS_REQUEST_COUNTS =		"sys_req_counts";
+static const char* REQ_STR_GROUP_PROXIMITY =		"group_proximity";
+static const char* REQ_STR_FLEET_TILE =			"fleet_tile";
+static const char* REQ_STR_BOAT_CMD_SYNC =		"boatcmd_sync";
+static const char* REQ_STR_SYS_NET_WORKERS =		"sys_net_workers";
+static const char* REQ_STR_GROUP_ETA =			"eta";
+static const char* REQ_STR_SYS_PROFILE_START =		"sys_prof_start";
+static const char* REQ_STR_SYS_PROFILE_STOP =		"sys_prof_stop";
+static const char* REQ_STR_SYS_BOAT_TIERS =		"sys_boat_tiers";
 
+// Optional client token prefix of boat commands (e.g. "boatcmd,#abc123,TestBoat,start"), echoed back in the response
+#define BOAT_CMD_TOKEN_PREFIX '#'
+#define BOAT_CMD_TOKEN_MAX_LEN (64)
 
-#define REQ_MAX_ARG_COUNT (2)
+
+#define REQ_MAX_ARG_COUNT (3)
 
 #define REQ_VAL_NONE	(0)
 #define REQ_VAL_INT	(1)
 #define REQ_VAL_DOUBLE	(2)
 #define REQ_VAL_STRING	(3)
 
-static const uint8_t REQ_VALS_NONE[REQ_MAX_ARG_COUNT] = { REQ_VAL_NONE, REQ_VAL_NONE };
+static const uint8_t REQ_VALS_NONE[REQ_MAX_ARG_COUNT] = { REQ_VAL_NONE, REQ_VAL_NONE, REQ_VAL_NONE };
 
-static const uint8_t REQ_VALS_LAT_LON[REQ_MAX_ARG_COUNT] = { REQ_VAL_DOUBLE, REQ_VAL_DOUBLE };
-static const uint8_t REQ_VALS_BOAT_DATA[REQ_MAX_ARG_COUNT] = { REQ_VAL_STRING, REQ_VAL_NONE };
+static const uint8_t REQ_VALS_LAT_LON[REQ_MAX_ARG_COUNT] = { REQ_VAL_DOUBLE, REQ_VAL_DOUBLE, REQ_VAL_NONE };
+static const uint8_t REQ_VALS_BOAT_DATA[REQ_MAX_ARG_COUNT] = { REQ_VAL_STRING, REQ_VAL_NONE, REQ_VAL_NONE };
 
-static const uint8_t REQ_VALS_BOAT_GROUP_MEMBERSHIP[REQ_MAX_ARG_COUNT] = { REQ_VAL_STRING, REQ_VAL_NONE };
+static const uint8_t REQ_VALS_BOAT_GROUP_MEMBERSHIP[REQ_MAX_ARG_COUNT] = { REQ_VAL_STRING, REQ_VAL_NONE, REQ_VAL_NONE };
+static const uint8_t REQ_VALS_GROUP_PROXIMITY[REQ_MAX_ARG_COUNT] = { REQ_VAL_STRING, REQ_VAL_NONE, REQ_VAL_NONE };
+static const uint8_t REQ_VALS_FLEET_TILE[REQ_MAX_ARG_COUNT] = { REQ_VAL_INT, REQ_VAL_INT, REQ_VAL_INT };
+static const uint8_t REQ_VALS_GROUP_ETA[REQ_MAX_ARG_COUNT] = { REQ_VAL_STRING, REQ_VAL_NONE, REQ_VAL_NONE };
+static const uint8_t REQ_VALS_SYS_PROFILE_START[REQ_MAX_ARG_COUNT] = { REQ_VAL_INT, REQ_VAL_NONE, REQ_VAL_NONE };
 
 typedef union
 {
@@ -96,15 +135,25 @@ typedef union
 } ReqValue;
 
 
+// Returned to a worker thread to tell it to retire, after idling for long enough with the pool over its minimum size
+#define NEXT_FD_RETIRE (-2)
+
+
 #define RECV_MSG_BUF_SIZE (1024)
 #define SEND_MSG_BUF_SIZE (64 * 1024)
 
+// HTTP requests (with all their headers) must fit in the receive buffer.
+#define HTTP_RECV_BUF_SIZE (8 * 1024)
+#define HTTP_HEAD_BUF_SIZE (256)
+#define HTTP_KEEPALIVE_TIMEOUT_S (30)
+
+// Profiles written by sys_prof_stop (by Unix time), in the working directory
+#define PROFILE_PATH_FORMAT "profile-%ld.folded"
+
+// handleRequest() results, other than 0 (for a response populated)
+#define REQ_HANDLE_BAD		(-1)
+#define REQ_HANDLE_NOT_FOUND	(-2)
 
-#define CACHE_LINE_SIZE (64)
-typedef union {
-	atomic_int_fast64_t i64;
-	atomic_uint_fast64_t u64;
-} __attribute__((aligned(CACHE_LINE_SIZE))) CacheLineAlignedAtomic;
 
 // Statistics counters
 #define COUNTER_ACCEPT		(0)
@@ -115,214 +164,362 @@ typedef union {
 #define COUNTER_MESSAGE		(5)
 #define COUNTER_MESSAGE_FAIL	(6)
 #define COUNTERS_COUNT		(COUNTER_MESSAGE_FAIL + 1)
-static CacheLineAlignedAtomic _counter[COUNTERS_COUNT] = { 0 };
 
-// Request type statistics counters
-static CacheLineAlignedAtomic _counterReqType[COUNTERS_REQ_TYPE_COUNT] = { 0 };
+// Request type statistics counters follow the others.
+#define COUNTER_REQ_TYPE_BASE	(COUNTERS_COUNT)
+
+// Sharded per thread, with each thread's own copy created on first use
+static Counters _counters = COUNTERS_INITIALIZER(COUNTERS_COUNT + COUNTERS_REQ_TYPE_COUNT);
+static __thread CountersSlot* _threadCounters = 0;
 
 
-static int startListen(const char* host, unsigned int port);
+static int startListen(const char* host, unsigned int port, int* listenFd);
+static int startListenUnix(const char* path, int* listenFd);
+
+static int startServerThread(unsigned int workerThreads);
+static int startHttpThread();
+static bool isAcceptStopped(int listenFd);
 
 static void* netServerThreadMain(void* arg);
-static int queueAcceptedFd(int fd);
+static void* httpThreadMain(void* arg);
+static int queueAcceptedFd(int fd, bool http);
+
+static int startMinWorkers();
+static int reserveWorkerSlot();
+static int startWorker(int slot);
 
 static void* netServerWorkerThreadMain(void* arg);
-static int getNextFd();
+static int getNextFd(unsigned int workerThreadId, bool afterConnection, long busyNs, bool* http);
 static void processConnection(unsigned int workerThreadId, int fd);
+static void processHttpConnection(unsigned int workerThreadId, int fd);
+static int writeAll(int fd, const char* buf, size_t len);
+static int writeHttpResponse(int fd, const char* head, size_t headLen, const char* body, size_t bodyLen);
 
 static void incCounter(int ctr);
 static void incReqTypeCounter(int ctr);
 
+static int handleRequest(char* reqStr, bool json, char* buf, size_t bufSize, int* reqType);
 static int getReqType(const char* s);
 static const uint8_t* getReqExpectedValueTypes(int reqType);
 static bool areValuesValidForReqType(int reqType, ReqValue values[REQ_MAX_ARG_COUNT]);
 
-static void populateWindResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool gust, bool adjustForCurrent);
-static void populateOceanResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool seaIce);
-static void populateWaveResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos);
-static void populateBoatDataResponse(char* buf, size_t bufSize, const char* key, bool noCelestial);
+static void populateWindResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool gust, bool adjustForCurrent, bool json);
+static void populateOceanResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool seaIce, bool json);
+static void populateWaveResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool json);
+static void populateBoatDataResponse(char* buf, size_t bufSize, const char* key, bool noCelestial, bool json);
 static void populateBoatCmdResponse(char* buf, size_t bufSize, char** tok);
-static void populateBoatGroupMembershipResponse(char* buf, size_t bufSize, const char* key);
-static void populateSysRequestCountsResponse(char* buf, size_t bufSize);
+static void populateBoatCmdSyncResponse(char* buf, size_t bufSize, char** tok);
+static char* takeBoatCmdToken(char* cmdStr, char* tokenSuffix, size_t tokenSuffixSize);
+static void populateBoatGroupMembershipResponse(char* buf, size_t bufSize, const char* key, bool json);
+static void populateGroupProximityResponse(char* buf, size_t bufSize, const char* key, bool json);
+static void populateFleetTileResponse(char* buf, size_t bufSize, int z, int x, int y, bool json);
+static void populateGroupEtaResponse(char* buf, size_t bufSize, const char* key, bool json);
+static void populateSysRequestCountsResponse(char* buf, size_t bufSize, bool json);
+static void populateSysNetWorkersResponse(char* buf, size_t bufSize, bool json);
+static void populateSysProfileStartResponse(char* buf, size_t bufSize, int hz);
+static void populateSysProfileStopResponse(char* buf, size_t bufSize);
+static void populateSysBoatTiersResponse(char* buf, size_t bufSize, bool json);
+static int populateJsonKeyResponseStart(char* buf, size_t bufSize, const char* type, const char* keyName, const char* key, const char* status);
 
 
 static pthread_t _netServerThread;
 static int _listenFd = 0;
 
+static pthread_t _httpThread;
+static int _httpListenFd = 0;
 
-int NetServer_init(const char* host, unsigned int port, unsigned int workerThreads)
+// Pipe for stopping the listener threads from accepting (with workers left serving connections already accepted)
+static int _acceptStopPipe[2] = { -1, -1 };
+
+// Set while stopped accepting, so that HTTP keep-alive connections are closed after their next response (for clients to
+// reconnect, to whichever process is accepting by then).
+static atomic_bool _acceptStopped = false;
+
+static NetServer_RequestHandlerFunc _requestHandler = &NetServer_handleRequest;
+
+
+int NetServer_init(const char* host, unsigned int port, const char* unixPath, unsigned int workerThreads)
 {
-	if (startListen(host, port) != 0)
+	if (_listenFd > 0)
 	{
-		ERRLOG1("Failed to start listening on localhost port %d!", port);
-		return -2;
+		ERRLOG("Net server already started!");
+		return -3;
 	}
 
-	ERRLOG1("Listening on port %d", port);
+	if (unixPath)
+	{
+		if (startListenUnix(unixPath, &_listenFd) != 0)
+		{
+			ERRLOG1("Failed to start listening on unix socket %s!", unixPath);
+			return -2;
+		}
 
-	unsigned int* wt = malloc(sizeof(unsigned int));
-	if (!wt)
+		ERRLOG1("Listening on unix socket %s", unixPath);
+	}
+	else
 	{
-		ERRLOG("Failed to alloc arg wt for thread!");
-		return -1;
+		if (startListen(host, port, &_listenFd) != 0)
+		{
+			ERRLOG1("Failed to start listening on localhost port %d!", port);
+			return -2;
+		}
+
+		ERRLOG1("Listening on port %d", port);
 	}
 
-	*wt = workerThreads;
+	return startServerThread(workerThreads);
+}
 
-	if (0 != pthread_create(&_netServerThread, 0, &netServerThreadMain, wt))
+int NetServer_initWithFd(int listenFd, unsigned int workerThreads)
+{
+	if (_listenFd > 0)
 	{
-		ERRLOG("Failed to start net server thread!");
-		free(wt);
+		ERRLOG("Net server already started!");
+		return -3;
+	}
+
+	_listenFd = listenFd;
+	ERRLOG1("Listening on handed over socket fd %d", listenFd);
+
+	return startServerThread(workerThreads);
+}
+
+// Replaces the handler used for each request message received by worker threads (e.g. for request forwarding in router mode).
+// Must be called before NetServer_init().
+void NetServer_setRequestHandler(NetServer_RequestHandlerFunc requestHandler)
+{
+	_requestHandler = requestHandler;
+}
+
+int NetServer_handleRequest(int writeFd, char* reqStr)
+{
+	char buf[SEND_MSG_BUF_SIZE];
+	int reqType;
+
+	if (handleRequest(reqStr, false, buf, SEND_MSG_BUF_SIZE, &reqType) != 0)
+	{
+		PROBE2(netserver_request_end, reqType, -1);
+
+		if (write(writeFd, "error\n", 6) != 6)
+		{
+			return -1;
+		}
+
 		return -1;
 	}
 
-#if defined(_GNU_SOURCE) && defined(__GLIBC__)
-	if (0 != pthread_setname_np(_netServerThread, THREAD_NAME))
+	if (writeAll(writeFd, buf, strlen(buf)) != 0)
 	{
-		ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", THREAD_NAME);
+		PROBE2(netserver_request_end, reqType, -1);
+		return -1;
 	}
-#endif
+
+	PROBE2(netserver_request_end, reqType, 0);
 
 	return 0;
 }
 
-int NetServer_handleRequest(int writeFd, char* reqStr)
+int NetServer_initHttp(const char* host, unsigned int port, const char* unixPath)
 {
-	char* s;
-	char* t;
+	if (_listenFd <= 0)
+	{
+		ERRLOG("HTTP listener requires the net server to be started first!");
+		return -3;
+	}
 
-	if ((s = strtok_r(reqStr, ",", &t)) == 0)
+	if (_httpListenFd > 0)
 	{
-		goto fail;
+		ERRLOG("HTTP listener already started!");
+		return -3;
 	}
 
-	const int reqType = getReqType(s);
-	incReqTypeCounter(reqType);
+	if (unixPath)
+	{
+		if (startListenUnix(unixPath, &_httpListenFd) != 0)
+		{
+			ERRLOG1("Failed to start HTTP listening on unix socket %s!", unixPath);
+			return -2;
+		}
 
-	if (reqType == REQ_TYPE_INVALID)
+		ERRLOG1("HTTP listening on unix socket %s", unixPath);
+	}
+	else
 	{
-		goto fail;
+		if (startListen(host, port, &_httpListenFd) != 0)
+		{
+			ERRLOG1("Failed to start HTTP listening on port %d!", port);
+			return -2;
+		}
+
+		ERRLOG1("HTTP listening on port %d", port);
 	}
 
-	const uint8_t* vals = getReqExpectedValueTypes(reqType);
+	return startHttpThread();
+}
 
-	ReqValue values[REQ_MAX_ARG_COUNT];
+int NetServer_initHttpWithFd(int listenFd)
+{
+	if (_listenFd <= 0)
+	{
+		ERRLOG("HTTP listener requires the net server to be started first!");
+		return -3;
+	}
 
-	for (int i = 0; i < REQ_MAX_ARG_COUNT; i++)
+	if (_httpListenFd > 0)
 	{
-		switch (vals[i])
-		{
-			case REQ_VAL_NONE:
-				break;
+		ERRLOG("HTTP listener already started!");
+		return -3;
+	}
 
-			case REQ_VAL_INT:
-			case REQ_VAL_DOUBLE:
-			case REQ_VAL_STRING:
-				if ((s = strtok_r(0, ",", &t)) == 0)
-				{
-					goto fail;
-				}
+	_httpListenFd = listenFd;
+	ERRLOG1("HTTP listening on handed over socket fd %d", listenFd);
 
-				if (vals[i] == REQ_VAL_INT)
-				{
-					values[i].i = strtol(s, 0, 10);
-				}
-				else if (vals[i] == REQ_VAL_DOUBLE)
-				{
-					values[i].d = strtod(s, 0);
-				}
-				else
-				{
-					values[i].s = s;
-				}
+	return startHttpThread();
+}
 
-				break;
+void NetServer_getListenFds(int* listenFd, int* httpListenFd)
+{
+	*listenFd = (_listenFd > 0) ? _listenFd : -1;
+	*httpListenFd = (_httpListenFd > 0) ? _httpListenFd : -1;
+}
 
-			default:
-				goto fail;
-		}
+int NetServer_stopAccepting()
+{
+	if (_listenFd <= 0)
+	{
+		return 0;
 	}
 
-	if (!areValuesValidForReqType(reqType, values))
+	if (write(_acceptStopPipe[1], "x", 1) != 1)
 	{
-		goto fail;
+		ERRLOG1("Failed to signal listener threads to stop! errno=%d", errno);
+		return -1;
 	}
 
+	if (0 != pthread_join(_netServerThread, 0) || (_httpListenFd > 0 && 0 != pthread_join(_httpThread, 0)))
+	{
+		ERRLOG("Failed to join listener threads!");
+		return -1;
+	}
 
-	char buf[SEND_MSG_BUF_SIZE];
-	proteus_GeoPos pos = { values[0].d, values[1].d };
+	char c;
+	if (read(_acceptStopPipe[0], &c, 1) != 1)
+	{
+		ERRLOG1("Failed to reset listener stop pipe! errno=%d", errno);
+		return -1;
+	}
 
-	switch (reqType)
+	atomic_store(&_acceptStopped, true);
+	ERRLOG("Stopped accepting connections.");
+
+	return 0;
+}
+
+int NetServer_resumeAccepting()
+{
+	if (_listenFd <= 0)
 	{
-		case REQ_TYPE_GET_WIND:
-		case REQ_TYPE_GET_WIND_ADJCUR:
-			populateWindResponse(buf, SEND_MSG_BUF_SIZE, &pos, false, (reqType == REQ_TYPE_GET_WIND_ADJCUR));
-			break;
-		case REQ_TYPE_GET_WIND_GUST:
-		case REQ_TYPE_GET_WIND_GUST_ADJCUR:
-			populateWindResponse(buf, SEND_MSG_BUF_SIZE, &pos, true, (reqType == REQ_TYPE_GET_WIND_GUST_ADJCUR));
-			break;
-		case REQ_TYPE_GET_OCEAN_CURRENT:
-			populateOceanResponse(buf, SEND_MSG_BUF_SIZE, &pos, false);
-			break;
-		case REQ_TYPE_GET_SEA_ICE:
-			populateOceanResponse(buf, SEND_MSG_BUF_SIZE, &pos, true);
-			break;
-		case REQ_TYPE_GET_WAVE_HEIGHT:
-			populateWaveResponse(buf, SEND_MSG_BUF_SIZE, &pos);
-			break;
-		case REQ_TYPE_GET_BOAT_DATA:
-		case REQ_TYPE_GET_BOAT_DATA_NO_CELESTIAL:
-			populateBoatDataResponse(buf, SEND_MSG_BUF_SIZE, values[0].s, (reqType == REQ_TYPE_GET_BOAT_DATA_NO_CELESTIAL));
-			break;
-		case REQ_TYPE_BOAT_CMD:
-			populateBoatCmdResponse(buf, SEND_MSG_BUF_SIZE, &t);
-			break;
-		case REQ_TYPE_BOAT_GROUP_MEMBERSHIP:
-			populateBoatGroupMembershipResponse(buf, SEND_MSG_BUF_SIZE, values[0].s);
-			break;
-		case REQ_TYPE_SYS_REQUEST_COUNTS:
-			populateSysRequestCountsResponse(buf, SEND_MSG_BUF_SIZE);
-			break;
-		default:
-			goto fail;
+		return 0;
 	}
 
-	const int bl = strlen(buf);
-	int wt = 0;
+	atomic_store(&_acceptStopped, false);
 
-	for (;;)
+	// Worker pool already running, so just the listener threads
+	if (0 != startServerThread(0) || (_httpListenFd > 0 && 0 != startHttpThread()))
 	{
-		int wb = write(writeFd, buf + wt, bl - wt);
+		return -1;
+	}
 
-		if (wb < 0)
+	ERRLOG("Resumed accepting connections.");
+
+	return 0;
+}
+
+
+// Starts the listener thread, along with the worker pool of workerThreads (if not 0, otherwise only the listener
+// thread is started, for a worker pool already running).
+static int startServerThread(unsigned int workerThreads)
+{
+	if (_acceptStopPipe[0] < 0 && 0 != pipe(_acceptStopPipe))
+	{
+		ERRLOG1("Failed to create listener stop pipe! errno=%d", errno);
+		return -1;
+	}
+
+	unsigned int* wt = 0;
+	if (workerThreads > 0)
+	{
+		if (!(wt = malloc(sizeof(unsigned int))))
 		{
+			ERRLOG("Failed to alloc arg wt for thread!");
 			return -1;
 		}
-		else
-		{
-			wt += wb;
-		}
 
-		if (wt == bl)
-		{
-			break;
-		}
+		*wt = workerThreads;
+	}
+
+	if (0 != pthread_create(&_netServerThread, 0, &netServerThreadMain, wt))
+	{
+		ERRLOG("Failed to start net server thread!");
+		free(wt);
+		return -1;
+	}
+
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+	if (0 != pthread_setname_np(_netServerThread, THREAD_NAME))
+	{
+		ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", THREAD_NAME);
 	}
+#endif
+
+	Affinity_applyToThread(_netServerThread, AFFINITY_ROLE_NET);
 
 	return 0;
+}
 
-fail:
-	if (write(writeFd, "error\n", 6) != 6)
+static int startHttpThread()
+{
+	if (0 != pthread_create(&_httpThread, 0, &httpThreadMain, 0))
 	{
+		ERRLOG("Failed to start HTTP listener thread!");
+		close(_httpListenFd);
+		_httpListenFd = 0;
 		return -1;
 	}
 
-	return -1;
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+	if (0 != pthread_setname_np(_httpThread, HTTP_THREAD_NAME))
+	{
+		ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", HTTP_THREAD_NAME);
+	}
+#endif
+
+	Affinity_applyToThread(_httpThread, AFFINITY_ROLE_NET);
+
+	return 0;
 }
 
+// Waits for a connection to accept on listenFd, returning true if instead told to stop accepting.
+static bool isAcceptStopped(int listenFd)
+{
+	for (;;)
+	{
+		struct pollfd fds[2] = { { listenFd, POLLIN, 0 }, { _acceptStopPipe[0], POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno != EINTR)
+			{
+				ERRLOG1("Failed to poll listening socket! errno=%d", errno);
+				return false;
+			}
+			continue;
+		}
 
-static int startListen(const char* host, unsigned int port)
+		return (fds[1].revents != 0);
+	}
+}
+
+static int startListen(const char* host, unsigned int port, int* listenFd)
 {
 	int rc = 0;
 
@@ -356,14 +553,69 @@ static int startListen(const char* host, unsigned int port)
 		freeaddrinfo(ai);
 	}
 
-	_listenFd = socket(sa.sin_family, SOCK_STREAM, 0);
-	if (_listenFd < 0)
+	*listenFd = socket(sa.sin_family, SOCK_STREAM, 0);
+	if (*listenFd < 0)
+	{
+		ERRLOG1("Failed to open socket! errno=%d", errno);
+		return -1;
+	}
+
+	rc = bind(*listenFd, (struct sockaddr*) &sa, sizeof(struct sockaddr_in));
+	if (rc != 0)
+	{
+		ERRLOG2("Failed to bind socket! rc=%d errno=%d", rc, errno);
+		rc = -2;
+		goto done;
+	}
+
+	rc = listen(*listenFd, 100);
+	if (rc != 0)
+	{
+		ERRLOG2("Failed to listen on socket! rc=%d errno=%d", rc, errno);
+		rc = -3;
+		goto done;
+	}
+
+done:
+	if (rc != 0)
+	{
+		close(*listenFd);
+		*listenFd = 0;
+	}
+
+	return rc;
+}
+
+static int startListenUnix(const char* path, int* listenFd)
+{
+	int rc = 0;
+
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		ERRLOG("Unix socket path is too long!");
+		return -4;
+	}
+	strcpy(sa.sun_path, path);
+
+	// Remove any stale socket file left behind by a previous run.
+	if (unlink(path) != 0 && errno != ENOENT)
+	{
+		ERRLOG1("Failed to unlink existing unix socket path! errno=%d", errno);
+		return -5;
+	}
+
+	*listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (*listenFd < 0)
 	{
 		ERRLOG1("Failed to open socket! errno=%d", errno);
 		return -1;
 	}
 
-	rc = bind(_listenFd, (struct sockaddr*) &sa, sizeof(struct sockaddr_in));
+	rc = bind(*listenFd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un));
 	if (rc != 0)
 	{
 		ERRLOG2("Failed to bind socket! rc=%d errno=%d", rc, errno);
@@ -371,7 +623,7 @@ static int startListen(const char* host, unsigned int port)
 		goto done;
 	}
 
-	rc = listen(_listenFd, 100);
+	rc = listen(*listenFd, 100);
 	if (rc != 0)
 	{
 		ERRLOG2("Failed to listen on socket! rc=%d errno=%d", rc, errno);
@@ -382,8 +634,8 @@ static int startListen(const char* host, unsigned int port)
 done:
 	if (rc != 0)
 	{
-		close(_listenFd);
-		_listenFd = 0;
+		close(*listenFd);
+		*listenFd = 0;
 	}
 
 	return rc;
@@ -393,94 +645,171 @@ done:
 #define MAX_ACCEPTED_FDS (256)
 // Circular buffer for accepted fds waiting for a worker thread to free up
 static int _acceptedFds[MAX_ACCEPTED_FDS];
+static bool _acceptedFdsHttp[MAX_ACCEPTED_FDS];
 static int _acceptedFdsStart = 0;
 static int _acceptedFdsNext = 0;
 static bool _acceptedFdsHas = false;
-static pthread_mutex_t _acceptedFdsLock;
+static unsigned int _acceptedFdsCount = 0;
+static pthread_mutex_t _acceptedFdsLock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t _acceptedFdsCond;
 
-
-static void* netServerThreadMain(void* arg)
+// Worker pool (guarded by _acceptedFdsLock), with workers indexed by slot (also used as worker ID)
+static pthread_t _workerThreads[NETSERVER_MAX_THREAD_COUNT];
+static bool _workerSlotUsed[NETSERVER_MAX_THREAD_COUNT];
+static unsigned int _workerCount = 0;
+static unsigned int _idleWorkers = 0;
+static unsigned int _workersMin = 0;
+static unsigned int _workersMax = 0;
+static unsigned int _workerIdleRetireMs = 0;
+static bool _workersRunning = false;
+static bool _workersStopping = false;
+static uint64_t _workersStarted = 0;
+static uint64_t _workersRetired = 0;
+static uint64_t _workersBusyNs = 0;
+
+
+int NetServer_setWorkerPoolLimits(unsigned int minWorkers, unsigned int maxWorkers, unsigned int idleRetireMs)
 {
-	const unsigned int workerThreadCount = *((unsigned int*)arg);
-	free(arg);
-
-	pthread_t workerThreads[workerThreadCount];
+	if (minWorkers < 1 || maxWorkers < minWorkers || maxWorkers > NETSERVER_MAX_THREAD_COUNT)
+	{
+		ERRLOG2("Invalid worker pool limits: min=%u, max=%u", minWorkers, maxWorkers);
+		return -1;
+	}
 
-	if (0 != pthread_mutex_init(&_acceptedFdsLock, 0))
+	if (0 != pthread_mutex_lock(&_acceptedFdsLock))
 	{
-		ERRLOG("Failed to init accepted fds mutex!");
-		return 0;
+		ERRLOG("setWorkerPoolLimits: Failed to lock accepted fds mutex!");
+		return -2;
 	}
 
-	if (0 != pthread_cond_init(&_acceptedFdsCond, 0))
+	_workersMin = minWorkers;
+	_workersMax = maxWorkers;
+	_workerIdleRetireMs = idleRetireMs;
+
+	const bool running = _workersRunning;
+
+	if (running)
 	{
-		ERRLOG("Failed to init accepted fds condvar!");
-		return 0;
+		// Idle workers over the new minimum start counting towards retiring.
+		pthread_cond_broadcast(&_acceptedFdsCond);
 	}
 
-	ERRLOG1("Starting up %u worker threads...", workerThreadCount);
-	for (unsigned int i = 0; i < workerThreadCount; i++)
+	if (0 != pthread_mutex_unlock(&_acceptedFdsLock))
 	{
-		unsigned int* workerArg = malloc(sizeof(unsigned int));
-		if (!workerArg)
-		{
-			// TODO: Make this fatal?
-			ERRLOG1("Failed to alloc workerArg for thread %u!", i);
-			continue;
-		}
+		ERRLOG("setWorkerPoolLimits: Failed to unlock accepted fds mutex!");
+	}
+
+	ERRLOG3("Worker pool limits: min=%u, max=%u, idle retire=%ums", minWorkers, maxWorkers, idleRetireMs);
+
+	return running ? startMinWorkers() : 0;
+}
+
+void NetServer_getWorkerPoolStats(NetServerWorkerPoolStats* stats)
+{
+	pthread_mutex_lock(&_acceptedFdsLock);
+
+	stats->workers = _workerCount;
+	stats->idleWorkers = _idleWorkers;
+	stats->minWorkers = _workersMin;
+	stats->maxWorkers = _workersMax;
+	stats->queuedFds = _acceptedFdsCount;
+	stats->started = _workersStarted;
+	stats->retired = _workersRetired;
+	stats->busyNs = _workersBusyNs;
+
+	pthread_mutex_unlock(&_acceptedFdsLock);
+}
+
+
+// Accepts text protocol connections, having first started the worker pool (if arg is set, to its worker thread count,
+// otherwise the pool is already running and only accepting resumes).
+static void* netServerThreadMain(void* arg)
+{
+	if (arg)
+	{
+		const unsigned int workerThreadCount = *((unsigned int*)arg);
+		free(arg);
 
-		*workerArg = i;
-		if (0 != pthread_create(workerThreads + i, 0, &netServerWorkerThreadMain, workerArg))
+		// Timed waits (for idle workers to retire) on the monotonic clock
+		pthread_condattr_t condAttr;
+		if (0 != pthread_condattr_init(&condAttr) ||
+				0 != pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC) ||
+				0 != pthread_cond_init(&_acceptedFdsCond, &condAttr))
 		{
-			// TODO: Make this fatal?
-			ERRLOG1("Failed to start worker thread %u!", i);
-			free(workerArg);
-			continue;
+			ERRLOG("Failed to init accepted fds condvar!");
+			return 0;
 		}
+		pthread_condattr_destroy(&condAttr);
 
-#if defined(_GNU_SOURCE) && defined(__GLIBC__)
-		char threadName[32];
-		snprintf(threadName, 32, "%s%u", WORKER_THREAD_NAME_PREFIX, i);
-		if (0 != pthread_setname_np(workerThreads[i], threadName))
+		pthread_mutex_lock(&_acceptedFdsLock);
+		if (_workersMax == 0)
 		{
-			ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", threadName);
+			// No limits set, so a fixed size pool.
+			_workersMin = workerThreadCount;
+			_workersMax = workerThreadCount;
 		}
-#endif
+		_workersRunning = true;
+		pthread_mutex_unlock(&_acceptedFdsLock);
+
+		ERRLOG3("Starting up %u worker threads (pool size %u to %u)...", _workersMin, _workersMin, _workersMax);
+		startMinWorkers();
 	}
 
 	ERRLOG("Server thread preparing to accept...");
 
+	// Only this thread counts accepts.
+	uint64_t acceptCount = 0;
+
 	for (;;)
 	{
 		// Occasionally log statistics counters.
-		if ((_counter[COUNTER_ACCEPT].u64 & 0x03ff) == 0)
+		if ((acceptCount & 0x03ff) == 0)
 		{
+			uint64_t c[COUNTERS_COUNT + COUNTERS_REQ_TYPE_COUNT];
+			Counters_sum(&_counters, c);
+
 			ERRLOG7("Stats: accept=%lu, accept_fail=%lu, read=%lu, read_fail=%lu, data_too_long=%lu, message=%lu, message_fail=%lu", \
-					_counter[COUNTER_ACCEPT].u64, \
-					_counter[COUNTER_ACCEPT_FAIL].u64, \
-					_counter[COUNTER_READ].u64, \
-					_counter[COUNTER_READ_FAIL].u64, \
-					_counter[COUNTER_DATA_TOO_LONG].u64, \
-					_counter[COUNTER_MESSAGE].u64, \
-					_counter[COUNTER_MESSAGE_FAIL].u64);
+					c[COUNTER_ACCEPT], \
+					c[COUNTER_ACCEPT_FAIL], \
+					c[COUNTER_READ], \
+					c[COUNTER_READ_FAIL], \
+					c[COUNTER_DATA_TOO_LONG], \
+					c[COUNTER_MESSAGE], \
+					c[COUNTER_MESSAGE_FAIL]);
+
+			NetServerWorkerPoolStats ps;
+			NetServer_getWorkerPoolStats(&ps);
+
+			ERRLOG5("Worker pool: workers=%u, idle=%u, started=%lu, retired=%lu, busy=%lums", \
+					ps.workers, \
+					ps.idleWorkers, \
+					ps.started, \
+					ps.retired, \
+					ps.busyNs / 1000000);
+		}
+
+		if (isAcceptStopped(_listenFd))
+		{
+			ERRLOG("Server thread stopped accepting.");
+			return 0;
 		}
 
-		struct sockaddr_in peer;
-		socklen_t sl = sizeof(struct sockaddr_in);
+		struct sockaddr_storage peer;
+		socklen_t sl = sizeof(struct sockaddr_storage);
 
 		int fd = accept(_listenFd, (struct sockaddr*) &peer, &sl);
-		_counter[COUNTER_ACCEPT].u64++;
+		incCounter(COUNTER_ACCEPT);
+		acceptCount++;
 
 		if (fd < 0)
 		{
 			ERRLOG1("Failed accept! errno=%d", errno);
-			_counter[COUNTER_ACCEPT_FAIL].u64++;
+			incCounter(COUNTER_ACCEPT_FAIL);
 
 			continue;
 		}
 
-		if (queueAcceptedFd(fd) != 0)
+		if (queueAcceptedFd(fd, false) != 0)
 		{
 			ERRLOG1("Closing fd %d early due to error queueing accepted fd!", fd);
 			close(fd);
@@ -488,15 +817,20 @@ static void* netServerThreadMain(void* arg)
 	}
 
 	// FIXME: If any threads failed to start above, then we may need to take this into account below.
-	for (unsigned int i = 0; i < workerThreadCount; i++)
+	pthread_mutex_lock(&_acceptedFdsLock);
+	_workersStopping = true;
+	const unsigned int workerThreadsLeft = _workerCount;
+	pthread_mutex_unlock(&_acceptedFdsLock);
+
+	for (unsigned int i = 0; i < workerThreadsLeft; i++)
 	{
 		// FIXME: Handle return value here (in case queueing failed).
-		queueAcceptedFd(-1);
+		queueAcceptedFd(-1, false);
 	}
 
-	for (unsigned int i = 0; i < workerThreadCount; i++)
+	for (unsigned int i = 0; i < NETSERVER_MAX_THREAD_COUNT; i++)
 	{
-		if (0 != pthread_join(workerThreads[i], 0))
+		if (_workerSlotUsed[i] && 0 != pthread_join(_workerThreads[i], 0))
 		{
 			ERRLOG1("Failed to join worker thread %d!", i);
 		}
@@ -511,9 +845,67 @@ static void* netServerThreadMain(void* arg)
 	return 0;
 }
 
-static int queueAcceptedFd(int fd)
+// Accepts HTTP connections, for the same worker pool as the text protocol connections.
+static void* httpThreadMain(void* arg)
+{
+	(void) arg;
+
+	ERRLOG("HTTP listener thread preparing to accept...");
+
+	for (;;)
+	{
+		if (isAcceptStopped(_httpListenFd))
+		{
+			ERRLOG("HTTP listener thread stopped accepting.");
+			return 0;
+		}
+
+		struct sockaddr_storage peer;
+		socklen_t sl = sizeof(struct sockaddr_storage);
+
+		int fd = accept(_httpListenFd, (struct sockaddr*) &peer, &sl);
+		incCounter(COUNTER_ACCEPT);
+
+		if (fd < 0)
+		{
+			ERRLOG1("Failed HTTP accept! errno=%d", errno);
+			incCounter(COUNTER_ACCEPT_FAIL);
+
+			continue;
+		}
+
+		if (peer.ss_family == AF_INET)
+		{
+			// Responses (each written whole) go out right away, even with pipelined requests.
+			const int one = 1;
+			if (0 != setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)))
+			{
+				ERRLOG1("Failed to set TCP_NODELAY on HTTP connection! errno=%d", errno);
+			}
+		}
+
+		// Idle keep-alive connections are closed after a while, to free up their workers.
+		struct timeval tv = { .tv_sec = HTTP_KEEPALIVE_TIMEOUT_S, .tv_usec = 0 };
+		if (0 != setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+		{
+			ERRLOG1("Failed to set HTTP connection receive timeout! errno=%d", errno);
+		}
+
+		if (queueAcceptedFd(fd, true) != 0)
+		{
+			ERRLOG1("Closing HTTP fd %d early due to error queueing accepted fd!", fd);
+			close(fd);
+		}
+	}
+
+	return 0;
+}
+
+static int queueAcceptedFd(int fd, bool http)
 {
 	int rc = 0;
+	int newWorkerSlot = -1;
+	unsigned int queuedFds = 0;
 
 	if (0 != pthread_mutex_lock(&_acceptedFdsLock))
 	{
@@ -529,6 +921,7 @@ static int queueAcceptedFd(int fd)
 		goto done;
 	}
 
+	_acceptedFdsHttp[_acceptedFdsNext] = http;
 	_acceptedFds[_acceptedFdsNext++] = fd;
 
 	if (_acceptedFdsNext == MAX_ACCEPTED_FDS)
@@ -537,46 +930,190 @@ static int queueAcceptedFd(int fd)
 	}
 
 	_acceptedFdsHas = true;
+	_acceptedFdsCount++;
 
 	if (0 != pthread_cond_signal(&_acceptedFdsCond))
 	{
 		ERRLOG("Failed to signal condvar!");
 	}
 
+	queuedFds = _acceptedFdsCount;
+
+	if (fd >= 0 && queuedFds > _idleWorkers)
+	{
+		// More fds waiting than workers free to take them (all others are busy), so grow the pool if allowed.
+		newWorkerSlot = reserveWorkerSlot();
+	}
+
 done:
 	if (0 != pthread_mutex_unlock(&_acceptedFdsLock))
 	{
 		ERRLOG("queueAcceptedFd: Failed to unlock accepted fds mutex!");
 	}
 
+	if (newWorkerSlot >= 0 && startWorker(newWorkerSlot) == 0)
+	{
+		ERRLOG2("Started worker thread %d, with %u fds waiting", newWorkerSlot, queuedFds);
+	}
+
 	return rc;
 }
 
+// Starts enough workers to bring the pool up to its minimum size.
+static int startMinWorkers()
+{
+	int rc = 0;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&_acceptedFdsLock);
+		const int slot = (_workerCount < _workersMin) ? reserveWorkerSlot() : -1;
+		pthread_mutex_unlock(&_acceptedFdsLock);
+
+		if (slot < 0)
+		{
+			break;
+		}
+
+		if (startWorker(slot) != 0)
+		{
+			// TODO: Make this fatal?
+			rc = -1;
+			break;
+		}
+	}
+
+	return rc;
+}
+
+// Takes a free worker slot (counting its worker as idle from now), if the pool isn't at its maximum size.
+// Must be called with _acceptedFdsLock held.
+static int reserveWorkerSlot()
+{
+	if (_workerCount >= _workersMax || _workersStopping)
+	{
+		return -1;
+	}
+
+	for (int i = 0; i < NETSERVER_MAX_THREAD_COUNT; i++)
+	{
+		if (!_workerSlotUsed[i])
+		{
+			_workerSlotUsed[i] = true;
+			_workerCount++;
+			_idleWorkers++;
+			_workersStarted++;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static int startWorker(int slot)
+{
+	unsigned int* workerArg = malloc(sizeof(unsigned int));
+	if (!workerArg)
+	{
+		ERRLOG1("Failed to alloc workerArg for thread %d!", slot);
+		goto fail;
+	}
+
+	*workerArg = slot;
+	if (0 != pthread_create(_workerThreads + slot, 0, &netServerWorkerThreadMain, workerArg))
+	{
+		ERRLOG1("Failed to start worker thread %d!", slot);
+		free(workerArg);
+		goto fail;
+	}
+
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+	char threadName[32];
+	snprintf(threadName, 32, "%s%d", WORKER_THREAD_NAME_PREFIX, slot);
+	if (0 != pthread_setname_np(_workerThreads[slot], threadName))
+	{
+		ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", threadName);
+	}
+#endif
+
+	Affinity_applyToThread(_workerThreads[slot], AFFINITY_ROLE_NET);
+
+	return 0;
+
+fail:
+	pthread_mutex_lock(&_acceptedFdsLock);
+	_workerSlotUsed[slot] = false;
+	_workerCount--;
+	_idleWorkers--;
+	_workersStarted--;
+	pthread_mutex_unlock(&_acceptedFdsLock);
+
+	return -1;
+}
+
 
 static void* netServerWorkerThreadMain(void* arg)
 {
 	const unsigned int workerThreadId = *((unsigned int*)arg);
 	free(arg);
 
+	bool afterConnection = false;
+	long busyNs = 0;
+
 	for (;;)
 	{
-		const int fd = getNextFd();
+		bool http;
+		const int fd = getNextFd(workerThreadId, afterConnection, busyNs, &http);
 
-		if (fd < 0)
+		if (fd == NEXT_FD_RETIRE)
 		{
+			// Nobody joins retired workers.
+			pthread_detach(pthread_self());
+			ERRLOG1("Retired idle worker thread %u", workerThreadId);
 			break;
 		}
+		else if (fd < 0)
+		{
+			break;
+		}
+
+		struct timespec t0;
+		struct timespec t1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
 
-		processConnection(workerThreadId, fd);
+		if (http)
+		{
+			processHttpConnection(workerThreadId, fd);
+		}
+		else
+		{
+			processConnection(workerThreadId, fd);
+		}
 		close(fd);
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		busyNs = (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
+		afterConnection = true;
+	}
+
+	// Its counts (and scheduler stats) are kept, and its copy of the counters reused by a later worker.
+	if (_threadCounters)
+	{
+		Counters_releaseThreadSlot(&_counters, _threadCounters);
+		_threadCounters = 0;
 	}
+	Affinity_retireThread();
 
 	return 0;
 }
 
-static int getNextFd()
+// Returns the next accepted fd to handle (or -1, or NEXT_FD_RETIRE if this worker is to retire after idling), and
+// whether it was accepted by the HTTP listener, first counting the worker as idle again (and its time spent on the
+// connection just handled) if afterConnection is set.
+static int getNextFd(unsigned int workerThreadId, bool afterConnection, long busyNs, bool* http)
 {
 	int fd = -1;
+	*http = false;
 
 	if (0 != pthread_mutex_lock(&_acceptedFdsLock))
 	{
@@ -584,15 +1121,52 @@ static int getNextFd()
 		return -1;
 	}
 
+	if (afterConnection)
+	{
+		_idleWorkers++;
+		_workersBusyNs += busyNs;
+	}
+
+	struct timespec retireTime;
+	clock_gettime(CLOCK_MONOTONIC, &retireTime);
+	retireTime.tv_sec += _workerIdleRetireMs / 1000;
+	retireTime.tv_nsec += (_workerIdleRetireMs % 1000) * 1000000L;
+	if (retireTime.tv_nsec >= 1000000000L)
+	{
+		retireTime.tv_sec++;
+		retireTime.tv_nsec -= 1000000000L;
+	}
+
 	while (!_acceptedFdsHas)
 	{
-		if (0 != pthread_cond_wait(&_acceptedFdsCond, &_acceptedFdsLock))
+		if (_workerCount > _workersMin && !_workersStopping)
+		{
+			// Pool is over its minimum size, so retire if still idle at the retire time.
+			const int rc = pthread_cond_timedwait(&_acceptedFdsCond, &_acceptedFdsLock, &retireTime);
+			if (rc == ETIMEDOUT && !_acceptedFdsHas && _workerCount > _workersMin)
+			{
+				_workerSlotUsed[workerThreadId] = false;
+				_workerCount--;
+				_idleWorkers--;
+				_workersRetired++;
+
+				fd = NEXT_FD_RETIRE;
+				goto done;
+			}
+			else if (rc != 0 && rc != ETIMEDOUT)
+			{
+				ERRLOG("Failed to wait on condvar!");
+				goto done;
+			}
+		}
+		else if (0 != pthread_cond_wait(&_acceptedFdsCond, &_acceptedFdsLock))
 		{
 			ERRLOG("Failed to wait on condvar!");
 			goto done;
 		}
 	}
 
+	*http = _acceptedFdsHttp[_acceptedFdsStart];
 	fd = _acceptedFds[_acceptedFdsStart++];
 
 	if (_acceptedFdsStart == MAX_ACCEPTED_FDS)
@@ -605,6 +1179,9 @@ static int getNextFd()
 		_acceptedFdsHas = false;
 	}
 
+	_acceptedFdsCount--;
+	_idleWorkers--;
+
 done:
 	if (0 != pthread_mutex_unlock(&_acceptedFdsLock))
 	{
@@ -708,7 +1285,7 @@ static void processConnection(unsigned int workerThreadId, int fd)
 
 		// Handle the request message.
 		incCounter(COUNTER_MESSAGE);
-		if (NetServer_handleRequest(fd, buf) != 0)
+		if (_requestHandler(fd, buf) != 0)
 		{
 			ERRLOG1("worker%u: Failed to handle request!", workerThreadId);
 			incCounter(COUNTER_MESSAGE_FAIL);
@@ -729,41 +1306,331 @@ static void processConnection(unsigned int workerThreadId, int fd)
 	}
 }
 
-static void incCounter(int ctr)
+// Handles HTTP requests on a connection, until it's closed by either end (or is idle for too long). Pipelined requests
+// are each handled in turn, with responses written in the same order.
+static void processHttpConnection(unsigned int workerThreadId, int fd)
 {
-	_counter[ctr].u64++;
+	char buf[HTTP_RECV_BUF_SIZE];
+	size_t readyBytes = 0;
+
+	char head[HTTP_HEAD_BUF_SIZE];
+	char body[SEND_MSG_BUF_SIZE];
+
+	for (;;)
+	{
+		HttpApiRequest req;
+		const int reqLen = HttpApi_parseRequest(buf, readyBytes, &req);
+
+		if (reqLen == 0)
+		{
+			if (readyBytes == HTTP_RECV_BUF_SIZE)
+			{
+				ERRLOG1("worker%u: Excessive HTTP request length!", workerThreadId);
+				incCounter(COUNTER_DATA_TOO_LONG);
+
+				req.status = HTTP_API_STATUS_HEADERS_TOO_LARGE;
+				req.keepAlive = false;
+			}
+			else
+			{
+				const ssize_t rb = read(fd, buf + readyBytes, HTTP_RECV_BUF_SIZE - readyBytes);
+				incCounter(COUNTER_READ);
+
+				if (rb < 0)
+				{
+					if (errno != EAGAIN && errno != EWOULDBLOCK)
+					{
+						// Not just idle for too long
+						ERRLOG2("worker%u: Failed read! errno=%d", workerThreadId, errno);
+						incCounter(COUNTER_READ_FAIL);
+					}
+
+					break;
+				}
+				else if (rb == 0)
+				{
+					break;
+				}
+
+				readyBytes += rb;
+				continue;
+			}
+		}
+		else if (reqLen < 0)
+		{
+			req.status = HTTP_API_STATUS_BAD_REQUEST;
+			req.keepAlive = false;
+		}
+
+		incCounter(COUNTER_MESSAGE);
+
+		int reqType = REQ_TYPE_INVALID;
+
+		if (req.status == HTTP_API_STATUS_OK)
+		{
+			const int rc = handleRequest(req.reqStr, true, body, SEND_MSG_BUF_SIZE, &reqType);
+			if (rc == REQ_HANDLE_NOT_FOUND)
+			{
+				req.status = HTTP_API_STATUS_NOT_FOUND;
+			}
+			else if (rc != 0)
+			{
+				req.status = HTTP_API_STATUS_BAD_REQUEST;
+			}
+		}
+
+		if (req.status != HTTP_API_STATUS_OK)
+		{
+			snprintf(body, SEND_MSG_BUF_SIZE, "{\"error\":%d}", req.status);
+		}
+
+		if (atomic_load(&_acceptStopped))
+		{
+			req.keepAlive = false;
+		}
+
+		const size_t bodyLen = strlen(body);
+		const int headLen = HttpApi_writeResponseHead(head, HTTP_HEAD_BUF_SIZE, req.status, bodyLen, req.keepAlive);
+
+		if (headLen < 0 || writeHttpResponse(fd, head, headLen, body, bodyLen) != 0)
+		{
+			PROBE2(netserver_request_end, reqType, -1);
+
+			ERRLOG1("worker%u: Failed to write HTTP response!", workerThreadId);
+			incCounter(COUNTER_MESSAGE_FAIL);
+
+			break;
+		}
+
+		PROBE2(netserver_request_end, reqType, (req.status == HTTP_API_STATUS_OK) ? 0 : -1);
+
+		if (!req.keepAlive)
+		{
+			break;
+		}
+
+		// Move any pipelined requests after this one to the start of the buffer.
+		memmove(buf, buf + reqLen, readyBytes - reqLen);
+		readyBytes -= reqLen;
+	}
 }
 
-static void incReqTypeCounter(int ctr)
+static int writeAll(int fd, const char* buf, size_t len)
 {
-	_counterReqType[ctr].u64++;
+	size_t wt = 0;
+
+	while (wt < len)
+	{
+		const ssize_t wb = write(fd, buf + wt, len - wt);
+		if (wb < 0)
+		{
+			return -1;
+		}
+
+		wt += wb;
+	}
+
+	return 0;
 }
 
-static int getReqType(const char* s)
+// Writes the head and body of a response together (so that they go out in one segment, where possible).
+static int writeHttpResponse(int fd, const char* head, size_t headLen, const char* body, size_t bodyLen)
 {
-	if (strcmp(REQ_STR_GET_BOAT_DATA_NO_CELESTIAL, s) == 0)
+	struct iovec iov[2] = {
+		{ .iov_base = (void*) head, .iov_len = headLen },
+		{ .iov_base = (void*) body, .iov_len = bodyLen }
+	};
+
+	const ssize_t wb = writev(fd, iov, 2);
+	if (wb < 0)
 	{
-		// This is generally expected to be the most common request type,
-		// so check for it first.
-		return REQ_TYPE_GET_BOAT_DATA_NO_CELESTIAL;
+		return -1;
 	}
-	else if (strcmp(REQ_STR_GET_WIND, s) == 0)
+	else if ((size_t) wb < headLen)
 	{
-		return REQ_TYPE_GET_WIND;
+		return (writeAll(fd, head + wb, headLen - wb) == 0 && writeAll(fd, body, bodyLen) == 0) ? 0 : -1;
 	}
-	else if (strcmp(REQ_STR_GET_WIND_ADJCUR, s) == 0)
+
+	return writeAll(fd, body + (wb - headLen), bodyLen - (wb - headLen));
+}
+
+static void incCounter(int ctr)
+{
+	if (!_threadCounters && !(_threadCounters = Counters_newThreadSlot(&_counters)))
 	{
-		return REQ_TYPE_GET_WIND_ADJCUR;
+		return;
 	}
-	else if (strcmp(REQ_STR_GET_WIND_GUST, s) == 0)
+
+	Counters_inc(_threadCounters, ctr);
+}
+
+static void incReqTypeCounter(int ctr)
+{
+	incCounter(COUNTER_REQ_TYPE_BASE + ctr);
+}
+
+// Handles a request string, populating buf with the response (as JSON if json is set, otherwise in the text protocol),
+// and setting reqType. Returns 0, or REQ_HANDLE_BAD for an invalid request, or REQ_HANDLE_NOT_FOUND for an unknown
+// request type (which includes boat commands for JSON requests, as the JSON API is read-only).
+static int handleRequest(char* reqStr, bool json, char* buf, size_t bufSize, int* reqType)
+{
+	char* s;
+	char* t;
+
+	*reqType = REQ_TYPE_INVALID;
+
+	if ((s = strtok_r(reqStr, ",", &t)) == 0)
 	{
-		return REQ_TYPE_GET_WIND_GUST;
+		return REQ_HANDLE_BAD;
 	}
-	else if (strcmp(REQ_STR_GET_WIND_GUST_ADJCUR, s) == 0)
+
+	*reqType = getReqType(s);
+	incReqTypeCounter(*reqType);
+
+	PROBE1(netserver_request_start, *reqType);
+
+	// Boat commands and profiler control are only available over the text protocol.
+	if (*reqType == REQ_TYPE_INVALID || (json && (*reqType == REQ_TYPE_BOAT_CMD || *reqType == REQ_TYPE_BOAT_CMD_SYNC ||
+			*reqType == REQ_TYPE_SYS_PROFILE_START || *reqType == REQ_TYPE_SYS_PROFILE_STOP)))
 	{
-		return REQ_TYPE_GET_WIND_GUST_ADJCUR;
+		return REQ_HANDLE_NOT_FOUND;
 	}
-	else if (strcmp(REQ_STR_GET_OCEAN_CURRENT, s) == 0)
+
+	const uint8_t* vals = getReqExpectedValueTypes(*reqType);
+
+	ReqValue values[REQ_MAX_ARG_COUNT];
+
+	for (int i = 0; i < REQ_MAX_ARG_COUNT; i++)
+	{
+		switch (vals[i])
+		{
+			case REQ_VAL_NONE:
+				break;
+
+			case REQ_VAL_INT:
+			case REQ_VAL_DOUBLE:
+			case REQ_VAL_STRING:
+				if ((s = strtok_r(0, ",", &t)) == 0)
+				{
+					return REQ_HANDLE_BAD;
+				}
+
+				if (vals[i] == REQ_VAL_INT)
+				{
+					values[i].i = strtol(s, 0, 10);
+				}
+				else if (vals[i] == REQ_VAL_DOUBLE)
+				{
+					values[i].d = strtod(s, 0);
+				}
+				else
+				{
+					values[i].s = s;
+				}
+
+				break;
+
+			default:
+				return REQ_HANDLE_BAD;
+		}
+	}
+
+	if (!areValuesValidForReqType(*reqType, values))
+	{
+		return REQ_HANDLE_BAD;
+	}
+
+
+	proteus_GeoPos pos = { values[0].d, values[1].d };
+
+	switch (*reqType)
+	{
+		case REQ_TYPE_GET_WIND:
+		case REQ_TYPE_GET_WIND_ADJCUR:
+			populateWindResponse(buf, bufSize, &pos, false, (*reqType == REQ_TYPE_GET_WIND_ADJCUR), json);
+			break;
+		case REQ_TYPE_GET_WIND_GUST:
+		case REQ_TYPE_GET_WIND_GUST_ADJCUR:
+			populateWindResponse(buf, bufSize, &pos, true, (*reqType == REQ_TYPE_GET_WIND_GUST_ADJCUR), json);
+			break;
+		case REQ_TYPE_GET_OCEAN_CURRENT:
+			populateOceanResponse(buf, bufSize, &pos, false, json);
+			break;
+		case REQ_TYPE_GET_SEA_ICE:
+			populateOceanResponse(buf, bufSize, &pos, true, json);
+			break;
+		case REQ_TYPE_GET_WAVE_HEIGHT:
+			populateWaveResponse(buf, bufSize, &pos, json);
+			break;
+		case REQ_TYPE_GET_BOAT_DATA:
+		case REQ_TYPE_GET_BOAT_DATA_NO_CELESTIAL:
+			populateBoatDataResponse(buf, bufSize, values[0].s, (*reqType == REQ_TYPE_GET_BOAT_DATA_NO_CELESTIAL), json);
+			break;
+		case REQ_TYPE_BOAT_CMD:
+			populateBoatCmdResponse(buf, bufSize, &t);
+			break;
+		case REQ_TYPE_BOAT_CMD_SYNC:
+			populateBoatCmdSyncResponse(buf, bufSize, &t);
+			break;
+		case REQ_TYPE_BOAT_GROUP_MEMBERSHIP:
+			populateBoatGroupMembershipResponse(buf, bufSize, values[0].s, json);
+			break;
+		case REQ_TYPE_SYS_REQUEST_COUNTS:
+			populateSysRequestCountsResponse(buf, bufSize, json);
+			break;
+		case REQ_TYPE_SYS_NET_WORKERS:
+			populateSysNetWorkersResponse(buf, bufSize, json);
+			break;
+		case REQ_TYPE_GROUP_PROXIMITY:
+			populateGroupProximityResponse(buf, bufSize, values[0].s, json);
+			break;
+		case REQ_TYPE_FLEET_TILE:
+			populateFleetTileResponse(buf, bufSize, values[0].i, values[1].i, values[2].i, json);
+			break;
+		case REQ_TYPE_GROUP_ETA:
+			populateGroupEtaResponse(buf, bufSize, values[0].s, json);
+			break;
+		case REQ_TYPE_SYS_PROFILE_START:
+			populateSysProfileStartResponse(buf, bufSize, values[0].i);
+			break;
+		case REQ_TYPE_SYS_PROFILE_STOP:
+			populateSysProfileStopResponse(buf, bufSize);
+			break;
+		case REQ_TYPE_SYS_BOAT_TIERS:
+			populateSysBoatTiersResponse(buf, bufSize, json);
+			break;
+		default:
+			return REQ_HANDLE_BAD;
+	}
+
+	return 0;
+}
+
+static int getReqType(const char* s)
+{
+	if (strcmp(REQ_STR_GET_BOAT_DATA_NO_CELESTIAL, s) == 0)
+	{
+		// This is generally expected to be the most common request type,
+		// so check for it first.
+		return REQ_TYPE_GET_BOAT_DATA_NO_CELESTIAL;
+	}
+	else if (strcmp(REQ_STR_GET_WIND, s) == 0)
+	{
+		return REQ_TYPE_GET_WIND;
+	}
+	else if (strcmp(REQ_STR_GET_WIND_ADJCUR, s) == 0)
+	{
+		return REQ_TYPE_GET_WIND_ADJCUR;
+	}
+	else if (strcmp(REQ_STR_GET_WIND_GUST, s) == 0)
+	{
+		return REQ_TYPE_GET_WIND_GUST;
+	}
+	else if (strcmp(REQ_STR_GET_WIND_GUST_ADJCUR, s) == 0)
+	{
+		return REQ_TYPE_GET_WIND_GUST_ADJCUR;
+	}
+	else if (strcmp(REQ_STR_GET_OCEAN_CURRENT, s) == 0)
 	{
 		return REQ_TYPE_GET_OCEAN_CURRENT;
 	}
@@ -791,6 +1658,38 @@ static int getReqType(const char* s)
 	{
 		return REQ_TYPE_SYS_REQUEST_COUNTS;
 	}
+	else if (strcmp(REQ_STR_GROUP_PROXIMITY, s) == 0)
+	{
+		return REQ_TYPE_GROUP_PROXIMITY;
+	}
+	else if (strcmp(REQ_STR_FLEET_TILE, s) == 0)
+	{
+		return REQ_TYPE_FLEET_TILE;
+	}
+	else if (strcmp(REQ_STR_BOAT_CMD_SYNC, s) == 0)
+	{
+		return REQ_TYPE_BOAT_CMD_SYNC;
+	}
+	else if (strcmp(REQ_STR_SYS_NET_WORKERS, s) == 0)
+	{
+		return REQ_TYPE_SYS_NET_WORKERS;
+	}
+	else if (strcmp(REQ_STR_GROUP_ETA, s) == 0)
+	{
+		return REQ_TYPE_GROUP_ETA;
+	}
+	else if (strcmp(REQ_STR_SYS_PROFILE_START, s) == 0)
+	{
+		return REQ_TYPE_SYS_PROFILE_START;
+	}
+	else if (strcmp(REQ_STR_SYS_PROFILE_STOP, s) == 0)
+	{
+		return REQ_TYPE_SYS_PROFILE_STOP;
+	}
+	else if (strcmp(REQ_STR_SYS_BOAT_TIERS, s) == 0)
+	{
+		return REQ_TYPE_SYS_BOAT_TIERS;
+	}
 
 	return REQ_TYPE_INVALID;
 }
@@ -812,6 +1711,14 @@ static const uint8_t* getReqExpectedValueTypes(int reqType)
 			return REQ_VALS_BOAT_DATA;
 		case REQ_TYPE_BOAT_GROUP_MEMBERSHIP:
 			return REQ_VALS_BOAT_GROUP_MEMBERSHIP;
+		case REQ_TYPE_GROUP_PROXIMITY:
+			return REQ_VALS_GROUP_PROXIMITY;
+		case REQ_TYPE_FLEET_TILE:
+			return REQ_VALS_FLEET_TILE;
+		case REQ_TYPE_GROUP_ETA:
+			return REQ_VALS_GROUP_ETA;
+		case REQ_TYPE_SYS_PROFILE_START:
+			return REQ_VALS_SYS_PROFILE_START;
 	}
 
 	return REQ_VALS_NONE;
@@ -832,6 +1739,14 @@ static bool areValuesValidForReqType(int reqType, ReqValue values[REQ_MAX_ARG_CO
 			return (values[0].d >= -90.0 && values[0].d <= 90.0 &&
 					values[1].d >= -180.0 && values[1].d <= 180.0);
 		}
+		case REQ_TYPE_FLEET_TILE:
+		{
+			return FleetTiles_isValidTile(values[0].i, values[1].i, values[2].i);
+		}
+		case REQ_TYPE_SYS_PROFILE_START:
+		{
+			return (values[0].i >= PROFILER_HZ_MIN && values[0].i <= PROFILER_HZ_MAX);
+		}
 	}
 
 	// All other request types either do not use request values or have no particular restrictions.
@@ -841,48 +1756,77 @@ static bool areValuesValidForReqType(int reqType, ReqValue values[REQ_MAX_ARG_CO
 #define INVALID_INTEGER_VALUE (-999)
 #define INVALID_DOUBLE_VALUE (-999.0)
 
-static void populateWindResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool gust, bool adjustForCurrent)
+static void populateWindResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool gust, bool adjustForCurrent, bool json)
 {
 	proteus_Weather wx;
-	proteus_Weather_get(pos, &wx, true);
-
-	double gustAngle = wx.wind.angle;
+	double gustAngle;
 
 	if (adjustForCurrent)
 	{
-		proteus_OceanData od;
-		if (proteus_Ocean_get(pos, &od))
+		// From the precomputed wind field if there is one
+		if (!WindField_get(pos, &wx, &gustAngle))
 		{
-			gustAngle = WxUtils_adjustWindForCurrent(&wx, &od.current);
+			gustAngle = WindField_getLive(pos, &wx);
 		}
 	}
+	else
+	{
+		proteus_Weather_get(pos, &wx, true);
+		gustAngle = wx.wind.angle;
+	}
+
+	const char* type = gust ?
+		(adjustForCurrent ? REQ_STR_GET_WIND_GUST_ADJCUR : REQ_STR_GET_WIND_GUST) :
+		(adjustForCurrent ? REQ_STR_GET_WIND_ADJCUR : REQ_STR_GET_WIND);
 
-	if (gust)
+	if (json)
 	{
-		snprintf(buf, bufSize, "%s,%f,%f,%f,%f\n",
-				adjustForCurrent ? REQ_STR_GET_WIND_GUST_ADJCUR : REQ_STR_GET_WIND_GUST,
+		snprintf(buf, bufSize, "{\"type\":\"%s\",\"lat\":%f,\"lon\":%f,\"angle\":%f,\"%s\":%f}",
+				type,
 				pos->lat,
 				pos->lon,
-				gustAngle,
-				wx.windGust);
+				gust ? gustAngle : wx.wind.angle,
+				gust ? "gust" : "speed",
+				gust ? wx.windGust : wx.wind.mag);
 	}
 	else
 	{
 		snprintf(buf, bufSize, "%s,%f,%f,%f,%f\n",
-				adjustForCurrent ? REQ_STR_GET_WIND_ADJCUR : REQ_STR_GET_WIND,
+				type,
 				pos->lat,
 				pos->lon,
-				wx.wind.angle,
-				wx.wind.mag);
+				gust ? gustAngle : wx.wind.angle,
+				gust ? wx.windGust : wx.wind.mag);
 	}
 }
 
-static void populateOceanResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool seaIce)
+static void populateOceanResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool seaIce, bool json)
 {
 	proteus_OceanData od;
 	const bool valid = proteus_Ocean_get(pos, &od);
 
-	if (seaIce)
+	if (json)
+	{
+		// Data missing (such as over land) as nulls
+		int n = snprintf(buf, bufSize, "{\"type\":\"%s\",\"lat\":%f,\"lon\":%f",
+				seaIce ? REQ_STR_GET_SEA_ICE : REQ_STR_GET_OCEAN_CURRENT,
+				pos->lat,
+				pos->lon);
+
+		if (!valid)
+		{
+			snprintf(buf + n, bufSize - n, seaIce ? ",\"ice\":null}" : ",\"angle\":null,\"speed\":null}");
+		}
+		else if (seaIce)
+		{
+			snprintf(buf + n, bufSize - n, ",\"ice\":%f}", od.ice);
+		}
+		else
+		{
+			snprintf(buf + n, bufSize - n, ",\"angle\":%f,\"speed\":%f}", od.current.angle, od.current.mag);
+		}
+	}
+	else if (seaIce)
 	{
 		snprintf(buf, bufSize, "%s,%f,%f,%f\n",
 				REQ_STR_GET_SEA_ICE,
@@ -901,11 +1845,30 @@ static void populateOceanResponse(char* buf, size_t bufSize, const proteus_GeoPo
 	}
 }
 
-static void populateWaveResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos)
+static void populateWaveResponse(char* buf, size_t bufSize, const proteus_GeoPos* pos, bool json)
 {
 	proteus_WaveData wd;
 	const bool valid = proteus_Wave_get(pos, &wd);
 
+	if (json)
+	{
+		const int n = snprintf(buf, bufSize, "{\"type\":\"%s\",\"lat\":%f,\"lon\":%f",
+				REQ_STR_GET_WAVE_HEIGHT,
+				pos->lat,
+				pos->lon);
+
+		if (valid)
+		{
+			snprintf(buf + n, bufSize - n, ",\"height\":%f}", wd.waveHeight);
+		}
+		else
+		{
+			snprintf(buf + n, bufSize - n, ",\"height\":null}");
+		}
+
+		return;
+	}
+
 	snprintf(buf, bufSize, "%s,%f,%f,%f\n",
 			REQ_STR_GET_WAVE_HEIGHT,
 			pos->lat,
@@ -913,16 +1876,34 @@ static void populateWaveResponse(char* buf, size_t bufSize, const proteus_GeoPos
 			valid ? wd.waveHeight : INVALID_DOUBLE_VALUE);
 }
 
-static void populateBoatDataResponse(char* buf, size_t bufSize, const char* key, bool noCelestial)
+static void populateBoatDataResponse(char* buf, size_t bufSize, const char* key, bool noCelestial, bool json)
 {
+	const char* type = noCelestial ? REQ_STR_GET_BOAT_DATA_NO_CELESTIAL : REQ_STR_GET_BOAT_DATA;
+
 	if (BoatRegistry_OK != BoatRegistry_rdlock())
 	{
 		ERRLOG("Failed to read-lock BoatRegistry lock for boat data response!");
-		snprintf(buf, bufSize, "%s,%s,failed\n", REQ_STR_GET_BOAT_DATA, key);
+
+		if (json)
+		{
+			const int n = populateJsonKeyResponseStart(buf, bufSize, type, "boat", key, "failed");
+			if (n > 0)
+			{
+				snprintf(buf + n, bufSize - n, "}");
+			}
+		}
+		else
+		{
+			snprintf(buf, bufSize, "%s,%s,failed\n", REQ_STR_GET_BOAT_DATA, key);
+		}
+
 		return;
 	}
 
-	const Boat* boat = BoatRegistry_get(key);
+	const BoatEntry* entry = BoatRegistry_getBoatEntry(key);
+
+	Boat coldBoat;
+	const Boat* boat = (entry ? BoatRegistry_view(entry, &coldBoat) : 0);
 
 	proteus_GeoPos pos;
 	proteus_GeoVec v;
@@ -951,10 +1932,38 @@ static void populateBoatDataResponse(char* buf, size_t bufSize, const char* key,
 		ERRLOG("Failed to unlock BoatRegistry lock for boat data response!");
 	}
 
-	if (boat)
+	// Boats not found may just not be restored yet.
+	const char* noBoatStatus = (!entry && BoatRestore_isRestoring()) ? "loading" : "noboat";
+
+	if (json)
+	{
+		const int n = populateJsonKeyResponseStart(buf, bufSize, type, "boat", key, boat ? "ok" : noBoatStatus);
+		if (n < 0)
+		{
+			return;
+		}
+
+		if (boat)
+		{
+			snprintf(buf + n, bufSize - n, ",\"lat\":%.6f,\"lon\":%.6f,\"angle\":%.1f,\"speed\":%.2f,\"groundAngle\":%.1f,\"groundSpeed\":%.2f,\"leewaySpeed\":%.2f,\"heelingAngle\":%.1f}",
+					pos.lat,
+					pos.lon,
+					v.angle,
+					v.mag,
+					vGround.angle,
+					vGround.mag,
+					leewaySpeed,
+					heelingAngle);
+		}
+		else
+		{
+			snprintf(buf + n, bufSize - n, "}");
+		}
+	}
+	else if (boat)
 	{
 		snprintf(buf, bufSize, "%s,%s,ok,%.6f,%.6f,%.1f,%.2f,%.1f,%.2f,%.2f,%.1f\n",
-				noCelestial ? REQ_STR_GET_BOAT_DATA_NO_CELESTIAL : REQ_STR_GET_BOAT_DATA,
+				type,
 				key,
 				pos.lat,
 				pos.lon,
@@ -967,7 +1976,7 @@ static void populateBoatDataResponse(char* buf, size_t bufSize, const char* key,
 	}
 	else
 	{
-		snprintf(buf, bufSize, "%s,%s,noboat\n", (noCelestial ? REQ_STR_GET_BOAT_DATA_NO_CELESTIAL : REQ_STR_GET_BOAT_DATA), key);
+		snprintf(buf, bufSize, "%s,%s,%s\n", type, key, noBoatStatus);
 	}
 }
 
@@ -975,8 +1984,9 @@ static void populateBoatCmdResponse(char* buf, size_t bufSize, char** tok)
 {
 	int rc = -1;
 	char* s;
+	char tokenSuffix[BOAT_CMD_TOKEN_MAX_LEN + 2] = "";
 
-	if ((s = strtok_r(0, "\n", tok)) == 0)
+	if ((s = strtok_r(0, "\n", tok)) == 0 || (s = takeBoatCmdToken(s, tokenSuffix, sizeof(tokenSuffix))) == 0)
 	{
 		goto fail;
 	}
@@ -984,44 +1994,149 @@ static void populateBoatCmdResponse(char* buf, size_t bufSize, char** tok)
 	rc = Command_add(s);
 
 fail:
-	snprintf(buf, bufSize, "%s,%s\n", REQ_STR_BOAT_CMD, (rc == 0) ? "ok" : "fail");
+	snprintf(buf, bufSize, "%s,%s%s\n", REQ_STR_BOAT_CMD, (rc == 0) ? "ok" : "fail", tokenSuffix);
 }
 
-static void populateBoatGroupMembershipResponse(char* buf, size_t bufSize, const char* key)
+static void populateBoatCmdSyncResponse(char* buf, size_t bufSize, char** tok)
+{
+	char* s;
+	char tokenSuffix[BOAT_CMD_TOKEN_MAX_LEN + 2] = "";
+
+	if ((s = strtok_r(0, "\n", tok)) == 0 || (s = takeBoatCmdToken(s, tokenSuffix, sizeof(tokenSuffix))) == 0)
+	{
+		goto fail;
+	}
+
+	// Hold the response until the main thread has handled the command (in its next iteration), or for a few ticks at most
+	// (with the command then still handled later).
+	CommandCompletion* completion;
+	if (0 != Command_addWithCompletion(s, &completion))
+	{
+		goto fail;
+	}
+
+	if (Command_waitCompletion(completion, COMMAND_COMPLETION_WAIT_MAX_MS))
+	{
+		snprintf(buf, bufSize, "%s,%s,%ld%s\n", REQ_STR_BOAT_CMD_SYNC, Command_getResultStr(completion->result), (long) completion->tick, tokenSuffix);
+	}
+	else
+	{
+		snprintf(buf, bufSize, "%s,%s,0%s\n", REQ_STR_BOAT_CMD_SYNC, Command_getResultStr(COMMAND_RESULT_PENDING), tokenSuffix);
+	}
+
+	Command_releaseCompletion(completion);
+	return;
+
+fail:
+	snprintf(buf, bufSize, "%s,%s%s\n", REQ_STR_BOAT_CMD_SYNC, Command_getResultStr(COMMAND_RESULT_FAILED), tokenSuffix);
+}
+
+// Takes the optional client token ("#<token>,") off the front of a boat command, returning the rest of the command (or null if
+// the token is too long or not followed by a command), and setting tokenSuffix to ",<token>" (or leaving it empty if there's none).
+static char* takeBoatCmdToken(char* cmdStr, char* tokenSuffix, size_t tokenSuffixSize)
+{
+	if (cmdStr[0] != BOAT_CMD_TOKEN_PREFIX)
+	{
+		return cmdStr;
+	}
+
+	char* e = strchr(cmdStr, ',');
+	if (!e || (size_t) (e - cmdStr) >= tokenSuffixSize)
+	{
+		return 0;
+	}
+
+	*e = 0;
+	snprintf(tokenSuffix, tokenSuffixSize, ",%s", cmdStr + 1);
+
+	return e + 1;
+}
+
+static const char* const GROUP_MEMBER_JSON_NAMES[] = { "boat", "altName" };
+static const char* const PROXIMITY_JSON_NAMES[] = { "boat", "distance" };
+static const char* const FLEET_TILE_JSON_NAMES[] = { "z", "x", "y", "count", "lat", "lon" };
+static const char* const ETA_JSON_NAMES[] = { "boat", "finishProb", "firstProb", "eta10", "eta50", "eta90" };
+
+static void populateBoatGroupMembershipResponse(char* buf, size_t bufSize, const char* key, bool json)
 {
 	if (BoatRegistry_OK != BoatRegistry_rdlock())
 	{
 		ERRLOG("Failed to read-lock BoatRegistry lock for boat group membership response!");
-		snprintf(buf, bufSize, "%s,%s,failed\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key);
+
+		if (json)
+		{
+			const int n = populateJsonKeyResponseStart(buf, bufSize, REQ_STR_BOAT_GROUP_MEMBERSHIP, "boat", key, "failed");
+			if (n > 0)
+			{
+				snprintf(buf + n, bufSize - n, "}");
+			}
+		}
+		else
+		{
+			snprintf(buf, bufSize, "%s,%s,failed\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key);
+		}
+
 		return;
 	}
 
+	const char* status = "ok";
+	const char* resp = 0;
+
 	const BoatEntry* entry = BoatRegistry_getBoatEntry(key);
+
+	Boat coldBoat;
+	const bool hidden = (entry && (BoatRegistry_view(entry, &coldBoat)->boatFlags & BOAT_FLAG_LIVE_SHARING_HIDDEN) != 0);
+
 	if (!entry)
 	{
-		snprintf(buf, bufSize, "%s,%s,%s\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key, "noboat");
+		status = "noboat";
 	}
 	else if (!entry->group)
 	{
-		snprintf(buf, bufSize, "%s,%s,%s\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key, "nogroup");
+		status = "nogroup";
 	}
-	else if ((entry->boat->boatFlags & BOAT_FLAG_LIVE_SHARING_HIDDEN) != 0)
+	else if (!hidden && !(resp = BoatRegistry_getBoatsInGroupResponse(entry->group)))
 	{
-		snprintf(buf, bufSize, "%s,%s,%s\n%s,?\n\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key, "ok", key);
+		status = "fail";
 	}
-	else
+
+	if (json)
 	{
-		const char* resp = BoatRegistry_getBoatsInGroupResponse(entry->group);
-		if (!resp)
+		int n = populateJsonKeyResponseStart(buf, bufSize, REQ_STR_BOAT_GROUP_MEMBERSHIP, "boat", key, status);
+
+		if (n > 0 && entry && entry->group && (resp || hidden))
 		{
-			snprintf(buf, bufSize, "%s,%s,%s\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key, "fail");
+			// Members hidden (from a boat not sharing its position live) as an empty list
+			const int hn = snprintf(buf + n, bufSize - n, ",\"hidden\":%s,\"members\":", resp ? "false" : "true");
+			const int rn = resp ?
+				HttpApi_writeJsonRows(buf + n + hn, bufSize - n - hn, resp, GROUP_MEMBER_JSON_NAMES, "so") :
+				snprintf(buf + n + hn, bufSize - n - hn, "[]");
+
+			n = (rn < 0) ? populateJsonKeyResponseStart(buf, bufSize, REQ_STR_BOAT_GROUP_MEMBERSHIP, "boat", key, "fail") : n + hn + rn;
 		}
-		else
+
+		if (n > 0)
 		{
-			snprintf(buf, bufSize, "%s,%s,%s\n%s\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key, "ok", resp);
-			BoatRegistry_freeBoatsInGroupResponse(resp);
+			snprintf(buf + n, bufSize - n, "}");
 		}
 	}
+	else if (!entry || !entry->group || (!resp && !hidden))
+	{
+		snprintf(buf, bufSize, "%s,%s,%s\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key, status);
+	}
+	else if (!resp)
+	{
+		snprintf(buf, bufSize, "%s,%s,%s\n%s,?\n\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key, "ok", key);
+	}
+	else
+	{
+		snprintf(buf, bufSize, "%s,%s,%s\n%s\n", REQ_STR_BOAT_GROUP_MEMBERSHIP, key, "ok", resp);
+	}
+
+	if (resp)
+	{
+		BoatRegistry_freeBoatsInGroupResponse(resp);
+	}
 
 	if (BoatRegistry_OK != BoatRegistry_unlock())
 	{
@@ -1029,16 +2144,193 @@ static void populateBoatGroupMembershipResponse(char* buf, size_t bufSize, const
 	}
 }
 
-static void populateSysRequestCountsResponse(char* buf, size_t bufSize)
+static void populateGroupProximityResponse(char* buf, size_t bufSize, const char* key, bool json)
+{
+	const char* status = "ok";
+	const char* resp = 0;
+	bool locked = false;
+
+	if (!Proximity_isEnabled())
+	{
+		status = "disabled";
+	}
+	else if (BoatRegistry_OK != BoatRegistry_rdlock())
+	{
+		ERRLOG("Failed to read-lock BoatRegistry lock for group proximity response!");
+		status = "failed";
+	}
+	else
+	{
+		locked = true;
+
+		const BoatEntry* entry = BoatRegistry_getBoatEntry(key);
+		if (!entry)
+		{
+			status = "noboat";
+		}
+		else if (!entry->group)
+		{
+			status = "nogroup";
+		}
+		else if (!(resp = Proximity_getBoatResponse(key)))
+		{
+			status = "fail";
+		}
+	}
+
+	if (json)
+	{
+		int n = populateJsonKeyResponseStart(buf, bufSize, REQ_STR_GROUP_PROXIMITY, "boat", key, status);
+
+		if (n > 0 && resp)
+		{
+			const int hn = snprintf(buf + n, bufSize - n, ",\"boats\":");
+			const int rn = HttpApi_writeJsonRows(buf + n + hn, bufSize - n - hn, resp, PROXIMITY_JSON_NAMES, "sn");
+
+			n = (rn < 0) ? populateJsonKeyResponseStart(buf, bufSize, REQ_STR_GROUP_PROXIMITY, "boat", key, "fail") : n + hn + rn;
+		}
+
+		if (n > 0)
+		{
+			snprintf(buf + n, bufSize - n, "}");
+		}
+	}
+	else if (resp)
+	{
+		snprintf(buf, bufSize, "%s,%s,%s\n%s\n", REQ_STR_GROUP_PROXIMITY, key, "ok", resp);
+	}
+	else
+	{
+		snprintf(buf, bufSize, "%s,%s,%s\n", REQ_STR_GROUP_PROXIMITY, key, status);
+	}
+
+	if (resp)
+	{
+		Proximity_freeBoatResponse(resp);
+	}
+
+	if (locked && BoatRegistry_OK != BoatRegistry_unlock())
+	{
+		ERRLOG("Failed to unlock BoatRegistry lock for group proximity response!");
+	}
+}
+
+static void populateFleetTileResponse(char* buf, size_t bufSize, int z, int x, int y, bool json)
+{
+	const char* status = "ok";
+	const char* resp = 0;
+
+	if (!FleetTiles_isEnabled())
+	{
+		status = "disabled";
+	}
+	else if (!(resp = FleetTiles_getTileResponse(z, x, y)))
+	{
+		status = "fail";
+	}
+
+	if (json)
+	{
+		int n = snprintf(buf, bufSize, "{\"type\":\"%s\",\"z\":%d,\"x\":%d,\"y\":%d,\"status\":\"%s\"", REQ_STR_FLEET_TILE, z, x, y, status);
+
+		if (resp)
+		{
+			const int hn = snprintf(buf + n, bufSize - n, ",\"tiles\":");
+			const int rn = HttpApi_writeJsonRows(buf + n + hn, bufSize - n - hn, resp, FLEET_TILE_JSON_NAMES, "nnnnnn");
+
+			n = (rn < 0) ?
+				snprintf(buf, bufSize, "{\"type\":\"%s\",\"z\":%d,\"x\":%d,\"y\":%d,\"status\":\"%s\"", REQ_STR_FLEET_TILE, z, x, y, "fail") :
+				n + hn + rn;
+		}
+
+		snprintf(buf + n, bufSize - n, "}");
+	}
+	else if (resp)
+	{
+		snprintf(buf, bufSize, "%s,%d,%d,%d,%s\n%s\n", REQ_STR_FLEET_TILE, z, x, y, "ok", resp);
+	}
+	else
+	{
+		snprintf(buf, bufSize, "%s,%d,%d,%d,%s\n", REQ_STR_FLEET_TILE, z, x, y, status);
+	}
+
+	if (resp)
+	{
+		FleetTiles_freeTileResponse(resp);
+	}
+}
+
+static void populateGroupEtaResponse(char* buf, size_t bufSize, const char* key, bool json)
 {
-	if ((COUNTERS_COUNT + COUNTERS_REQ_TYPE_COUNT) * 22 >= bufSize)
+	const char* status = "ok";
+	const char* resp = 0;
+	time_t runTime = 0;
+
+	if (!Ensemble_isEnabled())
+	{
+		status = "disabled";
+	}
+	else if (!(resp = Ensemble_getGroupResponse(key, &runTime)))
+	{
+		// No forecast (yet) for the group, or the group has no finish line.
+		status = "nogroup";
+	}
+
+	if (json)
+	{
+		int n = populateJsonKeyResponseStart(buf, bufSize, REQ_STR_GROUP_ETA, "group", key, status);
+
+		if (n > 0 && resp)
+		{
+			const int hn = snprintf(buf + n, bufSize - n, ",\"time\":%ld,\"boats\":", (long) runTime);
+			const int rn = HttpApi_writeJsonRows(buf + n + hn, bufSize - n - hn, resp, ETA_JSON_NAMES, "snnnnn");
+
+			n = (rn < 0) ? populateJsonKeyResponseStart(buf, bufSize, REQ_STR_GROUP_ETA, "group", key, "fail") : n + hn + rn;
+		}
+
+		if (n > 0)
+		{
+			snprintf(buf + n, bufSize - n, "}");
+		}
+	}
+	else if (resp)
+	{
+		snprintf(buf, bufSize, "%s,%s,%ld,%s\n%s\n", REQ_STR_GROUP_ETA, key, (long) runTime, "ok", resp);
+	}
+	else
+	{
+		snprintf(buf, bufSize, "%s,%s,%s\n", REQ_STR_GROUP_ETA, key, status);
+	}
+
+	if (resp)
+	{
+		Ensemble_freeGroupResponse(resp);
+	}
+}
+
+static const char* const COUNTER_JSON_NAMES[COUNTERS_COUNT] = {
+	"accept",
+	"acceptFail",
+	"read",
+	"readFail",
+	"dataTooLong",
+	"message",
+	"messageFail"
+};
+
+static void populateSysRequestCountsResponse(char* buf, size_t bufSize, bool json)
+{
+	if ((COUNTERS_COUNT + COUNTERS_REQ_TYPE_COUNT) * 36 >= bufSize)
 	{
 		ERRLOG("Failed to write request counts response due to too many counters and/or not enough space in buffer!");
 		goto fail;
 	}
 
+	uint64_t c[COUNTERS_COUNT + COUNTERS_REQ_TYPE_COUNT];
+	Counters_sum(&_counters, c);
+
 
-	int src = snprintf(buf, bufSize, "%s,", REQ_STR_SYS_REQUEST_COUNTS);
+	int src = snprintf(buf, bufSize, json ? "{\"type\":\"%s\"," : "%s,", REQ_STR_SYS_REQUEST_COUNTS);
 	if (src < 2) // < 2 because there must be at least two bytes written here (and similarly below)
 	{
 		ERRLOG1("snprintf failed with return = %d", src);
@@ -1049,7 +2341,9 @@ static void populateSysRequestCountsResponse(char* buf, size_t bufSize)
 
 	for (int i = 0; i < COUNTERS_COUNT; i++)
 	{
-		if ((src = snprintf(buf + pos, bufSize - pos, "%lu,", _counter[i].u64)) < 2)
+		if ((src = (json ?
+				snprintf(buf + pos, bufSize - pos, "\"%s\":%lu,", COUNTER_JSON_NAMES[i], c[i]) :
+				snprintf(buf + pos, bufSize - pos, "%lu,", c[i]))) < 2)
 		{
 			ERRLOG1("snprintf failed with return = %d", src);
 			goto fail;
@@ -1057,9 +2351,15 @@ static void populateSysRequestCountsResponse(char* buf, size_t bufSize)
 		pos += src;
 	}
 
+	if (json)
+	{
+		// Request counts by request type number
+		pos += snprintf(buf + pos, bufSize - pos, "\"requests\":[");
+	}
+
 	for (int i = 0; i < COUNTERS_REQ_TYPE_COUNT; i++)
 	{
-		if ((src = snprintf(buf + pos, bufSize - pos, "%lu,", _counterReqType[i].u64)) < 2)
+		if ((src = snprintf(buf + pos, bufSize - pos, "%lu,", c[COUNTER_REQ_TYPE_BASE + i])) < 2)
 		{
 			ERRLOG1("snprintf failed with return = %d", src);
 			goto fail;
@@ -1067,10 +2367,145 @@ static void populateSysRequestCountsResponse(char* buf, size_t bufSize)
 		pos += src;
 	}
 
-	buf[pos - 1] = '\n';
+	if (json)
+	{
+		snprintf(buf + pos - 1, bufSize - pos + 1, "]}");
+	}
+	else
+	{
+		buf[pos - 1] = '\n';
+	}
 
 	return;
 
 fail:
-	snprintf(buf, bufSize, "%s,%s", REQ_STR_SYS_REQUEST_COUNTS, "fail");
+	if (json)
+	{
+		snprintf(buf, bufSize, "{\"type\":\"%s\",\"status\":\"%s\"}", REQ_STR_SYS_REQUEST_COUNTS, "fail");
+	}
+	else
+	{
+		snprintf(buf, bufSize, "%s,%s", REQ_STR_SYS_REQUEST_COUNTS, "fail");
+	}
+}
+
+static void populateSysNetWorkersResponse(char* buf, size_t bufSize, bool json)
+{
+	NetServerWorkerPoolStats ps;
+	NetServer_getWorkerPoolStats(&ps);
+
+	snprintf(buf, bufSize, json ?
+				"{\"type\":\"%s\",\"workers\":%u,\"idleWorkers\":%u,\"minWorkers\":%u,\"maxWorkers\":%u,\"queuedFds\":%u,\"started\":%lu,\"retired\":%lu,\"busyMs\":%lu}" :
+				"%s,%u,%u,%u,%u,%u,%lu,%lu,%lu\n",
+			REQ_STR_SYS_NET_WORKERS,
+			ps.workers,
+			ps.idleWorkers,
+			ps.minWorkers,
+			ps.maxWorkers,
+			ps.queuedFds,
+			ps.started,
+			ps.retired,
+			ps.busyNs / 1000000);
+}
+
+static void populateSysBoatTiersResponse(char* buf, size_t bufSize, bool json)
+{
+	if (BoatRegistry_OK != BoatRegistry_rdlock())
+	{
+		ERRLOG("Failed to read-lock BoatRegistry lock for boat tiers response!");
+		snprintf(buf, bufSize, json ? "{\"type\":\"%s\",\"status\":\"%s\"}" : "%s,%s\n", REQ_STR_SYS_BOAT_TIERS, "fail");
+		return;
+	}
+
+	BoatRegistryTierStats ts;
+	BoatRegistry_getTierStats(&ts);
+
+	if (BoatRegistry_OK != BoatRegistry_unlock())
+	{
+		ERRLOG("Failed to unlock BoatRegistry lock for boat tiers response!");
+	}
+
+	snprintf(buf, bufSize, json ?
+				"{\"type\":\"%s\",\"hotBoats\":%lu,\"coldBoats\":%lu,\"hotBytes\":%zu,\"coldBytes\":%zu,\"entryBytes\":%zu,\"promotions\":%lu,\"demotions\":%lu}" :
+				"%s,%lu,%lu,%zu,%zu,%zu,%lu,%lu\n",
+			REQ_STR_SYS_BOAT_TIERS,
+			ts.hotCount,
+			ts.coldCount,
+			ts.hotBytes,
+			ts.coldBytes,
+			ts.entryBytes,
+			ts.promotions,
+			ts.demotions);
+}
+
+static void populateSysProfileStartResponse(char* buf, size_t bufSize, int hz)
+{
+	const int rc = Profiler_start(hz);
+
+	snprintf(buf, bufSize, "%s,%s\n", REQ_STR_SYS_PROFILE_START, (rc == 0) ? "ok" : ((rc == -1) ? "running" : "fail"));
+}
+
+static void populateSysProfileStopResponse(char* buf, size_t bufSize)
+{
+	ProfilerStats stats;
+	if (0 != Profiler_stop(&stats))
+	{
+		snprintf(buf, bufSize, "%s,%s\n", REQ_STR_SYS_PROFILE_STOP, "notrunning");
+		return;
+	}
+
+	// Collapsed stacks written to a file in the working directory (being too large for a response, in general)
+	char path[64];
+	snprintf(path, sizeof(path), PROFILE_PATH_FORMAT, (long) time(0));
+
+	int lines = -1;
+	FILE* f = fopen(path, "w");
+	if (f)
+	{
+		lines = Profiler_dump(f);
+		if (0 != fclose(f))
+		{
+			lines = -1;
+		}
+	}
+
+	if (lines < 0)
+	{
+		ERRLOG1("Failed to write profile to %s!", path);
+		snprintf(buf, bufSize, "%s,%s\n", REQ_STR_SYS_PROFILE_STOP, "fail");
+		return;
+	}
+
+	snprintf(buf, bufSize, "%s,%s,%lu,%lu,%u,%d,%s\n",
+			REQ_STR_SYS_PROFILE_STOP,
+			"ok",
+			stats.samples,
+			stats.dropped,
+			stats.threads,
+			lines,
+			path);
+}
+
+// Writes the start of a JSON response object for a request with a string key (such as a boat name), for the caller to
+// add any other members to, and close. Returns the length written, or -1 (with an error response written instead).
+static int populateJsonKeyResponseStart(char* buf, size_t bufSize, const char* type, const char* keyName, const char* key, const char* status)
+{
+	int n = snprintf(buf, bufSize, "{\"type\":\"%s\",\"%s\":", type, keyName);
+
+	int kn;
+	if (n < 0 || (size_t) n >= bufSize || (kn = HttpApi_writeJsonString(buf + n, bufSize - n, key)) < 0)
+	{
+		snprintf(buf, bufSize, "{\"error\":%d}", HTTP_API_STATUS_INTERNAL_ERROR);
+		return -1;
+	}
+	n += kn;
+
+	const int sn = snprintf(buf + n, bufSize - n, ",\"status\":\"%s\"", status);
+	if (sn < 0 || (size_t) sn >= bufSize - n)
+	{
+		snprintf(buf, bufSize, "{\"error\":%d}", HTTP_API_STATUS_INTERNAL_ERROR);
+		return -1;
+	}
+
+	return n + sn;
 }
@@ -18,8 +18,58 @@
 #define _NetServer_h_
 
 
-int NetServer_init(const char* host, unsigned int port, unsigned int workerThreads);
+#include <stdint.h>
+
+
+// Most worker threads the pool can have
+#define NETSERVER_MAX_THREAD_COUNT (10000)
+
+
+typedef int (*NetServer_RequestHandlerFunc)(int writeFd, char* reqStr);
+
+typedef struct
+{
+	unsigned int workers;
+	unsigned int idleWorkers;
+	unsigned int minWorkers;
+	unsigned int maxWorkers;
+	unsigned int queuedFds;
+
+	uint64_t started;
+	uint64_t retired;
+
+	// Total time spent by all workers handling connections
+	uint64_t busyNs;
+} NetServerWorkerPoolStats;
+
+int NetServer_init(const char* host, unsigned int port, const char* unixPath, unsigned int workerThreads);
+
+// Starts an HTTP/1.1 listener (on a TCP port, or a unix socket if unixPath is set) for the JSON read API, with its
+// connections handled by the same worker pool. Must be called after NetServer_init().
+int NetServer_initHttp(const char* host, unsigned int port, const char* unixPath);
+
+// As NetServer_init() and NetServer_initHttp(), but with sockets already listening (such as handed over from another
+// process by Handoff).
+int NetServer_initWithFd(int listenFd, unsigned int workerThreads);
+int NetServer_initHttpWithFd(int listenFd);
+
+// The listening sockets (or -1 for any not started).
+void NetServer_getListenFds(int* listenFd, int* httpListenFd);
+
+// Stops accepting connections (leaving the listening sockets open, and the worker pool serving connections already
+// accepted) until NetServer_resumeAccepting() is called.
+int NetServer_stopAccepting();
+int NetServer_resumeAccepting();
+
+void NetServer_setRequestHandler(NetServer_RequestHandlerFunc requestHandler);
 int NetServer_handleRequest(int writeFd, char* reqStr);
 
+// Lets the worker pool grow (whenever an accepted connection is queued with no idle worker to take it) up to
+// maxWorkers, and shrink (as workers retire after idling for idleRetireMs) down to minWorkers. Otherwise, the pool
+// stays at the size given to NetServer_init(). May be called before or after NetServer_init().
+int NetServer_setWorkerPoolLimits(unsigned int minWorkers, unsigned int maxWorkers, unsigned int idleRetireMs);
+
+void NetServer_getWorkerPoolStats(NetServerWorkerPoolStats* stats);
+
 
 #endif // _NetServer_h_
@@ -15,6 +15,10 @@
  */
 
 #include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,8 +26,10 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <fcntl.h>
 
 #include <proteus/Weather.h>
@@ -34,11 +40,30 @@
 
 #include "Perf.h"
 
+#include "Affinity.h"
+#include "Boat.h"
+#include "BoatInitParser.h"
 #include "BoatRegistry.h"
+#include "BoatRestore.h"
 #include "CelestialSight.h"
+#include "ColdBoat.h"
+#include "CommandJournal.h"
+#include "CommandSchedule.h"
+#include "Counters.h"
+#include "Ensemble.h"
 #include "ErrLog.h"
+#include "FleetTiles.h"
 #include "GeoUtils.h"
+#include "GhostTrack.h"
+#include "Handoff.h"
 #include "NetServer.h"
+#include "Profiler.h"
+#include "Proximity.h"
+#include "RaceMarks.h"
+#include "Replication.h"
+#include "SimCore.h"
+#include "WindField.h"
+#include "Zones.h"
 
 
 #define ERRLOG_ID "Perf"
@@ -71,6 +96,49 @@ static int runAddBoats(unsigned int boatCount);
 static int runRemoveAllBoats(bool expectNullBoats);
 static int runNetServerRequests(int netServerWriteFd, Perf_CommandHandlerFunc commandHandler);
 static int runDataGets();
+static int runWindField();
+static int runReplicationEncode(Perf_CommandHandlerFunc commandHandler);
+static int runProximity();
+static int runRaceMarks();
+static int runZones();
+static int runFleetTiles();
+static int runGhosts();
+static int runSimCore();
+static void* simCoreThreadMain(void* arg);
+static bool simCoreEnvGetOcean(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od);
+static void simCoreEnvGetWind(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx);
+static bool simCoreEnvGetWave(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd);
+static bool simCoreEnvIsWater(void* ctx, const proteus_GeoPos* pos);
+static double simCoreEnvGetMagDec(void* ctx, const proteus_GeoPos* pos, time_t t);
+static int runEnsemble();
+static int runProfiler();
+static int runColdTier();
+static int runBoatRestore();
+static int runHandoff();
+static void* handoffRecvThreadMain(void* arg);
+static void* ensembleThreadMain(void* arg);
+static int runCommandSchedule(Perf_CommandHandlerFunc commandHandler);
+static int runCommandJournal();
+static int runCommandCompletion(Perf_CommandHandlerFunc commandHandler);
+static int runBoatChurn();
+static int runTickJitter(Perf_CommandHandlerFunc commandHandler);
+static void* tickJitterLoadThreadMain(void* arg);
+static int compareLong(const void* a, const void* b);
+static int runCounters(int netServerWriteFd);
+static void* countersThreadMain(void* arg);
+static int runNetServerWorkerPool();
+static void* workerPoolClientThreadMain(void* arg);
+static int runHttpApi(Perf_CommandHandlerFunc commandHandler);
+static int connectUnix(const char* path);
+static int readHttpResponses(int fd, unsigned int count);
+static int runGroupCommands(Perf_CommandHandlerFunc commandHandler);
+static int addPerfGroupBoats(Perf_CommandHandlerFunc commandHandler);
+static long getRssKb();
+static void* commandCompletionTickThreadMain(void* arg);
+static void* commandCompletionClientThreadMain(void* arg);
+static int sendPerfRequest(int fd, int readFd, char* reqStr, char* resp, size_t respSize);
+static int addPerfZone(const char* group, const char* name, double lat, double lon, double radius, unsigned int vertexCount);
+static int runProximityCase(unsigned int boatCount, unsigned int groupCount, double areaKm, double radius);
 
 static char* getRandomName(unsigned int len);
 static double getRandomLat();
@@ -94,6 +162,9 @@ void Perf_addAndStartRandomBoat(int groupNameLen, Perf_CommandHandlerFunc comman
 	Command cmd;
 
 	cmd.name = getRandomName(PERF_RANDOM_BOAT_NAME_LEN);
+	cmd.execTime = 0;
+	cmd.str = 0;
+	cmd.completion = 0;
 	cmd.next = 0;
 
 
@@ -117,7 +188,7 @@ void Perf_addAndStartRandomBoat(int groupNameLen, Perf_CommandHandlerFunc comman
 		cmd.values[5].s = getRandomName(PERF_RANDOM_BOAT_ALT_NAME_LEN); // Boat alt name
 	}
 
-	commandHandler(&cmd);
+	commandHandler(&cmd, time(0));
 
 	if (withGroup)
 	{
@@ -133,13 +204,13 @@ void Perf_addAndStartRandomBoat(int groupNameLen, Perf_CommandHandlerFunc comman
 	cmd.action = (getRandomBool() ? COMMAND_ACTION_COURSE_TRUE : COMMAND_ACTION_COURSE_MAG);
 	cmd.values[0].i = getRandomCourse();
 
-	commandHandler(&cmd);
+	commandHandler(&cmd, time(0));
 
 
 	// Start boat.
 	cmd.action = COMMAND_ACTION_START;
 
-	commandHandler(&cmd);
+	commandHandler(&cmd, time(0));
 
 
 	free(cmd.name);
@@ -179,6 +250,12 @@ int Perf_runAdditional(Perf_CommandHandlerFunc commandHandler)
 		}
 	}
 
+	rc = runBoatChurn();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
 	int writeFd = open("/dev/null", O_WRONLY);
 	if (writeFd < 0)
 	{
@@ -186,6 +263,18 @@ int Perf_runAdditional(Perf_CommandHandlerFunc commandHandler)
 		return -2;
 	}
 	rc = runNetServerRequests(writeFd, commandHandler);
+	if (rc == 0)
+	{
+		rc = runCounters(writeFd);
+	}
+	if (rc == 0)
+	{
+		rc = runNetServerWorkerPool();
+	}
+	if (rc == 0)
+	{
+		rc = runHttpApi(commandHandler);
+	}
 	close(writeFd);
 	if (rc != 0)
 	{
@@ -198,6 +287,114 @@ int Perf_runAdditional(Perf_CommandHandlerFunc commandHandler)
 		return rc;
 	}
 
+	rc = runWindField();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runReplicationEncode(commandHandler);
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runProximity();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runRaceMarks();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runZones();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runFleetTiles();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runGhosts();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runSimCore();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runEnsemble();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runProfiler();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runColdTier();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runBoatRestore();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runHandoff();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runCommandSchedule(commandHandler);
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runCommandJournal();
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runCommandCompletion(commandHandler);
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runTickJitter(commandHandler);
+	if (rc != 0)
+	{
+		return rc;
+	}
+
+	rc = runGroupCommands(commandHandler);
+	if (rc != 0)
+	{
+		return rc;
+	}
+
 
 	PERF_CLOCK_INIT();
 
@@ -353,7 +550,7 @@ static int runRemoveAllBoats(bool expectNullBoats)
 		Boat* b = BoatRegistry_remove(boatNames[i]);
 		if (b)
 		{
-			free(b);
+			Boat_free(b);
 		}
 
 		if ((0 == b) != expectNullBoats)
@@ -647,6 +844,199 @@ static int runDataGets()
 	return 0;
 }
 
+static int runWindField()
+{
+	const unsigned int ITERATIONS = 1000000;
+	const size_t POSITION_COUNT = 1000000;
+
+
+	proteus_GeoPos* positions = malloc(POSITION_COUNT * sizeof(proteus_GeoPos));
+	if (!positions)
+	{
+		ERRLOG("Failed to alloc wind field perf positions!");
+		return -1;
+	}
+
+	for (size_t i = 0; i < POSITION_COUNT; i++)
+	{
+		positions[i].lat = getRandomLat();
+		positions[i].lon = getRandomLon();
+	}
+
+	PERF_CLOCK_INIT();
+
+
+	// Build
+	PERF_CLOCK_RESET();
+	if (0 != WindField_build(WINDFIELD_RES_DEG, 0))
+	{
+		free(positions);
+		return -1;
+	}
+	PERF_CLOCK_MEASURE();
+	printf("Wind field build (%.2f degrees): %.3fs\n", WINDFIELD_RES_DEG, PERF_CLOCK_NS_TAKEN / 1000000000.0);
+
+
+	// Live computation (weather and ocean lookups, and current adjustment)
+	double sum = 0.0;
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < ITERATIONS; i++)
+	{
+		proteus_Weather wx;
+		sum += WindField_getLive(positions + (i % POSITION_COUNT), &wx);
+	}
+	PERF_CLOCK_MEASURE();
+	const double liveKips = PERF_CLOCK_KIPS;
+	printf("Current-adjusted wind (live) per second: %.1fk\n", liveKips);
+
+
+	// Sampling the field
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < ITERATIONS; i++)
+	{
+		proteus_Weather wx;
+		WindField_get(positions + (i % POSITION_COUNT), &wx, 0);
+		sum += wx.wind.angle;
+	}
+	PERF_CLOCK_MEASURE();
+	printf("Current-adjusted wind (wind field) per second: %.1fk (%.1fx live, checksum %.0f)\n", PERF_CLOCK_KIPS, PERF_CLOCK_KIPS / liveKips, sum);
+
+
+	// Accuracy compared with the live computation
+	double windMagErrSum = 0.0;
+	double windMagErrMax = 0.0;
+	double windAngleErrSum = 0.0;
+	double windAngleErrMax = 0.0;
+	double gustErrSum = 0.0;
+	double gustErrMax = 0.0;
+	unsigned int angleCount = 0;
+
+	for (unsigned int i = 0; i < ITERATIONS; i++)
+	{
+		const proteus_GeoPos* pos = positions + (i % POSITION_COUNT);
+
+		proteus_Weather live;
+		proteus_Weather field;
+		WindField_getLive(pos, &live);
+		WindField_get(pos, &field, 0);
+
+		const double magErr = fabs(field.wind.mag - live.wind.mag);
+		windMagErrSum += magErr;
+		windMagErrMax = fmax(windMagErrMax, magErr);
+
+		const double gustErr = fabs(field.windGust - live.windGust);
+		gustErrSum += gustErr;
+		gustErrMax = fmax(gustErrMax, gustErr);
+
+		// Direction only matters with some wind.
+		if (live.wind.mag >= 1.0)
+		{
+			double angleErr = fabs(field.wind.angle - live.wind.angle);
+			if (angleErr > 180.0)
+			{
+				angleErr = 360.0 - angleErr;
+			}
+
+			windAngleErrSum += angleErr;
+			windAngleErrMax = fmax(windAngleErrMax, angleErr);
+			angleCount++;
+		}
+	}
+
+	printf("Wind field error vs live: wind speed mean %.3f max %.3f m/s, direction mean %.2f max %.2f deg (wind >= 1 m/s), gust mean %.3f max %.3f m/s\n",
+			windMagErrSum / ITERATIONS,
+			windMagErrMax,
+			angleCount > 0 ? windAngleErrSum / angleCount : 0.0,
+			windAngleErrMax,
+			gustErrSum / ITERATIONS,
+			gustErrMax);
+
+
+	free(positions);
+	positions = 0;
+
+	return 0;
+}
+
+static int runReplicationEncode(Perf_CommandHandlerFunc commandHandler)
+{
+	const unsigned int BOAT_COUNT = 100000;
+	const unsigned int ITERATIONS = 20;
+
+	PERF_CLOCK_INIT();
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		Perf_addAndStartRandomBoat(3, commandHandler);
+	}
+
+	ReplicationBuf buf;
+	memset(&buf, 0, sizeof(ReplicationBuf));
+
+	// Initial delta (all boats added)
+	PERF_CLOCK_RESET();
+	if (0 != Replication_encodeDelta(0, &buf))
+	{
+		ERRLOG("Replication_encodeDelta() failed!");
+		return -1;
+	}
+	PERF_CLOCK_MEASURE();
+	printf("Replication initial delta (boats=%u): %.3f ms, %zu bytes\n", BOAT_COUNT, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0, buf.len);
+	ReplicationBuf_free(&buf);
+
+	// Per-tick delta with all boats moving
+	long totalNs = 0;
+	size_t totalBytes = 0;
+	for (unsigned int i = 0; i < ITERATIONS; i++)
+	{
+		unsigned int boatCount;
+		void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
+		BoatEntry* e;
+		while ((e = sailnavsim_boatregistry_boats_iterator_get_next(iterator)) != 0)
+		{
+			e->boat->pos.lat += 0.0001;
+			e->boat->pos.lon += 0.0001;
+			e->boat->distanceTravelled += 10.0;
+		}
+		sailnavsim_boatregistry_free_boats_iterator(iterator);
+
+		PERF_CLOCK_RESET();
+		if (0 != Replication_encodeDelta(i + 1, &buf))
+		{
+			ERRLOG("Replication_encodeDelta() failed!");
+			return -1;
+		}
+		PERF_CLOCK_MEASURE();
+
+		totalNs += PERF_CLOCK_NS_TAKEN;
+		totalBytes += buf.len;
+		ReplicationBuf_free(&buf);
+	}
+	printf("Replication per-tick delta (boats=%u, all moving): %.3f ms, %zu bytes\n", BOAT_COUNT, ((double) totalNs) / ITERATIONS / 1000000.0, totalBytes / ITERATIONS);
+
+	// Snapshot for a newly connected replica
+	PERF_CLOCK_RESET();
+	if (0 != Replication_encodeSnapshot(0, &buf))
+	{
+		ERRLOG("Replication_encodeSnapshot() failed!");
+		return -1;
+	}
+	PERF_CLOCK_MEASURE();
+	printf("Replication snapshot (boats=%u): %.3f ms, %zu bytes\n", BOAT_COUNT, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0, buf.len);
+	ReplicationBuf_free(&buf);
+
+	Replication_resetPrimaryState();
+
+	if (0 != runRemoveAllBoats(false))
+	{
+		ERRLOG("Failed to remove all boats!");
+		return -1;
+	}
+
+	return 0;
+}
+
+
 static char* getRandomName(unsigned int len)
 {
 	static const char* RANDOM_NAME_CHARS = "0123456789abcdef";
@@ -750,3 +1140,2646 @@ static int getRandInt3(int max)
 	static unsigned int _randSeed3 = 141421356;
 	return (rand_r(&_randSeed3) % (max + 1));
 }
+
+static int runProximity()
+{
+	int rc;
+
+	// Race start densities: 10k boats in a 2 km x 2 km area
+	if ((rc = runProximityCase(10000, 1, 2.0, 25.0)) != 0 ||
+		(rc = runProximityCase(10000, 1, 2.0, 100.0)) != 0)
+	{
+		return rc;
+	}
+
+	// Spread out race: 10k boats in a 20 km x 20 km area, with "in sight" radius
+	if ((rc = runProximityCase(10000, 1, 20.0, 500.0)) != 0)
+	{
+		return rc;
+	}
+
+	// Many races: 100k boats in 100 groups, each in its own 20 km x 20 km area
+	if ((rc = runProximityCase(100000, 100, 20.0, 500.0)) != 0)
+	{
+		return rc;
+	}
+
+	return 0;
+}
+
+static int runProximityCase(unsigned int boatCount, unsigned int groupCount, double areaKm, double radius)
+{
+	const unsigned int ITERATIONS = 10;
+
+	PERF_CLOCK_INIT();
+
+	ProximityPoint* points = malloc(boatCount * sizeof(ProximityPoint));
+	if (!points)
+	{
+		ERRLOG("Alloc failed for proximity points!");
+		return -1;
+	}
+
+	// Area size in degrees of latitude (and of longitude, at around 45 degrees latitude)
+	const double areaLat = areaKm / 111.2;
+	const double areaLon = areaKm / 78.6;
+
+	for (unsigned int i = 0; i < boatCount; i++)
+	{
+		const unsigned int group = i % groupCount;
+
+		points[i].lat = 40.0 + (group / 10) * 1.0 + areaLat * (rand() / (double) RAND_MAX);
+		points[i].lon = -60.0 + (group % 10) * 1.0 + areaLon * (rand() / (double) RAND_MAX);
+		points[i].groupKey = group;
+	}
+
+	ProximityPair* pairs;
+	unsigned int pairCount = 0;
+
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < ITERATIONS; i++)
+	{
+		if (0 != Proximity_findPairs(points, boatCount, radius, &pairs, &pairCount))
+		{
+			ERRLOG("Failed to find proximity pairs!");
+			free(points);
+			return -1;
+		}
+
+		free(pairs);
+	}
+	PERF_CLOCK_MEASURE();
+
+	printf("Proximity pairs (boats=%u, groups=%u, area=%.0fkm x %.0fkm, radius=%.0fm, pairs=%u): %.3fms\n", boatCount, groupCount, areaKm, areaKm, radius, pairCount, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0 / ITERATIONS);
+
+	free(points);
+	return 0;
+}
+
+static int runRaceMarks()
+{
+	const unsigned int BOAT_COUNT = 100000;
+	const unsigned int RACE_COUNT = 5;
+	const unsigned int MARKS_PER_RACE = 10;
+	const unsigned int ITERATIONS = 20;
+
+	PERF_CLOCK_INIT();
+
+	char groups[RACE_COUNT][16];
+	for (unsigned int r = 0; r < RACE_COUNT; r++)
+	{
+		snprintf(groups[r], sizeof(groups[r]), "PerfRace%u", r);
+	}
+
+	// Each race has a row of 1 km long gate lines (plus a finish line), 0.02 degrees apart, around its own location.
+	for (unsigned int r = 0; r < RACE_COUNT; r++)
+	{
+		for (unsigned int m = 0; m < MARKS_PER_RACE; m++)
+		{
+			char name[16];
+			snprintf(name, sizeof(name), "Mark%u", m);
+
+			proteus_GeoPos p1;
+			proteus_GeoPos p2;
+			p1.lat = 40.0 + r + 0.02 * m;
+			p1.lon = -60.0 - 0.006;
+			p2.lat = p1.lat;
+			p2.lon = -60.0 + 0.006;
+
+			if (0 != RaceMarks_add(groups[r], name, (m == MARKS_PER_RACE - 1) ? RACEMARK_TYPE_FINISH : RACEMARK_TYPE_GATE, &p1, &p2))
+			{
+				ERRLOG("Failed to add race mark!");
+				return -1;
+			}
+		}
+	}
+
+	// Half of the boats race northward (at ~10 m/s) through their race's marks, and the other half are elsewhere (in no race).
+	proteus_GeoPos* pos = malloc(BOAT_COUNT * sizeof(proteus_GeoPos));
+	const char** boatGroups = malloc(BOAT_COUNT * sizeof(const char*));
+	if (!pos || !boatGroups)
+	{
+		ERRLOG("Alloc failed for race mark boats!");
+		free(pos);
+		free(boatGroups);
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		const bool inRace = (i % 2 == 0);
+		const unsigned int r = i % RACE_COUNT;
+
+		pos[i].lat = inRace ? (40.0 + r + 0.2 * (rand() / (double) RAND_MAX)) : getRandomLat();
+		pos[i].lon = inRace ? (-60.0 - 0.005 + 0.01 * (rand() / (double) RAND_MAX)) : getRandomLon();
+		boatGroups[i] = inRace ? groups[r] : 0;
+	}
+
+	const double dLat = 10.0 / 111200.0;
+	unsigned int crossings = 0;
+
+	PERF_CLOCK_RESET();
+	for (unsigned int it = 0; it < ITERATIONS; it++)
+	{
+		for (unsigned int i = 0; i < BOAT_COUNT; i++)
+		{
+			proteus_GeoPos prev = pos[i];
+			pos[i].lat += dLat;
+
+			if (boatGroups[i])
+			{
+				RaceMarks_checkCrossings("PerfBoat", boatGroups[i], &prev, pos + i, 1000 + it);
+			}
+		}
+
+		unsigned int evCount;
+		BoatEventEntry* events = RaceMarks_takeEvents(&evCount);
+		crossings += evCount;
+		Logger_freeEvents(events, evCount);
+	}
+	PERF_CLOCK_MEASURE();
+
+	printf("Race mark crossing checks per tick (boats=%u, marks=%u, crossings=%u): %.3fms\n", BOAT_COUNT, RACE_COUNT * MARKS_PER_RACE, crossings, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0 / ITERATIONS);
+
+	for (unsigned int r = 0; r < RACE_COUNT; r++)
+	{
+		for (unsigned int m = 0; m < MARKS_PER_RACE; m++)
+		{
+			char name[16];
+			snprintf(name, sizeof(name), "Mark%u", m);
+			RaceMarks_remove(groups[r], name);
+		}
+	}
+
+	free(pos);
+	free(boatGroups);
+	return 0;
+}
+
+static int runZones()
+{
+	const unsigned int BOAT_COUNT = 100000;
+	const unsigned int SMALL_ZONE_COUNT = 20;
+	const unsigned int ITERATIONS = 10;
+
+	PERF_CLOCK_INIT();
+
+	// A large, detailed "ice limit" polygon, plus some smaller restricted areas around and within it.
+	if (0 != addPerfZone("PerfZones", "IceLimit", -50.0, 0.0, 10.0, 50000))
+	{
+		return -1;
+	}
+
+	for (unsigned int z = 0; z < SMALL_ZONE_COUNT; z++)
+	{
+		char name[16];
+		snprintf(name, sizeof(name), "Area%u", z);
+
+		if (0 != addPerfZone("PerfZones", name, -62.0 + 1.2 * z, -14.0 + 1.4 * z, 0.5, 2000))
+		{
+			return -1;
+		}
+	}
+
+	const ZoneSet* zones = Zones_getGroupZones("PerfZones");
+
+	proteus_GeoPos* pos = malloc(BOAT_COUNT * sizeof(proteus_GeoPos));
+	if (!pos)
+	{
+		ERRLOG("Alloc failed for zone boats!");
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		pos[i].lat = -64.0 + 28.0 * (rand() / (double) RAND_MAX);
+		pos[i].lon = -18.0 + 36.0 * (rand() / (double) RAND_MAX);
+	}
+
+	unsigned int inside = 0;
+
+	PERF_CLOCK_RESET();
+	for (unsigned int it = 0; it < ITERATIONS; it++)
+	{
+		for (unsigned int i = 0; i < BOAT_COUNT; i++)
+		{
+			if (Zones_find(zones, pos + i))
+			{
+				inside++;
+			}
+		}
+	}
+	PERF_CLOCK_MEASURE();
+
+	printf("Zone checks per tick, indexed (boats=%u, zones=%u, vertices=%u, inside=%u): %.3fms\n", BOAT_COUNT, SMALL_ZONE_COUNT + 1, 50000 + SMALL_ZONE_COUNT * 2000, inside / ITERATIONS, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0 / ITERATIONS);
+
+	// For comparison, the unindexed test of every zone (for a sample of the boats, as it is much slower).
+	const unsigned int SAMPLE_COUNT = BOAT_COUNT / 50;
+	unsigned int mismatches = 0;
+
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < SAMPLE_COUNT; i++)
+	{
+		if (Zones_findExact(zones, pos + i) != Zones_find(zones, pos + i))
+		{
+			mismatches++;
+		}
+	}
+	PERF_CLOCK_MEASURE();
+
+	printf("Zone checks per tick, unindexed (boats=%u, mismatches=%u): %.3fms\n", BOAT_COUNT, mismatches, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0 * (BOAT_COUNT / SAMPLE_COUNT));
+
+	free(pos);
+
+	if (mismatches > 0)
+	{
+		ERRLOG1("Indexed zone checks differ from unindexed ones for %u boats!", mismatches);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Adds a zone with a jagged outline around a centre point (radius in degrees of latitude).
+static int addPerfZone(const char* group, const char* name, double lat, double lon, double radius, unsigned int vertexCount)
+{
+	proteus_GeoPos* vertices = malloc(vertexCount * sizeof(proteus_GeoPos));
+	if (!vertices)
+	{
+		ERRLOG("Alloc failed for zone vertices!");
+		return -1;
+	}
+
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		const double a = 2.0 * M_PI * v / vertexCount;
+		const double r = radius * (0.8 + 0.15 * sin(7.0 * a) + 0.05 * (rand() / (double) RAND_MAX));
+
+		vertices[v].lat = lat + r * sin(a);
+		vertices[v].lon = lon + r * cos(a) / cos(lat * M_PI / 180.0);
+	}
+
+	const int rc = Zones_add(group, name, ZONE_ACTION_STOP, vertices, vertexCount);
+	free(vertices);
+
+	if (rc != 0)
+	{
+		ERRLOG1("Failed to add zone %s!", name);
+	}
+
+	return rc;
+}
+
+static int runFleetTiles()
+{
+	const unsigned int BOAT_COUNT = 100000;
+	const unsigned int ITERATIONS = 20;
+	const unsigned int REQUESTS = 100000;
+
+	PERF_CLOCK_INIT();
+
+	FleetTileBoat* boats = malloc(BOAT_COUNT * sizeof(FleetTileBoat));
+	if (!boats)
+	{
+		ERRLOG("Alloc failed for fleet tile boats!");
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		boats[i].id = i + 1;
+		boats[i].lat = getRandomLat();
+		boats[i].lon = getRandomLon();
+	}
+
+	PERF_CLOCK_RESET();
+	if (0 != FleetTiles_build(boats, BOAT_COUNT))
+	{
+		ERRLOG("Failed to build fleet tiles!");
+		free(boats);
+		return -1;
+	}
+	PERF_CLOCK_MEASURE();
+
+	printf("Fleet tiles initial build (boats=%u): %.3fms\n", BOAT_COUNT, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0);
+
+	// Incremental builds, with every boat moving (~10 m) and with only a tenth of them moving
+	for (unsigned int moving = BOAT_COUNT; moving >= BOAT_COUNT / 10; moving /= 10)
+	{
+		PERF_CLOCK_RESET();
+		for (unsigned int it = 0; it < ITERATIONS; it++)
+		{
+			for (unsigned int i = 0; i < moving; i++)
+			{
+				boats[i].lat += ((boats[i].lat < 0.0) ? 1.0 : -1.0) * 0.0001;
+			}
+
+			if (0 != FleetTiles_build(boats, BOAT_COUNT))
+			{
+				ERRLOG("Failed to build fleet tiles!");
+				free(boats);
+				return -1;
+			}
+		}
+		PERF_CLOCK_MEASURE();
+
+		printf("Fleet tiles incremental build (boats=%u, moving=%u): %.3fms\n", BOAT_COUNT, moving, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0 / ITERATIONS);
+	}
+
+	free(boats);
+
+	// Tile requests at random zoom levels, over tiles that are mostly non-empty
+	unsigned int lines = 0;
+
+	PERF_CLOCK_RESET();
+	for (unsigned int r = 0; r < REQUESTS; r++)
+	{
+		const int z = rand() % 8;
+		const int x = rand() % (1 << z);
+		const int y = rand() % (1 << z);
+
+		const char* resp = FleetTiles_getTileResponse(z, x, y);
+		if (!resp)
+		{
+			ERRLOG("Failed to get fleet tile response!");
+			return -1;
+		}
+
+		for (const char* c = resp; *c; c++)
+		{
+			lines += (*c == '\n');
+		}
+
+		FleetTiles_freeTileResponse(resp);
+	}
+	PERF_CLOCK_MEASURE();
+
+	printf("Fleet tile requests (requests=%u, avg sub-tiles=%.1f): %.3fus\n", REQUESTS, lines / (double) REQUESTS, ((double) PERF_CLOCK_NS_TAKEN) / 1000.0 / REQUESTS);
+
+	FleetTiles_build(0, 0);
+	return 0;
+}
+
+static int runGhosts()
+{
+	const unsigned int BOAT_COUNT = 10000;
+	const unsigned int TICKS = 100;
+	const unsigned int TRACK_POINTS = 8640;
+
+	PERF_CLOCK_INIT();
+
+	// A day-long recorded track at 10-second intervals, wandering around at about 3 m/s.
+	time_t* times = malloc(TRACK_POINTS * sizeof(time_t));
+	proteus_GeoPos* positions = malloc(TRACK_POINTS * sizeof(proteus_GeoPos));
+	Boat** boats = malloc(BOAT_COUNT * sizeof(Boat*));
+	if (!times || !positions || !boats)
+	{
+		ERRLOG("Alloc failed for ghost track!");
+		free(times);
+		free(positions);
+		free(boats);
+		return -1;
+	}
+
+	const time_t startTime = time(0);
+
+	double course = 0.0;
+	for (unsigned int i = 0; i < TRACK_POINTS; i++)
+	{
+		times[i] = startTime + i * 10;
+		if (i == 0)
+		{
+			positions[i].lat = 20.0;
+			positions[i].lon = -40.0;
+		}
+		else
+		{
+			course += (rand() / (double) RAND_MAX - 0.5) * 0.2;
+			positions[i].lat = positions[i - 1].lat + 0.00027 * cos(course);
+			positions[i].lon = positions[i - 1].lon + 0.00029 * sin(course);
+		}
+	}
+
+	GhostTrack* track = GhostTrack_new(times, positions, TRACK_POINTS);
+	free(times);
+	free(positions);
+	if (!track)
+	{
+		ERRLOG("Failed to encode ghost track!");
+		free(boats);
+		return -1;
+	}
+
+	double nsPerBoat[2];
+
+	for (int ghost = 0; ghost <= 1; ghost++)
+	{
+		for (unsigned int i = 0; i < BOAT_COUNT; i++)
+		{
+			boats[i] = Boat_new(getRandomLat() * 0.5, getRandomLon(), getRandomBoatType(), 0);
+			if (!boats[i])
+			{
+				ERRLOG("Alloc failed for ghost perf boat!");
+				return -1;
+			}
+
+			if (ghost)
+			{
+				// Spread the ghosts out along the track.
+				Boat_startGhost(boats[i], track, startTime - (i % TRACK_POINTS) * 8);
+			}
+			else
+			{
+				boats[i]->stop = false;
+				boats[i]->setImmediateDesiredCourse = false;
+				boats[i]->desiredCourse = getRandomCourse();
+				boats[i]->sailArea = 0.5;
+			}
+		}
+
+		PERF_CLOCK_RESET();
+		for (unsigned int t = 1; t <= TICKS; t++)
+		{
+			for (unsigned int i = 0; i < BOAT_COUNT; i++)
+			{
+				Boat_advance(boats[i], startTime + t);
+			}
+		}
+		PERF_CLOCK_MEASURE();
+
+		nsPerBoat[ghost] = ((double) PERF_CLOCK_NS_TAKEN) / TICKS / BOAT_COUNT;
+
+		for (unsigned int i = 0; i < BOAT_COUNT; i++)
+		{
+			Boat_free(boats[i]);
+		}
+	}
+
+	printf("Boat advance per tick, real boats (boats=%u): %.1fns/boat\n", BOAT_COUNT, nsPerBoat[0]);
+	printf("Boat advance per tick, ghost boats (boats=%u, track points=%u, encoded bytes/point=%.2f): %.1fns/boat (%.1fx cheaper)\n",
+			BOAT_COUNT,
+			GhostTrack_getPointCount(track),
+			((double) GhostTrack_getEncodedSize(track)) / GhostTrack_getPointCount(track),
+			nsPerBoat[1],
+			nsPerBoat[0] / nsPerBoat[1]);
+
+	GhostTrack_free(track);
+	free(boats);
+
+	return 0;
+}
+
+
+#define PERF_SIMCORE_BOATS_PER_THREAD (2000)
+#define PERF_SIMCORE_STEP_SECONDS (300)
+#define PERF_SIMCORE_MAX_THREADS (256)
+
+typedef struct
+{
+	const BoatEnv* env;
+	unsigned int randSeed;
+	int rc;
+} SimCoreThreadArg;
+
+// Steady wind, no current or waves, and water everywhere, for timing the boat physics alone
+static const BoatEnv _simCoreSyntheticEnv = {
+	.getOcean = &simCoreEnvGetOcean,
+	.getWind = &simCoreEnvGetWind,
+	.getWave = &simCoreEnvGetWave,
+	.isWater = &simCoreEnvIsWater,
+	.getMagDec = &simCoreEnvGetMagDec,
+	.ctx = 0
+};
+
+static int runSimCore()
+{
+	unsigned int maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (maxThreads < 1)
+	{
+		maxThreads = 1;
+	}
+	else if (maxThreads > PERF_SIMCORE_MAX_THREADS)
+	{
+		maxThreads = PERF_SIMCORE_MAX_THREADS;
+	}
+
+	PERF_CLOCK_INIT();
+
+	for (int live = 0; live < 2; live++)
+	{
+		for (unsigned int threadCount = 1; ; threadCount = maxThreads)
+		{
+			pthread_t threads[PERF_SIMCORE_MAX_THREADS];
+			SimCoreThreadArg args[PERF_SIMCORE_MAX_THREADS];
+
+			PERF_CLOCK_RESET();
+
+			for (unsigned int i = 0; i < threadCount; i++)
+			{
+				args[i].env = live ? Boat_getLiveEnv() : &_simCoreSyntheticEnv;
+				args[i].randSeed = i + 1;
+				args[i].rc = 0;
+
+				if (0 != pthread_create(threads + i, 0, &simCoreThreadMain, args + i))
+				{
+					ERRLOG("Failed to start perf SimCore thread!");
+					return -1;
+				}
+			}
+
+			int rc = 0;
+			for (unsigned int i = 0; i < threadCount; i++)
+			{
+				pthread_join(threads[i], 0);
+				rc |= args[i].rc;
+			}
+
+			PERF_CLOCK_MEASURE();
+
+			if (rc != 0)
+			{
+				ERRLOG("Failed to alloc perf SimCore boats!");
+				return -2;
+			}
+
+			const double boatSeconds = ((double) threadCount) * PERF_SIMCORE_BOATS_PER_THREAD * PERF_SIMCORE_STEP_SECONDS;
+			const double perSec = boatSeconds / (((double) PERF_CLOCK_NS_TAKEN) / 1000000000.0);
+
+			printf("SimCore boat-seconds per second (%s env, threads=%u, boats/thread=%u, dt=%u): %.2fM total, %.2fM per core\n",
+					live ? "live" : "synthetic",
+					threadCount,
+					PERF_SIMCORE_BOATS_PER_THREAD,
+					PERF_SIMCORE_STEP_SECONDS,
+					perSec / 1000000.0,
+					perSec / 1000000.0 / threadCount);
+
+			if (threadCount == maxThreads)
+			{
+				break;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void* simCoreThreadMain(void* arg)
+{
+	SimCoreThreadArg* a = arg;
+
+	Boat* boats = malloc(PERF_SIMCORE_BOATS_PER_THREAD * sizeof(Boat));
+	if (!boats)
+	{
+		a->rc = -1;
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < PERF_SIMCORE_BOATS_PER_THREAD; i++)
+	{
+		Boat_initState(boats + i,
+				(rand_r(&a->randSeed) % 120000) / 1000.0 - 60.0,
+				(rand_r(&a->randSeed) % 360000) / 1000.0 - 180.0,
+				(i % 2 == 0) ? (rand_r(&a->randSeed) % 12) : 1024 /* advanced */,
+				BOAT_FLAG_TAKES_DAMAGE | BOAT_FLAG_WAVE_SPEED_EFFECT);
+
+		boats[i].stop = false;
+		boats[i].desiredCourse = rand_r(&a->randSeed) % 360;
+		boats[i].sailArea = 0.5;
+	}
+
+	SimCore_step(boats, PERF_SIMCORE_BOATS_PER_THREAD, time(0), PERF_SIMCORE_STEP_SECONDS, a->env, &a->randSeed);
+
+	free(boats);
+
+	return 0;
+}
+
+static bool simCoreEnvGetOcean(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od)
+{
+	(void) ctx;
+	(void) pos;
+	(void) od;
+	return false;
+}
+
+static void simCoreEnvGetWind(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx)
+{
+	(void) ctx;
+	(void) adjustForCurrent;
+	(void) od;
+
+	memset(wx, 0, sizeof(proteus_Weather));
+	wx->wind.angle = 250.0 + pos->lat;
+	wx->wind.mag = 9.0;
+	wx->windGust = 12.0;
+}
+
+static bool simCoreEnvGetWave(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd)
+{
+	(void) ctx;
+	(void) pos;
+	(void) wd;
+	return false;
+}
+
+static bool simCoreEnvIsWater(void* ctx, const proteus_GeoPos* pos)
+{
+	(void) ctx;
+	(void) pos;
+	return true;
+}
+
+static double simCoreEnvGetMagDec(void* ctx, const proteus_GeoPos* pos, time_t t)
+{
+	(void) ctx;
+	(void) pos;
+	(void) t;
+	return 0.0;
+}
+
+#define PERF_ENSEMBLE_BOATS_PER_THREAD (4)
+#define PERF_ENSEMBLE_MEMBERS (32)
+#define PERF_ENSEMBLE_HORIZON (6 * 3600)
+#define PERF_ENSEMBLE_CAPPED_SHARE (0.25)
+
+typedef struct
+{
+	unsigned int boatCount;
+	double share;
+	unsigned int seed;
+	double cpuSeconds;
+	int rc;
+} EnsembleThreadArg;
+
+static int runEnsemble()
+{
+	unsigned int maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (maxThreads < 1)
+	{
+		maxThreads = 1;
+	}
+	else if (maxThreads > PERF_SIMCORE_MAX_THREADS)
+	{
+		maxThreads = PERF_SIMCORE_MAX_THREADS;
+	}
+
+	PERF_CLOCK_INIT();
+
+	// Uncapped on one thread and on all threads, and then capped on one thread (with half the boats)
+	for (int pass = 0; pass < 3; pass++)
+	{
+		const unsigned int threadCount = (pass == 1) ? maxThreads : 1;
+		const bool capped = (pass == 2);
+
+		if (pass == 1 && maxThreads == 1)
+		{
+			continue;
+		}
+
+		pthread_t threads[PERF_SIMCORE_MAX_THREADS];
+		EnsembleThreadArg args[PERF_SIMCORE_MAX_THREADS];
+
+		PERF_CLOCK_RESET();
+
+		for (unsigned int i = 0; i < threadCount; i++)
+		{
+			args[i].boatCount = capped ? PERF_ENSEMBLE_BOATS_PER_THREAD / 2 : PERF_ENSEMBLE_BOATS_PER_THREAD;
+			args[i].share = capped ? PERF_ENSEMBLE_CAPPED_SHARE : 1.0;
+			args[i].seed = i + 1;
+			args[i].cpuSeconds = 0.0;
+			args[i].rc = 0;
+
+			if (0 != pthread_create(threads + i, 0, &ensembleThreadMain, args + i))
+			{
+				ERRLOG("Failed to start perf ensemble thread!");
+				return -1;
+			}
+		}
+
+		int rc = 0;
+		double cpuSeconds = 0.0;
+		for (unsigned int i = 0; i < threadCount; i++)
+		{
+			pthread_join(threads[i], 0);
+			rc |= args[i].rc;
+			cpuSeconds += args[i].cpuSeconds;
+		}
+
+		PERF_CLOCK_MEASURE();
+
+		if (rc != 0)
+		{
+			ERRLOG("Failed to run perf ensemble!");
+			return -2;
+		}
+
+		const double wallSeconds = ((double) PERF_CLOCK_NS_TAKEN) / 1000000000.0;
+		const double members = ((double) threadCount) * args[0].boatCount * PERF_ENSEMBLE_MEMBERS;
+
+		if (capped)
+		{
+			printf("Ensemble members per second (capped at %.0f%% of one CPU, members=%u, horizon=%uh): %.1f, using %.1f%% CPU\n",
+					PERF_ENSEMBLE_CAPPED_SHARE * 100.0,
+					PERF_ENSEMBLE_MEMBERS,
+					PERF_ENSEMBLE_HORIZON / 3600,
+					members / wallSeconds,
+					cpuSeconds / wallSeconds * 100.0);
+		}
+		else
+		{
+			printf("Ensemble members per second (threads=%u, members=%u, horizon=%uh): %.1f total, %.1f per core (%.2fM member-seconds per second per core)\n",
+					threadCount,
+					PERF_ENSEMBLE_MEMBERS,
+					PERF_ENSEMBLE_HORIZON / 3600,
+					members / wallSeconds,
+					members / wallSeconds / threadCount,
+					members * PERF_ENSEMBLE_HORIZON / wallSeconds / threadCount / 1000000.0);
+		}
+	}
+
+	return 0;
+}
+
+static void* ensembleThreadMain(void* arg)
+{
+	EnsembleThreadArg* a = arg;
+
+	int32_t finishTimes[PERF_ENSEMBLE_MEMBERS];
+
+	EnsembleThrottle throttle;
+	Ensemble_initThrottle(&throttle, a->share);
+
+	struct timespec cpu0;
+	struct timespec cpu1;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu0);
+
+	for (unsigned int i = 0; i < a->boatCount; i++)
+	{
+		Boat boat;
+		Boat_initState(&boat,
+				(rand_r(&a->seed) % 120000) / 1000.0 - 60.0,
+				(rand_r(&a->seed) % 360000) / 1000.0 - 180.0,
+				(i % 2 == 0) ? (rand_r(&a->seed) % 12) : 1024 /* advanced */,
+				BOAT_FLAG_TAKES_DAMAGE | BOAT_FLAG_WAVE_SPEED_EFFECT);
+
+		boat.stop = false;
+		boat.sailArea = 0.5;
+
+		// Finish line out of reach, so that all members run the whole horizon
+		const proteus_GeoPos f1 = { .lat = 89.0, .lon = 0.0 };
+		const proteus_GeoPos f2 = { .lat = 89.0, .lon = 1.0 };
+
+		if (0 != Ensemble_runBoat(&boat, &f1, &f2, time(0), PERF_ENSEMBLE_HORIZON, &_simCoreSyntheticEnv, PERF_ENSEMBLE_MEMBERS,
+				a->seed, a->seed + i, (a->share < 1.0) ? &throttle : 0, finishTimes))
+		{
+			a->rc = -1;
+			return 0;
+		}
+	}
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu1);
+	a->cpuSeconds = (cpu1.tv_sec - cpu0.tv_sec) + (cpu1.tv_nsec - cpu0.tv_nsec) / 1000000000.0;
+
+	return 0;
+}
+
+#define PERF_PROFILER_PAIRS (5)
+#define PERF_PROFILER_STEPS_PER_RUN (3)
+
+static int runProfiler()
+{
+	const unsigned int HZS[] = { PROFILER_HZ_DEFAULT, PROFILER_HZ_MAX };
+
+	PERF_CLOCK_INIT();
+
+	// Warm up (so that the first run measured isn't slower for it)
+	SimCoreThreadArg warmArg = { &_simCoreSyntheticEnv, 1, 0 };
+	simCoreThreadMain(&warmArg);
+
+	for (unsigned int h = 0; h < sizeof(HZS) / sizeof(HZS[0]); h++)
+	{
+		// The same boat physics work with the profiler off and on (sampling all threads), alternating, with the fastest
+		// of each taken (to leave out noise from other load)
+		long minNs[2] = { LONG_MAX, LONG_MAX };
+		uint64_t samples = 0;
+		int lines = 0;
+
+		for (unsigned int r = 0; r < PERF_PROFILER_PAIRS * 2; r++)
+		{
+			const int on = r % 2;
+
+			if (on && 0 != Profiler_start(HZS[h]))
+			{
+				ERRLOG("Failed to start profiler!");
+				return -1;
+			}
+
+			SimCoreThreadArg arg = { &_simCoreSyntheticEnv, 1, 0 };
+
+			PERF_CLOCK_RESET();
+			for (unsigned int i = 0; i < PERF_PROFILER_STEPS_PER_RUN; i++)
+			{
+				simCoreThreadMain(&arg);
+			}
+			PERF_CLOCK_MEASURE();
+
+			if (arg.rc != 0)
+			{
+				ERRLOG("Failed to alloc perf profiler boats!");
+				return -2;
+			}
+
+			if (PERF_CLOCK_NS_TAKEN < minNs[on])
+			{
+				minNs[on] = PERF_CLOCK_NS_TAKEN;
+			}
+
+			if (on)
+			{
+				ProfilerStats stats;
+				Profiler_stop(&stats);
+				samples += stats.samples;
+
+				FILE* f = fopen("/dev/null", "w");
+				if (f)
+				{
+					lines = Profiler_dump(f);
+					fclose(f);
+				}
+			}
+		}
+
+		printf("Profiler at %u Hz: %.1fms off, %.1fms on (%+.2f%%), %.1f samples per run, %d distinct stacks\n",
+				HZS[h],
+				minNs[0] / 1000000.0,
+				minNs[1] / 1000000.0,
+				(minNs[1] - minNs[0]) * 100.0 / minNs[0],
+				((double) samples) / PERF_PROFILER_PAIRS,
+				lines);
+	}
+
+	return 0;
+}
+
+// Cold tier test: idle boats demoted to compact state, read as they are (as for boat data requests and logs), and
+// promoted back to full state, with the memory taken by each boat's state in either tier.
+static int runColdTier()
+{
+	const unsigned int BOAT_COUNT = 200000;
+
+	PERF_CLOCK_INIT();
+
+	char** names = malloc(BOAT_COUNT * sizeof(char*));
+	char* group = getRandomName(PERF_RANDOM_BOAT_NAME_LEN);
+	if (!names || !group)
+	{
+		ERRLOG("Failed to alloc perf boat names!");
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		names[i] = getRandomName(PERF_RANDOM_BOAT_NAME_LEN);
+
+		Boat* b = Boat_new(getRandomLat(), getRandomLon(), 0, 0);
+		if (!b || BoatRegistry_OK != BoatRegistry_add(b, names[i], group, 0))
+		{
+			ERRLOG("Failed to add perf boat!");
+			return -1;
+		}
+	}
+
+	unsigned int count;
+	BoatEntry** entries = BoatRegistry_getGroupEntries(group, &count);
+	if (!entries)
+	{
+		ERRLOG("Failed to get perf boat entries!");
+		return -1;
+	}
+
+	unsigned int demoted = 0;
+
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (BoatRegistry_demote(entries[i]))
+		{
+			demoted++;
+		}
+	}
+	PERF_CLOCK_MEASURE();
+	const long demoteNs = PERF_CLOCK_NS_TAKEN;
+
+	BoatRegistryTierStats ts;
+	BoatRegistry_getTierStats(&ts);
+
+	double latSum = 0.0;
+
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Boat scratch;
+		latSum += BoatRegistry_view(entries[i], &scratch)->pos.lat;
+	}
+	PERF_CLOCK_MEASURE();
+	const long viewNs = PERF_CLOCK_NS_TAKEN;
+
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (!BoatRegistry_promote(entries[i]))
+		{
+			ERRLOG("Failed to promote perf boat!");
+			return -1;
+		}
+	}
+	PERF_CLOCK_MEASURE();
+	const long promoteNs = PERF_CLOCK_NS_TAKEN;
+
+	printf("Cold tier (boats=%u, demoted=%u, cold=%lu, latSum=%.0f): boat state %zu bytes hot, %zu bytes cold (%.1fMB in cold slab chunks); demote %.1fns, read %.1fns, promote %.1fns per boat\n",
+			count,
+			demoted,
+			ts.coldCount,
+			latSum,
+			(size_t) SLAB_OBJ_SIZE(sizeof(Boat)),
+			sizeof(ColdBoat),
+			((double) ts.coldBytes) / 1000000.0,
+			((double) demoteNs) / count,
+			((double) viewNs) / count,
+			((double) promoteNs) / count);
+
+	BoatRegistry_freeGroupEntries(entries, count);
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		Boat_free(BoatRegistry_remove(names[i]));
+		free(names[i]);
+	}
+	free(names);
+	free(group);
+
+	return 0;
+}
+
+static int runBoatRestore()
+{
+	const unsigned int BOAT_COUNT = 200000;
+
+	char path[] = "/tmp/sailnavsim_perf_restore_XXXXXX";
+	const int fd = mkstemp(path);
+	FILE* f = (fd >= 0) ? fdopen(fd, "w") : 0;
+	if (!f)
+	{
+		ERRLOG("Failed to create perf boat init file!");
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		fprintf(f, "PerfRestore%u,%f,%f,0,0\n", i, getRandomLat(), getRandomLon());
+	}
+	fclose(f);
+
+	PERF_CLOCK_INIT();
+
+	// Blocking: all boats restored before the first tick
+	PERF_CLOCK_RESET();
+	if (0 != BoatInitParser_start(path, 0))
+	{
+		ERRLOG("Failed to start perf boat init!");
+		return -1;
+	}
+
+	BoatInitEntry* be;
+	while ((be = BoatInitParser_getNext()) != 0)
+	{
+		if (BoatRegistry_OK != BoatRegistry_add(be->boat, be->name, be->group, be->boatAltName))
+		{
+			ERRLOG("Failed to add perf boat!");
+			return -1;
+		}
+		BoatInitParser_freeEntry(be);
+	}
+	PERF_CLOCK_MEASURE();
+	const long blockingNs = PERF_CLOCK_NS_TAKEN;
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		char name[32];
+		sprintf(name, "PerfRestore%u", i);
+		Boat_free(BoatRegistry_remove(name));
+	}
+
+	// Background: boats published (as at the start of each tick) as they're restored, with the registry write-locked
+	// only while publishing.
+	struct timespec t0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if (0 != BoatRestore_start(path, 0, 0))
+	{
+		ERRLOG("Failed to start perf boat restore!");
+		return -1;
+	}
+
+	long firstNs = -1;
+	long maxPublishNs = 0;
+	unsigned int publishCalls = 0;
+
+	while (BoatRestore_isRestoring())
+	{
+		PERF_CLOCK_RESET();
+		BoatRegistry_wrlock();
+		const unsigned int n = BoatRestore_publish(BOAT_RESTORE_PUBLISH_MAX);
+		BoatRegistry_unlock();
+		PERF_CLOCK_MEASURE();
+
+		if (PERF_CLOCK_NS_TAKEN > maxPublishNs)
+		{
+			maxPublishNs = PERF_CLOCK_NS_TAKEN;
+		}
+		publishCalls++;
+
+		if (n > 0 && firstNs < 0)
+		{
+			struct timespec t;
+			clock_gettime(CLOCK_MONOTONIC, &t);
+			firstNs = (t.tv_sec - t0.tv_sec) * 1000000000L + (t.tv_nsec - t0.tv_nsec);
+		}
+
+		usleep(1000);
+	}
+
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	const long fullNs = (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
+
+	BoatRestoreStats stats;
+	BoatRestore_getStats(&stats);
+
+	printf("Boat restore (boats=%lu): blocking %.1fms until first tick; background first boats published after %.2fms, fully restored after %.1fms, over %u publishes (longest %.2fms)\n",
+			stats.published,
+			((double) blockingNs) / 1000000.0,
+			((double) firstNs) / 1000000.0,
+			((double) fullNs) / 1000000.0,
+			publishCalls,
+			((double) maxPublishNs) / 1000000.0);
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		char name[32];
+		sprintf(name, "PerfRestore%u", i);
+		Boat_free(BoatRegistry_remove(name));
+	}
+
+	unlink(path);
+
+	return 0;
+}
+
+typedef struct
+{
+	int sock;
+	uint8_t* data;
+	size_t len;
+	int rc;
+} HandoffRecvArg;
+
+static int runHandoff()
+{
+	const unsigned int BOAT_COUNT = 200000;
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		char name[32];
+		sprintf(name, "PerfHandoff%u", i);
+
+		Boat* b = Boat_new(getRandomLat(), getRandomLon(), getRandomBoatType(), 0);
+		if (!b || BoatRegistry_OK != BoatRegistry_add(b, name, 0, 0))
+		{
+			ERRLOG("Failed to add perf boat!");
+			return -1;
+		}
+	}
+
+	PERF_CLOCK_INIT();
+
+	// Old process: snapshot taken at the end of its last tick
+	HandoffBuf snapshot = { 0, 0, 0 };
+
+	PERF_CLOCK_RESET();
+	if (0 != Handoff_encodeSnapshot(0, &snapshot))
+	{
+		ERRLOG("Failed to encode perf handoff snapshot!");
+		return -1;
+	}
+	PERF_CLOCK_MEASURE();
+	const long encodeNs = PERF_CLOCK_NS_TAKEN;
+
+	// Handed over (along with listening fds, here a pipe's) over a Unix socket to the new process
+	int sv[2];
+	int pipeFds[2];
+	if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, sv) || 0 != pipe(pipeFds))
+	{
+		ERRLOG("Failed to create perf handoff socket pair!");
+		return -1;
+	}
+
+	HandoffRecvArg recvArg = { sv[1], 0, snapshot.len, -1 };
+	pthread_t recvThread;
+
+	PERF_CLOCK_RESET();
+	if (0 != pthread_create(&recvThread, 0, &handoffRecvThreadMain, &recvArg))
+	{
+		ERRLOG("Failed to start perf handoff receiver thread!");
+		return -1;
+	}
+
+	const uint64_t snapshotLen = snapshot.len;
+	int rc = Handoff_sendFds(sv[0], pipeFds, 2, &snapshotLen, sizeof(snapshotLen));
+	for (size_t done = 0; rc == 0 && done < snapshot.len; )
+	{
+		const ssize_t n = write(sv[0], snapshot.data + done, snapshot.len - done);
+		if (n <= 0)
+		{
+			rc = -1;
+			break;
+		}
+		done += n;
+	}
+
+	pthread_join(recvThread, 0);
+	PERF_CLOCK_MEASURE();
+	const long transferNs = PERF_CLOCK_NS_TAKEN;
+
+	if (rc != 0 || recvArg.rc != 0)
+	{
+		ERRLOG("Failed to transfer perf handoff snapshot!");
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		char name[32];
+		sprintf(name, "PerfHandoff%u", i);
+		Boat_free(BoatRegistry_remove(name));
+	}
+
+	// New process: boats added to its registry, before its first tick
+	HandoffState state;
+	memset(&state, 0, sizeof(HandoffState));
+
+	PERF_CLOCK_RESET();
+	if (0 != Handoff_applySnapshot(recvArg.data, recvArg.len, &state))
+	{
+		ERRLOG("Failed to apply perf handoff snapshot!");
+		return -1;
+	}
+	PERF_CLOCK_MEASURE();
+	const long applyNs = PERF_CLOCK_NS_TAKEN;
+
+	// Neither process accepts connections from the handover until the snapshot is applied (with the snapshot taken
+	// before the handover).
+	const long gapNs = transferNs + applyNs;
+
+	printf("Handoff (boats=%u, snapshot=%zu bytes): encode %.1fms, transfer %.1fms, apply %.1fms; %.1fms without accepting (%ld ticks skipped)\n",
+			state.boatCount,
+			snapshot.len,
+			((double) encodeNs) / 1000000.0,
+			((double) transferNs) / 1000000.0,
+			((double) applyNs) / 1000000.0,
+			((double) gapNs) / 1000000.0,
+			gapNs / 1000000000L);
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		char name[32];
+		sprintf(name, "PerfHandoff%u", i);
+		Boat_free(BoatRegistry_remove(name));
+	}
+
+	free(recvArg.data);
+	HandoffBuf_free(&snapshot);
+	close(pipeFds[0]);
+	close(pipeFds[1]);
+	close(sv[0]);
+	close(sv[1]);
+
+	return 0;
+}
+
+static void* handoffRecvThreadMain(void* arg)
+{
+	HandoffRecvArg* a = (HandoffRecvArg*) arg;
+
+	int fds[HANDOFF_FD_COUNT];
+	unsigned int fdCount = 0;
+	uint64_t len;
+	if (0 != Handoff_receiveFds(a->sock, fds, HANDOFF_FD_COUNT, &fdCount, &len, sizeof(len)) || len != a->len)
+	{
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < fdCount; i++)
+	{
+		close(fds[i]);
+	}
+
+	if (!(a->data = malloc(len)))
+	{
+		return 0;
+	}
+
+	for (size_t done = 0; done < len; )
+	{
+		const ssize_t n = read(a->sock, a->data + done, len - done);
+		if (n <= 0)
+		{
+			return 0;
+		}
+		done += n;
+	}
+
+	a->rc = 0;
+
+	return 0;
+}
+
+static int runCommandSchedule(Perf_CommandHandlerFunc commandHandler)
+{
+	const unsigned int COMMAND_COUNT = 100000;
+
+	PERF_CLOCK_INIT();
+
+	char s[128];
+	Command* cmd;
+
+	// Boats for the scheduled commands
+	for (unsigned int i = 0; i < COMMAND_COUNT; i++)
+	{
+		snprintf(s, sizeof(s), "PerfSched%u,add,%.3f,%.3f,0,0", i, getRandomLat(), getRandomLon());
+		if (!(cmd = Command_parse(s)))
+		{
+			ERRLOG("Failed to parse perf boat add command!");
+			return -1;
+		}
+
+		commandHandler(cmd, time(0));
+		Command_free(cmd);
+	}
+
+	// Bring the schedule up to the current time, then schedule everything for the same second.
+	const time_t execTime = time(0) + 10;
+	for (cmd = CommandSchedule_takeDue(execTime - 10); cmd; )
+	{
+		Command* next = cmd->next;
+		Command_free(cmd);
+		cmd = next;
+	}
+
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < COMMAND_COUNT; i++)
+	{
+		snprintf(s, sizeof(s), "@%ld,PerfSched%u,course,%d", (long) execTime, i, getRandomCourse());
+		if (!(cmd = Command_parse(s)) || 0 != CommandSchedule_add(cmd))
+		{
+			ERRLOG("Failed to schedule perf command!");
+			return -1;
+		}
+	}
+	PERF_CLOCK_MEASURE();
+
+	printf("Scheduled commands parsed and added (count=%u, same second): %.3fms\n", COMMAND_COUNT, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0);
+
+	// Nothing is due until the scheduled second.
+	PERF_CLOCK_RESET();
+	cmd = CommandSchedule_takeDue(execTime - 1);
+	PERF_CLOCK_MEASURE();
+
+	if (cmd)
+	{
+		ERRLOG("Scheduled perf command due early!");
+		return -1;
+	}
+
+	printf("Scheduled commands, 9 ticks until due (including any cascading within the wheel): %.3fms\n", ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0);
+
+	unsigned int applied = 0;
+
+	PERF_CLOCK_RESET();
+	cmd = CommandSchedule_takeDue(execTime);
+	while (cmd)
+	{
+		Command* next = cmd->next;
+
+		commandHandler(cmd, execTime);
+		Command_free(cmd);
+		applied++;
+
+		cmd = next;
+	}
+	PERF_CLOCK_MEASURE();
+
+	printf("Scheduled commands due in one tick, taken and applied (count=%u): %.3fms\n", applied, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0);
+
+	for (unsigned int i = 0; i < COMMAND_COUNT; i++)
+	{
+		snprintf(s, sizeof(s), "PerfSched%u,remove", i);
+		if ((cmd = Command_parse(s)))
+		{
+			commandHandler(cmd, time(0));
+			Command_free(cmd);
+		}
+	}
+
+	if (applied != COMMAND_COUNT)
+	{
+		ERRLOG2("Unexpected scheduled perf command count! (%u, expected %u)", applied, COMMAND_COUNT);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int runCommandJournal()
+{
+	const unsigned int TICKS = 20;
+	const unsigned int MAX_COMMANDS_PER_TICK = 10000;
+	const unsigned int COMMANDS_PER_TICK[] = { 1, 10, 100, 1000, 10000 };
+
+	PERF_CLOCK_INIT();
+
+	// In the working directory, to be on the same filesystem as the DB (and a real journal).
+	char dir[] = "./perf_journal_XXXXXX";
+	if (!mkdtemp(dir))
+	{
+		ERRLOG1("Failed to create perf journal directory! errno=%d", errno);
+		return -1;
+	}
+
+	if (0 != CommandJournal_init(dir, 0))
+	{
+		ERRLOG("Failed to init perf command journal!");
+		return -1;
+	}
+
+	Command* cmds = 0;
+	Command** cmdsArray = malloc(MAX_COMMANDS_PER_TICK * sizeof(Command*));
+	if (!cmdsArray)
+	{
+		ERRLOG("Failed to alloc perf journal commands!");
+		return -1;
+	}
+
+	char s[128];
+	for (unsigned int i = 0; i < MAX_COMMANDS_PER_TICK; i++)
+	{
+		snprintf(s, sizeof(s), "PerfJournal%u,course,%d", i, getRandomCourse());
+		if (!(cmdsArray[i] = Command_parse(s)))
+		{
+			ERRLOG("Failed to parse perf journal command!");
+			return -1;
+		}
+	}
+
+	time_t t = time(0);
+
+	for (size_t c = 0; c < (sizeof(COMMANDS_PER_TICK) / sizeof(unsigned int)); c++)
+	{
+		const unsigned int count = COMMANDS_PER_TICK[c];
+
+		// Link this tick's commands.
+		for (unsigned int i = 0; i < count; i++)
+		{
+			cmdsArray[i]->next = (i + 1 < count) ? cmdsArray[i + 1] : 0;
+		}
+		cmds = cmdsArray[0];
+
+		PERF_CLOCK_RESET();
+		for (unsigned int i = 0; i < TICKS; i++)
+		{
+			if (0 != CommandJournal_write(t++, cmds))
+			{
+				ERRLOG("Failed to write perf command journal!");
+				return -1;
+			}
+		}
+		PERF_CLOCK_MEASURE();
+
+		printf("Command journal group commit (commands per tick=%u): %.3fms per tick, %.3fus per command\n", count, ((double) PERF_CLOCK_NS_TAKEN) / 1000000.0 / TICKS, ((double) PERF_CLOCK_NS_TAKEN) / 1000.0 / TICKS / count);
+	}
+
+	// For comparison, syncing each command on its own
+	{
+		const unsigned int count = 100;
+
+		PERF_CLOCK_RESET();
+		for (unsigned int i = 0; i < count; i++)
+		{
+			cmdsArray[i]->next = 0;
+			if (0 != CommandJournal_write(t, cmdsArray[i]))
+			{
+				ERRLOG("Failed to write perf command journal!");
+				return -1;
+			}
+		}
+		PERF_CLOCK_MEASURE();
+
+		printf("Command journal without group commit (commands=%u): %.3fus per command\n", count, ((double) PERF_CLOCK_NS_TAKEN) / 1000.0 / count);
+	}
+
+	for (unsigned int i = 0; i < MAX_COMMANDS_PER_TICK; i++)
+	{
+		Command_free(cmdsArray[i]);
+	}
+	free(cmdsArray);
+
+	// Remove everything journaled here.
+	CommandJournal_startSegment(t + 1);
+	CommandJournal_checkpoint(t + 1);
+	CommandJournal_close();
+
+	if (0 != rmdir(dir))
+	{
+		ERRLOG1("Failed to remove perf journal directory! errno=%d", errno);
+	}
+
+	return 0;
+}
+
+
+// Command completion test: a stand-in main loop (at a tick interval scaled down from 1 second) applies commands sent by
+// client threads, which either poll for the result with "bd" requests (at an interval scaled down the same way), or wait
+// for it with a single "boatcmd_sync" request.
+#define PERF_ACK_TICK_US (100000)
+#define PERF_ACK_POLL_US (20000)
+#define PERF_ACK_CLIENTS (8)
+#define PERF_ACK_COMMANDS_PER_CLIENT (10)
+
+typedef struct
+{
+	unsigned int id;
+	bool sync;
+	unsigned int requests;
+	unsigned int applied;
+	long nsTotal;
+} PerfAckClient;
+
+typedef struct
+{
+	Perf_CommandHandlerFunc commandHandler;
+	atomic_bool stop;
+} PerfAckTicker;
+
+static int runCommandCompletion(Perf_CommandHandlerFunc commandHandler)
+{
+	for (int mode = 0; mode < 2; mode++)
+	{
+		const bool sync = (mode == 1);
+
+		PerfAckTicker ticker;
+		ticker.commandHandler = commandHandler;
+		atomic_init(&ticker.stop, false);
+
+		pthread_t tickThread;
+		if (0 != pthread_create(&tickThread, 0, &commandCompletionTickThreadMain, &ticker))
+		{
+			ERRLOG("Failed to start perf tick thread!");
+			return -1;
+		}
+
+		PerfAckClient clients[PERF_ACK_CLIENTS];
+		pthread_t clientThreads[PERF_ACK_CLIENTS];
+
+		for (unsigned int i = 0; i < PERF_ACK_CLIENTS; i++)
+		{
+			clients[i].id = i;
+			clients[i].sync = sync;
+			clients[i].requests = 0;
+			clients[i].applied = 0;
+			clients[i].nsTotal = 0;
+
+			if (0 != pthread_create(clientThreads + i, 0, &commandCompletionClientThreadMain, clients + i))
+			{
+				ERRLOG("Failed to start perf client thread!");
+				return -1;
+			}
+		}
+
+		unsigned int requests = 0;
+		unsigned int applied = 0;
+		long nsTotal = 0;
+
+		for (unsigned int i = 0; i < PERF_ACK_CLIENTS; i++)
+		{
+			pthread_join(clientThreads[i], 0);
+			requests += clients[i].requests;
+			applied += clients[i].applied;
+			nsTotal += clients[i].nsTotal;
+		}
+
+		atomic_store(&ticker.stop, true);
+		pthread_join(tickThread, 0);
+
+		const unsigned int count = PERF_ACK_CLIENTS * PERF_ACK_COMMANDS_PER_CLIENT;
+		if (applied != count)
+		{
+			ERRLOG2("Unexpected applied perf command count! (%u, expected %u)", applied, count);
+			return -1;
+		}
+
+		printf("Command completion %s (tick=%dms, commands=%u): %.2f requests per command, %.1fms average until applied\n",
+				sync ? "with boatcmd_sync" : "by polling bd",
+				PERF_ACK_TICK_US / 1000,
+				count,
+				((double) requests) / count,
+				((double) nsTotal) / 1000000.0 / count);
+
+		for (unsigned int i = 0; i < PERF_ACK_CLIENTS; i++)
+		{
+			for (unsigned int j = 0; j < PERF_ACK_COMMANDS_PER_CLIENT; j++)
+			{
+				char s[128];
+				snprintf(s, sizeof(s), "PerfAck%u_%u,remove", i, j);
+
+				Command* cmd = Command_parse(s);
+				if (cmd)
+				{
+					commandHandler(cmd, time(0));
+					Command_free(cmd);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void* commandCompletionTickThreadMain(void* arg)
+{
+	PerfAckTicker* ticker = arg;
+	time_t tick = 0;
+
+	while (!atomic_load(&ticker->stop))
+	{
+		usleep(PERF_ACK_TICK_US);
+		tick++;
+
+		// Gather this tick's commands before applying any (as in the main loop), so that commands sent in response
+		// to a completion wait for the next tick.
+		Command* cmds = 0;
+		Command* cmdsLast = 0;
+		Command* cmd;
+		while ((cmd = Command_next()))
+		{
+			if (cmdsLast)
+			{
+				cmdsLast->next = cmd;
+			}
+			else
+			{
+				cmds = cmd;
+			}
+			cmdsLast = cmd;
+		}
+
+		if (BoatRegistry_OK != BoatRegistry_wrlock())
+		{
+			ERRLOG("Failed to write-lock BoatRegistry lock for perf commands!");
+		}
+
+		while (cmds)
+		{
+			cmd = cmds;
+			cmds = cmd->next;
+
+			const int result = ticker->commandHandler(cmd, tick);
+			Command_complete(cmd, result, tick);
+			Command_free(cmd);
+		}
+
+		if (BoatRegistry_OK != BoatRegistry_unlock())
+		{
+			ERRLOG("Failed to unlock BoatRegistry lock after perf commands!");
+		}
+	}
+
+	return 0;
+}
+
+static void* commandCompletionClientThreadMain(void* arg)
+{
+	PerfAckClient* client = arg;
+
+	int fds[2];
+	if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+	{
+		ERRLOG1("Failed to create perf client socket pair! errno=%d", errno);
+		return 0;
+	}
+
+	char reqStr[256];
+	char resp[256];
+
+	for (unsigned int i = 0; i < PERF_ACK_COMMANDS_PER_CLIENT; i++)
+	{
+		struct timespec t0;
+		struct timespec t1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+
+		if (client->sync)
+		{
+			snprintf(reqStr, sizeof(reqStr), "boatcmd_sync,#%u,PerfAck%u_%u,add,%.3f,%.3f,0,0", i, client->id, i, getRandomLat(), getRandomLon());
+			client->requests++;
+			if (0 != sendPerfRequest(fds[0], fds[1], reqStr, resp, sizeof(resp)) || strncmp(resp, "boatcmd_sync,ok,", 16) != 0)
+			{
+				continue;
+			}
+		}
+		else
+		{
+			snprintf(reqStr, sizeof(reqStr), "boatcmd,PerfAck%u_%u,add,%.3f,%.3f,0,0", client->id, i, getRandomLat(), getRandomLon());
+			client->requests++;
+			if (0 != sendPerfRequest(fds[0], fds[1], reqStr, resp, sizeof(resp)) || strncmp(resp, "boatcmd,ok", 10) != 0)
+			{
+				continue;
+			}
+
+			// Poll until the boat shows up.
+			do
+			{
+				usleep(PERF_ACK_POLL_US);
+				snprintf(reqStr, sizeof(reqStr), "bd,PerfAck%u_%u", client->id, i);
+				client->requests++;
+				if (0 != sendPerfRequest(fds[0], fds[1], reqStr, resp, sizeof(resp)))
+				{
+					break;
+				}
+			}
+			while (!strstr(resp, ",ok,"));
+
+			if (!strstr(resp, ",ok,"))
+			{
+				continue;
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		client->nsTotal += (t1.tv_nsec - t0.tv_nsec) + 1000000000L * (t1.tv_sec - t0.tv_sec);
+		client->applied++;
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+
+	return 0;
+}
+
+static int sendPerfRequest(int fd, int readFd, char* reqStr, char* resp, size_t respSize)
+{
+	if (NetServer_handleRequest(fd, reqStr) < 0)
+	{
+		return -1;
+	}
+
+	// Small single-line responses, so one read is enough.
+	const ssize_t n = read(readFd, resp, respSize - 1);
+	if (n <= 0)
+	{
+		return -1;
+	}
+
+	resp[n] = 0;
+	return 0;
+}
+
+
+// Boat allocation test: boats added with a group and alt name, then removed and replaced a tenth at a time.
+static int runBoatChurn()
+{
+	const unsigned int BOAT_COUNT = 200000;
+	const unsigned int CHURN_ROUNDS = 10;
+	const unsigned int CHURN_COUNT = BOAT_COUNT / 10;
+
+	PERF_CLOCK_INIT();
+
+	char** names = malloc(BOAT_COUNT * sizeof(char*));
+	char* group = getRandomName(3);
+	char* altName = getRandomName(PERF_RANDOM_BOAT_ALT_NAME_LEN);
+	if (!names || !group || !altName)
+	{
+		ERRLOG("Failed to alloc perf boat names!");
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		names[i] = getRandomName(PERF_RANDOM_BOAT_NAME_LEN);
+	}
+
+	const long rssBefore = getRssKb();
+
+	PERF_CLOCK_RESET();
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		Boat* b = Boat_new(getRandomLat(), getRandomLon(), 0, 0);
+		if (!b || BoatRegistry_OK != BoatRegistry_add(b, names[i], group, altName))
+		{
+			ERRLOG("Failed to add perf boat!");
+			return -1;
+		}
+	}
+	PERF_CLOCK_MEASURE();
+
+	SlabStats boatStats;
+	SlabStats entryStats;
+	Boat_getAllocStats(&boatStats);
+	BoatRegistry_getAllocStats(&entryStats);
+
+	printf("Boats allocated and added (count=%u): %.3fs, RSS +%ldkB, %u boat slab chunks (%lu boats), %u entry slab chunks (%lu entries)\n",
+			BOAT_COUNT,
+			((double) PERF_CLOCK_NS_TAKEN) / 1000000000.0,
+			getRssKb() - rssBefore,
+			boatStats.chunkCount,
+			boatStats.liveCount,
+			entryStats.chunkCount,
+			entryStats.liveCount);
+
+	PERF_CLOCK_RESET();
+	for (unsigned int r = 0; r < CHURN_ROUNDS; r++)
+	{
+		for (unsigned int j = 0; j < CHURN_COUNT; j++)
+		{
+			const unsigned int i = getRandInt(BOAT_COUNT - 1);
+
+			Boat_free(BoatRegistry_remove(names[i]));
+			free(names[i]);
+
+			names[i] = getRandomName(PERF_RANDOM_BOAT_NAME_LEN);
+			Boat* b = Boat_new(getRandomLat(), getRandomLon(), 0, 0);
+			if (!b || BoatRegistry_OK != BoatRegistry_add(b, names[i], group, altName))
+			{
+				ERRLOG("Failed to re-add perf boat!");
+				return -1;
+			}
+		}
+	}
+	PERF_CLOCK_MEASURE();
+
+	Boat_getAllocStats(&boatStats);
+	BoatRegistry_getAllocStats(&entryStats);
+
+	printf("Boats removed and re-added (count=%u): %.3fs, RSS +%ldkB, %u boat slab chunks, %u entry slab chunks\n",
+			CHURN_ROUNDS * CHURN_COUNT,
+			((double) PERF_CLOCK_NS_TAKEN) / 1000000000.0,
+			getRssKb() - rssBefore,
+			boatStats.chunkCount,
+			entryStats.chunkCount);
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		Boat_free(BoatRegistry_remove(names[i]));
+		free(names[i]);
+	}
+	free(names);
+	free(group);
+	free(altName);
+
+	return 0;
+}
+
+static long getRssKb()
+{
+	long pages = 0;
+
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f)
+	{
+		if (fscanf(f, "%*d %ld", &pages) != 1)
+		{
+			pages = 0;
+		}
+		fclose(f);
+	}
+
+	return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+// Tick jitter test: ticks advancing all boats (on this thread, with the tick thread's CPU affinity if set) while one
+// stand-in NetServer worker per CPU (with the net threads' CPU affinity if set) keeps busy with data lookups over a
+// buffer large enough to keep evicting caches.
+#define PERF_JITTER_BOAT_COUNT (20000)
+#define PERF_JITTER_TICKS (200)
+#define PERF_JITTER_MAX_LOAD_THREADS (64)
+#define PERF_JITTER_LOAD_BUF_SIZE (8 * 1024 * 1024)
+
+static atomic_bool _jitterStop;
+
+static int runTickJitter(Perf_CommandHandlerFunc commandHandler)
+{
+	unsigned int threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threadCount < 1)
+	{
+		threadCount = 1;
+	}
+	else if (threadCount > PERF_JITTER_MAX_LOAD_THREADS)
+	{
+		threadCount = PERF_JITTER_MAX_LOAD_THREADS;
+	}
+
+	for (unsigned int i = 0; i < PERF_JITTER_BOAT_COUNT; i++)
+	{
+		Perf_addAndStartRandomBoat(0, commandHandler);
+	}
+
+	atomic_init(&_jitterStop, false);
+
+	pthread_t threads[PERF_JITTER_MAX_LOAD_THREADS];
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		if (0 != pthread_create(threads + i, 0, &tickJitterLoadThreadMain, 0))
+		{
+			ERRLOG("Failed to start perf load thread!");
+			return -1;
+		}
+
+		// Named like NetServer workers, so counted with them in the scheduler stats.
+		char threadName[16];
+		snprintf(threadName, sizeof(threadName), "NSWorkerPerf%u", i);
+		pthread_setname_np(threads[i], threadName);
+		Affinity_applyToThread(threads[i], AFFINITY_ROLE_NET);
+	}
+
+	// Let the load get going.
+	usleep(100000);
+
+	AffinitySchedStats before[AFFINITY_STATS_ROLE_COUNT];
+	AffinitySchedStats after[AFFINITY_STATS_ROLE_COUNT];
+	Affinity_getSchedStats(before);
+
+	long ns[PERF_JITTER_TICKS];
+	const time_t t = time(0);
+
+	PERF_CLOCK_INIT();
+
+	for (unsigned int tick = 0; tick < PERF_JITTER_TICKS; tick++)
+	{
+		PERF_CLOCK_RESET();
+
+		unsigned int boatCount;
+		void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
+		BoatEntry* e;
+		while ((e = sailnavsim_boatregistry_boats_iterator_get_next(iterator)) != 0)
+		{
+			Boat_advance(e->boat, t + tick);
+		}
+		sailnavsim_boatregistry_free_boats_iterator(iterator);
+
+		PERF_CLOCK_MEASURE();
+		ns[tick] = PERF_CLOCK_NS_TAKEN;
+	}
+
+	Affinity_getSchedStats(after);
+
+	atomic_store(&_jitterStop, true);
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		pthread_join(threads[i], 0);
+	}
+
+	double sum = 0.0;
+	double sumSq = 0.0;
+	for (unsigned int i = 0; i < PERF_JITTER_TICKS; i++)
+	{
+		sum += ns[i];
+		sumSq += ((double) ns[i]) * ns[i];
+	}
+
+	const double mean = sum / PERF_JITTER_TICKS;
+	const double stddev = sqrt(fmax(0.0, sumSq / PERF_JITTER_TICKS - mean * mean));
+
+	qsort(ns, PERF_JITTER_TICKS, sizeof(long), &compareLong);
+
+	printf("Tick jitter (boats=%u, load threads=%u, tick %s, net %s): mean %.3fms, stddev %.3fms, p50 %.3fms, p99 %.3fms, max %.3fms\n",
+			PERF_JITTER_BOAT_COUNT,
+			threadCount,
+			Affinity_isSet(AFFINITY_ROLE_TICK) ? "pinned" : "unpinned",
+			Affinity_isSet(AFFINITY_ROLE_NET) ? "pinned" : "unpinned",
+			mean / 1000000.0,
+			stddev / 1000000.0,
+			ns[PERF_JITTER_TICKS / 2] / 1000000.0,
+			ns[PERF_JITTER_TICKS * 99 / 100] / 1000000.0,
+			ns[PERF_JITTER_TICKS - 1] / 1000000.0);
+
+	printf("Tick thread during jitter test: %lu migrations, %lu voluntary and %lu involuntary context switches\n",
+			after[AFFINITY_ROLE_TICK].migrations - before[AFFINITY_ROLE_TICK].migrations,
+			after[AFFINITY_ROLE_TICK].voluntarySwitches - before[AFFINITY_ROLE_TICK].voluntarySwitches,
+			after[AFFINITY_ROLE_TICK].involuntarySwitches - before[AFFINITY_ROLE_TICK].involuntarySwitches);
+
+	return runRemoveAllBoats(false);
+}
+
+static void* tickJitterLoadThreadMain(void* arg)
+{
+	(void) arg;
+
+	char* buf = malloc(PERF_JITTER_LOAD_BUF_SIZE);
+	if (!buf)
+	{
+		ERRLOG("Failed to alloc perf load buffer!");
+		return 0;
+	}
+	memset(buf, 0, PERF_JITTER_LOAD_BUF_SIZE);
+
+	unsigned int seed = (unsigned int) (uintptr_t) buf;
+	unsigned long x = 0;
+	size_t off = 0;
+
+	while (!atomic_load(&_jitterStop))
+	{
+		proteus_GeoPos pos = {
+			.lat = (rand_r(&seed) % 180000) / 1000.0 - 90.0,
+			.lon = (rand_r(&seed) % 360000) / 1000.0 - 180.0
+		};
+		proteus_Weather wx;
+		proteus_Weather_get(&pos, &wx, false);
+
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			buf[off] += (char) x++;
+			off = (off + 4096 + 64) % PERF_JITTER_LOAD_BUF_SIZE;
+		}
+	}
+
+	free(buf);
+	return 0;
+}
+
+static int compareLong(const void* a, const void* b)
+{
+	const long la = *((const long*) a);
+	const long lb = *((const long*) b);
+	return (la > lb) - (la < lb);
+}
+
+
+#define PERF_COUNTERS_INCREMENTS (2000000)
+#define PERF_COUNTERS_REQUESTS (20000)
+#define PERF_COUNTERS_MAX_THREADS (64)
+
+static _Atomic uint64_t _sharedCounter;
+static Counters _perfCounters = COUNTERS_INITIALIZER(1);
+static int _countersWriteFd;
+
+static int runCounters(int netServerWriteFd)
+{
+	const unsigned int THREAD_COUNTS[] = { 1, 8, 32, 64 };
+
+	_countersWriteFd = netServerWriteFd;
+
+	PERF_CLOCK_INIT();
+
+	for (size_t c = 0; c < (sizeof(THREAD_COUNTS) / sizeof(unsigned int)); c++)
+	{
+		const unsigned int threadCount = THREAD_COUNTS[c];
+		pthread_t threads[PERF_COUNTERS_MAX_THREADS];
+
+		// One atomic counter incremented by all threads, against per-thread copies, and whole requests
+		for (int mode = 0; mode < 3; mode++)
+		{
+			PERF_CLOCK_RESET();
+
+			for (unsigned int i = 0; i < threadCount; i++)
+			{
+				if (0 != pthread_create(threads + i, 0, &countersThreadMain, (void*) (intptr_t) mode))
+				{
+					ERRLOG("Failed to start perf counters thread!");
+					return -1;
+				}
+			}
+			for (unsigned int i = 0; i < threadCount; i++)
+			{
+				pthread_join(threads[i], 0);
+			}
+
+			PERF_CLOCK_MEASURE();
+
+			const unsigned int ITERATIONS = threadCount * ((mode == 2) ? PERF_COUNTERS_REQUESTS : PERF_COUNTERS_INCREMENTS);
+
+			if (mode == 0)
+			{
+				printf("Shared atomic counter increments per second (threads=%u): %.1fk\n", threadCount, PERF_CLOCK_KIPS);
+			}
+			else if (mode == 1)
+			{
+				printf("Per-thread counter increments per second (threads=%u): %.1fk\n", threadCount, PERF_CLOCK_KIPS);
+			}
+			else
+			{
+				printf("NetServer \"get wind\" requests per second (threads=%u): %.1fk\n", threadCount, PERF_CLOCK_KIPS);
+			}
+		}
+	}
+
+	if (Counters_get(&_perfCounters, 0) != atomic_load(&_sharedCounter))
+	{
+		ERRLOG("Per-thread counters total doesn't match shared counter!");
+		return -2;
+	}
+
+	return 0;
+}
+
+static void* countersThreadMain(void* arg)
+{
+	const int mode = (int) (intptr_t) arg;
+
+	if (mode == 0)
+	{
+		for (unsigned int i = 0; i < PERF_COUNTERS_INCREMENTS; i++)
+		{
+			atomic_fetch_add_explicit(&_sharedCounter, 1, memory_order_relaxed);
+		}
+	}
+	else if (mode == 1)
+	{
+		CountersSlot* slot = Counters_newThreadSlot(&_perfCounters);
+		if (!slot)
+		{
+			return 0;
+		}
+
+		for (unsigned int i = 0; i < PERF_COUNTERS_INCREMENTS; i++)
+		{
+			Counters_inc(slot, 0);
+		}
+
+		Counters_releaseThreadSlot(&_perfCounters, slot);
+	}
+	else
+	{
+		unsigned int seed = (unsigned int) (uintptr_t) &mode;
+
+		for (unsigned int i = 0; i < PERF_COUNTERS_REQUESTS; i++)
+		{
+			char reqStr[64];
+			snprintf(reqStr, sizeof(reqStr), "wind,%f,%f",
+					(rand_r(&seed) % 180000) / 1000.0 - 90.0,
+					(rand_r(&seed) % 360000) / 1000.0 - 180.0);
+			NetServer_handleRequest(_countersWriteFd, reqStr);
+		}
+	}
+
+	return 0;
+}
+
+
+#define PERF_POOL_SOCK_PATH_FMT "/tmp/sailnavsim_perf_%d.sock"
+#define PERF_POOL_CLIENTS (48)
+#define PERF_POOL_BURSTS (20)
+#define PERF_POOL_BURST_GAP_US (300000)
+#define PERF_POOL_IDLE_RETIRE_MS (500)
+
+// Every fourth client holds its connection open for a while before sending its request (like a slow client).
+#define PERF_POOL_SLOW_CLIENT_EVERY (4)
+#define PERF_POOL_SLOW_CLIENT_HOLD_US (50000)
+
+static char _poolSockPath[64];
+static bool _poolNetServerStarted = false;
+static pthread_barrier_t _poolBurstBarrier;
+
+// Per client, a latency per burst (or -1 if its request failed)
+static long* _poolLatencies;
+
+// Bursts of clients connecting all at once, for fixed size worker pools compared with one that grows and shrinks.
+static int runNetServerWorkerPool()
+{
+	snprintf(_poolSockPath, sizeof(_poolSockPath), PERF_POOL_SOCK_PATH_FMT, getpid());
+
+	if (NetServer_init(0, 0, _poolSockPath, 4) != 0)
+	{
+		printf("NetServer worker pool test skipped (net server already running or couldn't listen)\n");
+		return 0;
+	}
+
+	// Pool sizes (min, max) to compare
+	const unsigned int POOLS[][2] = { { 4, 4 }, { 4, 64 }, { 64, 64 } };
+
+	for (size_t p = 0; p < (sizeof(POOLS) / sizeof(POOLS[0])); p++)
+	{
+		const unsigned int minWorkers = POOLS[p][0];
+		const unsigned int maxWorkers = POOLS[p][1];
+
+		if (NetServer_setWorkerPoolLimits(minWorkers, maxWorkers, PERF_POOL_IDLE_RETIRE_MS) != 0)
+		{
+			return -1;
+		}
+
+		// Let any workers over the minimum from before retire.
+		usleep(PERF_POOL_IDLE_RETIRE_MS * 3 * 1000);
+
+		NetServerWorkerPoolStats before;
+		NetServer_getWorkerPoolStats(&before);
+
+		long* ns = _poolLatencies = malloc(PERF_POOL_CLIENTS * PERF_POOL_BURSTS * sizeof(long));
+		if (!ns)
+		{
+			ERRLOG("Failed to alloc perf latencies!");
+			return -1;
+		}
+
+		pthread_barrier_init(&_poolBurstBarrier, 0, PERF_POOL_CLIENTS + 1);
+
+		pthread_t threads[PERF_POOL_CLIENTS];
+		for (unsigned int i = 0; i < PERF_POOL_CLIENTS; i++)
+		{
+			if (0 != pthread_create(threads + i, 0, &workerPoolClientThreadMain, (void*) (intptr_t) i))
+			{
+				ERRLOG("Failed to start perf client thread!");
+				return -1;
+			}
+		}
+
+		unsigned int peakWorkers = 0;
+		for (unsigned int b = 0; b < PERF_POOL_BURSTS; b++)
+		{
+			pthread_barrier_wait(&_poolBurstBarrier);
+			usleep(PERF_POOL_BURST_GAP_US / 2);
+
+			NetServerWorkerPoolStats ps;
+			NetServer_getWorkerPoolStats(&ps);
+			if (ps.workers > peakWorkers)
+			{
+				peakWorkers = ps.workers;
+			}
+
+			usleep(PERF_POOL_BURST_GAP_US / 2);
+		}
+
+		for (unsigned int i = 0; i < PERF_POOL_CLIENTS; i++)
+		{
+			pthread_join(threads[i], 0);
+		}
+		pthread_barrier_destroy(&_poolBurstBarrier);
+
+		NetServerWorkerPoolStats after;
+		NetServer_getWorkerPoolStats(&after);
+
+		// Fast clients only (slow ones' latencies include their own hold time)
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < PERF_POOL_CLIENTS; i++)
+		{
+			if (i % PERF_POOL_SLOW_CLIENT_EVERY == 0)
+			{
+				continue;
+			}
+
+			for (unsigned int b = 0; b < PERF_POOL_BURSTS; b++)
+			{
+				if (ns[i * PERF_POOL_BURSTS + b] >= 0)
+				{
+					ns[count++] = ns[i * PERF_POOL_BURSTS + b];
+				}
+			}
+		}
+
+		if (count == 0)
+		{
+			ERRLOG("No successful perf requests!");
+			free(ns);
+			return -1;
+		}
+
+		qsort(ns, count, sizeof(long), &compareLong);
+
+		printf("NetServer bursts (clients=%u, pool %u-%u, peak workers %u, started %lu, retired %lu): request latency p50 %.3fms, p99 %.3fms, max %.3fms\n",
+				PERF_POOL_CLIENTS,
+				minWorkers,
+				maxWorkers,
+				peakWorkers,
+				after.started - before.started,
+				after.retired - before.retired,
+				ns[count / 2] / 1000000.0,
+				ns[count * 99 / 100] / 1000000.0,
+				ns[count - 1] / 1000000.0);
+
+		free(ns);
+	}
+
+	// Back to a small pool, to show the idle workers retiring.
+	NetServer_setWorkerPoolLimits(4, 64, PERF_POOL_IDLE_RETIRE_MS);
+	usleep(PERF_POOL_IDLE_RETIRE_MS * 3 * 1000);
+
+	NetServerWorkerPoolStats ps;
+	NetServer_getWorkerPoolStats(&ps);
+	printf("NetServer workers after idling: %u\n", ps.workers);
+
+	// Left listening, for the HTTP API test.
+	_poolNetServerStarted = true;
+
+	return 0;
+}
+
+static void* workerPoolClientThreadMain(void* arg)
+{
+	const unsigned int client = (unsigned int) (intptr_t) arg;
+	const bool slow = (client % PERF_POOL_SLOW_CLIENT_EVERY == 0);
+
+	long* ns = _poolLatencies + client * PERF_POOL_BURSTS;
+
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, _poolSockPath);
+
+	unsigned int seed = client;
+
+	for (unsigned int b = 0; b < PERF_POOL_BURSTS; b++)
+	{
+		pthread_barrier_wait(&_poolBurstBarrier);
+
+		ns[b] = -1;
+
+		struct timespec t0;
+		struct timespec t1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+
+		const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			continue;
+		}
+
+		if (connect(fd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)) != 0)
+		{
+			close(fd);
+			continue;
+		}
+
+		if (slow)
+		{
+			usleep(PERF_POOL_SLOW_CLIENT_HOLD_US);
+		}
+
+		char req[64];
+		const int len = snprintf(req, sizeof(req), "wind,%f,%f\n",
+				(rand_r(&seed) % 180000) / 1000.0 - 90.0,
+				(rand_r(&seed) % 360000) / 1000.0 - 180.0);
+
+		char resp[256];
+		ssize_t n = 0;
+		if (write(fd, req, len) == len)
+		{
+			// Read until the end of the one-line response.
+			ssize_t r;
+			while ((r = read(fd, resp + n, sizeof(resp) - 1 - n)) > 0)
+			{
+				n += r;
+				if (resp[n - 1] == '\n' || n == sizeof(resp) - 1)
+				{
+					break;
+				}
+			}
+		}
+
+		close(fd);
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		if (n > 0 && resp[n - 1] == '\n')
+		{
+			ns[b] = (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
+		}
+	}
+
+	return 0;
+}
+
+
+#define PERF_GROUP_BOAT_COUNT (10000)
+#define PERF_GROUP_NAME "PerfRace"
+
+// Group commands (each walking the group once) compared with the same command sent for each boat in the group.
+static int runGroupCommands(Perf_CommandHandlerFunc commandHandler)
+{
+	const char* ACTIONS[] = { "start", "course,135", "stop", "remove" };
+	const char* GROUP_ACTIONS[] = { "group_start", "group_course,135", "group_stop", "group_remove" };
+
+	PERF_CLOCK_INIT();
+
+	char cmdStr[128];
+
+	for (size_t a = 0; a < (sizeof(ACTIONS) / sizeof(ACTIONS[0])); a++)
+	{
+		long perBoatNs = 0;
+		long groupNs = 0;
+		long freeNs = 0;
+
+		// Per-boat commands, then the group command
+		for (int mode = 0; mode < 2; mode++)
+		{
+			if (a == 0 || (a == 3 && mode == 1))
+			{
+				if (0 != addPerfGroupBoats(commandHandler))
+				{
+					return -1;
+				}
+			}
+
+			PERF_CLOCK_RESET();
+
+			for (unsigned int i = 0; i < (mode == 0 ? PERF_GROUP_BOAT_COUNT : 1); i++)
+			{
+				if (mode == 0)
+				{
+					snprintf(cmdStr, sizeof(cmdStr), "PerfGroupBoat%u,%s", i, ACTIONS[a]);
+				}
+				else
+				{
+					snprintf(cmdStr, sizeof(cmdStr), "%s,%s", PERF_GROUP_NAME, GROUP_ACTIONS[a]);
+				}
+
+				Command* cmd = Command_parse(cmdStr);
+				if (!cmd)
+				{
+					ERRLOG1("Failed to parse perf command %s!", cmdStr);
+					return -1;
+				}
+
+				commandHandler(cmd, time(0));
+				Command_free(cmd);
+			}
+
+			PERF_CLOCK_MEASURE();
+
+			if (mode == 0)
+			{
+				perBoatNs = PERF_CLOCK_NS_TAKEN;
+			}
+			else
+			{
+				groupNs = PERF_CLOCK_NS_TAKEN;
+
+				// Freeing removed boats, outside the registry lock
+				PERF_CLOCK_RESET();
+				BoatRegistry_freeRemoved();
+				PERF_CLOCK_MEASURE();
+				freeNs = PERF_CLOCK_NS_TAKEN;
+			}
+		}
+
+		printf("Group \"%s\" (boats=%u): per-boat commands %.3fms, group command %.3fms (%.1fx)",
+				ACTIONS[a],
+				PERF_GROUP_BOAT_COUNT,
+				perBoatNs / 1000000.0,
+				groupNs / 1000000.0,
+				((double) perBoatNs) / groupNs);
+
+		if (a == 3)
+		{
+			printf(", then freeing after unlock %.3fms\n", freeNs / 1000000.0);
+		}
+		else
+		{
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
+
+static int addPerfGroupBoats(Perf_CommandHandlerFunc commandHandler)
+{
+	char cmdStr[128];
+
+	for (unsigned int i = 0; i < PERF_GROUP_BOAT_COUNT; i++)
+	{
+		snprintf(cmdStr, sizeof(cmdStr), "PerfGroupBoat%u,add_g,%f,%f,0,0,%s,Alt%u",
+				i, getRandomLat(), getRandomLon(), PERF_GROUP_NAME, i);
+
+		Command* cmd = Command_parse(cmdStr);
+		if (!cmd)
+		{
+			ERRLOG1("Failed to parse perf command %s!", cmdStr);
+			return -1;
+		}
+
+		commandHandler(cmd, time(0));
+		Command_free(cmd);
+	}
+
+	return 0;
+}
+
+
+#define PERF_HTTP_SOCK_PATH_FMT "/tmp/sailnavsim_perf_http_%d.sock"
+#define PERF_HTTP_REQUESTS (20000)
+#define PERF_HTTP_PIPELINE_DEPTH (16)
+#define PERF_HTTP_BOAT_NAME "PerfHttpBoat"
+
+// Boat data requests over HTTP (JSON, from the net server itself) compared with the text protocol behind a translation
+// proxy, as done for browser clients: one new text protocol connection per request, with the response reformatted as
+// JSON (the proxy's own HTTP handling, and the extra hop to it, are left out, so the proxy path is a best case).
+static int runHttpApi(Perf_CommandHandlerFunc commandHandler)
+{
+	if (!_poolNetServerStarted)
+	{
+		printf("NetServer HTTP API test skipped (net server not running)\n");
+		return 0;
+	}
+
+	char httpSockPath[64];
+	snprintf(httpSockPath, sizeof(httpSockPath), PERF_HTTP_SOCK_PATH_FMT, getpid());
+
+	if (NetServer_initHttp(0, 0, httpSockPath) != 0)
+	{
+		printf("NetServer HTTP API test skipped (couldn't listen)\n");
+		unlink(_poolSockPath);
+		return 0;
+	}
+
+	// Parsed in place
+	char addStr[] = PERF_HTTP_BOAT_NAME ",add,44.0,-63.0,0,0";
+
+	Command* cmd = Command_parse(addStr);
+	if (!cmd)
+	{
+		ERRLOG("Failed to parse perf HTTP boat add command!");
+		return -1;
+	}
+	commandHandler(cmd, time(0));
+	Command_free(cmd);
+
+	const char* MODES[] = { "text via proxy (connection per request)", "HTTP keep-alive", "HTTP pipelined" };
+
+	char req[PERF_HTTP_PIPELINE_DEPTH * 64];
+	char resp[1024];
+	char json[1024];
+
+	int httpFd = -1;
+
+	for (int mode = 0; mode < 3; mode++)
+	{
+		struct timespec t0, t1, c0, c1;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c0);
+
+		const unsigned int batch = (mode == 2) ? PERF_HTTP_PIPELINE_DEPTH : 1;
+
+		for (unsigned int i = 0; i < PERF_HTTP_REQUESTS; i += batch)
+		{
+			if (mode == 0)
+			{
+				const int fd = connectUnix(_poolSockPath);
+				if (fd < 0)
+				{
+					return -1;
+				}
+
+				const int len = snprintf(req, sizeof(req), "bd_nc,%s\n", PERF_HTTP_BOAT_NAME);
+				if (write(fd, req, len) != len)
+				{
+					close(fd);
+					return -1;
+				}
+				shutdown(fd, SHUT_WR);
+
+				ssize_t n = 0;
+				ssize_t r;
+				while ((r = read(fd, resp + n, sizeof(resp) - 1 - n)) > 0)
+				{
+					n += r;
+				}
+				resp[n] = 0;
+				close(fd);
+
+				// Reformatted as JSON, as by the proxy
+				char* t;
+				char* f[12];
+				int fc = 0;
+				for (char* v = strtok_r(resp, ",\n", &t); v && fc < 12; v = strtok_r(0, ",\n", &t))
+				{
+					f[fc++] = v;
+				}
+
+				if (fc != 11 || 0 != strcmp(f[2], "ok"))
+				{
+					ERRLOG("Unexpected perf boat data response!");
+					return -1;
+				}
+
+				snprintf(json, sizeof(json), "{\"type\":\"%s\",\"boat\":\"%s\",\"status\":\"%s\",\"lat\":%s,\"lon\":%s,\"angle\":%s,\"speed\":%s,\"groundAngle\":%s,\"groundSpeed\":%s,\"leewaySpeed\":%s,\"heelingAngle\":%s}",
+						f[0], f[1], f[2], f[3], f[4], f[5], f[6], f[7], f[8], f[9], f[10]);
+			}
+			else
+			{
+				if (httpFd < 0 && (httpFd = connectUnix(httpSockPath)) < 0)
+				{
+					return -1;
+				}
+
+				int len = 0;
+				for (unsigned int b = 0; b < batch; b++)
+				{
+					len += snprintf(req + len, sizeof(req) - len, "GET /bd_nc/%s HTTP/1.1\r\nHost: localhost\r\n\r\n", PERF_HTTP_BOAT_NAME);
+				}
+
+				if (write(httpFd, req, len) != len || readHttpResponses(httpFd, batch) != 0)
+				{
+					ERRLOG("Failed perf HTTP request!");
+					close(httpFd);
+					return -1;
+				}
+			}
+		}
+
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &c1);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		const double ns = (t1.tv_sec - t0.tv_sec) * 1000000000.0 + (t1.tv_nsec - t0.tv_nsec);
+		const double cpuNs = (c1.tv_sec - c0.tv_sec) * 1000000000.0 + (c1.tv_nsec - c0.tv_nsec);
+
+		printf("NetServer boat data, %s: %.1fk requests per second, %.1fus per request, %.1fus CPU (client and server) per request\n",
+				MODES[mode],
+				PERF_HTTP_REQUESTS / ns * 1000000.0,
+				ns / PERF_HTTP_REQUESTS / 1000.0,
+				cpuNs / PERF_HTTP_REQUESTS / 1000.0);
+	}
+
+	close(httpFd);
+
+	unlink(httpSockPath);
+	unlink(_poolSockPath);
+
+	return 0;
+}
+
+static int connectUnix(const char* path)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		ERRLOG1("Failed to open perf client socket! errno=%d", errno);
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)) != 0)
+	{
+		ERRLOG1("Failed to connect perf client socket! errno=%d", errno);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// Reads count whole (successful) HTTP responses.
+static int readHttpResponses(int fd, unsigned int count)
+{
+	char buf[8192];
+	size_t have = 0;
+
+	while (count > 0)
+	{
+		const char* end = memmem(buf, have, "\r\n\r\n", 4);
+		if (end)
+		{
+			const char* cl = strcasestr(buf, "Content-Length:");
+			if (0 != strncmp(buf, "HTTP/1.1 200 ", 13) || !cl || cl > end)
+			{
+				return -1;
+			}
+
+			const size_t total = (end - buf) + 4 + strtoul(cl + 15, 0, 10);
+			if (have >= total)
+			{
+				memmove(buf, buf + total, have - total);
+				have -= total;
+				buf[have] = 0;
+				count--;
+				continue;
+			}
+		}
+
+		if (have == sizeof(buf) - 1)
+		{
+			return -1;
+		}
+
+		const ssize_t r = read(fd, buf + have, sizeof(buf) - 1 - have);
+		if (r <= 0)
+		{
+			return -1;
+		}
+
+		have += r;
+		buf[have] = 0;
+	}
+
+	return 0;
+}
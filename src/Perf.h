@@ -17,10 +17,12 @@
 #ifndef _Perf_h_
 #define _Perf_h_
 
+#include <time.h>
+
 #include "Command.h"
 
 
-typedef void (*Perf_CommandHandlerFunc)(Command*);
+typedef int (*Perf_CommandHandlerFunc)(Command* cmd, time_t tick);
 
 void Perf_addAndStartRandomBoat(int groupNameLen, Perf_CommandHandlerFunc commandHandler);
 int Perf_runAdditional(Perf_CommandHandlerFunc commandHandler);
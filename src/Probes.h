@@ -0,0 +1,78 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Probes_h_
+#define _Probes_h_
+
+// USDT static probes (provider "sailnavsim") for use with bpftrace, perf, etc.
+//
+// Each probe site compiles down to a single nop instruction plus an ELF note
+// (in the .note.stapsdt section) describing it, so there is no cost unless a
+// tracer is actually attached. Probes use <sys/sdt.h> if available at build
+// time (e.g. from the systemtap-sdt-dev package), or otherwise the minimal
+// equivalent in sdt.h (on x86-64 and AArch64), and can be explicitly disabled
+// by defining SAILNAVSIM_NO_PROBES.
+//
+// Probes:
+//   tick_start(time, boatCount)
+//   tick_end(time, boatCount, cmdCount)
+//   advance_start(boatCount)
+//   advance_end(boatCount)
+//   command_applied(action, boatName)
+//   log_enqueue(logCount, sightCount)
+//   log_sink_done(logCount, sightCount)
+//   netserver_request_start(reqType)
+//   netserver_request_end(reqType, rc)
+//   registry_lock_wait_start(isWrite)
+//   registry_lock_acquired(isWrite)
+//
+// Example:
+//   bpftrace -e 'usdt:./sailnavsim:sailnavsim:tick_start { @t = nsecs; } usdt:./sailnavsim:sailnavsim:tick_end { @tick_us = hist((nsecs - @t) / 1000); }'
+
+#define PROBES_PROVIDER_NAME "sailnavsim"
+
+#ifndef SAILNAVSIM_NO_PROBES
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define PROBES_SYS_SDT
+#endif
+#endif
+#ifdef PROBES_SYS_SDT
+#include <sys/sdt.h>
+#define PROBES_ENABLED
+#else
+#include "sdt.h"
+#ifdef SDT_SUPPORTED
+#define PROBES_ENABLED
+#endif
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+
+#define PROBE1(name, a1) DTRACE_PROBE1(sailnavsim, name, a1)
+#define PROBE2(name, a1, a2) DTRACE_PROBE2(sailnavsim, name, a1, a2)
+#define PROBE3(name, a1, a2, a3) DTRACE_PROBE3(sailnavsim, name, a1, a2, a3)
+
+#else
+
+#define PROBE1(name, a1) do { (void)(a1); } while (0)
+#define PROBE2(name, a1, a2) do { (void)(a1); (void)(a2); } while (0)
+#define PROBE3(name, a1, a2, a3) do { (void)(a1); (void)(a2); (void)(a3); } while (0)
+
+#endif // PROBES_ENABLED
+
+#endif // _Probes_h_
@@ -0,0 +1,812 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "Profiler.h"
+
+#include "ErrLog.h"
+
+
+#define ERRLOG_ID "Profiler"
+
+// Frames of the signal handler itself (recordSample() and handleSigprof()) and the signal return trampoline at the top
+// of captured stacks, where the interrupted instruction address can't be found among them
+#define SIGNAL_FRAMES (3)
+
+// Table slots looked at for a stack before dropping the sample
+#define MAX_PROBES (16)
+
+#define LINE_MAX_LEN (PROFILER_MAX_DEPTH * 160 + 64)
+
+#if __ELF_NATIVE_CLASS == 64
+#define NATIVE_ELF_CLASS ELFCLASS64
+#else
+#define NATIVE_ELF_CLASS ELFCLASS32
+#endif
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+
+typedef struct
+{
+	uint64_t hash;
+	uint32_t count;
+	uint32_t depth;
+	void* pcs[PROFILER_MAX_DEPTH];
+} StackEntry;
+
+typedef struct
+{
+	pid_t tid;
+	char name[16];
+
+	timer_t timer;
+	bool hasTimer;
+
+	// Only written by the thread's own signal handler (while sampling)
+	StackEntry* stacks;
+	uint64_t samples;
+	uint64_t dropped;
+
+	// Set while the handler runs, so that stopping can wait for it to finish.
+	atomic_bool inHandler;
+} ThreadSlot;
+
+typedef struct
+{
+	uintptr_t addr;
+	size_t size;
+	const char* name;
+} Symbol;
+
+// Function symbols of the executable (from its ELF symbol table, so including static functions)
+typedef struct
+{
+	void* map;
+	size_t mapSize;
+
+	Symbol* syms;
+	size_t count;
+
+	// Load address of the executable (if position independent), and the range of addresses it's loaded at
+	uintptr_t bias;
+	uintptr_t start;
+	uintptr_t end;
+} SymbolTable;
+
+typedef struct
+{
+	char* line;
+	uint64_t count;
+} Line;
+
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static bool _running = false;
+static bool _handlerInstalled = false;
+static unsigned int _hz = 0;
+static struct timespec _startTime;
+static double _seconds = 0.0;
+
+static ThreadSlot _threads[PROFILER_MAX_THREADS];
+static unsigned int _threadCount = 0;
+static atomic_bool _active;
+
+
+static void handleSigprof(int sig, siginfo_t* si, void* uc);
+static void recordSample(ThreadSlot* t, const void* pc) __attribute__((noinline));
+static const void* getContextPc(const void* uc);
+
+static int findThreads();
+static void freeThreads();
+static void readThreadName(pid_t tid, char* name, size_t size);
+
+static int loadSymbols(SymbolTable* st);
+static void freeSymbols(SymbolTable* st);
+static int getExeRange(struct dl_phdr_info* info, size_t size, void* data);
+static int formatFrame(const SymbolTable* st, void* pc, char* buf, size_t bufSize);
+static int compareSymbols(const void* a, const void* b);
+static int compareLines(const void* a, const void* b);
+
+
+int Profiler_start(unsigned int hz)
+{
+	int rc = 0;
+
+	pthread_mutex_lock(&_lock);
+
+	if (_running || hz < PROFILER_HZ_MIN || hz > PROFILER_HZ_MAX)
+	{
+		rc = -1;
+		goto done;
+	}
+
+	// The first backtrace() call loads the unwinder (allocating memory), so get that done here rather than in a
+	// signal handler.
+	void* warm[4];
+	backtrace(warm, 4);
+
+	if (!_handlerInstalled)
+	{
+		// Left installed, since a signal from a just-deleted timer could still be pending (and SIGPROF would otherwise
+		// terminate the process).
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = &handleSigprof;
+		sa.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+
+		if (0 != sigaction(SIGPROF, &sa, 0))
+		{
+			ERRLOG1("Failed to install SIGPROF handler! errno=%d", errno);
+			rc = -2;
+			goto done;
+		}
+
+		_handlerInstalled = true;
+	}
+
+	freeThreads();
+
+	if (0 != findThreads())
+	{
+		freeThreads();
+		rc = -2;
+		goto done;
+	}
+
+	atomic_store(&_active, true);
+
+	const long intervalNs = 1000000000L / hz;
+	unsigned int timerCount = 0;
+
+	for (unsigned int i = 0; i < _threadCount; i++)
+	{
+		ThreadSlot* t = _threads + i;
+
+		struct sigevent sev;
+		memset(&sev, 0, sizeof(sev));
+		sev.sigev_notify = SIGEV_THREAD_ID;
+		sev.sigev_signo = SIGPROF;
+		sev.sigev_value.sival_int = i;
+		sev.sigev_notify_thread_id = t->tid;
+
+		// The thread's CPU time clock (as in the kernel's MAKE_THREAD_CPUCLOCK(tid, CPUCLOCK_SCHED))
+		const clockid_t clock = (~((clockid_t) t->tid) << 3) | 6;
+
+		if (0 != timer_create(clock, &sev, &t->timer))
+		{
+			// Such as for a thread that has exited since being found
+			continue;
+		}
+
+		const struct itimerspec its = {
+			.it_interval = { .tv_sec = intervalNs / 1000000000L, .tv_nsec = intervalNs % 1000000000L },
+			.it_value = { .tv_sec = intervalNs / 1000000000L, .tv_nsec = intervalNs % 1000000000L }
+		};
+
+		if (0 != timer_settime(t->timer, 0, &its, 0))
+		{
+			timer_delete(t->timer);
+			continue;
+		}
+
+		t->hasTimer = true;
+		timerCount++;
+	}
+
+	_hz = hz;
+	_running = true;
+	clock_gettime(CLOCK_MONOTONIC, &_startTime);
+
+	ERRLOG2("Profiler started: %u threads, %u Hz", timerCount, hz);
+
+done:
+	pthread_mutex_unlock(&_lock);
+	return rc;
+}
+
+int Profiler_stop(ProfilerStats* stats)
+{
+	pthread_mutex_lock(&_lock);
+
+	if (!_running)
+	{
+		pthread_mutex_unlock(&_lock);
+		return -1;
+	}
+
+	atomic_store(&_active, false);
+
+	for (unsigned int i = 0; i < _threadCount; i++)
+	{
+		if (_threads[i].hasTimer)
+		{
+			timer_delete(_threads[i].timer);
+			_threads[i].hasTimer = false;
+		}
+	}
+
+	// Wait for any handlers already past their check of _active.
+	for (unsigned int i = 0; i < _threadCount; i++)
+	{
+		while (atomic_load(&_threads[i].inHandler))
+		{
+			sched_yield();
+		}
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	_seconds = (now.tv_sec - _startTime.tv_sec) + (now.tv_nsec - _startTime.tv_nsec) / 1000000000.0;
+	_running = false;
+
+	ProfilerStats s = { _hz, _threadCount, 0, 0, _seconds };
+	for (unsigned int i = 0; i < _threadCount; i++)
+	{
+		s.samples += _threads[i].samples;
+		s.dropped += _threads[i].dropped;
+	}
+
+	pthread_mutex_unlock(&_lock);
+
+	ERRLOG4("Profiler stopped: %lu samples (%lu dropped) from %u threads in %.1fs", s.samples, s.dropped, s.threads, s.seconds);
+
+	if (stats)
+	{
+		*stats = s;
+	}
+
+	return 0;
+}
+
+bool Profiler_isRunning()
+{
+	pthread_mutex_lock(&_lock);
+	const bool running = _running;
+	pthread_mutex_unlock(&_lock);
+
+	return running;
+}
+
+int Profiler_dump(FILE* f)
+{
+	pthread_mutex_lock(&_lock);
+
+	if (_running)
+	{
+		pthread_mutex_unlock(&_lock);
+		return -1;
+	}
+
+	SymbolTable st;
+	if (0 != loadSymbols(&st))
+	{
+		// Still dumped, with addresses (and names from the dynamic symbol table) only
+		ERRLOG("Failed to load executable symbols!");
+	}
+
+	size_t lineCount = 0;
+	for (unsigned int i = 0; i < _threadCount; i++)
+	{
+		for (unsigned int j = 0; _threads[i].stacks && j < PROFILER_STACKS_PER_THREAD; j++)
+		{
+			lineCount += (_threads[i].stacks[j].count > 0);
+		}
+	}
+
+	Line* lines = malloc((lineCount + 1) * sizeof(Line));
+	char* buf = malloc(LINE_MAX_LEN);
+	int rc = 0;
+
+	if (!lines || !buf)
+	{
+		ERRLOG("dump: Alloc failed!");
+		rc = -1;
+		goto done;
+	}
+
+	size_t n = 0;
+
+	for (unsigned int i = 0; i < _threadCount && rc == 0; i++)
+	{
+		const ThreadSlot* t = _threads + i;
+
+		for (unsigned int j = 0; t->stacks && j < PROFILER_STACKS_PER_THREAD; j++)
+		{
+			const StackEntry* e = t->stacks + j;
+			if (e->count == 0)
+			{
+				continue;
+			}
+
+			// Outermost frame first
+			size_t pos = snprintf(buf, LINE_MAX_LEN, "%s", t->name);
+			for (int k = e->depth - 1; k >= 0 && pos < LINE_MAX_LEN - 1; k--)
+			{
+				buf[pos++] = ';';
+
+				// Return addresses (all but the interrupted frame's) point just past the call.
+				void* pc = (k == 0) ? e->pcs[k] : (void*) (((uintptr_t) e->pcs[k]) - 1);
+				pos += formatFrame(&st, pc, buf + pos, LINE_MAX_LEN - pos);
+			}
+			buf[pos < LINE_MAX_LEN ? pos : LINE_MAX_LEN - 1] = 0;
+
+			if (!(lines[n].line = strdup(buf)))
+			{
+				ERRLOG("dump: Alloc failed!");
+				rc = -1;
+				break;
+			}
+
+			lines[n].count = e->count;
+			n++;
+		}
+	}
+
+	// Identical stacks of threads with the same name together
+	qsort(lines, n, sizeof(Line), &compareLines);
+
+	for (size_t i = 0; i < n && rc >= 0; )
+	{
+		uint64_t count = lines[i].count;
+		size_t j = i + 1;
+		while (j < n && 0 == strcmp(lines[i].line, lines[j].line))
+		{
+			count += lines[j++].count;
+		}
+
+		if (fprintf(f, "%s %lu\n", lines[i].line, count) < 0)
+		{
+			rc = -1;
+			break;
+		}
+
+		rc++;
+		i = j;
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		free(lines[i].line);
+	}
+
+done:
+	free(lines);
+	free(buf);
+	freeSymbols(&st);
+
+	pthread_mutex_unlock(&_lock);
+	return rc;
+}
+
+
+static void handleSigprof(int sig, siginfo_t* si, void* uc)
+{
+	(void) sig;
+
+	const int savedErrno = errno;
+
+	const int i = si->si_value.sival_int;
+	if (si->si_code == SI_TIMER && atomic_load(&_active) && i >= 0 && i < (int) _threadCount)
+	{
+		ThreadSlot* t = _threads + i;
+
+		// Only ever on the slot's own thread (not, say, from a timer of an earlier run delivered late)
+		if (t->tid == (pid_t) syscall(SYS_gettid))
+		{
+			atomic_store(&t->inHandler, true);
+			if (atomic_load(&_active))
+			{
+				recordSample(t, getContextPc(uc));
+			}
+			atomic_store(&t->inHandler, false);
+		}
+	}
+
+	errno = savedErrno;
+}
+
+// Async-signal-safe (with the unwinder loaded beforehand): no locks or allocation, and only this thread's table written.
+static void recordSample(ThreadSlot* t, const void* pc)
+{
+	void* pcs[PROFILER_MAX_DEPTH + SIGNAL_FRAMES];
+	const int n = backtrace(pcs, PROFILER_MAX_DEPTH + SIGNAL_FRAMES);
+
+	t->samples++;
+
+	// Stack from the interrupted instruction on
+	int skip = SIGNAL_FRAMES;
+	for (int k = 0; pc && k < n && k <= SIGNAL_FRAMES + 1; k++)
+	{
+		if (pcs[k] == pc)
+		{
+			skip = k;
+			break;
+		}
+	}
+
+	if (n <= skip)
+	{
+		t->dropped++;
+		return;
+	}
+
+	void** stack = pcs + skip;
+	const uint32_t depth = n - skip;
+
+	// FNV-1a over the frame addresses
+	uint64_t hash = 14695981039346656037UL;
+	for (uint32_t k = 0; k < depth; k++)
+	{
+		hash = (hash ^ (uintptr_t) stack[k]) * 1099511628211UL;
+	}
+
+	for (unsigned int p = 0; p < MAX_PROBES; p++)
+	{
+		StackEntry* e = t->stacks + ((hash + p) & (PROFILER_STACKS_PER_THREAD - 1));
+
+		if (e->count == 0)
+		{
+			e->hash = hash;
+			e->depth = depth;
+			memcpy(e->pcs, stack, depth * sizeof(void*));
+			e->count = 1;
+			return;
+		}
+		else if (e->hash == hash && e->depth == depth && 0 == memcmp(e->pcs, stack, depth * sizeof(void*)))
+		{
+			e->count++;
+			return;
+		}
+	}
+
+	t->dropped++;
+}
+
+static const void* getContextPc(const void* uc)
+{
+	const ucontext_t* ctx = uc;
+
+#if defined(__x86_64__)
+	return (const void*) ctx->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+	return (const void*) ctx->uc_mcontext.pc;
+#else
+	(void) ctx;
+	return 0;
+#endif
+}
+
+static int findThreads()
+{
+	DIR* d = opendir("/proc/self/task");
+	if (!d)
+	{
+		ERRLOG("Failed to open /proc/self/task!");
+		return -1;
+	}
+
+	struct dirent* de;
+	while ((de = readdir(d)) && _threadCount < PROFILER_MAX_THREADS)
+	{
+		if (de->d_name[0] < '0' || de->d_name[0] > '9')
+		{
+			continue;
+		}
+
+		ThreadSlot* t = _threads + _threadCount;
+		memset(t, 0, sizeof(ThreadSlot));
+		atomic_init(&t->inHandler, false);
+
+		t->tid = atoi(de->d_name);
+		readThreadName(t->tid, t->name, sizeof(t->name));
+
+		if (!(t->stacks = calloc(PROFILER_STACKS_PER_THREAD, sizeof(StackEntry))))
+		{
+			ERRLOG("Failed to alloc profiler stack table!");
+			closedir(d);
+			return -1;
+		}
+
+		_threadCount++;
+	}
+
+	closedir(d);
+	return 0;
+}
+
+static void freeThreads()
+{
+	for (unsigned int i = 0; i < _threadCount; i++)
+	{
+		free(_threads[i].stacks);
+		_threads[i].stacks = 0;
+	}
+
+	_threadCount = 0;
+}
+
+static void readThreadName(pid_t tid, char* name, size_t size)
+{
+	if (tid == getpid())
+	{
+		// Main thread runs the ticks.
+		snprintf(name, size, "tick");
+		return;
+	}
+
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+
+	name[0] = 0;
+	FILE* f = fopen(path, "r");
+	if (f)
+	{
+		if (!fgets(name, size, f))
+		{
+			name[0] = 0;
+		}
+		fclose(f);
+	}
+
+	// Without the trailing newline, or any number suffix (such as of NetServer workers)
+	size_t len = strlen(name);
+	while (len > 0 && ((name[len - 1] >= '0' && name[len - 1] <= '9') || name[len - 1] == '\n'))
+	{
+		len--;
+	}
+	name[len] = 0;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		if (name[i] == ' ' || name[i] == ';')
+		{
+			name[i] = '_';
+		}
+	}
+
+	if (len == 0)
+	{
+		snprintf(name, size, "thread");
+	}
+}
+
+static int loadSymbols(SymbolTable* st)
+{
+	memset(st, 0, sizeof(SymbolTable));
+
+	int fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	struct stat sb;
+	if (0 != fstat(fd, &sb) || (size_t) sb.st_size < sizeof(ElfW(Ehdr)))
+	{
+		close(fd);
+		return -1;
+	}
+
+	void* map = mmap(0, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+	{
+		return -1;
+	}
+
+	st->map = map;
+	st->mapSize = sb.st_size;
+
+	const ElfW(Ehdr)* eh = map;
+	if (0 != memcmp(eh->e_ident, ELFMAG, SELFMAG) || eh->e_ident[EI_CLASS] != NATIVE_ELF_CLASS ||
+			eh->e_shoff == 0 || eh->e_shoff + eh->e_shnum * sizeof(ElfW(Shdr)) > st->mapSize)
+	{
+		return -1;
+	}
+
+	const ElfW(Shdr)* sh = (const ElfW(Shdr)*) (((const char*) map) + eh->e_shoff);
+
+	// The full symbol table (or just the dynamic one, if stripped)
+	const ElfW(Shdr)* symSh = 0;
+	for (unsigned int i = 0; i < eh->e_shnum; i++)
+	{
+		if (sh[i].sh_type == SHT_SYMTAB || (sh[i].sh_type == SHT_DYNSYM && !symSh))
+		{
+			symSh = sh + i;
+		}
+	}
+
+	if (!symSh || symSh->sh_link >= eh->e_shnum || symSh->sh_offset + symSh->sh_size > st->mapSize)
+	{
+		return -1;
+	}
+
+	const ElfW(Shdr)* strSh = sh + symSh->sh_link;
+	if (strSh->sh_offset + strSh->sh_size > st->mapSize)
+	{
+		return -1;
+	}
+
+	const ElfW(Sym)* syms = (const ElfW(Sym)*) (((const char*) map) + symSh->sh_offset);
+	const char* strs = ((const char*) map) + strSh->sh_offset;
+	const size_t symCount = symSh->sh_size / sizeof(ElfW(Sym));
+
+	if (!(st->syms = malloc((symCount + 1) * sizeof(Symbol))))
+	{
+		return -1;
+	}
+
+	for (size_t i = 0; i < symCount; i++)
+	{
+		// (Symbol types are the same for 32 and 64 bit ELF.)
+		if (ELF64_ST_TYPE(syms[i].st_info) == STT_FUNC && syms[i].st_value != 0 && syms[i].st_name < strSh->sh_size)
+		{
+			st->syms[st->count].addr = syms[i].st_value;
+			st->syms[st->count].size = syms[i].st_size;
+			st->syms[st->count].name = strs + syms[i].st_name;
+			st->count++;
+		}
+	}
+
+	qsort(st->syms, st->count, sizeof(Symbol), &compareSymbols);
+
+	dl_iterate_phdr(&getExeRange, st);
+
+	return 0;
+}
+
+static void freeSymbols(SymbolTable* st)
+{
+	free(st->syms);
+
+	if (st->map)
+	{
+		munmap(st->map, st->mapSize);
+	}
+
+	memset(st, 0, sizeof(SymbolTable));
+}
+
+static int getExeRange(struct dl_phdr_info* info, size_t size, void* data)
+{
+	(void) size;
+
+	SymbolTable* st = data;
+
+	// The executable itself comes first.
+	st->bias = info->dlpi_addr;
+	st->start = UINTPTR_MAX;
+	st->end = 0;
+
+	for (unsigned int i = 0; i < info->dlpi_phnum; i++)
+	{
+		const ElfW(Phdr)* ph = info->dlpi_phdr + i;
+		if (ph->p_type == PT_LOAD)
+		{
+			const uintptr_t s = info->dlpi_addr + ph->p_vaddr;
+			st->start = (s < st->start) ? s : st->start;
+			st->end = (s + ph->p_memsz > st->end) ? s + ph->p_memsz : st->end;
+		}
+	}
+
+	return 1;
+}
+
+static int formatFrame(const SymbolTable* st, void* pc, char* buf, size_t bufSize)
+{
+	const uintptr_t addr = ((uintptr_t) pc) - st->bias;
+	const char* name = 0;
+
+	// Last symbol at or before the address
+	size_t lo = 0;
+	size_t hi = st->count;
+	while (lo < hi)
+	{
+		const size_t mid = (lo + hi) / 2;
+		if (st->syms[mid].addr <= addr)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	const bool inExe = (((uintptr_t) pc) >= st->start && ((uintptr_t) pc) < st->end);
+	if (inExe && lo > 0 && (addr < st->syms[lo - 1].addr + st->syms[lo - 1].size || st->syms[lo - 1].size == 0))
+	{
+		name = st->syms[lo - 1].name;
+	}
+
+	int n;
+	Dl_info dli;
+
+	if (name)
+	{
+		n = snprintf(buf, bufSize, "%s", name);
+	}
+	else if (dladdr(pc, &dli) && dli.dli_sname)
+	{
+		n = snprintf(buf, bufSize, "%s", dli.dli_sname);
+	}
+	else if (dladdr(pc, &dli) && dli.dli_fname)
+	{
+		const char* base = strrchr(dli.dli_fname, '/');
+		n = snprintf(buf, bufSize, "[%s+0x%lx]", base ? base + 1 : dli.dli_fname, (unsigned long) (((uintptr_t) pc) - ((uintptr_t) dli.dli_fbase)));
+	}
+	else
+	{
+		n = snprintf(buf, bufSize, "[0x%lx]", (unsigned long) (uintptr_t) pc);
+	}
+
+	if (n < 0)
+	{
+		return 0;
+	}
+	else if ((size_t) n >= bufSize)
+	{
+		n = bufSize - 1;
+	}
+
+	// Separators can't be in frame names.
+	for (int i = 0; i < n; i++)
+	{
+		if (buf[i] == ' ' || buf[i] == ';')
+		{
+			buf[i] = '_';
+		}
+	}
+
+	return n;
+}
+
+static int compareSymbols(const void* a, const void* b)
+{
+	const uintptr_t x = ((const Symbol*) a)->addr;
+	const uintptr_t y = ((const Symbol*) b)->addr;
+
+	return (x > y) - (x < y);
+}
+
+static int compareLines(const void* a, const void* b)
+{
+	return strcmp(((const Line*) a)->line, ((const Line*) b)->line);
+}
@@ -0,0 +1,71 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Profiler_h_
+#define _Profiler_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+// In-process sampling profiler: a SIGPROF timer on each thread's CPU time clock (so that idle threads aren't sampled,
+// and the cost is bounded by the sampling rate per CPU second used), with the stacks captured in the signal handler and
+// counted in per-thread tables, and only symbolized when dumped (as collapsed stacks, one "thread;outer;...;inner count"
+// line per distinct stack, as taken by flamegraph tools).
+
+#define PROFILER_HZ_MIN		(1)
+#define PROFILER_HZ_MAX		(1000)
+#define PROFILER_HZ_DEFAULT	(99)
+
+// Threads sampled (those running when the profiler is started)
+#define PROFILER_MAX_THREADS	(256)
+
+// Frames kept per stack (innermost ones)
+#define PROFILER_MAX_DEPTH	(32)
+
+// Distinct stacks counted per thread (samples of any further ones are dropped)
+#define PROFILER_STACKS_PER_THREAD	(1024)
+
+
+typedef struct
+{
+	unsigned int hz;
+	unsigned int threads;
+
+	uint64_t samples;
+	uint64_t dropped;
+
+	double seconds;
+} ProfilerStats;
+
+
+// Starts sampling all threads of the process at hz samples per CPU second (discarding any previous profile).
+// Returns 0, -1 if already running or hz is out of range, or -2 on failure.
+int Profiler_start(unsigned int hz);
+
+// Stops sampling (keeping the profile for dumping). Returns 0, or -1 if not running.
+int Profiler_stop(ProfilerStats* stats);
+
+bool Profiler_isRunning();
+
+// Writes the last profile (once stopped) as collapsed stacks. Threads are labelled by name (with any number suffix
+// removed, so that pool threads are counted together), with the main thread as "tick". Returns the number of lines
+// written, or -1 on failure.
+int Profiler_dump(FILE* f);
+
+
+#endif // _Profiler_h_
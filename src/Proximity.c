@@ -0,0 +1,715 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sailnavsim_boatregistry.h>
+
+#include "Proximity.h"
+
+#include "BoatRegistry.h"
+#include "ErrLog.h"
+#include "Logger.h"
+#include "Shard.h"
+
+
+#define ERRLOG_ID "Proximity"
+
+#define EARTH_RADIUS (6371000.0)
+
+// Upper bound on pairs found per update, to bound memory use for pathological densities (e.g. a large radius at a crowded race start).
+#define PROXIMITY_MAX_PAIRS (4000000)
+
+// Nearest other boats listed per boat in request responses
+#define PROXIMITY_MAX_LISTED (100)
+
+#define NO_RUN (0xffffffff)
+
+
+typedef struct
+{
+	uint64_t group;
+	int32_t cx;
+	int32_t cy;
+	int32_t cz;
+	unsigned int idx;
+	double x;
+	double y;
+	double z;
+} CellPoint;
+
+typedef struct
+{
+	unsigned int start;
+	unsigned int end;
+} CellRun;
+
+typedef struct
+{
+	unsigned int from;
+	unsigned int to;
+	double distance;
+} DirectedPair;
+
+typedef struct
+{
+	char* name;
+	char* text;
+} BoatProximity;
+
+typedef struct
+{
+	BoatProximity* boats;
+	unsigned int count;
+} ProximitySnapshot;
+
+
+// Half of the 26 neighbouring cells (lexicographically "after" the cell itself), so that each pair of cells is visited once.
+static const int NEIGHBOUR_OFFSETS[13][3] = {
+	{ 0, 0, 1 },
+	{ 0, 1, -1 }, { 0, 1, 0 }, { 0, 1, 1 },
+	{ 1, -1, -1 }, { 1, -1, 0 }, { 1, -1, 1 },
+	{ 1, 0, -1 }, { 1, 0, 0 }, { 1, 0, 1 },
+	{ 1, 1, -1 }, { 1, 1, 0 }, { 1, 1, 1 }
+};
+
+
+static bool _enabled = false;
+static double _radius = 0.0;
+
+static pthread_rwlock_t _snapshotLock;
+static ProximitySnapshot _snapshot = { 0, 0 };
+
+static uint64_t* _prevPairKeys = 0;
+static unsigned int _prevPairKeyCount = 0;
+static bool _havePrevPairs = false;
+
+
+static int compareCellPoints(const void* a, const void* b);
+static int compareDirectedPairs(const void* a, const void* b);
+static int compareBoatProximity(const void* a, const void* b);
+static int compareU64(const void* a, const void* b);
+
+static uint64_t cellHash(uint64_t group, int32_t cx, int32_t cy, int32_t cz);
+static unsigned int findRun(const CellPoint* cps, const CellRun* runs, const unsigned int* table, uint64_t tableMask, uint64_t group, int32_t cx, int32_t cy, int32_t cz);
+static int addPair(ProximityPair** pairs, unsigned int* pairCount, unsigned int* pairCap, const CellPoint* p, const CellPoint* q, double chord2);
+
+static int buildSnapshot(const BoatEntry** entries, const ProximityPair* pairs, unsigned int pairCount, ProximitySnapshot* snapshot);
+static void freeSnapshot(ProximitySnapshot* snapshot);
+static void logNewPairEvents(time_t curTime, const BoatEntry** entries, const uint64_t* nameHashes, const ProximityPair* pairs, unsigned int pairCount);
+
+
+int Proximity_findPairs(const ProximityPoint* points, unsigned int count, double radius, ProximityPair** pairs, unsigned int* pairCount)
+{
+	*pairs = 0;
+	*pairCount = 0;
+
+	if (count < 2)
+	{
+		return 0;
+	}
+
+	// Points are placed on a sphere in 3D, so that the cells have no singularities at the poles or the antimeridian.
+	// The cell size is the chord length corresponding to the radius (arc length), so that any pair within the radius
+	// is in the same cell or in adjacent cells.
+	const double chord = 2.0 * EARTH_RADIUS * sin(fmin(radius, M_PI * EARTH_RADIUS) / (2.0 * EARTH_RADIUS));
+	const double chord2 = chord * chord;
+
+	CellPoint* cps = malloc(count * sizeof(CellPoint));
+	CellRun* runs = malloc(count * sizeof(CellRun));
+
+	uint64_t tableSize = 16;
+	while (tableSize < 2 * (uint64_t) count)
+	{
+		tableSize <<= 1;
+	}
+	const uint64_t tableMask = tableSize - 1;
+
+	unsigned int* table = malloc(tableSize * sizeof(unsigned int));
+
+	if (!cps || !runs || !table)
+	{
+		ERRLOG("findPairs: Alloc failed!");
+		free(cps);
+		free(runs);
+		free(table);
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const double lat = points[i].lat * M_PI / 180.0;
+		const double lon = points[i].lon * M_PI / 180.0;
+
+		CellPoint* cp = cps + i;
+
+		cp->group = points[i].groupKey;
+		cp->idx = i;
+		cp->x = EARTH_RADIUS * cos(lat) * cos(lon);
+		cp->y = EARTH_RADIUS * cos(lat) * sin(lon);
+		cp->z = EARTH_RADIUS * sin(lat);
+		cp->cx = (int32_t) floor(cp->x / chord);
+		cp->cy = (int32_t) floor(cp->y / chord);
+		cp->cz = (int32_t) floor(cp->z / chord);
+	}
+
+	// Sorting groups the points of each (group, cell) into a contiguous run.
+	qsort(cps, count, sizeof(CellPoint), &compareCellPoints);
+
+	unsigned int runCount = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (i == 0 || compareCellPoints(cps + i - 1, cps + i) != 0)
+		{
+			runs[runCount].start = i;
+			runCount++;
+		}
+
+		runs[runCount - 1].end = i + 1;
+	}
+
+	memset(table, 0xff, tableSize * sizeof(unsigned int));
+	for (unsigned int r = 0; r < runCount; r++)
+	{
+		const CellPoint* cp = cps + runs[r].start;
+		uint64_t slot = cellHash(cp->group, cp->cx, cp->cy, cp->cz) & tableMask;
+		while (table[slot] != NO_RUN)
+		{
+			slot = (slot + 1) & tableMask;
+		}
+		table[slot] = r;
+	}
+
+	unsigned int pairCap = 0;
+	int rc = 0;
+
+	for (unsigned int r = 0; r < runCount && rc == 0; r++)
+	{
+		const CellRun* run = runs + r;
+		const CellPoint* c = cps + run->start;
+
+		// Pairs within the cell itself
+		for (unsigned int i = run->start; i < run->end && rc == 0; i++)
+		{
+			for (unsigned int j = i + 1; j < run->end && rc == 0; j++)
+			{
+				rc = addPair(pairs, pairCount, &pairCap, cps + i, cps + j, chord2);
+			}
+		}
+
+		// Pairs with points in neighbouring cells
+		for (int n = 0; n < 13 && rc == 0; n++)
+		{
+			const unsigned int nr = findRun(cps, runs, table, tableMask, c->group, c->cx + NEIGHBOUR_OFFSETS[n][0], c->cy + NEIGHBOUR_OFFSETS[n][1], c->cz + NEIGHBOUR_OFFSETS[n][2]);
+			if (nr == NO_RUN)
+			{
+				continue;
+			}
+
+			for (unsigned int i = run->start; i < run->end && rc == 0; i++)
+			{
+				for (unsigned int j = runs[nr].start; j < runs[nr].end && rc == 0; j++)
+				{
+					rc = addPair(pairs, pairCount, &pairCap, cps + i, cps + j, chord2);
+				}
+			}
+		}
+	}
+
+	free(cps);
+	free(runs);
+	free(table);
+
+	if (rc > 0)
+	{
+		ERRLOG1("findPairs: Reached limit of %d pairs, so not all pairs were found!", PROXIMITY_MAX_PAIRS);
+		rc = 0;
+	}
+	else if (rc < 0)
+	{
+		free(*pairs);
+		*pairs = 0;
+		*pairCount = 0;
+	}
+
+	return rc;
+}
+
+
+int Proximity_init(double radius)
+{
+	if (radius < PROXIMITY_RADIUS_MIN || radius > PROXIMITY_RADIUS_MAX)
+	{
+		ERRLOG1("Invalid proximity radius: %f", radius);
+		return -1;
+	}
+
+	if (0 != pthread_rwlock_init(&_snapshotLock, 0))
+	{
+		ERRLOG("Failed to init snapshot rwlock!");
+		return -2;
+	}
+
+	_radius = radius;
+	_enabled = true;
+
+	ERRLOG1("Proximity detection enabled with radius %.1f m", _radius);
+
+	return 0;
+}
+
+bool Proximity_isEnabled()
+{
+	return _enabled;
+}
+
+void Proximity_update(time_t curTime)
+{
+	if (!_enabled)
+	{
+		return;
+	}
+
+	unsigned int boatCount;
+	void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
+
+	ProximityPoint* points = malloc((boatCount + 1) * sizeof(ProximityPoint));
+	const BoatEntry** entries = malloc((boatCount + 1) * sizeof(BoatEntry*));
+	uint64_t* nameHashes = malloc((boatCount + 1) * sizeof(uint64_t));
+
+	if (!points || !entries || !nameHashes)
+	{
+		ERRLOG("update: Alloc failed!");
+		sailnavsim_boatregistry_free_boats_iterator(iterator);
+		free(points);
+		free(entries);
+		free(nameHashes);
+		return;
+	}
+
+	// Only moving boats in groups are considered (stopped boats are typically waiting at a race start or already finished),
+	// so never cold ones.
+	unsigned int count = 0;
+	const BoatEntry* e;
+	while ((e = sailnavsim_boatregistry_boats_iterator_get_next(iterator)) && count < boatCount)
+	{
+		if (e->group && e->boat && !e->boat->stop)
+		{
+			points[count].lat = e->boat->pos.lat;
+			points[count].lon = e->boat->pos.lon;
+			points[count].groupKey = Shard_hash(e->group);
+			entries[count] = e;
+			nameHashes[count] = Shard_hash(e->name);
+			count++;
+		}
+	}
+
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+
+	ProximityPair* pairs;
+	unsigned int pairCount;
+
+	if (0 == Proximity_findPairs(points, count, _radius, &pairs, &pairCount))
+	{
+		ProximitySnapshot snapshot;
+		if (0 == buildSnapshot(entries, pairs, pairCount, &snapshot))
+		{
+			if (0 != pthread_rwlock_wrlock(&_snapshotLock))
+			{
+				ERRLOG("update: Failed to write-lock snapshot rwlock!");
+				freeSnapshot(&snapshot);
+			}
+			else
+			{
+				ProximitySnapshot old = _snapshot;
+				_snapshot = snapshot;
+
+				if (0 != pthread_rwlock_unlock(&_snapshotLock))
+				{
+					ERRLOG("update: Failed to unlock snapshot rwlock!");
+				}
+
+				freeSnapshot(&old);
+			}
+		}
+
+		logNewPairEvents(curTime, entries, nameHashes, pairs, pairCount);
+		free(pairs);
+	}
+
+	free(points);
+	free(entries);
+	free(nameHashes);
+}
+
+const char* Proximity_getBoatResponse(const char* name)
+{
+	if (0 != pthread_rwlock_rdlock(&_snapshotLock))
+	{
+		ERRLOG("getBoatResponse: Failed to read-lock snapshot rwlock!");
+		return 0;
+	}
+
+	const BoatProximity key = { (char*) name, 0 };
+	const BoatProximity* bp = bsearch(&key, _snapshot.boats, _snapshot.count, sizeof(BoatProximity), &compareBoatProximity);
+
+	char* resp = strdup(bp ? bp->text : "");
+
+	if (0 != pthread_rwlock_unlock(&_snapshotLock))
+	{
+		ERRLOG("getBoatResponse: Failed to unlock snapshot rwlock!");
+	}
+
+	return resp;
+}
+
+void Proximity_freeBoatResponse(const char* resp)
+{
+	free((char*) resp);
+}
+
+
+static int compareCellPoints(const void* a, const void* b)
+{
+	const CellPoint* p = (const CellPoint*) a;
+	const CellPoint* q = (const CellPoint*) b;
+
+	if (p->group != q->group)
+	{
+		return (p->group < q->group) ? -1 : 1;
+	}
+	else if (p->cx != q->cx)
+	{
+		return (p->cx < q->cx) ? -1 : 1;
+	}
+	else if (p->cy != q->cy)
+	{
+		return (p->cy < q->cy) ? -1 : 1;
+	}
+	else if (p->cz != q->cz)
+	{
+		return (p->cz < q->cz) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static int compareDirectedPairs(const void* a, const void* b)
+{
+	const DirectedPair* p = (const DirectedPair*) a;
+	const DirectedPair* q = (const DirectedPair*) b;
+
+	if (p->from != q->from)
+	{
+		return (p->from < q->from) ? -1 : 1;
+	}
+	else if (p->distance != q->distance)
+	{
+		return (p->distance < q->distance) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static int compareBoatProximity(const void* a, const void* b)
+{
+	return strcmp(((const BoatProximity*) a)->name, ((const BoatProximity*) b)->name);
+}
+
+static int compareU64(const void* a, const void* b)
+{
+	const uint64_t x = *((const uint64_t*) a);
+	const uint64_t y = *((const uint64_t*) b);
+
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static uint64_t cellHash(uint64_t group, int32_t cx, int32_t cy, int32_t cz)
+{
+	uint64_t h = group;
+	h ^= ((uint64_t) (uint32_t) cx) * 0x9e3779b97f4a7c15ULL;
+	h ^= ((uint64_t) (uint32_t) cy) * 0xc2b2ae3d27d4eb4fULL;
+	h ^= ((uint64_t) (uint32_t) cz) * 0x165667b19e3779f9ULL;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+static unsigned int findRun(const CellPoint* cps, const CellRun* runs, const unsigned int* table, uint64_t tableMask, uint64_t group, int32_t cx, int32_t cy, int32_t cz)
+{
+	uint64_t slot = cellHash(group, cx, cy, cz) & tableMask;
+
+	while (table[slot] != NO_RUN)
+	{
+		const CellPoint* cp = cps + runs[table[slot]].start;
+		if (cp->group == group && cp->cx == cx && cp->cy == cy && cp->cz == cz)
+		{
+			return table[slot];
+		}
+
+		slot = (slot + 1) & tableMask;
+	}
+
+	return NO_RUN;
+}
+
+// Returns 0 if the pair was added (or is not within the radius), 1 if the pair limit was reached, or -1 on failure.
+static int addPair(ProximityPair** pairs, unsigned int* pairCount, unsigned int* pairCap, const CellPoint* p, const CellPoint* q, double chord2)
+{
+	const double dx = p->x - q->x;
+	const double dy = p->y - q->y;
+	const double dz = p->z - q->z;
+	const double d2 = dx * dx + dy * dy + dz * dz;
+
+	if (d2 > chord2)
+	{
+		return 0;
+	}
+
+	if (*pairCount >= PROXIMITY_MAX_PAIRS)
+	{
+		return 1;
+	}
+
+	if (*pairCount == *pairCap)
+	{
+		const unsigned int newCap = (*pairCap == 0) ? 1024 : *pairCap * 2;
+		ProximityPair* newPairs = realloc(*pairs, newCap * sizeof(ProximityPair));
+		if (!newPairs)
+		{
+			ERRLOG("addPair: Alloc failed!");
+			return -1;
+		}
+
+		*pairs = newPairs;
+		*pairCap = newCap;
+	}
+
+	ProximityPair* pair = *pairs + *pairCount;
+
+	pair->a = (p->idx < q->idx) ? p->idx : q->idx;
+	pair->b = (p->idx < q->idx) ? q->idx : p->idx;
+	pair->distance = 2.0 * EARTH_RADIUS * asin(fmin(1.0, sqrt(d2) / (2.0 * EARTH_RADIUS)));
+
+	(*pairCount)++;
+	return 0;
+}
+
+static int buildSnapshot(const BoatEntry** entries, const ProximityPair* pairs, unsigned int pairCount, ProximitySnapshot* snapshot)
+{
+	snapshot->boats = 0;
+	snapshot->count = 0;
+
+	if (pairCount == 0)
+	{
+		return 0;
+	}
+
+	DirectedPair* dps = malloc(2 * ((size_t) pairCount) * sizeof(DirectedPair));
+	if (!dps)
+	{
+		ERRLOG("buildSnapshot: Alloc failed!");
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < pairCount; i++)
+	{
+		dps[2 * i].from = pairs[i].a;
+		dps[2 * i].to = pairs[i].b;
+		dps[2 * i].distance = pairs[i].distance;
+		dps[2 * i + 1].from = pairs[i].b;
+		dps[2 * i + 1].to = pairs[i].a;
+		dps[2 * i + 1].distance = pairs[i].distance;
+	}
+
+	// Nearest first for each boat
+	qsort(dps, 2 * ((size_t) pairCount), sizeof(DirectedPair), &compareDirectedPairs);
+
+	unsigned int boatCap = 64;
+	snapshot->boats = malloc(boatCap * sizeof(BoatProximity));
+	if (!snapshot->boats)
+	{
+		ERRLOG("buildSnapshot: Alloc failed!");
+		free(dps);
+		return -1;
+	}
+
+	const size_t dpCount = 2 * ((size_t) pairCount);
+	size_t i = 0;
+
+	while (i < dpCount)
+	{
+		const unsigned int from = dps[i].from;
+
+		size_t textSize = 0;
+		unsigned int listed = 0;
+		for (size_t j = i; j < dpCount && dps[j].from == from && listed < PROXIMITY_MAX_LISTED; j++)
+		{
+			// Boats hidden from live sharing are not listed for other boats.
+			if ((entries[dps[j].to]->boat->boatFlags & BOAT_FLAG_LIVE_SHARING_HIDDEN) == 0)
+			{
+				textSize += strlen(entries[dps[j].to]->name) + 24;
+				listed++;
+			}
+		}
+
+		char* text = malloc(textSize + 1);
+		if (!text)
+		{
+			ERRLOG("buildSnapshot: Alloc failed!");
+			free(dps);
+			freeSnapshot(snapshot);
+			return -1;
+		}
+
+		size_t pos = 0;
+		text[0] = 0;
+
+		listed = 0;
+		for (; i < dpCount && dps[i].from == from; i++)
+		{
+			if (listed < PROXIMITY_MAX_LISTED && (entries[dps[i].to]->boat->boatFlags & BOAT_FLAG_LIVE_SHARING_HIDDEN) == 0)
+			{
+				pos += snprintf(text + pos, textSize + 1 - pos, "%s,%.1f\n", entries[dps[i].to]->name, dps[i].distance);
+				listed++;
+			}
+		}
+
+		if (snapshot->count == boatCap)
+		{
+			boatCap *= 2;
+			BoatProximity* newBoats = realloc(snapshot->boats, boatCap * sizeof(BoatProximity));
+			if (!newBoats)
+			{
+				ERRLOG("buildSnapshot: Alloc failed!");
+				free(text);
+				free(dps);
+				freeSnapshot(snapshot);
+				return -1;
+			}
+
+			snapshot->boats = newBoats;
+		}
+
+		snapshot->boats[snapshot->count].name = strdup(entries[from]->name);
+		snapshot->boats[snapshot->count].text = text;
+		snapshot->count++;
+	}
+
+	free(dps);
+
+	qsort(snapshot->boats, snapshot->count, sizeof(BoatProximity), &compareBoatProximity);
+
+	return 0;
+}
+
+static void freeSnapshot(ProximitySnapshot* snapshot)
+{
+	for (unsigned int i = 0; i < snapshot->count; i++)
+	{
+		free(snapshot->boats[i].name);
+		free(snapshot->boats[i].text);
+	}
+
+	free(snapshot->boats);
+
+	snapshot->boats = 0;
+	snapshot->count = 0;
+}
+
+static void logNewPairEvents(time_t curTime, const BoatEntry** entries, const uint64_t* nameHashes, const ProximityPair* pairs, unsigned int pairCount)
+{
+	uint64_t* keys = malloc((pairCount + 1) * sizeof(uint64_t));
+	if (!keys)
+	{
+		ERRLOG("logNewPairEvents: Alloc failed!");
+		return;
+	}
+
+	for (unsigned int i = 0; i < pairCount; i++)
+	{
+		// Independent of the order of the two boats
+		const uint64_t ha = nameHashes[pairs[i].a];
+		const uint64_t hb = nameHashes[pairs[i].b];
+		const uint64_t lo = (ha < hb) ? ha : hb;
+		const uint64_t hi = (ha < hb) ? hb : ha;
+
+		keys[i] = lo ^ (hi * 0x9e3779b97f4a7c15ULL);
+	}
+
+	// Pairs already present at the first update (e.g. after a restart) are not considered new.
+	if (_havePrevPairs)
+	{
+		BoatEventEntry* events = 0;
+		unsigned int evCount = 0;
+		unsigned int evCap = 0;
+
+		for (unsigned int i = 0; i < pairCount; i++)
+		{
+			if (bsearch(keys + i, _prevPairKeys, _prevPairKeyCount, sizeof(uint64_t), &compareU64))
+			{
+				continue;
+			}
+
+			if (evCount + 2 > evCap)
+			{
+				evCap = (evCap == 0) ? 64 : evCap * 2;
+				BoatEventEntry* newEvents = realloc(events, evCap * sizeof(BoatEventEntry));
+				if (!newEvents)
+				{
+					ERRLOG("logNewPairEvents: Alloc failed!");
+					break;
+				}
+
+				events = newEvents;
+			}
+
+			for (int k = 0; k < 2; k++)
+			{
+				const BoatEntry* self = entries[(k == 0) ? pairs[i].a : pairs[i].b];
+				const BoatEntry* other = entries[(k == 0) ? pairs[i].b : pairs[i].a];
+
+				BoatEventEntry* ev = events + evCount++;
+				ev->time = curTime;
+				ev->boatName = strdup(self->name);
+				ev->type = BOAT_EVENT_PROXIMITY;
+				ev->ref = strdup(other->name);
+				ev->value = pairs[i].distance;
+			}
+		}
+
+		if (evCount > 0)
+		{
+			Logger_writeEvents(events, evCount);
+		}
+		else
+		{
+			free(events);
+		}
+	}
+
+	qsort(keys, pairCount, sizeof(uint64_t), &compareU64);
+
+	free(_prevPairKeys);
+	_prevPairKeys = keys;
+	_prevPairKeyCount = pairCount;
+	_havePrevPairs = true;
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Proximity_h_
+#define _Proximity_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+
+#define PROXIMITY_RADIUS_MIN (1.0)
+#define PROXIMITY_RADIUS_MAX (100000.0)
+
+
+typedef struct
+{
+	double lat;
+	double lon;
+
+	// Only points with the same group key are paired.
+	uint64_t groupKey;
+} ProximityPoint;
+
+typedef struct
+{
+	// Indices into the points array (a < b)
+	unsigned int a;
+	unsigned int b;
+
+	// Great circle distance (metres)
+	double distance;
+} ProximityPair;
+
+
+// Finds all pairs of points in the same group within radius (metres) of each other, using a spatial hash.
+// On success, returns 0 and sets *pairs (to be freed by the caller) and *pairCount.
+int Proximity_findPairs(const ProximityPoint* points, unsigned int count, double radius, ProximityPair** pairs, unsigned int* pairCount);
+
+
+int Proximity_init(double radius);
+bool Proximity_isEnabled();
+
+// Recomputes proximity pairs for all moving boats in groups, and logs events for newly close pairs.
+// Must be called from the main thread (which is the only writer of boats and the boat registry).
+void Proximity_update(time_t curTime);
+
+// Returns the "other boat,distance" lines for a boat from the latest update, or null on failure.
+const char* Proximity_getBoatResponse(const char* name);
+void Proximity_freeBoatResponse(const char* resp);
+
+
+#endif // _Proximity_h_
@@ -0,0 +1,564 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "RaceMarks.h"
+
+#include "ErrLog.h"
+
+
+#define ERRLOG_ID "RaceMarks"
+
+// Grid cell size (degrees) for the mark index. Boats move much less than one cell per tick.
+#define GRID_CELL_DEG (0.05)
+#define GRID_LON_CELLS (7200)
+
+#define NO_CELL (0xffffffffffffffffULL)
+
+
+typedef struct
+{
+	char* group;
+	char* name;
+	int type;
+	proteus_GeoPos p1;
+	proteus_GeoPos p2;
+} RaceMark;
+
+typedef struct
+{
+	uint64_t key;
+	unsigned int start;
+	unsigned int count;
+} GridCell;
+
+
+static RaceMark* _marks = 0;
+static unsigned int _markCount = 0;
+static unsigned int _markCap = 0;
+
+// Grid index: hash table of cells, each referring to a range of mark indices in _gridMarks
+static GridCell* _grid = 0;
+static uint64_t _gridMask = 0;
+static unsigned int* _gridMarks = 0;
+
+static BoatEventEntry* _events = 0;
+static unsigned int _evCount = 0;
+static unsigned int _evCap = 0;
+
+
+static int addMark(const char* group, const char* name, int type, const proteus_GeoPos* p1, const proteus_GeoPos* p2);
+static int loadMarksSql(const char* sqliteDbFilename);
+static int rebuildGrid();
+static void forEachMarkCell(const RaceMark* mark, void (*func)(uint64_t key, unsigned int markIndex, void* ctx), unsigned int markIndex, void* ctx);
+static void countRef(uint64_t key, unsigned int markIndex, void* ctx);
+static void insertCell(uint64_t key, unsigned int markIndex, void* ctx);
+static void fillCell(uint64_t key, unsigned int markIndex, void* ctx);
+static GridCell* findCell(uint64_t key, bool insert);
+static uint64_t cellKey(int32_t cLat, int32_t cLon);
+static double normalizeLon(double lon);
+static void queueEvent(const char* boatName, const RaceMark* mark, time_t curTime, double t);
+
+
+int RaceMarks_init(const char* sqliteDbFilename)
+{
+	if (0 != loadMarksSql(sqliteDbFilename))
+	{
+		return -1;
+	}
+
+	if (_markCount > 0)
+	{
+		ERRLOG1("Loaded %u race marks.", _markCount);
+	}
+
+	return rebuildGrid();
+}
+
+int RaceMarks_add(const char* group, const char* name, int type, const proteus_GeoPos* p1, const proteus_GeoPos* p2)
+{
+	if (0 != addMark(group, name, type, p1, p2))
+	{
+		return -1;
+	}
+
+	return rebuildGrid();
+}
+
+int RaceMarks_remove(const char* group, const char* name)
+{
+	for (unsigned int i = 0; i < _markCount; i++)
+	{
+		if (strcmp(_marks[i].group, group) == 0 && strcmp(_marks[i].name, name) == 0)
+		{
+			free(_marks[i].group);
+			free(_marks[i].name);
+
+			_marks[i] = _marks[--_markCount];
+
+			return rebuildGrid();
+		}
+	}
+
+	return -1;
+}
+
+bool RaceMarks_hasMarks()
+{
+	return (_markCount > 0);
+}
+
+unsigned int RaceMarks_getFinishes(RaceMarkFinish* finishes, unsigned int max)
+{
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; i < _markCount && n < max; i++)
+	{
+		if (_marks[i].type == RACEMARK_TYPE_FINISH)
+		{
+			finishes[n].group = _marks[i].group;
+			finishes[n].p1 = _marks[i].p1;
+			finishes[n].p2 = _marks[i].p2;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+unsigned int RaceMarks_getMarks(RaceMarkInfo* marks, unsigned int max)
+{
+	for (unsigned int i = 0; i < _markCount && i < max; i++)
+	{
+		marks[i].group = _marks[i].group;
+		marks[i].name = _marks[i].name;
+		marks[i].type = _marks[i].type;
+		marks[i].p1 = _marks[i].p1;
+		marks[i].p2 = _marks[i].p2;
+	}
+
+	return _markCount;
+}
+
+int RaceMarks_removeAll()
+{
+	for (unsigned int i = 0; i < _markCount; i++)
+	{
+		free(_marks[i].group);
+		free(_marks[i].name);
+	}
+
+	_markCount = 0;
+
+	return rebuildGrid();
+}
+
+void RaceMarks_checkCrossings(const char* boatName, const char* group, const proteus_GeoPos* from, const proteus_GeoPos* to, time_t curTime)
+{
+	if (!_grid || (from->lat == to->lat && from->lon == to->lon))
+	{
+		return;
+	}
+
+	// Marks are indexed in all cells within one cell of the line, and boats move less than one cell
+	// per tick, so only the cell of the starting position needs to be checked.
+	const int32_t cLat = (int32_t) floor((from->lat + 90.0) / GRID_CELL_DEG);
+	const int32_t cLon = (int32_t) floor((from->lon + 180.0) / GRID_CELL_DEG) % GRID_LON_CELLS;
+
+	const GridCell* cell = findCell(cellKey(cLat, cLon), false);
+	if (!cell)
+	{
+		return;
+	}
+
+	for (unsigned int i = 0; i < cell->count; i++)
+	{
+		const RaceMark* mark = _marks + _gridMarks[cell->start + i];
+
+		if (strcmp(mark->group, group) != 0)
+		{
+			continue;
+		}
+
+		const double t = RaceMarks_segmentCrossing(from, to, &mark->p1, &mark->p2);
+		if (t > 0.0)
+		{
+			queueEvent(boatName, mark, curTime, t);
+		}
+	}
+}
+
+BoatEventEntry* RaceMarks_takeEvents(unsigned int* evCount)
+{
+	BoatEventEntry* events = _events;
+	*evCount = _evCount;
+
+	_events = 0;
+	_evCount = 0;
+	_evCap = 0;
+
+	return events;
+}
+
+double RaceMarks_segmentCrossing(const proteus_GeoPos* from, const proteus_GeoPos* to, const proteus_GeoPos* p1, const proteus_GeoPos* p2)
+{
+	// Local equirectangular projection around the starting position (fine for short mark lines).
+	const double cosLat = cos(from->lat * M_PI / 180.0);
+
+	const double rx = normalizeLon(to->lon - from->lon) * cosLat;
+	const double ry = to->lat - from->lat;
+
+	const double cx = normalizeLon(p1->lon - from->lon) * cosLat;
+	const double cy = p1->lat - from->lat;
+
+	const double sx = normalizeLon(p2->lon - p1->lon) * cosLat;
+	const double sy = p2->lat - p1->lat;
+
+	const double denom = rx * sy - ry * sx;
+	if (denom == 0.0)
+	{
+		// Parallel (or degenerate)
+		return -1.0;
+	}
+
+	const double t = (cx * sy - cy * sx) / denom;
+	const double u = (cx * ry - cy * rx) / denom;
+
+	// Crossing at the very start of the segment is excluded, since that was already counted (at the end of the previous tick's segment).
+	if (t > 0.0 && t <= 1.0 && u >= 0.0 && u <= 1.0)
+	{
+		return t;
+	}
+
+	return -1.0;
+}
+
+
+static int addMark(const char* group, const char* name, int type, const proteus_GeoPos* p1, const proteus_GeoPos* p2)
+{
+	if ((type != RACEMARK_TYPE_GATE && type != RACEMARK_TYPE_FINISH) ||
+			p1->lat < -90.0 || p1->lat > 90.0 || p2->lat < -90.0 || p2->lat > 90.0 ||
+			p1->lon < -180.0 || p1->lon > 180.0 || p2->lon < -180.0 || p2->lon > 180.0 ||
+			fabs(p2->lat - p1->lat) > RACEMARK_MAX_SPAN_DEG ||
+			fabs(normalizeLon(p2->lon - p1->lon)) > RACEMARK_MAX_SPAN_DEG)
+	{
+		ERRLOG2("Invalid race mark %s for %s", name, group);
+		return -1;
+	}
+
+	RaceMark* mark = 0;
+
+	for (unsigned int i = 0; i < _markCount; i++)
+	{
+		if (strcmp(_marks[i].group, group) == 0 && strcmp(_marks[i].name, name) == 0)
+		{
+			mark = _marks + i;
+			break;
+		}
+	}
+
+	if (!mark)
+	{
+		if (_markCount == _markCap)
+		{
+			const unsigned int newCap = (_markCap == 0) ? 16 : _markCap * 2;
+			RaceMark* newMarks = realloc(_marks, newCap * sizeof(RaceMark));
+			if (!newMarks)
+			{
+				ERRLOG("add: Alloc failed!");
+				return -1;
+			}
+
+			_marks = newMarks;
+			_markCap = newCap;
+		}
+
+		char* g = strdup(group);
+		char* n = strdup(name);
+		if (!g || !n)
+		{
+			ERRLOG("add: Alloc failed!");
+			free(g);
+			free(n);
+			return -1;
+		}
+
+		mark = _marks + _markCount++;
+		mark->group = g;
+		mark->name = n;
+	}
+
+	mark->type = type;
+	mark->p1 = *p1;
+	mark->p2 = *p2;
+
+	return 0;
+}
+
+static int loadMarksSql(const char* sqliteDbFilename)
+{
+	if (!sqliteDbFilename)
+	{
+		return 0;
+	}
+
+	FILE* fdb = fopen(sqliteDbFilename, "r");
+	if (fdb == 0)
+	{
+		// No DB, so no marks from there.
+		return 0;
+	}
+	fclose(fdb);
+
+	sqlite3* sql;
+	sqlite3_stmt* stmt;
+	int src;
+
+	if (SQLITE_OK != (src = sqlite3_open(sqliteDbFilename, &sql)))
+	{
+		ERRLOG1("Failed to open SQLite DB. sqlite rc=%d", src);
+		return -1;
+	}
+
+	static const char* SELECT_RACEMARK_STMT_STR = "SELECT race, name, type, lat1, lon1, lat2, lon2 FROM RaceMark;";
+	if (SQLITE_OK != (src = sqlite3_prepare_v2(sql, SELECT_RACEMARK_STMT_STR, strlen(SELECT_RACEMARK_STMT_STR) + 1, &stmt, 0)))
+	{
+		// The RaceMark table was added later, so older DBs may not have it.
+		ERRLOG1("Failed to prepare RaceMark select statement, so not loading race marks. sqlite rc=%d", src);
+		sqlite3_close(sql);
+		return 0;
+	}
+
+	while (SQLITE_ROW == (src = sqlite3_step(stmt)))
+	{
+		int n = 0;
+
+		const char* race = (const char*) sqlite3_column_text(stmt, n++);
+		const char* name = (const char*) sqlite3_column_text(stmt, n++);
+		const int type = sqlite3_column_int(stmt, n++);
+
+		proteus_GeoPos p1;
+		proteus_GeoPos p2;
+		p1.lat = sqlite3_column_double(stmt, n++);
+		p1.lon = sqlite3_column_double(stmt, n++);
+		p2.lat = sqlite3_column_double(stmt, n++);
+		p2.lon = sqlite3_column_double(stmt, n++);
+
+		if (race && name)
+		{
+			addMark(race, name, type, &p1, &p2);
+		}
+	}
+
+	if (SQLITE_DONE != src)
+	{
+		ERRLOG1("Failed to step RaceMark select statement! sqlite rc=%d", src);
+	}
+
+	if (SQLITE_OK != (src = sqlite3_finalize(stmt)))
+	{
+		ERRLOG1("Failed to finalize RaceMark statement! sqlite rc=%d", src);
+	}
+
+	if (SQLITE_OK != (src = sqlite3_close(sql)))
+	{
+		ERRLOG1("Failed to close SQLite DB! sqlite rc=%d", src);
+	}
+
+	return 0;
+}
+
+static int rebuildGrid()
+{
+	free(_grid);
+	free(_gridMarks);
+	_grid = 0;
+	_gridMarks = 0;
+	_gridMask = 0;
+
+	if (_markCount == 0)
+	{
+		return 0;
+	}
+
+	// First pass: count cells and mark references per cell
+	unsigned int refCount = 0;
+	for (unsigned int i = 0; i < _markCount; i++)
+	{
+		forEachMarkCell(_marks + i, &countRef, i, &refCount);
+	}
+
+	uint64_t gridSize = 16;
+	while (gridSize < 2 * (uint64_t) refCount)
+	{
+		gridSize <<= 1;
+	}
+
+	_grid = malloc(gridSize * sizeof(GridCell));
+	_gridMarks = malloc(refCount * sizeof(unsigned int));
+	if (!_grid || !_gridMarks)
+	{
+		ERRLOG("rebuildGrid: Alloc failed!");
+		free(_grid);
+		free(_gridMarks);
+		_grid = 0;
+		_gridMarks = 0;
+		return -1;
+	}
+
+	_gridMask = gridSize - 1;
+	for (uint64_t i = 0; i < gridSize; i++)
+	{
+		_grid[i].key = NO_CELL;
+		_grid[i].count = 0;
+	}
+
+	// Second pass: insert cells and count references per cell
+	for (unsigned int i = 0; i < _markCount; i++)
+	{
+		forEachMarkCell(_marks + i, &insertCell, i, 0);
+	}
+
+	unsigned int start = 0;
+	for (uint64_t i = 0; i < gridSize; i++)
+	{
+		_grid[i].start = start;
+		start += _grid[i].count;
+		_grid[i].count = 0;
+	}
+
+	// Third pass: fill in mark references
+	for (unsigned int i = 0; i < _markCount; i++)
+	{
+		forEachMarkCell(_marks + i, &fillCell, i, 0);
+	}
+
+	return 0;
+}
+
+// Calls func for each grid cell within one cell of the bounding box of the mark line.
+static void forEachMarkCell(const RaceMark* mark, void (*func)(uint64_t key, unsigned int markIndex, void* ctx), unsigned int markIndex, void* ctx)
+{
+	const double lon1 = mark->p1.lon;
+	const double lon2 = mark->p1.lon + normalizeLon(mark->p2.lon - mark->p1.lon);
+
+	const int32_t latStart = (int32_t) floor((fmin(mark->p1.lat, mark->p2.lat) + 90.0) / GRID_CELL_DEG) - 1;
+	const int32_t latEnd = (int32_t) floor((fmax(mark->p1.lat, mark->p2.lat) + 90.0) / GRID_CELL_DEG) + 1;
+	const int32_t lonStart = (int32_t) floor((fmin(lon1, lon2) + 180.0) / GRID_CELL_DEG) - 1;
+	const int32_t lonEnd = (int32_t) floor((fmax(lon1, lon2) + 180.0) / GRID_CELL_DEG) + 1;
+
+	for (int32_t cLat = latStart; cLat <= latEnd; cLat++)
+	{
+		for (int32_t cLon = lonStart; cLon <= lonEnd; cLon++)
+		{
+			// Wrap around the antimeridian
+			func(cellKey(cLat, ((cLon % GRID_LON_CELLS) + GRID_LON_CELLS) % GRID_LON_CELLS), markIndex, ctx);
+		}
+	}
+}
+
+static void countRef(uint64_t key __attribute__((unused)), unsigned int markIndex __attribute__((unused)), void* ctx)
+{
+	(*((unsigned int*) ctx))++;
+}
+
+static void insertCell(uint64_t key, unsigned int markIndex __attribute__((unused)), void* ctx __attribute__((unused)))
+{
+	GridCell* cell = findCell(key, true);
+	cell->count++;
+}
+
+static void fillCell(uint64_t key, unsigned int markIndex, void* ctx __attribute__((unused)))
+{
+	GridCell* cell = findCell(key, false);
+	_gridMarks[cell->start + cell->count++] = markIndex;
+}
+
+static GridCell* findCell(uint64_t key, bool insert)
+{
+	uint64_t h = key * 0x9e3779b97f4a7c15ULL;
+	uint64_t slot = (h ^ (h >> 32)) & _gridMask;
+
+	while (_grid[slot].key != NO_CELL)
+	{
+		if (_grid[slot].key == key)
+		{
+			return _grid + slot;
+		}
+
+		slot = (slot + 1) & _gridMask;
+	}
+
+	if (insert)
+	{
+		_grid[slot].key = key;
+		return _grid + slot;
+	}
+
+	return 0;
+}
+
+static uint64_t cellKey(int32_t cLat, int32_t cLon)
+{
+	return (((uint64_t) (uint32_t) cLat) << 32) | ((uint64_t) (uint32_t) cLon);
+}
+
+static double normalizeLon(double lon)
+{
+	if (lon > 180.0)
+	{
+		return lon - 360.0;
+	}
+	else if (lon < -180.0)
+	{
+		return lon + 360.0;
+	}
+
+	return lon;
+}
+
+static void queueEvent(const char* boatName, const RaceMark* mark, time_t curTime, double t)
+{
+	if (_evCount == _evCap)
+	{
+		const unsigned int newCap = (_evCap == 0) ? 64 : _evCap * 2;
+		BoatEventEntry* newEvents = realloc(_events, newCap * sizeof(BoatEventEntry));
+		if (!newEvents)
+		{
+			ERRLOG("queueEvent: Alloc failed!");
+			return;
+		}
+
+		_events = newEvents;
+		_evCap = newCap;
+	}
+
+	BoatEventEntry* ev = _events + _evCount++;
+
+	// Each tick advances boats by one second, ending at curTime, so interpolate the crossing time within that second.
+	ev->value = ((double) (curTime - 1)) + t;
+	ev->time = (time_t) floor(ev->value);
+	ev->boatName = strdup(boatName);
+	ev->type = (mark->type == RACEMARK_TYPE_FINISH) ? BOAT_EVENT_FINISH_CROSSING : BOAT_EVENT_GATE_CROSSING;
+	ev->ref = strdup(mark->name);
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RaceMarks_h_
+#define _RaceMarks_h_
+
+#include <stdbool.h>
+#include <time.h>
+
+#include <proteus/GeoPos.h>
+
+#include "Logger.h"
+
+
+#define RACEMARK_TYPE_GATE	(0)
+#define RACEMARK_TYPE_FINISH	(1)
+
+// Maximum extent of a mark line, in degrees of latitude or longitude
+#define RACEMARK_MAX_SPAN_DEG	(1.0)
+
+
+typedef struct
+{
+	const char* group;
+	proteus_GeoPos p1;
+	proteus_GeoPos p2;
+} RaceMarkFinish;
+
+typedef struct
+{
+	const char* group;
+	const char* name;
+	int type;
+	proteus_GeoPos p1;
+	proteus_GeoPos p2;
+} RaceMarkInfo;
+
+
+int RaceMarks_init(const char* sqliteDbFilename);
+
+// Adds (or replaces) the named mark line for a group (race).
+int RaceMarks_add(const char* group, const char* name, int type, const proteus_GeoPos* p1, const proteus_GeoPos* p2);
+int RaceMarks_remove(const char* group, const char* name);
+
+bool RaceMarks_hasMarks();
+
+// Fills finishes (up to max) with the finish lines of all groups, returning the number filled. Group names are only valid
+// until the marks next change. Must be called from the main thread.
+unsigned int RaceMarks_getFinishes(RaceMarkFinish* finishes, unsigned int max);
+
+// Fills marks (up to max) with all marks, returning the total number of marks (which may be more than max). Names are
+// only valid until the marks next change. Must be called from the main thread.
+unsigned int RaceMarks_getMarks(RaceMarkInfo* marks, unsigned int max);
+
+int RaceMarks_removeAll();
+
+// Checks a boat's movement over the last tick (ending at curTime) against its group's marks, and queues an event for each crossing.
+// Must be called from the main thread (like the add and remove functions above).
+void RaceMarks_checkCrossings(const char* boatName, const char* group, const proteus_GeoPos* from, const proteus_GeoPos* to, time_t curTime);
+
+// Returns (and clears) the crossing events queued since the last call.
+BoatEventEntry* RaceMarks_takeEvents(unsigned int* evCount);
+
+// Returns the fraction (0, 1] of segment from-to at which it crosses line p1-p2, or a negative value if it does not.
+double RaceMarks_segmentCrossing(const proteus_GeoPos* from, const proteus_GeoPos* to, const proteus_GeoPos* p1, const proteus_GeoPos* p2);
+
+
+#endif // _RaceMarks_h_
@@ -0,0 +1,1657 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <sailnavsim_boatregistry.h>
+
+#include "Replication.h"
+
+#include "BoatRegistry.h"
+#include "ErrLog.h"
+#include "NetServer.h"
+
+
+#define ERRLOG_ID "Replication"
+#define THREAD_NAME_ACCEPT "ReplAccept"
+#define THREAD_NAME_SEND "ReplSend"
+#define THREAD_NAME_REPLICA "Replica"
+
+
+// Stream format (host byte order, since primary and replicas always run on the same machine):
+//
+//   Hello (primary to replica, on connect): u32 magic, u16 version, u16 reserved
+//
+//   Frame: u32 payload length, then payload:
+//     u8 flags, i64 tick time, i64 publish time (CLOCK_REALTIME ns), u32 record count, then records:
+//       ADD:    u8 type, u32 id, str name, str group, str alt name, all boat fields
+//       UPDATE: u8 type, u32 id, u8 field mask, changed boat fields
+//       REMOVE: u8 type, u32 id
+//
+//   Strings are a u16 length (or STR_NULL) followed by the bytes (without terminator).
+//   Boats are referred to by a small integer id (assigned by the primary) after being added.
+//   A snapshot frame tells the replica to drop all of its boats first.
+
+#define REPLICATION_MAGIC (0x534e5352)
+#define REPLICATION_VERSION (1)
+#define HELLO_SIZE (8)
+
+#define FRAME_FLAG_SNAPSHOT (0x01)
+#define FRAME_HEADER_SIZE (4 + 1 + 8 + 8 + 4)
+#define FRAME_RECORD_COUNT_OFFSET (4 + 1 + 8 + 8)
+#define FRAME_MAX_PAYLOAD_SIZE (256 * 1024 * 1024)
+
+#define REC_ADD (1)
+#define REC_UPDATE (2)
+#define REC_REMOVE (3)
+
+#define STR_NULL (0xffff)
+#define STR_MAX_LEN (0xfffe)
+
+#define FIELDS_POS		(0x01)	// pos
+#define FIELDS_V		(0x02)	// v
+#define FIELDS_VGROUND		(0x04)	// vGround
+#define FIELDS_COURSE		(0x08)	// desiredCourse, courseMagnetic, setImmediateDesiredCourse
+#define FIELDS_MOTION		(0x10)	// distanceTravelled, leewaySpeed, heelingAngle
+#define FIELDS_STATE		(0x20)	// damage, sailArea, boatType, boatFlags, startingFromLandCount, stop, sailsDown, movingToSea
+#define FIELDS_ALL		(0x3f)
+
+#define FIELDS_MAX_SIZE (16 + 16 + 16 + 10 + 24 + 31)
+
+#define NO_ID (UINT32_MAX)
+
+#define MAX_REPLICAS (64)
+#define REPLICA_SEND_TIMEOUT_SEC (5)
+#define REPLICA_RECONNECT_DELAY_SEC (1)
+
+// How many ticks/frames between stats log lines
+#define STATS_INTERVAL (60)
+
+
+// Primary side state for producing deltas: last published state of each boat, by id.
+
+typedef struct
+{
+	const BoatEntry* entry; // Null if id is not in use
+	char* name;
+	char* group;
+	char* altName;
+	Boat boat;
+	unsigned int gen;
+} Shadow;
+
+static Shadow* _shadows = 0;
+static uint32_t _shadowsCap = 0;
+static uint32_t _nextId = 0;
+
+static uint32_t* _freeIds = 0;
+static uint32_t _freeIdCount = 0;
+
+// Open-addressed (linear probing) index of BoatEntry pointer to id + 1 (0 being empty)
+static uint32_t* _index = 0;
+static uint32_t _indexCap = 0;
+static uint32_t _indexCount = 0;
+
+static unsigned int _gen = 0;
+
+
+// Primary side connections
+
+typedef struct ReplicationMsg ReplicationMsg;
+
+struct ReplicationMsg
+{
+	ReplicationBuf buf;
+	int targetFd; // -1 for all replicas
+	bool dropAll;
+	ReplicationMsg* next;
+};
+
+static int _listenFd = -1;
+static pthread_t _acceptThread;
+static pthread_t _sendThread;
+
+static pthread_mutex_t _pendingLock = PTHREAD_MUTEX_INITIALIZER;
+static int _pendingFds[MAX_REPLICAS];
+static int _pendingCount = 0;
+
+static pthread_mutex_t _msgsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _msgsCond = PTHREAD_COND_INITIALIZER;
+static ReplicationMsg* _msgs = 0;
+static ReplicationMsg* _msgsLast = 0;
+
+// Replicas either receiving deltas or with a snapshot queued to them
+static atomic_int _liveReplicaCount = 0;
+
+static unsigned int _statsTicks = 0;
+static long _statsCpuNs = 0;
+static size_t _statsBytes = 0;
+
+
+// Replica side state: local boats, by primary-assigned id
+
+typedef struct
+{
+	char* name;
+	Boat* boat;
+} ReplicaBoat;
+
+static char* _replicaPath = 0;
+static pthread_t _replicaThread;
+
+static ReplicaBoat* _replicaBoats = 0;
+static uint32_t _replicaBoatsCap = 0;
+
+
+typedef struct
+{
+	const uint8_t* p;
+	const uint8_t* end;
+} Reader;
+
+
+static void* acceptThreadMain();
+static void* sendThreadMain();
+static void* replicaThreadMain();
+
+static int startThread(pthread_t* thread, void* (*threadMain)(), const char* name);
+
+static ReplicationMsg* newMsg(int targetFd);
+static void freeMsg(ReplicationMsg* msg);
+static void queueMsg(ReplicationMsg* msg);
+
+static int writeAll(int fd, const void* buf, size_t len);
+static int readAll(int fd, void* buf, size_t len);
+static int connectPrimary(const char* path);
+static int receiveFrames(int fd);
+
+static void replicaReset(void* ctx);
+static int replicaAdd(void* ctx, uint32_t id, const char* name, const char* group, const char* altName, const Boat* boat);
+static Boat* replicaGet(void* ctx, uint32_t id);
+static int replicaRemove(void* ctx, uint32_t id);
+
+static uint32_t indexFind(const BoatEntry* entry);
+static int indexInsert(const BoatEntry* entry, uint32_t id);
+static void indexRemove(const BoatEntry* entry);
+
+static uint32_t shadowAdd(const BoatEntry* entry, const Boat* boat);
+static void shadowRemove(uint32_t id);
+static bool shadowMatches(const Shadow* s, const BoatEntry* entry);
+
+static int bufReserve(ReplicationBuf* buf, size_t n);
+static int beginFrame(ReplicationBuf* buf, bool snapshot, time_t tickTime);
+static void endFrame(ReplicationBuf* buf, size_t frameStart, uint32_t recordCount);
+static int putAdd(ReplicationBuf* buf, uint32_t id, const char* name, const char* group, const char* altName, const Boat* boat);
+static int putUpdate(ReplicationBuf* buf, uint32_t id, uint8_t mask, const Boat* boat);
+static int putRemove(ReplicationBuf* buf, uint32_t id);
+static void putFields(ReplicationBuf* buf, uint8_t mask, const Boat* boat);
+static uint8_t changedFields(const Boat* a, const Boat* b);
+
+static bool getBytes(Reader* r, void* v, size_t n);
+static bool getStr(Reader* r, char** s);
+static bool getFields(Reader* r, uint8_t mask, Boat* boat);
+
+
+int Replication_initPrimary(const char* path)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		ERRLOG("Replication socket path is too long!");
+		return -4;
+	}
+	strcpy(sa.sun_path, path);
+
+	// Remove any stale socket file left behind by a previous run.
+	if (unlink(path) != 0 && errno != ENOENT)
+	{
+		ERRLOG1("Failed to unlink existing replication socket path! errno=%d", errno);
+		return -5;
+	}
+
+	_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (_listenFd < 0)
+	{
+		ERRLOG1("Failed to open socket! errno=%d", errno);
+		return -1;
+	}
+
+	if (0 != bind(_listenFd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)) || 0 != listen(_listenFd, MAX_REPLICAS))
+	{
+		ERRLOG1("Failed to bind/listen on replication socket! errno=%d", errno);
+		close(_listenFd);
+		_listenFd = -1;
+		return -2;
+	}
+
+	if (0 != startThread(&_sendThread, &sendThreadMain, THREAD_NAME_SEND) ||
+			0 != startThread(&_acceptThread, &acceptThreadMain, THREAD_NAME_ACCEPT))
+	{
+		return -3;
+	}
+
+	ERRLOG1("Replication stream listening on %s", path);
+	return 0;
+}
+
+void Replication_publishTick(time_t tickTime)
+{
+	struct timespec c0;
+	struct timespec c1;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c0);
+
+	ReplicationMsg* msg = newMsg(-1);
+	if (!msg || 0 != Replication_encodeDelta(tickTime, &msg->buf))
+	{
+		// Delta state can no longer be trusted, so start over and make all replicas resync.
+		ERRLOG("Failed to encode replication delta! Dropping all replicas.");
+
+		freeMsg(msg);
+		Replication_resetPrimaryState();
+
+		ReplicationMsg* dropMsg = newMsg(-1);
+		if (dropMsg)
+		{
+			dropMsg->dropAll = true;
+			queueMsg(dropMsg);
+		}
+
+		return;
+	}
+
+	_statsBytes += msg->buf.len;
+
+	if (atomic_load(&_liveReplicaCount) > 0)
+	{
+		queueMsg(msg);
+	}
+	else
+	{
+		freeMsg(msg);
+	}
+
+	// Newly connected replicas get a snapshot matching the delta just produced, and then all following deltas.
+	int fds[MAX_REPLICAS];
+	int fdCount;
+
+	pthread_mutex_lock(&_pendingLock);
+	fdCount = _pendingCount;
+	memcpy(fds, _pendingFds, fdCount * sizeof(int));
+	_pendingCount = 0;
+	pthread_mutex_unlock(&_pendingLock);
+
+	for (int i = 0; i < fdCount; i++)
+	{
+		ReplicationMsg* snapMsg = newMsg(fds[i]);
+		if (!snapMsg || 0 != Replication_encodeSnapshot(tickTime, &snapMsg->buf))
+		{
+			ERRLOG("Failed to encode replication snapshot!");
+			freeMsg(snapMsg);
+			close(fds[i]);
+			continue;
+		}
+
+		ERRLOG2("Queued snapshot (%zu bytes) for new replica (fd=%d)", snapMsg->buf.len, fds[i]);
+
+		atomic_fetch_add(&_liveReplicaCount, 1);
+		queueMsg(snapMsg);
+	}
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+	_statsCpuNs += (c1.tv_nsec - c0.tv_nsec) + 1000000000L * (c1.tv_sec - c0.tv_sec);
+
+	if (++_statsTicks == STATS_INTERVAL)
+	{
+		ERRLOG4("Published %u ticks: avg %.1f us CPU/tick, avg %zu bytes/tick, %d replicas",
+				_statsTicks,
+				((double) _statsCpuNs) / ((double) _statsTicks) / 1000.0,
+				_statsBytes / _statsTicks,
+				atomic_load(&_liveReplicaCount));
+
+		_statsTicks = 0;
+		_statsCpuNs = 0;
+		_statsBytes = 0;
+	}
+}
+
+
+int Replication_initReplica(const char* path)
+{
+	_replicaPath = strdup(path);
+	if (!_replicaPath)
+	{
+		return -1;
+	}
+
+	return startThread(&_replicaThread, &replicaThreadMain, THREAD_NAME_REPLICA);
+}
+
+int Replication_handleReplicaRequest(int writeFd, char* reqStr)
+{
+	static const char* REQ_STR_BOAT_CMD = "boatcmd";
+	static const char* REQ_STR_BOAT_CMD_SYNC = "boatcmd_sync";
+	static const char* RESP_BOAT_CMD_FAIL = "boatcmd,fail\n";
+	static const char* RESP_BOAT_CMD_SYNC_FAIL = "boatcmd_sync,failed\n";
+
+	// Replicas are read-only; commands must go to the primary.
+	size_t len = strlen(REQ_STR_BOAT_CMD);
+	if (strncmp(reqStr, REQ_STR_BOAT_CMD, len) == 0 && (reqStr[len] == ',' || reqStr[len] == 0))
+	{
+		return writeAll(writeFd, RESP_BOAT_CMD_FAIL, strlen(RESP_BOAT_CMD_FAIL));
+	}
+
+	len = strlen(REQ_STR_BOAT_CMD_SYNC);
+	if (strncmp(reqStr, REQ_STR_BOAT_CMD_SYNC, len) == 0 && (reqStr[len] == ',' || reqStr[len] == 0))
+	{
+		return writeAll(writeFd, RESP_BOAT_CMD_SYNC_FAIL, strlen(RESP_BOAT_CMD_SYNC_FAIL));
+	}
+
+	return NetServer_handleRequest(writeFd, reqStr);
+}
+
+
+void ReplicationBuf_free(ReplicationBuf* buf)
+{
+	free(buf->data);
+	buf->data = 0;
+	buf->len = 0;
+	buf->cap = 0;
+}
+
+int Replication_encodeDelta(time_t tickTime, ReplicationBuf* out)
+{
+	const size_t frameStart = out->len;
+	if (0 != beginFrame(out, false, tickTime))
+	{
+		return -1;
+	}
+
+	uint32_t recordCount = 0;
+	_gen++;
+
+	unsigned int boatCount;
+	void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
+
+	const BoatEntry* e;
+	while ((e = sailnavsim_boatregistry_boats_iterator_get_next(iterator)) != 0)
+	{
+		if (!e->boat && !e->cold)
+		{
+			continue;
+		}
+
+		Boat coldBoat;
+		const Boat* boat = BoatRegistry_view(e, &coldBoat);
+
+		uint32_t id = indexFind(e);
+
+		if (id != NO_ID && !shadowMatches(_shadows + id, e))
+		{
+			// Entry memory was reused for a different boat within the same tick.
+			if (0 != putRemove(out, id))
+			{
+				goto fail;
+			}
+
+			shadowRemove(id);
+			recordCount++;
+			id = NO_ID;
+		}
+
+		if (id == NO_ID)
+		{
+			if ((id = shadowAdd(e, boat)) == NO_ID || 0 != putAdd(out, id, e->name, e->group, e->altName, boat))
+			{
+				goto fail;
+			}
+
+			recordCount++;
+		}
+		else
+		{
+			Shadow* s = _shadows + id;
+
+			const uint8_t mask = changedFields(&s->boat, boat);
+			if (mask != 0)
+			{
+				if (0 != putUpdate(out, id, mask, boat))
+				{
+					goto fail;
+				}
+
+				s->boat = *boat;
+				recordCount++;
+			}
+		}
+
+		_shadows[id].gen = _gen;
+	}
+
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+
+	// Anything not seen in the registry on this pass has been removed.
+	for (uint32_t id = 0; id < _nextId; id++)
+	{
+		if (_shadows[id].entry && _shadows[id].gen != _gen)
+		{
+			if (0 != putRemove(out, id))
+			{
+				return -1;
+			}
+
+			shadowRemove(id);
+			recordCount++;
+		}
+	}
+
+	endFrame(out, frameStart, recordCount);
+	return 0;
+
+fail:
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+	return -1;
+}
+
+int Replication_encodeSnapshot(time_t tickTime, ReplicationBuf* out)
+{
+	const size_t frameStart = out->len;
+	if (0 != beginFrame(out, true, tickTime))
+	{
+		return -1;
+	}
+
+	uint32_t recordCount = 0;
+
+	for (uint32_t id = 0; id < _nextId; id++)
+	{
+		const Shadow* s = _shadows + id;
+		if (!s->entry)
+		{
+			continue;
+		}
+
+		if (0 != putAdd(out, id, s->name, s->group, s->altName, &s->boat))
+		{
+			return -1;
+		}
+
+		recordCount++;
+	}
+
+	endFrame(out, frameStart, recordCount);
+	return 0;
+}
+
+void Replication_resetPrimaryState()
+{
+	for (uint32_t id = 0; id < _nextId; id++)
+	{
+		Shadow* s = _shadows + id;
+		if (s->entry)
+		{
+			free(s->name);
+			free(s->group);
+			free(s->altName);
+		}
+	}
+
+	free(_shadows);
+	free(_freeIds);
+	free(_index);
+
+	_shadows = 0;
+	_shadowsCap = 0;
+	_nextId = 0;
+	_freeIds = 0;
+	_freeIdCount = 0;
+	_index = 0;
+	_indexCap = 0;
+	_indexCount = 0;
+}
+
+int Replication_applyFrame(const uint8_t* payload, size_t len, const ReplicationApplyFuncs* funcs, void* ctx, ReplicationFrameInfo* info)
+{
+	Reader r = { payload, payload + len };
+
+	uint8_t flags;
+	if (!getBytes(&r, &flags, 1) ||
+			!getBytes(&r, &info->tickTime, 8) ||
+			!getBytes(&r, &info->publishTimeNs, 8) ||
+			!getBytes(&r, &info->recordCount, 4))
+	{
+		return -1;
+	}
+
+	info->snapshot = ((flags & FRAME_FLAG_SNAPSHOT) != 0);
+	if (info->snapshot)
+	{
+		funcs->reset(ctx);
+	}
+
+	for (uint32_t i = 0; i < info->recordCount; i++)
+	{
+		uint8_t type;
+		uint32_t id;
+		if (!getBytes(&r, &type, 1) || !getBytes(&r, &id, 4))
+		{
+			return -1;
+		}
+
+		switch (type)
+		{
+			case REC_ADD:
+			{
+				char* name = 0;
+				char* group = 0;
+				char* altName = 0;
+				Boat boat;
+				memset(&boat, 0, sizeof(Boat));
+
+				int rc = -1;
+				if (getStr(&r, &name) && name && getStr(&r, &group) && getStr(&r, &altName) && getFields(&r, FIELDS_ALL, &boat))
+				{
+					rc = funcs->add(ctx, id, name, group, altName, &boat);
+				}
+
+				free(name);
+				free(group);
+				free(altName);
+
+				if (rc != 0)
+				{
+					return -2;
+				}
+
+				break;
+			}
+			case REC_UPDATE:
+			{
+				uint8_t mask;
+				Boat* boat;
+				if (!getBytes(&r, &mask, 1) || !(boat = funcs->get(ctx, id)) || !getFields(&r, mask, boat))
+				{
+					return -2;
+				}
+
+				break;
+			}
+			case REC_REMOVE:
+				if (0 != funcs->remove(ctx, id))
+				{
+					return -2;
+				}
+
+				break;
+			default:
+				return -1;
+		}
+	}
+
+	return (r.p == r.end) ? 0 : -1;
+}
+
+
+static void* acceptThreadMain()
+{
+	for (;;)
+	{
+		const int fd = accept(_listenFd, 0, 0);
+		if (fd < 0)
+		{
+			ERRLOG1("Failed to accept replica connection! errno=%d", errno);
+			sleep(1);
+			continue;
+		}
+
+		// Don't let a stuck replica hold up the stream for everyone else.
+		struct timeval tv = { .tv_sec = REPLICA_SEND_TIMEOUT_SEC, .tv_usec = 0 };
+		if (0 != setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(struct timeval)))
+		{
+			ERRLOG1("Failed to set replica socket send timeout! errno=%d", errno);
+		}
+
+		uint8_t hello[HELLO_SIZE];
+		const uint32_t magic = REPLICATION_MAGIC;
+		const uint16_t version = REPLICATION_VERSION;
+		memset(hello, 0, HELLO_SIZE);
+		memcpy(hello, &magic, 4);
+		memcpy(hello + 4, &version, 2);
+
+		if (0 != writeAll(fd, hello, HELLO_SIZE))
+		{
+			close(fd);
+			continue;
+		}
+
+		pthread_mutex_lock(&_pendingLock);
+		const bool full = (_pendingCount + atomic_load(&_liveReplicaCount) >= MAX_REPLICAS);
+		if (!full)
+		{
+			_pendingFds[_pendingCount++] = fd;
+		}
+		pthread_mutex_unlock(&_pendingLock);
+
+		if (full)
+		{
+			ERRLOG("Too many replicas, so rejecting new replica connection.");
+			close(fd);
+		}
+		else
+		{
+			ERRLOG1("Replica connected (fd=%d), waiting for next tick to send snapshot", fd);
+		}
+	}
+
+	return 0;
+}
+
+static void* sendThreadMain()
+{
+	int fds[MAX_REPLICAS];
+	int fdCount = 0;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&_msgsLock);
+		while (!_msgs)
+		{
+			pthread_cond_wait(&_msgsCond, &_msgsLock);
+		}
+
+		ReplicationMsg* msg = _msgs;
+		_msgs = msg->next;
+		if (!_msgs)
+		{
+			_msgsLast = 0;
+		}
+		pthread_mutex_unlock(&_msgsLock);
+
+		if (msg->dropAll)
+		{
+			for (int i = 0; i < fdCount; i++)
+			{
+				close(fds[i]);
+			}
+
+			atomic_fetch_sub(&_liveReplicaCount, fdCount);
+			fdCount = 0;
+		}
+		else if (msg->targetFd >= 0)
+		{
+			// Snapshot for a new replica, which gets all deltas from here on.
+			if (0 == writeAll(msg->targetFd, msg->buf.data, msg->buf.len))
+			{
+				fds[fdCount++] = msg->targetFd;
+			}
+			else
+			{
+				ERRLOG1("Failed to send snapshot to replica (fd=%d)!", msg->targetFd);
+				close(msg->targetFd);
+				atomic_fetch_sub(&_liveReplicaCount, 1);
+			}
+		}
+		else
+		{
+			for (int i = 0; i < fdCount; i++)
+			{
+				if (0 != writeAll(fds[i], msg->buf.data, msg->buf.len))
+				{
+					ERRLOG2("Failed to send delta to replica (fd=%d)! errno=%d Dropping replica.", fds[i], errno);
+					close(fds[i]);
+					atomic_fetch_sub(&_liveReplicaCount, 1);
+
+					fds[i--] = fds[--fdCount];
+				}
+			}
+		}
+
+		freeMsg(msg);
+	}
+
+	return 0;
+}
+
+static void* replicaThreadMain()
+{
+	for (;;)
+	{
+		const int fd = connectPrimary(_replicaPath);
+		if (fd >= 0)
+		{
+			receiveFrames(fd);
+			close(fd);
+
+			ERRLOG("Lost replication stream. Reconnecting...");
+		}
+
+		sleep(REPLICA_RECONNECT_DELAY_SEC);
+	}
+
+	return 0;
+}
+
+static int startThread(pthread_t* thread, void* (*threadMain)(), const char* name)
+{
+	if (0 != pthread_create(thread, 0, threadMain, 0))
+	{
+		ERRLOG1("Failed to start %s thread!", name);
+		return -1;
+	}
+
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+	if (0 != pthread_setname_np(*thread, name))
+	{
+		ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", name);
+	}
+#endif
+
+	return 0;
+}
+
+
+static ReplicationMsg* newMsg(int targetFd)
+{
+	ReplicationMsg* msg = malloc(sizeof(ReplicationMsg));
+	if (!msg)
+	{
+		ERRLOG("Failed to alloc ReplicationMsg!");
+		return 0;
+	}
+
+	memset(msg, 0, sizeof(ReplicationMsg));
+	msg->targetFd = targetFd;
+
+	return msg;
+}
+
+static void freeMsg(ReplicationMsg* msg)
+{
+	if (msg)
+	{
+		ReplicationBuf_free(&msg->buf);
+		free(msg);
+	}
+}
+
+static void queueMsg(ReplicationMsg* msg)
+{
+	pthread_mutex_lock(&_msgsLock);
+
+	if (_msgsLast)
+	{
+		_msgsLast->next = msg;
+	}
+	else
+	{
+		_msgs = msg;
+	}
+	_msgsLast = msg;
+
+	pthread_cond_signal(&_msgsCond);
+	pthread_mutex_unlock(&_msgsLock);
+}
+
+
+static int writeAll(int fd, const void* buf, size_t len)
+{
+	size_t wt = 0;
+
+	while (wt < len)
+	{
+		// MSG_NOSIGNAL, so that a replica going away can't take down the primary with SIGPIPE.
+		const ssize_t wb = send(fd, ((const uint8_t*) buf) + wt, len - wt, MSG_NOSIGNAL);
+		if (wb < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return -1;
+		}
+
+		wt += wb;
+	}
+
+	return 0;
+}
+
+static int readAll(int fd, void* buf, size_t len)
+{
+	size_t rt = 0;
+
+	while (rt < len)
+	{
+		const ssize_t rb = read(fd, ((uint8_t*) buf) + rt, len - rt);
+		if (rb < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (rb <= 0)
+		{
+			return -1;
+		}
+
+		rt += rb;
+	}
+
+	return 0;
+}
+
+static int connectPrimary(const char* path)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(sa.sun_path))
+	{
+		ERRLOG("Replication socket path is too long!");
+		return -1;
+	}
+	strcpy(sa.sun_path, path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		ERRLOG1("Failed to open socket! errno=%d", errno);
+		return -1;
+	}
+
+	if (0 != connect(fd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)))
+	{
+		close(fd);
+		return -1;
+	}
+
+	uint8_t hello[HELLO_SIZE];
+	uint32_t magic;
+	uint16_t version;
+
+	if (0 != readAll(fd, hello, HELLO_SIZE))
+	{
+		ERRLOG("Failed to read replication stream hello!");
+		close(fd);
+		return -1;
+	}
+
+	memcpy(&magic, hello, 4);
+	memcpy(&version, hello + 4, 2);
+
+	if (magic != REPLICATION_MAGIC || version != REPLICATION_VERSION)
+	{
+		ERRLOG2("Unexpected replication stream magic/version: %x/%u", magic, version);
+		close(fd);
+		return -1;
+	}
+
+	ERRLOG1("Connected to primary at %s, waiting for snapshot", path);
+	return fd;
+}
+
+static int receiveFrames(int fd)
+{
+	static const ReplicationApplyFuncs funcs = {
+		&replicaReset,
+		&replicaAdd,
+		&replicaGet,
+		&replicaRemove
+	};
+
+	uint8_t* payload = 0;
+	uint32_t payloadCap = 0;
+	bool synced = false;
+	int rc = 0;
+
+	unsigned int statsFrames = 0;
+	double statsLagMsTotal = 0.0;
+	double statsLagMsMax = 0.0;
+
+	for (;;)
+	{
+		uint32_t len;
+		if (0 != readAll(fd, &len, 4) || len > FRAME_MAX_PAYLOAD_SIZE)
+		{
+			rc = -1;
+			break;
+		}
+
+		if (len > payloadCap)
+		{
+			uint8_t* p = realloc(payload, len);
+			if (!p)
+			{
+				ERRLOG("Failed to alloc replication frame buffer!");
+				rc = -2;
+				break;
+			}
+
+			payload = p;
+			payloadCap = len;
+		}
+
+		if (0 != readAll(fd, payload, len))
+		{
+			rc = -1;
+			break;
+		}
+
+		if (BoatRegistry_OK != BoatRegistry_wrlock())
+		{
+			ERRLOG("Failed to write-lock BoatRegistry lock for replication frame!");
+		}
+
+		ReplicationFrameInfo info;
+		const int arc = Replication_applyFrame(payload, len, &funcs, 0, &info);
+
+		if (BoatRegistry_OK != BoatRegistry_unlock())
+		{
+			ERRLOG("Failed to unlock BoatRegistry lock after replication frame!");
+		}
+
+		if (arc != 0 || (!synced && !info.snapshot))
+		{
+			ERRLOG1("Failed to apply replication frame! rc=%d", arc);
+			rc = -3;
+			break;
+		}
+
+		if (info.snapshot)
+		{
+			ERRLOG2("Applied snapshot with %u boats for tick %ld", info.recordCount, (long) info.tickTime);
+			synced = true;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		const double lagMs = ((double) ((now.tv_sec * 1000000000L + now.tv_nsec) - info.publishTimeNs)) / 1000000.0;
+
+		statsLagMsTotal += lagMs;
+		if (lagMs > statsLagMsMax)
+		{
+			statsLagMsMax = lagMs;
+		}
+
+		if (++statsFrames == STATS_INTERVAL)
+		{
+			ERRLOG4("Applied %u frames (up to tick %ld): lag avg %.3f ms, max %.3f ms",
+					statsFrames,
+					(long) info.tickTime,
+					statsLagMsTotal / statsFrames,
+					statsLagMsMax);
+
+			statsFrames = 0;
+			statsLagMsTotal = 0.0;
+			statsLagMsMax = 0.0;
+		}
+	}
+
+	free(payload);
+	return rc;
+}
+
+
+static void replicaReset(void* ctx)
+{
+	for (uint32_t id = 0; id < _replicaBoatsCap; id++)
+	{
+		if (_replicaBoats[id].name)
+		{
+			replicaRemove(ctx, id);
+		}
+	}
+}
+
+static int replicaAdd(void* ctx, uint32_t id, const char* name, const char* group, const char* altName, const Boat* boat)
+{
+	(void) ctx;
+
+	if (id >= _replicaBoatsCap)
+	{
+		uint32_t newCap = (_replicaBoatsCap > 0) ? _replicaBoatsCap : 1024;
+		while (newCap <= id)
+		{
+			newCap *= 2;
+		}
+
+		ReplicaBoat* rb = realloc(_replicaBoats, newCap * sizeof(ReplicaBoat));
+		if (!rb)
+		{
+			ERRLOG("Failed to alloc replica boats!");
+			return -1;
+		}
+
+		memset(rb + _replicaBoatsCap, 0, (newCap - _replicaBoatsCap) * sizeof(ReplicaBoat));
+		_replicaBoats = rb;
+		_replicaBoatsCap = newCap;
+	}
+
+	if (_replicaBoats[id].name)
+	{
+		ERRLOG1("Replica boat id %u already in use!", id);
+		return -1;
+	}
+
+	Boat* b = Boat_new(0.0, 0.0, 0, 0);
+	char* n = strdup(name);
+	if (!b || !n)
+	{
+		ERRLOG("Failed to alloc replica boat!");
+		Boat_free(b);
+		free(n);
+		return -1;
+	}
+
+	*b = *boat;
+
+	int rc;
+	if (BoatRegistry_OK != (rc = BoatRegistry_add(b, name, group, altName)))
+	{
+		ERRLOG2("Failed to add replica boat to registry! rc=%d, name=%s", rc, name);
+		Boat_free(b);
+		free(n);
+		return -1;
+	}
+
+	_replicaBoats[id].name = n;
+	_replicaBoats[id].boat = b;
+
+	return 0;
+}
+
+static Boat* replicaGet(void* ctx, uint32_t id)
+{
+	(void) ctx;
+	return (id < _replicaBoatsCap) ? _replicaBoats[id].boat : 0;
+}
+
+static int replicaRemove(void* ctx, uint32_t id)
+{
+	(void) ctx;
+
+	if (id >= _replicaBoatsCap || !_replicaBoats[id].name)
+	{
+		return -1;
+	}
+
+	Boat* b = BoatRegistry_remove(_replicaBoats[id].name);
+	Boat_free(b);
+	free(_replicaBoats[id].name);
+
+	_replicaBoats[id].name = 0;
+	_replicaBoats[id].boat = 0;
+
+	return 0;
+}
+
+
+static uint32_t hashPtr(const BoatEntry* entry)
+{
+	uint64_t h = (uint64_t) (uintptr_t) entry;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+	return (uint32_t) h;
+}
+
+static uint32_t indexFind(const BoatEntry* entry)
+{
+	if (_indexCap == 0)
+	{
+		return NO_ID;
+	}
+
+	const uint32_t mask = _indexCap - 1;
+	for (uint32_t i = hashPtr(entry) & mask; _index[i] != 0; i = (i + 1) & mask)
+	{
+		if (_shadows[_index[i] - 1].entry == entry)
+		{
+			return _index[i] - 1;
+		}
+	}
+
+	return NO_ID;
+}
+
+static int indexInsert(const BoatEntry* entry, uint32_t id)
+{
+	if ((_indexCount + 1) * 2 > _indexCap)
+	{
+		// Grow (keeping load factor at most 1/2) and rehash.
+		const uint32_t newCap = (_indexCap > 0) ? _indexCap * 2 : 1024;
+		uint32_t* newIndex = calloc(newCap, sizeof(uint32_t));
+		if (!newIndex)
+		{
+			ERRLOG("Failed to alloc replication index!");
+			return -1;
+		}
+
+		for (uint32_t j = 0; j < _indexCap; j++)
+		{
+			if (_index[j] != 0)
+			{
+				uint32_t i = hashPtr(_shadows[_index[j] - 1].entry) & (newCap - 1);
+				while (newIndex[i] != 0)
+				{
+					i = (i + 1) & (newCap - 1);
+				}
+				newIndex[i] = _index[j];
+			}
+		}
+
+		free(_index);
+		_index = newIndex;
+		_indexCap = newCap;
+	}
+
+	const uint32_t mask = _indexCap - 1;
+	uint32_t i = hashPtr(entry) & mask;
+	while (_index[i] != 0)
+	{
+		i = (i + 1) & mask;
+	}
+
+	_index[i] = id + 1;
+	_indexCount++;
+
+	return 0;
+}
+
+static void indexRemove(const BoatEntry* entry)
+{
+	const uint32_t mask = _indexCap - 1;
+
+	uint32_t i = hashPtr(entry) & mask;
+	while (_index[i] != 0 && _shadows[_index[i] - 1].entry != entry)
+	{
+		i = (i + 1) & mask;
+	}
+
+	if (_index[i] == 0)
+	{
+		return;
+	}
+
+	_indexCount--;
+
+	// Backward shift deletion, so that no tombstones are needed.
+	for (;;)
+	{
+		_index[i] = 0;
+
+		uint32_t j = i;
+		for (;;)
+		{
+			j = (j + 1) & mask;
+			if (_index[j] == 0)
+			{
+				return;
+			}
+
+			// Entry at j may stay if its home slot k is cyclically in (i, j].
+			const uint32_t k = hashPtr(_shadows[_index[j] - 1].entry) & mask;
+			if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			{
+				continue;
+			}
+
+			break;
+		}
+
+		_index[i] = _index[j];
+		i = j;
+	}
+}
+
+
+static uint32_t shadowAdd(const BoatEntry* entry, const Boat* boat)
+{
+	uint32_t id;
+
+	if (_freeIdCount > 0)
+	{
+		id = _freeIds[--_freeIdCount];
+	}
+	else
+	{
+		if (_nextId == _shadowsCap)
+		{
+			const uint32_t newCap = (_shadowsCap > 0) ? _shadowsCap * 2 : 1024;
+
+			Shadow* s = realloc(_shadows, newCap * sizeof(Shadow));
+			if (!s)
+			{
+				ERRLOG("Failed to alloc replication shadows!");
+				return NO_ID;
+			}
+			_shadows = s;
+
+			uint32_t* f = realloc(_freeIds, newCap * sizeof(uint32_t));
+			if (!f)
+			{
+				ERRLOG("Failed to alloc replication free ids!");
+				return NO_ID;
+			}
+			_freeIds = f;
+
+			_shadowsCap = newCap;
+		}
+
+		id = _nextId++;
+	}
+
+	Shadow* s = _shadows + id;
+	s->entry = entry;
+	s->name = strdup(entry->name);
+	s->group = (entry->group ? strdup(entry->group) : 0);
+	s->altName = (entry->altName ? strdup(entry->altName) : 0);
+	s->boat = *boat;
+	s->gen = _gen;
+
+	if (!s->name || (entry->group && !s->group) || (entry->altName && !s->altName) || 0 != indexInsert(entry, id))
+	{
+		ERRLOG("Failed to alloc replication shadow!");
+		free(s->name);
+		free(s->group);
+		free(s->altName);
+		s->entry = 0;
+		_freeIds[_freeIdCount++] = id;
+		return NO_ID;
+	}
+
+	return id;
+}
+
+static void shadowRemove(uint32_t id)
+{
+	Shadow* s = _shadows + id;
+
+	indexRemove(s->entry);
+
+	free(s->name);
+	free(s->group);
+	free(s->altName);
+	s->entry = 0;
+
+	_freeIds[_freeIdCount++] = id;
+}
+
+static bool shadowMatches(const Shadow* s, const BoatEntry* entry)
+{
+	if (strcmp(s->name, entry->name) != 0)
+	{
+		return false;
+	}
+
+	if (!s->group || !entry->group)
+	{
+		return (s->group == entry->group);
+	}
+
+	return (strcmp(s->group, entry->group) == 0);
+}
+
+
+static int bufReserve(ReplicationBuf* buf, size_t n)
+{
+	if (buf->len + n <= buf->cap)
+	{
+		return 0;
+	}
+
+	size_t newCap = (buf->cap > 0) ? buf->cap : 4096;
+	while (newCap < buf->len + n)
+	{
+		newCap *= 2;
+	}
+
+	uint8_t* d = realloc(buf->data, newCap);
+	if (!d)
+	{
+		ERRLOG("Failed to alloc replication buffer!");
+		return -1;
+	}
+
+	buf->data = d;
+	buf->cap = newCap;
+
+	return 0;
+}
+
+#define PUT(buf, v) do { memcpy((buf)->data + (buf)->len, &(v), sizeof(v)); (buf)->len += sizeof(v); } while (0)
+
+static int beginFrame(ReplicationBuf* buf, bool snapshot, time_t tickTime)
+{
+	if (0 != bufReserve(buf, FRAME_HEADER_SIZE))
+	{
+		return -1;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	const uint32_t len = 0; // Filled in by endFrame().
+	const uint8_t flags = (snapshot ? FRAME_FLAG_SNAPSHOT : 0);
+	const int64_t t = tickTime;
+	const int64_t publishTimeNs = now.tv_sec * 1000000000L + now.tv_nsec;
+	const uint32_t recordCount = 0; // Filled in by endFrame().
+
+	PUT(buf, len);
+	PUT(buf, flags);
+	PUT(buf, t);
+	PUT(buf, publishTimeNs);
+	PUT(buf, recordCount);
+
+	return 0;
+}
+
+static void endFrame(ReplicationBuf* buf, size_t frameStart, uint32_t recordCount)
+{
+	const uint32_t len = buf->len - frameStart - 4;
+
+	memcpy(buf->data + frameStart, &len, 4);
+	memcpy(buf->data + frameStart + FRAME_RECORD_COUNT_OFFSET, &recordCount, 4);
+}
+
+static int putStr(ReplicationBuf* buf, const char* s)
+{
+	const size_t slen = (s ? strlen(s) : 0);
+	if (slen > STR_MAX_LEN || 0 != bufReserve(buf, 2 + slen))
+	{
+		return -1;
+	}
+
+	const uint16_t len = (s ? slen : STR_NULL);
+	PUT(buf, len);
+
+	memcpy(buf->data + buf->len, s, slen);
+	buf->len += slen;
+
+	return 0;
+}
+
+static int putAdd(ReplicationBuf* buf, uint32_t id, const char* name, const char* group, const char* altName, const Boat* boat)
+{
+	const uint8_t type = REC_ADD;
+
+	if (0 != bufReserve(buf, 5))
+	{
+		return -1;
+	}
+
+	PUT(buf, type);
+	PUT(buf, id);
+
+	if (0 != putStr(buf, name) || 0 != putStr(buf, group) || 0 != putStr(buf, altName) || 0 != bufReserve(buf, FIELDS_MAX_SIZE))
+	{
+		return -1;
+	}
+
+	putFields(buf, FIELDS_ALL, boat);
+	return 0;
+}
+
+static int putUpdate(ReplicationBuf* buf, uint32_t id, uint8_t mask, const Boat* boat)
+{
+	const uint8_t type = REC_UPDATE;
+
+	if (0 != bufReserve(buf, 6 + FIELDS_MAX_SIZE))
+	{
+		return -1;
+	}
+
+	PUT(buf, type);
+	PUT(buf, id);
+	PUT(buf, mask);
+
+	putFields(buf, mask, boat);
+	return 0;
+}
+
+static int putRemove(ReplicationBuf* buf, uint32_t id)
+{
+	const uint8_t type = REC_REMOVE;
+
+	if (0 != bufReserve(buf, 5))
+	{
+		return -1;
+	}
+
+	PUT(buf, type);
+	PUT(buf, id);
+
+	return 0;
+}
+
+static void putFields(ReplicationBuf* buf, uint8_t mask, const Boat* boat)
+{
+	if (mask & FIELDS_POS)
+	{
+		PUT(buf, boat->pos.lat);
+		PUT(buf, boat->pos.lon);
+	}
+
+	if (mask & FIELDS_V)
+	{
+		PUT(buf, boat->v.angle);
+		PUT(buf, boat->v.mag);
+	}
+
+	if (mask & FIELDS_VGROUND)
+	{
+		PUT(buf, boat->vGround.angle);
+		PUT(buf, boat->vGround.mag);
+	}
+
+	if (mask & FIELDS_COURSE)
+	{
+		const uint8_t courseMagnetic = boat->courseMagnetic;
+		const uint8_t setImmediateDesiredCourse = boat->setImmediateDesiredCourse;
+
+		PUT(buf, boat->desiredCourse);
+		PUT(buf, courseMagnetic);
+		PUT(buf, setImmediateDesiredCourse);
+	}
+
+	if (mask & FIELDS_MOTION)
+	{
+		PUT(buf, boat->distanceTravelled);
+		PUT(buf, boat->leewaySpeed);
+		PUT(buf, boat->heelingAngle);
+	}
+
+	if (mask & FIELDS_STATE)
+	{
+		const int32_t boatType = boat->boatType;
+		const int32_t boatFlags = boat->boatFlags;
+		const int32_t startingFromLandCount = boat->startingFromLandCount;
+		const uint8_t stop = boat->stop;
+		const uint8_t sailsDown = boat->sailsDown;
+		const uint8_t movingToSea = boat->movingToSea;
+
+		PUT(buf, boat->damage);
+		PUT(buf, boat->sailArea);
+		PUT(buf, boatType);
+		PUT(buf, boatFlags);
+		PUT(buf, startingFromLandCount);
+		PUT(buf, stop);
+		PUT(buf, sailsDown);
+		PUT(buf, movingToSea);
+	}
+}
+
+#define FIELD_DIFF(a, b, f) (memcmp(&(a)->f, &(b)->f, sizeof((a)->f)) != 0)
+
+static uint8_t changedFields(const Boat* a, const Boat* b)
+{
+	uint8_t mask = 0;
+
+	if (FIELD_DIFF(a, b, pos.lat) || FIELD_DIFF(a, b, pos.lon))
+	{
+		mask |= FIELDS_POS;
+	}
+
+	if (FIELD_DIFF(a, b, v.angle) || FIELD_DIFF(a, b, v.mag))
+	{
+		mask |= FIELDS_V;
+	}
+
+	if (FIELD_DIFF(a, b, vGround.angle) || FIELD_DIFF(a, b, vGround.mag))
+	{
+		mask |= FIELDS_VGROUND;
+	}
+
+	if (FIELD_DIFF(a, b, desiredCourse) || a->courseMagnetic != b->courseMagnetic || a->setImmediateDesiredCourse != b->setImmediateDesiredCourse)
+	{
+		mask |= FIELDS_COURSE;
+	}
+
+	if (FIELD_DIFF(a, b, distanceTravelled) || FIELD_DIFF(a, b, leewaySpeed) || FIELD_DIFF(a, b, heelingAngle))
+	{
+		mask |= FIELDS_MOTION;
+	}
+
+	if (FIELD_DIFF(a, b, damage) || FIELD_DIFF(a, b, sailArea) ||
+			a->boatType != b->boatType || a->boatFlags != b->boatFlags || a->startingFromLandCount != b->startingFromLandCount ||
+			a->stop != b->stop || a->sailsDown != b->sailsDown || a->movingToSea != b->movingToSea)
+	{
+		mask |= FIELDS_STATE;
+	}
+
+	return mask;
+}
+
+
+static bool getBytes(Reader* r, void* v, size_t n)
+{
+	if ((size_t) (r->end - r->p) < n)
+	{
+		return false;
+	}
+
+	memcpy(v, r->p, n);
+	r->p += n;
+
+	return true;
+}
+
+static bool getStr(Reader* r, char** s)
+{
+	uint16_t len;
+	if (!getBytes(r, &len, 2))
+	{
+		return false;
+	}
+
+	if (len == STR_NULL)
+	{
+		*s = 0;
+		return true;
+	}
+
+	if ((size_t) (r->end - r->p) < len || !(*s = malloc(len + 1)))
+	{
+		return false;
+	}
+
+	memcpy(*s, r->p, len);
+	(*s)[len] = 0;
+	r->p += len;
+
+	return true;
+}
+
+#define GET(r, v) getBytes((r), &(v), sizeof(v))
+
+static bool getFields(Reader* r, uint8_t mask, Boat* boat)
+{
+	if (mask & ~FIELDS_ALL)
+	{
+		return false;
+	}
+
+	if ((mask & FIELDS_POS) && !(GET(r, boat->pos.lat) && GET(r, boat->pos.lon)))
+	{
+		return false;
+	}
+
+	if ((mask & FIELDS_V) && !(GET(r, boat->v.angle) && GET(r, boat->v.mag)))
+	{
+		return false;
+	}
+
+	if ((mask & FIELDS_VGROUND) && !(GET(r, boat->vGround.angle) && GET(r, boat->vGround.mag)))
+	{
+		return false;
+	}
+
+	if (mask & FIELDS_COURSE)
+	{
+		uint8_t courseMagnetic;
+		uint8_t setImmediateDesiredCourse;
+
+		if (!(GET(r, boat->desiredCourse) && GET(r, courseMagnetic) && GET(r, setImmediateDesiredCourse)))
+		{
+			return false;
+		}
+
+		boat->courseMagnetic = courseMagnetic;
+		boat->setImmediateDesiredCourse = setImmediateDesiredCourse;
+	}
+
+	if ((mask & FIELDS_MOTION) && !(GET(r, boat->distanceTravelled) && GET(r, boat->leewaySpeed) && GET(r, boat->heelingAngle)))
+	{
+		return false;
+	}
+
+	if (mask & FIELDS_STATE)
+	{
+		int32_t boatType;
+		int32_t boatFlags;
+		int32_t startingFromLandCount;
+		uint8_t stop;
+		uint8_t sailsDown;
+		uint8_t movingToSea;
+
+		if (!(GET(r, boat->damage) && GET(r, boat->sailArea) &&
+				GET(r, boatType) && GET(r, boatFlags) && GET(r, startingFromLandCount) &&
+				GET(r, stop) && GET(r, sailsDown) && GET(r, movingToSea)))
+		{
+			return false;
+		}
+
+		boat->boatType = boatType;
+		boat->boatFlags = boatFlags;
+		boat->startingFromLandCount = startingFromLandCount;
+		boat->stop = stop;
+		boat->sailsDown = sailsDown;
+		boat->movingToSea = movingToSea;
+	}
+
+	return true;
+}
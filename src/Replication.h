@@ -0,0 +1,87 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Replication_h_
+#define _Replication_h_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "Boat.h"
+
+
+// Primary side: a unix socket (--replstream) on which read-only replicas connect. Each replica gets a
+// snapshot of all boats, then a compact binary delta (boats added/removed and changed fields) every tick.
+
+int Replication_initPrimary(const char* path);
+
+// Must be called from the main simulation thread (the only thread which modifies boats or the registry),
+// after all boat advances and commands for the tick have been applied.
+void Replication_publishTick(time_t tickTime);
+
+
+// Replica side: connects to the primary's stream (--replica), keeps the local BoatRegistry identical to the
+// primary's, and reconnects (resyncing from a new snapshot) if the stream is lost.
+
+int Replication_initReplica(const char* path);
+
+// NetServer request handler for replicas, which rejects commands.
+int Replication_handleReplicaRequest(int writeFd, char* reqStr);
+
+
+// Stream encoding/decoding (exposed for testing)
+
+typedef struct
+{
+	uint8_t* data;
+	size_t len;
+	size_t cap;
+} ReplicationBuf;
+
+typedef struct
+{
+	void (*reset)(void* ctx);
+	int (*add)(void* ctx, uint32_t id, const char* name, const char* group, const char* altName, const Boat* boat);
+	Boat* (*get)(void* ctx, uint32_t id);
+	int (*remove)(void* ctx, uint32_t id);
+} ReplicationApplyFuncs;
+
+typedef struct
+{
+	bool snapshot;
+	int64_t tickTime;
+	int64_t publishTimeNs;
+	uint32_t recordCount;
+} ReplicationFrameInfo;
+
+void ReplicationBuf_free(ReplicationBuf* buf);
+
+// Appends one frame with changes in the boat registry since the last call (or all boats, on the first call).
+int Replication_encodeDelta(time_t tickTime, ReplicationBuf* out);
+
+// Appends one frame with all boats as of the last Replication_encodeDelta() call.
+int Replication_encodeSnapshot(time_t tickTime, ReplicationBuf* out);
+
+// Drops all state held for producing deltas.
+void Replication_resetPrimaryState();
+
+// Applies one frame payload (i.e. excluding the leading length field).
+int Replication_applyFrame(const uint8_t* payload, size_t len, const ReplicationApplyFuncs* funcs, void* ctx, ReplicationFrameInfo* info);
+
+
+#endif // _Replication_h_
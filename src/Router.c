@@ -0,0 +1,977 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "Router.h"
+
+#include "ErrLog.h"
+#include "Shard.h"
+
+
+#define ERRLOG_ID "Router"
+#define THREAD_NAME "RouterCmds"
+
+
+// The router accepts the same request protocol as NetServer (and the same command protocol as the
+// command input FIFO) and forwards each request/command to the shard process owning the boat, over
+// the shards' NetServer unix sockets. Each NetServer worker thread keeps its own connection to each shard.
+
+static const char* REQ_STR_GET_BOAT_DATA =		"bd";
+static const char* REQ_STR_GET_BOAT_DATA_NO_CELESTIAL =	"bd_nc";
+static const char* REQ_STR_BOAT_CMD =			"boatcmd";
+static const char* REQ_STR_BOAT_GROUP_MEMBERSHIP =	"boatgroupmembers";
+static const char* REQ_STR_GROUP_PROXIMITY =		"group_proximity";
+static const char* REQ_STR_SYS_REQUEST_COUNTS =		"sys_req_counts";
+static const char* REQ_STR_FLEET_TILE =			"fleet_tile";
+static const char* REQ_STR_BOAT_CMD_SYNC =		"boatcmd_sync";
+static const char* REQ_STR_GROUP_ETA =			"eta";
+
+static const char* CMD_ACTION_STR_ADD_BOAT = "add";
+static const char* CMD_ACTION_STR_ADD_BOAT_WITH_GROUP = "add_g";
+static const char* CMD_ACTION_STR_REMOVE_BOAT = "remove";
+static const char* CMD_ACTION_STR_ADD_MARK = "mark";
+static const char* CMD_ACTION_STR_REMOVE_MARK = "mark_remove";
+static const char* CMD_ACTION_STR_ADD_GHOST = "add_ghost";
+
+// Group commands (start, stop, course and remove), all starting with this
+static const char* CMD_ACTION_STR_GROUP_PREFIX = "group_";
+
+// Index of group name value (after boat name and action) in "add_g" and "add_ghost" commands
+#define CMD_ADD_BOAT_WITH_GROUP_GROUP_INDEX (6)
+#define CMD_ADD_GHOST_GROUP_INDEX (4)
+
+// Optional execution time prefix of scheduled commands
+#define CMD_EXEC_TIME_PREFIX '@'
+
+// Optional client token prefix of boat commands
+#define CMD_TOKEN_PREFIX '#'
+
+
+#define REQ_BUF_SIZE (1024)
+#define RESP_BUF_SIZE (64 * 1024)
+#define COMMAND_BUF_SIZE (1024)
+
+// Boat command responses (from each shard, for commands sent to all shards)
+#define CMD_RESP_BUF_SIZE (256)
+
+#define MAX_MERGED_VALUES (256)
+
+// Sub-tiles per fleet tile response (see FleetTiles.h)
+#define MAX_MERGED_TILES (64)
+
+#define SHARD_RECV_TIMEOUT_SEC (10)
+
+
+// Lock-free cache of boat (group and name) to owning shard, learned from adds and lookups, with a slot per name (hash).
+// Each slot holds the upper 40 bits of the name hash, a 16 bit tag of the boat's group, and the shard index in the
+// lower 8 bits. A name added in one group and then in another (without a remove in between) may be owned by two shards,
+// so its slot is marked ambiguous (and requests for it fan out) until the name is removed.
+//
+// An entry may still be stale (e.g. the boat since removed by its shard, or not restored yet), so it's only ever
+// trusted once the cached shard has answered for the boat: requests and sync commands get a "noboat" answer, while
+// plain commands (which a shard takes whether or not it has the boat) are only sent once the shard says it has the boat.
+// Otherwise, the request or command fans out to all shards.
+#define OWNER_CACHE_SIZE (1 << 16)
+static atomic_uint_fast64_t _ownerCache[OWNER_CACHE_SIZE];
+
+// Group tags of boats whose group isn't known (learned from lookups) and of boats without a group
+#define OWNER_CACHE_GROUP_UNKNOWN (0)
+#define OWNER_CACHE_GROUP_NONE (1)
+
+// Shard index of names owned by more than one shard (not a valid index, see SHARD_MAX_COUNT)
+#define OWNER_CACHE_AMBIGUOUS (0xff)
+
+
+static unsigned int _shardCount = 0;
+static char** _shardPaths = 0;
+
+static const char* _cmdsInputPath = 0;
+static pthread_t _cmdsThread;
+
+static __thread int _shardFds[SHARD_MAX_COUNT];
+static __thread bool _shardFdsInit = false;
+static __thread unsigned int _nextAnyShard = 0;
+
+
+static void* commandsThreadMain();
+
+static int routeCommand(const char* reqType, const char* cmdStr, char* resp, size_t respSize);
+static bool isCommandDoneResponse(const char* reqType, const char* resp);
+static int forwardToBoatOwner(const char* name, const char* req, bool multiLine, char* resp, size_t respSize);
+static bool shardHasBoat(unsigned int shard, const char* name);
+static int forwardMergeCounts(const char* req, const char* reqType, char* resp, size_t respSize);
+static int forwardMergeTiles(const char* req, char* resp, size_t respSize);
+static int forward(unsigned int shard, const char* req, bool multiLine, char* resp, size_t respSize);
+static void forwardToAll(const char* req, char resps[][CMD_RESP_BUF_SIZE], bool* answered);
+
+static int getShardFd(unsigned int shard);
+static void closeShardFd(unsigned int shard);
+static int connectShard(unsigned int shard);
+static int readResponse(int fd, bool multiLine, char* resp, size_t respSize);
+static int writeAll(int fd, const char* buf, size_t len);
+
+static bool isBoatKeyedRequest(const char* reqType);
+static bool isMultiLineResponse(const char* reqType);
+static bool isFirstLineEndingWith(const char* resp, const char* suffix);
+
+static int ownerCacheGet(const char* name);
+static void ownerCachePut(const char* name, const char* group, bool groupKnown, unsigned int shard);
+static void ownerCacheRemove(const char* name);
+static uint64_t ownerCacheGroupTag(const char* group, bool groupKnown);
+
+
+int Router_init(unsigned int shardCount, const char* shardSockPrefix, const char* cmdsInputPath)
+{
+	if (shardCount < 1 || shardCount > SHARD_MAX_COUNT || !shardSockPrefix)
+	{
+		return -3;
+	}
+
+	_shardPaths = malloc(shardCount * sizeof(char*));
+	if (!_shardPaths)
+	{
+		ERRLOG("Failed to alloc shard paths!");
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < shardCount; i++)
+	{
+		const size_t len = strlen(shardSockPrefix) + 16;
+
+		_shardPaths[i] = malloc(len);
+		if (!_shardPaths[i])
+		{
+			ERRLOG("Failed to alloc shard path!");
+			return -1;
+		}
+
+		snprintf(_shardPaths[i], len, "%s%u", shardSockPrefix, i);
+		ERRLOG2("Shard %u at %s", i, _shardPaths[i]);
+	}
+
+	_shardCount = shardCount;
+
+	if (cmdsInputPath)
+	{
+		_cmdsInputPath = strdup(cmdsInputPath);
+
+		if (0 != pthread_create(&_cmdsThread, 0, &commandsThreadMain, 0))
+		{
+			ERRLOG("Failed to start command forwarding thread!");
+			return -2;
+		}
+
+#if defined(_GNU_SOURCE) && defined(__GLIBC__)
+		if (0 != pthread_setname_np(_cmdsThread, THREAD_NAME))
+		{
+			ERRLOG1("Couldn't set thread name to %s. Continuing anyway.", THREAD_NAME);
+		}
+#endif
+	}
+
+	return 0;
+}
+
+int Router_handleRequest(int writeFd, char* reqStr)
+{
+	char req[REQ_BUF_SIZE];
+	char resp[RESP_BUF_SIZE];
+
+	// Keep an unmodified copy of the request message to forward as is.
+	if (snprintf(req, REQ_BUF_SIZE, "%s\n", reqStr) >= REQ_BUF_SIZE)
+	{
+		goto fail;
+	}
+
+	char* t;
+	const char* reqType = strtok_r(reqStr, ",", &t);
+	if (!reqType)
+	{
+		goto fail;
+	}
+
+	int rc;
+
+	if (strcmp(REQ_STR_BOAT_CMD, reqType) == 0 || strcmp(REQ_STR_BOAT_CMD_SYNC, reqType) == 0)
+	{
+		const char* cmdStr = strtok_r(0, "\n", &t);
+		if (!cmdStr)
+		{
+			goto fail;
+		}
+
+		rc = routeCommand(reqType, cmdStr, resp, RESP_BUF_SIZE);
+	}
+	else if (strcmp(REQ_STR_SYS_REQUEST_COUNTS, reqType) == 0)
+	{
+		rc = forwardMergeCounts(req, reqType, resp, RESP_BUF_SIZE);
+	}
+	else if (strcmp(REQ_STR_FLEET_TILE, reqType) == 0)
+	{
+		rc = forwardMergeTiles(req, resp, RESP_BUF_SIZE);
+	}
+	else if (strcmp(REQ_STR_GROUP_ETA, reqType) == 0)
+	{
+		// Keyed by group name, so answered by the shard owning that group's boats.
+		const char* group = strtok_r(0, ",", &t);
+		if (!group)
+		{
+			goto fail;
+		}
+
+		rc = forward(Shard_ownerOf(group, group, _shardCount), req, true, resp, RESP_BUF_SIZE);
+	}
+	else if (isBoatKeyedRequest(reqType))
+	{
+		const char* name = strtok_r(0, ",", &t);
+		if (!name)
+		{
+			goto fail;
+		}
+
+		rc = forwardToBoatOwner(name, req, isMultiLineResponse(reqType), resp, RESP_BUF_SIZE);
+	}
+	else
+	{
+		// Environment data requests (and anything else) can be answered by any shard, so spread them around.
+		rc = forward(_nextAnyShard++ % _shardCount, req, false, resp, RESP_BUF_SIZE);
+	}
+
+	if (rc != 0)
+	{
+		goto fail;
+	}
+
+	return writeAll(writeFd, resp, strlen(resp));
+
+fail:
+	if (write(writeFd, "error\n", 6) != 6)
+	{
+		return -1;
+	}
+
+	return -1;
+}
+
+
+static void* commandsThreadMain()
+{
+	char buf[COMMAND_BUF_SIZE];
+	char resp[RESP_BUF_SIZE];
+
+	FILE* f = fopen(_cmdsInputPath, "r");
+	if (f == 0)
+	{
+		ERRLOG("Failed to open command input path!");
+		return 0;
+	}
+
+	for (;;)
+	{
+		while (fgets(buf, COMMAND_BUF_SIZE, f) != 0)
+		{
+			// Remove trailing newline, if present.
+			const size_t slen = strlen(buf);
+			if (slen > 0 && buf[slen - 1] == '\n')
+			{
+				buf[slen - 1] = 0;
+			}
+
+			if (routeCommand(REQ_STR_BOAT_CMD, buf, resp, RESP_BUF_SIZE) != 0)
+			{
+				ERRLOG1("Failed to forward command: %s", buf);
+			}
+		}
+
+		clearerr(f);
+		sleep(1);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static int routeCommand(const char* reqType, const char* cmdStr, char* resp, size_t respSize)
+{
+	char req[REQ_BUF_SIZE];
+	if (snprintf(req, REQ_BUF_SIZE, "%s,%s\n", reqType, cmdStr) >= REQ_BUF_SIZE)
+	{
+		return -1;
+	}
+
+	// Pick out the boat name, action and (for adds with group) the group name.
+	char cmdCopy[REQ_BUF_SIZE];
+	strcpy(cmdCopy, cmdStr);
+
+	// Client tokens ("#token,...") and then scheduled commands ("@time,name,action,...") are routed by the rest of the command.
+	char* routeStr = cmdCopy;
+	const char* token = 0;
+	if (routeStr[0] == CMD_TOKEN_PREFIX)
+	{
+		char* e = strchr(routeStr, ',');
+		if (!e)
+		{
+			return -1;
+		}
+
+		*e = 0;
+		token = routeStr + 1;
+		routeStr = e + 1;
+	}
+
+	const bool scheduled = (routeStr[0] == CMD_EXEC_TIME_PREFIX);
+	if (scheduled && !(routeStr = strchr(routeStr, ',')))
+	{
+		return -1;
+	}
+	routeStr += (scheduled ? 1 : 0);
+
+	char* t;
+	const char* name = strtok_r(routeStr, ",", &t);
+	const char* action = (name ? strtok_r(0, ",", &t) : 0);
+	if (!name || !action)
+	{
+		return -1;
+	}
+
+	int owner = -1;
+	bool cached = false;
+
+	if (strcmp(CMD_ACTION_STR_ADD_BOAT, action) == 0)
+	{
+		owner = Shard_ownerOf(name, 0, _shardCount);
+		ownerCachePut(name, 0, true, owner);
+	}
+	else if (strcmp(CMD_ACTION_STR_ADD_BOAT_WITH_GROUP, action) == 0 || strcmp(CMD_ACTION_STR_ADD_GHOST, action) == 0)
+	{
+		const int groupIndex = (strcmp(CMD_ACTION_STR_ADD_GHOST, action) == 0 ? CMD_ADD_GHOST_GROUP_INDEX : CMD_ADD_BOAT_WITH_GROUP_GROUP_INDEX);
+
+		const char* group = 0;
+		for (int i = 2; i <= groupIndex && (group = strtok_r(0, ",", &t)) != 0; i++);
+
+		if (!group)
+		{
+			return -1;
+		}
+
+		owner = Shard_ownerOf(name, group, _shardCount);
+		ownerCachePut(name, group, true, owner);
+	}
+	else if (strcmp(CMD_ACTION_STR_ADD_MARK, action) == 0 || strcmp(CMD_ACTION_STR_REMOVE_MARK, action) == 0 ||
+			strncmp(CMD_ACTION_STR_GROUP_PREFIX, action, strlen(CMD_ACTION_STR_GROUP_PREFIX)) == 0)
+	{
+		// Race mark and group commands are keyed by group name, so go to the shard owning that group's boats.
+		owner = Shard_ownerOf(name, name, _shardCount);
+	}
+	else
+	{
+		owner = ownerCacheGet(name);
+		cached = true;
+	}
+
+	if (!scheduled && strcmp(CMD_ACTION_STR_REMOVE_BOAT, action) == 0)
+	{
+		ownerCacheRemove(name);
+	}
+
+	const bool sync = (strcmp(REQ_STR_BOAT_CMD_SYNC, reqType) == 0);
+
+	if (owner >= 0 && !cached)
+	{
+		// Owner follows from the command itself (adds, and race mark and group commands).
+		return forward(owner, req, false, resp, respSize);
+	}
+	else if (owner >= 0)
+	{
+		// A cached owner may be stale, and a plain command would be taken (and acked) by a shard without the boat, only to
+		// be dropped there. So plain commands are only sent once the cached shard has the boat (and are otherwise sent to
+		// all shards, so that the shard that has it, or is about to have it added, applies it). Sync commands are
+		// answered with "noboat" by a shard without the boat (having done nothing), so are simply sent on again.
+		if (sync ?
+				(forward(owner, req, false, resp, respSize) == 0 && isCommandDoneResponse(reqType, resp)) :
+				(shardHasBoat(owner, name) && forward(owner, req, false, resp, respSize) == 0))
+		{
+			return 0;
+		}
+
+		ownerCacheRemove(name);
+	}
+
+	// Owner not known (or not confirmed), so send the command to all shards, since only the owning shard will find the
+	// boat. Plain commands are taken by every shard (and only applied by the owner), so any shard's "ok" will do. Commands
+	// waiting on completion are answered (by the owner) only once applied, so they go to all shards at once rather than
+	// waiting up to a tick on each in turn.
+	char shardResps[SHARD_MAX_COUNT][CMD_RESP_BUF_SIZE];
+	bool answered[SHARD_MAX_COUNT];
+	forwardToAll(req, shardResps, answered);
+
+	bool anyResp = false;
+	for (unsigned int i = 0; i < _shardCount; i++)
+	{
+		if (!answered[i])
+		{
+			continue;
+		}
+
+		if (isCommandDoneResponse(reqType, shardResps[i]))
+		{
+			snprintf(resp, respSize, "%s", shardResps[i]);
+			return 0;
+		}
+
+		if (!anyResp)
+		{
+			snprintf(resp, respSize, "%s", shardResps[i]);
+			anyResp = true;
+		}
+	}
+
+	if (!anyResp)
+	{
+		snprintf(resp, respSize, "%s,%s%s%s\n", reqType, sync ? "failed" : "fail", token ? "," : "", token ? token : "");
+	}
+
+	return 0;
+}
+
+// Whether a shard's response to a boat command means the shard has taken the command (for plain commands)
+// or has found the boat (for commands waiting on completion).
+static bool isCommandDoneResponse(const char* reqType, const char* resp)
+{
+	const size_t len = strlen(reqType);
+	if (strncmp(resp, reqType, len) != 0 || resp[len] != ',')
+	{
+		return false;
+	}
+
+	if (strcmp(REQ_STR_BOAT_CMD_SYNC, reqType) == 0)
+	{
+		return (strncmp(resp + len + 1, "noboat,", 7) != 0);
+	}
+
+	return (strncmp(resp + len + 1, "ok", 2) == 0 && (resp[len + 3] == ',' || resp[len + 3] == '\n'));
+}
+
+static int forwardToBoatOwner(const char* name, const char* req, bool multiLine, char* resp, size_t respSize)
+{
+	const int cached = ownerCacheGet(name);
+	if (cached >= 0)
+	{
+		if (forward(cached, req, multiLine, resp, respSize) == 0 && !isFirstLineEndingWith(resp, ",noboat"))
+		{
+			return 0;
+		}
+
+		ownerCacheRemove(name);
+	}
+
+	// Owner not known (or no longer owner), so ask each shard in turn.
+	bool answered = false;
+	for (unsigned int i = 0; i < _shardCount; i++)
+	{
+		if ((int) i == cached || forward(i, req, multiLine, resp, respSize) != 0)
+		{
+			continue;
+		}
+
+		answered = true;
+
+		if (!isFirstLineEndingWith(resp, ",noboat"))
+		{
+			ownerCachePut(name, 0, false, i);
+			return 0;
+		}
+	}
+
+	// No shard has this boat, so pass along the last "noboat" response.
+	return (answered ? 0 : -1);
+}
+
+// Whether a shard has a boat (added and restored), asked with a boat data request (answered with "ok" for any boat).
+static bool shardHasBoat(unsigned int shard, const char* name)
+{
+	char req[REQ_BUF_SIZE];
+	char resp[RESP_BUF_SIZE];
+
+	if (snprintf(req, REQ_BUF_SIZE, "%s,%s\n", REQ_STR_GET_BOAT_DATA, name) >= REQ_BUF_SIZE ||
+			forward(shard, req, false, resp, RESP_BUF_SIZE) != 0)
+	{
+		return false;
+	}
+
+	const size_t typeLen = strlen(REQ_STR_GET_BOAT_DATA);
+	const size_t nameLen = strlen(name);
+
+	return (strncmp(resp, REQ_STR_GET_BOAT_DATA, typeLen) == 0 && resp[typeLen] == ',' &&
+			strncmp(resp + typeLen + 1, name, nameLen) == 0 && strncmp(resp + typeLen + 1 + nameLen, ",ok,", 4) == 0);
+}
+
+// Merges (sums) comma-separated counter values from all shards' responses, position by position.
+static int forwardMergeCounts(const char* req, const char* reqType, char* resp, size_t respSize)
+{
+	uint64_t sums[MAX_MERGED_VALUES] = { 0 };
+	int valueCount = 0;
+	bool answered = false;
+
+	for (unsigned int i = 0; i < _shardCount; i++)
+	{
+		if (forward(i, req, false, resp, respSize) != 0)
+		{
+			continue;
+		}
+
+		const char* s = strchr(resp, ',');
+		if (!s || !isdigit((unsigned char) s[1]))
+		{
+			continue;
+		}
+
+		answered = true;
+
+		for (int n = 0; n < MAX_MERGED_VALUES && s && *s == ','; n++)
+		{
+			char* end;
+			sums[n] += strtoull(s + 1, &end, 10);
+			s = end;
+
+			if (n + 1 > valueCount)
+			{
+				valueCount = n + 1;
+			}
+		}
+	}
+
+	if (!answered)
+	{
+		return -1;
+	}
+
+	size_t pos = snprintf(resp, respSize, "%s", reqType);
+	for (int n = 0; n < valueCount && pos < respSize; n++)
+	{
+		pos += snprintf(resp + pos, respSize - pos, ",%lu", sums[n]);
+	}
+
+	if (pos + 2 > respSize)
+	{
+		return -1;
+	}
+
+	resp[pos++] = '\n';
+	resp[pos] = 0;
+
+	return 0;
+}
+
+// Each shard only has aggregates of its own boats, so sum up the counts (and weight the mean positions) of each sub-tile.
+static int forwardMergeTiles(const char* req, char* resp, size_t respSize)
+{
+	int tileZXY[MAX_MERGED_TILES][3];
+	unsigned int counts[MAX_MERGED_TILES];
+	double sumLat[MAX_MERGED_TILES];
+	double sumLon[MAX_MERGED_TILES];
+	int tileCount = 0;
+
+	char header[REQ_BUF_SIZE] = { 0 };
+
+	for (unsigned int i = 0; i < _shardCount; i++)
+	{
+		if (forward(i, req, true, resp, respSize) != 0)
+		{
+			continue;
+		}
+
+		const char* nl = strchr(resp, '\n');
+		if (!isFirstLineEndingWith(resp, ",ok"))
+		{
+			// Disabled or failed, which is the same for all shards.
+			return 0;
+		}
+
+		snprintf(header, sizeof(header), "%.*s", (int) (nl - resp), resp);
+
+		for (const char* line = nl + 1; *line && *line != '\n'; )
+		{
+			int z, x, y;
+			unsigned int count;
+			double lat, lon;
+
+			if (6 != sscanf(line, "%d,%d,%d,%u,%lf,%lf", &z, &x, &y, &count, &lat, &lon))
+			{
+				return -1;
+			}
+
+			int t = 0;
+			while (t < tileCount && !(tileZXY[t][0] == z && tileZXY[t][1] == x && tileZXY[t][2] == y))
+			{
+				t++;
+			}
+
+			if (t == tileCount)
+			{
+				if (tileCount == MAX_MERGED_TILES)
+				{
+					return -1;
+				}
+
+				tileZXY[t][0] = z;
+				tileZXY[t][1] = x;
+				tileZXY[t][2] = y;
+				counts[t] = 0;
+				sumLat[t] = 0.0;
+				sumLon[t] = 0.0;
+				tileCount++;
+			}
+
+			counts[t] += count;
+			sumLat[t] += lat * count;
+			sumLon[t] += lon * count;
+
+			if (!(line = strchr(line, '\n')))
+			{
+				break;
+			}
+			line++;
+		}
+	}
+
+	if (!header[0])
+	{
+		return -1;
+	}
+
+	size_t pos = snprintf(resp, respSize, "%s\n", header);
+	for (int t = 0; t < tileCount && pos < respSize; t++)
+	{
+		pos += snprintf(resp + pos, respSize - pos, "%d,%d,%d,%u,%.5f,%.5f\n", tileZXY[t][0], tileZXY[t][1], tileZXY[t][2], counts[t], sumLat[t] / counts[t], sumLon[t] / counts[t]);
+	}
+
+	if (pos + 2 > respSize)
+	{
+		return -1;
+	}
+
+	resp[pos++] = '\n';
+	resp[pos] = 0;
+
+	return 0;
+}
+
+// Sends a request to a shard and reads back the full response (null-terminated) into resp.
+static int forward(unsigned int shard, const char* req, bool multiLine, char* resp, size_t respSize)
+{
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		const int fd = getShardFd(shard);
+		if (fd < 0)
+		{
+			return -1;
+		}
+
+		if (writeAll(fd, req, strlen(req)) == 0 && readResponse(fd, multiLine, resp, respSize) == 0)
+		{
+			return 0;
+		}
+
+		// Connection may have gone stale (e.g. shard restarted), so reconnect and try once more.
+		closeShardFd(shard);
+	}
+
+	ERRLOG1("Failed to forward request to shard %u!", shard);
+	return -1;
+}
+
+// Sends a (single line response) request to all shards, and only then reads back each shard's response, so that the
+// shards handle it concurrently. Sets answered for each shard that responded.
+static void forwardToAll(const char* req, char resps[][CMD_RESP_BUF_SIZE], bool* answered)
+{
+	const size_t len = strlen(req);
+
+	for (unsigned int i = 0; i < _shardCount; i++)
+	{
+		int fd = getShardFd(i);
+		if (fd >= 0 && writeAll(fd, req, len) != 0)
+		{
+			// Connection may have gone stale (e.g. shard restarted), so reconnect and try once more.
+			closeShardFd(i);
+			if ((fd = getShardFd(i)) >= 0 && writeAll(fd, req, len) != 0)
+			{
+				closeShardFd(i);
+				fd = -1;
+			}
+		}
+
+		answered[i] = (fd >= 0);
+	}
+
+	for (unsigned int i = 0; i < _shardCount; i++)
+	{
+		if (!answered[i])
+		{
+			ERRLOG1("Failed to forward request to shard %u!", i);
+			continue;
+		}
+
+		// Not sent again if the response doesn't come, since the shard may have taken the command.
+		if (readResponse(_shardFds[i], false, resps[i], CMD_RESP_BUF_SIZE) != 0)
+		{
+			ERRLOG1("Failed to read response from shard %u!", i);
+			closeShardFd(i);
+			answered[i] = false;
+		}
+	}
+}
+
+
+static int getShardFd(unsigned int shard)
+{
+	if (!_shardFdsInit)
+	{
+		for (unsigned int i = 0; i < SHARD_MAX_COUNT; i++)
+		{
+			_shardFds[i] = -1;
+		}
+
+		_shardFdsInit = true;
+	}
+
+	if (_shardFds[shard] < 0)
+	{
+		_shardFds[shard] = connectShard(shard);
+	}
+
+	return _shardFds[shard];
+}
+
+static void closeShardFd(unsigned int shard)
+{
+	if (_shardFds[shard] >= 0)
+	{
+		close(_shardFds[shard]);
+		_shardFds[shard] = -1;
+	}
+}
+
+static int connectShard(unsigned int shard)
+{
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+
+	if (strlen(_shardPaths[shard]) >= sizeof(sa.sun_path))
+	{
+		ERRLOG1("Shard %u socket path is too long!", shard);
+		return -1;
+	}
+	strcpy(sa.sun_path, _shardPaths[shard]);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		ERRLOG1("Failed to open socket! errno=%d", errno);
+		return -1;
+	}
+
+	// Don't let a hung shard hold up a worker thread indefinitely.
+	struct timeval tv = { .tv_sec = SHARD_RECV_TIMEOUT_SEC, .tv_usec = 0 };
+	if (0 != setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(struct timeval)))
+	{
+		ERRLOG1("Failed to set shard socket receive timeout! errno=%d", errno);
+	}
+
+	if (0 != connect(fd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)))
+	{
+		ERRLOG2("Failed to connect to shard %u! errno=%d", shard, errno);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// Reads one response message. Most responses are a single line, but some (e.g. successful group membership
+// responses) are multiple lines terminated by an empty line.
+static int readResponse(int fd, bool multiLine, char* resp, size_t respSize)
+{
+	size_t n = 0;
+
+	for (;;)
+	{
+		if (n == respSize - 1)
+		{
+			ERRLOG("Shard response too long!");
+			return -1;
+		}
+
+		const ssize_t rb = read(fd, resp + n, respSize - 1 - n);
+		if (rb <= 0)
+		{
+			return -1;
+		}
+
+		n += rb;
+		resp[n] = 0;
+
+		if (!strchr(resp, '\n'))
+		{
+			continue;
+		}
+
+		if (!multiLine || !isFirstLineEndingWith(resp, ",ok"))
+		{
+			return 0;
+		}
+
+		if (n >= 2 && resp[n - 2] == '\n' && resp[n - 1] == '\n')
+		{
+			return 0;
+		}
+	}
+}
+
+static int writeAll(int fd, const char* buf, size_t len)
+{
+	size_t wt = 0;
+
+	while (wt < len)
+	{
+		const ssize_t wb = write(fd, buf + wt, len - wt);
+		if (wb < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return -1;
+		}
+
+		wt += wb;
+	}
+
+	return 0;
+}
+
+
+static bool isBoatKeyedRequest(const char* reqType)
+{
+	return (strcmp(REQ_STR_GET_BOAT_DATA_NO_CELESTIAL, reqType) == 0 ||
+			strcmp(REQ_STR_GET_BOAT_DATA, reqType) == 0 ||
+			strcmp(REQ_STR_BOAT_GROUP_MEMBERSHIP, reqType) == 0 ||
+			strcmp(REQ_STR_GROUP_PROXIMITY, reqType) == 0);
+}
+
+static bool isMultiLineResponse(const char* reqType)
+{
+	return (strcmp(REQ_STR_BOAT_GROUP_MEMBERSHIP, reqType) == 0 ||
+			strcmp(REQ_STR_GROUP_PROXIMITY, reqType) == 0);
+}
+
+static bool isFirstLineEndingWith(const char* resp, const char* suffix)
+{
+	const char* nl = strchr(resp, '\n');
+	const size_t lineLen = (nl ? (size_t) (nl - resp) : strlen(resp));
+	const size_t suffixLen = strlen(suffix);
+
+	return (lineLen >= suffixLen && memcmp(resp + lineLen - suffixLen, suffix, suffixLen) == 0);
+}
+
+
+static int ownerCacheGet(const char* name)
+{
+	const uint64_t h = Shard_hash(name);
+	const uint64_t v = atomic_load_explicit(&_ownerCache[h % OWNER_CACHE_SIZE], memory_order_relaxed);
+
+	if (v != 0 && (v >> 24) == (h >> 24) && (v & 0xff) != OWNER_CACHE_AMBIGUOUS)
+	{
+		return (int) (v & 0xff);
+	}
+
+	return -1;
+}
+
+// Caches the owner of a boat, by name and group (if known, with 0 for a boat without a group).
+static void ownerCachePut(const char* name, const char* group, bool groupKnown, unsigned int shard)
+{
+	const uint64_t h = Shard_hash(name);
+	const uint64_t groupTag = ownerCacheGroupTag(group, groupKnown);
+
+	atomic_uint_fast64_t* slot = &_ownerCache[h % OWNER_CACHE_SIZE];
+	uint64_t v = atomic_load_explicit(slot, memory_order_relaxed);
+
+	for (;;)
+	{
+		uint64_t nv = ((h >> 24) << 24) | (groupTag << 8) | shard;
+
+		if (v != 0 && (v >> 24) == (h >> 24))
+		{
+			const uint64_t oldGroupTag = (v >> 8) & 0xffff;
+
+			if ((v & 0xff) == OWNER_CACHE_AMBIGUOUS ||
+					(groupTag != OWNER_CACHE_GROUP_UNKNOWN && oldGroupTag != OWNER_CACHE_GROUP_UNKNOWN && oldGroupTag != groupTag && (v & 0xff) != shard))
+			{
+				// Same name, in another group owned by another shard (and not removed since), so both boats may exist.
+				nv = ((h >> 24) << 24) | OWNER_CACHE_AMBIGUOUS;
+			}
+			else if (groupTag == OWNER_CACHE_GROUP_UNKNOWN)
+			{
+				// Keep the group of an earlier add (with the shard just found).
+				nv = (v & ~(uint64_t) 0xff) | shard;
+			}
+		}
+
+		if (atomic_compare_exchange_weak_explicit(slot, &v, nv, memory_order_relaxed, memory_order_relaxed))
+		{
+			return;
+		}
+	}
+}
+
+static void ownerCacheRemove(const char* name)
+{
+	const uint64_t h = Shard_hash(name);
+	atomic_store_explicit(&_ownerCache[h % OWNER_CACHE_SIZE], 0, memory_order_relaxed);
+}
+
+static uint64_t ownerCacheGroupTag(const char* group, bool groupKnown)
+{
+	if (!groupKnown)
+	{
+		return OWNER_CACHE_GROUP_UNKNOWN;
+	}
+	else if (!group)
+	{
+		return OWNER_CACHE_GROUP_NONE;
+	}
+
+	// Folded, since names differing only near the end differ mostly in the low bits of the hash (and never one of the
+	// tags above).
+	const uint64_t h = Shard_hash(group);
+	return (((h ^ (h >> 16) ^ (h >> 32) ^ (h >> 48)) & 0xffff) | 2);
+}
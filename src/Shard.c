@@ -0,0 +1,84 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "Shard.h"
+
+
+#define FNV1A_64_OFFSET_BASIS (0xcbf29ce484222325UL)
+#define FNV1A_64_PRIME (0x00000100000001b3UL)
+
+
+// Parses a shard specification of the form "I/N" (shard index I of N total shards).
+int Shard_parseSpec(const char* spec, unsigned int* shardIndex, unsigned int* shardCount)
+{
+	char* end;
+
+	const long i = strtol(spec, &end, 10);
+	if (end == spec || *end != '/')
+	{
+		return -1;
+	}
+
+	const char* countStr = end + 1;
+	const long n = strtol(countStr, &end, 10);
+	if (end == countStr || *end != 0)
+	{
+		return -1;
+	}
+
+	if (n < 1 || n > SHARD_MAX_COUNT || i < 0 || i >= n)
+	{
+		return -2;
+	}
+
+	*shardIndex = (unsigned int) i;
+	*shardCount = (unsigned int) n;
+
+	return 0;
+}
+
+// FNV-1a (64-bit) hash, which is stable across builds and processes.
+uint64_t Shard_hash(const char* s)
+{
+	uint64_t h = FNV1A_64_OFFSET_BASIS;
+
+	for (; *s != 0; s++)
+	{
+		h ^= (uint8_t) *s;
+		h *= FNV1A_64_PRIME;
+	}
+
+	return h;
+}
+
+// Boats in a group are always owned by the same shard (so that group queries can be answered by
+// a single shard), while ungrouped boats are spread across shards by name.
+unsigned int Shard_ownerOf(const char* name, const char* group, unsigned int shardCount)
+{
+	if (shardCount <= 1)
+	{
+		return 0;
+	}
+
+	return (unsigned int) (Shard_hash(group ? group : name) % shardCount);
+}
+
+bool Shard_isOwner(const char* name, const char* group, unsigned int shardIndex, unsigned int shardCount)
+{
+	return (Shard_ownerOf(name, group, shardCount) == shardIndex);
+}
@@ -0,0 +1,34 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Shard_h_
+#define _Shard_h_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define SHARD_MAX_COUNT (255)
+
+
+int Shard_parseSpec(const char* spec, unsigned int* shardIndex, unsigned int* shardCount);
+
+uint64_t Shard_hash(const char* s);
+unsigned int Shard_ownerOf(const char* name, const char* group, unsigned int shardCount);
+bool Shard_isOwner(const char* name, const char* group, unsigned int shardIndex, unsigned int shardCount);
+
+
+#endif // _Shard_h_
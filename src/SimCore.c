@@ -0,0 +1,38 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SimCore.h"
+
+#include "BoatWindResponse.h"
+
+
+int SimCore_init()
+{
+	return BoatWindResponse_init();
+}
+
+void SimCore_step(Boat* boats, size_t n, time_t t, unsigned int dt, const BoatEnv* env, unsigned int* randSeed)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		Boat* b = boats + i;
+
+		for (unsigned int s = 1; s <= dt; s++)
+		{
+			Boat_advanceWithEnv(b, t + s, env, randSeed);
+		}
+	}
+}
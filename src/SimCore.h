@@ -0,0 +1,40 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SimCore_h_
+#define _SimCore_h_
+
+#include <stddef.h>
+#include <time.h>
+
+#include "Boat.h"
+
+
+// Boat physics for embedding (built as libsailnavsim_core.a): boat states are caller-owned (set up with
+// Boat_initState()), environment lookups come from a BoatEnv, and random number state is passed in explicitly, so
+// stepping is reentrant and any number of threads can each step their own boats.
+
+// Sets up the boat type tables (once, before stepping any boats).
+int SimCore_init();
+
+// Advances each of n boats from time t to t + dt (in one-second steps, as the daemon does), with environment lookups
+// from env (Boat_getLiveEnv() for proteus data) and random numbers from randSeed. Each boat is stepped through all of
+// dt before the next (so results depend on the seed and the order of boats, but not on how the steps are batched for a
+// single boat).
+void SimCore_step(Boat* boats, size_t n, time_t t, unsigned int dt, const BoatEnv* env, unsigned int* randSeed);
+
+
+#endif // _SimCore_h_
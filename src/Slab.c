@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "Slab.h"
+
+#include "ErrLog.h"
+
+
+#define ERRLOG_ID "Slab"
+
+
+void* Slab_alloc(Slab* slab)
+{
+	void* obj = 0;
+
+	if (0 != pthread_mutex_lock(&slab->lock))
+	{
+		ERRLOG("alloc: Failed to lock slab mutex!");
+		return 0;
+	}
+
+	if (slab->freeList)
+	{
+		// Freed objects hold the link to the next freed object.
+		obj = slab->freeList;
+		slab->freeList = *((void**) obj);
+	}
+	else
+	{
+		if (slab->chunkRemaining == 0)
+		{
+			char* chunk = aligned_alloc(SLAB_ALIGN, slab->objSize * slab->objsPerChunk);
+			if (!chunk)
+			{
+				ERRLOG("Failed to alloc slab chunk!");
+				goto done;
+			}
+
+			slab->chunkNext = chunk;
+			slab->chunkRemaining = slab->objsPerChunk;
+			slab->chunkCount++;
+		}
+
+		obj = slab->chunkNext;
+		slab->chunkNext += slab->objSize;
+		slab->chunkRemaining--;
+	}
+
+	slab->liveCount++;
+
+done:
+	if (0 != pthread_mutex_unlock(&slab->lock))
+	{
+		ERRLOG("alloc: Failed to unlock slab mutex!");
+	}
+
+	return obj;
+}
+
+void Slab_free(Slab* slab, void* obj)
+{
+	if (!obj)
+	{
+		return;
+	}
+
+	if (0 != pthread_mutex_lock(&slab->lock))
+	{
+		ERRLOG("free: Failed to lock slab mutex!");
+		return;
+	}
+
+	*((void**) obj) = slab->freeList;
+	slab->freeList = obj;
+	slab->liveCount--;
+
+	if (0 != pthread_mutex_unlock(&slab->lock))
+	{
+		ERRLOG("free: Failed to unlock slab mutex!");
+	}
+}
+
+void Slab_getStats(Slab* slab, SlabStats* stats)
+{
+	pthread_mutex_lock(&slab->lock);
+
+	stats->liveCount = slab->liveCount;
+	stats->chunkCount = slab->chunkCount;
+	stats->bytes = ((size_t) slab->chunkCount) * slab->objSize * slab->objsPerChunk;
+
+	pthread_mutex_unlock(&slab->lock);
+}
@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Slab_h_
+#define _Slab_h_
+
+#include <pthread.h>
+#include <stddef.h>
+
+
+// Pool of fixed-size objects, carved out of large cache-line-aligned chunks (so that objects of one kind are packed
+// together rather than spread across the heap), with freed objects reused (most recently freed first) before any new ones.
+// Chunks are never returned to the heap. Thread-safe.
+
+#define SLAB_ALIGN (64)
+
+#define SLAB_OBJ_SIZE(size) ((((size) + SLAB_ALIGN - 1) / SLAB_ALIGN) * SLAB_ALIGN)
+
+// Static initializer, for a slab of objects of the given size, allocated objsPerChunk at a time.
+#define SLAB_INITIALIZER(size, objsPerChunk) { SLAB_OBJ_SIZE(size), (objsPerChunk), 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER }
+
+// Static initializer, for a slab of small objects packed without padding to whole cache lines (size must be a multiple
+// of the pointer size, and should divide SLAB_ALIGN so that no object straddles cache lines).
+#define SLAB_INITIALIZER_PACKED(size, objsPerChunk) { (size), (objsPerChunk), 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER }
+
+
+typedef struct
+{
+	size_t objSize;
+	unsigned int objsPerChunk;
+
+	void* freeList;
+
+	// Unused objects at the end of the last chunk
+	char* chunkNext;
+	unsigned int chunkRemaining;
+
+	unsigned int chunkCount;
+	unsigned long liveCount;
+
+	pthread_mutex_t lock;
+} Slab;
+
+typedef struct
+{
+	// Objects currently allocated, and heap allocations made (chunks) for them
+	unsigned long liveCount;
+	unsigned int chunkCount;
+
+	// Total size of chunks
+	size_t bytes;
+} SlabStats;
+
+
+void* Slab_alloc(Slab* slab);
+void Slab_free(Slab* slab, void* obj);
+
+void Slab_getStats(Slab* slab, SlabStats* stats);
+
+
+#endif // _Slab_h_
@@ -0,0 +1,296 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <proteus/Ocean.h>
+
+#include "WindField.h"
+
+#include "ErrLog.h"
+#include "WxUtils.h"
+
+
+#define ERRLOG_ID "WindField"
+
+#define DEG2RAD (M_PI / 180.0)
+#define RAD2DEG (180.0 / M_PI)
+
+
+// Wind and gust vectors as east/north components (so that they can be interpolated linearly), in fixed point
+// (1/CELL_SCALE m/s units, up to about 327 m/s) to keep the grid small enough to mostly stay in cache.
+#define CELL_SCALE (100.0)
+
+typedef struct
+{
+	int16_t windU;
+	int16_t windV;
+	int16_t gustU;
+	int16_t gustV;
+} Cell;
+
+// Points at latitudes -90 to 90 (inclusive) and longitudes -180 to 180 (exclusive, wrapping around), res apart
+typedef struct
+{
+	double invRes;
+	unsigned int latCount;
+	unsigned int lonCount;
+
+	Cell cells[];
+} Grid;
+
+
+// Field being sampled, published (and sampled) without locking. A replaced field is only freed when the next one
+// replaces it in turn (builds are minutes apart, while sampling takes well under a microsecond).
+static _Atomic(Grid*) _grid = 0;
+static Grid* _retired = 0;
+
+static pthread_mutex_t _buildLock = PTHREAD_MUTEX_INITIALIZER;
+
+static double _threadRes = 0.0;
+static unsigned int _threadIntervalMinutes = 0;
+static pthread_t _buildThread;
+
+static void* buildThreadMain(void* arg);
+static int16_t toFixed(double v);
+static void setVec(proteus_GeoVec* v, double u, double n);
+
+
+int WindField_build(double resDeg, WindField_SourceFunc source)
+{
+	if (!(resDeg > 0.0 && resDeg <= 90.0))
+	{
+		ERRLOG1("Invalid wind field resolution: %f", resDeg);
+		return -1;
+	}
+
+	if (!source)
+	{
+		source = &WindField_getLive;
+	}
+
+	const unsigned int latCount = (unsigned int) lround(180.0 / resDeg) + 1;
+	const unsigned int lonCount = (unsigned int) lround(360.0 / resDeg);
+
+	Grid* g = malloc(sizeof(Grid) + ((size_t) latCount) * lonCount * sizeof(Cell));
+	if (!g)
+	{
+		ERRLOG("Failed to alloc wind field grid!");
+		return -2;
+	}
+
+	g->invRes = 1.0 / resDeg;
+	g->latCount = latCount;
+	g->lonCount = lonCount;
+
+	struct timespec t0;
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	Cell* c = g->cells;
+	for (unsigned int i = 0; i < latCount; i++)
+	{
+		proteus_GeoPos pos = { .lat = -90.0 + i * resDeg };
+		if (pos.lat > 90.0)
+		{
+			pos.lat = 90.0;
+		}
+
+		for (unsigned int j = 0; j < lonCount; j++, c++)
+		{
+			pos.lon = -180.0 + j * resDeg;
+
+			proteus_Weather wx;
+			const double gustAngle = source(&pos, &wx);
+
+			c->windU = toFixed(wx.wind.mag * sin(wx.wind.angle * DEG2RAD));
+			c->windV = toFixed(wx.wind.mag * cos(wx.wind.angle * DEG2RAD));
+			c->gustU = toFixed(wx.windGust * sin(gustAngle * DEG2RAD));
+			c->gustV = toFixed(wx.windGust * cos(gustAngle * DEG2RAD));
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	pthread_mutex_lock(&_buildLock);
+
+	Grid* replaced = atomic_exchange_explicit(&_grid, g, memory_order_acq_rel);
+	free(_retired);
+	_retired = replaced;
+
+	pthread_mutex_unlock(&_buildLock);
+
+	ERRLOG4("Built wind field (%u x %u points at %.2f degrees) in %.1fms",
+			latCount,
+			lonCount,
+			resDeg,
+			((t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec)) / 1000000.0);
+
+	return 0;
+}
+
+int WindField_start(double resDeg, unsigned int intervalMinutes)
+{
+	if (intervalMinutes < WINDFIELD_INTERVAL_MIN || intervalMinutes > WINDFIELD_INTERVAL_MAX)
+	{
+		ERRLOG1("Invalid wind field build interval: %u", intervalMinutes);
+		return -1;
+	}
+
+	_threadRes = resDeg;
+	_threadIntervalMinutes = intervalMinutes;
+
+	if (0 != pthread_create(&_buildThread, 0, &buildThreadMain, 0))
+	{
+		ERRLOG("Failed to create wind field build thread!");
+		return -2;
+	}
+
+	return 0;
+}
+
+bool WindField_get(const proteus_GeoPos* pos, proteus_Weather* wx, double* gustAngle)
+{
+	const Grid* g = atomic_load_explicit(&_grid, memory_order_acquire);
+	if (!g)
+	{
+		return false;
+	}
+
+	// Latitude clamped to the grid, longitude wrapped around.
+	double y = (pos->lat + 90.0) * g->invRes;
+	if (y < 0.0)
+	{
+		y = 0.0;
+	}
+
+	unsigned int i0 = (unsigned int) y;
+	if (i0 > g->latCount - 2)
+	{
+		i0 = g->latCount - 2;
+	}
+
+	double fy = y - i0;
+	if (fy > 1.0)
+	{
+		fy = 1.0;
+	}
+
+	double x = (pos->lon + 180.0) * g->invRes;
+	x -= floor(x / g->lonCount) * g->lonCount;
+
+	if (x >= g->lonCount)
+	{
+		x = 0.0;
+	}
+
+	const unsigned int j0 = (unsigned int) x;
+	const unsigned int j1 = (j0 + 1 == g->lonCount) ? 0 : j0 + 1;
+	const double fx = x - j0;
+
+	const Cell* r0 = g->cells + ((size_t) i0) * g->lonCount;
+	const Cell* r1 = r0 + g->lonCount;
+
+	const double w00 = (1.0 - fy) * (1.0 - fx) / CELL_SCALE;
+	const double w01 = (1.0 - fy) * fx / CELL_SCALE;
+	const double w10 = fy * (1.0 - fx) / CELL_SCALE;
+	const double w11 = fy * fx / CELL_SCALE;
+
+	setVec(&wx->wind,
+			w00 * r0[j0].windU + w01 * r0[j1].windU + w10 * r1[j0].windU + w11 * r1[j1].windU,
+			w00 * r0[j0].windV + w01 * r0[j1].windV + w10 * r1[j0].windV + w11 * r1[j1].windV);
+
+	const double gustU = w00 * r0[j0].gustU + w01 * r0[j1].gustU + w10 * r1[j0].gustU + w11 * r1[j1].gustU;
+	const double gustV = w00 * r0[j0].gustV + w01 * r0[j1].gustV + w10 * r1[j0].gustV + w11 * r1[j1].gustV;
+
+	wx->windGust = sqrt(gustU * gustU + gustV * gustV);
+	if (gustAngle)
+	{
+		proteus_GeoVec gust;
+		setVec(&gust, gustU, gustV);
+		*gustAngle = gust.angle;
+	}
+
+	return true;
+}
+
+double WindField_getLive(const proteus_GeoPos* pos, proteus_Weather* wx)
+{
+	proteus_Weather_get(pos, wx, true);
+
+	proteus_OceanData od;
+	if (proteus_Ocean_get(pos, &od))
+	{
+		return WxUtils_adjustWindForCurrent(wx, &od.current);
+	}
+
+	return wx->wind.angle;
+}
+
+void WindField_destroy()
+{
+	pthread_mutex_lock(&_buildLock);
+
+	free(atomic_exchange_explicit(&_grid, 0, memory_order_acq_rel));
+	free(_retired);
+	_retired = 0;
+
+	pthread_mutex_unlock(&_buildLock);
+}
+
+
+static void* buildThreadMain(void* arg)
+{
+	(void) arg;
+
+	for (;;)
+	{
+		if (0 != WindField_build(_threadRes, 0))
+		{
+			ERRLOG("Failed to build wind field! Will retry at the next interval.");
+		}
+
+		unsigned int remaining = _threadIntervalMinutes * 60;
+		while (remaining > 0)
+		{
+			remaining = sleep(remaining);
+		}
+	}
+
+	return 0;
+}
+
+static int16_t toFixed(double v)
+{
+	const double f = round(v * CELL_SCALE);
+	return (f > INT16_MAX) ? INT16_MAX : ((f < INT16_MIN) ? INT16_MIN : (int16_t) f);
+}
+
+static void setVec(proteus_GeoVec* v, double u, double n)
+{
+	v->mag = sqrt(u * u + n * n);
+	v->angle = atan2(u, n) * RAD2DEG;
+	if (v->angle < 0.0)
+	{
+		v->angle += 360.0;
+	}
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WindField_h_
+#define _WindField_h_
+
+#include <stdbool.h>
+
+#include <proteus/GeoPos.h>
+#include <proteus/Weather.h>
+
+
+// Precomputed global grid of current-adjusted wind and gust vectors, sampled (bilinearly interpolated) instead of
+// looking up weather and ocean data and adjusting the wind for the current on every use.
+
+// Nominal resolutions (degrees) of the weather (1.00 degree grid source) and ocean data grids
+#define WINDFIELD_WEATHER_RES_DEG	(1.0)
+#define WINDFIELD_OCEAN_RES_DEG		(0.5)
+
+// The field is built at the finer of the two.
+#define WINDFIELD_RES_DEG		(WINDFIELD_WEATHER_RES_DEG < WINDFIELD_OCEAN_RES_DEG ? WINDFIELD_WEATHER_RES_DEG : WINDFIELD_OCEAN_RES_DEG)
+
+#define WINDFIELD_INTERVAL_MIN		(1)
+#define WINDFIELD_INTERVAL_MAX		(180)
+
+
+// Current-adjusted wind (wx->wind and wx->windGust only) at a position, returning the gust angle
+typedef double (*WindField_SourceFunc)(const proteus_GeoPos* pos, proteus_Weather* wx);
+
+
+// Builds the field now (on the calling thread) from the given source (or from the live weather and ocean data, if null),
+// replacing any previous one.
+int WindField_build(double resDeg, WindField_SourceFunc source);
+
+// Starts a background thread building the field from the live weather and ocean data right away, and then again every
+// intervalMinutes (so that the field follows data refreshes and the weather/ocean forecast time interpolation).
+int WindField_start(double resDeg, unsigned int intervalMinutes);
+
+// Samples the field, setting wx->wind and wx->windGust (and the gust angle, if gustAngle is non-null).
+// Returns false (leaving wx untouched) if no field has been built yet.
+bool WindField_get(const proteus_GeoPos* pos, proteus_Weather* wx, double* gustAngle);
+
+// Current-adjusted wind computed from the live weather and ocean data, as the field is built from.
+double WindField_getLive(const proteus_GeoPos* pos, proteus_Weather* wx);
+
+// Frees the field (only when not started, and nothing else can be sampling it).
+void WindField_destroy();
+
+
+#endif // _WindField_h_
@@ -0,0 +1,739 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "Zones.h"
+
+#include "ErrLog.h"
+#include "Logger.h"
+
+
+#define ERRLOG_ID "Zones"
+
+#define CELL_OUTSIDE	(0)
+#define CELL_INSIDE	(1)
+#define CELL_BOUNDARY	(2)
+
+// Grid dimension limits (per side) for each zone
+#define GRID_MIN_DIM	(16)
+#define GRID_MAX_DIM	(512)
+
+
+// Polygon coordinates are (x: lon, y: lat) in degrees, with longitudes unwrapped to be continuous from the first vertex.
+// Each zone is rasterized into a grid over its bounding box: cells entirely inside or outside the polygon are answered
+// directly, and cells crossed by edges keep a list of those edges for an exact test.
+struct Zone
+{
+	char* name;
+	int action;
+
+	unsigned int vertexCount;
+	double* x;
+	double* y;
+
+	double minX;
+	double maxX;
+	double minY;
+	double maxY;
+
+	int cols;
+	int rows;
+	double cellW;
+	double cellH;
+
+	uint8_t* cells;
+
+	// For boundary cells: edges (index of first vertex) crossing the cell, as ranges in cellEdges
+	unsigned int* cellEdgeStart;
+	unsigned int* cellEdges;
+};
+
+struct ZoneSet
+{
+	char* group;
+	Zone** zones;
+	unsigned int count;
+};
+
+
+static ZoneSet** _sets = 0;
+static unsigned int _setCount = 0;
+
+static BoatEventEntry* _events = 0;
+static unsigned int _evCount = 0;
+static unsigned int _evCap = 0;
+
+
+static int loadZonesSql(const char* sqliteDbFilename);
+static proteus_GeoPos* parseVertices(const char* s, unsigned int* count);
+static ZoneSet* getOrAddSet(const char* group);
+static Zone* newZone(const char* name, int action, const proteus_GeoPos* vertices, unsigned int vertexCount);
+static void freeZone(Zone* zone);
+static int rasterize(Zone* zone);
+static void addEdgeCells(Zone* zone, unsigned int e, unsigned int* fill);
+static int compareDoubles(const void* a, const void* b);
+static bool containsIndexed(const Zone* zone, double x, double y);
+static bool containsExact(const Zone* zone, double x, double y);
+static bool segmentsCross(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy);
+static double unwrapLon(const Zone* zone, double lon);
+
+
+int Zones_init(const char* sqliteDbFilename)
+{
+	if (0 != loadZonesSql(sqliteDbFilename))
+	{
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < _setCount; i++)
+	{
+		ERRLOG2("Loaded %u zones for %s.", _sets[i]->count, _sets[i]->group);
+	}
+
+	return 0;
+}
+
+int Zones_add(const char* group, const char* name, int action, const proteus_GeoPos* vertices, unsigned int vertexCount)
+{
+	if ((action != ZONE_ACTION_STOP && action != ZONE_ACTION_PENALTY) || vertexCount < ZONE_MIN_VERTICES || vertexCount > ZONE_MAX_VERTICES)
+	{
+		ERRLOG2("Invalid zone %s for %s", name, group);
+		return -1;
+	}
+
+	ZoneSet* set = getOrAddSet(group);
+	if (!set)
+	{
+		return -1;
+	}
+
+	Zone* zone = newZone(name, action, vertices, vertexCount);
+	if (!zone)
+	{
+		return -1;
+	}
+
+	Zone** newZones = realloc(set->zones, (set->count + 1) * sizeof(Zone*));
+	if (!newZones)
+	{
+		ERRLOG("add: Alloc failed!");
+		freeZone(zone);
+		return -1;
+	}
+
+	set->zones = newZones;
+	set->zones[set->count++] = zone;
+
+	return 0;
+}
+
+const ZoneSet* Zones_getGroupZones(const char* group)
+{
+	if (!group)
+	{
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < _setCount; i++)
+	{
+		if (strcmp(_sets[i]->group, group) == 0)
+		{
+			return _sets[i];
+		}
+	}
+
+	return 0;
+}
+
+const Zone* Zones_find(const ZoneSet* zones, const proteus_GeoPos* pos)
+{
+	for (unsigned int i = 0; i < zones->count; i++)
+	{
+		const Zone* zone = zones->zones[i];
+		const double x = unwrapLon(zone, pos->lon);
+
+		if (pos->lat < zone->minY || pos->lat > zone->maxY || x < zone->minX || x > zone->maxX)
+		{
+			continue;
+		}
+
+		if (containsIndexed(zone, x, pos->lat))
+		{
+			return zone;
+		}
+	}
+
+	return 0;
+}
+
+const char* Zones_getName(const Zone* zone)
+{
+	return zone->name;
+}
+
+int Zones_getAction(const Zone* zone)
+{
+	return zone->action;
+}
+
+const Zone* Zones_findExact(const ZoneSet* zones, const proteus_GeoPos* pos)
+{
+	for (unsigned int i = 0; i < zones->count; i++)
+	{
+		const Zone* zone = zones->zones[i];
+		const double x = unwrapLon(zone, pos->lon);
+
+		if (pos->lat < zone->minY || pos->lat > zone->maxY || x < zone->minX || x > zone->maxX)
+		{
+			continue;
+		}
+
+		if (containsExact(zone, x, pos->lat))
+		{
+			return zone;
+		}
+	}
+
+	return 0;
+}
+
+void Zones_addEntryEvent(const char* boatName, const Zone* zone, time_t curTime)
+{
+	if (_evCount == _evCap)
+	{
+		const unsigned int newCap = (_evCap == 0) ? 64 : _evCap * 2;
+		BoatEventEntry* newEvents = realloc(_events, newCap * sizeof(BoatEventEntry));
+		if (!newEvents)
+		{
+			ERRLOG("addEntryEvent: Alloc failed!");
+			return;
+		}
+
+		_events = newEvents;
+		_evCap = newCap;
+	}
+
+	BoatEventEntry* ev = _events + _evCount++;
+
+	ev->time = curTime;
+	ev->boatName = strdup(boatName);
+	ev->type = (zone->action == ZONE_ACTION_STOP) ? BOAT_EVENT_ZONE_STOP : BOAT_EVENT_ZONE_PENALTY;
+	ev->ref = strdup(zone->name);
+	ev->value = 0.0;
+}
+
+BoatEventEntry* Zones_takeEvents(unsigned int* evCount)
+{
+	BoatEventEntry* events = _events;
+	*evCount = _evCount;
+
+	_events = 0;
+	_evCount = 0;
+	_evCap = 0;
+
+	return events;
+}
+
+
+static int loadZonesSql(const char* sqliteDbFilename)
+{
+	if (!sqliteDbFilename)
+	{
+		return 0;
+	}
+
+	FILE* fdb = fopen(sqliteDbFilename, "r");
+	if (fdb == 0)
+	{
+		// No DB, so no zones from there.
+		return 0;
+	}
+	fclose(fdb);
+
+	sqlite3* sql;
+	sqlite3_stmt* stmt;
+	int src;
+
+	if (SQLITE_OK != (src = sqlite3_open(sqliteDbFilename, &sql)))
+	{
+		ERRLOG1("Failed to open SQLite DB. sqlite rc=%d", src);
+		return -1;
+	}
+
+	static const char* SELECT_ZONE_STMT_STR = "SELECT race, name, action, vertices FROM Zone;";
+	if (SQLITE_OK != (src = sqlite3_prepare_v2(sql, SELECT_ZONE_STMT_STR, strlen(SELECT_ZONE_STMT_STR) + 1, &stmt, 0)))
+	{
+		// The Zone table was added later, so older DBs may not have it.
+		ERRLOG1("Failed to prepare Zone select statement, so not loading zones. sqlite rc=%d", src);
+		sqlite3_close(sql);
+		return 0;
+	}
+
+	while (SQLITE_ROW == (src = sqlite3_step(stmt)))
+	{
+		int n = 0;
+
+		const char* race = (const char*) sqlite3_column_text(stmt, n++);
+		const char* name = (const char*) sqlite3_column_text(stmt, n++);
+		const int action = sqlite3_column_int(stmt, n++);
+		const char* verticesStr = (const char*) sqlite3_column_text(stmt, n++);
+
+		if (!race || !name || !verticesStr)
+		{
+			continue;
+		}
+
+		unsigned int vertexCount;
+		proteus_GeoPos* vertices = parseVertices(verticesStr, &vertexCount);
+		if (!vertices)
+		{
+			ERRLOG2("Failed to parse vertices of zone %s for %s!", name, race);
+			continue;
+		}
+
+		Zones_add(race, name, action, vertices, vertexCount);
+		free(vertices);
+	}
+
+	if (SQLITE_DONE != src)
+	{
+		ERRLOG1("Failed to step Zone select statement! sqlite rc=%d", src);
+	}
+
+	if (SQLITE_OK != (src = sqlite3_finalize(stmt)))
+	{
+		ERRLOG1("Failed to finalize Zone statement! sqlite rc=%d", src);
+	}
+
+	if (SQLITE_OK != (src = sqlite3_close(sql)))
+	{
+		ERRLOG1("Failed to close SQLite DB! sqlite rc=%d", src);
+	}
+
+	return 0;
+}
+
+// Parses "lat,lon;lat,lon;..." vertices.
+static proteus_GeoPos* parseVertices(const char* s, unsigned int* count)
+{
+	unsigned int cap = 1;
+	for (const char* c = s; *c; c++)
+	{
+		if (*c == ';')
+		{
+			cap++;
+		}
+	}
+
+	proteus_GeoPos* vertices = malloc(cap * sizeof(proteus_GeoPos));
+	if (!vertices)
+	{
+		return 0;
+	}
+
+	unsigned int n = 0;
+	const char* c = s;
+
+	while (*c && n < cap)
+	{
+		char* end;
+
+		vertices[n].lat = strtod(c, &end);
+		if (end == c || *end != ',')
+		{
+			break;
+		}
+
+		c = end + 1;
+		vertices[n].lon = strtod(c, &end);
+		if (end == c || (*end != ';' && *end != 0) ||
+				vertices[n].lat < -90.0 || vertices[n].lat > 90.0 || vertices[n].lon < -180.0 || vertices[n].lon > 180.0)
+		{
+			break;
+		}
+
+		n++;
+		c = (*end == ';') ? end + 1 : end;
+	}
+
+	if (*c != 0 || n == 0)
+	{
+		free(vertices);
+		return 0;
+	}
+
+	*count = n;
+	return vertices;
+}
+
+static ZoneSet* getOrAddSet(const char* group)
+{
+	ZoneSet* set = (ZoneSet*) Zones_getGroupZones(group);
+	if (set)
+	{
+		return set;
+	}
+
+	ZoneSet** newSets = realloc(_sets, (_setCount + 1) * sizeof(ZoneSet*));
+	if (!newSets)
+	{
+		ERRLOG("getOrAddSet: Alloc failed!");
+		return 0;
+	}
+	_sets = newSets;
+
+	set = malloc(sizeof(ZoneSet));
+	if (!set || !(set->group = strdup(group)))
+	{
+		ERRLOG("getOrAddSet: Alloc failed!");
+		free(set);
+		return 0;
+	}
+
+	set->zones = 0;
+	set->count = 0;
+
+	_sets[_setCount++] = set;
+	return set;
+}
+
+static Zone* newZone(const char* name, int action, const proteus_GeoPos* vertices, unsigned int vertexCount)
+{
+	Zone* zone = calloc(1, sizeof(Zone));
+	if (!zone)
+	{
+		ERRLOG("newZone: Alloc failed!");
+		return 0;
+	}
+
+	zone->name = strdup(name);
+	zone->action = action;
+	zone->vertexCount = vertexCount;
+	zone->x = malloc(vertexCount * sizeof(double));
+	zone->y = malloc(vertexCount * sizeof(double));
+
+	if (!zone->name || !zone->x || !zone->y)
+	{
+		ERRLOG("newZone: Alloc failed!");
+		freeZone(zone);
+		return 0;
+	}
+
+	// Unwrap longitudes, so that zones spanning the antimeridian are continuous.
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		double x = vertices[i].lon;
+		if (i > 0)
+		{
+			while (x - zone->x[i - 1] > 180.0)
+			{
+				x -= 360.0;
+			}
+			while (x - zone->x[i - 1] < -180.0)
+			{
+				x += 360.0;
+			}
+		}
+
+		zone->x[i] = x;
+		zone->y[i] = vertices[i].lat;
+
+		if (i == 0 || x < zone->minX)
+		{
+			zone->minX = x;
+		}
+		if (i == 0 || x > zone->maxX)
+		{
+			zone->maxX = x;
+		}
+		if (i == 0 || zone->y[i] < zone->minY)
+		{
+			zone->minY = zone->y[i];
+		}
+		if (i == 0 || zone->y[i] > zone->maxY)
+		{
+			zone->maxY = zone->y[i];
+		}
+	}
+
+	if (0 != rasterize(zone))
+	{
+		freeZone(zone);
+		return 0;
+	}
+
+	return zone;
+}
+
+static void freeZone(Zone* zone)
+{
+	free(zone->name);
+	free(zone->x);
+	free(zone->y);
+	free(zone->cells);
+	free(zone->cellEdgeStart);
+	free(zone->cellEdges);
+	free(zone);
+}
+
+static int rasterize(Zone* zone)
+{
+	// Roughly a few edges per boundary cell
+	int dim = (int) (4.0 * sqrt((double) zone->vertexCount));
+	dim = (dim < GRID_MIN_DIM) ? GRID_MIN_DIM : ((dim > GRID_MAX_DIM) ? GRID_MAX_DIM : dim);
+
+	zone->cols = dim;
+	zone->rows = dim;
+	zone->cellW = fmax(zone->maxX - zone->minX, 1e-9) / zone->cols;
+	zone->cellH = fmax(zone->maxY - zone->minY, 1e-9) / zone->rows;
+
+	const int cellCount = zone->cols * zone->rows;
+
+	zone->cells = malloc(cellCount * sizeof(uint8_t));
+	zone->cellEdgeStart = calloc(cellCount + 1, sizeof(unsigned int));
+	double* xs = malloc(zone->vertexCount * sizeof(double));
+
+	if (!zone->cells || !zone->cellEdgeStart || !xs)
+	{
+		ERRLOG("rasterize: Alloc failed!");
+		free(xs);
+		return -1;
+	}
+
+	// Inside/outside state of each cell centre, by scanline (crossing number) along each row of centres
+	for (int r = 0; r < zone->rows; r++)
+	{
+		const double yc = zone->minY + (r + 0.5) * zone->cellH;
+		unsigned int xCount = 0;
+
+		for (unsigned int i = 0, j = zone->vertexCount - 1; i < zone->vertexCount; j = i++)
+		{
+			if ((zone->y[i] > yc) != (zone->y[j] > yc))
+			{
+				xs[xCount++] = zone->x[j] + (yc - zone->y[j]) * (zone->x[i] - zone->x[j]) / (zone->y[i] - zone->y[j]);
+			}
+		}
+
+		qsort(xs, xCount, sizeof(double), &compareDoubles);
+
+		unsigned int k = 0;
+		for (int c = 0; c < zone->cols; c++)
+		{
+			const double xc = zone->minX + (c + 0.5) * zone->cellW;
+			while (k < xCount && xs[k] <= xc)
+			{
+				k++;
+			}
+
+			zone->cells[r * zone->cols + c] = (k % 2 == 1) ? CELL_INSIDE : CELL_OUTSIDE;
+		}
+	}
+
+	free(xs);
+
+	// Cells touched by edges are boundary cells, each with its list of edges (counted first, then filled in).
+	for (unsigned int e = 0; e < zone->vertexCount; e++)
+	{
+		addEdgeCells(zone, e, 0);
+	}
+
+	unsigned int total = 0;
+	for (int c = 0; c < cellCount; c++)
+	{
+		const unsigned int n = zone->cellEdgeStart[c];
+		zone->cellEdgeStart[c] = total;
+		total += n;
+	}
+	zone->cellEdgeStart[cellCount] = total;
+
+	zone->cellEdges = malloc((total + 1) * sizeof(unsigned int));
+	unsigned int* fill = calloc(cellCount, sizeof(unsigned int));
+	if (!zone->cellEdges || !fill)
+	{
+		ERRLOG("rasterize: Alloc failed!");
+		free(fill);
+		return -1;
+	}
+
+	for (unsigned int e = 0; e < zone->vertexCount; e++)
+	{
+		addEdgeCells(zone, e, fill);
+	}
+
+	free(fill);
+
+	unsigned int boundaryCount = 0;
+	for (int c = 0; c < cellCount; c++)
+	{
+		if (zone->cellEdgeStart[c + 1] > zone->cellEdgeStart[c])
+		{
+			// Boundary cells keep the state of their centre, for the exact test.
+			zone->cells[c] |= CELL_BOUNDARY;
+			boundaryCount++;
+		}
+	}
+
+	ERRLOG5("Zone %s: %u vertices, %dx%d grid, %u boundary cells", zone->name, zone->vertexCount, zone->cols, zone->rows, boundaryCount);
+
+	return 0;
+}
+
+// Counts (if fill is null) or records the edge from vertex e to vertex e + 1 in each grid cell that it touches.
+static void addEdgeCells(Zone* zone, unsigned int e, unsigned int* fill)
+{
+	const unsigned int next = (e + 1) % zone->vertexCount;
+
+	const double x0 = zone->x[e];
+	const double y0 = zone->y[e];
+	const double x1 = zone->x[next];
+	const double y1 = zone->y[next];
+
+	// Small margins, so that edges along (or rounding onto) cell borders are included on both sides.
+	const double marginX = zone->cellW * 1e-6;
+	const double marginY = zone->cellH * 1e-6;
+
+	int rStart = (int) floor((fmin(y0, y1) - marginY - zone->minY) / zone->cellH);
+	int rEnd = (int) floor((fmax(y0, y1) + marginY - zone->minY) / zone->cellH);
+	rStart = (rStart < 0) ? 0 : rStart;
+	rEnd = (rEnd >= zone->rows) ? zone->rows - 1 : rEnd;
+
+	for (int r = rStart; r <= rEnd; r++)
+	{
+		// Part of the edge within this row's band
+		double bx0 = x0;
+		double bx1 = x1;
+
+		if (y1 != y0)
+		{
+			const double bandY0 = fmax(fmin(y0, y1), zone->minY + r * zone->cellH - marginY);
+			const double bandY1 = fmin(fmax(y0, y1), zone->minY + (r + 1) * zone->cellH + marginY);
+
+			bx0 = x0 + (bandY0 - y0) * (x1 - x0) / (y1 - y0);
+			bx1 = x0 + (bandY1 - y0) * (x1 - x0) / (y1 - y0);
+		}
+
+		int cStart = (int) floor((fmin(bx0, bx1) - marginX - zone->minX) / zone->cellW);
+		int cEnd = (int) floor((fmax(bx0, bx1) + marginX - zone->minX) / zone->cellW);
+		cStart = (cStart < 0) ? 0 : cStart;
+		cEnd = (cEnd >= zone->cols) ? zone->cols - 1 : cEnd;
+
+		for (int c = cStart; c <= cEnd; c++)
+		{
+			const int cell = r * zone->cols + c;
+
+			if (fill)
+			{
+				zone->cellEdges[zone->cellEdgeStart[cell] + fill[cell]++] = e;
+			}
+			else
+			{
+				zone->cellEdgeStart[cell]++;
+			}
+		}
+	}
+}
+
+static int compareDoubles(const void* a, const void* b)
+{
+	const double x = *((const double*) a);
+	const double y = *((const double*) b);
+
+	return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+static bool containsIndexed(const Zone* zone, double x, double y)
+{
+	int c = (int) ((x - zone->minX) / zone->cellW);
+	int r = (int) ((y - zone->minY) / zone->cellH);
+	c = (c >= zone->cols) ? zone->cols - 1 : c;
+	r = (r >= zone->rows) ? zone->rows - 1 : r;
+
+	const int cell = r * zone->cols + c;
+	bool inside = ((zone->cells[cell] & CELL_INSIDE) != 0);
+
+	if ((zone->cells[cell] & CELL_BOUNDARY) == 0)
+	{
+		return inside;
+	}
+
+	// Boundary cell, so start from the state of the cell centre, and flip it for each edge crossed on the way to the point.
+	// (The path stays within the cell, so only the cell's own edges need to be checked.)
+	const double xc = zone->minX + (c + 0.5) * zone->cellW;
+	const double yc = zone->minY + (r + 0.5) * zone->cellH;
+
+	for (unsigned int k = zone->cellEdgeStart[cell]; k < zone->cellEdgeStart[cell + 1]; k++)
+	{
+		const unsigned int e = zone->cellEdges[k];
+		const unsigned int next = (e + 1) % zone->vertexCount;
+
+		if (segmentsCross(xc, yc, x, y, zone->x[e], zone->y[e], zone->x[next], zone->y[next]))
+		{
+			inside = !inside;
+		}
+	}
+
+	return inside;
+}
+
+static bool containsExact(const Zone* zone, double x, double y)
+{
+	bool inside = false;
+
+	for (unsigned int i = 0, j = zone->vertexCount - 1; i < zone->vertexCount; j = i++)
+	{
+		if ((zone->y[i] > y) != (zone->y[j] > y) &&
+				x < zone->x[j] + (y - zone->y[j]) * (zone->x[i] - zone->x[j]) / (zone->y[i] - zone->y[j]))
+		{
+			inside = !inside;
+		}
+	}
+
+	return inside;
+}
+
+static bool segmentsCross(double ax, double ay, double bx, double by, double cx, double cy, double dx, double dy)
+{
+	const double d1 = (dx - cx) * (ay - cy) - (dy - cy) * (ax - cx);
+	const double d2 = (dx - cx) * (by - cy) - (dy - cy) * (bx - cx);
+	const double d3 = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+	const double d4 = (bx - ax) * (dy - ay) - (by - ay) * (dx - ax);
+
+	return (((d1 > 0.0) != (d2 > 0.0)) && ((d3 > 0.0) != (d4 > 0.0)));
+}
+
+static double unwrapLon(const Zone* zone, double lon)
+{
+	const double mid = 0.5 * (zone->minX + zone->maxX);
+
+	while (lon - mid > 180.0)
+	{
+		lon -= 360.0;
+	}
+	while (lon - mid < -180.0)
+	{
+		lon += 360.0;
+	}
+
+	return lon;
+}
@@ -0,0 +1,58 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _Zones_h_
+#define _Zones_h_
+
+#include <time.h>
+
+#include <proteus/GeoPos.h>
+
+
+#define ZONE_ACTION_STOP	(0)	// Boats are stopped at the zone boundary.
+#define ZONE_ACTION_PENALTY	(1)	// Boats may enter, but each entry is logged as a penalty event.
+
+#define ZONE_MIN_VERTICES	(3)
+#define ZONE_MAX_VERTICES	(1000000)
+
+
+typedef struct Zone Zone;
+typedef struct ZoneSet ZoneSet;
+
+
+int Zones_init(const char* sqliteDbFilename);
+
+// Adds a polygon zone (vertices in order, not closed) for a group. Must be called from the main thread.
+int Zones_add(const char* group, const char* name, int action, const proteus_GeoPos* vertices, unsigned int vertexCount);
+
+// Returns the zones of a group (remaining valid for the lifetime of the process), or null if the group has none.
+const ZoneSet* Zones_getGroupZones(const char* group);
+
+// Returns the first zone in the set containing the position, or null if none.
+const Zone* Zones_find(const ZoneSet* zones, const proteus_GeoPos* pos);
+
+const char* Zones_getName(const Zone* zone);
+int Zones_getAction(const Zone* zone);
+
+// Same as Zones_find(), but testing every polygon edge without the grid index (for comparison).
+const Zone* Zones_findExact(const ZoneSet* zones, const proteus_GeoPos* pos);
+
+// Queues a zone entry event for a boat, and returns (and clears) the queued events.
+void Zones_addEntryEvent(const char* boatName, const Zone* zone, time_t curTime);
+struct BoatEventEntry* Zones_takeEvents(unsigned int* evCount);
+
+
+#endif // _Zones_h_
@@ -35,17 +35,34 @@
 
 #include <sailnavsim_boatregistry.h>
 
+#include "Affinity.h"
 #include "Boat.h"
 #include "BoatInitParser.h"
 #include "BoatRegistry.h"
+#include "BoatRestore.h"
 #include "BoatWindResponse.h"
 #include "CelestialSight.h"
 #include "Command.h"
+#include "CommandJournal.h"
+#include "CommandSchedule.h"
+#include "Ensemble.h"
 #include "ErrLog.h"
+#include "FleetTiles.h"
 #include "GeoUtils.h"
+#include "GhostTrack.h"
+#include "Handoff.h"
+#include "InitPhases.h"
 #include "Logger.h"
 #include "NetServer.h"
 #include "Perf.h"
+#include "Probes.h"
+#include "Proximity.h"
+#include "RaceMarks.h"
+#include "Replication.h"
+#include "Router.h"
+#include "Shard.h"
+#include "WindField.h"
+#include "Zones.h"
 
 
 #define ERRLOG_ID "Main"
@@ -55,8 +72,16 @@
 // Minimum value: 2; a value less than 2 results in no boat logs being written
 #define ITERATIONS_PER_LOG (60)
 
+// Seconds between logging of per-thread-role CPU migrations and context switches
+#define SCHED_STATS_LOG_INTERVAL (600)
+
 #define NETSERVER_DEFAULT_THREAD_COUNT (5)
-#define NETSERVER_MAX_THREAD_COUNT (10000)
+
+// How long NetServer worker threads over the minimum pool size idle before retiring (with --netthreadsmax)
+#define NETSERVER_WORKER_IDLE_RETIRE_MS (30000)
+
+// One thread per startup init phase
+#define INIT_DEFAULT_THREAD_COUNT (6)
 
 
 #define WX_DATA_DIR_PATH_F006 "wx_data_f006/"
@@ -94,16 +119,106 @@ static const char* VERSION_STRING = "SailNavSim version 1.19.2 (" __DATE__ " " _
 static int parseArgs(int argc, char** argv);
 static void printVersionInfo();
 
-static void handleCommand(Command* cmd);
-static void handleBoatRegistryCommand(Command* cmd);
+static int handleCommand(Command* cmd, time_t tick);
+static int handleBoatRegistryCommand(Command* cmd, time_t tick);
+static int handleRaceMarkCommand(Command* cmd);
+static int handleGroupCommand(Command* cmd, time_t tick);
+static int applyBoatAction(Boat* b, int action, const CommandValue* values, time_t tick);
+static void logBoat(const Boat* boat, const char* name, time_t curTime, LogEntry* log, CelestialSight* sight, int* totalSights);
 
 static int _netPort = 0;
 static char* _netHost = 0;
 static int _netThreads = NETSERVER_DEFAULT_THREAD_COUNT;
+static int _netThreadsMax = 0;
+static char* _netUnixPath = 0;
+
+// HTTP/1.1 JSON read API listener (sharing the net server's worker pool)
+static int _httpPort = 0;
+static char* _httpUnixPath = 0;
+
+// Shard of the boat population handled by this process (when _shardCount > 0)
+static unsigned int _shardIndex = 0;
+static unsigned int _shardCount = 0;
+
+// Number of shard processes to route requests to (when running as router)
+static unsigned int _routerShardCount = 0;
+static char* _routerShardSockPrefix = 0;
+
+static int runRouter();
+
+// Unix socket path on which to publish the per-tick replication stream (primary)
+static char* _replStreamPath = 0;
+
+// Unix socket path of the primary's replication stream (when running as read-only replica)
+static char* _replicaPath = 0;
+
+static int runReplica();
+
+// Radius (metres) for boat proximity detection within groups (0: disabled)
+static double _proxRadius = 0.0;
+
+// Ticks between fleet tile builds (0: disabled)
+static unsigned int _fleetTilesInterval = 0;
+
+// Ensemble ETA forecasts (interval 0: disabled)
+static EnsembleConfig _ensembleConfig = {
+	.interval = 0,
+	.members = ENSEMBLE_MEMBERS_DEFAULT,
+	.threads = ENSEMBLE_THREADS_DEFAULT,
+	.cpuPercent = ENSEMBLE_CPU_PERCENT_DEFAULT,
+	.horizonHours = ENSEMBLE_HORIZON_HOURS_DEFAULT
+};
+
+// Command journal directory (if enabled)
+static char* _journalDir = 0;
+
+// Directory ghost track files are loaded from (file sources rejected if not set)
+static char* _ghostTrackDir = 0;
+
+// Minutes between precomputed wind field builds (0: disabled)
+static unsigned int _windFieldInterval = 0;
+
+// Allocate boats and boat log buffers on the tick thread's NUMA node
+static bool _numaLocal = false;
+
+// Demote idle boats to compact (cold) state
+static bool _coldTier = false;
+
+// Threads for running startup init phases (1: one phase after another)
+static unsigned int _initThreads = INIT_DEFAULT_THREAD_COUNT;
+
+// Exit once startup init phases are done (for measuring startup time)
+static bool _initOnly = false;
+
+// Restore boats in the background, while ticking (rather than as an init phase)
+static bool _bgRestore = false;
+
+// Unix socket path on which a new process can connect to take over from this one
+static char* _handoffPath = 0;
+
+// Unix socket path of an old process to take over from (rather than restoring boats)
+static char* _takeoverPath = 0;
+
+static int initWeather(void* arg);
+static int initOcean(void* arg);
+static int initWave(void* arg);
+static int initGeoInfo(void* arg);
+static int initCompass(void* arg);
+static int restoreBoats(void* arg);
+static int restoreBoatsFromInit();
+static bool isOwnBoat(const char* name, const char* group);
+static bool isHeldWhileRestoring(Command* cmd);
+static bool isHeldForGhostTrack(Command* cmd, const Command* held);
+static int replayCommand(Command* cmd, time_t tick);
+static long msSince(const struct timespec* t);
+static void waitForTick(time_t tickTime);
 
 
 int main(int argc, char** argv)
 {
+	struct timespec startT;
+	clock_gettime(CLOCK_MONOTONIC, &startT);
+
 	int argsRc;
 	if ((argsRc = parseArgs(argc, argv)) < 0)
 	{
@@ -127,6 +242,19 @@ int main(int argc, char** argv)
 	ERRLOG(VERSION_STRING);
 	ERRLOG1("Using libProteus version %s", proteus_getVersionString());
 
+	if (_numaLocal && Affinity_setNumaLocal() != 0)
+	{
+		ERRLOG("Failed to set up NUMA-local allocation!");
+		return -1;
+	}
+
+	// Self-adjusting NetServer worker pool, from --netthreads up to --netthreadsmax
+	if (_netThreadsMax > 0 && NetServer_setWorkerPoolLimits(_netThreads, _netThreadsMax, NETSERVER_WORKER_IDLE_RETIRE_MS) != 0)
+	{
+		ERRLOG("Failed to set NetServer worker pool limits!");
+		return -1;
+	}
+
 	if (perfTest)
 	{
 		// Perf test run, so direct libproteus logging output to nowhere.
@@ -138,6 +266,17 @@ int main(int argc, char** argv)
 		proteus_Logging_setOutputFd(2);
 	}
 
+	if (_routerShardCount > 0)
+	{
+		// Router only forwards requests/commands to shard processes, so no simulation data is loaded here.
+		return runRouter();
+	}
+
+	if (_shardCount > 0)
+	{
+		ERRLOG2("Running as shard %u of %u", _shardIndex, _shardCount);
+	}
+
 
 	if (BoatRegistry_init() != 0)
 	{
@@ -145,68 +284,59 @@ int main(int argc, char** argv)
 		return -1;
 	}
 
-	int initRc;
-	if ((initRc = BoatInitParser_start(BOAT_INIT_DATA_FILENAME, SQLITE_DB_FILENAME)) == 0)
-	{
-		BoatInitEntry* be;
-		while ((be = BoatInitParser_getNext()) != 0)
-		{
-			if (BoatRegistry_OK != BoatRegistry_add(be->boat, be->name, be->group, be->boatAltName))
-			{
-				ERRLOG("Failed to add boat to registry!");
-				return -1;
-			}
+	BoatRegistry_setColdTier(_coldTier);
 
-			free(be->name);
-			if (be->group)
-			{
-				free(be->group);
-			}
-			if (be->boatAltName)
-			{
-				free(be->boatAltName);
-			}
-			free(be);
-		}
-	}
-	else if (initRc == 1)
+	if (Zones_init(SQLITE_DB_FILENAME) != 0)
 	{
-		ERRLOG("Boat init found nothing. Continuing with no boats.");
+		ERRLOG("Failed to init zones!");
+		return -1;
 	}
-	else
+
+	if (GhostTrack_init(SQLITE_DB_FILENAME, _ghostTrackDir) != 0)
 	{
-		ERRLOG("Failed to read boats for init!");
+		ERRLOG("Failed to init ghost tracks!");
 		return -1;
 	}
 
-	if (proteus_Weather_init(PROTEUS_WEATHER_SOURCE_DATA_GRID_1P00, WX_DATA_DIR_PATH_F006, WX_DATA_DIR_PATH_F009) != 0)
+	// Environment datasets and boats (all independent of each other) are loaded concurrently.
+	InitPhase initPhases[] = {
+		{ "weather", &initWeather, 0, 0, false, 0, 0 },
+		{ "ocean", &initOcean, 0, 0, false, 0, 0 },
+		{ "wave", &initWave, 0, 0, false, 0, 0 },
+		{ "geoinfo", &initGeoInfo, 0, 0, false, 0, 0 },
+		{ "compass", &initCompass, 0, 0, false, 0, 0 },
+		{ "boats", &restoreBoats, 0, 0, false, 0, 0 }
+	};
+
+	// Replicas get all boats from the primary's replication stream, and a process taking over from another gets them from
+	// its snapshot, so neither has boats to restore, and with background restore, boats are restored once ticking has started.
+	const unsigned int initPhaseCount = (sizeof(initPhases) / sizeof(InitPhase)) - ((_replicaPath || _takeoverPath || _bgRestore) ? 1 : 0);
+	if (_replicaPath)
 	{
-		ERRLOG("Failed to init weather!");
-		return -1;
+		ERRLOG("Running as replica, so all boats will come from the primary's replication stream.");
 	}
 
-	if (proteus_Ocean_init(OCEAN_DATA_PATH_T030, OCEAN_DATA_PATH_T042) != 0)
+	if (InitPhases_run(initPhases, initPhaseCount, _initThreads) != 0)
 	{
-		ERRLOG("Failed to init ocean data!");
+		ERRLOG("Failed to run startup init phases!");
 		return -1;
 	}
 
-	if (proteus_Wave_init(WAVE_DATA_PATH_F30, WAVE_DATA_PATH_F42) != 0)
+	if (_initOnly)
 	{
-		ERRLOG("Failed to init wave data!");
-		return -1;
+		return 0;
 	}
 
-	if (proteus_GeoInfo_init(GEO_INFO_DATA_DIR_PATH) != 0)
+	if (_windFieldInterval > 0 && WindField_start(WINDFIELD_RES_DEG, _windFieldInterval) != 0)
 	{
-		ERRLOG("Failed to init geographic info!");
+		ERRLOG("Failed to start wind field building!");
 		return -1;
 	}
 
-	if (proteus_Compass_init(COMPASS_DATA_PATH) != 0)
+	if (_replicaPath)
 	{
-		ERRLOG("Failed to init compass data!");
-		return -1;
+		// Replica only serves read requests, so nothing else (commands, logging, boat advancing) is needed here.
+		return runReplica();
 	}
 
 	if (CelestialSight_init() != 0)
@@ -221,7 +351,9 @@ int main(int argc, char** argv)
 		return -1;
 	}
 
-	if (Command_init(CMDS_INPUT_PATH) != 0)
+	// Shards receive commands only via the router (over NetServer), rather than reading the command input FIFO. When
+	// taking over, the command input comes from the old process (once taken over, below).
+	if (!_takeoverPath && Command_init(_shardCount > 0 ? 0 : CMDS_INPUT_PATH) != 0)
 	{
 		ERRLOG("Failed to init command processor!");
 		return -1;
@@ -239,18 +371,157 @@ int main(int argc, char** argv)
 		return -1;
 	}
 
-	if (_netPort > 0 && _netThreads > 0)
+	if (RaceMarks_init(SQLITE_DB_FILENAME) != 0)
+	{
+		ERRLOG("Failed to init race marks!");
+		return -1;
+	}
+
+	time_t journalDoneUpTo = 0;
+	if (_journalDir && !_takeoverPath)
+	{
+		if (CommandJournal_init(_journalDir, SQLITE_DB_FILENAME) != 0)
+		{
+			ERRLOG("Failed to init command journal!");
+			return -1;
+		}
+
+		// Reapply commands from after the last boat logs (from which the boats were restored), before anything else can see the boats.
+		if (CommandJournal_replay(&replayCommand, &CommandSchedule_addJournaled, &journalDoneUpTo) != 0)
+		{
+			ERRLOG("Failed to replay command journal!");
+			return -1;
+		}
+	}
+
+	// The old process keeps ticking until the end of the tick in which this process connects.
+	HandoffState handoff;
+	memset(&handoff, 0, sizeof(HandoffState));
+	if (_takeoverPath)
+	{
+		if (Handoff_takeover(_takeoverPath, &handoff) != 0)
+		{
+			ERRLOG("Failed to take over from old process!");
+			return -1;
+		}
+
+		const int cmdFd = handoff.fds[HANDOFF_FD_CMD];
+		if ((cmdFd >= 0 ? Command_initWithInput(cmdFd, handoff.pending, handoff.pendingLen) : Command_init(_shardCount > 0 ? 0 : CMDS_INPUT_PATH)) != 0)
+		{
+			ERRLOG("Failed to init command processor!");
+			return -1;
+		}
+
+		if (Handoff_startForwarded() != 0)
+		{
+			ERRLOG("Failed to start receiving forwarded commands!");
+			return -1;
+		}
+
+		// Scheduled commands up to the old process's last tick have been applied by it.
+		journalDoneUpTo = handoff.tickTime;
+
+		// The old process's segments are carried on from (in a new segment) but not replayed, since its boat snapshot
+		// already has its commands applied. Only initialized now, after its last tick's commands have been written.
+		if (_journalDir && CommandJournal_init(_journalDir, SQLITE_DB_FILENAME) != 0)
+		{
+			ERRLOG("Failed to init command journal!");
+			return -1;
+		}
+	}
+
+	if (CommandSchedule_init(SQLITE_DB_FILENAME, _takeoverPath ? handoff.tickTime : time(0), journalDoneUpTo) != 0)
+	{
+		ERRLOG("Failed to init command schedule!");
+		return -1;
+	}
+
+	if (_bgRestore)
+	{
+		// Started before NetServer, so that boat data requests answer "loading" (not "noboat") until restore is done.
+		const int restoreRc = BoatRestore_start(BOAT_INIT_DATA_FILENAME, SQLITE_DB_FILENAME, (_shardCount > 0) ? &isOwnBoat : 0);
+		if (restoreRc == 1)
+		{
+			ERRLOG("Boat init found nothing. Continuing with no boats.");
+		}
+		else if (restoreRc != 0)
+		{
+			ERRLOG("Failed to start background boat restore!");
+			return -1;
+		}
+	}
+
+	if (_takeoverPath && handoff.fds[HANDOFF_FD_NET] >= 0)
+	{
+		signal(SIGPIPE, SIG_IGN);
+
+		// Listening sockets of the old process, with connections waiting on them since the handoff.
+		if (NetServer_initWithFd(handoff.fds[HANDOFF_FD_NET], _netThreads) != 0)
+		{
+			ERRLOG("Failed to init net server!");
+			return -1;
+		}
+
+		if (handoff.fds[HANDOFF_FD_HTTP] >= 0 && NetServer_initHttpWithFd(handoff.fds[HANDOFF_FD_HTTP]) != 0)
+		{
+			ERRLOG("Failed to init HTTP listener!");
+			return -1;
+		}
+	}
+	else if ((_netPort > 0 || _netUnixPath) && _netThreads > 0)
 	{
 		signal(SIGPIPE, SIG_IGN);
 
-		if (NetServer_init(_netHost, _netPort, _netThreads) != 0)
+		if (NetServer_init(_netHost, _netPort, _netUnixPath, _netThreads) != 0)
 		{
 			ERRLOG("Failed to init net server!");
 			return -1;
 		}
+
+		if ((_httpPort > 0 || _httpUnixPath) && NetServer_initHttp(_netHost, _httpPort, _httpUnixPath) != 0)
+		{
+			ERRLOG("Failed to init HTTP listener!");
+			return -1;
+		}
+	}
+
+	if (_replStreamPath && Replication_initPrimary(_replStreamPath) != 0)
+	{
+		ERRLOG("Failed to init replication stream!");
+		return -1;
+	}
+
+	if (_proxRadius > 0.0 && Proximity_init(_proxRadius) != 0)
+	{
+		ERRLOG("Failed to init proximity detection!");
+		return -1;
+	}
+
+	if (_fleetTilesInterval > 0 && FleetTiles_init(_fleetTilesInterval) != 0)
+	{
+		ERRLOG("Failed to init fleet tiles!");
+		return -1;
+	}
+
+	if (_ensembleConfig.interval > 0 && Ensemble_init(&_ensembleConfig) != 0)
+	{
+		ERRLOG("Failed to init ensemble ETA forecasts!");
+		return -1;
+	}
+
+	if (_handoffPath && Handoff_listen(_handoffPath) != 0)
+	{
+		ERRLOG("Failed to init handoff socket!");
+		return -1;
 	}
 
 
+	// All other threads have been started by now (and would otherwise have taken on the tick thread's CPUs).
+	Affinity_applyToThread(pthread_self(), AFFINITY_ROLE_TICK);
+	Affinity_preferTickNode(true);
+
+	time_t lastSchedStatsTime = time(0);
+
 	int lastIter = 1;
 
 	int perfIter = 0;
@@ -258,6 +529,18 @@ int main(int argc, char** argv)
 	long perfTotalNs = 0;
 	bool perfFirst = true;
 
+	bool firstTick = true;
+	bool restoring = _bgRestore && BoatRestore_isRestoring();
+
+	// Commands held (in order) until restore is done, for boats (or groups) not all restored yet
+	Command* heldCmds = 0;
+
+	if (_takeoverPath)
+	{
+		// Carry on from the second after the old process's last tick (so that no second is ticked twice).
+		waitForTick(handoff.tickTime + 1);
+	}
+
 	struct timespec nextT;
 	if (0 != clock_gettime(CLOCK_MONOTONIC, &nextT))
 	{
@@ -269,10 +552,55 @@ int main(int argc, char** argv)
 	{
 		time_t curTime = time(0);
 
+		if (restoring)
+		{
+			// Boats restored so far join the registry before this tick's advance.
+			if (BoatRegistry_OK != BoatRegistry_wrlock())
+			{
+				ERRLOG("Failed to write-lock BoatRegistry lock for boat restore!");
+			}
+
+			BoatRestore_publish(BOAT_RESTORE_PUBLISH_MAX);
+
+			if (BoatRegistry_OK != BoatRegistry_unlock())
+			{
+				ERRLOG("Failed to unlock BoatRegistry lock after boat restore!");
+			}
+
+			if (!(restoring = BoatRestore_isRestoring()))
+			{
+				BoatRestoreStats stats;
+				BoatRestore_getStats(&stats);
+				ERRLOG2("Fully restored %lu boats, %ld ms after start", stats.published, msSince(&startT));
+			}
+		}
+
 		unsigned int boatCount;
 		void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
 		BoatEntry* boats = sailnavsim_boatregistry_boats_iterator_get_next(iterator);
 
+		if (firstTick)
+		{
+			ERRLOG2("First tick %ld ms after start, with %u boats restored", msSince(&startT), boatCount);
+
+			if (_takeoverPath)
+			{
+				struct timespec now;
+				clock_gettime(CLOCK_REALTIME, &now);
+				const long sinceHandoffMs = ((now.tv_sec * 1000000000L + now.tv_nsec) - handoff.handoffTimeNs) / 1000000L;
+
+				ERRLOG4("First tick %ld after old process's last tick %ld (%ld ticks skipped), %ld ms after handoff", \
+						curTime, \
+						handoff.tickTime, \
+						curTime - handoff.tickTime - 1, \
+						sinceHandoffMs);
+			}
+
+			firstTick = false;
+		}
+
+		PROBE2(tick_start, curTime, boatCount);
+
 		// Process all boats.
 		if (boatCount > 0)
 		{
@@ -327,75 +655,91 @@ int main(int argc, char** argv)
 				ERRLOG("Failed to write-lock BoatRegistry lock for boat advance!");
 			}
 
+			PROBE1(advance_start, boatCount);
+
+			const bool hasMarks = RaceMarks_hasMarks();
+
 			// Advance boats.
 			BoatEntry* e = boats;
 			while (e)
 			{
-				Boat* boat = e->boat;
-				Boat_advance(boat, curTime);
-
-				if (doLog)
+				if (!e->boat)
 				{
-					bool isReportVisible = true;
-
-					if ((boat->boatFlags & BOAT_FLAG_CELESTIAL))
+					// Cold (idle) boat, so nothing to advance, and just logged as it is.
+					if (doLog)
 					{
-						// Boat is in celestial navigation mode.
-						proteus_Weather wx;
-						proteus_Weather_get(&boat->pos, &wx, false);
+						Boat coldBoat;
+						logBoat(BoatRegistry_view(e, &coldBoat), e->name, curTime, logEntries + ilog, sights + ilog, &totalSights);
+						ilog++;
+					}
 
-						CelestialSight_shoot(curTime, &boat->pos, (int) roundf(wx.cloud), (double) wx.pressure, (double) wx.temp, sights + ilog);
+					e = sailnavsim_boatregistry_boats_iterator_get_next(iterator);
+					continue;
+				}
 
-						if (sights[ilog].obj >= 0)
-						{
-							// We have successfully shot a sight.
-							if ((boat->boatFlags & BOAT_FLAG_CELESTIAL_WAVE_EFFECT))
-							{
-								// Waves affect sight accuracy.
-								double az = sights[ilog].coord.az;
-								double alt = sights[ilog].coord.alt;
-
-								if (Boat_getWaveAdjustedCelestialAzAlt(boat, &az, &alt))
-								{
-									// Adjusted values available, so update the sight.
-									sights[ilog].coord.az = az;
-									sights[ilog].coord.alt = alt;
-
-									totalSights++;
-								}
-								else
-								{
-									// No adjusted values available, so drop the sight.
-									sights[ilog].obj = -1;
-								}
-							}
-							else
-							{
-								// No wave effect on sight accuracy, so just move on.
-								totalSights++;
-							}
-						}
+				Boat* boat = e->boat;
+				const proteus_GeoPos prevPos = boat->pos;
 
-						isReportVisible = GeoUtils_isApproximatelyNearVisibleLand(&boat->pos, wx.visibility);
-					}
-					else
-					{
-						sights[ilog].obj = -1;
-					}
+				Boat_advance(boat, curTime);
+
+				if (hasMarks && e->group)
+				{
+					RaceMarks_checkCrossings(e->name, e->group, &prevPos, &boat->pos, curTime);
+				}
 
-					Logger_fillLogEntry(boat, e->name, curTime, isReportVisible, logEntries + ilog);
+				if (boat->enteredZone)
+				{
+					Zones_addEntryEvent(e->name, boat->enteredZone, curTime);
+				}
 
+				if (doLog)
+				{
+					logBoat(boat, e->name, curTime, logEntries + ilog, sights + ilog, &totalSights);
 					ilog++;
 				}
 
+				if (_coldTier)
+				{
+					BoatRegistry_demote(e);
+				}
+
 				e = sailnavsim_boatregistry_boats_iterator_get_next(iterator);
 			}
 
+			PROBE1(advance_end, boatCount);
+
 			if (BoatRegistry_OK != BoatRegistry_unlock())
 			{
 				ERRLOG("Failed to unlock BoatRegistry lock after boat advance!");
 			}
 
+			if (hasMarks)
+			{
+				unsigned int evCount;
+				BoatEventEntry* events = RaceMarks_takeEvents(&evCount);
+				if (evCount > 0)
+				{
+					Logger_writeEvents(events, evCount);
+				}
+				else
+				{
+					free(events);
+				}
+			}
+
+			{
+				unsigned int evCount;
+				BoatEventEntry* events = Zones_takeEvents(&evCount);
+				if (evCount > 0)
+				{
+					Logger_writeEvents(events, evCount);
+				}
+				else
+				{
+					free(events);
+				}
+			}
+
 			if (doLog)
 			{
 				CelestialSightEntry* csEntries = malloc(totalSights * sizeof(CelestialSightEntry));
@@ -426,6 +770,12 @@ int main(int argc, char** argv)
 				free(sights);
 
 				Logger_writeLogs(logEntries, boatCount, csEntries, totalSights);
+
+				if (_journalDir)
+				{
+					// Boat logs for this tick cover all commands journaled so far, so later ones go into a new segment.
+					CommandJournal_startSegment(curTime);
+				}
 			}
 		}
 		sailnavsim_boatregistry_free_boats_iterator(iterator);
@@ -526,27 +876,170 @@ int main(int argc, char** argv)
 		} // End of performance testing control block inside main loop.
 
 
-		if (BoatRegistry_OK != BoatRegistry_wrlock())
+		// Gather this tick's commands: any held ones, then scheduled ones now due, then pending ones.
+		Command* cmds = CommandSchedule_takeDue(curTime);
+		if (heldCmds)
 		{
-			ERRLOG("Failed to write-lock BoatRegistry lock for commands!");
+			Command* heldLast = heldCmds;
+			while (heldLast->next)
+			{
+				heldLast = heldLast->next;
+			}
+
+			heldLast->next = cmds;
+			cmds = heldCmds;
+			heldCmds = 0;
 		}
 
-		// Handle pending commands.
-		unsigned int cmdCount = 0;
+		Command* cmdsLast = cmds;
+		while (cmdsLast && cmdsLast->next)
+		{
+			cmdsLast = cmdsLast->next;
+		}
+
+		Command* scheduled = 0;
+		Command* scheduledLast = 0;
+
 		Command* cmd;
 		while ((cmd = Command_next()))
 		{
-			handleCommand(cmd);
-			Command_free(cmd);
-			cmdCount++;
+			if (cmd->execTime > curTime)
+			{
+				// Scheduled for later, once journaled.
+				cmd->next = 0;
+				if (scheduledLast)
+				{
+					scheduledLast->next = cmd;
+				}
+				else
+				{
+					scheduled = cmd;
+				}
+				scheduledLast = cmd;
+				continue;
+			}
+
+			if (cmdsLast)
+			{
+				cmdsLast->next = cmd;
+			}
+			else
+			{
+				cmds = cmd;
+			}
+			cmdsLast = cmd;
 		}
 
-		if (BoatRegistry_OK != BoatRegistry_unlock())
+		// Journal them all at once (and on disk) before applying any, with newly scheduled ones (so that they're
+		// durable before being acknowledged) first.
+		if (scheduledLast)
 		{
-			ERRLOG("Failed to unlock BoatRegistry lock after commands!");
+			scheduledLast->next = cmds;
 		}
 
-
+		if (_journalDir && 0 != CommandJournal_write(curTime, scheduled ? scheduled : cmds))
+		{
+			ERRLOG("Failed to journal commands! Applying them anyway.");
+		}
+
+		if (scheduledLast)
+		{
+			scheduledLast->next = 0;
+		}
+
+		while (scheduled)
+		{
+			cmd = scheduled;
+			scheduled = cmd->next;
+
+			if (0 != CommandSchedule_add(cmd))
+			{
+				Command_free(cmd);
+			}
+			else
+			{
+				Command_complete(cmd, COMMAND_RESULT_SCHEDULED, curTime);
+			}
+		}
+
+		if (BoatRegistry_OK != BoatRegistry_wrlock())
+		{
+			ERRLOG("Failed to write-lock BoatRegistry lock for commands!");
+		}
+
+		// Handle pending commands.
+		unsigned int cmdCount = 0;
+		Command* heldLast = 0;
+		while (cmds)
+		{
+			cmd = cmds;
+			cmds = cmd->next;
+
+			if ((restoring && isHeldWhileRestoring(cmd)) || isHeldForGhostTrack(cmd, heldCmds))
+			{
+				// Tried again next tick.
+				cmd->next = 0;
+				if (heldLast)
+				{
+					heldLast->next = cmd;
+				}
+				else
+				{
+					heldCmds = cmd;
+				}
+				heldLast = cmd;
+				continue;
+			}
+
+			const int result = handleCommand(cmd, curTime);
+			PROBE2(command_applied, cmd->action, cmd->name);
+			Command_complete(cmd, result, curTime);
+			Command_free(cmd);
+			cmdCount++;
+		}
+
+		if (BoatRegistry_OK != BoatRegistry_unlock())
+		{
+			ERRLOG("Failed to unlock BoatRegistry lock after commands!");
+		}
+
+		// Boats removed by group commands
+		BoatRegistry_freeRemoved();
+
+		if (_journalDir)
+		{
+			// Drop journal segments covered by boat logs now in the DB.
+			CommandJournal_checkpoint(Logger_getLastBoatLogTime());
+		}
+
+		PROBE3(tick_end, curTime, boatCount, cmdCount);
+
+		if (_replStreamPath)
+		{
+			// No lock needed here, since only this thread modifies boats and the boat registry.
+			Replication_publishTick(curTime);
+		}
+
+		// Likewise no lock needed here (and Proximity, FleetTiles and Ensemble take their own locks to publish results to NetServer).
+		Proximity_update(curTime);
+		FleetTiles_update();
+		Ensemble_update(curTime);
+
+		if (curTime - lastSchedStatsTime >= SCHED_STATS_LOG_INTERVAL)
+		{
+			Affinity_logSchedStats();
+			lastSchedStatsTime = curTime;
+		}
+
+		// Put off while commands are held (for ghost tracks being loaded), since they aren't handed over.
+		if (_handoffPath && !heldCmds && Handoff_isRequested() && Handoff_run(curTime) == 0)
+		{
+			// The new process carries on from the next tick, and connections accepted here are all done (or given up on).
+			ERRLOG("Handed over to new process. Exiting.");
+			return 0;
+		}
+
+
 		// Next iteration 1 second later
 		nextT.tv_sec++;
 
@@ -675,115 +1168,1081 @@ static int parseArgs(int argc, char** argv)
 				return -1;
 			}
 		}
-		else
+		else if (0 == strcmp("--netthreadsmax", argv[i]))
 		{
-			printf("Invalid argument: %s\n", argv[i]);
-			return -1;
-		}
-	}
-
-	if (doPerf)
-	{
-		return 2;
-	}
-
-	return 0;
-}
+			if (argv[i + 1])
+			{
+				_netThreadsMax = atoi(argv[i + 1]);
 
-static void printVersionInfo()
-{
-	printf("%s, using libProteus version %s\n", VERSION_STRING, proteus_getVersionString());
-}
+				if (_netThreadsMax <= 0 || _netThreadsMax > NETSERVER_MAX_THREAD_COUNT)
+				{
+					printf("Invalid netthreadsmax argument: %s\n", argv[i + 1]);
+					return -1;
+				}
 
-static void handleCommand(Command* cmd)
-{
-	// First check if it's a boat registry action, and handle those actions separately.
-	switch (cmd->action)
-	{
-		case COMMAND_ACTION_ADD_BOAT:
-		case COMMAND_ACTION_ADD_BOAT_WITH_GROUP:
-		case COMMAND_ACTION_REMOVE_BOAT:
-			handleBoatRegistryCommand(cmd);
-			return;
-	}
+				i++;
+			}
+			else
+			{
+				printf("No netthreadsmax argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--netunix", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_netUnixPath = strdup(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				printf("No netunix argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--httpport", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_httpPort = atoi(argv[i + 1]);
 
-	Boat* b = BoatRegistry_get(cmd->name);
-	if (!b)
-	{
-		return;
-	}
+				if (_httpPort <= 0 || _httpPort > 65535)
+				{
+					printf("Invalid httpport argument: %s\n", argv[i + 1]);
+					return -1;
+				}
 
-	switch (cmd->action)
-	{
-		case COMMAND_ACTION_STOP:
-			if (BoatWindResponse_isBoatTypeBasic(b->boatType))
+				i++;
+			}
+			else
 			{
-				b->sailsDown = true;
+				printf("No httpport argument provided!\n");
+				return -1;
 			}
-			break;
-		case COMMAND_ACTION_START:
-			if (Boat_isHeadingTowardWater(b, time(0)))
+		}
+		else if (0 == strcmp("--httpunix", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_httpUnixPath = strdup(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				printf("No httpunix argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--shard", argv[i]))
+		{
+			if (argv[i + 1])
 			{
-				if (BoatWindResponse_isBoatTypeAdvanced(b->boatType) && b->sailArea == 0.0)
+				if (Shard_parseSpec(argv[i + 1], &_shardIndex, &_shardCount) != 0)
 				{
-					// Advanced boat type with zero sail area, so start with 10% sail area.
-					b->sailArea = 0.1;
+					printf("Invalid shard argument (expected I/N, with 0 <= I < N <= %d): %s\n", SHARD_MAX_COUNT, argv[i + 1]);
+					return -1;
 				}
-				b->stop = false;
-				b->sailsDown = false;
-				b->movingToSea = true;
+
+				i++;
 			}
-			break;
-		case COMMAND_ACTION_COURSE_TRUE:
-		case COMMAND_ACTION_COURSE_MAG:
-			b->desiredCourse = cmd->values[0].i;
-			b->courseMagnetic = (cmd->action == COMMAND_ACTION_COURSE_MAG);
-			break;
-		case COMMAND_ACTION_SAIL_AREA:
-			if (BoatWindResponse_isBoatTypeAdvanced(b->boatType))
+			else
 			{
-				b->sailArea = ((double) cmd->values[0].i) / 100.0;
+				printf("No shard argument provided!\n");
+				return -1;
 			}
-			break;
-	}
-}
-
-static void handleBoatRegistryCommand(Command* cmd)
-{
-	switch (cmd->action)
-	{
-		case COMMAND_ACTION_ADD_BOAT:
-		case COMMAND_ACTION_ADD_BOAT_WITH_GROUP:
+		}
+		else if (0 == strcmp("--router", argv[i]))
 		{
-			const char* groupName = (cmd->action == COMMAND_ACTION_ADD_BOAT_WITH_GROUP ? cmd->values[4].s : 0);
-			const char* boatAltName = (cmd->action == COMMAND_ACTION_ADD_BOAT_WITH_GROUP ? cmd->values[5].s : 0);
+			if (argv[i + 1])
+			{
+				const int count = atoi(argv[i + 1]);
 
-			Boat* boat = Boat_new(cmd->values[0].d, cmd->values[1].d, cmd->values[2].i, cmd->values[3].i);
-			if (!boat)
+				if (count <= 0 || count > SHARD_MAX_COUNT)
+				{
+					printf("Invalid router argument: %s\n", argv[i + 1]);
+					return -1;
+				}
+
+				_routerShardCount = count;
+				i++;
+			}
+			else
 			{
-				ERRLOG("handleBoatRegistryCommand: Failed to create new Boat!");
+				printf("No router argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--shardsock", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_routerShardSockPrefix = strdup(argv[i + 1]);
+				i++;
 			}
 			else
 			{
-				int rc;
-				if (BoatRegistry_OK != (rc = BoatRegistry_add(boat, cmd->name, groupName, boatAltName)))
+				printf("No shardsock argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--replstream", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_replStreamPath = strdup(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				printf("No replstream argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--proxradius", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_proxRadius = atof(argv[i + 1]);
+
+				if (_proxRadius < PROXIMITY_RADIUS_MIN || _proxRadius > PROXIMITY_RADIUS_MAX)
 				{
-					ERRLOG2("handleBoatRegistryCommand: Failed to add Boat to BoatRegistry! rc=%d, name=%s", rc, cmd->name);
-					free(boat);
+					printf("Invalid proxradius argument (expected %.0f to %.0f metres): %s\n", PROXIMITY_RADIUS_MIN, PROXIMITY_RADIUS_MAX, argv[i + 1]);
+					return -1;
 				}
+
+				i++;
+			}
+			else
+			{
+				printf("No proxradius argument provided!\n");
+				return -1;
 			}
+		}
+		else if (0 == strcmp("--fleettiles", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				const int interval = atoi(argv[i + 1]);
 
-			break;
+				if (interval < FLEETTILES_INTERVAL_MIN || interval > FLEETTILES_INTERVAL_MAX)
+				{
+					printf("Invalid fleettiles argument (expected %d to %d ticks): %s\n", FLEETTILES_INTERVAL_MIN, FLEETTILES_INTERVAL_MAX, argv[i + 1]);
+					return -1;
+				}
+
+				_fleetTilesInterval = interval;
+				i++;
+			}
+			else
+			{
+				printf("No fleettiles argument provided!\n");
+				return -1;
+			}
 		}
-		case COMMAND_ACTION_REMOVE_BOAT:
+		else if (0 == strcmp("--eta", argv[i]))
 		{
-			Boat* boat;
-			if ((boat = BoatRegistry_remove(cmd->name)))
+			if (argv[i + 1])
+			{
+				const int v = atoi(argv[i + 1]);
+
+				if (v < ENSEMBLE_INTERVAL_MIN || v > ENSEMBLE_INTERVAL_MAX)
+				{
+					printf("Invalid eta argument (expected %d to %d ticks): %s\n", ENSEMBLE_INTERVAL_MIN, ENSEMBLE_INTERVAL_MAX, argv[i + 1]);
+					return -1;
+				}
+
+				_ensembleConfig.interval = v;
+				i++;
+			}
+			else
 			{
-				free(boat);
+				printf("No eta argument provided!\n");
+				return -1;
 			}
+		}
+		else if (0 == strcmp("--etamembers", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				const int v = atoi(argv[i + 1]);
 
-			break;
+				if (v < ENSEMBLE_MEMBERS_MIN || v > ENSEMBLE_MEMBERS_MAX)
+				{
+					printf("Invalid etamembers argument (expected %d to %d members): %s\n", ENSEMBLE_MEMBERS_MIN, ENSEMBLE_MEMBERS_MAX, argv[i + 1]);
+					return -1;
+				}
+
+				_ensembleConfig.members = v;
+				i++;
+			}
+			else
+			{
+				printf("No etamembers argument provided!\n");
+				return -1;
+			}
 		}
-	}
+		else if (0 == strcmp("--etathreads", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				const int v = atoi(argv[i + 1]);
+
+				if (v < 1 || v > ENSEMBLE_THREADS_MAX)
+				{
+					printf("Invalid etathreads argument (expected %d to %d threads): %s\n", 1, ENSEMBLE_THREADS_MAX, argv[i + 1]);
+					return -1;
+				}
+
+				_ensembleConfig.threads = v;
+				i++;
+			}
+			else
+			{
+				printf("No etathreads argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--etacpu", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				const int v = atoi(argv[i + 1]);
+
+				if (v < ENSEMBLE_CPU_PERCENT_MIN || v > ENSEMBLE_CPU_PERCENT_MAX)
+				{
+					printf("Invalid etacpu argument (expected %d to %d percent of one CPU): %s\n", ENSEMBLE_CPU_PERCENT_MIN, ENSEMBLE_CPU_PERCENT_MAX, argv[i + 1]);
+					return -1;
+				}
+
+				_ensembleConfig.cpuPercent = v;
+				i++;
+			}
+			else
+			{
+				printf("No etacpu argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--etahorizon", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				const int v = atoi(argv[i + 1]);
+
+				if (v < ENSEMBLE_HORIZON_HOURS_MIN || v > ENSEMBLE_HORIZON_HOURS_MAX)
+				{
+					printf("Invalid etahorizon argument (expected %d to %d hours): %s\n", ENSEMBLE_HORIZON_HOURS_MIN, ENSEMBLE_HORIZON_HOURS_MAX, argv[i + 1]);
+					return -1;
+				}
+
+				_ensembleConfig.horizonHours = v;
+				i++;
+			}
+			else
+			{
+				printf("No etahorizon argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--windfield", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				const int interval = atoi(argv[i + 1]);
+
+				if (interval < WINDFIELD_INTERVAL_MIN || interval > WINDFIELD_INTERVAL_MAX)
+				{
+					printf("Invalid windfield argument (expected %d to %d minutes): %s\n", WINDFIELD_INTERVAL_MIN, WINDFIELD_INTERVAL_MAX, argv[i + 1]);
+					return -1;
+				}
+
+				_windFieldInterval = interval;
+				i++;
+			}
+			else
+			{
+				printf("No windfield argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--affinity", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				if (0 != Affinity_parse(argv[i + 1]))
+				{
+					printf("Invalid affinity argument (expected tick|logger|command|net|ensemble=CPUS, such as net=4-7,12): %s\n", argv[i + 1]);
+					return -1;
+				}
+
+				i++;
+			}
+			else
+			{
+				printf("No affinity argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--numalocal", argv[i]))
+		{
+			_numaLocal = true;
+		}
+		else if (0 == strcmp("--journal", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_journalDir = strdup(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				printf("No journal argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--ghostdir", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_ghostTrackDir = strdup(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				printf("No ghostdir argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--initthreads", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				const int threads = atoi(argv[i + 1]);
+
+				if (threads <= 0 || threads > INIT_PHASES_MAX_THREAD_COUNT)
+				{
+					printf("Invalid initthreads argument (expected 1 to %d): %s\n", INIT_PHASES_MAX_THREAD_COUNT, argv[i + 1]);
+					return -1;
+				}
+
+				_initThreads = threads;
+				i++;
+			}
+			else
+			{
+				printf("No initthreads argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--initonly", argv[i]))
+		{
+			_initOnly = true;
+		}
+		else if (0 == strcmp("--coldtier", argv[i]))
+		{
+			_coldTier = true;
+		}
+		else if (0 == strcmp("--bgrestore", argv[i]))
+		{
+			_bgRestore = true;
+		}
+		else if (0 == strcmp("--handoff", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_handoffPath = strdup(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				printf("No handoff argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--takeover", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_takeoverPath = strdup(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				printf("No takeover argument provided!\n");
+				return -1;
+			}
+		}
+		else if (0 == strcmp("--replica", argv[i]))
+		{
+			if (argv[i + 1])
+			{
+				_replicaPath = strdup(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				printf("No replica argument provided!\n");
+				return -1;
+			}
+		}
+		else
+		{
+			printf("Invalid argument: %s\n", argv[i]);
+			return -1;
+		}
+	}
+
+	if (_replicaPath && (_replStreamPath || _shardCount > 0 || _routerShardCount > 0 || doPerf))
+	{
+		printf("Replica mode cannot be combined with --replstream, --shard, --router or --perf!\n");
+		return -1;
+	}
+
+	if (_routerShardCount > 0 && (!_routerShardSockPrefix || _shardCount > 0 || doPerf))
+	{
+		printf("Router mode requires --shardsock, and cannot be combined with --shard or --perf!\n");
+		return -1;
+	}
+
+	if (_journalDir && (_replicaPath || _routerShardCount > 0 || doPerf))
+	{
+		printf("Command journal cannot be combined with --replica, --router or --perf!\n");
+		return -1;
+	}
+
+	if ((_httpPort > 0 || _httpUnixPath) && (!(_netPort > 0 || _netUnixPath) || _replicaPath || _routerShardCount > 0 || doPerf))
+	{
+		printf("HTTP listener (--httpport or --httpunix) requires --netport or --netunix, and cannot be combined with --replica, --router or --perf!\n");
+		return -1;
+	}
+
+	if (_ensembleConfig.interval > 0 && (_replicaPath || _routerShardCount > 0 || doPerf))
+	{
+		printf("Ensemble ETA forecasts (--eta) cannot be combined with --replica, --router or --perf!\n");
+		return -1;
+	}
+
+	if (_coldTier && (_replicaPath || _routerShardCount > 0 || doPerf))
+	{
+		printf("Cold tier (--coldtier) cannot be combined with --replica, --router or --perf!\n");
+		return -1;
+	}
+
+	if (_bgRestore && (_journalDir || _replicaPath || _routerShardCount > 0 || _initOnly || doPerf))
+	{
+		printf("Background restore (--bgrestore) cannot be combined with --journal, --replica, --router, --initonly or --perf!\n");
+		return -1;
+	}
+
+	if ((_handoffPath || _takeoverPath) && (_replicaPath || _routerShardCount > 0 || _bgRestore || _initOnly || doPerf))
+	{
+		printf("Handoff (--handoff or --takeover) cannot be combined with --replica, --router, --bgrestore, --initonly or --perf!\n");
+		return -1;
+	}
+
+	if (_netThreadsMax > 0 && _netThreadsMax < _netThreads)
+	{
+		printf("Max net threads (--netthreadsmax) must be at least the min (--netthreads)!\n");
+		return -1;
+	}
+
+	if (_numaLocal && !Affinity_isSet(AFFINITY_ROLE_TICK))
+	{
+		printf("NUMA-local allocation requires --affinity tick=CPUS!\n");
+		return -1;
+	}
+
+	if (doPerf)
+	{
+		return 2;
+	}
+
+	return 0;
+}
+
+static int runRouter()
+{
+	ERRLOG1("Running as router for %u shards", _routerShardCount);
+
+	if (!(_netPort > 0 || _netUnixPath) || _netThreads <= 0)
+	{
+		ERRLOG("Router requires a net server port or unix socket path!");
+		return -1;
+	}
+
+	if (Router_init(_routerShardCount, _routerShardSockPrefix, CMDS_INPUT_PATH) != 0)
+	{
+		ERRLOG("Failed to init router!");
+		return -1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	NetServer_setRequestHandler(&Router_handleRequest);
+	if (NetServer_init(_netHost, _netPort, _netUnixPath, _netThreads) != 0)
+	{
+		ERRLOG("Failed to init net server!");
+		return -1;
+	}
+
+	for (;;)
+	{
+		pause();
+	}
+
+	return 0;
+}
+
+static int runReplica()
+{
+	if (!(_netPort > 0 || _netUnixPath) || _netThreads <= 0)
+	{
+		ERRLOG("Replica requires a net server port or unix socket path!");
+		return -1;
+	}
+
+	if (Replication_initReplica(_replicaPath) != 0)
+	{
+		ERRLOG("Failed to init replica!");
+		return -1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	NetServer_setRequestHandler(&Replication_handleReplicaRequest);
+	if (NetServer_init(_netHost, _netPort, _netUnixPath, _netThreads) != 0)
+	{
+		ERRLOG("Failed to init net server!");
+		return -1;
+	}
+
+	for (;;)
+	{
+		pause();
+	}
+
+	return 0;
+}
+
+static int initWeather(void* arg)
+{
+	(void) arg;
+
+	if (proteus_Weather_init(PROTEUS_WEATHER_SOURCE_DATA_GRID_1P00, WX_DATA_DIR_PATH_F006, WX_DATA_DIR_PATH_F009) != 0)
+	{
+		ERRLOG("Failed to init weather!");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int initOcean(void* arg)
+{
+	(void) arg;
+
+	if (proteus_Ocean_init(OCEAN_DATA_PATH_T030, OCEAN_DATA_PATH_T042) != 0)
+	{
+		ERRLOG("Failed to init ocean data!");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int initWave(void* arg)
+{
+	(void) arg;
+
+	if (proteus_Wave_init(WAVE_DATA_PATH_F30, WAVE_DATA_PATH_F42) != 0)
+	{
+		ERRLOG("Failed to init wave data!");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int initGeoInfo(void* arg)
+{
+	(void) arg;
+
+	if (proteus_GeoInfo_init(GEO_INFO_DATA_DIR_PATH) != 0)
+	{
+		ERRLOG("Failed to init geographic info!");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int initCompass(void* arg)
+{
+	(void) arg;
+
+	if (proteus_Compass_init(COMPASS_DATA_PATH) != 0)
+	{
+		ERRLOG("Failed to init compass data!");
+		return -1;
+	}
+
+	return 0;
+}
+
+// Restores boats into the registry (which nothing else touches until init phases are done), after zones have been loaded.
+static int restoreBoats(void* arg)
+{
+	(void) arg;
+
+	// Boats restored here are allocated on the tick thread's NUMA node (if enabled), since that's where they're used.
+	Affinity_preferTickNode(true);
+	const int rc = restoreBoatsFromInit();
+	Affinity_preferTickNode(false);
+
+	return rc;
+}
+
+static int restoreBoatsFromInit()
+{
+	const int initRc = BoatInitParser_start(BOAT_INIT_DATA_FILENAME, SQLITE_DB_FILENAME);
+	if (initRc == 1)
+	{
+		ERRLOG("Boat init found nothing. Continuing with no boats.");
+		return 0;
+	}
+	else if (initRc != 0)
+	{
+		ERRLOG("Failed to read boats for init!");
+		return -1;
+	}
+
+	BoatInitEntry* be;
+	while ((be = BoatInitParser_getNext()) != 0)
+	{
+		if (_shardCount > 0 && !Shard_isOwner(be->name, be->group, _shardIndex, _shardCount))
+		{
+			// Boat belongs to another shard.
+			Boat_free(be->boat);
+		}
+		else
+		{
+			be->boat->zones = Zones_getGroupZones(be->group);
+
+			if (BoatRegistry_OK != BoatRegistry_add(be->boat, be->name, be->group, be->boatAltName))
+			{
+				ERRLOG("Failed to add boat to registry!");
+				return -1;
+			}
+		}
+
+		BoatInitParser_freeEntry(be);
+	}
+
+	return 0;
+}
+
+// Whether a restored boat belongs to this shard
+static bool isOwnBoat(const char* name, const char* group)
+{
+	return Shard_isOwner(name, group, _shardIndex, _shardCount);
+}
+
+// Whether a command is to be held until background restore is done: those adding or removing boats (which may clash
+// with boats not restored yet), those for groups (which may not all be restored yet), and those for boats not restored
+// yet. Race mark commands don't depend on boats, so are never held.
+static bool isHeldWhileRestoring(Command* cmd)
+{
+	switch (cmd->action)
+	{
+		case COMMAND_ACTION_ADD_BOAT:
+		case COMMAND_ACTION_ADD_BOAT_WITH_GROUP:
+		case COMMAND_ACTION_ADD_GHOST:
+		case COMMAND_ACTION_REMOVE_BOAT:
+		case COMMAND_ACTION_GROUP_START:
+		case COMMAND_ACTION_GROUP_STOP:
+		case COMMAND_ACTION_GROUP_COURSE:
+		case COMMAND_ACTION_GROUP_REMOVE:
+			return true;
+		case COMMAND_ACTION_ADD_MARK:
+		case COMMAND_ACTION_REMOVE_MARK:
+			return false;
+	}
+
+	return !BoatRegistry_getBoatEntry(cmd->name);
+}
+
+// Whether a command waits for a ghost track being loaded (in the background): a ghost add whose track isn't loaded yet,
+// or any command for a boat whose ghost add is already held (so that it's still handled after the add).
+static bool isHeldForGhostTrack(Command* cmd, const Command* held)
+{
+	for (const Command* h = held; h; h = h->next)
+	{
+		if (h->action == COMMAND_ACTION_ADD_GHOST && strcmp(h->name, cmd->name) == 0)
+		{
+			return true;
+		}
+	}
+
+	// (Ghosts of other shards are rejected when handled, so their tracks aren't loaded.)
+	return (cmd->action == COMMAND_ACTION_ADD_GHOST &&
+			(_shardCount == 0 || Shard_isOwner(cmd->name, cmd->values[2].s, _shardIndex, _shardCount)) &&
+			GhostTrack_request(cmd->values[0].s) == GHOSTTRACK_LOADING);
+}
+
+// Handles a command replayed from the journal, before ticking, so ghost tracks are loaded there and then.
+static int replayCommand(Command* cmd, time_t tick)
+{
+	if (cmd->action == COMMAND_ACTION_ADD_GHOST)
+	{
+		GhostTrack_load(cmd->values[0].s);
+	}
+
+	return handleCommand(cmd, tick);
+}
+
+static long msSince(const struct timespec* t)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - t->tv_sec) * 1000L + (now.tv_nsec - t->tv_nsec) / 1000000L;
+}
+
+// Sleeps until the wall clock reaches tickTime.
+static void waitForTick(time_t tickTime)
+{
+	// Checked against time(0) (as ticks are), which can lag the clock slept on by a little.
+	while (time(0) < tickTime)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+
+		long sleepNs = (tickTime - now.tv_sec) * 1000000000L - now.tv_nsec;
+		if (sleepNs < 1000000L)
+		{
+			sleepNs = 1000000L;
+		}
+
+		struct timespec sleepT = { sleepNs / 1000000000L, sleepNs % 1000000000L };
+		struct timespec remT;
+		while (0 != nanosleep(&sleepT, &remT) && errno == EINTR)
+		{
+			sleepT = remT;
+		}
+	}
+}
+
+static void printVersionInfo()
+{
+	printf("%s, using libProteus version %s\n", VERSION_STRING, proteus_getVersionString());
+}
+
+static int handleCommand(Command* cmd, time_t tick)
+{
+	// First check if it's a boat registry action, and handle those actions separately.
+	switch (cmd->action)
+	{
+		case COMMAND_ACTION_ADD_BOAT:
+		case COMMAND_ACTION_ADD_BOAT_WITH_GROUP:
+		case COMMAND_ACTION_ADD_GHOST:
+		case COMMAND_ACTION_REMOVE_BOAT:
+			return handleBoatRegistryCommand(cmd, tick);
+		case COMMAND_ACTION_ADD_MARK:
+		case COMMAND_ACTION_REMOVE_MARK:
+			return handleRaceMarkCommand(cmd);
+		case COMMAND_ACTION_GROUP_START:
+		case COMMAND_ACTION_GROUP_STOP:
+		case COMMAND_ACTION_GROUP_COURSE:
+		case COMMAND_ACTION_GROUP_REMOVE:
+			return handleGroupCommand(cmd, tick);
+	}
+
+	Boat* b = BoatRegistry_get(cmd->name);
+	if (!b)
+	{
+		return COMMAND_RESULT_NOBOAT;
+	}
+
+	return applyBoatAction(b, cmd->action, cmd->values, tick);
+}
+
+// Fills a boat's log entry, with a celestial sight (obj -1 if none) shot from it if it's in celestial navigation mode.
+static void logBoat(const Boat* boat, const char* name, time_t curTime, LogEntry* log, CelestialSight* sight, int* totalSights)
+{
+	bool isReportVisible = true;
+
+	if ((boat->boatFlags & BOAT_FLAG_CELESTIAL))
+	{
+		// Boat is in celestial navigation mode.
+		proteus_Weather wx;
+		proteus_Weather_get(&boat->pos, &wx, false);
+
+		CelestialSight_shoot(curTime, &boat->pos, (int) roundf(wx.cloud), (double) wx.pressure, (double) wx.temp, sight);
+
+		if (sight->obj >= 0)
+		{
+			// We have successfully shot a sight.
+			if ((boat->boatFlags & BOAT_FLAG_CELESTIAL_WAVE_EFFECT))
+			{
+				// Waves affect sight accuracy.
+				double az = sight->coord.az;
+				double alt = sight->coord.alt;
+
+				if (Boat_getWaveAdjustedCelestialAzAlt(boat, &az, &alt))
+				{
+					// Adjusted values available, so update the sight.
+					sight->coord.az = az;
+					sight->coord.alt = alt;
+
+					(*totalSights)++;
+				}
+				else
+				{
+					// No adjusted values available, so drop the sight.
+					sight->obj = -1;
+				}
+			}
+			else
+			{
+				// No wave effect on sight accuracy, so just move on.
+				(*totalSights)++;
+			}
+		}
+
+		isReportVisible = GeoUtils_isApproximatelyNearVisibleLand(&boat->pos, wx.visibility);
+	}
+	else
+	{
+		sight->obj = -1;
+	}
+
+	Logger_fillLogEntry(boat, name, curTime, isReportVisible, log);
+}
+
+static int applyBoatAction(Boat* b, int action, const CommandValue* values, time_t tick)
+{
+	if ((b->boatFlags & BOAT_FLAG_GHOST))
+	{
+		// Ghost boats only follow their recorded track.
+		return COMMAND_RESULT_REJECTED;
+	}
+
+	switch (action)
+	{
+		case COMMAND_ACTION_STOP:
+			if (!BoatWindResponse_isBoatTypeBasic(b->boatType))
+			{
+				return COMMAND_RESULT_REJECTED;
+			}
+			b->sailsDown = true;
+			break;
+		case COMMAND_ACTION_START:
+			if (!Boat_isHeadingTowardWater(b, tick))
+			{
+				return COMMAND_RESULT_REJECTED;
+			}
+			if (BoatWindResponse_isBoatTypeAdvanced(b->boatType) && b->sailArea == 0.0)
+			{
+				// Advanced boat type with zero sail area, so start with 10% sail area.
+				b->sailArea = 0.1;
+			}
+			b->stop = false;
+			b->sailsDown = false;
+			b->movingToSea = true;
+			break;
+		case COMMAND_ACTION_COURSE_TRUE:
+		case COMMAND_ACTION_COURSE_MAG:
+			b->desiredCourse = values[0].i;
+			b->courseMagnetic = (action == COMMAND_ACTION_COURSE_MAG);
+			break;
+		case COMMAND_ACTION_SAIL_AREA:
+			if (!BoatWindResponse_isBoatTypeAdvanced(b->boatType))
+			{
+				return COMMAND_RESULT_REJECTED;
+			}
+			b->sailArea = ((double) values[0].i) / 100.0;
+			break;
+	}
+
+	return COMMAND_RESULT_OK;
+}
+
+static int handleBoatRegistryCommand(Command* cmd, time_t tick)
+{
+	switch (cmd->action)
+	{
+		case COMMAND_ACTION_ADD_BOAT:
+		case COMMAND_ACTION_ADD_BOAT_WITH_GROUP:
+		{
+			const char* groupName = (cmd->action == COMMAND_ACTION_ADD_BOAT_WITH_GROUP ? cmd->values[4].s : 0);
+			const char* boatAltName = (cmd->action == COMMAND_ACTION_ADD_BOAT_WITH_GROUP ? cmd->values[5].s : 0);
+
+			Boat* boat = Boat_new(cmd->values[0].d, cmd->values[1].d, cmd->values[2].i, cmd->values[3].i);
+			if (!boat)
+			{
+				ERRLOG("handleBoatRegistryCommand: Failed to create new Boat!");
+				return COMMAND_RESULT_FAILED;
+			}
+			else if (_shardCount > 0 && !Shard_isOwner(cmd->name, groupName, _shardIndex, _shardCount))
+			{
+				ERRLOG1("handleBoatRegistryCommand: Boat %s belongs to another shard, so not adding.", cmd->name);
+				Boat_free(boat);
+				return COMMAND_RESULT_REJECTED;
+			}
+			else
+			{
+				boat->zones = Zones_getGroupZones(groupName);
+
+				int rc;
+				if (BoatRegistry_OK != (rc = BoatRegistry_add(boat, cmd->name, groupName, boatAltName)))
+				{
+					ERRLOG2("handleBoatRegistryCommand: Failed to add Boat to BoatRegistry! rc=%d, name=%s", rc, cmd->name);
+					Boat_free(boat);
+					return COMMAND_RESULT_REJECTED;
+				}
+			}
+
+			break;
+		}
+		case COMMAND_ACTION_ADD_GHOST:
+		{
+			const char* groupName = cmd->values[2].s;
+			const char* boatAltName = cmd->values[3].s;
+
+			if (_shardCount > 0 && !Shard_isOwner(cmd->name, groupName, _shardIndex, _shardCount))
+			{
+				ERRLOG1("handleBoatRegistryCommand: Ghost boat %s belongs to another shard, so not adding.", cmd->name);
+				return COMMAND_RESULT_REJECTED;
+			}
+
+			const GhostTrack* track = GhostTrack_get(cmd->values[0].s);
+			if (!track)
+			{
+				ERRLOG2("handleBoatRegistryCommand: No track for ghost boat %s from %s!", cmd->name, cmd->values[0].s);
+				return COMMAND_RESULT_REJECTED;
+			}
+
+			Boat* boat = Boat_new(0.0, 0.0, cmd->values[1].i, 0);
+			if (!boat)
+			{
+				ERRLOG("handleBoatRegistryCommand: Failed to create new ghost Boat!");
+				return COMMAND_RESULT_FAILED;
+			}
+
+			Boat_startGhost(boat, track, tick);
+
+			int rc;
+			if (BoatRegistry_OK != (rc = BoatRegistry_add(boat, cmd->name, groupName, boatAltName)))
+			{
+				ERRLOG2("handleBoatRegistryCommand: Failed to add ghost Boat to BoatRegistry! rc=%d, name=%s", rc, cmd->name);
+				Boat_free(boat);
+				return COMMAND_RESULT_REJECTED;
+			}
+
+			break;
+		}
+		case COMMAND_ACTION_REMOVE_BOAT:
+		{
+			Boat* boat;
+			if (!(boat = BoatRegistry_remove(cmd->name)))
+			{
+				return COMMAND_RESULT_NOBOAT;
+			}
+
+			Boat_free(boat);
+			break;
+		}
+	}
+
+	return COMMAND_RESULT_OK;
+}
+
+static int handleGroupCommand(Command* cmd, time_t tick)
+{
+	if (cmd->action == COMMAND_ACTION_GROUP_REMOVE)
+	{
+		// Boats and their entries are freed after the registry is unlocked.
+		const unsigned int count = BoatRegistry_removeGroup(cmd->name);
+		if (count == 0)
+		{
+			return COMMAND_RESULT_NOBOAT;
+		}
+
+		ERRLOG2("Removed %u boats in group %s", count, cmd->name);
+		return COMMAND_RESULT_OK;
+	}
+
+	int action;
+	switch (cmd->action)
+	{
+		case COMMAND_ACTION_GROUP_START:
+			action = COMMAND_ACTION_START;
+			break;
+		case COMMAND_ACTION_GROUP_STOP:
+			action = COMMAND_ACTION_STOP;
+			break;
+		default:
+			action = COMMAND_ACTION_COURSE_TRUE;
+			break;
+	}
+
+	unsigned int count;
+	BoatEntry** entries = BoatRegistry_getGroupEntries(cmd->name, &count);
+	if (!entries)
+	{
+		return COMMAND_RESULT_NOBOAT;
+	}
+
+	// Same as the command for each boat, with boats that reject it (e.g. ghosts) left as they are.
+	unsigned int applied = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Boat* b = BoatRegistry_promote(entries[i]);
+		if (b && applyBoatAction(b, action, cmd->values, tick) == COMMAND_RESULT_OK)
+		{
+			applied++;
+		}
+	}
+
+	BoatRegistry_freeGroupEntries(entries, count);
+
+	return (applied > 0) ? COMMAND_RESULT_OK : COMMAND_RESULT_REJECTED;
+}
+
+static int handleRaceMarkCommand(Command* cmd)
+{
+	switch (cmd->action)
+	{
+		case COMMAND_ACTION_ADD_MARK:
+		{
+			proteus_GeoPos p1;
+			p1.lat = cmd->values[2].d;
+			p1.lon = cmd->values[3].d;
+
+			proteus_GeoPos p2;
+			p2.lat = cmd->values[4].d;
+			p2.lon = cmd->values[5].d;
+
+			if (0 != RaceMarks_add(cmd->name, cmd->values[0].s, cmd->values[1].i, &p1, &p2))
+			{
+				ERRLOG2("handleRaceMarkCommand: Failed to add race mark %s for %s!", cmd->values[0].s, cmd->name);
+				return COMMAND_RESULT_REJECTED;
+			}
+
+			break;
+		}
+		case COMMAND_ACTION_REMOVE_MARK:
+		{
+			if (0 != RaceMarks_remove(cmd->name, cmd->values[0].s))
+			{
+				ERRLOG2("handleRaceMarkCommand: Race mark %s for %s not found!", cmd->values[0].s, cmd->name);
+				return COMMAND_RESULT_REJECTED;
+			}
+
+			break;
+		}
+	}
+
+	return COMMAND_RESULT_OK;
 }
@@ -0,0 +1,72 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _sdt_h_
+#define _sdt_h_
+
+#include <stdint.h>
+
+
+// Minimal stand-in for SystemTap's <sys/sdt.h> (used by Probes.h when that isn't installed), with just the
+// DTRACE_PROBE1..3 macros. Each probe site is a nop, with a "stapsdt" note (version 3, as read by bpftrace, perf,
+// etc.) in the .note.stapsdt section giving its address, provider, name and arguments. Arguments are passed as
+// signed 64-bit values (so integers and pointers only). No semaphores: probes are always armed (costing only the nop).
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define SDT_SUPPORTED
+#endif
+
+#ifdef SDT_SUPPORTED
+
+#define _SDT_NOTE(provider, name, args, ...) \
+	__asm__ __volatile__ ( \
+			"990:\tnop\n" \
+			"\t.pushsection .note.stapsdt,\"\",\"note\"\n" \
+			"\t.balign 4\n" \
+			"\t.4byte 992f-991f, 994f-993f, 3\n" \
+			"991:\t.asciz \"stapsdt\"\n" \
+			"992:\t.balign 4\n" \
+			"993:\t.8byte 990b\n" \
+			"\t.8byte _.stapsdt.base\n" \
+			"\t.8byte 0\n" \
+			"\t.asciz \"" #provider "\"\n" \
+			"\t.asciz \"" #name "\"\n" \
+			"\t.asciz \"" args "\"\n" \
+			"994:\t.balign 4\n" \
+			"\t.popsection\n" \
+			"\t.ifndef _.stapsdt.base\n" \
+			"\t.pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+			"\t.weak _.stapsdt.base\n" \
+			"\t.hidden _.stapsdt.base\n" \
+			"_.stapsdt.base:\t.space 1\n" \
+			"\t.size _.stapsdt.base, 1\n" \
+			"\t.popsection\n" \
+			"\t.endif\n" \
+			: : __VA_ARGS__)
+
+#define DTRACE_PROBE1(provider, name, a1) \
+	_SDT_NOTE(provider, name, "-8@%0", "nor" ((int64_t) (a1)))
+
+#define DTRACE_PROBE2(provider, name, a1, a2) \
+	_SDT_NOTE(provider, name, "-8@%0 -8@%1", "nor" ((int64_t) (a1)), "nor" ((int64_t) (a2)))
+
+#define DTRACE_PROBE3(provider, name, a1, a2, a3) \
+	_SDT_NOTE(provider, name, "-8@%0 -8@%1 -8@%2", "nor" ((int64_t) (a1)), "nor" ((int64_t) (a2)), "nor" ((int64_t) (a3)))
+
+#endif // SDT_SUPPORTED
+
+
+#endif // _sdt_h_
@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Affinity.h"
+
+
+static bool hasCpus(int role, const int* cpus, unsigned int count);
+
+
+int test_Affinity()
+{
+	// Single CPUs and ranges
+	EQUALS(Affinity_parse("tick=2"), 0);
+	IS_TRUE(Affinity_isSet(AFFINITY_ROLE_TICK));
+	IS_TRUE(hasCpus(AFFINITY_ROLE_TICK, (const int[]) { 2 }, 1));
+
+	EQUALS(Affinity_parse("net=0-3,6"), 0);
+	IS_TRUE(hasCpus(AFFINITY_ROLE_NET, (const int[]) { 0, 1, 2, 3, 6 }, 5));
+
+	EQUALS(Affinity_parse("logger=4-4,7-8"), 0);
+	IS_TRUE(hasCpus(AFFINITY_ROLE_LOGGER, (const int[]) { 4, 7, 8 }, 3));
+
+	char spec[64];
+	snprintf(spec, sizeof(spec), "ensemble=%d", CPU_SETSIZE - 1);
+	EQUALS(Affinity_parse(spec), 0);
+	IS_TRUE(hasCpus(AFFINITY_ROLE_ENSEMBLE, (const int[]) { CPU_SETSIZE - 1 }, 1));
+
+	// Unknown or missing roles
+	EQUALS(Affinity_parse("bogus=1"), -2);
+	EQUALS(Affinity_parse("ticks=1"), -2);
+	EQUALS(Affinity_parse("tic=1"), -2);
+	EQUALS(Affinity_parse("other=1"), -2);
+	EQUALS(Affinity_parse("=1"), -2);
+	EQUALS(Affinity_parse("tick"), -1);
+	EQUALS(Affinity_parse(""), -1);
+
+	// Bad CPU lists, none of which change CPUs already set
+	static const char* BAD_SPECS[] = {
+		"net=",
+		"net=3-1",
+		"net=0-3,",
+		"net=,1",
+		"net=1,,2",
+		"net=1-",
+		"net=-1",
+		"net= 1",
+		"net=+1",
+		"net=1x",
+		"net=1-2-3",
+		"net=99999999999999999999"
+	};
+
+	for (size_t i = 0; i < sizeof(BAD_SPECS) / sizeof(const char*); i++)
+	{
+		if (Affinity_parse(BAD_SPECS[i]) != -3)
+		{
+			printf("\tSpec \"%s\" was accepted!\n", BAD_SPECS[i]);
+			return 1;
+		}
+	}
+
+	snprintf(spec, sizeof(spec), "net=%d", CPU_SETSIZE);
+	EQUALS(Affinity_parse(spec), -3);
+	snprintf(spec, sizeof(spec), "net=0-%d", CPU_SETSIZE);
+	EQUALS(Affinity_parse(spec), -3);
+
+	IS_TRUE(hasCpus(AFFINITY_ROLE_NET, (const int[]) { 0, 1, 2, 3, 6 }, 5));
+
+	// Back to nothing set (for the tests that follow)
+	Affinity_reset();
+	for (int i = 0; i < AFFINITY_ROLE_COUNT; i++)
+	{
+		IS_FALSE(Affinity_isSet(i));
+		IS_TRUE(Affinity_getCpus(i) == 0);
+	}
+
+	return 0;
+}
+
+
+static bool hasCpus(int role, const int* cpus, unsigned int count)
+{
+	const cpu_set_t* set = Affinity_getCpus(role);
+	if (!set || CPU_COUNT(set) != (int) count)
+	{
+		return false;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (!CPU_ISSET(cpus[i], set))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
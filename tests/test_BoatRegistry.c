@@ -70,7 +70,7 @@ int test_BoatRegistry_runBasic()
 	EQUALS_DBL(0.0, b->pos.lon);
 	EQUALS(0, b->boatType);
 	EQUALS(0, b->boatFlags);
-	free(b);
+	Boat_free(b);
 
 	// Get boat that doesn't exist
 	b = BoatRegistry_get("TestBoat0");
@@ -104,7 +104,7 @@ int test_BoatRegistry_runBasic()
 	b = Boat_new(0.9, 0.9, 0, 0);
 	rc = BoatRegistry_add(b, "TestBoat0", 0, 0);
 	EQUALS(BoatRegistry_EXISTS, rc);
-	free(b);
+	Boat_free(b);
 
 	// Still 1 boat
 	iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
@@ -139,7 +139,7 @@ int test_BoatRegistry_runBasic()
 	EQUALS_DBL(0.1, b->pos.lon);
 	EQUALS(0, b->boatType);
 	EQUALS(0, b->boatFlags);
-	free(b);
+	Boat_free(b);
 
 	// Get boat that doesn't exist
 	b = BoatRegistry_get("TestBoat0");
@@ -164,7 +164,7 @@ int test_BoatRegistry_runBasic()
 	EQUALS_DBL(1.0, b->pos.lon);
 	EQUALS(0, b->boatType);
 	EQUALS(0, b->boatFlags);
-	free(b);
+	Boat_free(b);
 
 	// Get boat that doesn't exist
 	b = BoatRegistry_get("TestBoat0");
@@ -233,7 +233,7 @@ int test_BoatRegistry_runBasicWithGroups()
 	EQUALS_DBL(0.0, b->pos.lon);
 	EQUALS(0, b->boatType);
 	EQUALS(0, b->boatFlags);
-	free(b);
+	Boat_free(b);
 
 	// Get boat that doesn't exist
 	b = BoatRegistry_get("TestBoat0");
@@ -267,7 +267,7 @@ int test_BoatRegistry_runBasicWithGroups()
 	b = Boat_new(0.9, 0.9, 0, 0);
 	rc = BoatRegistry_add(b, "TestBoat0", "TestGroup2", 0);
 	EQUALS(BoatRegistry_EXISTS, rc);
-	free(b);
+	Boat_free(b);
 
 	// Still 1 boat
 	iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
@@ -302,7 +302,7 @@ int test_BoatRegistry_runBasicWithGroups()
 	EQUALS_DBL(0.1, b->pos.lon);
 	EQUALS(0, b->boatType);
 	EQUALS(0, b->boatFlags);
-	free(b);
+	Boat_free(b);
 
 	// Get boat that doesn't exist
 	b = BoatRegistry_get("TestBoat0");
@@ -327,7 +327,7 @@ int test_BoatRegistry_runBasicWithGroups()
 	EQUALS_DBL(1.0, b->pos.lon);
 	EQUALS(0, b->boatType);
 	EQUALS(0, b->boatFlags);
-	free(b);
+	Boat_free(b);
 
 	// Get boat that doesn't exist
 	b = BoatRegistry_get("TestBoat0");
@@ -352,6 +352,96 @@ int test_BoatRegistry_runBasicWithGroups()
 }
 
 
+int test_BoatRegistry_runGroupOps()
+{
+	unsigned int boatCount = -1;
+	unsigned int count;
+	void* iterator;
+	int rc;
+
+	rc = BoatRegistry_init();
+	EQUALS(rc, 0);
+
+	// 10 boats in GroupA (one also removed on its own), 5 in GroupB, and one with no group
+	char name[16];
+	for (int i = 0; i < 15; i++)
+	{
+		sprintf(name, "Boat%d", i);
+		rc = BoatRegistry_add(Boat_new(i, i, 0, 0), name, (i < 10) ? "GroupA" : "GroupB", "Alt");
+		EQUALS(BoatRegistry_OK, rc);
+	}
+	rc = BoatRegistry_add(Boat_new(20.0, 20.0, 0, 0), "Boat20", 0, 0);
+	EQUALS(BoatRegistry_OK, rc);
+
+	Boat_free(BoatRegistry_remove("Boat3"));
+
+	// Group entries
+	BoatEntry** entries = BoatRegistry_getGroupEntries("GroupA", &count);
+	IS_FALSE(entries == 0);
+	EQUALS(count, 9);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		IS_TRUE(0 == strcmp("GroupA", entries[i]->group));
+		IS_TRUE(entries[i]->boat == BoatRegistry_get(entries[i]->name));
+		IS_FALSE(0 == strcmp("Boat3", entries[i]->name));
+	}
+	BoatRegistry_freeGroupEntries(entries, count);
+
+	entries = BoatRegistry_getGroupEntries("NoGroup", &count);
+	IS_TRUE(entries == 0);
+	EQUALS(count, 0);
+
+	// Remove whole group
+	EQUALS(9, BoatRegistry_removeGroup("GroupA"));
+	EQUALS(0, BoatRegistry_removeGroup("GroupA"));
+	EQUALS(0, BoatRegistry_removeGroup("NoGroup"));
+
+	// Gone from the registry right away (and freed only later)
+	IS_TRUE(BoatRegistry_get("Boat0") == 0);
+	IS_TRUE(BoatRegistry_get("Boat9") == 0);
+	IS_FALSE(BoatRegistry_get("Boat10") == 0);
+	IS_FALSE(BoatRegistry_get("Boat20") == 0);
+
+	entries = BoatRegistry_getGroupEntries("GroupA", &count);
+	IS_TRUE(entries == 0);
+
+	const char* groupResp = BoatRegistry_getBoatsInGroupResponse("GroupA");
+	IS_TRUE(0 == strcmp("", groupResp));
+	BoatRegistry_freeBoatsInGroupResponse(groupResp);
+
+	iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+	EQUALS(boatCount, 6);
+
+	BoatRegistry_freeRemoved();
+
+	// Same names can be added again.
+	rc = BoatRegistry_add(Boat_new(1.0, 1.0, 0, 0), "Boat0", "GroupA", 0);
+	EQUALS(BoatRegistry_OK, rc);
+
+	entries = BoatRegistry_getGroupEntries("GroupA", &count);
+	EQUALS(count, 1);
+	IS_TRUE(0 == strcmp("Boat0", entries[0]->name));
+	BoatRegistry_freeGroupEntries(entries, count);
+
+	EQUALS(1, BoatRegistry_removeGroup("GroupA"));
+	EQUALS(5, BoatRegistry_removeGroup("GroupB"));
+	BoatRegistry_freeRemoved();
+
+	Boat_free(BoatRegistry_remove("Boat20"));
+
+	iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+	EQUALS(boatCount, 0);
+
+
+	BoatRegistry_destroy();
+
+
+	return 0;
+}
+
+
 #define LOAD_BOAT_COUNT_MAX (2500)
 #define LOAD_ITERATIONS (2500)
 
@@ -402,7 +492,7 @@ int test_BoatRegistry_runLoad()
 			{
 				// Boat already exists.
 				EQUALS(BoatRegistry_EXISTS, rc);
-				free(b);
+				Boat_free(b);
 
 				addExists++;
 			}
@@ -430,7 +520,7 @@ int test_BoatRegistry_runLoad()
 				// Boat existed and was removed.
 				IS_TRUE(b != 0);
 				boatList[r] = false;
-				free(b);
+				Boat_free(b);
 
 				removeOk++;
 			}
@@ -473,7 +563,7 @@ int test_BoatRegistry_runLoad()
 
 			IS_TRUE(b != 0);
 			boatList[i] = false;
-			free(b);
+			Boat_free(b);
 		}
 	}
 
@@ -641,7 +731,7 @@ int test_BoatRegistry_runLoadWithBigGroups()
 			{
 				// Boat already exists.
 				EQUALS(BoatRegistry_EXISTS, rc);
-				free(b);
+				Boat_free(b);
 
 				addExists++;
 			}
@@ -669,7 +759,7 @@ int test_BoatRegistry_runLoadWithBigGroups()
 				// Boat existed and was removed.
 				IS_TRUE(b != 0);
 				boatList[r] = false;
-				free(b);
+				Boat_free(b);
 
 				removeOk++;
 			}
@@ -712,7 +802,7 @@ int test_BoatRegistry_runLoadWithBigGroups()
 
 			IS_TRUE(b != 0);
 			boatList[i] = false;
-			free(b);
+			Boat_free(b);
 		}
 	}
 
@@ -0,0 +1,278 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sqlite3.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "BoatRegistry.h"
+#include "BoatRestore.h"
+#include "Logger.h"
+
+
+// More than a batch, so that boats are published over several calls
+#define BOAT_COUNT (BOAT_RESTORE_BATCH_SIZE * 2 + 100)
+
+// Boats restored from the DB, with a boat log written (by the Logger) when the restore is partway through
+#define DB_BOAT_COUNT (1000)
+#define DB_BOAT_LOG_AT (300)
+
+
+static bool isEven(const char* name, const char* group);
+static unsigned int publishAll(unsigned int max, unsigned int* calls);
+static int setupDb(const char* path);
+static bool writeLogDuringRestore(const char* name, const char* group);
+static int countBoatLogs(const char* path, const char* boatName);
+
+static atomic_uint _dbRestored = 0;
+
+
+int test_BoatRestore()
+{
+	char path[] = "/tmp/sailnavsim_test_restore_XXXXXX";
+	const int fd = mkstemp(path);
+	IS_TRUE(fd >= 0);
+
+	FILE* f = fdopen(fd, "w");
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		fprintf(f, "RestoreBoat%u,%f,%f,0,0\n", i, 44.0 + (i % 100) * 0.01, -63.0 - (i / 100) * 0.01);
+	}
+	fclose(f);
+
+	IS_TRUE(0 == BoatRegistry_init());
+	IS_FALSE(BoatRestore_isRestoring());
+
+	// Nothing to restore
+	EQUALS(BoatRestore_start("/nonexistent/boatinit.txt", 0, 0), 1);
+	IS_FALSE(BoatRestore_isRestoring());
+
+	// All boats, published in limited numbers per call
+	IS_TRUE(0 == BoatRestore_start(path, 0, 0));
+	IS_TRUE(BoatRestore_start(path, 0, 0) < 0);
+
+	unsigned int calls;
+	EQUALS(publishAll(1000, &calls), BOAT_COUNT);
+	IS_TRUE(calls >= 3);
+	IS_FALSE(BoatRestore_isRestoring());
+	EQUALS(BoatRestore_publish(1000), 0);
+
+	BoatRestoreStats stats;
+	BoatRestore_getStats(&stats);
+	IS_TRUE(stats.done);
+	EQUALS(stats.restored, BOAT_COUNT);
+	EQUALS(stats.skipped, 0);
+	EQUALS(stats.published, BOAT_COUNT);
+
+	const BoatEntry* e = BoatRegistry_getBoatEntry("RestoreBoat101");
+	IS_TRUE(e != 0 && e->boat != 0 && e->group == 0);
+	EQUALS_DBL(e->boat->pos.lat, 44.01);
+	EQUALS_DBL(e->boat->pos.lon, -63.01);
+	IS_TRUE(e->boat->stop);
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		char name[32];
+		sprintf(name, "RestoreBoat%u", i);
+		Boat_free(BoatRegistry_remove(name));
+	}
+
+	// Filtered
+	IS_TRUE(0 == BoatRestore_start(path, 0, &isEven));
+	EQUALS(publishAll(BOAT_RESTORE_PUBLISH_MAX, &calls), BOAT_COUNT / 2);
+	BoatRestore_getStats(&stats);
+	EQUALS(stats.restored, BOAT_COUNT);
+	EQUALS(stats.skipped, BOAT_COUNT / 2);
+	EQUALS(stats.published, BOAT_COUNT / 2);
+	IS_TRUE(BoatRegistry_getBoatEntry("RestoreBoat100") != 0);
+	IS_TRUE(BoatRegistry_getBoatEntry("RestoreBoat101") == 0);
+
+	for (unsigned int i = 0; i < BOAT_COUNT; i += 2)
+	{
+		char name[32];
+		sprintf(name, "RestoreBoat%u", i);
+		Boat_free(BoatRegistry_remove(name));
+	}
+
+	unlink(path);
+
+	// From the DB, with the Logger committing boat logs (to the same DB) while the restore is partway through
+	char dbPath[] = "/tmp/sailnavsim_test_restore_db_XXXXXX";
+	const int dbFd = mkstemp(dbPath);
+	IS_TRUE(dbFd >= 0);
+	close(dbFd);
+
+	IS_TRUE(0 == setupDb(dbPath));
+	IS_TRUE(0 == Logger_init(0, dbPath));
+
+	IS_TRUE(0 == BoatRestore_start(0, dbPath, &writeLogDuringRestore));
+	EQUALS(publishAll(BOAT_RESTORE_PUBLISH_MAX, &calls), DB_BOAT_COUNT);
+	EQUALS(atomic_load(&_dbRestored), DB_BOAT_COUNT);
+	EQUALS(countBoatLogs(dbPath, "LoggedBoat"), 1);
+
+	e = BoatRegistry_getBoatEntry("DbBoat999");
+	IS_TRUE(e != 0 && e->boat != 0 && e->group != 0 && strcmp(e->group, "DbRace") == 0);
+	EQUALS_DBL(e->boat->pos.lat, 45.0);
+	EQUALS_DBL(e->boat->pos.lon, -62.0);
+
+	for (unsigned int i = 0; i < DB_BOAT_COUNT; i++)
+	{
+		char name[32];
+		sprintf(name, "DbBoat%u", i);
+		Boat_free(BoatRegistry_remove(name));
+	}
+
+	BoatRegistry_destroy();
+	unlink(dbPath);
+
+	return 0;
+}
+
+
+static bool isEven(const char* name, const char* group)
+{
+	(void) group;
+
+	unsigned int i;
+	return (sscanf(name, "RestoreBoat%u", &i) == 1 && (i % 2) == 0);
+}
+
+// Publishes (as the tick thread does) until restore is done, returning the number of boats taken from the restore.
+static unsigned int publishAll(unsigned int max, unsigned int* calls)
+{
+	unsigned int total = 0;
+	*calls = 0;
+
+	while (BoatRestore_isRestoring())
+	{
+		BoatRegistry_wrlock();
+		const unsigned int n = BoatRestore_publish(max);
+		BoatRegistry_unlock();
+
+		total += n;
+		(*calls)++;
+
+		if (n == 0)
+		{
+			usleep(1000);
+		}
+	}
+
+	return total;
+}
+
+// Creates the tables restored from (as in setup_db.txt), with boats that each have one boat log.
+static int setupDb(const char* path)
+{
+	sqlite3* db;
+	if (SQLITE_OK != sqlite3_open(path, &db))
+	{
+		return -1;
+	}
+
+	static const char* SETUP_STR =
+		"CREATE TABLE Boat(name TEXT NOT NULL UNIQUE, friendlyName TEXT NOT NULL, race TEXT NOT NULL, desiredCourse REAL NOT NULL, "
+			"started INTEGER NOT NULL, boatType INTEGER NOT NULL, isActive INTEGER NOT NULL, boatFlags INTEGER NOT NULL, sailArea REAL);"
+		"CREATE TABLE BoatRace(name TEXT NOT NULL UNIQUE, startLat REAL NOT NULL, startLon REAL NOT NULL);"
+		"CREATE TABLE BoatLog(boatName TEXT NOT NULL, time INTEGER NOT NULL, lat REAL NOT NULL, lon REAL NOT NULL, "
+			"courseWater REAL NOT NULL, speedWater REAL NOT NULL, trackGround REAL NOT NULL, speedGround REAL NOT NULL, "
+			"windDir REAL NOT NULL, windSpeed REAL NOT NULL, oceanCurrentDir REAL, oceanCurrentSpeed REAL, waterTemp REAL, "
+			"temp REAL NOT NULL, dewpoint REAL NOT NULL, pressure REAL NOT NULL, cloud INTEGER NOT NULL, visibility INTEGER NOT NULL, "
+			"precipRate REAL NOT NULL, precipType INTEGER NOT NULL, boatStatus INTEGER NOT NULL, boatLocation INTEGER NOT NULL, "
+			"waterSalinity REAL, oceanIce INTEGER, distanceTravelled REAL NOT NULL, damage REAL NOT NULL, windGust REAL NOT NULL, "
+			"waveHeight REAL, compassMagDec REAL NOT NULL, invisibleLog INTEGER NOT NULL, windGustAngle REAL, sailArea REAL, "
+			"leewaySpeed REAL, heelingAngle REAL);"
+		"CREATE TABLE CelestialSight(boatName TEXT NOT NULL, time INTEGER NOT NULL, obj INTEGER NOT NULL, az REAL NOT NULL, "
+			"alt REAL NOT NULL, compassMagDec REAL NOT NULL);"
+		"INSERT INTO BoatRace VALUES ('DbRace', 45.0, -62.0);";
+
+	int rc = (SQLITE_OK == sqlite3_exec(db, SETUP_STR, 0, 0, 0)) ? 0 : -1;
+	rc |= (SQLITE_OK == sqlite3_exec(db, "BEGIN TRANSACTION;", 0, 0, 0)) ? 0 : -1;
+
+	for (unsigned int i = 0; i < DB_BOAT_COUNT && rc == 0; i++)
+	{
+		char sql[512];
+
+		// The last boat has no log yet, so starts at its race start.
+		sprintf(sql, "INSERT INTO Boat VALUES ('DbBoat%u', 'Boat %u', 'DbRace', 90.0, 1, 0, 1, 0, NULL);", i, i);
+		rc |= (SQLITE_OK == sqlite3_exec(db, sql, 0, 0, 0)) ? 0 : -1;
+
+		if (i < DB_BOAT_COUNT - 1)
+		{
+			sprintf(sql, "INSERT INTO BoatLog VALUES ('DbBoat%u', 100, 44.0, -63.0, 90.0, 1.0, 90.0, 1.0, 0, 0, NULL, NULL, NULL, 0, 0, 0, "
+					"0, 0, 0, 0, 1, 0, NULL, NULL, 0, 0, 0, NULL, 0, 0, NULL, NULL, NULL, NULL);", i);
+			rc |= (SQLITE_OK == sqlite3_exec(db, sql, 0, 0, 0)) ? 0 : -1;
+		}
+	}
+
+	rc |= (SQLITE_OK == sqlite3_exec(db, "END TRANSACTION;", 0, 0, 0)) ? 0 : -1;
+
+	sqlite3_close(db);
+	return rc;
+}
+
+// Restore filter that has the Logger write (and commit) a boat log partway through the restore, as the tick thread
+// would while boats are still being read.
+static bool writeLogDuringRestore(const char* name, const char* group)
+{
+	(void) name;
+	(void) group;
+
+	if (atomic_fetch_add(&_dbRestored, 1) == DB_BOAT_LOG_AT)
+	{
+		LogEntry* log = calloc(1, sizeof(LogEntry));
+		log->time = 200;
+		log->boatName = strdup("LoggedBoat");
+
+		Logger_writeLogs(log, 1, 0, 0);
+		Logger_flush();
+	}
+
+	return true;
+}
+
+static int countBoatLogs(const char* path, const char* boatName)
+{
+	sqlite3* db;
+	if (SQLITE_OK != sqlite3_open(path, &db))
+	{
+		return -1;
+	}
+
+	int count = -1;
+
+	sqlite3_stmt* stmt;
+	if (SQLITE_OK == sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM BoatLog WHERE boatName=?;", -1, &stmt, 0))
+	{
+		sqlite3_bind_text(stmt, 1, boatName, -1, 0);
+		if (SQLITE_ROW == sqlite3_step(stmt))
+		{
+			count = sqlite3_column_int(stmt, 0);
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	sqlite3_close(db);
+	return count;
+}
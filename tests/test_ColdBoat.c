@@ -0,0 +1,190 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <math.h>
+#include <string.h>
+
+#include <sailnavsim_boatregistry.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "BoatRegistry.h"
+#include "ColdBoat.h"
+#include "Zones.h"
+
+
+static BoatEntry* findEntry(const char* name);
+
+
+int test_ColdBoat()
+{
+	IS_TRUE(sizeof(ColdBoat) == 32);
+
+	// New boats are stopped, so idle.
+	Boat b;
+	Boat_initState(&b, 44.123456789, -63.987654321, 0, BOAT_FLAG_CELESTIAL);
+	b.desiredCourse = 275.0;
+	b.sailsDown = true;
+	b.sailArea = 0.37;
+	b.v.angle = 359.999;
+	b.vGround.angle = 12.346;
+	b.distanceTravelled = 123456.7;
+	IS_TRUE(ColdBoat_canDemote(&b));
+
+	ColdBoat c;
+	ColdBoat_encode(&b, &c);
+
+	Boat d;
+	ColdBoat_decode(&c, 0, &d);
+
+	// Position to within about 1cm, and angles to within a hundredth of a degree
+	IS_TRUE(fabs(d.pos.lat - b.pos.lat) <= 0.5 / COLD_BOAT_POS_SCALE);
+	IS_TRUE(fabs(d.pos.lon - b.pos.lon) <= 0.5 / COLD_BOAT_POS_SCALE);
+	EQUALS_DBL(d.desiredCourse, 275.0);
+	EQUALS_DBL(d.v.angle, 0.0);
+	EQUALS_DBL(d.vGround.angle, 12.35);
+	EQUALS_DBL(d.sailArea, 0.37);
+	IS_TRUE(fabs(d.distanceTravelled - b.distanceTravelled) < 0.01);
+
+	EQUALS(d.boatFlags, BOAT_FLAG_CELESTIAL);
+	IS_TRUE(d.stop && d.sailsDown && d.courseMagnetic && d.setImmediateDesiredCourse && !d.movingToSea);
+	IS_TRUE(d.zones == 0 && d.inZone == 0 && d.ghost.track == 0);
+
+	// No drift from demoting again
+	ColdBoat c2;
+	ColdBoat_encode(&d, &c2);
+	IS_TRUE(0 == memcmp(&c, &c2, sizeof(ColdBoat)));
+
+	// Not idle
+	d.stop = false;
+	IS_FALSE(ColdBoat_canDemote(&d));
+	d.stop = true;
+	d.damage = 0.5;
+	IS_FALSE(ColdBoat_canDemote(&d));
+	d.damage = 0.0;
+	d.boatFlags = 0x100;
+	IS_FALSE(ColdBoat_canDemote(&d));
+
+	// Exclusion zones given back when promoted, along with the zone the boat is within
+	const proteus_GeoPos v[] = { { 44.0, -64.0 }, { 44.0, -63.0 }, { 45.0, -63.0 }, { 45.0, -64.0 } };
+	IS_TRUE(0 == Zones_add("ColdRace", "Square", ZONE_ACTION_PENALTY, v, 4));
+
+	b.zones = Zones_getGroupZones("ColdRace");
+	b.inZone = Zones_find(b.zones, &b.pos);
+	IS_TRUE(b.inZone != 0);
+
+	ColdBoat_encode(&b, &c);
+	IS_TRUE(ColdBoat_hasZones(&c));
+	ColdBoat_decode(&c, b.zones, &d);
+	IS_TRUE(d.zones == b.zones && d.inZone == b.inZone);
+
+
+	// Registry tiers
+	IS_TRUE(0 == BoatRegistry_init());
+
+	BoatRegistryTierStats ts0;
+	BoatRegistryTierStats ts;
+	BoatRegistry_getTierStats(&ts0);
+
+	Boat* idle = Boat_new(44.5, -63.5, 0, 0);
+	idle->zones = Zones_getGroupZones("ColdRace");
+	Boat* moving = Boat_new(10.0, 20.0, 0, 0);
+	moving->stop = false;
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(idle, "ColdIdle", "ColdRace", "Idle"));
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(moving, "ColdMoving", 0, 0));
+
+	BoatEntry* ei = findEntry("ColdIdle");
+	BoatEntry* em = findEntry("ColdMoving");
+	IS_TRUE(ei != 0 && em != 0);
+
+	IS_TRUE(BoatRegistry_demote(ei));
+	IS_FALSE(BoatRegistry_demote(em));
+	IS_TRUE(ei->boat == 0 && ei->cold != 0);
+	IS_TRUE(em->boat == moving && em->cold == 0);
+
+	BoatRegistry_getTierStats(&ts);
+	EQUALS(ts.coldCount, ts0.coldCount + 1);
+	EQUALS(ts.hotCount, ts0.hotCount + 1);
+	EQUALS(ts.demotions, ts0.demotions + 1);
+
+	// Read as it is, without promoting
+	Boat scratch;
+	const Boat* view = BoatRegistry_view(ei, &scratch);
+	IS_TRUE(view == &scratch);
+	EQUALS_DBL(view->pos.lat, 44.5);
+	EQUALS_DBL(view->pos.lon, -63.5);
+	IS_TRUE(ei->boat == 0);
+	IS_TRUE(BoatRegistry_view(em, &scratch) == moving);
+
+	// Promoted when got for changing
+	Boat* p = BoatRegistry_get("ColdIdle");
+	IS_TRUE(p != 0 && ei->boat == p && ei->cold == 0);
+	EQUALS_DBL(p->pos.lat, 44.5);
+	IS_TRUE(p->zones == Zones_getGroupZones("ColdRace") && p->inZone != 0);
+
+	BoatRegistry_getTierStats(&ts);
+	EQUALS(ts.coldCount, ts0.coldCount);
+	EQUALS(ts.promotions, ts0.promotions + 1);
+
+	// Removed boats handed back in full state
+	IS_TRUE(BoatRegistry_demote(ei));
+	p = BoatRegistry_remove("ColdIdle");
+	IS_TRUE(p != 0);
+	EQUALS_DBL(p->pos.lon, -63.5);
+	Boat_free(p);
+	Boat_free(BoatRegistry_remove("ColdMoving"));
+
+	BoatRegistry_getTierStats(&ts);
+	EQUALS(ts.coldCount, ts0.coldCount);
+	EQUALS(ts.hotCount, ts0.hotCount);
+
+	// Demoted as soon as added with the cold tier on, and removed with their group
+	BoatRegistry_setColdTier(true);
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(Boat_new(44.5, -63.5, 0, 0), "ColdIdle", "ColdRace", 0));
+	BoatRegistry_setColdTier(false);
+	IS_TRUE(findEntry("ColdIdle")->cold != 0);
+	EQUALS(BoatRegistry_removeGroup("ColdRace"), 1);
+	BoatRegistry_freeRemoved();
+
+	BoatRegistry_getTierStats(&ts);
+	EQUALS(ts.coldCount, ts0.coldCount);
+
+	BoatRegistry_destroy();
+
+	return 0;
+}
+
+
+static BoatEntry* findEntry(const char* name)
+{
+	unsigned int count;
+	void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &count);
+
+	BoatEntry* e;
+	while ((e = sailnavsim_boatregistry_boats_iterator_get_next(iterator)) != 0)
+	{
+		if (strcmp(e->name, name) == 0)
+		{
+			break;
+		}
+	}
+
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+
+	return e;
+}
@@ -0,0 +1,149 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Command.h"
+
+
+#define WAITER_COUNT (4)
+
+
+typedef struct
+{
+	char cmdStr[64];
+	int rc;
+	bool done;
+	int result;
+	time_t tick;
+} Waiter;
+
+
+static void* waiterThreadMain(void* arg);
+
+
+int test_CommandCompletion()
+{
+	IS_TRUE(0 == Command_init(0));
+
+	IS_TRUE(strcmp(Command_getResultStr(COMMAND_RESULT_OK), "ok") == 0);
+	IS_TRUE(strcmp(Command_getResultStr(COMMAND_RESULT_NOBOAT), "noboat") == 0);
+	IS_TRUE(strcmp(Command_getResultStr(COMMAND_RESULT_REJECTED), "rejected") == 0);
+	IS_TRUE(strcmp(Command_getResultStr(COMMAND_RESULT_SCHEDULED), "scheduled") == 0);
+	IS_TRUE(strcmp(Command_getResultStr(COMMAND_RESULT_PENDING), "pending") == 0);
+	IS_TRUE(strcmp(Command_getResultStr(-1), "failed") == 0);
+
+	// Invalid commands aren't queued (so there's nothing to wait for).
+	CommandCompletion* completion = 0;
+	char s[64];
+	strcpy(s, "BoatA,course,400");
+	IS_TRUE(0 != Command_addWithCompletion(s, &completion));
+	IS_TRUE(completion == 0);
+	IS_TRUE(Command_next() == 0);
+
+	// Waiting gives up if the command isn't handled in time, with the command handled later.
+	strcpy(s, "BoatA,course,40");
+	IS_TRUE(0 == Command_addWithCompletion(s, &completion));
+	IS_FALSE(Command_waitCompletion(completion, 20));
+	Command_releaseCompletion(completion);
+
+	Command* late = Command_next();
+	IS_TRUE(late != 0 && late->completion != 0);
+	Command_complete(late, COMMAND_RESULT_OK, 999);
+	IS_TRUE(late->completion == 0);
+	Command_free(late);
+
+	// Each waiter is woken with its own command's result, whether handled or just freed.
+	Waiter waiters[WAITER_COUNT];
+	pthread_t threads[WAITER_COUNT];
+
+	for (int i = 0; i < WAITER_COUNT; i++)
+	{
+		snprintf(waiters[i].cmdStr, sizeof(waiters[i].cmdStr), "Boat%d,course,%d", i, i * 10);
+		waiters[i].rc = -1;
+		IS_TRUE(0 == pthread_create(threads + i, 0, &waiterThreadMain, waiters + i));
+	}
+
+	// Wait for all commands to be queued, then handle them as the main thread would.
+	int handled = 0;
+	while (handled < WAITER_COUNT)
+	{
+		Command* cmd = Command_next();
+		if (!cmd)
+		{
+			usleep(1000);
+			continue;
+		}
+
+		IS_TRUE(cmd->completion != 0);
+
+		const int boat = cmd->name[4] - '0';
+		if (boat == 3)
+		{
+			// Never handled
+			Command_free(cmd);
+		}
+		else
+		{
+			Command_complete(cmd, (boat == 2 ? COMMAND_RESULT_NOBOAT : COMMAND_RESULT_OK), 1000 + boat);
+			IS_TRUE(cmd->completion == 0);
+
+			// Already completed, so no change.
+			Command_complete(cmd, COMMAND_RESULT_REJECTED, 0);
+			Command_free(cmd);
+		}
+
+		handled++;
+	}
+
+	for (int i = 0; i < WAITER_COUNT; i++)
+	{
+		IS_TRUE(0 == pthread_join(threads[i], 0));
+		IS_TRUE(waiters[i].rc == 0);
+	}
+
+	IS_TRUE(waiters[0].done && waiters[0].result == COMMAND_RESULT_OK && waiters[0].tick == 1000);
+	IS_TRUE(waiters[1].done && waiters[1].result == COMMAND_RESULT_OK && waiters[1].tick == 1001);
+	IS_TRUE(waiters[2].done && waiters[2].result == COMMAND_RESULT_NOBOAT && waiters[2].tick == 1002);
+	IS_TRUE(waiters[3].done && waiters[3].result == COMMAND_RESULT_FAILED);
+
+
+	return 0;
+}
+
+
+static void* waiterThreadMain(void* arg)
+{
+	Waiter* w = arg;
+
+	CommandCompletion* completion;
+	if (0 == (w->rc = Command_addWithCompletion(w->cmdStr, &completion)))
+	{
+		w->done = Command_waitCompletion(completion, 10000);
+		w->result = completion->result;
+		w->tick = completion->tick;
+		Command_releaseCompletion(completion);
+	}
+
+	return 0;
+}
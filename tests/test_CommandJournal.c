@@ -0,0 +1,256 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Command.h"
+#include "CommandJournal.h"
+
+
+#define MAX_REPLAYED (16)
+
+
+static Command* parse(const char* s);
+static int writeTick(time_t t, const char* const* cmdStrs, unsigned int count);
+static unsigned int countSegments(const char* dir);
+static int onReplay(Command* cmd, time_t tick);
+static void onReplayScheduled(Command* cmd);
+
+static char _replayed[MAX_REPLAYED][128];
+static time_t _replayedTicks[MAX_REPLAYED];
+static unsigned int _replayedCount = 0;
+
+static Command* _replayedScheduled = 0;
+
+
+int test_CommandJournal()
+{
+	char buf[256];
+	Command* cmd;
+
+	// Formatting parses back to the same command.
+	cmd = parse("BoatA,add_g,44.123456789,-63.5,3,1,RaceA,Alt Name");
+	IS_TRUE(cmd != 0);
+	IS_TRUE(Command_format(cmd, buf, sizeof(buf)) == (int) strlen(buf));
+	Command* cmd2 = parse(buf);
+	IS_TRUE(cmd2 != 0);
+	IS_TRUE(cmd2->values[0].d == cmd->values[0].d);
+	IS_TRUE(cmd2->values[1].d == cmd->values[1].d);
+	IS_TRUE(strcmp(cmd2->values[5].s, "Alt Name") == 0);
+	Command_free(cmd2);
+
+	// Truncated (snprintf-style)
+	IS_TRUE(Command_format(cmd, buf, 8) == (int) strlen("BoatA,add_g,44.123456789000002,-63.5,3,1,RaceA,Alt Name"));
+	IS_TRUE(strcmp(buf, "BoatA,a") == 0);
+	Command_free(cmd);
+
+	cmd = parse("BoatB,course_m,270");
+	IS_TRUE(Command_format(cmd, buf, sizeof(buf)) > 0);
+	IS_TRUE(strcmp(buf, "BoatB,course_m,270") == 0);
+	Command_free(cmd);
+
+	// With execution time, if scheduled
+	cmd = parse("@1000000300,BoatB,stop");
+	IS_TRUE(Command_format(cmd, buf, sizeof(buf)) > 0);
+	IS_TRUE(strcmp(buf, "@1000000300,BoatB,stop") == 0);
+	Command_free(cmd);
+
+
+	char dir[] = "/tmp/sailnavsim_test_journal_XXXXXX";
+	IS_TRUE(mkdtemp(dir) != 0);
+
+	// Ticks from a bit after now (the first segment is named by the time the journal is opened)
+	const time_t base = time(0) + 100;
+
+	IS_TRUE(0 == CommandJournal_init(dir, 0));
+
+	const char* const tick1[] = { "BoatA,add,44.0,-63.0,0,0", "BoatA,course,90" };
+	const char* const tick2[] = { "BoatA,start" };
+	const char* const tick3[] = { "BoatA,course,180", "BoatB,stop" };
+
+	IS_TRUE(0 == writeTick(base, tick1, 2));
+	IS_TRUE(0 == writeTick(base + 1, tick2, 1));
+
+	// Scheduled (for later) at base + 2, along with one scheduled earlier and now due
+	char sched[2][64];
+	snprintf(sched[0], sizeof(sched[0]), "@%ld,BoatA,stop", (long) (base + 500));
+	snprintf(sched[1], sizeof(sched[1]), "@%ld,BoatB,start", (long) (base + 2));
+	const char* const tick2b[] = { sched[0], sched[1] };
+	IS_TRUE(0 == writeTick(base + 2, tick2b, 2));
+
+	// Boat logs at base + 60, then more commands
+	CommandJournal_startSegment(base + 60);
+	IS_TRUE(0 == writeTick(base + 60, tick3, 2));
+	IS_TRUE(countSegments(dir) == 2);
+
+	// Not yet committed
+	CommandJournal_checkpoint(base + 59);
+	IS_TRUE(countSegments(dir) == 2);
+
+	CommandJournal_close();
+
+	// Partly written record from a crash
+	snprintf(buf, sizeof(buf), "%s/%ld.journal", dir, (long) (base + 60));
+	FILE* f = fopen(buf, "a");
+	IS_TRUE(f != 0);
+	fputs("1061,BoatB,sta", f);
+	fclose(f);
+
+
+	// Everything replayed (with no DB, so no boat logs), without the partly written record.
+	time_t doneUpTo;
+	IS_TRUE(0 == CommandJournal_init(dir, 0));
+	_replayedCount = 0;
+	IS_TRUE(0 == CommandJournal_replay(&onReplay, &onReplayScheduled, &doneUpTo));
+	IS_TRUE(doneUpTo == base + 60);
+	IS_TRUE(_replayedCount == 6);
+	IS_TRUE(strcmp(_replayed[0], "BoatA,add,44,-63,0,0") == 0);
+	IS_TRUE(strcmp(_replayed[1], "BoatA,course,90") == 0);
+	IS_TRUE(strcmp(_replayed[2], "BoatA,start") == 0);
+	IS_TRUE(strcmp(_replayed[3], sched[1]) == 0);
+	IS_TRUE(strcmp(_replayed[4], "BoatA,course,180") == 0);
+	IS_TRUE(strcmp(_replayed[5], "BoatB,stop") == 0);
+
+	// Each applied at its journaled tick
+	IS_TRUE(_replayedTicks[0] == base && _replayedTicks[1] == base);
+	IS_TRUE(_replayedTicks[2] == base + 1);
+	IS_TRUE(_replayedTicks[3] == base + 2);
+	IS_TRUE(_replayedTicks[4] == base + 60 && _replayedTicks[5] == base + 60);
+
+	// The one scheduled for later is handed over as such (not applied).
+	IS_TRUE(_replayedScheduled != 0 && _replayedScheduled->next == 0);
+	IS_TRUE(_replayedScheduled->execTime == base + 500);
+	IS_TRUE(strcmp(_replayedScheduled->name, "BoatA") == 0);
+	IS_TRUE(_replayedScheduled->action == COMMAND_ACTION_STOP);
+	Command_free(_replayedScheduled);
+	_replayedScheduled = 0;
+
+	// New segment for this run (once written to), after the existing ones
+	IS_TRUE(countSegments(dir) == 2);
+	IS_TRUE(0 == writeTick(base + 70, tick2, 1));
+	IS_TRUE(countSegments(dir) == 3);
+
+	// Boat logs at base + 60 committed, so the first segment goes.
+	CommandJournal_checkpoint(base + 60);
+	IS_TRUE(countSegments(dir) == 2);
+
+	// Boat logs after the restart committed, so only the current segment stays.
+	CommandJournal_checkpoint(base + 61);
+	IS_TRUE(countSegments(dir) == 1);
+
+	CommandJournal_startSegment(base + 120);
+	CommandJournal_checkpoint(base + 120);
+	IS_TRUE(countSegments(dir) == 0);
+
+	CommandJournal_close();
+	IS_TRUE(0 == rmdir(dir));
+
+
+	return 0;
+}
+
+
+static Command* parse(const char* s)
+{
+	char b[256];
+	strcpy(b, s);
+	return Command_parse(b);
+}
+
+static int writeTick(time_t t, const char* const* cmdStrs, unsigned int count)
+{
+	Command* cmds = 0;
+	Command* last = 0;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Command* cmd = parse(cmdStrs[i]);
+		if (!cmd)
+		{
+			return -1;
+		}
+
+		if (last)
+		{
+			last->next = cmd;
+		}
+		else
+		{
+			cmds = cmd;
+		}
+		last = cmd;
+	}
+
+	const int rc = CommandJournal_write(t, cmds);
+
+	while (cmds)
+	{
+		Command* next = cmds->next;
+		Command_free(cmds);
+		cmds = next;
+	}
+
+	return rc;
+}
+
+static unsigned int countSegments(const char* dir)
+{
+	unsigned int count = 0;
+
+	DIR* d = opendir(dir);
+	if (!d)
+	{
+		return 0;
+	}
+
+	struct dirent* de;
+	while ((de = readdir(d)))
+	{
+		if (strstr(de->d_name, ".journal"))
+		{
+			count++;
+		}
+	}
+
+	closedir(d);
+	return count;
+}
+
+static int onReplay(Command* cmd, time_t tick)
+{
+	if (_replayedCount < MAX_REPLAYED)
+	{
+		Command_format(cmd, _replayed[_replayedCount], sizeof(_replayed[_replayedCount]));
+		_replayedTicks[_replayedCount] = tick;
+		_replayedCount++;
+	}
+
+	return COMMAND_RESULT_OK;
+}
+
+static void onReplayScheduled(Command* cmd)
+{
+	cmd->next = _replayedScheduled;
+	_replayedScheduled = cmd;
+}
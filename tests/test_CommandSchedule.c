@@ -0,0 +1,171 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Command.h"
+#include "CommandSchedule.h"
+
+
+static Command* parse(const char* s);
+static unsigned int countAndFree(Command* cmds, const char* const* expectedNames, unsigned int expectedCount);
+
+
+int test_CommandSchedule()
+{
+	// Just before a 65536-second boundary, so that commands cascade down through the levels.
+	const time_t base = 1000013824 - 10;
+
+	Command* cmd;
+
+	// Execution time parsing
+	cmd = parse("@1000000300,BoatA,course,90");
+	IS_TRUE(cmd != 0);
+	IS_TRUE(cmd->execTime == 1000000300);
+	IS_TRUE(strcmp(cmd->name, "BoatA") == 0);
+	IS_TRUE(cmd->action == COMMAND_ACTION_COURSE_TRUE);
+	IS_TRUE(cmd->values[0].i == 90);
+	IS_TRUE(strcmp(cmd->str, "BoatA,course,90") == 0);
+	Command_free(cmd);
+
+	cmd = parse("BoatA,start");
+	IS_TRUE(cmd != 0);
+	IS_TRUE(cmd->execTime == 0);
+	IS_TRUE(cmd->str == 0);
+	Command_free(cmd);
+
+	IS_TRUE(parse("@abc,BoatA,start") == 0);
+	IS_TRUE(parse("@1000000300") == 0);
+	IS_TRUE(parse("@1000000300,BoatA,course,400") == 0);
+
+
+	IS_TRUE(0 == CommandSchedule_init(0, base, 0));
+
+	char s[128];
+
+	// Scheduled well ahead (in a higher level of the wheel), and then some more for the same second closer to the time.
+	snprintf(s, sizeof(s), "@%ld,BoatA,course,90", (long) (base + 300));
+	IS_TRUE(0 == CommandSchedule_add(parse(s)));
+
+	snprintf(s, sizeof(s), "@%ld,BoatC,stop", (long) (base + 5));
+	IS_TRUE(0 == CommandSchedule_add(parse(s)));
+
+	snprintf(s, sizeof(s), "@%ld,BoatD,start", (long) (base + 100000));
+	IS_TRUE(0 == CommandSchedule_add(parse(s)));
+
+	// Already due
+	snprintf(s, sizeof(s), "@%ld,BoatE,start", (long) (base - 5));
+	IS_TRUE(0 == CommandSchedule_add(parse(s)));
+
+	// Too far ahead
+	snprintf(s, sizeof(s), "@%ld,BoatF,start", (long) (base + 5000000000L));
+	cmd = parse(s);
+	IS_TRUE(0 != CommandSchedule_add(cmd));
+	Command_free(cmd);
+
+	IS_TRUE(CommandSchedule_getCount() == 4);
+
+	const char* const dueE[] = { "BoatE" };
+	IS_TRUE(1 == countAndFree(CommandSchedule_takeDue(base + 4), dueE, 1));
+	IS_TRUE(CommandSchedule_getCount() == 3);
+
+	const char* const dueC[] = { "BoatC" };
+	IS_TRUE(1 == countAndFree(CommandSchedule_takeDue(base + 5), dueC, 1));
+
+	IS_TRUE(0 == countAndFree(CommandSchedule_takeDue(base + 100), 0, 0));
+
+	snprintf(s, sizeof(s), "@%ld,BoatB,start", (long) (base + 300));
+	IS_TRUE(0 == CommandSchedule_add(parse(s)));
+	snprintf(s, sizeof(s), "@%ld,BoatA,start", (long) (base + 300));
+	IS_TRUE(0 == CommandSchedule_add(parse(s)));
+
+	IS_TRUE(0 == countAndFree(CommandSchedule_takeDue(base + 299), 0, 0));
+
+	// In order of scheduling
+	const char* const dueABA[] = { "BoatA", "BoatB", "BoatA" };
+	IS_TRUE(3 == countAndFree(CommandSchedule_takeDue(base + 300), dueABA, 3));
+
+	// Catching up over a longer time
+	const char* const dueD[] = { "BoatD" };
+	IS_TRUE(0 == countAndFree(CommandSchedule_takeDue(base + 99999), 0, 0));
+	IS_TRUE(1 == countAndFree(CommandSchedule_takeDue(base + 100010), dueD, 1));
+
+	IS_TRUE(CommandSchedule_getCount() == 0);
+
+
+	// Scheduled commands replayed from the command journal (as after a restart), put back unless already applied (by
+	// doneUpTo) or already scheduled (such as loaded from the DB)
+	const time_t restart = base + 200000;
+
+	snprintf(s, sizeof(s), "@%ld,BoatG,start", (long) (restart - 10));
+	CommandSchedule_addJournaled(parse(s));
+
+	snprintf(s, sizeof(s), "@%ld,BoatH,start", (long) (restart + 10));
+	CommandSchedule_addJournaled(parse(s));
+	CommandSchedule_addJournaled(parse(s));
+
+	snprintf(s, sizeof(s), "@%ld,BoatJ,start", (long) (restart - 5));
+	CommandSchedule_addJournaled(parse(s));
+
+	IS_TRUE(0 == CommandSchedule_init(0, restart, restart - 8));
+	IS_TRUE(CommandSchedule_getCount() == 2);
+
+	const char* const dueJ[] = { "BoatJ" };
+	IS_TRUE(1 == countAndFree(CommandSchedule_takeDue(restart), dueJ, 1));
+
+	const char* const dueH[] = { "BoatH" };
+	IS_TRUE(1 == countAndFree(CommandSchedule_takeDue(restart + 10), dueH, 1));
+
+	IS_TRUE(CommandSchedule_getCount() == 0);
+
+
+	return 0;
+}
+
+
+static Command* parse(const char* s)
+{
+	char buf[128];
+	strcpy(buf, s);
+	return Command_parse(buf);
+}
+
+static unsigned int countAndFree(Command* cmds, const char* const* expectedNames, unsigned int expectedCount)
+{
+	unsigned int n = 0;
+	bool match = true;
+
+	while (cmds)
+	{
+		Command* next = cmds->next;
+
+		if (n >= expectedCount || strcmp(cmds->name, expectedNames[n]) != 0)
+		{
+			match = false;
+		}
+
+		Command_free(cmds);
+		cmds = next;
+		n++;
+	}
+
+	return (match ? n : 0xffffffff);
+}
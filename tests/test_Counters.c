@@ -0,0 +1,129 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Counters.h"
+
+
+#define COUNTER_COUNT (3)
+
+// More threads than have their own copies, so that some share one.
+#define THREAD_COUNT (COUNTERS_MAX_THREADS + 44)
+#define INCREMENTS (10000)
+
+
+static Counters _counters = COUNTERS_INITIALIZER(COUNTER_COUNT);
+
+static void* threadMain(void* arg);
+
+
+int test_Counters()
+{
+	uint64_t totals[COUNTER_COUNT];
+
+	Counters_sum(&_counters, totals);
+	IS_TRUE(totals[0] == 0 && totals[1] == 0 && totals[2] == 0);
+
+	// Copies are separate, in whole cache lines.
+	CountersSlot* a = Counters_newThreadSlot(&_counters);
+	CountersSlot* b = Counters_newThreadSlot(&_counters);
+	IS_TRUE(a != 0 && b != 0);
+	IS_FALSE(a->shared);
+	IS_TRUE(((uintptr_t) a) % COUNTERS_CACHE_LINE_SIZE == 0);
+	IS_TRUE(((uintptr_t) b) % COUNTERS_CACHE_LINE_SIZE == 0);
+
+	Counters_inc(a, 0);
+	Counters_add(b, 0, 4);
+	Counters_inc(b, 2);
+	IS_TRUE(Counters_get(&_counters, 0) == 5);
+	IS_TRUE(Counters_get(&_counters, 1) == 0);
+	IS_TRUE(Counters_get(&_counters, 2) == 1);
+
+	// Many threads, incrementing at once
+	pthread_t threads[THREAD_COUNT];
+	for (unsigned int i = 0; i < THREAD_COUNT; i++)
+	{
+		IS_TRUE(0 == pthread_create(threads + i, 0, &threadMain, 0));
+	}
+
+	unsigned int sharedCount = 0;
+	for (unsigned int i = 0; i < THREAD_COUNT; i++)
+	{
+		void* shared;
+		IS_TRUE(0 == pthread_join(threads[i], &shared));
+		if (shared)
+		{
+			sharedCount++;
+		}
+	}
+
+	// Two copies taken above
+	IS_TRUE(sharedCount == THREAD_COUNT - (COUNTERS_MAX_THREADS - 2));
+
+	Counters_sum(&_counters, totals);
+	IS_TRUE(totals[0] == 5);
+	IS_TRUE(totals[1] == ((uint64_t) THREAD_COUNT) * INCREMENTS);
+	IS_TRUE(totals[2] == 1 + ((uint64_t) THREAD_COUNT) * INCREMENTS * 2);
+	IS_TRUE(Counters_get(&_counters, 1) == totals[1]);
+
+	// Released copies keep their counts in the totals, and are reused (zeroed) rather than sharing.
+	uint64_t released[COUNTER_COUNT];
+	Counters_releaseThreadSlot(&_counters, a);
+	Counters_releaseThreadSlot(&_counters, b);
+	Counters_sum(&_counters, released);
+	IS_TRUE(released[0] == totals[0] && released[1] == totals[1] && released[2] == totals[2]);
+
+	for (unsigned int k = 0; k < 2 * COUNTERS_MAX_THREADS; k++)
+	{
+		CountersSlot* c = Counters_newThreadSlot(&_counters);
+		IS_TRUE(c == a || c == b);
+		IS_FALSE(c->shared);
+		IS_TRUE(atomic_load(c->v + 0) == 0 && atomic_load(c->v + 2) == 0);
+
+		Counters_inc(c, 0);
+		Counters_releaseThreadSlot(&_counters, c);
+	}
+
+	IS_TRUE(Counters_get(&_counters, 0) == totals[0] + 2 * COUNTERS_MAX_THREADS);
+	IS_TRUE(Counters_get(&_counters, 2) == totals[2]);
+
+	return 0;
+}
+
+
+static void* threadMain(void* arg)
+{
+	(void) arg;
+
+	CountersSlot* slot = Counters_newThreadSlot(&_counters);
+	if (!slot)
+	{
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < INCREMENTS; i++)
+	{
+		Counters_inc(slot, 1);
+		Counters_add(slot, 2, 2);
+	}
+
+	return slot->shared ? slot : 0;
+}
@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+#include "test_env.h"
+
+#include "Ensemble.h"
+#include "SimCore.h"
+
+
+#define MEMBERS (16)
+#define START_TIME (1700000000)
+#define HORIZON (3 * 3600)
+
+
+static void initBoat(Boat* b);
+
+
+int test_Ensemble()
+{
+	// Summaries: one boat finishing in all members, and one in half of them (tied with the first in member 0)
+	int32_t times[2 * 10];
+	for (unsigned int m = 0; m < 10; m++)
+	{
+		times[m] = (m + 1) * 100;
+		times[10 + m] = (m == 0) ? 100 : ((m < 5) ? 50 : -1);
+	}
+
+	EnsembleEta etas[2];
+	Ensemble_summarize(times, 2, 10, etas);
+
+	EQUALS_DBL(etas[0].finishProb, 1.0);
+	EQUALS_DBL(etas[1].finishProb, 0.5);
+	EQUALS_DBL(etas[0].firstProb, 0.55);
+	EQUALS_DBL(etas[1].firstProb, 0.45);
+	EQUALS(etas[0].p10, 100);
+	EQUALS(etas[0].p50, 500);
+	EQUALS(etas[0].p90, 900);
+	EQUALS(etas[1].p10, 50);
+	EQUALS(etas[1].p50, 100);
+	EQUALS(etas[1].p90, -1);
+
+	// Members sailing downwind to a finish line about 4 km east
+	IS_TRUE(0 == SimCore_init());
+
+	Boat boat;
+	initBoat(&boat);
+
+	const proteus_GeoPos f1 = { .lat = 44.97, .lon = -39.95 };
+	const proteus_GeoPos f2 = { .lat = 45.0, .lon = -39.95 };
+
+	int32_t ft[MEMBERS];
+	IS_TRUE(0 == Ensemble_runBoat(&boat, &f1, &f2, START_TIME, HORIZON, &TEST_ENV, MEMBERS, 1, 2, 0, ft));
+
+	bool allSame = true;
+	for (unsigned int m = 0; m < MEMBERS; m++)
+	{
+		IS_TRUE(ft[m] > 0 && ft[m] < HORIZON);
+		allSame = allSame && (ft[m] == ft[0]);
+	}
+
+	// The members vary.
+	IS_FALSE(allSame);
+
+	// The boat's own state is left as it was.
+	IS_TRUE(boat.pos.lat == 45.0 && boat.pos.lon == -40.0 && boat.distanceTravelled == 0.0);
+
+	// Same seeds, same result
+	int32_t ft2[MEMBERS];
+	IS_TRUE(0 == Ensemble_runBoat(&boat, &f1, &f2, START_TIME, HORIZON, &TEST_ENV, MEMBERS, 1, 2, 0, ft2));
+	IS_TRUE(0 == memcmp(ft, ft2, sizeof(ft)));
+
+	// Finish line too far away to reach within the horizon
+	const proteus_GeoPos f3 = { .lat = 44.9, .lon = -39.0 };
+	const proteus_GeoPos f4 = { .lat = 45.0, .lon = -39.0 };
+	IS_TRUE(0 == Ensemble_runBoat(&boat, &f3, &f4, START_TIME, HORIZON, &TEST_ENV, MEMBERS, 1, 2, 0, ft));
+	for (unsigned int m = 0; m < MEMBERS; m++)
+	{
+		EQUALS(ft[m], -1);
+	}
+
+	// Stopped boats don't finish.
+	boat.stop = true;
+	IS_TRUE(0 == Ensemble_runBoat(&boat, &f1, &f2, START_TIME, HORIZON, &TEST_ENV, MEMBERS, 1, 2, 0, ft));
+	for (unsigned int m = 0; m < MEMBERS; m++)
+	{
+		EQUALS(ft[m], -1);
+	}
+
+	return 0;
+}
+
+
+static void initBoat(Boat* b)
+{
+	Boat_initState(b, 45.0, -40.0, 4, 0);
+
+	b->stop = false;
+	b->sailArea = 1.0;
+	b->desiredCourse = 90.0;
+}
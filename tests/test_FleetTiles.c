@@ -0,0 +1,194 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "FleetTiles.h"
+
+
+static unsigned int sumCounts(const FleetTile* tiles, int n);
+static int checkSubTileCounts(int z, int x, int y, unsigned int expected);
+static void tileXY(double lat, double lon, int z, int* x, int* y);
+
+
+int test_FleetTiles()
+{
+	FleetTile tiles[64];
+	FleetTileBoat boats[3];
+	int n;
+
+
+	IS_TRUE(FleetTiles_isValidTile(0, 0, 0));
+	IS_TRUE(FleetTiles_isValidTile(FLEETTILES_MAX_ZOOM, (1 << FLEETTILES_MAX_ZOOM) - 1, 0));
+	IS_TRUE(!FleetTiles_isValidTile(1, 2, 0));
+	IS_TRUE(!FleetTiles_isValidTile(FLEETTILES_MAX_ZOOM + 1, 0, 0));
+	IS_TRUE(!FleetTiles_isValidTile(-1, 0, 0));
+	IS_TRUE(-1 == FleetTiles_getSubTiles(2, 0, 4, tiles, 64));
+
+
+	// Two boats close together (in one sub-tile of the world tile) and one far away
+	boats[0].id = 1;
+	boats[0].lat = 0.1;
+	boats[0].lon = 0.1;
+	boats[1].id = 2;
+	boats[1].lat = 0.2;
+	boats[1].lon = 0.2;
+	boats[2].id = 3;
+	boats[2].lat = -33.9;
+	boats[2].lon = 151.2;
+
+	IS_TRUE(0 == FleetTiles_build(boats, 3));
+
+	n = FleetTiles_getSubTiles(0, 0, 0, tiles, 64);
+	IS_TRUE(2 == n);
+	IS_TRUE(3 == sumCounts(tiles, n));
+
+	const FleetTile* pair = (tiles[0].count == 2) ? tiles : tiles + 1;
+	IS_TRUE(2 == pair->count);
+	IS_TRUE(FLEETTILES_SUBTILE_LEVELS == pair->z);
+	IS_TRUE(4 == pair->x);
+	IS_TRUE(3 == pair->y);
+	IS_TRUE(fabs(pair->lat - 0.15) < 0.000001);
+	IS_TRUE(fabs(pair->lon - 0.15) < 0.000001);
+
+	// Sub-tiles of a tile deeper than the maximum zoom less the sub-tile levels stop at the maximum zoom.
+	n = FleetTiles_getSubTiles(FLEETTILES_MAX_ZOOM, 2049, 2046, tiles, 64);
+	IS_TRUE(1 == n);
+	IS_TRUE(1 == tiles[0].count);
+	IS_TRUE(FLEETTILES_MAX_ZOOM == tiles[0].z);
+
+	// Moving one of the pair away, and removing the other
+	boats[0].lat = 10.0;
+	boats[0].lon = 10.0;
+	boats[1] = boats[2];
+
+	IS_TRUE(0 == FleetTiles_build(boats, 2));
+
+	n = FleetTiles_getSubTiles(0, 0, 0, tiles, 64);
+	IS_TRUE(2 == n);
+	IS_TRUE(1 == tiles[0].count && 1 == tiles[1].count);
+
+	n = FleetTiles_getSubTiles(FLEETTILES_MAX_ZOOM, 2049, 2046, tiles, 64);
+	IS_TRUE(0 == n);
+
+	// Response lines
+	const char* resp = FleetTiles_getTileResponse(0, 0, 0);
+	IS_TRUE(0 != resp);
+	IS_TRUE(resp[0] == '3' && resp[strlen(resp) - 1] == '\n');
+	FleetTiles_freeTileResponse(resp);
+
+	IS_TRUE(0 == FleetTiles_build(boats, 0));
+	IS_TRUE(0 == FleetTiles_getSubTiles(0, 0, 0, tiles, 64));
+
+
+	// Many boats, moving around and coming and going over several builds, must add up at every level.
+	const unsigned int MANY = 20000;
+	FleetTileBoat* many = malloc(MANY * sizeof(FleetTileBoat));
+	IS_TRUE(0 != many);
+
+	srand(4096);
+	for (unsigned int i = 0; i < MANY; i++)
+	{
+		many[i].id = 1000 + i;
+		many[i].lat = 40.0 + 10.0 * (rand() / (double) RAND_MAX);
+		many[i].lon = -70.0 + 40.0 * (rand() / (double) RAND_MAX);
+	}
+
+	for (int build = 0; build < 5; build++)
+	{
+		const unsigned int count = MANY - build * 1000;
+
+		for (unsigned int i = 0; i < count; i += 3)
+		{
+			many[i].lat += 0.01;
+			many[i].lon -= 0.02;
+		}
+
+		IS_TRUE(0 == FleetTiles_build(many, count));
+		IS_TRUE(0 == checkSubTileCounts(0, 0, 0, count));
+	}
+
+	// A few boats moving at a time (so that only the changes are applied to the tiles served) to an otherwise empty area
+	for (int build = 0; build < 4; build++)
+	{
+		many[build].lat = -60.0 - build;
+		many[build].lon = 170.0;
+
+		IS_TRUE(0 == FleetTiles_build(many, MANY - 4000));
+		IS_TRUE(0 == checkSubTileCounts(0, 0, 0, MANY - 4000));
+
+		for (int b = 0; b <= build; b++)
+		{
+			int x, y;
+			tileXY(many[b].lat, many[b].lon, FLEETTILES_MAX_ZOOM, &x, &y);
+
+			IS_TRUE(1 == FleetTiles_getSubTiles(FLEETTILES_MAX_ZOOM, x, y, tiles, 64));
+			IS_TRUE(1 == tiles[0].count);
+			IS_TRUE(fabs(tiles[0].lat - many[b].lat) < 0.000001);
+		}
+	}
+
+	free(many);
+	IS_TRUE(0 == FleetTiles_build(0, 0));
+
+
+	return 0;
+}
+
+
+static unsigned int sumCounts(const FleetTile* tiles, int n)
+{
+	unsigned int sum = 0;
+	for (int i = 0; i < n; i++)
+	{
+		sum += tiles[i].count;
+	}
+
+	return sum;
+}
+
+// Checks that the sub-tiles of a tile add up to its count, recursively down to the maximum zoom level.
+static int checkSubTileCounts(int z, int x, int y, unsigned int expected)
+{
+	FleetTile tiles[64];
+
+	const int n = FleetTiles_getSubTiles(z, x, y, tiles, 64);
+	if (n <= 0 || sumCounts(tiles, n) != expected)
+	{
+		return -1;
+	}
+
+	if (tiles[0].z == FLEETTILES_MAX_ZOOM || tiles[0].z == z)
+	{
+		return 0;
+	}
+
+	// Following the first sub-tile only, to keep it quick.
+	return checkSubTileCounts(tiles[0].z, tiles[0].x, tiles[0].y, tiles[0].count);
+}
+
+static void tileXY(double lat, double lon, int z, int* x, int* y)
+{
+	const double latRad = lat * M_PI / 180.0;
+
+	*x = (int) floor((lon + 180.0) / 360.0 * (1 << z));
+	*y = (int) floor((1.0 - log(tan(latRad) + 1.0 / cos(latRad)) / M_PI) / 2.0 * (1 << z));
+}
@@ -0,0 +1,288 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Boat.h"
+#include "GhostTrack.h"
+
+
+#define POINT_COUNT (1000)
+
+
+static int requestUntilDone(const char* source);
+
+
+int test_GhostTrack()
+{
+	time_t times[POINT_COUNT];
+	proteus_GeoPos positions[POINT_COUNT];
+
+	// A track heading east across the antimeridian, at 10-second intervals.
+	for (int i = 0; i < POINT_COUNT; i++)
+	{
+		times[i] = 1000000 + i * 10;
+		positions[i].lat = 10.0 + i * 0.0001;
+		positions[i].lon = 179.95 + i * 0.0001;
+		if (positions[i].lon >= 180.0)
+		{
+			positions[i].lon -= 360.0;
+		}
+	}
+
+	GhostTrack* track = GhostTrack_new(times, positions, POINT_COUNT);
+	IS_TRUE(track != 0);
+	IS_TRUE(GhostTrack_getPointCount(track) == POINT_COUNT);
+	IS_TRUE(GhostTrack_getStartTime(track) == 1000000);
+	IS_TRUE(GhostTrack_getEndTime(track) == 1000000 + (POINT_COUNT - 1) * 10);
+
+	// Compact encoding (well under the size of the raw points)
+	IS_TRUE(GhostTrack_getEncodedSize(track) < POINT_COUNT * 8);
+
+	GhostCursor c;
+	GhostTrack_initCursor(&c, track);
+
+	proteus_GeoPos pos;
+	proteus_GeoVec v;
+
+	// Every recorded point, and interpolation in between
+	for (int i = 0; i < POINT_COUNT - 1; i++)
+	{
+		IS_TRUE(GhostTrack_position(&c, times[i], &pos, &v));
+		IS_TRUE(fabs(pos.lat - positions[i].lat) < 0.000002);
+		IS_TRUE(fabs(pos.lon - positions[i].lon) < 0.000002);
+
+		IS_TRUE(GhostTrack_position(&c, times[i] + 5, &pos, &v));
+		IS_TRUE(fabs(pos.lat - (positions[i].lat + 0.00005)) < 0.000002);
+		IS_TRUE(pos.lon >= -180.0 && pos.lon < 180.0);
+	}
+
+	// Heading north-east at about 1.55 m/s
+	IS_TRUE(fabs(v.angle - 44.6) < 0.5);
+	IS_TRUE(fabs(v.mag - 1.55) < 0.02);
+
+	// Seeking backward, and before the start of the track
+	IS_TRUE(GhostTrack_position(&c, times[100], &pos, &v));
+	IS_TRUE(fabs(pos.lat - positions[100].lat) < 0.000002);
+
+	IS_TRUE(GhostTrack_position(&c, times[0] - 100, &pos, &v));
+	IS_TRUE(fabs(pos.lat - positions[0].lat) < 0.000002);
+	IS_TRUE(v.mag == 0.0);
+
+	// Jumping forward across keyframes
+	IS_TRUE(GhostTrack_position(&c, times[900] + 2, &pos, &v));
+	IS_TRUE(fabs(pos.lat - (positions[900].lat + 0.00002)) < 0.000002);
+
+	// End of the track
+	IS_TRUE(!GhostTrack_position(&c, times[POINT_COUNT - 1], &pos, &v));
+	IS_TRUE(fabs(pos.lon - positions[POINT_COUNT - 1].lon) < 0.000002);
+	IS_TRUE(v.mag == 0.0);
+
+
+	// Ghost boat following the track
+	Boat* boat = Boat_new(0.0, 0.0, 0, 0);
+	IS_TRUE(boat != 0);
+
+	Boat_startGhost(boat, track, 5000);
+	IS_TRUE((boat->boatFlags & BOAT_FLAG_GHOST) != 0);
+	IS_TRUE(!boat->stop);
+	IS_TRUE(fabs(boat->pos.lat - positions[0].lat) < 0.000002);
+
+	for (time_t t = 5001; t <= 5100; t++)
+	{
+		Boat_advance(boat, t);
+	}
+	IS_TRUE(fabs(boat->pos.lat - positions[10].lat) < 0.000002);
+	IS_TRUE(fabs(boat->distanceTravelled - 155.0) < 2.0);
+
+	Boat_advance(boat, 5000 + (POINT_COUNT - 1) * 10);
+	IS_TRUE(boat->stop);
+
+	Boat_free(boat);
+
+
+	// Out of order points are dropped, and a single point track holds its position.
+	times[1] = times[0];
+	GhostTrack* track2 = GhostTrack_new(times, positions, 3);
+	IS_TRUE(GhostTrack_getPointCount(track2) == 2);
+	GhostTrack_free(track2);
+
+	track2 = GhostTrack_new(times, positions, 1);
+	GhostTrack_initCursor(&c, track2);
+	IS_TRUE(GhostTrack_position(&c, times[0] - 1, &pos, &v));
+	IS_TRUE(!GhostTrack_position(&c, times[0], &pos, &v));
+	IS_TRUE(fabs(pos.lat - positions[0].lat) < 0.000002);
+	GhostTrack_free(track2);
+
+	IS_TRUE(GhostTrack_new(times, positions, 0) == 0);
+
+
+	// Encoded form (as handed over), decoding to the same points (with seeking by the rebuilt keyframes)
+	GhostTrackData d;
+	GhostTrack_getData(track, &d);
+	EQUALS(d.count, POINT_COUNT);
+	EQUALS(d.startTime, 1000000);
+
+	GhostTrack* copy = GhostTrack_fromData(&d);
+	IS_TRUE(copy != 0);
+	EQUALS(GhostTrack_getPointCount(copy), POINT_COUNT);
+	EQUALS(GhostTrack_getEndTime(copy), GhostTrack_getEndTime(track));
+	EQUALS(GhostTrack_getEncodedSize(copy), GhostTrack_getEncodedSize(track));
+
+	GhostCursor cc;
+	GhostTrack_initCursor(&cc, copy);
+	for (int i = POINT_COUNT - 1; i >= 0; i -= 37)
+	{
+		IS_TRUE(GhostTrack_position(&cc, times[i] + 5, &pos, &v) == (i < POINT_COUNT - 1));
+		IS_TRUE(fabs(pos.lat - (i < POINT_COUNT - 1 ? 0.5 * (positions[i].lat + positions[i + 1].lat) : positions[i].lat)) < 0.000002);
+	}
+
+	// Truncated, with trailing data, and with fewer points than claimed
+	GhostTrackData bad = d;
+	bad.dataSize--;
+	IS_TRUE(GhostTrack_fromData(&bad) == 0);
+
+	bad = d;
+	bad.count--;
+	IS_TRUE(GhostTrack_fromData(&bad) == 0);
+
+	bad = d;
+	bad.count++;
+	IS_TRUE(GhostTrack_fromData(&bad) == 0);
+
+	bad = d;
+	bad.count = 0;
+	IS_TRUE(GhostTrack_fromData(&bad) == 0);
+
+	// Cached as if loaded from a source (which needn't exist), keeping an already cached track for the same source
+	IS_TRUE(0 == GhostTrack_put("handed/over.csv", copy));
+	IS_TRUE(GhostTrack_get("handed/over.csv") == copy);
+	IS_TRUE(strcmp(GhostTrack_getSource(copy), "handed/over.csv") == 0);
+	EQUALS(GhostTrack_request("handed/over.csv"), GHOSTTRACK_READY);
+
+	IS_TRUE(0 == GhostTrack_put("handed/over.csv", GhostTrack_fromData(&d)));
+	IS_TRUE(GhostTrack_get("handed/over.csv") == copy);
+
+	// Only tracks used by ghost boats
+	const GhostTrack* used[2];
+	EQUALS(GhostTrack_getUsed(used, 2), 0);
+	Boat* handedOver = Boat_new(0.0, 0.0, 0, 0);
+	Boat_startGhost(handedOver, copy, 5000);
+	EQUALS(GhostTrack_getUsed(used, 2), 1);
+	IS_TRUE(used[0] == copy);
+	Boat_free(handedOver);
+	EQUALS(GhostTrack_getUsed(0, 0), 0);
+
+	GhostTrack_free(track);
+
+
+	// Loading (in the background, and caching) a track from a CSV boat log file, within the track directory
+	IS_TRUE(0 == GhostTrack_init(0, "/tmp"));
+
+	char path[] = "/tmp/sailnavsim_test_ghost_XXXXXX";
+	const int fd = mkstemp(path);
+	IS_TRUE(fd >= 0);
+
+	FILE* f = fdopen(fd, "w");
+	fprintf(f, "1000,44.500000,-63.500000,90.0,2.000\n");
+	fprintf(f, "garbage\n");
+	fprintf(f, "1060,44.500000,-63.498000,90.0,2.000\n");
+	fprintf(f, "1120,44.501000,-63.498000,0.0,2.000\n");
+	fclose(f);
+
+	IS_TRUE(GhostTrack_get(path) == 0);
+	EQUALS(GhostTrack_request(path), GHOSTTRACK_LOADING);
+	EQUALS(requestUntilDone(path), GHOSTTRACK_READY);
+
+	const GhostTrack* fileTrack = GhostTrack_get(path);
+	IS_TRUE(fileTrack != 0);
+	IS_TRUE(GhostTrack_getPointCount(fileTrack) == 3);
+	IS_TRUE(strcmp(GhostTrack_getSource(fileTrack), path) == 0);
+	IS_TRUE(GhostTrack_load(path) == fileTrack);
+
+	// Relative to the track directory (with a '/' making it a file source, rather than a boat name)
+	char relPath[64];
+	snprintf(relPath, sizeof(relPath), "./%s", path + strlen("/tmp/"));
+	const GhostTrack* relTrack = GhostTrack_load(relPath);
+	IS_TRUE(relTrack != 0 && relTrack != fileTrack);
+	IS_TRUE(GhostTrack_getPointCount(relTrack) == 3);
+
+	// Failures are reported once, with the next request loading again.
+	EQUALS(requestUntilDone("/nonexistent/ghost.csv"), GHOSTTRACK_FAILED);
+	EQUALS(GhostTrack_request("/nonexistent/ghost.csv"), GHOSTTRACK_LOADING);
+	EQUALS(requestUntilDone("/nonexistent/ghost.csv"), GHOSTTRACK_FAILED);
+	IS_TRUE(GhostTrack_get("/nonexistent/ghost.csv") == 0);
+
+	// Only regular files within the track directory (so not a FIFO, which would block the loader thread)
+	IS_TRUE(GhostTrack_load("/etc/hostname") == 0);
+	IS_TRUE(GhostTrack_load("../etc/hostname") == 0);
+
+	char fifoPath[64];
+	snprintf(fifoPath, sizeof(fifoPath), "/tmp/sailnavsim_test_ghost_fifo_%d", (int) getpid());
+	IS_TRUE(0 == mkfifo(fifoPath, 0600));
+	IS_TRUE(GhostTrack_load(fifoPath) == 0);
+	unlink(fifoPath);
+
+	IS_TRUE(GhostTrack_load("/dev/zero") == 0);
+
+	// Unused tracks beyond the most recently used few are freed, while tracks used by a ghost boat are kept.
+	Boat* ghost = Boat_new(0.0, 0.0, 0, 0);
+	Boat_startGhost(ghost, fileTrack, 5000);
+
+	char source[256];
+	for (unsigned int i = 0; i <= GHOSTTRACK_CACHE_MAX_UNUSED; i++)
+	{
+		// Same file, by a different source each time
+		snprintf(source, sizeof(source), "/tmp/%.*s%s", (int) (i * 2), "././././././././././././././././././././././././././././././././././././", relPath + 2);
+		IS_TRUE(GhostTrack_load(source) != 0);
+	}
+
+	IS_TRUE(GhostTrack_get(relPath) == 0);
+	IS_TRUE(GhostTrack_get(path) == fileTrack);
+
+	Boat_free(ghost);
+
+	unlink(path);
+
+	// No file sources without a track directory
+	IS_TRUE(0 == GhostTrack_init(0, 0));
+	IS_TRUE(GhostTrack_load("/tmp/sailnavsim_test_ghost_other.csv") == 0);
+
+
+	return 0;
+}
+
+
+// Requests a track until it's loaded (or failed to load).
+static int requestUntilDone(const char* source)
+{
+	int rc;
+	while ((rc = GhostTrack_request(source)) == GHOSTTRACK_LOADING)
+	{
+		usleep(1000);
+	}
+
+	return rc;
+}
@@ -0,0 +1,320 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Boat.h"
+#include "BoatRegistry.h"
+#include "GhostTrack.h"
+#include "Handoff.h"
+#include "RaceMarks.h"
+
+
+// As in Handoff.c
+#define HANDOFF_MAGIC (0x534e5348)
+
+
+// Old process side of a handoff, sending a snapshot (and the read end of a pipe as command input), then committing
+// (or not) once the new process is ready
+typedef struct
+{
+	int listenFd;
+	const HandoffBuf* snapshot;
+	int cmdFd;
+	bool commit;
+	bool ready;
+} FakeOld;
+
+static void* fakeOldMain(void* arg);
+static int takeoverFrom(FakeOld* old, HandoffState* state);
+
+
+int test_Handoff()
+{
+	IS_TRUE(0 == BoatRegistry_init());
+
+	// A plain boat, one in a group (with alt name), and a ghost boat part way along its track
+	Boat* plain = Boat_new(44.5, -63.5, 0, 0);
+	plain->desiredCourse = 123.5;
+	plain->stop = false;
+	plain->v.mag = 2.25;
+	plain->distanceTravelled = 1234.5;
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(plain, "HandoffPlain", 0, 0));
+
+	Boat* grouped = Boat_new(45.0, -64.0, 1, BOAT_FLAG_TAKES_DAMAGE);
+	grouped->damage = 12.5;
+	grouped->courseMagnetic = true;
+	grouped->sailArea = 0.5;
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(grouped, "HandoffGrouped", "HandoffRace", "Alt Name"));
+
+	char path[] = "/tmp/sailnavsim_test_handoff_XXXXXX";
+	const int fd = mkstemp(path);
+	IS_TRUE(fd >= 0);
+
+	FILE* f = fdopen(fd, "w");
+	fprintf(f, "1000,44.500000,-63.500000,90.0,2.000\n");
+	fprintf(f, "1060,44.500000,-63.498000,90.0,2.000\n");
+	fprintf(f, "1120,44.501000,-63.498000,0.0,2.000\n");
+	fclose(f);
+
+	IS_TRUE(0 == GhostTrack_init(0, "/tmp"));
+	const GhostTrack* track = GhostTrack_load(path);
+	IS_TRUE(track != 0);
+
+	Boat* ghost = Boat_new(0.0, 0.0, 0, 0);
+	Boat_startGhost(ghost, track, 5000);
+	proteus_GeoPos ghostPos;
+	proteus_GeoVec ghostV;
+	IS_TRUE(GhostTrack_position(&ghost->ghost, 1090, &ghostPos, &ghostV));
+	const GhostCursor cursor = ghost->ghost;
+	IS_TRUE(cursor.index > 0);
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(ghost, "HandoffGhost", 0, 0));
+
+	proteus_GeoPos p1 = { 44.0, -63.01 };
+	proteus_GeoPos p2 = { 44.0, -62.99 };
+	IS_TRUE(0 == RaceMarks_add("HandoffRace", "Finish", RACEMARK_TYPE_FINISH, &p1, &p2));
+
+	// Snapshot, with the boats and marks then gone (as in a new process)
+	HandoffBuf buf = { 0, 0, 0 };
+	IS_TRUE(0 == Handoff_encodeSnapshot(5090, &buf));
+
+	const Boat plainCopy = *plain;
+	const Boat groupedCopy = *grouped;
+
+	Boat_free(BoatRegistry_remove("HandoffPlain"));
+	Boat_free(BoatRegistry_remove("HandoffGrouped"));
+	Boat_free(BoatRegistry_remove("HandoffGhost"));
+	IS_TRUE(0 == RaceMarks_removeAll());
+	IS_FALSE(RaceMarks_hasMarks());
+
+	// Truncated
+	HandoffState state;
+	IS_TRUE(0 != Handoff_applySnapshot(buf.data, buf.len - 1, &state));
+	Boat_free(BoatRegistry_remove("HandoffPlain"));
+	Boat_free(BoatRegistry_remove("HandoffGrouped"));
+	Boat_free(BoatRegistry_remove("HandoffGhost"));
+
+	IS_TRUE(0 == Handoff_applySnapshot(buf.data, buf.len, &state));
+	EQUALS(state.tickTime, 5090);
+	EQUALS(state.boatCount, 3);
+	EQUALS(state.markCount, 1);
+	EQUALS(state.trackCount, 1);
+	HandoffBuf_free(&buf);
+
+	const BoatEntry* e = BoatRegistry_getBoatEntry("HandoffPlain");
+	IS_TRUE(e != 0 && e->boat != 0 && e->group == 0 && e->altName == 0);
+	IS_TRUE(0 == memcmp(&e->boat->pos, &plainCopy.pos, sizeof(proteus_GeoPos)));
+	EQUALS_DBL(e->boat->desiredCourse, 123.5);
+	EQUALS_DBL(e->boat->v.mag, 2.25);
+	EQUALS_DBL(e->boat->distanceTravelled, plainCopy.distanceTravelled);
+	IS_FALSE(e->boat->stop);
+
+	e = BoatRegistry_getBoatEntry("HandoffGrouped");
+	IS_TRUE(e != 0 && e->boat != 0);
+	IS_TRUE(0 == strcmp(e->group, "HandoffRace"));
+	IS_TRUE(0 == strcmp(e->altName, "Alt Name"));
+	EQUALS(e->boat->boatType, 1);
+	EQUALS(e->boat->boatFlags, BOAT_FLAG_TAKES_DAMAGE);
+	EQUALS_DBL(e->boat->damage, groupedCopy.damage);
+	EQUALS_DBL(e->boat->sailArea, 0.5);
+	IS_TRUE(e->boat->courseMagnetic);
+
+	e = BoatRegistry_getBoatEntry("HandoffGhost");
+	IS_TRUE(e != 0 && e->boat != 0);
+	IS_TRUE(e->boat->ghost.track == track);
+	EQUALS(e->boat->ghost.index, cursor.index);
+	EQUALS(e->boat->ghost.t0, cursor.t0);
+	EQUALS(e->boat->ghost.lat1, cursor.lat1);
+	EQUALS(e->boat->ghostTimeOffset, 4000);
+	IS_TRUE((e->boat->boatFlags & BOAT_FLAG_GHOST) != 0);
+
+	RaceMarkInfo mark;
+	EQUALS(RaceMarks_getMarks(&mark, 1), 1);
+	IS_TRUE(0 == strcmp(mark.group, "HandoffRace") && 0 == strcmp(mark.name, "Finish"));
+	EQUALS(mark.type, RACEMARK_TYPE_FINISH);
+	EQUALS_DBL(mark.p2.lon, -62.99);
+
+	// Applying again fails, with the boats already there.
+	IS_TRUE(0 == Handoff_encodeSnapshot(5091, &buf));
+	IS_TRUE(0 != Handoff_applySnapshot(buf.data, buf.len, &state));
+	HandoffBuf_free(&buf);
+
+	Boat_free(BoatRegistry_remove("HandoffPlain"));
+	Boat_free(BoatRegistry_remove("HandoffGrouped"));
+	Boat_free(BoatRegistry_remove("HandoffGhost"));
+	IS_TRUE(0 == RaceMarks_removeAll());
+	unlink(path);
+
+
+	// Taking over only once the old process commits (with an empty snapshot, now that the boats are gone)
+	IS_TRUE(0 == Handoff_encodeSnapshot(6000, &buf));
+
+	int cmdPipe[2];
+	IS_TRUE(0 == pipe(cmdPipe));
+
+	FakeOld old = { -1, &buf, cmdPipe[0], false, false };
+	IS_TRUE(0 != takeoverFrom(&old, &state));
+	IS_TRUE(old.ready);
+
+	old.commit = true;
+	old.ready = false;
+	IS_TRUE(0 == takeoverFrom(&old, &state));
+	IS_TRUE(old.ready);
+	EQUALS(state.tickTime, 6000);
+	EQUALS(state.boatCount, 0);
+	IS_TRUE(state.fds[HANDOFF_FD_NET] == -1 && state.fds[HANDOFF_FD_HTTP] == -1 && state.fds[HANDOFF_FD_CMD] >= 0);
+
+	IS_TRUE(1 == write(cmdPipe[1], "x", 1));
+	char cmdByte = 0;
+	IS_TRUE(1 == read(state.fds[HANDOFF_FD_CMD], &cmdByte, 1));
+	IS_TRUE(cmdByte == 'x');
+
+	close(state.fds[HANDOFF_FD_CMD]);
+	close(cmdPipe[0]);
+	close(cmdPipe[1]);
+	HandoffBuf_free(&buf);
+
+
+	// Passing fds (the read end of a pipe, still readable after being passed)
+	int sv[2];
+	IS_TRUE(0 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+	int pipeFds[2];
+	IS_TRUE(0 == pipe(pipeFds));
+
+	const int sendFds[2] = { pipeFds[0], sv[1] };
+	const char data[] = "handover";
+	IS_TRUE(0 == Handoff_sendFds(sv[0], sendFds, 2, data, sizeof(data)));
+	close(pipeFds[0]);
+
+	int recvFds[HANDOFF_FD_COUNT];
+	unsigned int recvCount;
+	char recvData[sizeof(data)];
+	IS_TRUE(0 == Handoff_receiveFds(sv[1], recvFds, HANDOFF_FD_COUNT, &recvCount, recvData, sizeof(recvData)));
+	EQUALS(recvCount, 2);
+	IS_TRUE(0 == memcmp(data, recvData, sizeof(data)));
+
+	IS_TRUE(1 == write(pipeFds[1], "x", 1));
+	char c = 0;
+	IS_TRUE(1 == read(recvFds[0], &c, 1));
+	IS_TRUE(c == 'x');
+
+	// No fds
+	IS_TRUE(0 == Handoff_sendFds(sv[0], 0, 0, data, sizeof(data)));
+	IS_TRUE(0 == Handoff_receiveFds(sv[1], recvFds + 2, 1, &recvCount, recvData, sizeof(recvData)));
+	EQUALS(recvCount, 0);
+
+	close(recvFds[0]);
+	close(recvFds[1]);
+	close(pipeFds[1]);
+	close(sv[0]);
+	close(sv[1]);
+
+	BoatRegistry_destroy();
+
+	return 0;
+}
+
+
+static void* fakeOldMain(void* arg)
+{
+	FakeOld* old = arg;
+
+	const int fd = accept(old->listenFd, 0, 0);
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	uint8_t hello[8];
+	if (8 != read(fd, hello, 8))
+	{
+		close(fd);
+		return 0;
+	}
+
+	// Handover: magic, fd mask (command input only), reserved, pending input length, snapshot length
+	uint8_t handover[16];
+	const uint32_t magic = HANDOFF_MAGIC;
+	const uint8_t fdMask = (1 << HANDOFF_FD_CMD);
+	const uint64_t snapshotLen = old->snapshot->len;
+
+	memset(handover, 0, sizeof(handover));
+	memcpy(handover, &magic, 4);
+	memcpy(handover + 4, &fdMask, 1);
+	memcpy(handover + 8, &snapshotLen, 8);
+
+	uint32_t ready = 0;
+	if (0 == Handoff_sendFds(fd, &old->cmdFd, 1, handover, sizeof(handover)) &&
+			(ssize_t) snapshotLen == write(fd, old->snapshot->data, snapshotLen) &&
+			4 == read(fd, &ready, 4) && ready == HANDOFF_MAGIC)
+	{
+		old->ready = true;
+
+		if (old->commit)
+		{
+			(void) !write(fd, &magic, 4);
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+static int takeoverFrom(FakeOld* old, HandoffState* state)
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/sailnavsim_test_handoff_%d.sock", (int) getpid());
+	unlink(path);
+
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+
+	old->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (old->listenFd < 0 || 0 != bind(old->listenFd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)) || 0 != listen(old->listenFd, 1))
+	{
+		return -1;
+	}
+
+	pthread_t thread;
+	if (0 != pthread_create(&thread, 0, &fakeOldMain, old))
+	{
+		close(old->listenFd);
+		return -1;
+	}
+
+	const int rc = Handoff_takeover(path, state);
+
+	pthread_join(thread, 0);
+	close(old->listenFd);
+	unlink(path);
+
+	return rc;
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "HttpApi.h"
+
+
+static const char* const ROW_NAMES[] = { "boat", "altName", "distance" };
+
+
+int test_HttpApi()
+{
+	HttpApiRequest req;
+
+	// Incomplete, then complete
+	const char* r1 = "GET /wind/44.0/-63.0 HTTP/1.1\r\nHost: localhost\r\n";
+	EQUALS(HttpApi_parseRequest(r1, strlen(r1), &req), 0);
+
+	const char* r2 = "GET /wind/44.0/-63.0 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	EQUALS(HttpApi_parseRequest(r2, strlen(r2), &req), (int) strlen(r2));
+	EQUALS(req.status, HTTP_API_STATUS_OK);
+	IS_TRUE(req.keepAlive);
+	IS_TRUE(0 == strcmp(req.reqStr, "wind,44.0,-63.0"));
+
+	// Pipelined: each request parsed in turn
+	const char* r3 = "GET /bd_nc/Boat%20One/ HTTP/1.1\r\n\r\nGET /sys_req_counts?x=1 HTTP/1.1\r\nConnection: close\r\n\r\nGET /";
+	int n = HttpApi_parseRequest(r3, strlen(r3), &req);
+	EQUALS(n, 35);
+	EQUALS(req.status, HTTP_API_STATUS_OK);
+	IS_TRUE(0 == strcmp(req.reqStr, "bd_nc,Boat One"));
+
+	const int n2 = HttpApi_parseRequest(r3 + n, strlen(r3) - n, &req);
+	IS_TRUE(n2 > 0);
+	EQUALS(req.status, HTTP_API_STATUS_OK);
+	IS_FALSE(req.keepAlive);
+	IS_TRUE(0 == strcmp(req.reqStr, "sys_req_counts"));
+
+	n += n2;
+	EQUALS(HttpApi_parseRequest(r3 + n, strlen(r3) - n, &req), 0);
+
+	// HTTP/1.0 closes by default, unless asked to keep alive.
+	const char* r4 = "GET /wind/1/2 HTTP/1.0\r\n\r\n";
+	IS_TRUE(HttpApi_parseRequest(r4, strlen(r4), &req) > 0);
+	IS_FALSE(req.keepAlive);
+
+	const char* r5 = "GET /wind/1/2 HTTP/1.0\r\nconnection: Keep-Alive\r\n\r\n";
+	IS_TRUE(HttpApi_parseRequest(r5, strlen(r5), &req) > 0);
+	IS_TRUE(req.keepAlive);
+
+	// Errors
+	const char* r6 = "POST /wind/1/2 HTTP/1.1\r\nContent-Length: 0\r\n\r\n";
+	IS_TRUE(HttpApi_parseRequest(r6, strlen(r6), &req) > 0);
+	EQUALS(req.status, HTTP_API_STATUS_METHOD_NOT_ALLOWED);
+
+	const char* r7 = "GET /bd/a,b HTTP/1.1\r\n\r\n";
+	IS_TRUE(HttpApi_parseRequest(r7, strlen(r7), &req) > 0);
+	EQUALS(req.status, HTTP_API_STATUS_BAD_REQUEST);
+
+	const char* r8 = "GET /bd/a%2Cb HTTP/1.1\r\n\r\n";
+	IS_TRUE(HttpApi_parseRequest(r8, strlen(r8), &req) > 0);
+	EQUALS(req.status, HTTP_API_STATUS_BAD_REQUEST);
+
+	const char* r9 = "GET / HTTP/1.1\r\n\r\n";
+	IS_TRUE(HttpApi_parseRequest(r9, strlen(r9), &req) > 0);
+	EQUALS(req.status, HTTP_API_STATUS_NOT_FOUND);
+
+	const char* r10 = "GET /wind/1/2 HTTP/2.0\r\n\r\n";
+	EQUALS(HttpApi_parseRequest(r10, strlen(r10), &req), -1);
+
+	const char* r11 = "GET /wind/1/2 HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+	EQUALS(HttpApi_parseRequest(r11, strlen(r11), &req), -1);
+
+	// Response head
+	char buf[512];
+	n = HttpApi_writeResponseHead(buf, sizeof(buf), HTTP_API_STATUS_OK, 42, true);
+	IS_TRUE(n > 0);
+	IS_TRUE(0 == strncmp(buf, "HTTP/1.1 200 OK\r\n", 17));
+	IS_TRUE(strstr(buf, "\r\nContent-Length: 42\r\n") != 0);
+	IS_TRUE(strstr(buf, "\r\nConnection: keep-alive\r\n") != 0);
+	IS_TRUE(0 == strcmp(buf + n - 4, "\r\n\r\n"));
+	EQUALS(HttpApi_writeResponseHead(buf, 16, HTTP_API_STATUS_OK, 42, true), -1);
+
+	// JSON strings
+	n = HttpApi_writeJsonString(buf, sizeof(buf), "a\"b\\c\nd");
+	IS_TRUE(0 == strcmp(buf, "\"a\\\"b\\\\c\\u000ad\""));
+	EQUALS(n, (int) strlen(buf));
+	EQUALS(HttpApi_writeJsonString(buf, 8, "abcdefgh"), -1);
+
+	// JSON rows
+	n = HttpApi_writeJsonRows(buf, sizeof(buf), "B1,Alt1,12.5\nB\"2,!,7\n\n", ROW_NAMES, "son");
+	IS_TRUE(0 == strcmp(buf, "[{\"boat\":\"B1\",\"altName\":\"Alt1\",\"distance\":12.5},{\"boat\":\"B\\\"2\",\"altName\":null,\"distance\":7}]"));
+	EQUALS(n, (int) strlen(buf));
+
+	EQUALS(HttpApi_writeJsonRows(buf, sizeof(buf), "", ROW_NAMES, "son"), 2);
+	IS_TRUE(0 == strcmp(buf, "[]"));
+
+	EQUALS(HttpApi_writeJsonRows(buf, sizeof(buf), "B1,Alt1\n", ROW_NAMES, "son"), -1);
+	EQUALS(HttpApi_writeJsonRows(buf, 20, "B1,Alt1,12.5\n", ROW_NAMES, "son"), -1);
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "InitPhases.h"
+
+
+#define PHASE_COUNT (5)
+
+#define FAILING_PHASE (2)
+#define FAILING_RC (-7)
+
+
+// Order in which phases were run and torn down (by index)
+static unsigned int _runOrder[PHASE_COUNT];
+static unsigned int _runCount;
+static unsigned int _teardownOrder[PHASE_COUNT];
+static unsigned int _teardownCount;
+
+static unsigned int _indices[PHASE_COUNT];
+
+static int runPhase(void* arg);
+static int runFailingPhase(void* arg);
+static void teardownPhase(void* arg);
+static void initPhases(InitPhase* phases, bool withFailure);
+
+
+int test_InitPhases()
+{
+	InitPhase phases[PHASE_COUNT];
+
+	for (unsigned int i = 0; i < PHASE_COUNT; i++)
+	{
+		_indices[i] = i;
+	}
+
+	// All succeed, run in order on one thread, with no teardown.
+	initPhases(phases, false);
+	EQUALS(InitPhases_run(phases, PHASE_COUNT, 1), 0);
+	EQUALS(_runCount, PHASE_COUNT);
+	EQUALS(_teardownCount, 0);
+	for (unsigned int i = 0; i < PHASE_COUNT; i++)
+	{
+		EQUALS(_runOrder[i], i);
+		IS_TRUE(phases[i].run);
+		EQUALS(phases[i].rc, 0);
+	}
+
+	// A failing phase stops the later ones, its result is returned, and the phases before it are torn down in reverse.
+	initPhases(phases, true);
+	EQUALS(InitPhases_run(phases, PHASE_COUNT, 1), FAILING_RC);
+	EQUALS(_runCount, FAILING_PHASE + 1);
+	for (unsigned int i = 0; i <= FAILING_PHASE; i++)
+	{
+		EQUALS(_runOrder[i], i);
+		IS_TRUE(phases[i].run);
+	}
+	for (unsigned int i = FAILING_PHASE + 1; i < PHASE_COUNT; i++)
+	{
+		IS_FALSE(phases[i].run);
+	}
+
+	EQUALS(_teardownCount, FAILING_PHASE);
+	for (unsigned int i = 0; i < FAILING_PHASE; i++)
+	{
+		EQUALS(_teardownOrder[i], FAILING_PHASE - 1 - i);
+	}
+
+	// On several threads, every phase that succeeded (whichever did run) is torn down, and none that didn't.
+	initPhases(phases, true);
+	EQUALS(InitPhases_run(phases, PHASE_COUNT, 3), FAILING_RC);
+
+	unsigned int succeeded = 0;
+	for (unsigned int i = 0; i < PHASE_COUNT; i++)
+	{
+		if (phases[i].run && phases[i].rc == 0)
+		{
+			succeeded++;
+		}
+	}
+	IS_TRUE(phases[FAILING_PHASE].run);
+	EQUALS(_teardownCount, succeeded);
+	for (unsigned int i = 1; i < _teardownCount; i++)
+	{
+		IS_TRUE(_teardownOrder[i] < _teardownOrder[i - 1]);
+	}
+
+	return 0;
+}
+
+
+static int runPhase(void* arg)
+{
+	_runOrder[__atomic_fetch_add(&_runCount, 1, __ATOMIC_SEQ_CST)] = *((const unsigned int*) arg);
+	return 0;
+}
+
+static int runFailingPhase(void* arg)
+{
+	runPhase(arg);
+	return FAILING_RC;
+}
+
+static void teardownPhase(void* arg)
+{
+	_teardownOrder[_teardownCount++] = *((const unsigned int*) arg);
+}
+
+static void initPhases(InitPhase* phases, bool withFailure)
+{
+	for (unsigned int i = 0; i < PHASE_COUNT; i++)
+	{
+		phases[i].name = "test";
+		phases[i].func = (withFailure && i == FAILING_PHASE) ? &runFailingPhase : &runPhase;
+		phases[i].teardown = &teardownPhase;
+		phases[i].arg = _indices + i;
+	}
+
+	_runCount = 0;
+	_teardownCount = 0;
+}
@@ -0,0 +1,232 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <elf.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Probes.h"
+
+
+#define STAPSDT_NOTE_SECTION ".note.stapsdt"
+#define STAPSDT_NOTE_NAME "stapsdt"
+#define STAPSDT_NOTE_TYPE (3)
+
+#define MAX_PROBE_NAMES (256)
+#define MAX_PROBE_NAME_LEN (64)
+
+#define SAILNAVSIM_BINARY_PATH "./sailnavsim"
+
+#ifdef PROBES_ENABLED
+#define IS_DEFINED_PROBES_ENABLED (true)
+#else
+#define IS_DEFINED_PROBES_ENABLED (false)
+#endif
+
+
+// Probes compiled into modules that are linked into the tests binary
+static const char* PROBES_MODULES[] = {
+	"registry_lock_wait_start",
+	"registry_lock_acquired",
+	"log_enqueue",
+	"log_sink_done",
+	"netserver_request_start",
+	"netserver_request_end"
+};
+
+// Probes compiled into the main simulator loop (only in the sailnavsim binary)
+static const char* PROBES_MAIN[] = {
+	"tick_start",
+	"tick_end",
+	"advance_start",
+	"advance_end",
+	"command_applied"
+};
+
+
+static char* readFile(const char* path, size_t* len);
+static int readProbeNames(const char* path, char names[MAX_PROBE_NAMES][MAX_PROBE_NAME_LEN]);
+static bool hasProbe(char names[MAX_PROBE_NAMES][MAX_PROBE_NAME_LEN], int count, const char* name);
+
+
+int test_Probes()
+{
+#ifdef SAILNAVSIM_NO_PROBES
+	printf("\t(USDT probes disabled, so skipping checks)\n");
+	return 0;
+#endif
+
+	// Probes are expected in all other builds (on platforms with <sys/sdt.h> or sdt.h support).
+	IS_TRUE(IS_DEFINED_PROBES_ENABLED);
+
+	static char names[MAX_PROBE_NAMES][MAX_PROBE_NAME_LEN];
+	int count;
+
+
+	// Probes in this tests binary itself
+	count = readProbeNames("/proc/self/exe", names);
+	IS_TRUE(count > 0);
+
+	for (size_t i = 0; i < sizeof(PROBES_MODULES) / sizeof(const char*); i++)
+	{
+		IS_TRUE(hasProbe(names, count, PROBES_MODULES[i]));
+	}
+
+
+	// Probes in the simulator binary, if it has been built
+	if (0 != access(SAILNAVSIM_BINARY_PATH, R_OK))
+	{
+		printf("\t(%s not found, so skipping main loop probe checks)\n", SAILNAVSIM_BINARY_PATH);
+		return 0;
+	}
+
+	count = readProbeNames(SAILNAVSIM_BINARY_PATH, names);
+	IS_TRUE(count > 0);
+
+	for (size_t i = 0; i < sizeof(PROBES_MODULES) / sizeof(const char*); i++)
+	{
+		IS_TRUE(hasProbe(names, count, PROBES_MODULES[i]));
+	}
+
+	for (size_t i = 0; i < sizeof(PROBES_MAIN) / sizeof(const char*); i++)
+	{
+		IS_TRUE(hasProbe(names, count, PROBES_MAIN[i]));
+	}
+
+
+	return 0;
+}
+
+
+static char* readFile(const char* path, size_t* len)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		return 0;
+	}
+
+	size_t cap = 1024 * 1024;
+	size_t n = 0;
+	char* buf = malloc(cap);
+
+	while (buf)
+	{
+		n += fread(buf + n, 1, cap - n, f);
+		if (n < cap)
+		{
+			break;
+		}
+
+		cap *= 2;
+		char* b = realloc(buf, cap);
+		if (!b)
+		{
+			free(buf);
+		}
+		buf = b;
+	}
+
+	fclose(f);
+
+	*len = n;
+	return buf;
+}
+
+// Returns the number of probe names (for our provider) found in the ELF file at the given path, or -1 on failure.
+static int readProbeNames(const char* path, char names[MAX_PROBE_NAMES][MAX_PROBE_NAME_LEN])
+{
+	size_t len;
+	char* elf = readFile(path, &len);
+	if (!elf)
+	{
+		return -1;
+	}
+
+	int count = -1;
+
+	const Elf64_Ehdr* eh = (const Elf64_Ehdr*) elf;
+	if (len < sizeof(Elf64_Ehdr) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS64)
+	{
+		goto done;
+	}
+
+	if (eh->e_shoff + ((size_t) eh->e_shnum) * sizeof(Elf64_Shdr) > len || eh->e_shstrndx >= eh->e_shnum)
+	{
+		goto done;
+	}
+
+	const Elf64_Shdr* sh = (const Elf64_Shdr*) (elf + eh->e_shoff);
+	const char* shstrtab = elf + sh[eh->e_shstrndx].sh_offset;
+
+	count = 0;
+
+	for (int i = 0; i < eh->e_shnum; i++)
+	{
+		if (sh[i].sh_type != SHT_NOTE || strcmp(shstrtab + sh[i].sh_name, STAPSDT_NOTE_SECTION) != 0)
+		{
+			continue;
+		}
+
+		const char* p = elf + sh[i].sh_offset;
+		const char* end = p + sh[i].sh_size;
+
+		while (p + sizeof(Elf64_Nhdr) <= end)
+		{
+			const Elf64_Nhdr* nh = (const Elf64_Nhdr*) p;
+			const char* noteName = p + sizeof(Elf64_Nhdr);
+			const char* desc = noteName + ((nh->n_namesz + 3) & ~3);
+
+			if (nh->n_type == STAPSDT_NOTE_TYPE && strcmp(noteName, STAPSDT_NOTE_NAME) == 0)
+			{
+				// Descriptor: PC, base address, semaphore address, then provider, name and args strings.
+				const char* provider = desc + 3 * sizeof(Elf64_Addr);
+				const char* probeName = provider + strlen(provider) + 1;
+
+				if (strcmp(provider, PROBES_PROVIDER_NAME) == 0 && count < MAX_PROBE_NAMES)
+				{
+					snprintf(names[count++], MAX_PROBE_NAME_LEN, "%s", probeName);
+				}
+			}
+
+			p = desc + ((nh->n_descsz + 3) & ~3);
+		}
+	}
+
+done:
+	free(elf);
+	return count;
+}
+
+static bool hasProbe(char names[MAX_PROBE_NAMES][MAX_PROBE_NAME_LEN], int count, const char* name)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(names[i], name) == 0)
+		{
+			return true;
+		}
+	}
+
+	printf("\tProbe not found: %s\n", name);
+	return false;
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Profiler.h"
+
+
+#define HZ (1000)
+#define BURN_NS (300000000L)
+
+
+static double burnCpu(long ns) __attribute__((noinline));
+
+
+int test_Profiler()
+{
+	ProfilerStats stats;
+
+	IS_TRUE(-1 == Profiler_start(0));
+	IS_TRUE(-1 == Profiler_start(PROFILER_HZ_MAX + 1));
+	IS_TRUE(-1 == Profiler_stop(&stats));
+	IS_FALSE(Profiler_isRunning());
+
+	IS_TRUE(0 == Profiler_start(HZ));
+	IS_TRUE(Profiler_isRunning());
+	IS_TRUE(-1 == Profiler_start(HZ));
+
+	// Not while running
+	IS_TRUE(-1 == Profiler_dump(stdout));
+
+	IS_TRUE(burnCpu(BURN_NS) > 0.0);
+
+	IS_TRUE(0 == Profiler_stop(&stats));
+	IS_FALSE(Profiler_isRunning());
+
+	// Up to one sample per millisecond of CPU time (of this thread, with others idle), or one per kernel tick
+	EQUALS(stats.hz, HZ);
+	IS_TRUE(stats.threads >= 1);
+	IS_TRUE(stats.samples >= 20);
+	IS_TRUE(stats.dropped < stats.samples / 10);
+
+	FILE* f = tmpfile();
+	IS_TRUE(f != 0);
+
+	const int lines = Profiler_dump(f);
+	IS_TRUE(lines >= 1);
+
+	// The test function's stacks, from the main thread, outermost frame first
+	rewind(f);
+	char line[8192];
+	unsigned long burnSamples = 0;
+	int readLines = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		readLines++;
+
+		char* count = strrchr(line, ' ');
+		IS_TRUE(count != 0);
+
+		if (0 == strncmp(line, "tick;", 5) && strstr(line, ";burnCpu") && strstr(line, "test_Profiler;"))
+		{
+			IS_TRUE(strstr(line, "test_Profiler;") < strstr(line, ";burnCpu"));
+			burnSamples += strtoul(count + 1, 0, 10);
+		}
+	}
+	fclose(f);
+
+	EQUALS(readLines, lines);
+	IS_TRUE(burnSamples >= stats.samples / 2);
+
+	// Started again, with the previous profile discarded
+	IS_TRUE(0 == Profiler_start(PROFILER_HZ_DEFAULT));
+	IS_TRUE(0 == Profiler_stop(&stats));
+	IS_TRUE(stats.samples < 20);
+
+	return 0;
+}
+
+
+static double burnCpu(long ns)
+{
+	struct timespec t0;
+	struct timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+
+	volatile double x = 1.0;
+
+	do
+	{
+		for (int i = 0; i < 10000; i++)
+		{
+			x = x * 1.0000001 + 0.5;
+		}
+
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	}
+	while ((t.tv_sec - t0.tv_sec) * 1000000000L + (t.tv_nsec - t0.tv_nsec) < ns);
+
+	return x;
+}
@@ -0,0 +1,186 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Proximity.h"
+
+
+#define EARTH_RADIUS (6371000.0)
+
+#define RANDOM_POINT_COUNT (2000)
+
+
+static double haversine(const ProximityPoint* p, const ProximityPoint* q);
+static int countBruteForce(const ProximityPoint* points, unsigned int count, double radius);
+static bool hasPair(const ProximityPair* pairs, unsigned int pairCount, unsigned int a, unsigned int b);
+static int checkAgainstBruteForce(const ProximityPoint* points, unsigned int count, double radius);
+
+
+int test_Proximity()
+{
+	ProximityPair* pairs;
+	unsigned int pairCount;
+
+
+	// Trivial cases
+	IS_TRUE(0 == Proximity_findPairs(0, 0, 100.0, &pairs, &pairCount));
+	IS_TRUE(pairCount == 0 && pairs == 0);
+
+	{
+		const ProximityPoint one[] = { { 44.0, -63.0, 1 } };
+		IS_TRUE(0 == Proximity_findPairs(one, 1, 100.0, &pairs, &pairCount));
+		IS_TRUE(pairCount == 0);
+	}
+
+
+	// Only boats in the same group are paired, and distances are great circle distances.
+	{
+		const ProximityPoint points[] = {
+			{ 44.0, -63.0, 1 },
+			{ 44.0005, -63.0, 1 },	// ~56 m north of point 0
+			{ 44.0, -63.0, 2 },	// Same position as point 0, but different group
+			{ 44.01, -63.0, 1 }	// ~1.1 km north of point 0
+		};
+
+		IS_TRUE(0 == Proximity_findPairs(points, 4, 100.0, &pairs, &pairCount));
+		IS_TRUE(pairCount == 1);
+		IS_TRUE(hasPair(pairs, pairCount, 0, 1));
+		IS_TRUE(fabs(pairs[0].distance - haversine(points + 0, points + 1)) < 0.01);
+		free(pairs);
+
+		IS_TRUE(0 == Proximity_findPairs(points, 4, 2000.0, &pairs, &pairCount));
+		IS_TRUE(pairCount == 3);
+		IS_TRUE(hasPair(pairs, pairCount, 0, 1));
+		IS_TRUE(hasPair(pairs, pairCount, 0, 3));
+		IS_TRUE(hasPair(pairs, pairCount, 1, 3));
+		free(pairs);
+	}
+
+
+	// Across the antimeridian and near the poles
+	{
+		const ProximityPoint points[] = {
+			{ 10.0, 179.9995, 1 },
+			{ 10.0, -179.9995, 1 },	// ~110 m east of point 0
+			{ 89.9999, 0.0, 1 },
+			{ 89.9999, 180.0, 1 },	// ~22 m from point 2, across the pole
+			{ -90.0, 0.0, 1 },
+			{ -90.0, 90.0, 1 }	// Same point as point 4
+		};
+
+		IS_TRUE(0 == Proximity_findPairs(points, 6, 150.0, &pairs, &pairCount));
+		IS_TRUE(pairCount == 3);
+		IS_TRUE(hasPair(pairs, pairCount, 0, 1));
+		IS_TRUE(hasPair(pairs, pairCount, 2, 3));
+		IS_TRUE(hasPair(pairs, pairCount, 4, 5));
+		free(pairs);
+	}
+
+
+	// Random points (in a few groups) match a brute force search, for several radii.
+	{
+		ProximityPoint* points = malloc(RANDOM_POINT_COUNT * sizeof(ProximityPoint));
+		IS_TRUE(points != 0);
+
+		srand(104);
+
+		for (int i = 0; i < RANDOM_POINT_COUNT; i++)
+		{
+			points[i].lat = 44.0 + 0.05 * (rand() / (double) RAND_MAX);
+			points[i].lon = -63.0 + 0.05 * (rand() / (double) RAND_MAX);
+			points[i].groupKey = rand() % 3;
+		}
+
+		IS_TRUE(0 == checkAgainstBruteForce(points, RANDOM_POINT_COUNT, 10.0));
+		IS_TRUE(0 == checkAgainstBruteForce(points, RANDOM_POINT_COUNT, 100.0));
+		IS_TRUE(0 == checkAgainstBruteForce(points, RANDOM_POINT_COUNT, 500.0));
+
+		free(points);
+	}
+
+
+	return 0;
+}
+
+
+static double haversine(const ProximityPoint* p, const ProximityPoint* q)
+{
+	const double lat1 = p->lat * M_PI / 180.0;
+	const double lat2 = q->lat * M_PI / 180.0;
+	const double dLat = lat2 - lat1;
+	const double dLon = (q->lon - p->lon) * M_PI / 180.0;
+
+	const double a = sin(dLat / 2.0) * sin(dLat / 2.0) + cos(lat1) * cos(lat2) * sin(dLon / 2.0) * sin(dLon / 2.0);
+	return 2.0 * EARTH_RADIUS * asin(sqrt(a));
+}
+
+static int countBruteForce(const ProximityPoint* points, unsigned int count, double radius)
+{
+	int n = 0;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		for (unsigned int j = i + 1; j < count; j++)
+		{
+			if (points[i].groupKey == points[j].groupKey && haversine(points + i, points + j) <= radius)
+			{
+				n++;
+			}
+		}
+	}
+
+	return n;
+}
+
+static bool hasPair(const ProximityPair* pairs, unsigned int pairCount, unsigned int a, unsigned int b)
+{
+	for (unsigned int i = 0; i < pairCount; i++)
+	{
+		if (pairs[i].a == a && pairs[i].b == b)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int checkAgainstBruteForce(const ProximityPoint* points, unsigned int count, double radius)
+{
+	ProximityPair* pairs;
+	unsigned int pairCount;
+
+	IS_TRUE(0 == Proximity_findPairs(points, count, radius, &pairs, &pairCount));
+	IS_TRUE((int) pairCount == countBruteForce(points, count, radius));
+
+	for (unsigned int i = 0; i < pairCount; i++)
+	{
+		IS_TRUE(pairs[i].a < pairs[i].b);
+		IS_TRUE(points[pairs[i].a].groupKey == points[pairs[i].b].groupKey);
+		IS_TRUE(fabs(pairs[i].distance - haversine(points + pairs[i].a, points + pairs[i].b)) < 0.01);
+		IS_TRUE(pairs[i].distance <= radius + 0.01);
+	}
+
+	free(pairs);
+	return 0;
+}
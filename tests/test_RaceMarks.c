@@ -0,0 +1,154 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "RaceMarks.h"
+
+
+static proteus_GeoPos pos(double lat, double lon);
+
+
+int test_RaceMarks()
+{
+	proteus_GeoPos a, b, p1, p2;
+
+
+	// Segment crossing
+	p1 = pos(44.0, -63.01);
+	p2 = pos(44.0, -62.99);
+
+	a = pos(43.9999, -63.0);
+	b = pos(44.0003, -63.0);
+	IS_TRUE(fabs(RaceMarks_segmentCrossing(&a, &b, &p1, &p2) - 0.25) < 0.000001);
+
+	// Not reaching the line, past the end of the line, or parallel
+	b = pos(43.99995, -63.0);
+	IS_TRUE(RaceMarks_segmentCrossing(&a, &b, &p1, &p2) < 0.0);
+
+	a = pos(43.9999, -62.98);
+	b = pos(44.0003, -62.98);
+	IS_TRUE(RaceMarks_segmentCrossing(&a, &b, &p1, &p2) < 0.0);
+
+	a = pos(44.0, -63.0);
+	b = pos(44.0, -62.995);
+	IS_TRUE(RaceMarks_segmentCrossing(&a, &b, &p1, &p2) < 0.0);
+
+	// Ending exactly on the line counts, but starting on it does not (so it's only counted once).
+	a = pos(43.9999, -63.0);
+	b = pos(44.0, -63.0);
+	IS_TRUE(fabs(RaceMarks_segmentCrossing(&a, &b, &p1, &p2) - 1.0) < 0.000001);
+	IS_TRUE(RaceMarks_segmentCrossing(&b, &a, &p1, &p2) < 0.0);
+
+	// Across the antimeridian
+	p1 = pos(10.0, 179.99);
+	p2 = pos(10.01, -179.99);
+	a = pos(10.01, 179.999);
+	b = pos(10.0, -179.999);
+	IS_TRUE(RaceMarks_segmentCrossing(&a, &b, &p1, &p2) > 0.0);
+
+
+	// Marks and crossing events
+	unsigned int evCount;
+	BoatEventEntry* events;
+
+	IS_TRUE(!RaceMarks_hasMarks());
+
+	p1 = pos(44.0, -63.01);
+	p2 = pos(44.0, -62.99);
+	IS_TRUE(0 == RaceMarks_add("Race1", "Finish", RACEMARK_TYPE_FINISH, &p1, &p2));
+	IS_TRUE(RaceMarks_hasMarks());
+
+	p1 = pos(45.0, -63.01);
+	p2 = pos(45.0, -62.99);
+	IS_TRUE(0 == RaceMarks_add("Race1", "Gate1", RACEMARK_TYPE_GATE, &p1, &p2));
+
+	// Invalid type, or line too long
+	IS_TRUE(0 != RaceMarks_add("Race1", "Bad", 7, &p1, &p2));
+	p2 = pos(45.0, -61.0);
+	IS_TRUE(0 != RaceMarks_add("Race1", "Bad", RACEMARK_TYPE_GATE, &p1, &p2));
+
+	a = pos(43.9999, -63.0);
+	b = pos(44.0003, -63.0);
+
+	RaceMarks_checkCrossings("Boat1", "Race1", &a, &b, 1000);
+	RaceMarks_checkCrossings("Boat2", "Race2", &a, &b, 1000); // Different race, so no crossing
+	RaceMarks_checkCrossings("Boat3", "Race1", &b, &a, 1001); // Crossing in the other direction also counts
+
+	events = RaceMarks_takeEvents(&evCount);
+	IS_TRUE(evCount == 2);
+	IS_TRUE(strcmp(events[0].boatName, "Boat1") == 0);
+	IS_TRUE(strcmp(events[0].ref, "Finish") == 0);
+	IS_TRUE(events[0].type == BOAT_EVENT_FINISH_CROSSING);
+	IS_TRUE(events[0].time == 999);
+	IS_TRUE(fabs(events[0].value - 999.25) < 0.000001);
+	IS_TRUE(strcmp(events[1].boatName, "Boat3") == 0);
+	IS_TRUE(events[1].time == 1000);
+	IS_TRUE(fabs(events[1].value - 1000.75) < 0.000001);
+	Logger_freeEvents(events, evCount);
+
+	events = RaceMarks_takeEvents(&evCount);
+	IS_TRUE(evCount == 0);
+
+	// Gate, far from the finish line (in another grid cell)
+	a = pos(44.9999, -63.0);
+	b = pos(45.0001, -63.0);
+	RaceMarks_checkCrossings("Boat1", "Race1", &a, &b, 1002);
+
+	events = RaceMarks_takeEvents(&evCount);
+	IS_TRUE(evCount == 1);
+	IS_TRUE(events[0].type == BOAT_EVENT_GATE_CROSSING);
+	IS_TRUE(strcmp(events[0].ref, "Gate1") == 0);
+	Logger_freeEvents(events, evCount);
+
+	// Replaced (moved) mark
+	p1 = pos(46.0, -63.01);
+	p2 = pos(46.0, -62.99);
+	IS_TRUE(0 == RaceMarks_add("Race1", "Gate1", RACEMARK_TYPE_GATE, &p1, &p2));
+	RaceMarks_checkCrossings("Boat1", "Race1", &a, &b, 1003);
+	events = RaceMarks_takeEvents(&evCount);
+	IS_TRUE(evCount == 0);
+
+	// Removed marks
+	IS_TRUE(0 == RaceMarks_remove("Race1", "Finish"));
+	IS_TRUE(0 != RaceMarks_remove("Race1", "Finish"));
+	IS_TRUE(0 == RaceMarks_remove("Race1", "Gate1"));
+	IS_TRUE(!RaceMarks_hasMarks());
+
+	a = pos(43.9999, -63.0);
+	b = pos(44.0003, -63.0);
+	RaceMarks_checkCrossings("Boat1", "Race1", &a, &b, 1004);
+	events = RaceMarks_takeEvents(&evCount);
+	IS_TRUE(evCount == 0);
+
+
+	return 0;
+}
+
+
+static proteus_GeoPos pos(double lat, double lon)
+{
+	proteus_GeoPos p;
+	p.lat = lat;
+	p.lon = lon;
+	return p;
+}
@@ -0,0 +1,290 @@
+/**
+ * Copyright (C) 2023 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sailnavsim_boatregistry.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "BoatRegistry.h"
+#include "Replication.h"
+
+
+#define MAX_IDS (64)
+
+
+// Replica-side state kept by the test apply functions
+typedef struct
+{
+	bool used[MAX_IDS];
+	char* name[MAX_IDS];
+	char* group[MAX_IDS];
+	char* altName[MAX_IDS];
+	Boat boat[MAX_IDS];
+	unsigned int count;
+} TestReplica;
+
+
+static void testReset(void* ctx);
+static int testAdd(void* ctx, uint32_t id, const char* name, const char* group, const char* altName, const Boat* boat);
+static Boat* testGet(void* ctx, uint32_t id);
+static int testRemove(void* ctx, uint32_t id);
+
+static const ReplicationApplyFuncs TEST_FUNCS = {
+	&testReset,
+	&testAdd,
+	&testGet,
+	&testRemove
+};
+
+static Boat* newBoat(double lat, double lon);
+static int applyAll(const ReplicationBuf* buf, TestReplica* replica, ReplicationFrameInfo* info);
+static bool matchesRegistry(const TestReplica* replica);
+static bool strEq(const char* a, const char* b);
+
+
+int test_Replication()
+{
+	TestReplica replica;
+	TestReplica restarted;
+	ReplicationBuf buf;
+	ReplicationFrameInfo info;
+
+	memset(&replica, 0, sizeof(TestReplica));
+	memset(&restarted, 0, sizeof(TestReplica));
+	memset(&buf, 0, sizeof(ReplicationBuf));
+
+	IS_TRUE(0 == BoatRegistry_init());
+	Replication_resetPrimaryState();
+
+
+	// First delta contains all boats.
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(newBoat(10.0, 20.0), "BoatA", 0, 0));
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(newBoat(11.0, 21.0), "BoatB", "GroupX", "Boat B"));
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(newBoat(12.0, 22.0), "BoatC", "GroupX", 0));
+
+	IS_TRUE(0 == Replication_encodeDelta(1000, &buf));
+	IS_TRUE(0 == applyAll(&buf, &replica, &info));
+	IS_TRUE(!info.snapshot);
+	IS_TRUE(1000 == info.tickTime);
+	IS_TRUE(info.publishTimeNs > 0);
+	IS_TRUE(3 == info.recordCount);
+	IS_TRUE(3 == replica.count);
+	IS_TRUE(matchesRegistry(&replica));
+
+
+	// Nothing changed, so empty delta.
+	ReplicationBuf_free(&buf);
+	IS_TRUE(0 == Replication_encodeDelta(1001, &buf));
+	IS_TRUE(0 == applyAll(&buf, &replica, &info));
+	IS_TRUE(0 == info.recordCount);
+	const size_t emptyFrameLen = buf.len;
+
+
+	// Only changed fields are sent.
+	ReplicationBuf_free(&buf);
+	Boat* a = BoatRegistry_get("BoatA");
+	a->pos.lat = 10.5;
+	IS_TRUE(0 == Replication_encodeDelta(1002, &buf));
+	IS_TRUE(emptyFrameLen + 1 + 4 + 1 + 16 == buf.len);
+	IS_TRUE(0 == applyAll(&buf, &replica, &info));
+	IS_TRUE(1 == info.recordCount);
+	IS_TRUE(matchesRegistry(&replica));
+
+
+	// Adds, removes and changes together.
+	ReplicationBuf_free(&buf);
+	Boat_free(BoatRegistry_remove("BoatB"));
+	IS_TRUE(BoatRegistry_OK == BoatRegistry_add(newBoat(13.0, 23.0), "BoatD", "GroupY", "Boat D"));
+	Boat* c = BoatRegistry_get("BoatC");
+	c->stop = false;
+	c->v.mag = 3.5;
+	c->distanceTravelled = 100.0;
+
+	IS_TRUE(0 == Replication_encodeDelta(1003, &buf));
+	IS_TRUE(0 == applyAll(&buf, &replica, &info));
+	IS_TRUE(3 == info.recordCount);
+	IS_TRUE(3 == replica.count);
+	IS_TRUE(matchesRegistry(&replica));
+
+
+	// Replica (re)starting from a snapshot catches up to the same state, and then follows deltas.
+	ReplicationBuf_free(&buf);
+	testAdd(&restarted, MAX_IDS - 1, "StaleBoat", 0, 0, a);
+
+	IS_TRUE(0 == Replication_encodeSnapshot(1003, &buf));
+	IS_TRUE(0 == applyAll(&buf, &restarted, &info));
+	IS_TRUE(info.snapshot);
+	IS_TRUE(3 == restarted.count);
+	IS_TRUE(matchesRegistry(&restarted));
+
+	ReplicationBuf_free(&buf);
+	c->pos.lon = 22.5;
+	Boat_free(BoatRegistry_remove("BoatA"));
+
+	IS_TRUE(0 == Replication_encodeDelta(1004, &buf));
+	IS_TRUE(0 == applyAll(&buf, &restarted, &info));
+	IS_TRUE(0 == applyAll(&buf, &replica, &info));
+	IS_TRUE(2 == restarted.count);
+	IS_TRUE(matchesRegistry(&restarted));
+	IS_TRUE(matchesRegistry(&replica));
+
+
+	// Truncated or corrupt frames are rejected.
+	IS_TRUE(0 != Replication_applyFrame(buf.data + 4, buf.len - 5, &TEST_FUNCS, &replica, &info));
+	buf.data[4 + 1 + 8 + 8 + 4] = 0x7f;
+	IS_TRUE(0 != Replication_applyFrame(buf.data + 4, buf.len - 4, &TEST_FUNCS, &replica, &info));
+
+
+	// Clean up.
+	ReplicationBuf_free(&buf);
+	Boat_free(BoatRegistry_remove("BoatC"));
+	Boat_free(BoatRegistry_remove("BoatD"));
+	IS_TRUE(0 == Replication_encodeDelta(1005, &buf));
+	IS_TRUE(0 == applyAll(&buf, &replica, &info));
+	IS_TRUE(0 == replica.count);
+
+	ReplicationBuf_free(&buf);
+	testReset(&restarted);
+	Replication_resetPrimaryState();
+	BoatRegistry_destroy();
+
+	return 0;
+}
+
+
+static void testReset(void* ctx)
+{
+	TestReplica* r = ctx;
+
+	for (uint32_t id = 0; id < MAX_IDS; id++)
+	{
+		if (r->used[id])
+		{
+			testRemove(ctx, id);
+		}
+	}
+}
+
+static int testAdd(void* ctx, uint32_t id, const char* name, const char* group, const char* altName, const Boat* boat)
+{
+	TestReplica* r = ctx;
+
+	if (id >= MAX_IDS || r->used[id])
+	{
+		return -1;
+	}
+
+	r->used[id] = true;
+	r->name[id] = strdup(name);
+	r->group[id] = (group ? strdup(group) : 0);
+	r->altName[id] = (altName ? strdup(altName) : 0);
+	r->boat[id] = *boat;
+	r->count++;
+
+	return 0;
+}
+
+static Boat* testGet(void* ctx, uint32_t id)
+{
+	TestReplica* r = ctx;
+	return (id < MAX_IDS && r->used[id]) ? r->boat + id : 0;
+}
+
+static int testRemove(void* ctx, uint32_t id)
+{
+	TestReplica* r = ctx;
+
+	if (id >= MAX_IDS || !r->used[id])
+	{
+		return -1;
+	}
+
+	free(r->name[id]);
+	free(r->group[id]);
+	free(r->altName[id]);
+	r->used[id] = false;
+	r->count--;
+
+	return 0;
+}
+
+
+static Boat* newBoat(double lat, double lon)
+{
+	Boat* b = Boat_new(0.0, 0.0, 0, 0);
+	memset(b, 0, sizeof(Boat));
+
+	b->pos.lat = lat;
+	b->pos.lon = lon;
+	b->desiredCourse = 90.0;
+	b->boatType = 3;
+	b->boatFlags = 0x0012;
+	b->stop = true;
+
+	return b;
+}
+
+static int applyAll(const ReplicationBuf* buf, TestReplica* replica, ReplicationFrameInfo* info)
+{
+	uint32_t len;
+	memcpy(&len, buf->data, 4);
+
+	if (len + 4 != buf->len)
+	{
+		return -1;
+	}
+
+	return Replication_applyFrame(buf->data + 4, len, &TEST_FUNCS, replica, info);
+}
+
+static bool matchesRegistry(const TestReplica* replica)
+{
+	unsigned int boatCount;
+	void* iterator = sailnavsim_boatregistry_get_boats_iterator(BoatRegistry_registry(), &boatCount);
+
+	bool ok = (boatCount == replica->count);
+
+	const BoatEntry* e;
+	while (ok && (e = sailnavsim_boatregistry_boats_iterator_get_next(iterator)) != 0)
+	{
+		bool found = false;
+
+		for (uint32_t id = 0; id < MAX_IDS; id++)
+		{
+			if (replica->used[id] && strcmp(replica->name[id], e->name) == 0)
+			{
+				found = strEq(replica->group[id], e->group) &&
+					strEq(replica->altName[id], e->altName) &&
+					memcmp(replica->boat + id, e->boat, sizeof(Boat)) == 0;
+				break;
+			}
+		}
+
+		ok = found;
+	}
+
+	sailnavsim_boatregistry_free_boats_iterator(iterator);
+	return ok;
+}
+
+static bool strEq(const char* a, const char* b)
+{
+	return (!a || !b) ? (a == b) : (strcmp(a, b) == 0);
+}
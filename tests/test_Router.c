@@ -0,0 +1,363 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Router.h"
+#include "Shard.h"
+
+
+#define SHARD_COUNT (2)
+#define FAKE_SHARD_MAX_BOATS (4)
+#define FAKE_SHARD_LINE_SIZE (1024)
+
+
+// Stands in for a shard process's NetServer: answers boat data requests and takes boat commands, like a shard would,
+// for the boats it's been given.
+typedef struct
+{
+	int listenFd;
+
+	pthread_mutex_t lock;
+	const char* boats[FAKE_SHARD_MAX_BOATS];
+	unsigned int boatCount;
+
+	// Boat commands taken, and the last one
+	unsigned int cmdCount;
+	char lastCmd[FAKE_SHARD_LINE_SIZE];
+} FakeShard;
+
+
+static int startFakeShard(FakeShard* shard, const char* path);
+static void* fakeShardThreadMain(void* arg);
+static void fakeShardRespond(FakeShard* shard, int fd, char* line);
+static bool fakeShardHasBoat(FakeShard* shard, const char* name);
+static void fakeShardAddBoat(FakeShard* shard, const char* name);
+static unsigned int fakeShardCmdCount(FakeShard* shard);
+static int request(const char* reqStr, char* resp, size_t respSize);
+
+static FakeShard _shards[SHARD_COUNT];
+
+
+int test_Router()
+{
+	char prefix[64];
+	snprintf(prefix, sizeof(prefix), "/tmp/sailnavsim_test_router_%d_", (int) getpid());
+
+	for (unsigned int i = 0; i < SHARD_COUNT; i++)
+	{
+		char path[80];
+		snprintf(path, sizeof(path), "%s%u", prefix, i);
+		IS_TRUE(0 == startFakeShard(_shards + i, path));
+	}
+
+	IS_TRUE(0 == Router_init(SHARD_COUNT, prefix, 0));
+
+	char resp[256];
+	unsigned int counts[SHARD_COUNT];
+
+
+	// Stale cache: added (so cached) on its owner by name, but the boat is with the other shard (e.g. since re-added
+	// in a group owned there). The command must reach the shard with the boat, not just be acked by the cached one.
+	const unsigned int owner = Shard_ownerOf("StaleBoat", 0, SHARD_COUNT);
+	const unsigned int other = (owner + 1) % SHARD_COUNT;
+
+	IS_TRUE(0 == request("boatcmd,StaleBoat,add,44.0,-63.0,0,0", resp, sizeof(resp)));
+	IS_TRUE(strcmp(resp, "boatcmd,ok\n") == 0);
+	fakeShardAddBoat(_shards + other, "StaleBoat");
+
+	counts[other] = fakeShardCmdCount(_shards + other);
+	IS_TRUE(0 == request("boatcmd,#t1,StaleBoat,course,90", resp, sizeof(resp)));
+	IS_TRUE(strcmp(resp, "boatcmd,ok,t1\n") == 0);
+	EQUALS(fakeShardCmdCount(_shards + other), counts[other] + 1);
+	IS_TRUE(strcmp(_shards[other].lastCmd, "boatcmd,#t1,StaleBoat,course,90") == 0);
+
+	// Likewise for sync commands, answered by the shard with the boat.
+	IS_TRUE(0 == request("boatcmd,StaleBoat,add,44.0,-63.0,0,0", resp, sizeof(resp)));
+	IS_TRUE(0 == request("boatcmd_sync,StaleBoat,start", resp, sizeof(resp)));
+	IS_TRUE(strcmp(resp, "boatcmd_sync,ok,1\n") == 0);
+	IS_TRUE(strcmp(_shards[other].lastCmd, "boatcmd_sync,StaleBoat,start") == 0);
+
+
+	// Cached owner that has the boat: the command only goes there.
+	const unsigned int boatOwner = Shard_ownerOf("OwnedBoat", 0, SHARD_COUNT);
+	const unsigned int notOwner = (boatOwner + 1) % SHARD_COUNT;
+
+	IS_TRUE(0 == request("boatcmd,OwnedBoat,add,44.0,-63.0,0,0", resp, sizeof(resp)));
+	fakeShardAddBoat(_shards + boatOwner, "OwnedBoat");
+
+	counts[boatOwner] = fakeShardCmdCount(_shards + boatOwner);
+	counts[notOwner] = fakeShardCmdCount(_shards + notOwner);
+	IS_TRUE(0 == request("boatcmd,OwnedBoat,stop", resp, sizeof(resp)));
+	IS_TRUE(strcmp(resp, "boatcmd,ok\n") == 0);
+	EQUALS(fakeShardCmdCount(_shards + boatOwner), counts[boatOwner] + 1);
+	EQUALS(fakeShardCmdCount(_shards + notOwner), counts[notOwner]);
+
+
+	// Same name added in two groups owned by different shards: both may have the boat, so commands go to both.
+	char groupA[32];
+	char groupB[32];
+	strcpy(groupA, "RouterGroup0");
+	for (unsigned int i = 1; ; i++)
+	{
+		snprintf(groupB, sizeof(groupB), "RouterGroup%u", i);
+		if (Shard_ownerOf("GroupBoat", groupB, SHARD_COUNT) != Shard_ownerOf("GroupBoat", groupA, SHARD_COUNT))
+		{
+			break;
+		}
+	}
+
+	const unsigned int ownerA = Shard_ownerOf("GroupBoat", groupA, SHARD_COUNT);
+	const unsigned int ownerB = Shard_ownerOf("GroupBoat", groupB, SHARD_COUNT);
+
+	char req[128];
+	snprintf(req, sizeof(req), "boatcmd,GroupBoat,add_g,44.0,-63.0,0,0,%s,Alt", groupA);
+	IS_TRUE(0 == request(req, resp, sizeof(resp)));
+	fakeShardAddBoat(_shards + ownerA, "GroupBoat");
+	snprintf(req, sizeof(req), "boatcmd,GroupBoat,add_g,44.0,-63.0,0,0,%s,Alt", groupB);
+	IS_TRUE(0 == request(req, resp, sizeof(resp)));
+	fakeShardAddBoat(_shards + ownerB, "GroupBoat");
+
+	counts[ownerA] = fakeShardCmdCount(_shards + ownerA);
+	counts[ownerB] = fakeShardCmdCount(_shards + ownerB);
+	IS_TRUE(0 == request("boatcmd,GroupBoat,course,180", resp, sizeof(resp)));
+	IS_TRUE(strcmp(resp, "boatcmd,ok\n") == 0);
+	EQUALS(fakeShardCmdCount(_shards + ownerA), counts[ownerA] + 1);
+	EQUALS(fakeShardCmdCount(_shards + ownerB), counts[ownerB] + 1);
+
+	// Once removed and added again in one group, only that group's shard is sent commands.
+	IS_TRUE(0 == request("boatcmd,GroupBoat,remove", resp, sizeof(resp)));
+	IS_TRUE(0 == request(req, resp, sizeof(resp)));
+
+	counts[ownerA] = fakeShardCmdCount(_shards + ownerA);
+	counts[ownerB] = fakeShardCmdCount(_shards + ownerB);
+	IS_TRUE(0 == request("boatcmd,GroupBoat,course,270", resp, sizeof(resp)));
+	EQUALS(fakeShardCmdCount(_shards + ownerA), counts[ownerA]);
+	EQUALS(fakeShardCmdCount(_shards + ownerB), counts[ownerB] + 1);
+
+
+	for (unsigned int i = 0; i < SHARD_COUNT; i++)
+	{
+		char path[80];
+		snprintf(path, sizeof(path), "%s%u", prefix, i);
+		unlink(path);
+	}
+
+	return 0;
+}
+
+
+static int startFakeShard(FakeShard* shard, const char* path)
+{
+	memset(shard, 0, sizeof(FakeShard));
+	pthread_mutex_init(&shard->lock, 0);
+
+	struct sockaddr_un sa;
+	memset(&sa, 0, sizeof(struct sockaddr_un));
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+	unlink(path);
+
+	if ((shard->listenFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+			0 != bind(shard->listenFd, (struct sockaddr*) &sa, sizeof(struct sockaddr_un)) ||
+			0 != listen(shard->listenFd, 4))
+	{
+		return -1;
+	}
+
+	pthread_t thread;
+	if (0 != pthread_create(&thread, 0, &fakeShardThreadMain, shard))
+	{
+		return -1;
+	}
+
+	pthread_detach(thread);
+
+	return 0;
+}
+
+static void* fakeShardThreadMain(void* arg)
+{
+	FakeShard* shard = arg;
+	char buf[FAKE_SHARD_LINE_SIZE];
+
+	for (;;)
+	{
+		const int fd = accept(shard->listenFd, 0, 0);
+		if (fd < 0)
+		{
+			return 0;
+		}
+
+		size_t n = 0;
+		ssize_t rb;
+		while ((rb = read(fd, buf + n, sizeof(buf) - 1 - n)) > 0)
+		{
+			n += rb;
+			buf[n] = 0;
+
+			char* nl;
+			while ((nl = strchr(buf, '\n')) != 0)
+			{
+				*nl = 0;
+				fakeShardRespond(shard, fd, buf);
+
+				n -= (nl + 1 - buf);
+				memmove(buf, nl + 1, n + 1);
+			}
+		}
+
+		close(fd);
+	}
+
+	return 0;
+}
+
+static void fakeShardRespond(FakeShard* shard, int fd, char* line)
+{
+	char resp[FAKE_SHARD_LINE_SIZE + 64];
+
+	if (strncmp(line, "bd,", 3) == 0)
+	{
+		const char* name = line + 3;
+
+		if (fakeShardHasBoat(shard, name))
+		{
+			snprintf(resp, sizeof(resp), "bd,%s,ok,44.000000,-63.000000,90.0,1.00,90.0,1.00,0.00,0.0\n", name);
+		}
+		else
+		{
+			snprintf(resp, sizeof(resp), "bd,%s,noboat\n", name);
+		}
+	}
+	else if (strncmp(line, "boatcmd_sync,", 13) == 0)
+	{
+		// Answered (and applied) only with the boat
+		char name[FAKE_SHARD_LINE_SIZE];
+		sscanf(line + 13, "%[^,]", name);
+
+		if (fakeShardHasBoat(shard, name))
+		{
+			pthread_mutex_lock(&shard->lock);
+			shard->cmdCount++;
+			strcpy(shard->lastCmd, line);
+			pthread_mutex_unlock(&shard->lock);
+
+			snprintf(resp, sizeof(resp), "boatcmd_sync,ok,1\n");
+		}
+		else
+		{
+			snprintf(resp, sizeof(resp), "boatcmd_sync,noboat,0\n");
+		}
+	}
+	else if (strncmp(line, "boatcmd,", 8) == 0)
+	{
+		// Taken whether or not the boat is here
+		pthread_mutex_lock(&shard->lock);
+		shard->cmdCount++;
+		strcpy(shard->lastCmd, line);
+		pthread_mutex_unlock(&shard->lock);
+
+		const char* token = (line[8] == '#') ? line + 9 : 0;
+		const char* tokenEnd = token ? strchr(token, ',') : 0;
+
+		if (tokenEnd)
+		{
+			snprintf(resp, sizeof(resp), "boatcmd,ok,%.*s\n", (int) (tokenEnd - token), token);
+		}
+		else
+		{
+			snprintf(resp, sizeof(resp), "boatcmd,ok\n");
+		}
+	}
+	else
+	{
+		snprintf(resp, sizeof(resp), "error\n");
+	}
+
+	if (write(fd, resp, strlen(resp)) < 0)
+	{
+		return;
+	}
+}
+
+static bool fakeShardHasBoat(FakeShard* shard, const char* name)
+{
+	bool has = false;
+
+	pthread_mutex_lock(&shard->lock);
+	for (unsigned int i = 0; i < shard->boatCount; i++)
+	{
+		has |= (strcmp(shard->boats[i], name) == 0);
+	}
+	pthread_mutex_unlock(&shard->lock);
+
+	return has;
+}
+
+static void fakeShardAddBoat(FakeShard* shard, const char* name)
+{
+	pthread_mutex_lock(&shard->lock);
+	if (shard->boatCount < FAKE_SHARD_MAX_BOATS)
+	{
+		shard->boats[shard->boatCount++] = name;
+	}
+	pthread_mutex_unlock(&shard->lock);
+}
+
+static unsigned int fakeShardCmdCount(FakeShard* shard)
+{
+	pthread_mutex_lock(&shard->lock);
+	const unsigned int count = shard->cmdCount;
+	pthread_mutex_unlock(&shard->lock);
+
+	return count;
+}
+
+// Has the router handle a request (as a NetServer worker would), returning its response.
+static int request(const char* reqStr, char* resp, size_t respSize)
+{
+	char req[FAKE_SHARD_LINE_SIZE];
+	snprintf(req, sizeof(req), "%s", reqStr);
+
+	int fds[2];
+	if (0 != pipe(fds))
+	{
+		return -1;
+	}
+
+	Router_handleRequest(fds[1], req);
+	close(fds[1]);
+
+	const ssize_t rb = read(fds[0], resp, respSize - 1);
+	close(fds[0]);
+
+	if (rb <= 0)
+	{
+		return -1;
+	}
+
+	resp[rb] = 0;
+	return 0;
+}
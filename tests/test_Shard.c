@@ -0,0 +1,100 @@
+/**
+ * Copyright (C) 2023 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Shard.h"
+
+
+#define BALANCE_BOAT_COUNT (100000)
+#define BALANCE_SHARD_COUNT (8)
+
+
+int test_Shard()
+{
+	unsigned int idx;
+	unsigned int count;
+
+
+	// Spec parsing
+	IS_TRUE(0 == Shard_parseSpec("0/1", &idx, &count));
+	IS_TRUE(idx == 0 && count == 1);
+
+	IS_TRUE(0 == Shard_parseSpec("3/4", &idx, &count));
+	IS_TRUE(idx == 3 && count == 4);
+
+	IS_TRUE(-1 == Shard_parseSpec("", &idx, &count));
+	IS_TRUE(-1 == Shard_parseSpec("3", &idx, &count));
+	IS_TRUE(-1 == Shard_parseSpec("3/", &idx, &count));
+	IS_TRUE(-1 == Shard_parseSpec("3/4x", &idx, &count));
+	IS_TRUE(-2 == Shard_parseSpec("4/4", &idx, &count));
+	IS_TRUE(-2 == Shard_parseSpec("0/0", &idx, &count));
+	IS_TRUE(-2 == Shard_parseSpec("-1/4", &idx, &count));
+	IS_TRUE(-2 == Shard_parseSpec("0/256", &idx, &count));
+
+
+	// Hash is FNV-1a, so stable across processes and builds.
+	IS_TRUE(0xcbf29ce484222325UL == Shard_hash(""));
+	IS_TRUE(0xaf63dc4c8601ec8cUL == Shard_hash("a"));
+
+
+	// Single shard owns everything.
+	IS_TRUE(0 == Shard_ownerOf("TestBoat", 0, 1));
+	IS_TRUE(Shard_isOwner("TestBoat", "TestGroup", 0, 1));
+
+
+	// Boats in the same group are always on the same shard.
+	{
+		const unsigned int owner = Shard_ownerOf("TestBoat0", "TestGroup", BALANCE_SHARD_COUNT);
+		char name[32];
+
+		for (int i = 1; i < 1000; i++)
+		{
+			snprintf(name, sizeof(name), "TestBoat%d", i);
+			IS_TRUE(owner == Shard_ownerOf(name, "TestGroup", BALANCE_SHARD_COUNT));
+			IS_TRUE(Shard_isOwner(name, "TestGroup", owner, BALANCE_SHARD_COUNT));
+		}
+	}
+
+
+	// Ungrouped boats are spread (roughly) evenly across shards.
+	{
+		unsigned int counts[BALANCE_SHARD_COUNT] = { 0 };
+		char name[32];
+
+		for (int i = 0; i < BALANCE_BOAT_COUNT; i++)
+		{
+			snprintf(name, sizeof(name), "TestBoat%d", i);
+
+			const unsigned int owner = Shard_ownerOf(name, 0, BALANCE_SHARD_COUNT);
+			IS_TRUE(owner < BALANCE_SHARD_COUNT);
+			counts[owner]++;
+		}
+
+		const unsigned int expected = BALANCE_BOAT_COUNT / BALANCE_SHARD_COUNT;
+		for (int i = 0; i < BALANCE_SHARD_COUNT; i++)
+		{
+			IS_TRUE(counts[i] > expected * 9 / 10);
+			IS_TRUE(counts[i] < expected * 11 / 10);
+		}
+	}
+
+
+	return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+#include "test_env.h"
+
+#include "SimCore.h"
+
+
+#define BOAT_COUNT (16)
+#define THREAD_COUNT (4)
+#define STEP_SECONDS (600)
+#define START_TIME (1700000000)
+
+
+typedef struct
+{
+	Boat boats[BOAT_COUNT];
+	unsigned int randSeed;
+} ThreadArg;
+
+static void initBoats(Boat* boats);
+static bool sameState(const Boat* a, const Boat* b);
+static void* threadMain(void* arg);
+
+
+int test_SimCore()
+{
+	IS_TRUE(0 == SimCore_init());
+
+	Boat boats[BOAT_COUNT];
+	initBoats(boats);
+
+	unsigned int seed = 44;
+	SimCore_step(boats, BOAT_COUNT, START_TIME, STEP_SECONDS, &TEST_ENV, &seed);
+
+	// Boats heading east and south of east get going, on the environment's wind.
+	IS_TRUE(boats[0].distanceTravelled > 0.0);
+	IS_FALSE(boats[0].stop);
+	IS_TRUE(boats[0].pos.lon > -40.0);
+	IS_TRUE(boats[0].v.mag > 0.0);
+
+	// The boat heading north runs aground.
+	IS_TRUE(boats[BOAT_COUNT - 1].stop);
+	IS_TRUE(boats[BOAT_COUNT - 1].pos.lat < TEST_ENV_COAST_LAT + 0.01);
+
+	// A single boat comes out the same in one step of many seconds as in many one-second steps.
+	Boat one[2];
+	initBoats(boats);
+	one[0] = boats[1];
+	one[1] = boats[1];
+
+	unsigned int seedA = 7;
+	unsigned int seedB = 7;
+	SimCore_step(one, 1, START_TIME, STEP_SECONDS, &TEST_ENV, &seedA);
+	for (unsigned int s = 0; s < STEP_SECONDS; s++)
+	{
+		SimCore_step(one + 1, 1, START_TIME + s, 1, &TEST_ENV, &seedB);
+	}
+	IS_TRUE(sameState(one, one + 1));
+	IS_TRUE(seedA == seedB);
+
+	// Each thread steps its own boats with its own random number state, the same as a single thread.
+	Boat expected[BOAT_COUNT];
+	initBoats(expected);
+	seed = 1;
+	SimCore_step(expected, BOAT_COUNT, START_TIME, STEP_SECONDS, &TEST_ENV, &seed);
+
+	ThreadArg args[THREAD_COUNT];
+	pthread_t threads[THREAD_COUNT];
+	for (unsigned int i = 0; i < THREAD_COUNT; i++)
+	{
+		initBoats(args[i].boats);
+		args[i].randSeed = 1;
+		IS_TRUE(0 == pthread_create(threads + i, 0, &threadMain, args + i));
+	}
+
+	for (unsigned int i = 0; i < THREAD_COUNT; i++)
+	{
+		IS_TRUE(0 == pthread_join(threads[i], 0));
+		IS_TRUE(args[i].randSeed == seed);
+
+		for (unsigned int j = 0; j < BOAT_COUNT; j++)
+		{
+			IS_TRUE(sameState(args[i].boats + j, expected + j));
+		}
+	}
+
+	return 0;
+}
+
+
+static void initBoats(Boat* boats)
+{
+	for (unsigned int i = 0; i < BOAT_COUNT; i++)
+	{
+		Boat* b = boats + i;
+		Boat_initState(b, 45.0, -40.0, i % 2 == 0 ? 4 : 1024 /* advanced */, BOAT_FLAG_TAKES_DAMAGE);
+
+		b->stop = false;
+		b->sailArea = 0.75;
+
+		// Headings from east round to north, with the last one opposite the boat's initial heading (so turning
+		// either way, at random).
+		b->desiredCourse = (i == BOAT_COUNT - 1) ? 0.0 : 90.0 + (i * 80.0 / BOAT_COUNT);
+		if (i == BOAT_COUNT - 1)
+		{
+			b->setImmediateDesiredCourse = false;
+			b->v.angle = 180.0;
+		}
+	}
+}
+
+static bool sameState(const Boat* a, const Boat* b)
+{
+	return a->pos.lat == b->pos.lat &&
+		a->pos.lon == b->pos.lon &&
+		a->v.angle == b->v.angle &&
+		a->v.mag == b->v.mag &&
+		a->vGround.angle == b->vGround.angle &&
+		a->vGround.mag == b->vGround.mag &&
+		a->distanceTravelled == b->distanceTravelled &&
+		a->damage == b->damage &&
+		a->leewaySpeed == b->leewaySpeed &&
+		a->heelingAngle == b->heelingAngle &&
+		a->stop == b->stop;
+}
+
+static void* threadMain(void* arg)
+{
+	ThreadArg* a = arg;
+	SimCore_step(a->boats, BOAT_COUNT, START_TIME, STEP_SECONDS, &TEST_ENV, &a->randSeed);
+	return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+
+#include <proteus/GeoPos.h>
+#include <proteus/Weather.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "WindField.h"
+
+
+// Tolerances for values interpolated from the (fixed point, 0.01 m/s) grid values
+#define EPS (0.01)
+#define ANGLE_EPS (0.5)
+
+
+static double testSource(const proteus_GeoPos* pos, proteus_Weather* wx);
+static void testWind(double lat, double lon, proteus_GeoVec* wind);
+static bool near(double a, double b, double eps);
+static bool nearAngle(double a, double b, double eps);
+
+
+int test_WindField()
+{
+	proteus_Weather wx;
+	proteus_GeoVec expected;
+	double gustAngle;
+
+	WindField_destroy();
+
+	// Nothing to sample yet.
+	const proteus_GeoPos p0 = { .lat = 10.0, .lon = 20.0 };
+	IS_FALSE(WindField_get(&p0, &wx, &gustAngle));
+
+	for (int r = 0; r < 2; r++)
+	{
+		const double res = (r == 0) ? 1.0 : 0.5;
+		IS_TRUE(0 == WindField_build(res, &testSource));
+
+		// Wind components are linear in position (away from the antimeridian), so interpolation is exact (to the grid
+		// precision), at grid points or between them.
+		const proteus_GeoPos POSITIONS[] = {
+			{ .lat = 10.0, .lon = 20.0 },
+			{ .lat = 10.25, .lon = 20.75 },
+			{ .lat = -45.3, .lon = -120.1 },
+			{ .lat = 0.0, .lon = 0.0 },
+			{ .lat = 89.9, .lon = 179.0 },
+			{ .lat = 90.0, .lon = -179.0 },
+			{ .lat = -90.0, .lon = 100.0 }
+		};
+
+		for (unsigned int i = 0; i < sizeof(POSITIONS) / sizeof(proteus_GeoPos); i++)
+		{
+			const proteus_GeoPos* pos = POSITIONS + i;
+
+			IS_TRUE(WindField_get(pos, &wx, &gustAngle));
+			testWind(pos->lat, pos->lon, &expected);
+
+			IS_TRUE(near(expected.mag, wx.wind.mag, EPS));
+			IS_TRUE(nearAngle(expected.angle, wx.wind.angle, ANGLE_EPS));
+			IS_TRUE(near(expected.mag * 1.5, wx.windGust, EPS));
+			IS_TRUE(nearAngle(expected.angle, gustAngle, ANGLE_EPS));
+		}
+
+		// Longitude wraps around (180 is -180), and samples across the antimeridian are between the values either side.
+		const proteus_GeoPos west = { .lat = 30.0, .lon = -180.0 };
+		const proteus_GeoPos east = { .lat = 30.0, .lon = 180.0 };
+		const proteus_GeoPos across = { .lat = 30.0, .lon = 180.0 - res / 2.0 };
+		const proteus_GeoPos beyond = { .lat = 30.0, .lon = 190.0 };
+		proteus_Weather wx2;
+
+		IS_TRUE(WindField_get(&west, &wx, 0));
+		IS_TRUE(WindField_get(&east, &wx2, 0));
+		IS_TRUE(near(wx.wind.mag, wx2.wind.mag, EPS));
+		IS_TRUE(nearAngle(wx.wind.angle, wx2.wind.angle, ANGLE_EPS));
+
+		IS_TRUE(WindField_get(&across, &wx2, 0));
+		testWind(30.0, 180.0 - res, &expected);
+		IS_TRUE(wx2.wind.mag > fmin(wx.wind.mag, expected.mag) - EPS);
+		IS_TRUE(wx2.wind.mag < fmax(wx.wind.mag, expected.mag) + EPS);
+
+		IS_TRUE(WindField_get(&beyond, &wx, 0));
+		testWind(30.0, -170.0, &expected);
+		IS_TRUE(near(expected.mag, wx.wind.mag, EPS));
+	}
+
+	// Freed
+	WindField_destroy();
+	IS_FALSE(WindField_get(&p0, &wx, &gustAngle));
+
+	// Invalid resolution
+	IS_TRUE(0 != WindField_build(0.0, &testSource));
+	IS_FALSE(WindField_get(&p0, &wx, &gustAngle));
+
+	return 0;
+}
+
+
+static double testSource(const proteus_GeoPos* pos, proteus_Weather* wx)
+{
+	testWind(pos->lat, pos->lon, &wx->wind);
+	wx->windGust = wx->wind.mag * 1.5;
+
+	return wx->wind.angle;
+}
+
+static void testWind(double lat, double lon, proteus_GeoVec* wind)
+{
+	const double u = 2.0 + 0.1 * lat;
+	const double v = -3.0 + 0.01 * lon + 0.02 * lat;
+
+	wind->mag = sqrt(u * u + v * v);
+	wind->angle = atan2(u, v) * 180.0 / M_PI;
+	if (wind->angle < 0.0)
+	{
+		wind->angle += 360.0;
+	}
+}
+
+static bool near(double a, double b, double eps)
+{
+	return fabs(a - b) <= eps;
+}
+
+static bool nearAngle(double a, double b, double eps)
+{
+	const double d = fabs(a - b);
+	return (d <= eps || fabs(d - 360.0) <= eps);
+}
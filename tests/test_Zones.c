@@ -0,0 +1,161 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tests.h"
+#include "tests_assert.h"
+
+#include "Zones.h"
+#include "Logger.h"
+
+
+static proteus_GeoPos pos(double lat, double lon);
+
+
+int test_Zones()
+{
+	proteus_GeoPos p;
+	proteus_GeoPos v[4];
+
+
+	// Invalid zones
+	v[0] = pos(10.0, 10.0);
+	v[1] = pos(10.0, 11.0);
+	v[2] = pos(11.0, 11.0);
+	IS_TRUE(0 != Zones_add("ZoneRace", "Bad", ZONE_ACTION_STOP, v, 2));
+	IS_TRUE(0 != Zones_add("ZoneRace", "Bad", 7, v, 3));
+	IS_TRUE(0 == Zones_getGroupZones("ZoneRace"));
+	IS_TRUE(0 == Zones_getGroupZones(0));
+
+
+	// Simple square
+	v[3] = pos(11.0, 10.0);
+	IS_TRUE(0 == Zones_add("ZoneRace", "Square", ZONE_ACTION_STOP, v, 4));
+
+	const ZoneSet* zones = Zones_getGroupZones("ZoneRace");
+	IS_TRUE(0 != zones);
+
+	p = pos(10.5, 10.5);
+	const Zone* zone = Zones_find(zones, &p);
+	IS_TRUE(0 != zone);
+	IS_TRUE(0 == strcmp("Square", Zones_getName(zone)));
+	IS_TRUE(ZONE_ACTION_STOP == Zones_getAction(zone));
+
+	p = pos(10.999, 10.001);
+	IS_TRUE(zone == Zones_find(zones, &p));
+	p = pos(11.001, 10.5);
+	IS_TRUE(0 == Zones_find(zones, &p));
+	p = pos(10.5, 9.999);
+	IS_TRUE(0 == Zones_find(zones, &p));
+
+
+	// Across the antimeridian
+	v[0] = pos(-50.0, 179.0);
+	v[1] = pos(-50.0, -179.0);
+	v[2] = pos(-49.0, -179.0);
+	v[3] = pos(-49.0, 179.0);
+	IS_TRUE(0 == Zones_add("ZoneRace", "Antimeridian", ZONE_ACTION_PENALTY, v, 4));
+
+	p = pos(-49.5, 179.5);
+	IS_TRUE(0 != (zone = Zones_find(zones, &p)));
+	IS_TRUE(ZONE_ACTION_PENALTY == Zones_getAction(zone));
+	p = pos(-49.5, -179.5);
+	IS_TRUE(zone == Zones_find(zones, &p));
+	p = pos(-49.5, 178.5);
+	IS_TRUE(0 == Zones_find(zones, &p));
+	p = pos(-49.5, -178.5);
+	IS_TRUE(0 == Zones_find(zones, &p));
+
+
+	// Detailed star-shaped polygon, where the indexed test must agree with the unindexed one everywhere.
+	const unsigned int STAR_VERTICES = 2000;
+	proteus_GeoPos* star = malloc(STAR_VERTICES * sizeof(proteus_GeoPos));
+	IS_TRUE(0 != star);
+
+	srand(4096);
+	for (unsigned int i = 0; i < STAR_VERTICES; i++)
+	{
+		const double a = 2.0 * M_PI * i / STAR_VERTICES;
+		const double r = ((i % 2 == 0) ? 2.0 : 0.5) + 0.1 * (rand() / (double) RAND_MAX);
+
+		star[i] = pos(30.0 + r * sin(a), -40.0 + r * cos(a));
+	}
+
+	IS_TRUE(0 == Zones_add("StarRace", "Star", ZONE_ACTION_STOP, star, STAR_VERTICES));
+	free(star);
+
+	const ZoneSet* starZones = Zones_getGroupZones("StarRace");
+	IS_TRUE(0 != starZones);
+
+	unsigned int inside = 0;
+	for (unsigned int i = 0; i < 200000; i++)
+	{
+		p = pos(27.8 + 4.4 * (rand() / (double) RAND_MAX), -42.2 + 4.4 * (rand() / (double) RAND_MAX));
+
+		const Zone* found = Zones_find(starZones, &p);
+		IS_TRUE(found == Zones_findExact(starZones, &p));
+
+		if (found)
+		{
+			inside++;
+		}
+	}
+
+	IS_TRUE(inside > 0);
+
+	p = pos(30.0, -40.0);
+	IS_TRUE(0 != Zones_find(starZones, &p));
+
+
+	// Entry events
+	unsigned int evCount;
+	BoatEventEntry* events;
+
+	p = pos(10.5, 10.5);
+	Zones_addEntryEvent("Boat1", Zones_find(zones, &p), 1000);
+	p = pos(-49.5, 179.5);
+	Zones_addEntryEvent("Boat2", Zones_find(zones, &p), 1001);
+
+	events = Zones_takeEvents(&evCount);
+	IS_TRUE(2 == evCount);
+	IS_TRUE(0 == strcmp("Boat1", events[0].boatName));
+	IS_TRUE(BOAT_EVENT_ZONE_STOP == events[0].type);
+	IS_TRUE(0 == strcmp("Square", events[0].ref));
+	IS_TRUE(1000 == events[0].time);
+	IS_TRUE(0 == strcmp("Boat2", events[1].boatName));
+	IS_TRUE(BOAT_EVENT_ZONE_PENALTY == events[1].type);
+	IS_TRUE(0 == strcmp("Antimeridian", events[1].ref));
+	Logger_freeEvents(events, evCount);
+
+	events = Zones_takeEvents(&evCount);
+	IS_TRUE(0 == evCount);
+	free(events);
+
+
+	return 0;
+}
+
+
+static proteus_GeoPos pos(double lat, double lon)
+{
+	proteus_GeoPos p;
+	p.lat = lat;
+	p.lon = lon;
+	return p;
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <string.h>
+
+#include "test_env.h"
+
+
+static bool envGetOcean(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od);
+static void envGetWind(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx);
+static bool envGetWave(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd);
+static bool envIsWater(void* ctx, const proteus_GeoPos* pos);
+static double envGetMagDec(void* ctx, const proteus_GeoPos* pos, time_t t);
+
+
+const BoatEnv TEST_ENV = {
+	.getOcean = &envGetOcean,
+	.getWind = &envGetWind,
+	.getWave = &envGetWave,
+	.isWater = &envIsWater,
+	.getMagDec = &envGetMagDec,
+	.ctx = 0
+};
+
+
+static bool envGetOcean(void* ctx, const proteus_GeoPos* pos, proteus_OceanData* od)
+{
+	(void) ctx;
+	(void) pos;
+	(void) od;
+	return false;
+}
+
+static void envGetWind(void* ctx, const proteus_GeoPos* pos, bool adjustForCurrent, const proteus_OceanData* od, proteus_Weather* wx)
+{
+	(void) ctx;
+	(void) pos;
+	(void) adjustForCurrent;
+	(void) od;
+
+	memset(wx, 0, sizeof(proteus_Weather));
+	wx->wind.angle = 270.0;
+	wx->wind.mag = 8.0;
+	wx->windGust = 10.0;
+}
+
+static bool envGetWave(void* ctx, const proteus_GeoPos* pos, proteus_WaveData* wd)
+{
+	(void) ctx;
+	(void) pos;
+	(void) wd;
+	return false;
+}
+
+static bool envIsWater(void* ctx, const proteus_GeoPos* pos)
+{
+	(void) ctx;
+	return pos->lat < TEST_ENV_COAST_LAT;
+}
+
+static double envGetMagDec(void* ctx, const proteus_GeoPos* pos, time_t t)
+{
+	(void) ctx;
+	(void) pos;
+	(void) t;
+	return 0.0;
+}
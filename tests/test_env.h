@@ -0,0 +1,31 @@
+/**
+ * Copyright (C) 2024 ls4096 <ls4096@8bitbyte.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _test_env_h_
+#define _test_env_h_
+
+#include "Boat.h"
+
+
+// All water south of this latitude (in the synthetic environment)
+#define TEST_ENV_COAST_LAT (45.005)
+
+// Synthetic environment for stepping boats in tests: steady westerly wind, no current or waves, and land to the north
+extern const BoatEnv TEST_ENV;
+
+
+#endif // _test_env_h_
@@ -21,7 +21,54 @@ int test_BoatRegistry_runBasic();
 int test_BoatRegistry_runBasicWithGroups();
 int test_BoatRegistry_runLoad();
 int test_BoatRegistry_runLoadWithBigGroups();
+int test_BoatRegistry_runGroupOps();
 
 int test_WxUtils();
 
+int test_Probes();
+
+int test_Shard();
+
+int test_Router();
+
+int test_Replication();
+
+int test_Proximity();
+
+int test_RaceMarks();
+
+int test_Zones();
+
+int test_FleetTiles();
+
+int test_GhostTrack();
+
+int test_CommandSchedule();
+
+int test_CommandJournal();
+
+int test_CommandCompletion();
+
+int test_InitPhases();
+
+int test_WindField();
+
+int test_Affinity();
+
+int test_Counters();
+
+int test_HttpApi();
+
+int test_SimCore();
+
+int test_Ensemble();
+
+int test_Profiler();
+
+int test_ColdBoat();
+
+int test_BoatRestore();
+
+int test_Handoff();
+
 #endif // _tests_h_
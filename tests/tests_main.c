@@ -25,7 +25,31 @@ static const char* TEST_NAMES[] = {
 	"BoatRegistry_basicWithGroups",
 	"BoatRegistry_load",
 	"BoatRegistry_loadWithBigGroups",
-	"WxUtils"
+	"BoatRegistry_groupOps",
+	"WxUtils",
+	"Probes",
+	"Shard",
+	"Router",
+	"Replication",
+	"Proximity",
+	"RaceMarks",
+	"Zones",
+	"FleetTiles",
+	"GhostTrack",
+	"CommandSchedule",
+	"CommandJournal",
+	"CommandCompletion",
+	"InitPhases",
+	"WindField",
+	"Affinity",
+	"Counters",
+	"HttpApi",
+	"SimCore",
+	"Ensemble",
+	"Profiler",
+	"ColdBoat",
+	"BoatRestore",
+	"Handoff"
 };
 
 static const test_func TEST_FUNCS[] = {
@@ -33,7 +57,31 @@ static const test_func TEST_FUNCS[] = {
 	&test_BoatRegistry_runBasicWithGroups,
 	&test_BoatRegistry_runLoad,
 	&test_BoatRegistry_runLoadWithBigGroups,
-	&test_WxUtils
+	&test_BoatRegistry_runGroupOps,
+	&test_WxUtils,
+	&test_Probes,
+	&test_Shard,
+	&test_Router,
+	&test_Replication,
+	&test_Proximity,
+	&test_RaceMarks,
+	&test_Zones,
+	&test_FleetTiles,
+	&test_GhostTrack,
+	&test_CommandSchedule,
+	&test_CommandJournal,
+	&test_CommandCompletion,
+	&test_InitPhases,
+	&test_WindField,
+	&test_Affinity,
+	&test_Counters,
+	&test_HttpApi,
+	&test_SimCore,
+	&test_Ensemble,
+	&test_Profiler,
+	&test_ColdBoat,
+	&test_BoatRestore,
+	&test_Handoff
 };
 
 int main()
@@ -0,0 +1,180 @@
+#!/bin/sh
+
+# Measures sharded simulation throughput and request routing overhead, against
+# a single unsharded process with the same boats. Boats are restored from a
+# generated boatinit.txt (in a scratch directory, linked to the environment
+# data of the simulator's working directory, which this is to be run from).
+#
+# For each setup (a single process, then N shard processes behind a router),
+# clients send boat data requests and boat commands (each client over its own
+# connection, one request at a time) for a while, and the request throughput
+# and latency are reported, along with the boat iterations per second of tick
+# time (summed over shards). The difference in latency between the two is the
+# cost of routing (an extra hop through the router).
+#
+# Requires python3 (for the clients).
+#
+# Usage: tools/shard_bench.sh [N] [BOATS] [SECONDS] [CLIENTS] [path/to/sailnavsim]
+
+N=${1:-4}
+BOATS=${2:-200000}
+SECS=${3:-20}
+CLIENTS=${4:-16}
+BIN=$(realpath "${5:-./sailnavsim}")
+
+DATA_DIR=$(pwd)
+DIR=$(mktemp -d)
+PIDS=""
+
+cleanup() {
+	[ -n "$PIDS" ] && kill $PIDS 2> /dev/null
+	wait 2> /dev/null
+	rm -rf "$DIR"
+}
+trap cleanup EXIT
+
+for d in wx_data_f006 wx_data_f009 ocean_data wave_data geo_water_data compass_data; do
+	[ -e "$DATA_DIR/$d" ] && ln -s "$DATA_DIR/$d" "$DIR/$d"
+done
+
+awk -v n="$BOATS" 'BEGIN {
+	srand(1);
+	for (i = 0; i < n; i++) {
+		printf("SB%d,%f,%f,0,0\n", i, rand() * 80.0 - 40.0, rand() * 340.0 - 170.0);
+	}
+}' > "$DIR/boatinit.txt"
+
+mkfifo "$DIR/cmds"
+cd "$DIR" || exit 1
+
+# Waits (up to 10 minutes) for a process to have ticked, by its log.
+wait_ticking() {
+	i=0
+	until grep -q "Main: Iter (" "$1" 2> /dev/null; do
+		i=$((i + 1))
+		if [ "$i" -gt 600 ]; then
+			echo "Timed out waiting for $1"
+			exit 1
+		fi
+		sleep 1
+	done
+}
+
+# Runs the clients against a socket, printing requests per second and latency.
+run_clients() {
+	python3 - "$1" "$SECS" "$CLIENTS" "$BOATS" << 'EOF'
+import random, socket, sys, threading, time
+
+path, secs, clients, boats = sys.argv[1], float(sys.argv[2]), int(sys.argv[3]), int(sys.argv[4])
+lat = []
+errs = [0]
+lock = threading.Lock()
+
+def client(seed):
+	rng = random.Random(seed)
+	s = socket.socket(socket.AF_UNIX)
+	s.connect(path)
+	f = s.makefile('rb')
+	mine = []
+	e = 0
+	end = time.time() + secs
+	while time.time() < end:
+		b = rng.randrange(boats)
+		if rng.random() < 0.5:
+			req = 'bd,SB%d\n' % b
+		else:
+			req = 'boatcmd,SB%d,course,%d\n' % (b, rng.randrange(360))
+		t0 = time.perf_counter()
+		s.sendall(req.encode())
+		r = f.readline()
+		mine.append(time.perf_counter() - t0)
+		if not r or r.startswith(b'error') or b'noboat' in r or b'fail' in r:
+			e += 1
+	s.close()
+	with lock:
+		lat.extend(mine)
+		errs[0] += e
+
+threads = [threading.Thread(target=client, args=(i,)) for i in range(clients)]
+for t in threads:
+	t.start()
+for t in threads:
+	t.join()
+
+lat.sort()
+n = len(lat)
+print('requests %d (%d failed): %.0f per second, latency p50 %.3fms, p99 %.3fms' % (n, errs[0], n / secs, lat[n // 2] * 1000.0, lat[(n * 99) // 100] * 1000.0))
+EOF
+}
+
+# Prints boat iterations per second of tick time, summed over the given logs (from "Iter" lines, each tick taking
+# the second less the time until the next one).
+tick_stats() {
+	awk '
+		FNR == 1 {
+			p++;
+		}
+		/Main: Iter \(b=/ {
+			b = $0;
+			sub(/.*\(b=/, "", b);
+			sub(/,.*/, "", b);
+			us = $0;
+			sub(/.*Next in /, "", us);
+			sub(/ us.*/, "", us);
+			busy = 1000000 - us;
+			if (busy > 0) {
+				sum[p] += busy;
+				boats[p] = b;
+				n[p]++;
+			}
+		}
+		END {
+			for (i in n) {
+				total += boats[i] * 1000000.0 / (sum[i] / n[i]);
+				if (sum[i] / n[i] > maxTick) {
+					maxTick = sum[i] / n[i];
+				}
+			}
+			printf("boat iterations per second of tick time %.1fk, longest mean tick %.1fms\n", total / 1000.0, maxTick / 1000.0);
+		}' "$@"
+}
+
+echo "Boats: $BOATS, clients: $CLIENTS, $SECS seconds each"
+
+# Single unsharded process
+"$BIN" --netunix "$DIR/single.sock" > single.log 2>&1 &
+PIDS="$!"
+wait_ticking single.log
+printf "Single process: "
+run_clients "$DIR/single.sock"
+printf "Single process: "
+tick_stats single.log
+kill $PIDS
+wait 2> /dev/null
+PIDS=""
+
+# N shards behind a router
+i=0
+while [ "$i" -lt "$N" ]; do
+	"$BIN" --shard "$i/$N" --netunix "$DIR/shard$i" > "shard$i.log" 2>&1 &
+	PIDS="$PIDS $!"
+	i=$((i + 1))
+done
+
+i=0
+while [ "$i" -lt "$N" ]; do
+	wait_ticking "shard$i.log"
+	i=$((i + 1))
+done
+
+"$BIN" --router "$N" --shardsock "$DIR/shard" --netunix "$DIR/router.sock" > router.log 2>&1 &
+PIDS="$PIDS $!"
+until [ -S "$DIR/router.sock" ]; do
+	sleep 1
+done
+
+printf "%d shards via router: " "$N"
+run_clients "$DIR/router.sock"
+
+printf "%d shards: " "$N"
+tick_stats shard*.log
@@ -0,0 +1,38 @@
+#!/bin/sh
+
+# Measures startup time (loading the weather/ocean/wave/geo/compass data and
+# restoring boats), with the init phases run one after another and then run
+# concurrently, as the average over R runs of each. Run from the simulator's
+# working directory (with its data files and DB).
+#
+# Usage: tools/startup_bench.sh [R] [path/to/sailnavsim]
+
+R=${1:-5}
+BIN=${2:-./sailnavsim}
+
+run() {
+	i=0
+	while [ "$i" -lt "$R" ]; do
+		"$BIN" --initonly --initthreads "$1" 2>&1 < /dev/null | grep "Startup init phases done"
+		i=$((i + 1))
+	done | awk -v threads="$1" '
+		{
+			v = $0;
+			sub(/.*done in /, "", v);
+			sub(/ms.*/, "", v);
+			s = $0;
+			sub(/.*\(/, "", s);
+			sub(/ms for all.*/, "", s);
+			total += v;
+			sum += s;
+			n++;
+		}
+		END {
+			if (n > 0) {
+				printf("Init threads %d: startup %.1fms (phases one after another: %.1fms), average of %d runs\n", threads, total / n, sum / n, n);
+			}
+		}'
+}
+
+run 1
+run 6